@@ -0,0 +1,5 @@
+let x = 9223372036854775807;
+x++;
+print(x);
+let y = -9223372036854775807 - 1;
+print(y / -1);
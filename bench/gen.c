@@ -0,0 +1,221 @@
+/*
+Synthetic workload generator for the benchmarks (make bench).
+
+Writes a valid Eidos program to stdout. The same options and seed always
+give the same program, so timings from different commits are comparable.
+Programs declare their variables up front, divide only by nonzero literals
+and loop a few times per level, so every one compiles and runs to the end.
+
+usage: bench_gen [options]
+    --statements=N      top-level statements (default 1000)
+    --vars=N            distinct variables (default 64)
+    --idents=P          percent of expression leaves that are variables, the rest literals (default 50)
+    --expr-depth=N      deepest expression, in operators (default 3)
+    --nest-depth=N      deepest block nesting of ifs and loops (default 2)
+    --loops=P           percent of statements that are loops, where nesting allows (default 10)
+    --seed=N            random seed (default 1)
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct GenOptions {
+    unsigned long statements;
+    unsigned long vars;
+    unsigned long idents;
+    unsigned long expr_depth;
+    unsigned long nest_depth;
+    unsigned long loops;
+    unsigned long seed;
+} GenOptions;
+
+typedef struct Gen {
+    const GenOptions *options;
+    uint64_t state;
+    unsigned long counters;     // loop counters handed out so far
+} Gen;
+
+/* ===== Helper Functions ===== */
+
+// xorshift64*, the sequence only depends on the seed
+static uint64_t next_random(Gen *g) {
+    g->state ^= g->state >> 12;
+    g->state ^= g->state << 25;
+    g->state ^= g->state >> 27;
+    return g->state * 2685821657736338717ULL;
+}
+
+static unsigned long below(Gen *g, unsigned long n) {
+    return n ? (unsigned long)(next_random(g) >> 11) % n : 0;
+}
+
+static int percent(Gen *g, unsigned long p) {
+    return below(g, 100) < p;
+}
+
+static void indent(int depth) {
+    for (int i = 0; i < depth; i++) {
+        fputs("    ", stdout);
+    }
+}
+
+static void gen_expr(Gen *g, unsigned long depth) {
+    // leaves get likelier the deeper the expression already is
+    if (depth >= g->options->expr_depth || below(g, g->options->expr_depth + 1) < depth) {
+        if (percent(g, g->options->idents)) {
+            printf("v%lu", below(g, g->options->vars));
+        } else {
+            printf("%lu", below(g, 100));
+        }
+        return;
+    }
+
+    switch (below(g, 5)) {
+    case 0:
+        // divisors are nonzero literals, so no program traps
+        fputs("(", stdout);
+        gen_expr(g, depth + 1);
+        printf(" / %lu)", 1 + below(g, 9));
+        break;
+    case 1:
+        fputs("-(", stdout);
+        gen_expr(g, depth + 1);
+        fputs(")", stdout);
+        break;
+    default: {
+        static const char ops[] = "+-*";
+        fputs("(", stdout);
+        gen_expr(g, depth + 1);
+        printf(" %c ", ops[below(g, 3)]);
+        gen_expr(g, depth + 1);
+        fputs(")", stdout);
+        break;
+    }
+    }
+}
+
+static void gen_cond(Gen *g) {
+    static const char *cmps[] = { "<", ">", "<=", ">=", "==", "!=" };
+    gen_expr(g, 1);
+    printf(" %s ", cmps[below(g, 6)]);
+    gen_expr(g, 1);
+}
+
+static void gen_stmt(Gen *g, int depth);
+
+static void gen_block(Gen *g, int depth) {
+    unsigned long n = 1 + below(g, 4);
+    for (unsigned long i = 0; i < n; i++) {
+        gen_stmt(g, depth);
+    }
+}
+
+static void gen_stmt(Gen *g, int depth) {
+    const GenOptions *o = g->options;
+    int can_nest = (unsigned long)depth < o->nest_depth;
+
+    if (can_nest && percent(g, o->loops)) {
+        // a few trips per level keeps nested loops cheap to run
+        unsigned long c = g->counters++;
+        unsigned long trips = 1 + below(g, 4);
+        if (below(g, 2)) {
+            indent(depth);
+            printf("for (i%lu = 0; i%lu < %lu; i%lu++) {\n", c, c, trips, c);
+            gen_block(g, depth + 1);
+            indent(depth);
+            puts("}");
+        } else {
+            indent(depth);
+            printf("let w%lu = 0;\n", c);
+            indent(depth);
+            printf("while (w%lu < %lu) {\n", c, trips);
+            gen_block(g, depth + 1);
+            indent(depth + 1);
+            printf("w%lu++;\n", c);
+            indent(depth);
+            puts("}");
+        }
+        return;
+    }
+
+    if (can_nest && percent(g, 15)) {
+        indent(depth);
+        fputs("if (", stdout);
+        gen_cond(g);
+        puts(") {");
+        gen_block(g, depth + 1);
+        if (below(g, 2)) {
+            indent(depth);
+            puts("} else {");
+            gen_block(g, depth + 1);
+        }
+        indent(depth);
+        puts("}");
+        return;
+    }
+
+    indent(depth);
+    unsigned long kind = below(g, 10);
+    if (kind < 6) {
+        printf("v%lu = ", below(g, o->vars));
+        gen_expr(g, 0);
+        puts(";");
+    } else if (kind < 9) {
+        fputs("print(", stdout);
+        gen_expr(g, 0);
+        puts(");");
+    } else {
+        printf("v%lu%s;\n", below(g, o->vars), below(g, 2) ? "++" : "--");
+    }
+}
+
+static int parse_option(const char *arg, const char *name, unsigned long *value) {
+    size_t len = strlen(name);
+    if (strncmp(arg, name, len) != 0 || arg[len] != '=') {
+        return 0;
+    }
+    char *end;
+    *value = strtoul(arg + len + 1, &end, 10);
+    if (arg[len + 1] < '0' || arg[len + 1] > '9' || *end != '\0') {
+        fprintf(stderr, "ERROR: Bad value in '%s'.\n", arg);
+        exit(1);
+    }
+    return 1;
+}
+
+
+/* ========== MAIN ========== */
+
+int main(int argc, char **argv) {
+    GenOptions o = { 1000, 64, 50, 3, 2, 10, 1 };
+
+    for (int i = 1; i < argc; i++) {
+        if (!parse_option(argv[i], "--statements", &o.statements) &&
+            !parse_option(argv[i], "--vars", &o.vars) &&
+            !parse_option(argv[i], "--idents", &o.idents) &&
+            !parse_option(argv[i], "--expr-depth", &o.expr_depth) &&
+            !parse_option(argv[i], "--nest-depth", &o.nest_depth) &&
+            !parse_option(argv[i], "--loops", &o.loops) &&
+            !parse_option(argv[i], "--seed", &o.seed)) {
+            fprintf(stderr, "ERROR: Unknown option '%s'.\n", argv[i]);
+            fprintf(stderr, "usage: bench_gen [--statements=N] [--vars=N] [--idents=P] [--expr-depth=N]\n"
+                            "                 [--nest-depth=N] [--loops=P] [--seed=N]\n");
+            return 1;
+        }
+    }
+    if (o.vars == 0) {
+        o.vars = 1;
+    }
+
+    Gen g = { &o, (o.seed + 1) * 0x9E3779B97F4A7C15ULL, 0 };
+
+    for (unsigned long v = 0; v < o.vars; v++) {
+        printf("let v%lu = %lu;\n", v, below(&g, 100));
+    }
+    for (unsigned long s = 0; s < o.statements; s++) {
+        gen_stmt(&g, 0);
+    }
+    return fflush(stdout) != 0;
+}
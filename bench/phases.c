@@ -0,0 +1,493 @@
+/*
+Phase-level compiler benchmark (make bench).
+
+Runs every phase of the pipeline over each input, one after another, the way
+`eidos` does, and reports per phase:
+
+- wall time (best of --repeat runs)
+- throughput as source bytes, tokens and AST nodes per second, the counts
+  being those of the whole input, so phases are comparable with each other
+- allocations and bytes allocated, counted by the allocator of a libeidos
+  context the phases run under
+- the most memory live in the context during the phase, and the process'
+  peak RSS once it is done
+
+Phases: read, lex (the token stream on its own), parse (pulls its tokens from
+the lexer, so it includes lexing again), sema, fold, unroll, pe, hashcons,
+ir_build, ir_passes, emit_c and bytecode. pe runs on a copy of the tree:
+precomputing a read-free program leaves nothing for the later phases, which
+therefore see the program as --run and --dump-ir do.
+
+Results go to stdout as JSON, a table to stderr.
+
+--scaling=SMALL,LARGE names two of the inputs, the same kind of program at
+two sizes. Each phase's time per byte on LARGE is divided by its time per
+byte on SMALL and recorded in the JSON. If a phase grows by more than
+SCALING_LIMIT, it is reported and the exit status is 1. A linear phase
+stays near 1, whatever the machine. A phase that goes quadratic on large
+inputs shows up here before anyone has to read the timings.
+
+usage: bench_phases [--repeat=N] [--label=TEXT] [--scaling=SMALL,LARGE] file.e...
+*/
+
+#include "../src/util/context.h"
+#include "../src/lexer/lexer.h"
+#include "../src/parser/parser.h"
+#include "../src/semantic/sema.h"
+#include "../src/optimizer/fold.h"
+#include "../src/optimizer/unroll.h"
+#include "../src/optimizer/partial_eval.h"
+#include "../src/optimizer/hashcons.h"
+#include "../src/ir/ir.h"
+#include "../src/ir/passes.h"
+#include "../src/codegen/c_backend.h"
+#include "../src/bytecode/bytecode.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+// most a phase's time per byte may grow from the small input to the large one
+#define SCALING_LIMIT 2.5
+// phases quicker than this on the small input are too noisy to compare
+#define SCALING_MIN_SECONDS 0.002
+
+typedef enum PhaseId {
+    PHASE_READ,
+    PHASE_LEX,
+    PHASE_PARSE,
+    PHASE_SEMA,
+    PHASE_FOLD,
+    PHASE_UNROLL,
+    PHASE_PE,
+    PHASE_HASHCONS,
+    PHASE_IR_BUILD,
+    PHASE_IR_PASSES,
+    PHASE_EMIT_C,
+    PHASE_BYTECODE,
+    PHASE_COUNT,
+} PhaseId;
+
+static const char *phase_names[PHASE_COUNT] = {
+    "read", "lex", "parse", "sema", "fold", "unroll", "pe", "hashcons",
+    "ir_build", "ir_passes", "emit_c", "bytecode",
+};
+
+typedef struct Phase {
+    double seconds;             // best run
+    size_t allocations;
+    size_t allocated_bytes;
+    size_t peak_live_bytes;     // most memory live in the context during the phase
+    long peak_rss_kib;          // process peak RSS after the phase
+} Phase;
+
+typedef struct Workload {
+    const char *path;
+    size_t bytes;
+    size_t tokens;
+    size_t nodes;               // AST nodes right after parsing
+    Phase phases[PHASE_COUNT];
+} Workload;
+
+// allocator that counts everything handed out
+typedef struct Counter {
+    size_t allocations;
+    size_t bytes;
+} Counter;
+
+// a phase being measured
+typedef struct Clock {
+    EidosContext *ctx;
+    Counter *counter;
+    double start;
+    size_t allocations;
+    size_t bytes;
+} Clock;
+
+/* ===== Helper Functions ===== */
+
+static void *counting_alloc(void *user, size_t size) {
+    Counter *c = user;
+    c->allocations++;
+    c->bytes += size;
+    return malloc(size);
+}
+
+static void counting_release(void *user, void *ptr, size_t size) {
+    (void)user;
+    (void)size;
+    free(ptr);
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void phase_begin(Clock *clock) {
+    clock->ctx->peak_bytes = clock->ctx->live_bytes;
+    clock->allocations = clock->counter->allocations;
+    clock->bytes = clock->counter->bytes;
+    clock->start = now();
+}
+
+/*
+Ends the phase started by phase_begin and records it, keeping the best time
+
+args:
+    *clock (Clock) -> the running measurement
+    *phase (Phase) -> where the results go
+    first (int) -> 1 on the first run, which also records memory
+*/
+static void phase_end(Clock *clock, Phase *phase, int first) {
+    double seconds = now() - clock->start;
+    if (first || seconds < phase->seconds) {
+        phase->seconds = seconds;
+    }
+    if (first) {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        phase->allocations = clock->counter->allocations - clock->allocations;
+        phase->allocated_bytes = clock->counter->bytes - clock->bytes;
+        phase->peak_live_bytes = clock->ctx->peak_bytes;
+        phase->peak_rss_kib = usage.ru_maxrss;
+    }
+}
+
+static char *read_source(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    rewind(f);
+
+    char *buffer = eidos_malloc((size_t)len + 1);
+    if (!buffer || fread(buffer, 1, (size_t)len, f) != (size_t)len) {
+        fprintf(stderr, "Error: Failed to read %s\n", path);
+        exit(1);
+    }
+    buffer[len] = '\0';
+    fclose(f);
+
+    *size = (size_t)len;
+    return buffer;
+}
+
+/*
+Runs the whole pipeline over one input once
+
+args:
+    *w (Workload) -> input and results
+    *clock (Clock) -> context and counters
+    first (int) -> 1 on the first run
+*/
+static void run_pipeline(Workload *w, Clock *clock, int first) {
+    Phase *p = w->phases;
+
+    phase_begin(clock);
+    char *source = read_source(w->path, &w->bytes);
+    phase_end(clock, &p[PHASE_READ], first);
+
+    phase_begin(clock);
+    Lexer lexer;
+    init_lexer(&lexer, source);
+    size_t tokens = 0;
+    Token tok;
+    do {
+        tok = next_token(&lexer);
+        eidos_free((void*)tok.lexeme);
+        tokens++;
+    } while (tok.tokenType != EOF_TOK);
+    phase_end(clock, &p[PHASE_LEX], first);
+    w->tokens = tokens;
+
+    phase_begin(clock);
+    init_lexer(&lexer, source);
+    Parser *parser = parser_init(&lexer);
+    ASTNode *program = parse_program(parser);
+    parser_free(parser);
+    phase_end(clock, &p[PHASE_PARSE], first);
+    w->nodes = ast_count_nodes(program);
+
+    phase_begin(clock);
+    if (sema_check(program)) {
+        fprintf(stderr, "Error: %s has semantic errors\n", w->path);
+        exit(1);
+    }
+    phase_end(clock, &p[PHASE_SEMA], first);
+
+    phase_begin(clock);
+    FoldStats fold_stats = {0};
+    fold_program(program, &fold_stats);
+    phase_end(clock, &p[PHASE_FOLD], first);
+    if (fold_stats.errors) {
+        fprintf(stderr, "Error: %s divides by a constant zero\n", w->path);
+        exit(1);
+    }
+
+    phase_begin(clock);
+    UnrollOptions unroll_options;
+    unroll_default_options(&unroll_options);
+    UnrollStats unroll_stats = {0};
+    unroll_program(program, &unroll_options, &unroll_stats);
+    phase_end(clock, &p[PHASE_UNROLL], first);
+
+    ASTNode *copy = ast_clone(program);
+    phase_begin(clock);
+    PEOptions pe_options;
+    pe_default_options(&pe_options);
+    PEResult pe_result = {0};
+    pe_program(copy, &pe_options, &pe_result);
+    phase_end(clock, &p[PHASE_PE], first);
+    free(pe_result.output);
+    ast_free(copy);
+
+    phase_begin(clock);
+    HashConsStats hashcons_stats = {0};
+    hashcons_program(program, &hashcons_stats);
+    phase_end(clock, &p[PHASE_HASHCONS], first);
+
+    phase_begin(clock);
+    IRFunction *fn = ir_build(program);
+    phase_end(clock, &p[PHASE_IR_BUILD], first);
+    if (!fn) {
+        fprintf(stderr, "Error: %s failed to lower\n", w->path);
+        exit(1);
+    }
+
+    phase_begin(clock);
+    IRPassManager pm;
+    ir_pm_init_default(&pm);
+    ir_pm_run(&pm, fn);
+    phase_end(clock, &p[PHASE_IR_PASSES], first);
+
+    FILE *sink = fopen("/dev/null", "w");
+    if (!sink) {
+        perror("/dev/null");
+        exit(1);
+    }
+
+    phase_begin(clock);
+    CEmitOptions c_options = { w->path, NULL, 0, 0, 0, 1 };
+    c_emit_program(fn, &c_options, sink);
+    fflush(sink);
+    phase_end(clock, &p[PHASE_EMIT_C], first);
+
+    phase_begin(clock);
+    bc_write_image(fn, NULL, 0, 1, NULL, sink);
+    fflush(sink);
+    phase_end(clock, &p[PHASE_BYTECODE], first);
+
+    fclose(sink);
+    ir_free_function(fn);
+    ast_free(program);
+    eidos_free(source);
+}
+
+static double per_second(size_t count, double seconds) {
+    return seconds > 0 ? (double)count / seconds : 0;
+}
+
+static void print_json_string(const char *s, FILE *out) {
+    fputc('"', out);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            fprintf(out, "\\%c", *s);
+        } else if ((unsigned char)*s < 32) {
+            fprintf(out, "\\u%04x", (unsigned char)*s);
+        } else {
+            fputc(*s, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/*
+Compares a phase's time per byte on two sizes of the same kind of program
+
+args:
+    *small (Workload) -> the smaller input
+    *large (Workload) -> the larger one
+    k (int) -> phase
+
+returns:
+    (double) -> large's time per byte over small's, 0 if the phase is too quick to tell
+*/
+static double growth(const Workload *small, const Workload *large, int k) {
+    double s = small->phases[k].seconds;
+    double l = large->phases[k].seconds;
+    if (s < SCALING_MIN_SECONDS || !small->bytes || !large->bytes) {
+        return 0;
+    }
+    return (l / (double)large->bytes) / (s / (double)small->bytes);
+}
+
+static void print_json(const Workload *workloads, size_t count, const char *label, unsigned long repeat,
+                       const Workload *small, const Workload *large, FILE *out) {
+    fputs("{\n  \"label\": ", out);
+    print_json_string(label, out);
+    fprintf(out, ",\n  \"repeat\": %lu,\n  \"workloads\": [\n", repeat);
+
+    for (size_t i = 0; i < count; i++) {
+        const Workload *w = &workloads[i];
+        fputs("    {\n      \"file\": ", out);
+        print_json_string(w->path, out);
+        fprintf(out, ",\n      \"bytes\": %zu,\n      \"tokens\": %zu,\n      \"nodes\": %zu,\n"
+                     "      \"phases\": [\n", w->bytes, w->tokens, w->nodes);
+
+        for (int k = 0; k < PHASE_COUNT; k++) {
+            const Phase *p = &w->phases[k];
+            fprintf(out, "        {\"phase\": \"%s\", \"seconds\": %.9f, \"bytes_per_sec\": %.0f, "
+                         "\"tokens_per_sec\": %.0f, \"nodes_per_sec\": %.0f, \"allocations\": %zu, "
+                         "\"allocated_bytes\": %zu, \"peak_live_bytes\": %zu, \"peak_rss_kib\": %ld}%s\n",
+                    phase_names[k], p->seconds, per_second(w->bytes, p->seconds),
+                    per_second(w->tokens, p->seconds), per_second(w->nodes, p->seconds),
+                    p->allocations, p->allocated_bytes, p->peak_live_bytes, p->peak_rss_kib,
+                    k + 1 < PHASE_COUNT ? "," : "");
+        }
+        fprintf(out, "      ]\n    }%s\n", i + 1 < count ? "," : "");
+    }
+    fputs("  ]", out);
+
+    if (small) {
+        fputs(",\n  \"scaling\": {\n    \"small\": ", out);
+        print_json_string(small->path, out);
+        fputs(",\n    \"large\": ", out);
+        print_json_string(large->path, out);
+        fprintf(out, ",\n    \"limit\": %.1f,\n    \"growth\": {", SCALING_LIMIT);
+        for (int k = 0; k < PHASE_COUNT; k++) {
+            double g = growth(small, large, k);
+            fprintf(out, "%s\"%s\": ", k ? ", " : "", phase_names[k]);
+            if (g > 0) {
+                fprintf(out, "%.2f", g);
+            } else {
+                fputs("null", out);
+            }
+        }
+        fputs("}\n  }", out);
+    }
+    fputs("\n}\n", out);
+}
+
+static void print_table(const Workload *w, FILE *out) {
+    fprintf(out, "%s: %zu bytes, %zu tokens, %zu nodes\n", w->path, w->bytes, w->tokens, w->nodes);
+    fprintf(out, "  %-10s %10s %12s %12s %12s %10s %12s\n",
+            "phase", "ms", "MB/s", "Mtokens/s", "Mnodes/s", "allocs", "peak KiB");
+    for (int k = 0; k < PHASE_COUNT; k++) {
+        const Phase *p = &w->phases[k];
+        fprintf(out, "  %-10s %10.3f %12.2f %12.2f %12.2f %10zu %12zu\n", phase_names[k],
+                p->seconds * 1e3, per_second(w->bytes, p->seconds) / 1e6,
+                per_second(w->tokens, p->seconds) / 1e6, per_second(w->nodes, p->seconds) / 1e6,
+                p->allocations, p->peak_live_bytes / 1024);
+    }
+}
+
+
+/* ========== MAIN ========== */
+
+int main(int argc, char **argv) {
+    unsigned long repeat = 5;
+    const char *label = "";
+    const char *scaling = NULL;
+    Workload *workloads = calloc((size_t)argc, sizeof(Workload));
+    size_t count = 0;
+
+    if (!workloads) {
+        fprintf(stderr, "Error: Failed to allocate workloads\n");
+        return 1;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--repeat=", 9) == 0) {
+            char *end;
+            repeat = strtoul(argv[i] + 9, &end, 10);
+            if (*end != '\0' || repeat == 0) {
+                fprintf(stderr, "ERROR: Bad value in '%s'.\n", argv[i]);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--label=", 8) == 0) {
+            label = argv[i] + 8;
+        } else if (strncmp(argv[i], "--scaling=", 10) == 0) {
+            scaling = argv[i] + 10;
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "ERROR: Unknown option '%s'.\n", argv[i]);
+            fprintf(stderr, "usage: bench_phases [--repeat=N] [--label=TEXT] [--scaling=SMALL,LARGE] file.e...\n");
+            return 1;
+        } else {
+            workloads[count++].path = argv[i];
+        }
+    }
+    if (count == 0) {
+        fprintf(stderr, "usage: bench_phases [--repeat=N] [--label=TEXT] [--scaling=SMALL,LARGE] file.e...\n");
+        return 1;
+    }
+
+    // the two inputs --scaling compares, by path
+    Workload *small = NULL;
+    Workload *large = NULL;
+    if (scaling) {
+        const char *comma = strchr(scaling, ',');
+        for (size_t i = 0; comma && i < count; i++) {
+            const char *path = workloads[i].path;
+            if (strlen(path) == (size_t)(comma - scaling) && strncmp(path, scaling, strlen(path)) == 0) {
+                small = &workloads[i];
+            } else if (strcmp(path, comma + 1) == 0) {
+                large = &workloads[i];
+            }
+        }
+        if (!small || !large) {
+            fprintf(stderr, "ERROR: --scaling needs two of the input files, got '%s'.\n", scaling);
+            return 1;
+        }
+    }
+
+    // every phase allocates through a context, which counts and tracks the live bytes
+    Counter counter = {0};
+    EidosAllocator allocator = { counting_alloc, counting_release, &counter };
+    EidosContext *ctx = eidos_context_new(&allocator);
+    if (!ctx) {
+        fprintf(stderr, "Error: Failed to create context\n");
+        return 1;
+    }
+    eidos_context_enter(ctx);
+
+    Clock clock = { ctx, &counter, 0, 0, 0 };
+    for (size_t i = 0; i < count; i++) {
+        for (unsigned long r = 0; r < repeat; r++) {
+            run_pipeline(&workloads[i], &clock, r == 0);
+        }
+        print_table(&workloads[i], stderr);
+    }
+
+    eidos_context_enter(NULL);
+    eidos_context_free(ctx);
+
+    int failed = 0;
+    if (small) {
+        fprintf(stderr, "scaling %s -> %s, time per byte:", small->path, large->path);
+        for (int k = 0; k < PHASE_COUNT; k++) {
+            double g = growth(small, large, k);
+            if (g > 0) {
+                fprintf(stderr, " %s %.2f", phase_names[k], g);
+            }
+        }
+        fputs("\n", stderr);
+        for (int k = 0; k < PHASE_COUNT; k++) {
+            double g = growth(small, large, k);
+            if (g > SCALING_LIMIT) {
+                fprintf(stderr, "bench_phases: %s takes %.1f times as long per byte on %s as on %s (limit %.1f)\n",
+                        phase_names[k], g, large->path, small->path, SCALING_LIMIT);
+                failed = 1;
+            }
+        }
+    }
+
+    print_json(workloads, count, label, repeat, small, large, stdout);
+    free(workloads);
+    return (fflush(stdout) != 0) | failed;
+}
@@ -0,0 +1,253 @@
+/*
+Scheduler benchmark (bench_sched.sh).
+
+Spawns thousands of bytecode programs on the scheduler (driver/sched.h) at
+once and waits for all of them. Three kinds, by their index:
+
+- spin (1 in 100): `while (1 < 2)`, ends when --max-steps runs out
+- echo (1 in 5): reads a count, then that many numbers, printing the
+  running total after each; the numbers are fed one round at a time while
+  everything runs, so these block in read() over and over
+- sum (the rest): reads n, all of it there from the start, and sums 0..n-1,
+  n being anywhere from 1000 to 100000
+
+Reports throughput (programs and instructions per second) and, per kind, the
+latency from spawn to finish: p50, p99, p99.9 and max. Every output is
+checked. --slice=0 runs each program to its end once it starts, which is
+what a worker pool without the scheduler does.
+
+usage: bench_sched [--programs=N] [--threads=N] [--slice=N] [--max-steps=N]
+*/
+
+#include "../src/lib/eidos.h"
+#include "../src/driver/sched.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// numbers each echo program reads after its count
+#define ECHO_ROUNDS 8
+
+typedef enum Kind {
+    KIND_SUM,
+    KIND_ECHO,
+    KIND_SPIN,
+    KIND_COUNT,
+} Kind;
+
+static const char *kind_names[KIND_COUNT] = { "sum", "echo", "spin" };
+
+static const char *sources[KIND_COUNT] = {
+    "let n = 0;\n"
+    "read(n);\n"
+    "let s = 0;\n"
+    "for (i = 0; i < n; i++) {\n"
+    "    s = s + i;\n"
+    "}\n"
+    "print(s);\n",
+
+    "let k = 0;\n"
+    "read(k);\n"
+    "let total = 0;\n"
+    "let x = 0;\n"
+    "for (i = 0; i < k; i++) {\n"
+    "    read(x);\n"
+    "    total = total + x;\n"
+    "    print(total);\n"
+    "}\n",
+
+    "let x = 0;\n"
+    "while (1 < 2) {\n"
+    "    x = x + 1;\n"
+    "}\n",
+};
+
+typedef struct Program {
+    Kind kind;
+    int64_t n;                  // sum: its n; echo: first number fed
+    SchedTask *task;
+} Program;
+
+static double now_millis(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, size_t n, double p) {
+    size_t rank = (size_t)(p * (double)n + 0.999999);
+    return sorted[rank ? rank - 1 : 0];
+}
+
+// compiles one of the sources to an image, malloc'd
+static char *compile_image(const char *source, size_t *len) {
+    EidosContext *ctx = eidos_context_new(NULL);
+    EidosOptions options;
+    eidos_default_options(&options);
+    options.target = EIDOS_TARGET_IMAGE;
+    if (!ctx || eidos_compile(ctx, source, strlen(source), &options) != EIDOS_OK) {
+        fprintf(stderr, "bench_sched: failed to compile:\n%s%s", source, ctx ? eidos_diagnostics(ctx) : "");
+        exit(1);
+    }
+    const char *output = eidos_output(ctx, len);
+    char *image = malloc(*len);
+    memcpy(image, output, *len);
+    eidos_context_free(ctx);
+    return image;
+}
+
+// 1 if a finished program printed and ended the way it should have
+static int check(const Program *p) {
+    const SchedTask *t = p->task;
+    char expected[512];
+    size_t len = 0;
+    switch (p->kind) {
+    case KIND_SUM:
+        len = (size_t)snprintf(expected, sizeof(expected), "%" PRId64 "\n", p->n * (p->n - 1) / 2);
+        return t->result == SCHED_DONE && t->output_len == len && memcmp(t->output, expected, len) == 0;
+    case KIND_ECHO: {
+        int64_t total = 0;
+        for (int64_t r = 0; r < ECHO_ROUNDS; r++) {
+            total += p->n + r;
+            len += (size_t)snprintf(expected + len, sizeof(expected) - len, "%" PRId64 "\n", total);
+        }
+        return t->result == SCHED_DONE && t->output_len == len && memcmp(t->output, expected, len) == 0;
+    }
+    default:
+        return t->result == SCHED_STOPPED && t->output_len == 0;
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t nprograms = 10000;
+    SchedOptions options = { 0, SCHED_SLICE, 20000000, 0, NULL };
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--programs=", 11) == 0) {
+            nprograms = strtoull(argv[i] + 11, NULL, 10);
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            options.threads = strtoull(argv[i] + 10, NULL, 10);
+        } else if (strncmp(argv[i], "--slice=", 8) == 0) {
+            options.slice = strtoull(argv[i] + 8, NULL, 10);
+        } else if (strncmp(argv[i], "--max-steps=", 12) == 0) {
+            options.max_steps = strtoull(argv[i] + 12, NULL, 10);
+        } else {
+            fprintf(stderr, "usage: bench_sched [--programs=N] [--threads=N] [--slice=N] [--max-steps=N]\n");
+            return 1;
+        }
+    }
+    if (!options.max_steps) {
+        fprintf(stderr, "bench_sched: the spin programs need --max-steps\n");
+        return 1;
+    }
+
+    char *images[KIND_COUNT];
+    size_t image_lens[KIND_COUNT];
+    for (int k = 0; k < KIND_COUNT; k++) {
+        images[k] = compile_image(sources[k], &image_lens[k]);
+    }
+
+    Program *programs = calloc(nprograms, sizeof(Program));
+    size_t counts[KIND_COUNT] = { 0 };
+    uint64_t seed = 0x2545f4914f6cdd1dULL;
+    for (size_t i = 0; i < nprograms; i++) {
+        Program *p = &programs[i];
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        if (i % 100 == 0) {
+            p->kind = KIND_SPIN;
+        } else if (i % 5 == 1) {
+            p->kind = KIND_ECHO;
+            p->n = (int64_t)i;
+        } else {
+            p->kind = KIND_SUM;
+            p->n = 1000 + (int64_t)((seed >> 33) % 99001);
+        }
+        counts[p->kind]++;
+    }
+
+    Sched *s = sched_start(&options);
+    if (!s) {
+        fprintf(stderr, "bench_sched: failed to start the scheduler\n");
+        return 1;
+    }
+    double start = now_millis();
+    for (size_t i = 0; i < nprograms; i++) {
+        Program *p = &programs[i];
+        char input[32];
+        int len = 0;
+        if (p->kind == KIND_SUM) {
+            len = snprintf(input, sizeof(input), "%" PRId64 "\n", p->n);
+        } else if (p->kind == KIND_ECHO) {
+            len = snprintf(input, sizeof(input), "%d\n", ECHO_ROUNDS);
+        }
+        // echo programs get the rest of their input below, spin programs none
+        p->task = sched_spawn(s, images[p->kind], image_lens[p->kind], input, (size_t)len,
+                              p->kind != KIND_ECHO, NULL, NULL);
+        if (!p->task) {
+            return 1;
+        }
+    }
+    for (int64_t r = 0; r < ECHO_ROUNDS; r++) {
+        for (size_t i = 0; i < nprograms; i++) {
+            if (programs[i].kind == KIND_ECHO) {
+                char input[32];
+                int len = snprintf(input, sizeof(input), "%" PRId64 "\n", programs[i].n + r);
+                sched_feed(s, programs[i].task, input, (size_t)len);
+            }
+        }
+    }
+    sched_wait(s);
+    double wall = now_millis() - start;
+
+    SchedStats stats;
+    sched_stats(s, &stats);
+    sched_stop(s);
+
+    uint64_t instructions = 0;
+    size_t wrong = 0;
+    double *latency[KIND_COUNT];
+    size_t nlatency[KIND_COUNT] = { 0 };
+    for (int k = 0; k < KIND_COUNT; k++) {
+        latency[k] = malloc((counts[k] ? counts[k] : 1) * sizeof(double));
+    }
+    for (size_t i = 0; i < nprograms; i++) {
+        Program *p = &programs[i];
+        instructions += p->task->vm.executed;
+        latency[p->kind][nlatency[p->kind]++] = p->task->finished - p->task->spawned;
+        if (!check(p)) {
+            wrong++;
+        }
+        sched_task_free(p->task);
+    }
+
+    printf("%zu programs (%zu sum, %zu echo, %zu spin) on %zu threads, slice %" PRIu64 ", max steps %" PRIu64 "\n",
+           nprograms, counts[KIND_SUM], counts[KIND_ECHO], counts[KIND_SPIN], stats.threads,
+           options.slice, options.max_steps);
+    printf("wall %.1f ms: %.0f programs/s, %.1f M instructions/s, %" PRIu64 " slices, longest wait for a slice %.2f ms\n",
+           wall, nprograms / (wall / 1e3), instructions / (wall / 1e3) / 1e6, stats.slices, stats.max_wait);
+    printf("%-6s %10s %10s %10s %10s   (latency, ms from spawn to finish)\n", "kind", "p50", "p99", "p99.9", "max");
+    for (int k = 0; k < KIND_COUNT; k++) {
+        size_t n = nlatency[k];
+        if (n) {
+            qsort(latency[k], n, sizeof(double), compare_doubles);
+            printf("%-6s %10.2f %10.2f %10.2f %10.2f\n", kind_names[k], percentile(latency[k], n, 0.50),
+                   percentile(latency[k], n, 0.99), percentile(latency[k], n, 0.999), latency[k][n - 1]);
+        }
+        free(latency[k]);
+    }
+    if (wrong) {
+        printf("%zu programs printed the wrong output\n", wrong);
+    }
+
+    for (int k = 0; k < KIND_COUNT; k++) {
+        free(images[k]);
+    }
+    free(programs);
+    return wrong ? 1 : 0;
+}
@@ -0,0 +1,65 @@
+#!/bin/bash
+
+# Compares executed IR operations and bytecode run time with and without the
+# inliner on the function call programs in bench_codes/
+
+N=${1:-200}
+VM_N=${2:-2000}
+
+mkdir -p logs
+
+echo "Building project..."
+make > logs/make.log 2>&1
+if [ $? -ne 0 ]; then
+    echo "Build failed! Check logs/make.log"
+    exit 1
+fi
+
+EXECUTABLE="./eidos"
+NO_INLINE="copyprop,sccp,unreachable,copyprop,copyprop,sccp,unreachable,licm,strength,copyprop,sccp,licm,dse"
+
+# pulls "<instructions> <calls>" out of a --stats report
+count_ops() {
+    awk '/^run:/ { insts = $2 } /^run ops:/ { for (i = 3; i < NF; i += 2) if ($i == "call") calls = $(i + 1) }
+         END { printf "%s %s", insts, (calls == "" ? 0 : calls) }' "$1"
+}
+
+# milliseconds `eidos run` takes on an image, reading VM_N
+time_image() {
+    local start end
+    start=$(date +%s%N)
+    echo "$VM_N" | $EXECUTABLE run "$1" > "$2"
+    end=$(date +%s%N)
+    echo $(( (end - start) / 1000000 ))
+}
+
+printf "%-18s %11s %11s %12s %12s %8s %9s %9s\n" "program (n=$N)" "calls base" "calls inl" \
+       "insts base" "insts inl" "saved" "vm ms" "vm ms inl"
+
+STATUS=0
+for program in bench_codes/calls_*.e; do
+    name=$(basename "$program")
+
+    echo "$N" | $EXECUTABLE --run --stats --passes=$NO_INLINE "$program" > logs/bench_base.out 2> logs/bench_base.err
+    echo "$N" | $EXECUTABLE --run --stats "$program" > logs/bench_inline.out 2> logs/bench_inline.err
+    $EXECUTABLE compile --passes=$NO_INLINE "$program" -o logs/bench_base.eidb
+    $EXECUTABLE compile "$program" -o logs/bench_inline.eidb
+    base_ms=$(time_image logs/bench_base.eidb logs/bench_base_vm.out)
+    inline_ms=$(time_image logs/bench_inline.eidb logs/bench_inline_vm.out)
+
+    if ! diff -q logs/bench_base.out logs/bench_inline.out > /dev/null ||
+       ! diff -q logs/bench_base_vm.out logs/bench_inline_vm.out > /dev/null; then
+        echo "$name: output differs between pipelines"
+        STATUS=1
+        continue
+    fi
+
+    read base_insts base_calls <<< "$(count_ops logs/bench_base.err)"
+    read inline_insts inline_calls <<< "$(count_ops logs/bench_inline.err)"
+    saved=$(awk -v a="$base_insts" -v b="$inline_insts" 'BEGIN { printf "%.1f%%", 100 * (a - b) / a }')
+
+    printf "%-18s %11s %11s %12s %12s %8s %9s %9s\n" "$name" "$base_calls" "$inline_calls" \
+           "$base_insts" "$inline_insts" "$saved" "$base_ms" "$inline_ms"
+done
+
+exit $STATUS
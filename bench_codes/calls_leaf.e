@@ -0,0 +1,19 @@
+fn sq(x) {
+    return x * x;
+}
+
+fn clamp(x, lo, hi) {
+    r = x;
+    if (x < lo) { r = lo; }
+    if (x > hi) { r = hi; }
+    return r;
+}
+
+read(n);
+let total = 0;
+for (i = 0; i < n; i++) {
+    for (j = 0; j < n; j++) {
+        total = total + clamp(sq(i - j), 0, 1000);
+    }
+}
+print(total);
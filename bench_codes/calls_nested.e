@@ -0,0 +1,22 @@
+fn mid(a, b) {
+    return (a + b) / 2;
+}
+
+fn dist(a, b) {
+    d = a - b;
+    if (d < 0) { d = 0 - d; }
+    return d;
+}
+
+fn score(a, b) {
+    return dist(a, mid(a, b)) + dist(b, mid(a, b));
+}
+
+read(n);
+let total = 0;
+for (i = 0; i < n; i++) {
+    for (j = 0; j < n; j++) {
+        total = total + score(i, j * 3);
+    }
+}
+print(total);
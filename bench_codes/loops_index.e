@@ -0,0 +1,10 @@
+read(n);
+let stride = n + 1;
+let sum = 0;
+for (row = 0; row < n; row++) {
+    for (col = 0; col < n; col++) {
+        let idx = row * stride + col * 4;
+        sum = sum + idx;
+    }
+}
+print(sum);
@@ -0,0 +1,10 @@
+read(n);
+let w = n + 7;
+let total = 0;
+for (i = 0; i < n; i++) {
+    for (j = 0; j < n; j++) {
+        let scale = w * w - n;
+        total = total + scale / 3 + j;
+    }
+}
+print(total);
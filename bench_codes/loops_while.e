@@ -0,0 +1,13 @@
+read(n);
+let base = n * 3;
+let acc = 0;
+let i = 0;
+while (i < n) {
+    let j = 0;
+    while (j < n) {
+        acc = acc + i * base + (base + 1) * j;
+        j++;
+    }
+    i++;
+}
+print(acc);
@@ -0,0 +1,48 @@
+#!/bin/bash
+
+# Compares executed IR operations with and without the loop passes
+# (licm, strength) on the programs in bench_codes/
+
+N=${1:-200}
+
+mkdir -p logs
+
+echo "Building project..."
+make > logs/make.log 2>&1
+if [ $? -ne 0 ]; then
+    echo "Build failed! Check logs/make.log"
+    exit 1
+fi
+
+EXECUTABLE="./eidos"
+NO_LOOP_PASSES="copyprop,sccp,unreachable,copyprop,dse"
+
+# pulls "<instructions> <muls>" out of a --stats report
+count_ops() {
+    awk '/^run:/ { insts = $2 } /^run ops:/ { for (i = 3; i < NF; i += 2) if ($i == "mul") muls = $(i + 1) }
+         END { printf "%s %s", insts, (muls == "" ? 0 : muls) }' "$1"
+}
+
+printf "%-22s %12s %12s %8s %10s %10s\n" "program (n=$N)" "insts base" "insts loop" "saved" "mul base" "mul loop"
+
+STATUS=0
+for program in bench_codes/loops_*.e; do
+    name=$(basename "$program")
+
+    echo "$N" | $EXECUTABLE --run --stats --passes=$NO_LOOP_PASSES "$program" > logs/bench_base.out 2> logs/bench_base.err
+    echo "$N" | $EXECUTABLE --run --stats "$program" > logs/bench_loop.out 2> logs/bench_loop.err
+
+    if ! diff -q logs/bench_base.out logs/bench_loop.out > /dev/null; then
+        echo "$name: output differs between pipelines"
+        STATUS=1
+        continue
+    fi
+
+    read base_insts base_muls <<< "$(count_ops logs/bench_base.err)"
+    read loop_insts loop_muls <<< "$(count_ops logs/bench_loop.err)"
+    saved=$(awk -v a="$base_insts" -v b="$loop_insts" 'BEGIN { printf "%.1f%%", 100 * (a - b) / a }')
+
+    printf "%-22s %12s %12s %8s %10s %10s\n" "$name" "$base_insts" "$loop_insts" "$saved" "$base_muls" "$loop_muls"
+done
+
+exit $STATUS
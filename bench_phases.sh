@@ -0,0 +1,57 @@
+#!/bin/bash
+
+# Times every compiler phase on generated workloads (make bench) and writes
+# the results to logs/bench.json, labeled with the current commit. Fails if
+# a phase scales worse than linearly from mixed to large.
+
+REPEAT=${1:-3}
+
+mkdir -p logs/bench
+
+echo "Building project..."
+make eidos builds/bench_gen builds/bench_phases > logs/make.log 2>&1
+if [ $? -ne 0 ]; then
+    echo "Build failed! Check logs/make.log"
+    exit 1
+fi
+
+GEN="./builds/bench_gen"
+
+# name and generator options of each workload
+WORKLOADS=(
+    "mixed       --statements=5000"
+    "straight    --statements=20000 --loops=0 --nest-depth=0"
+    "deep_expr   --statements=2000 --expr-depth=10"
+    "loops       --statements=500  --loops=40 --nest-depth=4"
+    "many_vars   --statements=3000 --vars=2000 --idents=90"
+    "large       --statements=40000"
+)
+
+FILES=()
+for workload in "${WORKLOADS[@]}"; do
+    set -- $workload
+    name=$1
+    shift
+    if ! $GEN "$@" > "logs/bench/$name.e"; then
+        echo "$name: generator failed"
+        exit 1
+    fi
+    # every workload must be a valid program that runs to the end
+    if ! ./eidos --run "logs/bench/$name.e" < /dev/null > /dev/null 2> logs/bench/run.err; then
+        echo "$name: generated program fails, see logs/bench/run.err"
+        exit 1
+    fi
+    FILES+=("logs/bench/$name.e")
+done
+
+LABEL=$(git describe --always --dirty 2> /dev/null || echo unknown)
+# mixed and large are the same program at two sizes: a phase whose time per
+# byte grows between them has stopped scaling linearly, and fails the run
+./builds/bench_phases --repeat="$REPEAT" --label="$LABEL" \
+    --scaling=logs/bench/mixed.e,logs/bench/large.e "${FILES[@]}" > logs/bench.json
+if [ $? -ne 0 ]; then
+    echo "A phase grew faster than its input, see logs/bench.json"
+    exit 1
+fi
+
+echo "Results written to logs/bench.json"
@@ -0,0 +1,27 @@
+#!/bin/bash
+
+# Runs thousands of programs at once on the scheduler, in slices and then
+# each to its end, and compares throughput and latency (bench/sched.c)
+
+PROGRAMS=${1:-10000}
+THREADS=${2:-0}
+
+mkdir -p logs
+
+echo "Building project..."
+make builds/bench_sched > logs/make.log 2>&1
+if [ $? -ne 0 ]; then
+    echo "Build failed! Check logs/make.log"
+    exit 1
+fi
+
+STATUS=0
+for slice in 20000 0; do
+    echo
+    ./builds/bench_sched --programs=$PROGRAMS --threads=$THREADS --slice=$slice | tee logs/bench_sched_$slice.txt
+    if [ ${PIPESTATUS[0]} -ne 0 ]; then
+        STATUS=1
+    fi
+done
+
+exit $STATUS
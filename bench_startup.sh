@@ -0,0 +1,61 @@
+#!/bin/bash
+
+# Compares the time to run each program in test_codes/ from source
+# (eidos run file.e) with running its compiled image (eidos run file.eidb)
+
+RUNS=${1:-200}
+
+mkdir -p logs
+
+echo "Building project..."
+make > logs/make.log 2>&1
+if [ $? -ne 0 ]; then
+    echo "Build failed! Check logs/make.log"
+    exit 1
+fi
+
+EXECUTABLE="./eidos"
+
+# average wall time of RUNS runs of a command, in milliseconds
+time_runs() {
+    local start end
+    start=$(date +%s%N)
+    for ((r = 0; r < RUNS; r++)); do
+        "$@" < /dev/null > /dev/null 2>&1
+    done
+    end=$(date +%s%N)
+    awk -v ns=$((end - start)) -v n="$RUNS" 'BEGIN { printf "%.3f", ns / n / 1e6 }'
+}
+
+printf "%-30s %10s %10s %10s %9s\n" "program (runs=$RUNS)" "source ms" "image ms" "speedup" "bytes"
+
+# a long straight-line program, where lexing and optimizing dominate startup
+awk 'BEGIN { print "let v0 = 1;"; for (i = 1; i <= 5000; i++) { printf "let v%d = v%d * 3 + %d;\n", i, i - 1, i; if (i % 50 == 0) printf "print(v%d);\n", i } }' > logs/bench_large.e
+
+STATUS=0
+for program in test_codes/*.e logs/bench_large.e; do
+    name=$(basename "$program")
+    image="logs/${name%.e}.eidb"
+
+    if ! $EXECUTABLE compile "$program" -o "$image" > /dev/null 2> logs/bench_compile.err; then
+        echo "$name: compile failed, see logs/bench_compile.err"
+        STATUS=1
+        continue
+    fi
+
+    $EXECUTABLE run "$program" < /dev/null > logs/bench_source.out 2>&1
+    $EXECUTABLE run "$image" < /dev/null > logs/bench_image.out 2>&1
+    if ! diff -q logs/bench_source.out logs/bench_image.out > /dev/null; then
+        echo "$name: output differs between source and image"
+        STATUS=1
+        continue
+    fi
+
+    source_ms=$(time_runs $EXECUTABLE run "$program")
+    image_ms=$(time_runs $EXECUTABLE run "$image")
+    speedup=$(awk -v a="$source_ms" -v b="$image_ms" 'BEGIN { printf "%.2fx", a / b }')
+
+    printf "%-30s %10s %10s %10s %9s\n" "$name" "$source_ms" "$image_ms" "$speedup" "$(wc -c < "$image")"
+done
+
+exit $STATUS
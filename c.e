@@ -0,0 +1,6 @@
+let n = read();
+let i = 0;
+while (i < n) {
+  print(i * 7 + n);
+  i++;
+}
@@ -0,0 +1,760 @@
+#include "bytecode.h"
+#include "../util/context.h"
+#include "../runtime/eidos_io.h"
+#include "../semantic/sema.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* ===== Helper Functions ===== */
+
+static int bad_image(const char *path, const char *what) {
+    eidos_diag("Error: %s is not a usable bytecode image: %s\n", path, what);
+    return -1;
+}
+
+// 1 if count items of `size` bytes at `off` lie inside the image, 8-byte aligned
+static int section_fits(const BCHeader *h, uint64_t off, uint64_t count, uint64_t size) {
+    return off % 8 == 0 && off <= h->size && count <= (h->size - off) / size;
+}
+
+/*
+Checks the code of the program or of one function: code[begin .. end - 1],
+using slots 0 .. nslots - 1
+
+returns:
+    (const char*) -> what is wrong, NULL if the code is fine
+*/
+static const char *verify_code(const BCImage *image, uint64_t begin, uint64_t end, uint32_t nslots,
+                               int is_function) {
+    const BCHeader *h = image->header;
+
+    if (begin >= end) {
+        return "no code";
+    }
+    for (uint64_t pc = begin; pc < end; pc++) {
+        const BCInst *in = &image->code[pc];
+        switch ((BCOp)in->op) {
+        case BC_CONST:
+            if (in->dst >= nslots || in->a >= h->nconsts) return "constant out of range";
+            break;
+        case BC_MOV:
+        case BC_NEG:
+        case BC_NOT:
+            if (in->dst >= nslots || in->a >= nslots) return "slot out of range";
+            break;
+        case BC_DIVM:
+            if (in->b >= h->nconsts) return "constant out of range";
+            // fallthrough
+        case BC_SHL:
+            if (in->shift > 63) return "bad shift";
+            if (in->dst >= nslots || in->a >= nslots) return "slot out of range";
+            break;
+        case BC_DIVP:
+            if (in->shift < 1 || in->shift > 62) return "bad shift";
+            if (in->dst >= nslots || in->a >= nslots) return "slot out of range";
+            break;
+        case BC_CMP:
+            if (in->cmp > CMP_GE) return "bad comparison";
+            // fallthrough
+        case BC_ADD:
+        case BC_SUB:
+        case BC_MUL:
+        case BC_DIV:
+            if (in->dst >= nslots || in->a >= nslots || in->b >= nslots) return "slot out of range";
+            break;
+        case BC_READ:
+            if (in->dst >= nslots) return "slot out of range";
+            break;
+        case BC_PRINT:
+            if (in->a >= nslots) return "slot out of range";
+            break;
+        case BC_LOAD:
+            if (in->dst >= nslots || in->a >= nslots) return "slot out of range";
+            if (in->b >= h->narrays) return "array out of range";
+            break;
+        case BC_STORE:
+            if (in->a >= nslots || in->b >= nslots) return "slot out of range";
+            if (in->dst >= h->narrays) return "array out of range";
+            break;
+        case BC_JCMP:
+            if (in->cmp > CMP_GE) return "bad comparison";
+            if (in->b >= nslots) return "slot out of range";
+            // fallthrough
+        case BC_JZ:
+            if (in->a >= nslots) return "slot out of range";
+            // fallthrough
+        case BC_JMP:
+            if (in->dst < begin || in->dst >= end) return "jump out of range";
+            break;
+        case BC_CALL:
+            if (in->a >= h->nfuncs) return "function out of range";
+            if (in->shift != image->funcs[in->a].nparams) return "wrong argument count";
+            // the callee's slots start at b, past them the stack grows
+            if (in->dst >= nslots || (uint64_t)in->b + in->shift > nslots) return "slot out of range";
+            break;
+        case BC_RETV:
+            if (!is_function) return "return outside a function";
+            if (in->a >= nslots) return "slot out of range";
+            break;
+        case BC_RET:
+            if (is_function) return "function ends the program";
+            break;
+        default:
+            return "unknown instruction";
+        }
+    }
+
+    // control can't run off the end of the code
+    BCOp last = (BCOp)image->code[end - 1].op;
+    if (last != BC_RET && last != BC_RETV && last != BC_JMP) {
+        return "code does not end in a jump or return";
+    }
+    return NULL;
+}
+
+/*
+Checks everything the VM trusts without checking again while running
+
+returns:
+    (const char*) -> what is wrong, NULL if the image is fine
+*/
+static const char *verify(const BCImage *image) {
+    const BCHeader *h = image->header;
+
+    for (uint64_t i = 0; i < h->narrays; i++) {
+        if (image->arrays[i] < 1 || image->arrays[i] > ARRAY_MAX_ELEMENTS) {
+            return "bad array size";
+        }
+    }
+
+    // the program, then every function right after the one before
+    uint64_t end = h->nfuncs ? image->funcs[0].entry : h->ncode;
+    if (end > h->ncode) {
+        return "bad function table";
+    }
+    const char *problem = verify_code(image, 0, end, h->nslots, 0);
+    for (uint64_t i = 0; i < h->nfuncs && !problem; i++) {
+        const BCFunc *f = &image->funcs[i];
+        if (f->entry != end || f->ncode > h->ncode - end || f->nparams > f->nslots) {
+            return "bad function table";
+        }
+        end += f->ncode;
+        problem = verify_code(image, f->entry, end, f->nslots, 1);
+    }
+    if (!problem && end != h->ncode) {
+        return "bad function table";
+    }
+    return problem;
+}
+
+/*
+Checks the header and sections of an image in memory and fills in the
+section pointers
+
+returns:
+    (const char*) -> what is wrong, NULL if the image is fine
+*/
+static const char *check_image(BCImage *image) {
+    const BCHeader *h = image->header;
+    const char *base = (const char*)h;
+
+    if (memcmp(h->magic, BC_MAGIC, 4) != 0) {
+        return "bad magic";
+    } else if (h->byte_order != BC_BYTE_ORDER) {
+        return "written on a machine of the other byte order";
+    } else if (h->version != BC_VERSION) {
+        return "written by another version of eidos";
+    } else if (h->size != image->size) {
+        return "size does not match the file";
+    } else if (!section_fits(h, h->consts_off, h->nconsts, sizeof(int64_t)) ||
+               !section_fits(h, h->arrays_off, h->narrays, sizeof(int64_t)) ||
+               !section_fits(h, h->code_off, h->ncode, sizeof(BCInst)) ||
+               !section_fits(h, h->lines_off, h->nlines, sizeof(BCLine)) ||
+               !section_fits(h, h->funcs_off, h->nfuncs, sizeof(BCFunc)) ||
+               !section_fits(h, h->output_off, h->output_len, 1)) {
+        return "section out of bounds";
+    } else if (h->ncode == 0) {
+        return "no code";
+    }
+
+    image->consts = (const int64_t*)(base + h->consts_off);
+    image->arrays = (const int64_t*)(base + h->arrays_off);
+    image->code = (const BCInst*)(base + h->code_off);
+    image->lines = (const BCLine*)(base + h->lines_off);
+    image->funcs = (const BCFunc*)(base + h->funcs_off);
+    image->output = base + h->output_off;
+    return verify(image);
+}
+
+/*
+Source position of the instruction at pc, from the line table
+*/
+static const BCLine *line_of(const BCImage *image, uint32_t pc) {
+    size_t lo = 0, hi = image->header->nlines;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (image->lines[mid].pc < pc) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < image->header->nlines && image->lines[lo].pc == pc ? &image->lines[lo] : NULL;
+}
+
+// arithmetic shift right, which C leaves to the implementation for negative x
+static int64_t shift_right(int64_t x, unsigned shift) {
+    return x < 0 ? (int64_t)~(~(uint64_t)x >> shift) : (int64_t)((uint64_t)x >> shift);
+}
+
+// high half of the 128-bit product
+static int64_t mul_high(int64_t a, int64_t b) {
+#if defined(__SIZEOF_INT128__)
+    return (int64_t)(((__int128)a * b) >> 64);
+#else
+    uint64_t ua = (uint64_t)a, ub = (uint64_t)b;
+    uint64_t lo_lo = (ua & 0xffffffffu) * (ub & 0xffffffffu);
+    uint64_t hi_lo = (ua >> 32) * (ub & 0xffffffffu);
+    uint64_t lo_hi = (ua & 0xffffffffu) * (ub >> 32);
+    uint64_t hi_hi = (ua >> 32) * (ub >> 32);
+    uint64_t mid = (lo_lo >> 32) + (hi_lo & 0xffffffffu) + lo_hi;
+    uint64_t high = hi_hi + (hi_lo >> 32) + (mid >> 32);
+    // signed from unsigned: subtract b where a is negative and a where b is
+    high -= a < 0 ? ub : 0;
+    high -= b < 0 ? ua : 0;
+    return (int64_t)high;
+#endif
+}
+
+// x / 2^shift, truncated toward zero like eidos_div
+static int64_t div_pow2(int64_t x, unsigned shift) {
+    return x < 0 ? (int64_t)(0 - ((0 - (uint64_t)x) >> shift)) : (int64_t)((uint64_t)x >> shift);
+}
+
+// x / d through the magic number bc_write.c computed for d
+static int64_t div_magic(int64_t x, int64_t magic, unsigned shift) {
+    int64_t q = mul_high(magic, x);
+    if (magic < 0) {
+        q = eidos_add(q, x);
+    }
+    return eidos_add(shift_right(q, shift), (int64_t)((uint64_t)x >> 63));
+}
+
+static void runtime_error(BCVM *vm, uint32_t pc, const char *message) {
+    const BCLine *l = line_of(vm->image, pc);
+    snprintf(vm->error, sizeof(vm->error), "Runtime Error at line %u, column %u: %s\n",
+             l ? l->line : 0, l ? l->col : 0, message);
+}
+
+static void *grow(void *items, size_t *cap, size_t need, size_t size) {
+    size_t want = *cap ? *cap : 256;
+    while (want < need) {
+        want *= 2;
+    }
+    items = eidos_realloc(items, want * size);
+    if (!items) {
+        eidos_fatal("Failed to allocate VM state");
+    }
+    *cap = want;
+    return items;
+}
+
+static void append_output(BCVM *vm, const char *data, size_t len) {
+    if (vm->output_cap - vm->output_len < len) {
+        vm->output = grow(vm->output, &vm->output_cap, vm->output_len + len, 1);
+    }
+    memcpy(vm->output + vm->output_len, data, len);
+    vm->output_len += len;
+}
+
+/*
+read() from the fed input, like eidos_read_int but never past what was fed
+
+returns:
+    (int) -> EIDOS_READ_OK with *value set, EIDOS_READ_NONE, EIDOS_READ_RANGE,
+             or -1 if the integer may go on in input not fed yet
+*/
+static int read_fed(BCVM *vm, int64_t *value) {
+    const char *p = vm->input + vm->input_pos;
+    const char *end = vm->input + vm->input_len;
+    while (p < end && (*p == ' ' || *p == '\n' || *p == '\t' || *p == '\r' || *p == '\v' || *p == '\f')) {
+        p++;
+    }
+    vm->input_pos = (size_t)(p - vm->input);
+
+    const char *digits = p < end && (*p == '-' || *p == '+') ? p + 1 : p;
+    const char *q = digits;
+    while (q < end && (unsigned)(*q - '0') < 10) {
+        q++;
+    }
+    if (q == end && !vm->input_closed) {
+        return -1;
+    }
+    if (q == digits) {
+        return EIDOS_READ_NONE;
+    }
+
+    // magnitude limit: 2^63 for negative numbers, 2^63 - 1 otherwise
+    int negative = *p == '-';
+    uint64_t limit = negative ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+    uint64_t u = 0;
+    for (const char *d = digits; d < q; d++) {
+        unsigned digit = (unsigned)(*d - '0');
+        if (u > (limit - digit) / 10) {
+            return EIDOS_READ_RANGE;
+        }
+        u = u * 10 + digit;
+    }
+    vm->input_pos = (size_t)(q - vm->input);
+    *value = negative ? (int64_t)(0 - u) : (int64_t)u;
+    return EIDOS_READ_OK;
+}
+
+
+/* ========== PUBLIC API ========== */
+
+/*
+Looks at the first bytes of a file
+
+args:
+    *path (char) -> file name
+
+returns:
+    (int) -> 1 if it starts with BC_MAGIC
+*/
+int bc_is_image(const char *path) {
+    char magic[4];
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return 0;
+    }
+    int is_image = fread(magic, 1, 4, f) == 4 && memcmp(magic, BC_MAGIC, 4) == 0;
+    fclose(f);
+    return is_image;
+}
+
+/*
+Maps and verifies an image
+
+args:
+    *path (char) -> .eidb file
+    *image (BCImage) -> filled in on success
+
+returns:
+    (int) -> 0 on success, -1 after reporting an error
+*/
+int bc_load_image(const char *path, BCImage *image) {
+    memset(image, 0, sizeof(BCImage));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        eidos_diag("Error: Could not open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        eidos_diag("Error: Could not stat %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    if ((size_t)st.st_size < sizeof(BCHeader)) {
+        close(fd);
+        return bad_image(path, "truncated header");
+    }
+
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    int map_errno = errno;
+    close(fd);
+    if (map == MAP_FAILED) {
+        eidos_diag("Error: Could not map %s: %s\n", path, strerror(map_errno));
+        return -1;
+    }
+    image->header = map;
+    image->size = (size_t)st.st_size;
+    image->mapped = 1;
+
+    const char *problem = check_image(image);
+    if (problem) {
+        bc_unload_image(image);
+        return bad_image(path, problem);
+    }
+    return 0;
+}
+
+/*
+Verifies an image already in memory, such as the output of a compilation
+
+args:
+    *data (void) -> image bytes, 8-byte aligned, kept alive while the image is used
+    size (size_t) -> their length
+    *name (char) -> what to call the image in the error message
+    *image (BCImage) -> filled in on success
+
+returns:
+    (int) -> 0 on success, -1 after reporting an error
+*/
+int bc_open_image(const void *data, size_t size, const char *name, BCImage *image) {
+    memset(image, 0, sizeof(BCImage));
+    if (size < sizeof(BCHeader)) {
+        return bad_image(name, "truncated header");
+    }
+    if ((uintptr_t)data % 8 != 0) {
+        return bad_image(name, "not 8-byte aligned");
+    }
+
+    image->header = data;
+    image->size = size;
+    const char *problem = check_image(image);
+    if (problem) {
+        memset(image, 0, sizeof(BCImage));
+        return bad_image(name, problem);
+    }
+    return 0;
+}
+
+/*
+Releases an image from bc_load_image
+
+args:
+    *image (BCImage) -> image to release
+*/
+void bc_unload_image(BCImage *image) {
+    if (image->mapped && image->header) {
+        munmap((void*)image->header, image->size);
+    }
+    memset(image, 0, sizeof(BCImage));
+}
+
+/*
+Sets up a VM to run an image from the start
+
+args:
+    *vm (BCVM) -> state to fill in
+    *image (BCImage) -> verified image, kept alive while the VM is used
+*/
+void bc_vm_init(BCVM *vm, const BCImage *image) {
+    const BCHeader *h = image->header;
+    memset(vm, 0, sizeof(BCVM));
+    vm->image = image;
+    vm->status = BC_VM_YIELD;
+    vm->output_limit = BC_VM_OUTPUT_LIMIT;
+
+    vm->stack_cap = h->nslots ? h->nslots : 1;
+    vm->stack = eidos_calloc(vm->stack_cap, sizeof(int64_t));
+    vm->arrays = eidos_calloc(h->narrays ? h->narrays : 1, sizeof(int64_t*));
+    if (!vm->stack || !vm->arrays) {
+        eidos_fatal("Failed to allocate VM state");
+    }
+    for (uint64_t i = 0; i < h->narrays; i++) {
+        vm->arrays[i] = eidos_calloc((size_t)image->arrays[i], sizeof(int64_t));
+        if (!vm->arrays[i]) {
+            eidos_fatal("Failed to allocate VM state");
+        }
+    }
+    if (h->output_len) {
+        append_output(vm, image->output, h->output_len);
+    }
+}
+
+/*
+Releases a VM's memory
+
+args:
+    *vm (BCVM) -> from bc_vm_init
+*/
+void bc_vm_free(BCVM *vm) {
+    if (vm->arrays) {
+        for (uint64_t i = 0; i < vm->image->header->narrays; i++) {
+            eidos_free(vm->arrays[i]);
+        }
+    }
+    eidos_free(vm->arrays);
+    eidos_free(vm->stack);
+    eidos_free(vm->frames);
+    eidos_free(vm->input);
+    eidos_free(vm->output);
+    memset(vm, 0, sizeof(BCVM));
+}
+
+/*
+Appends input for read()
+
+args:
+    *vm (BCVM) -> VM, not running
+    *data (char) -> bytes of input
+    len (size_t) -> their count
+*/
+void bc_vm_feed(BCVM *vm, const char *data, size_t len) {
+    // what was read already goes first, once it is most of the buffer
+    if (vm->input_pos && vm->input_pos >= vm->input_len / 2) {
+        memmove(vm->input, vm->input + vm->input_pos, vm->input_len - vm->input_pos);
+        vm->input_len -= vm->input_pos;
+        vm->input_pos = 0;
+    }
+    if (vm->input_cap - vm->input_len < len) {
+        vm->input = grow(vm->input, &vm->input_cap, vm->input_len + len, 1);
+    }
+    memcpy(vm->input + vm->input_len, data, len);
+    vm->input_len += len;
+}
+
+void bc_vm_close_input(BCVM *vm) {
+    vm->input_closed = 1;
+}
+
+/*
+Executes a slice of a program
+
+args:
+    *vm (BCVM) -> VM from bc_vm_init
+    budget (uint64_t) -> instructions the slice may execute, 0 for no limit
+
+returns:
+    (BCVMStatus) -> why it stopped
+*/
+BCVMStatus bc_vm_resume(BCVM *vm, uint64_t budget) {
+    if (vm->status == BC_VM_DONE || vm->status == BC_VM_ERROR) {
+        return vm->status;
+    }
+    const BCImage *image = vm->image;
+    const BCInst *code = image->code;
+    const int64_t *consts = image->consts;
+    int64_t **arrays = vm->arrays;
+
+    int64_t *slot = vm->stack + vm->base;
+    uint32_t pc = vm->pc;
+    uint64_t executed = vm->executed;
+    // only looked at with a budget, so running without one pays a test of a register
+    uint64_t limit = executed + budget;
+    BCVMStatus status = BC_VM_YIELD;
+
+    for (;;) {
+        const BCInst *ins = &code[pc];
+        executed++;
+
+        switch ((BCOp)ins->op) {
+        case BC_CONST: slot[ins->dst] = consts[ins->a]; break;
+        case BC_MOV:   slot[ins->dst] = slot[ins->a]; break;
+        case BC_ADD:   slot[ins->dst] = eidos_add(slot[ins->a], slot[ins->b]); break;
+        case BC_SUB:   slot[ins->dst] = eidos_sub(slot[ins->a], slot[ins->b]); break;
+        case BC_MUL:   slot[ins->dst] = eidos_mul(slot[ins->a], slot[ins->b]); break;
+        case BC_NEG:   slot[ins->dst] = eidos_neg(slot[ins->a]); break;
+        case BC_SHL:   slot[ins->dst] = (int64_t)((uint64_t)slot[ins->a] << ins->shift); break;
+        case BC_DIVP:  slot[ins->dst] = div_pow2(slot[ins->a], ins->shift); break;
+        case BC_DIVM:  slot[ins->dst] = div_magic(slot[ins->a], consts[ins->b], ins->shift); break;
+        case BC_NOT:   slot[ins->dst] = eidos_not(slot[ins->a]); break;
+        case BC_CMP:
+            slot[ins->dst] = eidos_compare((CmpOp)ins->cmp, slot[ins->a], slot[ins->b]);
+            break;
+        case BC_DIV:
+            if (slot[ins->b] == 0) {
+                runtime_error(vm, pc, "division by zero");
+                status = BC_VM_ERROR;
+                goto done;
+            }
+            slot[ins->dst] = eidos_div(slot[ins->a], slot[ins->b]);
+            break;
+        case BC_READ: {
+            int result = read_fed(vm, &slot[ins->dst]);
+            if (result < 0) {
+                // the read starts over once there is more input
+                executed--;
+                status = BC_VM_BLOCKED;
+                goto done;
+            }
+            if (result != EIDOS_READ_OK) {
+                runtime_error(vm, pc, result == EIDOS_READ_RANGE ? "read() integer out of range"
+                                                                 : "read() expected an integer");
+                status = BC_VM_ERROR;
+                goto done;
+            }
+            break;
+        }
+        case BC_PRINT: {
+            if (vm->output_cap - vm->output_len < 21) {
+                vm->output = grow(vm->output, &vm->output_cap, vm->output_len + 21, 1);
+            }
+            // sign, 19 digits and the newline
+            char text[24];
+            char *end = text + sizeof(text);
+            end[-1] = '\n';
+            char *start = eidos_format_int(end - 1, slot[ins->a]);
+            memcpy(vm->output + vm->output_len, start, (size_t)(end - start));
+            vm->output_len += (size_t)(end - start);
+            if (vm->output_len >= vm->output_limit) {
+                pc++;
+                goto done;
+            }
+            break;
+        }
+        case BC_LOAD:
+            if ((uint64_t)slot[ins->a] >= (uint64_t)image->arrays[ins->b]) {
+                runtime_error(vm, pc, "array index out of bounds");
+                status = BC_VM_ERROR;
+                goto done;
+            }
+            slot[ins->dst] = arrays[ins->b][slot[ins->a]];
+            break;
+        case BC_STORE:
+            if ((uint64_t)slot[ins->a] >= (uint64_t)image->arrays[ins->dst]) {
+                runtime_error(vm, pc, "array index out of bounds");
+                status = BC_VM_ERROR;
+                goto done;
+            }
+            arrays[ins->dst][slot[ins->a]] = slot[ins->b];
+            break;
+        case BC_JMP:
+            // only a jump can start another round of a loop, so the budget is checked here;
+            // the jump that would go past it is left for the next slice
+            if (budget && executed > limit) {
+                executed--;
+                goto done;
+            }
+            pc = ins->dst;
+            continue;
+        case BC_JZ:
+            if (slot[ins->a] == 0) {
+                if (budget && executed > limit) {
+                    executed--;
+                    goto done;
+                }
+                pc = ins->dst;
+                continue;
+            }
+            break;
+        case BC_JCMP:
+            if (eidos_compare((CmpOp)ins->cmp, slot[ins->a], slot[ins->b])) {
+                if (budget && executed > limit) {
+                    executed--;
+                    goto done;
+                }
+                pc = ins->dst;
+                continue;
+            }
+            break;
+        case BC_CALL: {
+            if (vm->depth == IR_MAX_CALL_DEPTH) {
+                runtime_error(vm, pc, "call depth limit exceeded");
+                status = BC_VM_ERROR;
+                goto done;
+            }
+            // recursion needs no jump, so calls count against the budget too
+            if (budget && executed > limit) {
+                executed--;
+                goto done;
+            }
+            if (vm->depth == vm->frames_cap) {
+                vm->frames = grow(vm->frames, &vm->frames_cap, vm->depth + 1, sizeof(BCFrame));
+            }
+            const BCFunc *callee = &image->funcs[ins->a];
+            size_t callee_base = vm->base + ins->b;
+            if (callee_base + callee->nslots > vm->stack_cap) {
+                vm->stack = grow(vm->stack, &vm->stack_cap, callee_base + callee->nslots, sizeof(int64_t));
+            }
+            BCFrame *f = &vm->frames[vm->depth++];
+            f->pc = pc;
+            f->dst = ins->dst;
+            f->base = vm->base;
+            vm->base = callee_base;
+            slot = vm->stack + vm->base;
+            pc = callee->entry;
+            continue;
+        }
+        case BC_RETV: {
+            int64_t result = slot[ins->a];
+            const BCFrame *f = &vm->frames[--vm->depth];
+            vm->base = f->base;
+            slot = vm->stack + vm->base;
+            slot[f->dst] = result;
+            pc = f->pc + 1;
+            continue;
+        }
+        case BC_RET:
+        case BC_OP_COUNT:
+            status = BC_VM_DONE;
+            goto done;
+        }
+        pc++;
+    }
+
+done:
+    vm->pc = pc;
+    vm->executed = executed;
+    if (status == BC_VM_DONE || status == BC_VM_ERROR) {
+        vm->status = status;
+    }
+    return status;
+}
+
+/*
+Executes an image to the end
+
+args:
+    *image (BCImage) -> verified image
+    *in (FILE) -> where read() takes integers from
+    *out (FILE) -> where print() writes to
+    max_insts (uint64_t) -> instructions it may execute, 0 for no limit
+    *insts_executed (uint64_t) -> receives the instruction count, may be NULL
+
+returns:
+    (int) -> 0 on success, 1 on a runtime error, 2 if max_insts ran out
+*/
+int bc_run_image(const BCImage *image, FILE *in, FILE *out, uint64_t max_insts, uint64_t *insts_executed) {
+    BCVM vm;
+    EidosOut *print_out = eidos_malloc(sizeof(EidosOut));
+    EidosIn *read_in = eidos_malloc(sizeof(EidosIn));
+    if (!print_out || !read_in) {
+        eidos_fatal("Failed to allocate VM state");
+    }
+    eidos_out_init(print_out, out);
+    eidos_in_init(read_in, in, print_out);
+    bc_vm_init(&vm, image);
+    // on a terminal every print() shows up as it happens
+    if (print_out->line_buffered) {
+        vm.output_limit = 1;
+    }
+
+    int status;
+    for (;;) {
+        BCVMStatus result = bc_vm_resume(&vm, max_insts ? max_insts - vm.executed : 0);
+        eidos_out_write(print_out, vm.output, vm.output_len);
+        vm.output_len = 0;
+        if (print_out->line_buffered) {
+            eidos_out_flush(print_out);
+        }
+
+        if (result == BC_VM_BLOCKED) {
+            // refilling flushes the output first, so a prompt shows before the wait
+            if (eidos_in_fill(read_in)) {
+                bc_vm_feed(&vm, read_in->pos, (size_t)(read_in->end - read_in->pos));
+                read_in->pos = read_in->end;
+            } else {
+                bc_vm_close_input(&vm);
+            }
+        } else if (result == BC_VM_YIELD) {
+            if (max_insts && vm.executed >= max_insts) {
+                status = 2;
+                break;
+            }
+        } else {
+            status = result == BC_VM_DONE ? 0 : 1;
+            break;
+        }
+    }
+
+    eidos_out_flush(print_out);
+    if (status == 1) {
+        eidos_diag("%s", vm.error);
+    }
+    if (insts_executed) {
+        *insts_executed = vm.executed;
+    }
+    bc_vm_free(&vm);
+    eidos_free(read_in);
+    eidos_free(print_out);
+    return status;
+}
@@ -0,0 +1,638 @@
+#include "bytecode.h"
+#include "peephole.h"
+#include "../util/context.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+IR -> bytecode image.
+
+Blocks are laid out in id order, like the C backend does, so most jumps fall
+through. Phis become moves on the edges into their block; when a block has
+several, the moves go through scratch slots first since phis read all their
+inputs before any is written.
+
+With a recorded profile (ir_layout), cold blocks go after all the others, and
+a branch that is usually true keeps its false edge out of line: the JZ jumps
+to the false edge's moves, placed after the last block, and the true edge
+falls through.
+
+Unless the peephole work is off, multiplications and divisions by a constant
+become shifts, moves, negations or a multiplication by a magic number
+(instruction selection), phi moves go through scratch slots only when one
+would overwrite another's source, and the finished code goes through
+bc_peephole.
+
+Functions are lowered and cleaned up one at a time, the program first, and
+their code is appended to the image's. A function's parameters are its first
+slots; the arguments of its calls are moved to the slots after all the
+others, where the callee's window starts (bytecode.h).
+*/
+
+typedef struct BCWriter {
+    BCInst *code;               // of the function being lowered
+    size_t ncode;
+    size_t code_cap;
+
+    int64_t *consts;
+    size_t nconsts;
+    size_t consts_cap;
+    uint32_t *const_index;      // open addressing over consts, index + 1, 0 is empty
+    size_t index_cap;
+
+    BCLine *lines;
+    size_t nlines;
+    size_t lines_cap;
+
+    uint32_t *jumps;            // instructions whose dst still names a block id
+    size_t njumps;
+    size_t jumps_cap;
+
+    BCInst *image;              // every function lowered so far, jumps naming image pcs
+    size_t nimage;
+    size_t image_cap;
+    BCLine *image_lines;
+    size_t nimage_lines;
+    size_t image_lines_cap;
+
+    int peephole;               // pick cheaper instructions, see bc_write_image
+    BCPeepholeStats *stats;
+} BCWriter;
+
+/* ===== Helper Functions ===== */
+
+static void *grow(void *items, size_t *cap, size_t size) {
+    *cap = *cap ? *cap * 2 : 64;
+    items = eidos_realloc(items, *cap * size);
+    if (!items) {
+        eidos_fatal("Failed to allocate bytecode");
+    }
+    return items;
+}
+
+static size_t emit(BCWriter *w, BCOp op, uint32_t dst, uint32_t a, uint32_t b) {
+    if (w->ncode == w->code_cap) {
+        w->code = grow(w->code, &w->code_cap, sizeof(BCInst));
+    }
+    BCInst *in = &w->code[w->ncode];
+    memset(in, 0, sizeof(BCInst));
+    in->op = (uint8_t)op;
+    in->dst = dst;
+    in->a = a;
+    in->b = b;
+    return w->ncode++;
+}
+
+// a jump to the start of a block, patched once every block has its pc
+static void emit_jump(BCWriter *w, BCOp op, int block, uint32_t cond) {
+    size_t pc = emit(w, op, (uint32_t)block, cond, 0);
+    if (w->njumps == w->jumps_cap) {
+        w->jumps = grow(w->jumps, &w->jumps_cap, sizeof(uint32_t));
+    }
+    w->jumps[w->njumps++] = (uint32_t)pc;
+}
+
+static void add_line(BCWriter *w, size_t pc, const IRInst *in) {
+    if (w->nlines == w->lines_cap) {
+        w->lines = grow(w->lines, &w->lines_cap, sizeof(BCLine));
+    }
+    BCLine *l = &w->lines[w->nlines++];
+    l->pc = (uint32_t)pc;
+    l->line = (uint32_t)in->line;
+    l->col = (uint32_t)in->col;
+    l->unused = 0;
+}
+
+static size_t const_hash(int64_t value, size_t mask) {
+    uint64_t h = (uint64_t)value * 0x9e3779b97f4a7c15ULL;
+    return (size_t)(h >> 17) & mask;
+}
+
+/*
+Index of a value in the constant pool, adding it the first time
+*/
+static uint32_t const_slot(BCWriter *w, int64_t value) {
+    if ((w->nconsts + 1) * 2 > w->index_cap) {
+        eidos_free(w->const_index);
+        w->index_cap = w->index_cap ? w->index_cap * 2 : 64;
+        w->const_index = eidos_calloc(w->index_cap, sizeof(uint32_t));
+        if (!w->const_index) {
+            eidos_fatal("Failed to allocate constant pool");
+        }
+        for (size_t k = 0; k < w->nconsts; k++) {
+            size_t i = const_hash(w->consts[k], w->index_cap - 1);
+            while (w->const_index[i]) {
+                i = (i + 1) & (w->index_cap - 1);
+            }
+            w->const_index[i] = (uint32_t)k + 1;
+        }
+    }
+
+    size_t mask = w->index_cap - 1;
+    size_t i = const_hash(value, mask);
+    while (w->const_index[i]) {
+        if (w->consts[w->const_index[i] - 1] == value) {
+            return w->const_index[i] - 1;
+        }
+        i = (i + 1) & mask;
+    }
+
+    if (w->nconsts == w->consts_cap) {
+        w->consts = grow(w->consts, &w->consts_cap, sizeof(int64_t));
+    }
+    w->consts[w->nconsts] = value;
+    w->const_index[i] = (uint32_t)++w->nconsts;
+    return (uint32_t)(w->nconsts - 1);
+}
+
+// log2 of a power of two > 1, 0 for anything else
+static int pow2_shift(int64_t k) {
+    if (k < 2 || (k & (k - 1)) != 0) {
+        return 0;
+    }
+    int shift = 0;
+    while (((uint64_t)1 << shift) != (uint64_t)k) {
+        shift++;
+    }
+    return shift;
+}
+
+/*
+Magic number of a division by d > 1 that isn't a power of two (Hacker's
+Delight, 10-1): n / d is the high half of n * magic, plus n if the magic is
+negative, shifted right by the returned amount, plus 1 if n is negative.
+bc_vm.c's BC_DIVM does exactly that.
+
+returns:
+    (int) -> the shift
+*/
+static int div_magic(int64_t d, int64_t *magic) {
+    const uint64_t two63 = (uint64_t)1 << 63;
+    uint64_t ad = (uint64_t)d;
+    uint64_t anc = two63 - 1 - two63 % ad;
+    uint64_t q1 = two63 / anc, r1 = two63 - q1 * anc;
+    uint64_t q2 = two63 / ad, r2 = two63 - q2 * ad;
+    uint64_t delta;
+    int p = 63;
+    do {
+        p++;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc) {
+            q1++;
+            r1 -= anc;
+        }
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= ad) {
+            q2++;
+            r2 -= ad;
+        }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+    *magic = (int64_t)(q2 + 1);
+    return p - 64;
+}
+
+/*
+A multiplication or division by a constant, without BC_MUL or BC_DIV
+
+returns:
+    (int) -> 1 if it was emitted
+*/
+static int select_by_constant(BCWriter *w, const IRFunction *fn, const uint32_t *slot, int v) {
+    const IRInst *in = &fn->insts[v];
+    int x = in->a;
+    int64_t k;
+    size_t pc;
+
+    if (fn->insts[in->b].op == IR_CONST) {
+        k = fn->insts[in->b].imm;
+    } else if (in->op == IR_MUL && fn->insts[in->a].op == IR_CONST) {
+        k = fn->insts[in->a].imm;
+        x = in->b;
+    } else {
+        return 0;
+    }
+
+    int shift = pow2_shift(k);
+    if (k == 1) {
+        emit(w, BC_MOV, slot[v], slot[x], 0);
+    } else if (k == -1) {
+        emit(w, BC_NEG, slot[v], slot[x], 0);
+    } else if (in->op == IR_MUL) {
+        if (k == 0) {
+            emit(w, BC_CONST, slot[v], const_slot(w, 0), 0);
+        } else if (shift) {
+            pc = emit(w, BC_SHL, slot[v], slot[x], 0);
+            w->code[pc].shift = (uint8_t)shift;
+        } else {
+            return 0;   // imul is as cheap as anything else the VM could do
+        }
+    } else if (shift && shift <= 62) {
+        pc = emit(w, BC_DIVP, slot[v], slot[x], 0);
+        w->code[pc].shift = (uint8_t)shift;
+    } else if (k > 1) {
+        int64_t magic;
+        int s = div_magic(k, &magic);
+        pc = emit(w, BC_DIVM, slot[v], slot[x], const_slot(w, magic));
+        w->code[pc].shift = (uint8_t)s;
+    } else {
+        return 0;       // zero traps, other negative divisors are rare
+    }
+
+    if (in->op == IR_MUL) {
+        w->stats->muls++;
+    } else {
+        w->stats->divs++;
+    }
+    return 1;
+}
+
+static void emit_inst(BCWriter *w, const IRFunction *fn, const uint32_t *slot, uint32_t outgoing, int v) {
+    const IRInst *in = &fn->insts[v];
+    uint32_t a = in->a >= 0 ? slot[in->a] : 0;
+    uint32_t b = in->b >= 0 ? slot[in->b] : 0;
+    size_t pc;
+
+    switch (in->op) {
+    case IR_CONST: emit(w, BC_CONST, slot[v], const_slot(w, in->imm), 0); break;
+    case IR_ADD:   emit(w, BC_ADD, slot[v], a, b); break;
+    case IR_SUB:   emit(w, BC_SUB, slot[v], a, b); break;
+    case IR_MUL:
+        if (!w->peephole || !select_by_constant(w, fn, slot, v)) {
+            emit(w, BC_MUL, slot[v], a, b);
+        }
+        break;
+    case IR_NEG:   emit(w, BC_NEG, slot[v], a, 0); break;
+    case IR_NOT:   emit(w, BC_NOT, slot[v], a, 0); break;
+    case IR_COPY:  emit(w, BC_MOV, slot[v], a, 0); break;
+    case IR_PRINT: emit(w, BC_PRINT, 0, a, 0); break;
+    case IR_CMP:
+        pc = emit(w, BC_CMP, slot[v], a, b);
+        w->code[pc].cmp = (uint8_t)in->imm;
+        break;
+    case IR_DIV:
+        if (w->peephole && select_by_constant(w, fn, slot, v)) {
+            break;
+        }
+        pc = emit(w, BC_DIV, slot[v], a, b);
+        add_line(w, pc, in);
+        break;
+    case IR_READ:
+        pc = emit(w, BC_READ, slot[v], 0, 0);
+        add_line(w, pc, in);
+        break;
+    case IR_LOAD:
+        pc = emit(w, BC_LOAD, slot[v], a, (uint32_t)in->imm);
+        add_line(w, pc, in);
+        break;
+    case IR_STORE:
+        pc = emit(w, BC_STORE, (uint32_t)in->imm, a, b);
+        add_line(w, pc, in);
+        break;
+    case IR_CALL:
+        for (size_t i = 0; i < in->nphi; i++) {
+            emit(w, BC_MOV, outgoing + (uint32_t)i, slot[in->phi_args[i]], 0);
+        }
+        pc = emit(w, BC_CALL, slot[v], (uint32_t)in->imm, outgoing);
+        w->code[pc].shift = (uint8_t)in->nphi;
+        add_line(w, pc, in);
+        break;
+    case IR_RETURN: emit(w, BC_RETV, 0, a, 0); break;
+    case IR_PARAM:      // already in its slot
+    case IR_PHI:
+    case IR_OP_COUNT:
+        break;
+    }
+}
+
+/*
+Moves for the phis of `to` on the edge from -> to
+
+args:
+    *w (BCWriter) -> writer
+    *fn (IRFunction) -> function
+    *slot (uint32_t) -> slot of every value
+    scratch (uint32_t) -> first scratch slot
+    from, to (int) -> the edge
+*/
+static void emit_edge_moves(BCWriter *w, const IRFunction *fn, const uint32_t *slot,
+                            uint32_t scratch, int from, int to) {
+    const IRBlock *bb = &fn->blocks[to];
+    size_t edge = 0;
+    while (edge < bb->npreds && bb->preds[edge] != from) {
+        edge++;
+    }
+
+    if (bb->nphis == 1) {
+        int phi = bb->phis[0];
+        emit(w, BC_MOV, slot[phi], slot[fn->insts[phi].phi_args[edge]], 0);
+        return;
+    }
+
+    // in order, unless a move would overwrite a slot a later one reads
+    int direct = w->peephole;
+    for (size_t i = 0; i < bb->nphis && direct; i++) {
+        for (size_t j = i + 1; j < bb->nphis; j++) {
+            if (slot[bb->phis[i]] == slot[fn->insts[bb->phis[j]].phi_args[edge]]) {
+                direct = 0;
+                break;
+            }
+        }
+    }
+    if (direct) {
+        for (size_t i = 0; i < bb->nphis; i++) {
+            int phi = bb->phis[i];
+            emit(w, BC_MOV, slot[phi], slot[fn->insts[phi].phi_args[edge]], 0);
+        }
+        w->stats->spills += bb->nphis;
+        return;
+    }
+    for (size_t i = 0; i < bb->nphis; i++) {
+        int phi = bb->phis[i];
+        emit(w, BC_MOV, scratch + (uint32_t)i, slot[fn->insts[phi].phi_args[edge]], 0);
+    }
+    for (size_t i = 0; i < bb->nphis; i++) {
+        emit(w, BC_MOV, slot[bb->phis[i]], scratch + (uint32_t)i, 0);
+    }
+}
+
+/*
+Moves the code and line entries of the function just lowered to the end of
+the image, its jumps following it, and empties the writer for the next one
+*/
+static void append(BCWriter *w) {
+    uint32_t entry = (uint32_t)w->nimage;
+    while (w->nimage + w->ncode > w->image_cap) {
+        w->image = grow(w->image, &w->image_cap, sizeof(BCInst));
+    }
+    for (size_t pc = 0; pc < w->ncode; pc++) {
+        BCInst in = w->code[pc];
+        if (in.op == BC_JMP || in.op == BC_JZ || in.op == BC_JCMP) {
+            in.dst += entry;
+        }
+        w->image[w->nimage++] = in;
+    }
+    while (w->nimage_lines + w->nlines > w->image_lines_cap) {
+        w->image_lines = grow(w->image_lines, &w->image_lines_cap, sizeof(BCLine));
+    }
+    for (size_t i = 0; i < w->nlines; i++) {
+        w->image_lines[w->nimage_lines] = w->lines[i];
+        w->image_lines[w->nimage_lines++].pc += entry;
+    }
+    w->ncode = 0;
+    w->nlines = 0;
+    w->njumps = 0;
+}
+
+/*
+Lowers one function and appends it to the image
+
+args:
+    *w (BCWriter) -> writer
+    *fn (IRFunction) -> the program (name NULL) or one of its functions
+
+returns:
+    (uint32_t) -> slots the function uses
+*/
+static uint32_t write_function(BCWriter *w, const IRFunction *fn) {
+    uint32_t *slot = eidos_malloc((fn->ninsts ? fn->ninsts : 1) * sizeof(uint32_t));
+    uint32_t *block_pc = eidos_malloc((fn->nblocks ? fn->nblocks : 1) * sizeof(uint32_t));
+    if (!slot || !block_pc) {
+        eidos_fatal("Failed to allocate bytecode");
+    }
+
+    // parameters first, where the caller left the arguments
+    uint32_t nslots = (uint32_t)fn->nparams;
+    size_t max_phis = 0, max_args = 0;
+    for (size_t v = 0; v < fn->ninsts; v++) {
+        const IRInst *in = &fn->insts[v];
+        if (in->block < 0) {
+            continue;
+        }
+        if (in->op == IR_PARAM) {
+            slot[v] = (uint32_t)in->imm;
+        } else if (!ir_is_void(in)) {
+            slot[v] = nslots++;
+        }
+        if (in->op == IR_CALL && in->nphi > max_args) {
+            max_args = in->nphi;
+        }
+    }
+    for (size_t i = 0; i < fn->nblocks; i++) {
+        if (!fn->blocks[i].dead && fn->blocks[i].nphis > max_phis) {
+            max_phis = fn->blocks[i].nphis;
+        }
+    }
+    uint32_t scratch = nslots;
+    nslots += max_phis > 1 ? (uint32_t)max_phis : 0;
+    uint32_t outgoing = nslots;
+    nslots += (uint32_t)max_args;
+
+    int *order = eidos_malloc((fn->nblocks ? fn->nblocks : 1) * sizeof(int));
+    size_t *stubs = eidos_malloc((fn->nblocks ? fn->nblocks : 1) * sizeof(size_t));
+    if (!order || !stubs) {
+        eidos_fatal("Failed to allocate bytecode");
+    }
+    size_t nordered = ir_layout(fn, order);
+    size_t nstubs = 0;      // JZs of likely branches, pointing at their block until the stubs exist
+
+    for (size_t n = 0; n < nordered; n++) {
+        int i = order[n];
+        const IRBlock *bb = &fn->blocks[i];
+        int fallthrough = n + 1 < nordered ? order[n + 1] : -1;
+
+        block_pc[i] = (uint32_t)w->ncode;
+        for (size_t k = 0; k < bb->ninsts; k++) {
+            emit_inst(w, fn, slot, outgoing, bb->insts[k]);
+        }
+
+        switch (bb->term) {
+        case TERM_JMP:
+            emit_edge_moves(w, fn, slot, scratch, bb->id, bb->succ[0]);
+            if (bb->succ[0] != fallthrough) {
+                emit_jump(w, BC_JMP, bb->succ[0], 0);
+            }
+            break;
+        case TERM_BR: {
+            if (bb->likely > 0) {
+                // the false edge is emitted out of line, after every block
+                stubs[nstubs++] = emit(w, BC_JZ, (uint32_t)i, slot[bb->cond], 0);
+                emit_edge_moves(w, fn, slot, scratch, bb->id, bb->succ[0]);
+                if (bb->succ[0] != fallthrough) {
+                    emit_jump(w, BC_JMP, bb->succ[0], 0);
+                }
+                break;
+            }
+
+            // true edge first; the JZ skips it to the moves of the false edge
+            size_t jz = emit(w, BC_JZ, 0, slot[bb->cond], 0);
+            emit_edge_moves(w, fn, slot, scratch, bb->id, bb->succ[0]);
+            emit_jump(w, BC_JMP, bb->succ[0], 0);
+            w->code[jz].dst = (uint32_t)w->ncode;
+            emit_edge_moves(w, fn, slot, scratch, bb->id, bb->succ[1]);
+            if (bb->succ[1] != fallthrough) {
+                emit_jump(w, BC_JMP, bb->succ[1], 0);
+            }
+            break;
+        }
+        default:
+            // a function already left through the BC_RETV of its IR_RETURN
+            if (!fn->name) {
+                emit(w, BC_RET, 0, 0, 0);
+            }
+            break;
+        }
+    }
+
+    for (size_t k = 0; k < nstubs; k++) {
+        const IRBlock *bb = &fn->blocks[w->code[stubs[k]].dst];
+        w->code[stubs[k]].dst = (uint32_t)w->ncode;
+        emit_edge_moves(w, fn, slot, scratch, bb->id, bb->succ[1]);
+        emit_jump(w, BC_JMP, bb->succ[1], 0);
+    }
+
+    for (size_t j = 0; j < w->njumps; j++) {
+        BCInst *in = &w->code[w->jumps[j]];
+        in->dst = block_pc[in->dst];
+    }
+    if (w->peephole) {
+        bc_peephole(&w->code, &w->ncode, w->lines, &w->nlines, nslots, w->stats);
+        w->code_cap = w->ncode;     // the code is a new array, no bigger than that
+    }
+    append(w);
+
+    eidos_free(stubs);
+    eidos_free(order);
+    eidos_free(block_pc);
+    eidos_free(slot);
+    return nslots;
+}
+
+// writes zero bytes up to the next multiple of 8
+static int pad(FILE *out, uint64_t *pos) {
+    static const char zeros[8] = {0};
+    size_t n = (size_t)((8 - *pos % 8) % 8);
+    *pos += n;
+    return fwrite(zeros, 1, n, out) == n ? 0 : -1;
+}
+
+static int write_section(FILE *out, const void *data, size_t bytes, uint64_t *pos) {
+    if (bytes && fwrite(data, 1, bytes, out) != bytes) {
+        return -1;
+    }
+    *pos += bytes;
+    return pad(out, pos);
+}
+
+
+/* ========== PUBLIC API ========== */
+
+/*
+Writes a bytecode image
+
+args:
+    *fn (IRFunction) -> optimized function, NULL if nothing is left to run
+    *output (char) -> precomputed output, may be NULL
+    output_len (size_t) -> its length
+    peephole (int) -> 1 for instruction selection and the peephole pass
+    *stats (BCPeepholeStats) -> receives what they did, may be NULL
+    *out (FILE) -> stream the image goes to
+
+returns:
+    (int) -> 0, -1 on a write error
+*/
+int bc_write_image(const IRFunction *fn, const char *output, size_t output_len, int peephole,
+                   BCPeepholeStats *stats, FILE *out) {
+    BCWriter w;
+    BCPeepholeStats ignored;
+    memset(&w, 0, sizeof(w));
+    w.peephole = peephole;
+    w.stats = stats ? stats : &ignored;
+    memset(w.stats, 0, sizeof(BCPeepholeStats));
+    uint32_t nslots = 0;
+    size_t narrays = fn ? fn->narrays : 0;
+    int64_t *arrays = eidos_malloc((narrays ? narrays : 1) * sizeof(int64_t));
+    if (!arrays) {
+        eidos_fatal("Failed to allocate bytecode");
+    }
+    for (size_t i = 0; i < narrays; i++) {
+        arrays[i] = fn->arrays[i].size;
+    }
+
+    size_t nfuncs = fn ? fn->nfuncs : 0;
+    BCFunc *funcs = eidos_calloc(nfuncs ? nfuncs : 1, sizeof(BCFunc));
+    if (!funcs) {
+        eidos_fatal("Failed to allocate bytecode");
+    }
+    if (fn) {
+        nslots = write_function(&w, fn);
+        for (size_t i = 0; i < nfuncs; i++) {
+            funcs[i].entry = (uint32_t)w.nimage;
+            funcs[i].nslots = write_function(&w, fn->funcs[i]);
+            funcs[i].ncode = (uint32_t)(w.nimage - funcs[i].entry);
+            funcs[i].nparams = (uint32_t)fn->funcs[i]->nparams;
+        }
+    } else {
+        // a program always ends in RET, even one with no code left
+        emit(&w, BC_RET, 0, 0, 0);
+        append(&w);
+    }
+
+    BCHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, BC_MAGIC, 4);
+    h.byte_order = BC_BYTE_ORDER;
+    h.version = BC_VERSION;
+    h.nslots = nslots;
+    h.nconsts = w.nconsts;
+    h.narrays = narrays;
+    h.ncode = w.nimage;
+    h.nlines = w.nimage_lines;
+    h.nfuncs = nfuncs;
+    h.output_len = output_len;
+
+    // sizeof(BCHeader), BCInst, BCLine and BCFunc are multiples of 8, so only the tail sections pad
+    h.consts_off = sizeof(BCHeader);
+    h.arrays_off = h.consts_off + h.nconsts * sizeof(int64_t);
+    h.code_off = h.arrays_off + h.narrays * sizeof(int64_t);
+    h.lines_off = h.code_off + h.ncode * sizeof(BCInst);
+    h.funcs_off = h.lines_off + h.nlines * sizeof(BCLine);
+    h.output_off = h.funcs_off + h.nfuncs * sizeof(BCFunc);
+    h.size = h.output_off + (output_len + 7) / 8 * 8;
+
+    uint64_t pos = 0;
+    int failed = write_section(out, &h, sizeof(h), &pos);
+    failed |= write_section(out, w.consts, h.nconsts * sizeof(int64_t), &pos);
+    failed |= write_section(out, arrays, h.narrays * sizeof(int64_t), &pos);
+    failed |= write_section(out, w.image, h.ncode * sizeof(BCInst), &pos);
+    failed |= write_section(out, w.image_lines, h.nlines * sizeof(BCLine), &pos);
+    failed |= write_section(out, funcs, h.nfuncs * sizeof(BCFunc), &pos);
+    failed |= write_section(out, output, output_len, &pos);
+
+    eidos_free(funcs);
+    eidos_free(arrays);
+    eidos_free(w.code);
+    eidos_free(w.consts);
+    eidos_free(w.const_index);
+    eidos_free(w.lines);
+    eidos_free(w.jumps);
+    eidos_free(w.image);
+    eidos_free(w.image_lines);
+    return failed ? -1 : 0;
+}
+
+/*
+Prints what instruction selection and the peephole pass did
+
+args:
+    *stats (BCPeepholeStats) -> from bc_write_image
+    *out (FILE) -> stream
+*/
+void bc_print_peephole_stats(const BCPeepholeStats *stats, FILE *out) {
+    fprintf(out, "peephole: %zu muls and %zu divs by constants rewritten, %zu compares fused, "
+                 "%zu moves, %zu spills and %zu jumps removed, %zu loops inverted\n",
+            stats->muls, stats->divs, stats->fused, stats->moves, stats->spills, stats->jumps,
+            stats->inverted);
+}
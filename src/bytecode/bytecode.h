@@ -0,0 +1,270 @@
+#pragma once
+
+/*
+Bytecode images (.eidb).
+
+`eidos compile file.e -o file.eidb` lowers the optimized IR to a register
+bytecode and writes it as one position-independent image; `eidos run
+file.eidb` maps the file read-only and executes it in place. Nothing in an
+image is a pointer: sections are found through offsets from the start of the
+file and jumps name instruction indices, so the mapped bytes are used as-is
+with no parsing or relocation.
+
+Layout, every section 8-byte aligned, integers in host byte order:
+
+    BCHeader
+    int64_t  consts[nconsts]        constant pool
+    int64_t  arrays[narrays]        element count of every array, zero-filled
+                                    by the VM before the code runs
+    BCInst   code[ncode]            instructions
+    BCLine   lines[nlines]          source positions of instructions that can
+                                    fail, sorted by pc
+    BCFunc   funcs[nfuncs]          user functions, indexed by BC_CALL's a
+    char     output[output_len]     precomputed output (partial_eval.h),
+                                    written before the code runs
+
+Every SSA value gets its own slot; slots start at 0 like source variables.
+
+The code of the program runs from 0 to the entry of the first function, and
+the functions follow one after the other. Each function has its own slots
+(parameters first), a window of one stack of slots: BC_CALL copies nothing,
+the caller moves the arguments to the end of its own slots and the callee's
+slot 0 starts there. The VM keeps that stack and its return frames for the
+whole run, so a call allocates nothing once they have grown.
+
+The VM (BCVM) keeps all of a run's state outside the C stack, so it can stop
+and go on later: bc_vm_resume runs for a budget of instructions, or until
+read() needs input that hasn't been fed, and returns. `eidos run` resumes it
+until the program ends; the scheduler (driver/sched.h) takes turns among
+thousands of them.
+
+Unless turned off (--no-peephole), the writer picks cheaper instructions for
+multiplication and division by constants, and a peephole pass (peephole.h)
+cleans up the finished code before it is written.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include "../ir/ir.h"
+
+#define BC_MAGIC "EIDB"
+#define BC_VERSION 4
+#define BC_BYTE_ORDER 0x01020304u  // reads differently on a host of the other endianness
+
+typedef enum BCOp {
+    BC_CONST,       // slot[dst] = consts[a]
+    BC_MOV,         // slot[dst] = slot[a]
+    BC_ADD,         // slot[dst] = slot[a] + slot[b]
+    BC_SUB,
+    BC_MUL,
+    BC_DIV,         // traps on slot[b] == 0
+    BC_SHL,         // slot[dst] = slot[a] << shift, a multiplication by 2^shift
+    BC_DIVP,        // slot[dst] = slot[a] / 2^shift, 1 <= shift <= 62
+    BC_DIVM,        // slot[dst] = slot[a] / d for a constant d > 1, by multiplying by consts[b] (bc_vm.c)
+    BC_NEG,         // slot[dst] = -slot[a]
+    BC_NOT,         // slot[dst] = !slot[a]
+    BC_CMP,         // slot[dst] = slot[a] <cmp> slot[b]
+    BC_READ,        // slot[dst] = next integer of input
+    BC_PRINT,       // prints slot[a]
+    BC_LOAD,        // slot[dst] = array b[slot[a]], traps when out of bounds
+    BC_STORE,       // array dst[slot[a]] = slot[b], traps like BC_LOAD
+    BC_JMP,         // pc = dst
+    BC_JZ,          // if slot[a] == 0, pc = dst
+    BC_JCMP,        // if slot[a] <cmp> slot[b], pc = dst
+    BC_CALL,        // slot[dst] = funcs[a](slot[b] .. slot[b + shift - 1]), traps past IR_MAX_CALL_DEPTH
+    BC_RETV,        // returns slot[a] from a function
+    BC_RET,         // end of program
+    BC_OP_COUNT,    // number of ops, not an op
+} BCOp;
+
+typedef struct BCInst {
+    uint8_t op;     // BCOp
+    uint8_t cmp;    // CmpOp of BC_CMP and BC_JCMP
+    uint8_t shift;  // of BC_SHL, BC_DIVP and BC_DIVM; argument count of BC_CALL
+    uint8_t unused;
+    uint32_t dst;   // destination slot, or jump target
+    uint32_t a;
+    uint32_t b;
+} BCInst;
+
+typedef struct BCLine {
+    uint32_t pc;
+    uint32_t line;
+    uint32_t col;
+    uint32_t unused;
+} BCLine;
+
+typedef struct BCFunc {
+    uint32_t entry;         // pc of its first instruction
+    uint32_t ncode;         // its code is code[entry .. entry + ncode - 1]
+    uint32_t nslots;
+    uint32_t nparams;       // slots 0 .. nparams - 1 on entry
+} BCFunc;
+
+typedef struct BCHeader {
+    char magic[4];          // BC_MAGIC
+    uint32_t byte_order;    // BC_BYTE_ORDER
+    uint32_t version;       // BC_VERSION
+    uint32_t nslots;        // of the program's own code
+    uint64_t size;          // whole image, in bytes
+    uint64_t consts_off;
+    uint64_t nconsts;
+    uint64_t arrays_off;
+    uint64_t narrays;
+    uint64_t code_off;
+    uint64_t ncode;
+    uint64_t lines_off;
+    uint64_t nlines;
+    uint64_t output_off;
+    uint64_t output_len;
+    uint64_t funcs_off;
+    uint64_t nfuncs;
+} BCHeader;
+
+// An image mapped (or read) into memory
+typedef struct BCImage {
+    const BCHeader *header;
+    const int64_t *consts;
+    const int64_t *arrays;  // sizes
+    const BCInst *code;
+    const BCLine *lines;
+    const BCFunc *funcs;
+    const char *output;
+    size_t size;
+    int mapped;             // 1 if header points at an mmap of the file
+} BCImage;
+
+
+// output a BCVM holds before it yields for its owner to take it
+#define BC_VM_OUTPUT_LIMIT (1 << 16)
+
+// Why bc_vm_resume returned
+typedef enum BCVMStatus {
+    BC_VM_DONE,             // the program ended
+    BC_VM_ERROR,            // it stopped on a runtime error, see BCVM.error
+    BC_VM_YIELD,            // the budget ran out, or output is waiting; resume to go on
+    BC_VM_BLOCKED,          // read() needs input that hasn't been fed yet
+} BCVMStatus;
+
+typedef struct BCFrame {
+    uint32_t pc;            // of the BC_CALL
+    uint32_t dst;           // caller slot receiving the result
+    size_t base;            // of the caller's slots in the stack
+} BCFrame;
+
+/*
+A program run a slice at a time. Everything it needs between slices is in
+here, so any thread may resume it, one at a time, and it can wait for input
+without holding one.
+*/
+typedef struct BCVM {
+    const BCImage *image;
+    uint32_t pc;            // next instruction
+    uint64_t executed;      // instructions so far
+    BCVMStatus status;      // BC_VM_DONE or BC_VM_ERROR once it has finished
+
+    int64_t *stack;         // every frame's slots are a window of it
+    size_t stack_cap;
+    size_t base;            // of the running function's slots
+    BCFrame *frames;        // calls waiting for a BC_RETV, kept for the next call
+    size_t depth;
+    size_t frames_cap;
+    int64_t **arrays;
+
+    char *input;            // fed, unread from input_pos on
+    size_t input_len;
+    size_t input_pos;
+    size_t input_cap;
+    int input_closed;       // nothing more will be fed: read() at the end fails
+
+    char *output;           // printed and not taken yet: the owner writes out
+    size_t output_len;      // output[0 .. output_len - 1] and sets output_len to 0
+    size_t output_cap;
+    size_t output_limit;    // yields once this much is waiting, BC_VM_OUTPUT_LIMIT by default
+
+    char error[160];        // "Runtime Error at line L, column C: ...\n"
+} BCVM;
+
+// What the instruction selection and the peephole pass did (--stats)
+typedef struct BCPeepholeStats {
+    size_t muls;            // multiplications by constants turned into shifts, moves or negations
+    size_t divs;            // divisions by constants that no longer divide
+    size_t fused;           // compares merged into the branch that tests them
+    size_t moves;           // moves removed, results computed straight into their slot
+    size_t spills;          // phi moves that no longer go through scratch slots
+    size_t jumps;           // jumps removed or sent straight to their final target
+    size_t inverted;        // loops that test their condition at the bottom
+} BCPeepholeStats;
+
+
+/* ========== Public API Functions ========== */
+
+/*
+Lowers an optimized program and its functions to an image and writes it to
+`out`. `fn` may be NULL when the whole program was precomputed. With `peephole` 0 the code is
+lowered one instruction per IR instruction. `stats` may be NULL. Returns 0,
+or -1 on a write error.
+*/
+int bc_write_image(const IRFunction *fn, const char *output, size_t output_len, int peephole,
+                   BCPeepholeStats *stats, FILE *out);
+
+/*
+Prints "peephole: ..." statistics
+*/
+void bc_print_peephole_stats(const BCPeepholeStats *stats, FILE *out);
+
+/*
+1 if the file starts with the image magic (so `eidos run` knows what it got)
+*/
+int bc_is_image(const char *path);
+
+/*
+Maps an image read-only and checks that every offset, slot and jump target in
+it is in bounds. Returns 0, or -1 after reporting what is wrong with the file.
+*/
+int bc_load_image(const char *path, BCImage *image);
+
+/*
+Checks an image that is already in memory (8-byte aligned) like
+bc_load_image; the image points into `data`. Returns 0, or -1 after reporting
+what is wrong.
+*/
+int bc_open_image(const void *data, size_t size, const char *name, BCImage *image);
+
+/*
+Unmaps an image
+*/
+void bc_unload_image(BCImage *image);
+
+/*
+Starts a program on a verified image, which must outlive the VM. Its
+precomputed output is waiting in vm->output.
+*/
+void bc_vm_init(BCVM *vm, const BCImage *image);
+
+/*
+Releases what a VM holds
+*/
+void bc_vm_free(BCVM *vm);
+
+/*
+Adds input for read(); a read() only takes an integer once a character
+after it, or bc_vm_close_input, shows it is complete
+*/
+void bc_vm_feed(BCVM *vm, const char *data, size_t len);
+void bc_vm_close_input(BCVM *vm);
+
+/*
+Runs until the program ends or fails, `budget` instructions (0 for no limit)
+have run, output reaches vm->output_limit, or read() runs out of input.
+The budget is checked at jumps and calls, so a slice can run over it by a
+straight run of code. A finished VM keeps returning its status.
+*/
+BCVMStatus bc_vm_resume(BCVM *vm, uint64_t budget);
+
+/*
+Runs an image reading from `in` and printing to `out`. Returns 0, 1 after
+reporting a runtime error, or 2 when `max_insts` (0 for no limit) ran out.
+`insts_executed` may be NULL.
+*/
+int bc_run_image(const BCImage *image, FILE *in, FILE *out, uint64_t max_insts, uint64_t *insts_executed);
@@ -0,0 +1,399 @@
+#include "peephole.h"
+#include "../util/context.h"
+#include <stdlib.h>
+#include <string.h>
+
+// a jump cycle like `JMP a; a: JMP b; b: JMP a` would keep threading forever
+#define PEEPHOLE_MAX_ROUNDS 16
+
+// how far ahead a result looks for the MOV copying it
+#define PEEPHOLE_WINDOW 8
+
+// longest run of instructions copied in place of a jump to it
+#define PEEPHOLE_MAX_TAIL 8
+
+// One round over the code. Rules read the code as it was when the round started.
+typedef struct Round {
+    const BCInst *c;
+    size_t n;
+    uint32_t *reads;        // per slot, instructions reading it
+    char *target;           // per instruction, 1 if a jump goes to it
+    char *has_line;         // per instruction, 1 if it can fail
+    char *gone;             // per instruction, 1 once a rule removed it
+    size_t *first;          // per instruction (and n), where it went in out
+
+    BCInst *out;            // the new code, jumps still naming old indices
+    size_t nout;
+    size_t cap;
+    size_t limit;           // no tail is copied once out could grow past this
+
+    BCPeepholeStats *stats;
+    size_t changes;
+} Round;
+
+/* ===== Helper Functions ===== */
+
+static int is_jump(BCOp op) {
+    return op == BC_JMP || op == BC_JZ || op == BC_JCMP;
+}
+
+// 1 if the instruction writes slot dst
+static int writes_slot(BCOp op) {
+    switch (op) {
+    case BC_CONST: case BC_MOV: case BC_ADD: case BC_SUB: case BC_MUL: case BC_DIV:
+    case BC_SHL: case BC_DIVP: case BC_DIVM: case BC_NEG: case BC_NOT: case BC_CMP:
+    case BC_READ: case BC_LOAD: case BC_CALL:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// 1 if the instruction reads slot s
+static int reads_slot(const BCInst *in, uint32_t s) {
+    switch ((BCOp)in->op) {
+    case BC_ADD: case BC_SUB: case BC_MUL: case BC_DIV: case BC_CMP:
+    case BC_STORE: case BC_JCMP:
+        return in->a == s || in->b == s;
+    case BC_MOV: case BC_NEG: case BC_NOT: case BC_SHL: case BC_DIVP: case BC_DIVM:
+    case BC_PRINT: case BC_LOAD: case BC_JZ: case BC_RETV:
+        return in->a == s;
+    case BC_CALL:
+        return s >= in->b && s - in->b < in->shift;
+    default:
+        return 0;
+    }
+}
+
+static void count_reads(const BCInst *in, uint32_t *reads) {
+    switch ((BCOp)in->op) {
+    case BC_ADD: case BC_SUB: case BC_MUL: case BC_DIV: case BC_CMP:
+    case BC_STORE: case BC_JCMP:
+        reads[in->a]++;
+        reads[in->b]++;
+        break;
+    case BC_MOV: case BC_NEG: case BC_NOT: case BC_SHL: case BC_DIVP: case BC_DIVM:
+    case BC_PRINT: case BC_LOAD: case BC_JZ: case BC_RETV:
+        reads[in->a]++;
+        break;
+    case BC_CALL:
+        for (uint32_t k = 0; k < in->shift; k++) {
+            reads[in->b + k]++;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+// the comparison that holds exactly when `cmp` doesn't
+static uint8_t negate(uint8_t cmp) {
+    switch ((CmpOp)cmp) {
+    case CMP_EQ: return CMP_NE;
+    case CMP_NE: return CMP_EQ;
+    case CMP_LT: return CMP_GE;
+    case CMP_GE: return CMP_LT;
+    case CMP_GT: return CMP_LE;
+    case CMP_LE: return CMP_GT;
+    }
+    return cmp;
+}
+
+static void push(Round *r, const BCInst *in) {
+    if (r->nout == r->cap) {
+        r->cap = r->cap ? r->cap * 2 : 64;
+        r->out = eidos_realloc(r->out, r->cap * sizeof(BCInst));
+        if (!r->out) {
+            eidos_fatal("Failed to allocate bytecode");
+        }
+    }
+    r->out[r->nout++] = *in;
+}
+
+/*
+t = x + y; ...; MOV v, t  =>  v = x + y; ...
+when nothing else reads t and nothing in between touches v
+
+args:
+    *r (Round) -> the round
+    pc (size_t) -> index of the instruction writing t
+    *in (BCInst) -> its copy, retargeted to v
+
+returns:
+    (int) -> 1 if the rule applied and the MOV is gone
+*/
+static int fold_move(Round *r, size_t pc, BCInst *in) {
+    uint32_t t = in->dst;
+    if (r->reads[t] != 1) {
+        return 0;
+    }
+    for (size_t k = pc + 1; k < r->n && k <= pc + PEEPHOLE_WINDOW; k++) {
+        const BCInst *next = &r->c[k];
+        // a call overwrites the slots past its arguments, a return leaves the function
+        if (r->target[k] || r->gone[k] || is_jump((BCOp)next->op) || next->op == BC_RET ||
+            next->op == BC_CALL || next->op == BC_RETV) {
+            return 0;
+        }
+        if (!reads_slot(next, t)) {
+            continue;
+        }
+        if (next->op != BC_MOV || next->dst == t) {
+            return 0;
+        }
+        uint32_t v = next->dst;
+        for (size_t j = pc + 1; j < k; j++) {
+            if (reads_slot(&r->c[j], v) || (writes_slot((BCOp)r->c[j].op) && r->c[j].dst == v)) {
+                return 0;
+            }
+        }
+        in->dst = v;
+        r->gone[k] = 1;
+        return 1;
+    }
+    return 0;
+}
+
+/*
+JMP H back to `H: JCMP -> X` testing the loop condition  =>  a copy of the
+test branching back into the loop, then a JMP out of it
+
+returns:
+    (int) -> 1 if the copy replaced the JMP at pc
+*/
+static int invert_loop(Round *r, size_t pc, const BCInst *in) {
+    uint32_t h = in->dst;
+    if (h >= pc || r->c[h].op != BC_JCMP) {
+        return 0;
+    }
+    BCInst test = r->c[h];
+    BCInst leave = { .op = BC_JMP };
+    uint32_t fall = h + 1;
+    if (r->c[fall].op == BC_JMP) {
+        fall = r->c[fall].dst;
+    }
+
+    if (test.dst > h && test.dst <= pc) {
+        leave.dst = fall;
+    } else {
+        leave.dst = test.dst;
+        test.cmp = negate(test.cmp);
+        test.dst = h + 1;
+    }
+    // the JMP must leave the loop, or the next round would invert it again
+    if (leave.dst >= h && leave.dst <= pc) {
+        return 0;
+    }
+    push(r, &test);
+    push(r, &leave);
+    r->stats->inverted++;
+    return 1;
+}
+
+/*
+JMP L to a short run of instructions ending in a JMP, RET or RETV  =>  a copy of
+the run, unless the run holds the JMP itself or something that can fail
+
+returns:
+    (int) -> 1 if the copy replaced the JMP at pc
+*/
+static int duplicate_tail(Round *r, size_t pc, const BCInst *in) {
+    size_t start = in->dst;
+    size_t end = start;
+    while (end < r->n && r->c[end].op != BC_JMP && r->c[end].op != BC_RET && r->c[end].op != BC_RETV) {
+        if (end - start == PEEPHOLE_MAX_TAIL || is_jump((BCOp)r->c[end].op) || r->has_line[end]) {
+            return 0;
+        }
+        end++;
+    }
+    if (end == r->n || (pc >= start && pc <= end) || r->nout + (r->n - pc) + (end - start) > r->limit) {
+        return 0;
+    }
+    for (size_t k = start; k <= end; k++) {
+        push(r, &r->c[k]);
+    }
+    r->stats->jumps++;
+    return 1;
+}
+
+/*
+One pass of every rule over the code
+
+args:
+    *r (Round) -> the code, zeroed scratch, and where the new code goes
+
+returns:
+    (size_t) -> number of rewrites
+*/
+static size_t round_once(Round *r) {
+    const BCInst *c = r->c;
+    size_t n = r->n;
+    BCPeepholeStats *stats = r->stats;
+    int unreachable = 0;        // nothing falls through into the next instruction
+
+    for (size_t pc = 0; pc < n; pc++) {
+        count_reads(&c[pc], r->reads);
+        if (is_jump((BCOp)c[pc].op)) {
+            r->target[c[pc].dst] = 1;
+        }
+    }
+
+    for (size_t pc = 0; pc < n; pc++) {
+        BCInst in = c[pc];
+        BCOp op = (BCOp)in.op;
+        const BCInst *next = pc + 1 < n && !r->target[pc + 1] ? &c[pc + 1] : NULL;
+        r->first[pc] = r->nout;
+        if (r->gone[pc]) {
+            continue;
+        }
+        if (r->target[pc]) {
+            unreachable = 0;
+        }
+
+        // code nothing reaches
+        if (unreachable) {
+            r->gone[pc] = 1;
+            r->changes++;
+            continue;
+        }
+
+        // moves to itself, values nobody reads
+        if ((op == BC_MOV && in.dst == in.a) || ((op == BC_CONST || op == BC_MOV) && r->reads[in.dst] == 0)) {
+            r->gone[pc] = 1;
+            stats->moves++;
+            r->changes++;
+            continue;
+        }
+
+        // CMP t = a < b; JZ t -> L  =>  JCMP a >= b -> L
+        if (op == BC_CMP && next && next->op == BC_JZ && next->a == in.dst && r->reads[in.dst] == 1) {
+            in.op = BC_JCMP;
+            in.cmp = negate(in.cmp);
+            in.dst = next->dst;
+            push(r, &in);
+            r->first[++pc] = r->nout - 1;
+            r->gone[pc] = 1;
+            stats->fused++;
+            r->changes++;
+            continue;
+        }
+
+        if (writes_slot(op) && fold_move(r, pc, &in)) {
+            push(r, &in);
+            stats->moves++;
+            r->changes++;
+            continue;
+        }
+
+        if (is_jump(op)) {
+            // JCMP a < b -> pc + 2; JMP L  =>  JCMP a >= b -> L
+            if (op == BC_JCMP && in.dst == pc + 2 && next && next->op == BC_JMP) {
+                in.cmp = negate(in.cmp);
+                in.dst = next->dst;
+                push(r, &in);
+                r->first[++pc] = r->nout - 1;
+                r->gone[pc] = 1;
+                stats->jumps++;
+                r->changes++;
+                continue;
+            }
+            if (in.dst == pc + 1) {
+                r->gone[pc] = 1;
+                stats->jumps++;
+                r->changes++;
+                continue;
+            }
+            if (c[in.dst].op == BC_JMP && c[in.dst].dst != in.dst) {
+                in.dst = c[in.dst].dst;
+                stats->jumps++;
+                r->changes++;
+            }
+        }
+
+        if (op == BC_JMP && (invert_loop(r, pc, &in) || duplicate_tail(r, pc, &in))) {
+            unreachable = 1;
+            r->changes++;
+            continue;
+        }
+
+        push(r, &in);
+        unreachable = op == BC_JMP || op == BC_RET || op == BC_RETV;
+    }
+    r->first[n] = r->nout;
+    return r->changes;
+}
+
+
+/* ========== PUBLIC API ========== */
+
+/*
+Runs the peephole rules until none applies
+
+args:
+    **code (BCInst) -> instructions, jumps naming instruction indices
+    *ncode (size_t) -> their count, updated
+    *lines (BCLine) -> line table sorted by pc, updated
+    *nlines (size_t) -> its length, updated
+    nslots (uint32_t) -> slots the code uses
+    *stats (BCPeepholeStats) -> counts what changed, may be NULL
+*/
+void bc_peephole(BCInst **code, size_t *ncode, BCLine *lines, size_t *nlines, uint32_t nslots,
+                 BCPeepholeStats *stats) {
+    BCPeepholeStats ignored;
+    if (!stats) {
+        memset(&ignored, 0, sizeof(ignored));
+        stats = &ignored;
+    }
+    size_t limit = *ncode + *ncode / 2 + PEEPHOLE_MAX_TAIL;
+
+    for (int round = 0; round < PEEPHOLE_MAX_ROUNDS; round++) {
+        size_t n = *ncode;
+        Round r;
+        memset(&r, 0, sizeof(r));
+        r.c = *code;
+        r.n = n;
+        r.limit = limit;
+        r.stats = stats;
+        r.cap = n + n / 4 + 1;
+        r.out = eidos_malloc(r.cap * sizeof(BCInst));
+        r.reads = eidos_calloc(nslots ? nslots : 1, sizeof(uint32_t));
+        r.target = eidos_calloc(n ? n : 1, 1);
+        r.has_line = eidos_calloc(n ? n : 1, 1);
+        r.gone = eidos_calloc(n ? n : 1, 1);
+        r.first = eidos_malloc((n + 1) * sizeof(size_t));
+        if (!r.out || !r.reads || !r.target || !r.has_line || !r.gone || !r.first) {
+            eidos_fatal("Failed to allocate bytecode");
+        }
+        for (size_t i = 0; i < *nlines; i++) {
+            r.has_line[lines[i].pc] = 1;
+        }
+
+        size_t changes = round_once(&r);
+
+        for (size_t pc = 0; pc < r.nout; pc++) {
+            if (is_jump((BCOp)r.out[pc].op)) {
+                r.out[pc].dst = (uint32_t)r.first[r.out[pc].dst];
+            }
+        }
+        // an instruction that can fail only goes when nothing reaches it, and its entry with it
+        size_t kept = 0;
+        for (size_t i = 0; i < *nlines; i++) {
+            if (!r.gone[lines[i].pc]) {
+                lines[kept] = lines[i];
+                lines[kept++].pc = (uint32_t)r.first[lines[i].pc];
+            }
+        }
+        *nlines = kept;
+
+        eidos_free(*code);
+        *code = r.out;
+        *ncode = r.nout;
+        eidos_free(r.first);
+        eidos_free(r.gone);
+        eidos_free(r.has_line);
+        eidos_free(r.target);
+        eidos_free(r.reads);
+        if (!changes) {
+            break;
+        }
+    }
+}
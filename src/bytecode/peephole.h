@@ -0,0 +1,40 @@
+#pragma once
+
+/*
+Peephole pass over the finished bytecode of a program or of one of its
+functions, once every jump names the instruction it goes to.
+
+The writer lowers one IR instruction at a time, so its output has patterns
+no single instruction can see:
+
+- a compare whose only use is the JZ right after it: both become a JCMP
+  with the opposite comparison;
+- a JCMP that skips over a JMP: the JCMP takes the JMP's target with its
+  comparison turned around, the JMP goes;
+- a result computed into a slot that is only copied to another one (the
+  phi moves at the end of a loop body): computed straight into the other;
+- moves of a slot to itself, constants and moves nobody reads, code
+  nothing jumps or falls into;
+- jumps to the next instruction, and jumps to a JMP, which go to its target;
+- a JMP to a short run of instructions ending in a JMP, RET or RETV (a
+  loop's increment, laid out after the loop): a copy of the run;
+- a loop whose body jumps back to a JCMP testing the loop condition: the
+  body ends with a copy of the test instead, so a round of the loop costs
+  one jump.
+
+Rules apply until none does. Only the instructions with a line entry can
+fail; none is copied, and one is only removed with its entry when nothing
+reaches it, so every runtime error keeps its position.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bytecode.h"
+
+/*
+Rewrites code[ncode] (replacing the eidos_malloc'd array) and moves the pcs
+of the line table lines[nlines] with it, counting what it did in `stats`,
+which may be NULL
+*/
+void bc_peephole(BCInst **code, size_t *ncode, BCLine *lines, size_t *nlines, uint32_t nslots,
+                 BCPeepholeStats *stats);
@@ -0,0 +1,1539 @@
+#include "c_backend.h"
+#include "../ir/parloop.h"
+#include "../ir/vecloop.h"
+#include "../util/context.h"
+#include <inttypes.h>
+
+// buffered print()/read(), src/runtime/eidos_io.h as a string (see the makefile)
+static const char *io_runtime =
+#include "eidos_io.inc"
+    ;
+
+// runtime the generated code relies on, semantics match src/util/arith.h
+static const char *runtime_globals =
+    "#include <stdlib.h>\n"
+    "\n"
+    "static EidosOut eidos_out;\n"
+    "static EidosIn eidos_in;\n"
+    "\n";
+
+static const char *runtime_trap =
+    "static void eidos_trap(int line, int col, const char *message) {\n"
+    "    eidos_out_flush(&eidos_out);\n"
+    "    fprintf(stderr, \"Runtime Error at line %d, column %d: %s\\n\", line, col, message);\n"
+    "    exit(1);\n"
+    "}\n"
+    "\n";
+
+// with parallel loops a trap on a worker thread stops its chunk, eidos_parallel_for reports it in order
+static const char *runtime_parallel_trap =
+    "#include <pthread.h>\n"
+    "#include <setjmp.h>\n"
+    "\n"
+    "typedef struct EidosChunk {\n"
+    "    int64_t first;          // induction variable of its first iteration\n"
+    "    uint64_t count;         // iterations\n"
+    "    char *text;             // its output\n"
+    "    size_t len;\n"
+    "    int trapped;            // it stopped at a runtime error\n"
+    "    int line;\n"
+    "    int col;\n"
+    "    const char *message;\n"
+    "    jmp_buf stop;\n"
+    "} EidosChunk;\n"
+    "\n"
+    "// chunk running on this thread, NULL outside parallel loops\n"
+    "static _Thread_local EidosChunk *eidos_chunk;\n"
+    "\n"
+    "static void eidos_trap(int line, int col, const char *message) {\n"
+    "    if (eidos_chunk) {\n"
+    "        eidos_chunk->trapped = 1;\n"
+    "        eidos_chunk->line = line;\n"
+    "        eidos_chunk->col = col;\n"
+    "        eidos_chunk->message = message;\n"
+    "        longjmp(eidos_chunk->stop, 1);\n"
+    "    }\n"
+    "    eidos_out_flush(&eidos_out);\n"
+    "    fprintf(stderr, \"Runtime Error at line %d, column %d: %s\\n\", line, col, message);\n"
+    "    exit(1);\n"
+    "}\n"
+    "\n";
+
+static const char *runtime_prelude =
+    "static inline int64_t eidos_div(int64_t a, int64_t b, int line, int col) {\n"
+    "    if (b == 0) {\n"
+    "        eidos_trap(line, col, \"division by zero\");\n"
+    "    }\n"
+    "    if (a == INT64_MIN && b == -1) {\n"
+    "        return INT64_MIN;\n"
+    "    }\n"
+    "    return a / b;\n"
+    "}\n"
+    "\n"
+    "static inline int64_t eidos_read(int line, int col) {\n"
+    "    int64_t x = 0;\n"
+    "    switch (eidos_read_int(&eidos_in, &x)) {\n"
+    "    case EIDOS_READ_NONE:\n"
+    "        eidos_trap(line, col, \"read() expected an integer\");\n"
+    "        break;\n"
+    "    case EIDOS_READ_RANGE:\n"
+    "        eidos_trap(line, col, \"read() integer out of range\");\n"
+    "        break;\n"
+    "    }\n"
+    "    return x;\n"
+    "}\n"
+    "\n"
+    "static inline int64_t eidos_index(int64_t i, int64_t size, int line, int col) {\n"
+    "    if ((uint64_t)i >= (uint64_t)size) {\n"
+    "        eidos_trap(line, col, \"array index out of bounds\");\n"
+    "    }\n"
+    "    return i;\n"
+    "}\n"
+    "\n"
+    "#define WRAP(a, op, b) ((int64_t)((uint64_t)(a) op (uint64_t)(b)))\n"
+    "\n"
+    "// branch hints from a recorded profile\n"
+    "#if defined(__GNUC__)\n"
+    "#define EIDOS_EXPECT(x, v) __builtin_expect((x) != 0, v)\n"
+    "#else\n"
+    "#define EIDOS_EXPECT(x, v) ((x) != 0)\n"
+    "#endif\n";
+
+// --parallel-loops: runs a loop's iterations in chunks on threads, in rounds of one chunk per thread
+static const char *runtime_parallel =
+    "\n"
+    "#define EIDOS_PAR_MIN_CHUNK 1024\n"
+    "#define EIDOS_PAR_MAX_CHUNK 65536\n"
+    "\n"
+    "typedef void (*EidosChunkFn)(const int64_t *env, int64_t first, uint64_t count, EidosOut *out);\n"
+    "\n"
+    "typedef struct EidosParFor {\n"
+    "    EidosChunkFn fn;\n"
+    "    const int64_t *env;\n"
+    "    EidosChunk *chunks;     // one per thread\n"
+    "    size_t nchunks;         // chunks of the current round\n"
+    "    int finished;\n"
+    "    pthread_barrier_t start;\n"
+    "    pthread_barrier_t done;\n"
+    "} EidosParFor;\n"
+    "\n"
+    "typedef struct EidosParWorker {\n"
+    "    EidosParFor *par;\n"
+    "    size_t index;\n"
+    "    pthread_t thread;\n"
+    "} EidosParWorker;\n"
+    "\n"
+    "static void eidos_par_fail(void) {\n"
+    "    eidos_out_flush(&eidos_out);\n"
+    "    fprintf(stderr, \"Runtime Error: could not run a parallel loop\\n\");\n"
+    "    exit(1);\n"
+    "}\n"
+    "\n"
+    "// EIDOS_THREADS, or one thread per online CPU\n"
+    "static size_t eidos_par_threads(void) {\n"
+    "    const char *env = getenv(\"EIDOS_THREADS\");\n"
+    "    long n = env ? strtol(env, NULL, 10) : sysconf(_SC_NPROCESSORS_ONLN);\n"
+    "    return n > 0 ? (size_t)n : 1;\n"
+    "}\n"
+    "\n"
+    "// iterations of `for (i = first; i < bound; i += step)` (<= if inclusive), 0 if too few or if i could wrap\n"
+    "static uint64_t eidos_par_trips(int64_t first, int64_t bound, int64_t step, int inclusive, uint64_t min) {\n"
+    "    if (bound > INT64_MAX - step || (inclusive ? first > bound : first >= bound)) {\n"
+    "        return 0;\n"
+    "    }\n"
+    "    uint64_t span = (uint64_t)bound - (uint64_t)first;\n"
+    "    uint64_t trips = inclusive ? span / (uint64_t)step + 1 : (span - 1) / (uint64_t)step + 1;\n"
+    "    return trips >= min ? trips : 0;\n"
+    "}\n"
+    "\n"
+    "static void eidos_run_chunk(EidosParFor *par, EidosChunk *chunk) {\n"
+    "    EidosOut *out = malloc(sizeof(EidosOut));\n"
+    "    FILE *text = open_memstream(&chunk->text, &chunk->len);\n"
+    "    if (!out || !text) {\n"
+    "        eidos_par_fail();\n"
+    "    }\n"
+    "    eidos_out_init(out, text);\n"
+    "\n"
+    "    chunk->trapped = 0;\n"
+    "    eidos_chunk = chunk;\n"
+    "    if (setjmp(chunk->stop) == 0) {\n"
+    "        par->fn(par->env, chunk->first, chunk->count, out);\n"
+    "    }\n"
+    "    eidos_chunk = NULL;\n"
+    "\n"
+    "    eidos_out_flush(out);\n"
+    "    fclose(text);\n"
+    "    free(out);\n"
+    "}\n"
+    "\n"
+    "static void *eidos_par_work(void *arg) {\n"
+    "    EidosParWorker *w = arg;\n"
+    "    for (;;) {\n"
+    "        pthread_barrier_wait(&w->par->start);\n"
+    "        if (w->par->finished) {\n"
+    "            return NULL;\n"
+    "        }\n"
+    "        if (w->index < w->par->nchunks) {\n"
+    "            eidos_run_chunk(w->par, &w->par->chunks[w->index]);\n"
+    "        }\n"
+    "        pthread_barrier_wait(&w->par->done);\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "/*\n"
+    "Runs `trips` iterations starting at `first`. Each round gives every thread a\n"
+    "chunk of consecutive iterations, then writes the chunks' output in order, so\n"
+    "the program prints what the sequential loop prints. A runtime error is\n"
+    "reported after the output of the iterations before it, and nothing after.\n"
+    "*/\n"
+    "static void eidos_parallel_for(EidosChunkFn fn, const int64_t *env, int64_t first, int64_t step,\n"
+    "                               uint64_t trips) {\n"
+    "    size_t threads = eidos_par_threads();\n"
+    "    uint64_t size = trips / (threads * 4);\n"
+    "    size = size < EIDOS_PAR_MIN_CHUNK ? EIDOS_PAR_MIN_CHUNK : size > EIDOS_PAR_MAX_CHUNK ? EIDOS_PAR_MAX_CHUNK : size;\n"
+    "\n"
+    "    EidosParFor par;\n"
+    "    par.fn = fn;\n"
+    "    par.env = env;\n"
+    "    par.finished = 0;\n"
+    "    par.chunks = calloc(threads, sizeof(EidosChunk));\n"
+    "    EidosParWorker *workers = calloc(threads, sizeof(EidosParWorker));\n"
+    "    if (!par.chunks || !workers) {\n"
+    "        eidos_par_fail();\n"
+    "    }\n"
+    "    pthread_barrier_init(&par.start, NULL, (unsigned)threads);\n"
+    "    pthread_barrier_init(&par.done, NULL, (unsigned)threads);\n"
+    "\n"
+    "    // this thread runs chunk 0 of every round\n"
+    "    for (size_t t = 1; t < threads; t++) {\n"
+    "        workers[t].par = &par;\n"
+    "        workers[t].index = t;\n"
+    "        if (pthread_create(&workers[t].thread, NULL, eidos_par_work, &workers[t]) != 0) {\n"
+    "            eidos_par_fail();\n"
+    "        }\n"
+    "    }\n"
+    "\n"
+    "    uint64_t done = 0;\n"
+    "    while (done < trips) {\n"
+    "        par.nchunks = 0;\n"
+    "        for (size_t t = 0; t < threads && done < trips; t++) {\n"
+    "            EidosChunk *chunk = &par.chunks[t];\n"
+    "            chunk->first = (int64_t)((uint64_t)first + done * (uint64_t)step);\n"
+    "            chunk->count = trips - done < size ? trips - done : size;\n"
+    "            done += chunk->count;\n"
+    "            par.nchunks++;\n"
+    "        }\n"
+    "\n"
+    "        pthread_barrier_wait(&par.start);\n"
+    "        eidos_run_chunk(&par, &par.chunks[0]);\n"
+    "        pthread_barrier_wait(&par.done);\n"
+    "\n"
+    "        for (size_t t = 0; t < par.nchunks; t++) {\n"
+    "            EidosChunk *chunk = &par.chunks[t];\n"
+    "            eidos_out_write(&eidos_out, chunk->text, chunk->len);\n"
+    "            free(chunk->text);\n"
+    "            if (chunk->trapped) {\n"
+    "                eidos_trap(chunk->line, chunk->col, chunk->message);\n"
+    "            }\n"
+    "        }\n"
+    "        if (eidos_out.line_buffered) {\n"
+    "            eidos_out_flush(&eidos_out);\n"
+    "        }\n"
+    "    }\n"
+    "\n"
+    "    par.finished = 1;\n"
+    "    pthread_barrier_wait(&par.start);\n"
+    "    for (size_t t = 1; t < threads; t++) {\n"
+    "        pthread_join(workers[t].thread, NULL);\n"
+    "    }\n"
+    "    pthread_barrier_destroy(&par.start);\n"
+    "    pthread_barrier_destroy(&par.done);\n"
+    "    free(workers);\n"
+    "    free(par.chunks);\n"
+    "}\n";
+
+// vector kernels (ir/vecloop.h), with the GCC vector extensions
+static const char *runtime_vector =
+    "\n"
+    "#if defined(__GNUC__)\n"
+    "#include <string.h>\n"
+    "\n"
+    "// one AVX2 register, or one SSE2 register when the target has no AVX2\n"
+    "#if defined(__AVX2__)\n"
+    "#define EIDOS_VEC 4\n"
+    "#define EIDOS_VEC_LANES { 0, 1, 2, 3 }\n"
+    "#else\n"
+    "#define EIDOS_VEC 2\n"
+    "#define EIDOS_VEC_LANES { 0, 1 }\n"
+    "#endif\n"
+    "\n"
+    "typedef uint64_t EidosVec __attribute__((vector_size(EIDOS_VEC * 8)));\n"
+    "typedef int64_t EidosVecS __attribute__((vector_size(EIDOS_VEC * 8)));\n"
+    "\n"
+    "// macros rather than functions, so no vector crosses a call and the ABI never depends on -mavx2\n"
+    "#define eidos_vload(p) __extension__ ({ EidosVec x_; memcpy(&x_, (p), sizeof(x_)); x_; })\n"
+    "#define eidos_vstore(p, x) do { EidosVec x_ = (x); memcpy((p), &x_, sizeof(x_)); } while (0)\n"
+    "#define eidos_vsplat(x) ((EidosVec){ 0 } + (uint64_t)(x))\n"
+    "\n"
+    "// i, i + 1, ..., wrapping like WRAP\n"
+    "#define eidos_viota(i) (eidos_vsplat(i) + (EidosVec)EIDOS_VEC_LANES)\n"
+    "\n"
+    "// comparison result (-1 or 0 per lane) -> 1 or 0\n"
+    "#define eidos_vbool(mask) ((EidosVec)-(mask))\n"
+    "\n"
+    "// iterations of `for (i = first; i < bound; i++)` (<= if inclusive), 0 if i could wrap\n"
+    "static inline uint64_t eidos_vec_trips(int64_t first, int64_t bound, int inclusive) {\n"
+    "    if (inclusive ? first > bound || bound == INT64_MAX : first >= bound) {\n"
+    "        return 0;\n"
+    "    }\n"
+    "    return (uint64_t)bound - (uint64_t)first + (inclusive ? 1 : 0);\n"
+    "}\n"
+    "\n"
+    "// 1 if elements first + lo .. first + hi + n - 1 of an array of `size` all exist\n"
+    "static inline int eidos_vec_fits(int64_t first, int64_t lo, int64_t hi, uint64_t n, int64_t size) {\n"
+    "    if (first < -(INT64_C(1) << 62) || first > (INT64_C(1) << 62)) {\n"
+    "        return 0;\n"
+    "    }\n"
+    "    return first + lo >= 0 && n <= (uint64_t)size && (uint64_t)(first + hi) <= (uint64_t)size - n;\n"
+    "}\n"
+    "#else\n"
+    "#define EIDOS_VEC 0\n"
+    "#endif\n";
+
+// parallel loops and vector kernels of the function being written
+typedef struct CLoops {
+    const IRParLoop *chunk;     // loop whose chunk function is being written, NULL while writing main
+    const IRParLoop *pars;      // loops main runs in parallel
+    size_t count;
+    size_t min_trips;           // fewest iterations worth starting threads for
+    const IRVecLoop *vecs;      // loops main runs in vector kernels first
+    size_t nvecs;
+} CLoops;
+
+/* ===== Helper Functions ===== */
+
+static const char *cmp_symbol(int64_t cmp) {
+    switch ((CmpOp)cmp) {
+    case CMP_EQ: return "==";
+    case CMP_NE: return "!=";
+    case CMP_LT: return "<";
+    case CMP_GT: return ">";
+    case CMP_LE: return "<=";
+    case CMP_GE: return ">=";
+    }
+    return "==";
+}
+
+// INT64_MIN has no literal spelling in C
+static void format_const(int64_t value, char *buf, size_t size) {
+    if (value == INT64_MIN) {
+        snprintf(buf, size, "INT64_MIN");
+    } else {
+        snprintf(buf, size, "INT64_C(%" PRId64 ")", value);
+    }
+}
+
+static void emit_const(int64_t value, FILE *out) {
+    char buf[32];
+    format_const(value, buf, sizeof(buf));
+    fputs(buf, out);
+}
+
+/*
+Writes bytes as a C string literal, split over lines
+
+args:
+    *data (char) -> bytes to write
+    len (size_t) -> number of bytes
+    *out (FILE) -> stream to write to
+*/
+static void emit_string(const char *data, size_t len, FILE *out) {
+    fputs("    \"", out);
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)data[i];
+        if (c == '\n') {
+            fputs("\\n", out);
+            // a newline in the output starts a new piece of the literal
+            if (i + 1 < len) {
+                fputs("\"\n    \"", out);
+            }
+        } else if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if (c < 32 || c > 126) {
+            fprintf(out, "\\%03o", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputs("\"", out);
+}
+
+static void emit_inst(const IRFunction *fn, int v, const char *print_to, const char *indent, FILE *out) {
+    const IRInst *in = &fn->insts[v];
+
+    fputs(indent, out);
+    switch (in->op) {
+    case IR_CONST:
+        fprintf(out, "v%d = ", v);
+        emit_const(in->imm, out);
+        fputs(";", out);
+        break;
+    case IR_ADD:  fprintf(out, "v%d = WRAP(v%d, +, v%d);", v, in->a, in->b); break;
+    case IR_SUB:  fprintf(out, "v%d = WRAP(v%d, -, v%d);", v, in->a, in->b); break;
+    case IR_MUL:  fprintf(out, "v%d = WRAP(v%d, *, v%d);", v, in->a, in->b); break;
+    case IR_NEG:  fprintf(out, "v%d = WRAP(0, -, v%d);", v, in->a); break;
+    case IR_NOT:  fprintf(out, "v%d = v%d == 0;", v, in->a); break;
+    case IR_COPY: fprintf(out, "v%d = v%d;", v, in->a); break;
+    case IR_CMP:
+        fprintf(out, "v%d = v%d %s v%d;", v, in->a, cmp_symbol(in->imm), in->b);
+        break;
+    case IR_DIV:
+        fprintf(out, "v%d = eidos_div(v%d, v%d, %zu, %zu);", v, in->a, in->b, in->line, in->col);
+        break;
+    case IR_READ:
+        fprintf(out, "v%d = eidos_read(%zu, %zu);", v, in->line, in->col);
+        break;
+    case IR_PRINT:
+        fprintf(out, "eidos_print_int(%s, v%d);", print_to, in->a);
+        break;
+    case IR_LOAD:
+        fprintf(out, "v%d = a%" PRId64 "[eidos_index(v%d, %" PRId64 ", %zu, %zu)];", v, in->imm, in->a,
+                fn->arrays[in->imm].size, in->line, in->col);
+        break;
+    case IR_STORE:
+        fprintf(out, "a%" PRId64 "[eidos_index(v%d, %" PRId64 ", %zu, %zu)] = v%d;", in->imm, in->a,
+                fn->arrays[in->imm].size, in->line, in->col, in->b);
+        break;
+    case IR_PARAM:
+        fprintf(out, "v%d = p%" PRId64 ";", v, in->imm);
+        break;
+    case IR_CALL:
+        fprintf(out, "eidos_enter(%zu, %zu); v%d = eidos_fn%" PRId64 "(", in->line, in->col, v, in->imm);
+        for (size_t i = 0; i < in->nphi; i++) {
+            fprintf(out, "%sv%d", i ? ", " : "", in->phi_args[i]);
+        }
+        fputs("); eidos_depth--;", out);
+        break;
+    case IR_RETURN:
+        fprintf(out, "return v%d;", in->a);
+        break;
+    case IR_PHI:
+    case IR_OP_COUNT:
+        break;
+    }
+
+    if (in->var >= 0) {
+        fprintf(out, "    // %s", fn->var_names[in->var]);
+    }
+    fputs("\n", out);
+}
+
+/*
+Writes the phi copies for the edge from -> to followed by the jump
+
+args:
+    *fn (IRFunction) -> function
+    from, to (int) -> the edge
+    fallthrough (int) -> block emitted next, the goto is left out when it is `to`
+    *indent (char) -> prefix of every line
+    *out (FILE) -> stream to write to
+*/
+static void emit_edge(const IRFunction *fn, int from, int to, int fallthrough,
+                      const char *indent, FILE *out) {
+    const IRBlock *bb = &fn->blocks[to];
+    size_t edge = 0;
+    while (edge < bb->npreds && bb->preds[edge] != from) {
+        edge++;
+    }
+
+    if (bb->nphis == 1) {
+        int phi = bb->phis[0];
+        fprintf(out, "%sv%d = v%d;\n", indent, phi, fn->insts[phi].phi_args[edge]);
+    } else if (bb->nphis > 1) {
+        // phis read all their inputs before any is written
+        fprintf(out, "%s{\n", indent);
+        for (size_t i = 0; i < bb->nphis; i++) {
+            int phi = bb->phis[i];
+            fprintf(out, "%s    int64_t t%zu = v%d;\n", indent, i, fn->insts[phi].phi_args[edge]);
+        }
+        for (size_t i = 0; i < bb->nphis; i++) {
+            fprintf(out, "%s    v%d = t%zu;\n", indent, bb->phis[i], i);
+        }
+        fprintf(out, "%s}\n", indent);
+    }
+
+    if (to != fallthrough) {
+        fprintf(out, "%sgoto bb%d;\n", indent, to);
+    }
+}
+
+/*
+Declares the values as locals, up front so gotos can't skip an initializer
+
+args:
+    *fn (IRFunction) -> function
+    *in_loop (char) -> only the values of these blocks, NULL for all
+    *out (FILE) -> stream to write to
+*/
+static void emit_locals(const IRFunction *fn, const char *in_loop, FILE *out) {
+    int declared = 0;
+    for (size_t v = 0; v < fn->ninsts; v++) {
+        const IRInst *in = &fn->insts[v];
+        if (in->block < 0 || ir_is_void(in) || (in_loop && !in_loop[in->block])) {
+            continue;
+        }
+        fprintf(out, "%s v%zu", declared % 8 ? "," : declared ? ";\n    int64_t" : "    int64_t", v);
+        declared++;
+    }
+    if (declared) {
+        fputs(";\n", out);
+    }
+}
+
+/*
+Writes the switch in front of a parallel loop: enough iterations run on
+threads and skip to the loop's exit, fewer fall through to the loop itself
+
+args:
+    *fn (IRFunction) -> function
+    *par (IRParLoop) -> the loop
+    min_trips (size_t) -> fewest iterations worth the threads
+    *out (FILE) -> stream to write to
+*/
+static void emit_par_entry(const IRFunction *fn, const IRParLoop *par, size_t min_trips, FILE *out) {
+    const IRLoop *loop = &fn->loops[par->loop];
+    const IRBlock *header = &fn->blocks[loop->header];
+
+    fputs("    {\n", out);
+    if (par->nenv) {
+        fputs("        const int64_t env[] = {", out);
+        for (size_t e = 0; e < par->nenv; e++) {
+            fprintf(out, "%s v%d", e ? "," : "", par->env[e]);
+        }
+        fputs(" };\n", out);
+    } else {
+        fputs("        const int64_t *env = NULL;\n", out);
+    }
+    fprintf(out, "        uint64_t trips = eidos_par_trips(v%d, v%d, INT64_C(%" PRId64 "), %d, %zu);\n",
+            par->init, par->bound, par->step, par->inclusive, min_trips);
+    fputs("        if (trips) {\n", out);
+    fprintf(out, "            eidos_parallel_for(eidos_loop%d, env, v%d, INT64_C(%" PRId64 "), trips);\n",
+            par->loop, par->init, par->step);
+    fprintf(out, "            v%d = (int64_t)((uint64_t)v%d + trips * (uint64_t)INT64_C(%" PRId64 "));\n",
+            par->iv, par->init, par->step);
+    emit_edge(fn, header->id, header->succ[1], -1, "            ", out);
+    fputs("        }\n    }\n", out);
+}
+
+/*
+Spells a value of a vector kernel's body as a vector of its lanes
+
+args:
+    *vec (IRVecLoop) -> the loop
+    v (int) -> value
+    *buf (char) -> receives the C expression
+    size (size_t) -> size of buf
+*/
+static void vec_operand(const IRVecLoop *vec, int v, char *buf, size_t size) {
+    switch ((IRVecKind)vec->kind[v]) {
+    case VEC_OUTSIDE:
+        snprintf(buf, size, "eidos_vsplat(v%d)", v);
+        break;
+    case VEC_INDEX:
+        snprintf(buf, size, "eidos_viota(WRAP(i, +, INT64_C(%" PRId64 ")))", vec->offset[v]);
+        break;
+    case VEC_LANES:
+        snprintf(buf, size, "x%d", v);
+        break;
+    }
+}
+
+/*
+Writes the vector kernel in front of a loop: when every access of all the
+whole blocks of EIDOS_VEC iterations is in bounds, they run in vector
+registers and the loop itself only runs what is left over, one iteration at
+a time and with its own checks
+
+args:
+    *fn (IRFunction) -> function
+    *vec (IRVecLoop) -> the loop
+    *out (FILE) -> stream to write to
+*/
+static void emit_vec_kernel(const IRFunction *fn, const IRVecLoop *vec, FILE *out) {
+    const IRLoop *loop = &fn->loops[vec->loop];
+    char a[64], b[64];
+
+    fputs("#if EIDOS_VEC\n    {\n", out);
+    fprintf(out, "        // loop at line %zu, EIDOS_VEC iterations at a time\n", loop->line);
+    fprintf(out, "        uint64_t blocks = eidos_vec_trips(v%d, v%d, %d) / EIDOS_VEC;\n",
+            vec->init, vec->bound, vec->inclusive);
+    // arrays of one size are in bounds together if the lowest and highest offset into any of them are
+    fputs("        if (blocks", out);
+    for (size_t k = 0; k < vec->naccesses; k++) {
+        int64_t size = fn->arrays[vec->accesses[k].array].size;
+        int64_t lo = vec->accesses[k].offset, hi = lo;
+        int seen = 0;
+        for (size_t j = 0; j < vec->naccesses; j++) {
+            const IRVecAccess *acc = &vec->accesses[j];
+            if (fn->arrays[acc->array].size != size) {
+                continue;
+            }
+            if (j < k) {
+                seen = 1;
+                break;
+            }
+            lo = acc->offset < lo ? acc->offset : lo;
+            hi = acc->offset > hi ? acc->offset : hi;
+        }
+        if (!seen) {
+            fprintf(out, " &&\n            eidos_vec_fits(v%d, INT64_C(%" PRId64 "), INT64_C(%" PRId64 "), "
+                    "blocks * EIDOS_VEC, %" PRId64 ")", vec->init, lo, hi, size);
+        }
+    }
+    fputs(") {\n", out);
+
+    // the same in every iteration: computed once
+    for (size_t k = 0; k < vec->nbody; k++) {
+        int v = vec->body[k];
+        if (vec->kind[v] == VEC_OUTSIDE && !ir_is_void(&fn->insts[v])) {
+            emit_inst(fn, v, "&eidos_out", "            ", out);
+        }
+    }
+
+    fputs("            for (uint64_t k = 0; k < blocks; k++) {\n", out);
+    fprintf(out, "                int64_t i = (int64_t)((uint64_t)v%d + k * EIDOS_VEC);\n", vec->init);
+    for (size_t k = 0; k < vec->nbody; k++) {
+        int v = vec->body[k];
+        const IRInst *in = &fn->insts[v];
+        if (in->op != IR_STORE && vec->kind[v] != VEC_LANES) {
+            continue;
+        }
+        if (in->a >= 0) {
+            vec_operand(vec, in->a, a, sizeof(a));
+        }
+        if (in->b >= 0) {
+            vec_operand(vec, in->b, b, sizeof(b));
+        }
+
+        fputs("                ", out);
+        switch (in->op) {
+        case IR_ADD:  fprintf(out, "EidosVec x%d = %s + %s;", v, a, b); break;
+        case IR_SUB:  fprintf(out, "EidosVec x%d = %s - %s;", v, a, b); break;
+        case IR_MUL:  fprintf(out, "EidosVec x%d = %s * %s;", v, a, b); break;
+        case IR_NEG:  fprintf(out, "EidosVec x%d = -%s;", v, a); break;
+        case IR_COPY: fprintf(out, "EidosVec x%d = %s;", v, a); break;
+        case IR_NOT:
+            fprintf(out, "EidosVec x%d = eidos_vbool((EidosVecS)((EidosVecS)%s == (EidosVecS)eidos_vsplat(0)));", v, a);
+            break;
+        case IR_CMP:
+            fprintf(out, "EidosVec x%d = eidos_vbool((EidosVecS)((EidosVecS)%s %s (EidosVecS)%s));",
+                    v, a, cmp_symbol(in->imm), b);
+            break;
+        case IR_LOAD:
+            fprintf(out, "EidosVec x%d = eidos_vload(&a%" PRId64 "[i + INT64_C(%" PRId64 ")]);",
+                    v, in->imm, vec->offset[in->a]);
+            break;
+        case IR_STORE:
+            fprintf(out, "eidos_vstore(&a%" PRId64 "[i + INT64_C(%" PRId64 ")], %s);",
+                    in->imm, vec->offset[in->a], b);
+            break;
+        default:
+            break;
+        }
+        if (in->var >= 0) {
+            fprintf(out, "    // %s", fn->var_names[in->var]);
+        }
+        fputs("\n", out);
+    }
+    fputs("            }\n", out);
+
+    // the loop picks up where the kernel stopped
+    fprintf(out, "            v%d = (int64_t)((uint64_t)v%d + blocks * EIDOS_VEC);\n", vec->iv, vec->init);
+    fprintf(out, "            goto bb%d;\n", loop->header);
+    fputs("        }\n    }\n#endif\n", out);
+}
+
+/*
+Writes the edge from -> to, or a return if it leaves the loop a chunk function runs
+
+args:
+    *fn (IRFunction) -> function
+    *loops (CLoops) -> parallel loops
+    from, to, fallthrough, *indent, *out -> as for emit_edge
+*/
+static void emit_exit_or_edge(const IRFunction *fn, const CLoops *loops, int from, int to, int fallthrough,
+                              const char *indent, FILE *out) {
+    const IRParLoop *chunk = loops->chunk;
+    if (chunk && !chunk->in_loop[to]) {
+        fprintf(out, "%sreturn;\n", indent);
+        return;
+    }
+    emit_edge(fn, from, to, fallthrough, indent, out);
+}
+
+/*
+The block written after order[n]: the next one, or while writing a chunk
+function the next one of its loop
+
+returns:
+    (int) -> block id, -1 for none
+*/
+static int next_written(const int *order, size_t nordered, size_t n, const IRParLoop *chunk) {
+    size_t m = n + 1;
+    while (chunk && m < nordered && !chunk->in_loop[order[m]]) {
+        m++;
+    }
+    return m < nordered ? order[m] : -1;
+}
+
+/*
+Marks the blocks some goto of the function being written jumps to, the only
+ones that get a label; the rest are only ever fallen into
+
+args:
+    *fn (IRFunction) -> function
+    *loops (CLoops) -> parallel loops and vector kernels
+    *order (int) -> block layout of fn, `nordered` ids
+    *labels (char) -> fn->nblocks flags, set to 1 for each block jumped to
+*/
+static void find_labels(const IRFunction *fn, const CLoops *loops, const int *order, size_t nordered,
+                        char *labels) {
+    const IRParLoop *chunk = loops->chunk;
+    memset(labels, 0, fn->nblocks);
+    if (chunk) {
+        labels[fn->loops[chunk->loop].header] = 1;     // where the chunk starts
+    }
+    for (size_t p = 0; p < loops->nvecs; p++) {
+        labels[fn->loops[loops->vecs[p].loop].header] = 1;     // where the scalar loop takes over
+    }
+
+    for (size_t n = 0; n < nordered; n++) {
+        const IRBlock *bb = &fn->blocks[order[n]];
+        if (chunk && !chunk->in_loop[bb->id]) {
+            continue;
+        }
+        size_t nsucc = bb->term == TERM_JMP ? 1 : bb->term == TERM_BR ? 2 : 0;
+        int fallthrough = bb->term == TERM_JMP ? next_written(order, nordered, n, chunk) : -1;
+        for (size_t k = 0; k < nsucc; k++) {
+            int to = bb->succ[k];
+            if (to != fallthrough && (!chunk || chunk->in_loop[to])) {
+                labels[to] = 1;
+            }
+        }
+    }
+}
+
+/*
+Writes one block: label, instructions, terminator
+
+args:
+    *fn (IRFunction) -> function
+    *bb (IRBlock) -> block to write
+    fallthrough (int) -> block written next, -1 for none
+    *loops (CLoops) -> parallel loops
+    *labels (char) -> blocks jumped to, from find_labels
+    *out (FILE) -> stream to write to
+*/
+static void emit_block(const IRFunction *fn, const IRBlock *bb, int fallthrough, const CLoops *loops,
+                       const char *labels, FILE *out) {
+    const IRParLoop *chunk = loops->chunk;
+    if (bb->id != fn->entry && labels[bb->id]) {
+        fprintf(out, "\nbb%d:\n", bb->id);
+    }
+    // a chunk runs `count` iterations, or fewer if the loop ends first
+    if (chunk && bb->id == fn->loops[chunk->loop].header) {
+        fputs("    if (count-- == 0) {\n        return;\n    }\n", out);
+    }
+    for (size_t k = 0; k < bb->ninsts; k++) {
+        emit_inst(fn, bb->insts[k], chunk ? "out" : "&eidos_out", "    ", out);
+    }
+
+    if (!chunk) {
+        for (size_t p = 0; p < loops->count; p++) {
+            if (fn->loops[loops->pars[p].loop].preheader == bb->id) {
+                emit_par_entry(fn, &loops->pars[p], loops->min_trips, out);
+            }
+        }
+        for (size_t p = 0; p < loops->nvecs; p++) {
+            if (fn->loops[loops->vecs[p].loop].preheader == bb->id) {
+                emit_vec_kernel(fn, &loops->vecs[p], out);
+            }
+        }
+    }
+
+    switch (bb->term) {
+    case TERM_JMP:
+        emit_exit_or_edge(fn, loops, bb->id, bb->succ[0], fallthrough, "    ", out);
+        break;
+    case TERM_BR:
+        if (bb->likely) {
+            fprintf(out, "    if (EIDOS_EXPECT(v%d, %d)) {\n", bb->cond, bb->likely > 0);
+        } else {
+            fprintf(out, "    if (v%d) {\n", bb->cond);
+        }
+        emit_exit_or_edge(fn, loops, bb->id, bb->succ[0], -1, "        ", out);
+        fputs("    } else {\n", out);
+        emit_exit_or_edge(fn, loops, bb->id, bb->succ[1], -1, "        ", out);
+        fputs("    }\n", out);
+        break;
+    default:
+        // a function returned with its IR_RETURN
+        if (!fn->name) {
+            fputs("    return eidos_out_flush(&eidos_out) ? 1 : 0;\n", out);
+        }
+        break;
+    }
+}
+
+/*
+Writes the function that runs a chunk of a parallel loop's iterations on a
+worker thread: the loop's blocks, with every exit from the loop a return
+
+args:
+    *fn (IRFunction) -> function
+    *par (IRParLoop) -> the loop
+    *order (int) -> block layout of fn, `nordered` ids
+    *out (FILE) -> stream to write to
+*/
+static void emit_chunk_fn(const IRFunction *fn, const IRParLoop *par, const int *order, size_t nordered,
+                          FILE *out) {
+    const IRLoop *loop = &fn->loops[par->loop];
+
+    fprintf(out, "\n// iterations of the loop at line %zu, see eidos_parallel_for\n", loop->line);
+    fprintf(out, "static void eidos_loop%d(const int64_t *env, int64_t first, uint64_t count, EidosOut *out) {\n",
+            par->loop);
+    for (size_t e = 0; e < par->nenv; e++) {
+        fprintf(out, "    const int64_t v%d = env[%zu];\n", par->env[e], e);
+    }
+    emit_locals(fn, par->in_loop, out);
+    fprintf(out, "    v%d = first;\n", par->iv);
+    fprintf(out, "    goto bb%d;\n", loop->header);
+
+    CLoops loops = { par, NULL, 0, 0, NULL, 0 };
+    char *labels = eidos_malloc(fn->nblocks);
+    if (!labels) {
+        eidos_fatal("Failed to allocate block labels");
+    }
+    find_labels(fn, &loops, order, nordered, labels);
+    for (size_t n = 0; n < nordered; n++) {
+        if (!par->in_loop[order[n]]) {
+            continue;
+        }
+        // only the loop's blocks are written, the next one of them follows
+        emit_block(fn, &fn->blocks[order[n]], next_written(order, nordered, n, par), &loops, labels, out);
+    }
+    fputs("}\n", out);
+    eidos_free(labels);
+}
+
+static void emit_body(const IRFunction *fn, const CLoops *loops, const int *order, size_t nordered, FILE *out) {
+    emit_locals(fn, NULL, out);
+
+    char *labels = eidos_malloc(fn->nblocks);
+    if (!labels) {
+        eidos_fatal("Failed to allocate block labels");
+    }
+    find_labels(fn, loops, order, nordered, labels);
+    for (size_t n = 0; n < nordered; n++) {
+        emit_block(fn, &fn->blocks[order[n]], next_written(order, nordered, n, NULL), loops, labels, out);
+    }
+    eidos_free(labels);
+}
+
+static void emit_signature(const IRFunction *fn, size_t index, FILE *out) {
+    fprintf(out, "static int64_t eidos_fn%zu(", index);
+    for (size_t i = 0; i < fn->nparams; i++) {
+        fprintf(out, "%sint64_t p%zu", i ? ", " : "", i);
+    }
+    fputs(fn->nparams ? ")" : "void)", out);
+}
+
+// eidos_depth and eidos_enter, which count the calls in progress
+static void emit_call_depth(FILE *out) {
+    fputs("\n// calls in progress\n", out);
+    fputs("static int eidos_depth;\n\n", out);
+    fputs("static inline void eidos_enter(int line, int col) {\n", out);
+    fprintf(out, "    if (++eidos_depth > %d) {\n", IR_MAX_CALL_DEPTH);
+    fputs("        eidos_trap(line, col, \"call depth limit exceeded\");\n    }\n}\n", out);
+}
+
+/*
+Marks the functions a function calls, and the ones those call, in `used`
+*/
+static void mark_called(const IRFunction *fn, char *used) {
+    for (size_t b = 0; b < fn->nblocks; b++) {
+        const IRBlock *bb = &fn->blocks[b];
+        if (bb->dead) {
+            continue;
+        }
+        for (size_t k = 0; k < bb->ninsts; k++) {
+            const IRInst *in = &fn->insts[bb->insts[k]];
+            if (in->op == IR_CALL && !used[in->imm]) {
+                used[in->imm] = 1;
+                mark_called(fn->funcs[in->imm], used);
+            }
+        }
+    }
+}
+
+/*
+Writes the functions main still calls, one C function each; the inliner may
+have replaced every call of the others. Calls count their depth in
+eidos_depth, so a runaway recursion is a runtime error rather than a crash.
+
+args:
+    *fn (IRFunction) -> main
+    *out (FILE) -> stream to write to
+*/
+static void emit_functions(const IRFunction *fn, FILE *out) {
+    char *used = eidos_calloc(fn->nfuncs, 1);
+    if (!used) {
+        eidos_fatal("Failed to allocate function table");
+    }
+    mark_called(fn, used);
+
+    size_t nused = 0;
+    for (size_t f = 0; f < fn->nfuncs; f++) {
+        nused += used[f];
+    }
+    if (!nused) {
+        eidos_free(used);
+        return;
+    }
+
+    emit_call_depth(out);
+    fputs("\n", out);
+
+    for (size_t f = 0; f < fn->nfuncs; f++) {
+        if (!used[f]) {
+            continue;
+        }
+        emit_signature(fn->funcs[f], f, out);
+        fprintf(out, ";    // %s\n", fn->funcs[f]->name);
+    }
+
+    CLoops none = { NULL, NULL, 0, 0, NULL, 0 };
+    for (size_t f = 0; f < fn->nfuncs; f++) {
+        if (!used[f]) {
+            continue;
+        }
+        const IRFunction *callee = fn->funcs[f];
+        int *order = eidos_malloc((callee->nblocks ? callee->nblocks : 1) * sizeof(int));
+        if (!order) {
+            eidos_fatal("Failed to allocate block layout");
+        }
+        size_t nordered = ir_layout(callee, order);
+
+        fprintf(out, "\n// %s, line %zu\n", callee->name, callee->blocks[callee->entry].line);
+        emit_signature(callee, f, out);
+        fputs(" {\n", out);
+        emit_body(callee, &none, order, nordered, out);
+        fputs("}\n", out);
+        eidos_free(order);
+    }
+    eidos_free(used);
+}
+
+
+/* ===== Streaming Helpers ===== */
+
+// an expression operand: a literal, a global gN or a temporary tN
+typedef char COperand[32];
+
+/*
+Declares the pointer and size of an array the first time it is named, and
+defines them at its declaration (a tentative definition completed later)
+
+args:
+    *stream (CStream) -> translation state
+    *name (char) -> array name
+    *decl (ASTNode) -> its AST_ARRAY_DECL_NODE, NULL for a use
+*/
+static void declare_array(CStream *stream, const char *name, const ASTNode *decl) {
+    size_t global;
+    if (!strmap_get(&stream->arrays, name, &global)) {
+        global = stream->arrays.count;
+        strmap_put(&stream->arrays, name, global);
+        fprintf(stream->out, "static int64_t *a%zu, n%zu;    // %s\n", global, global, name);
+    }
+    if (decl) {
+        fprintf(stream->out, "static _Alignas(32) int64_t d%zu[%" PRId64 "];\n", global, decl->data.array_decl.size);
+        fprintf(stream->out, "static int64_t *a%zu = d%zu, n%zu = %" PRId64 ";\n",
+                global, global, global, decl->data.array_decl.size);
+    }
+}
+
+/*
+Declares the C function of an Eidos function the first time it is named:
+its prototype, from the number of arguments of a call (sema checks that
+the declaration agrees), or nothing when the name is the declaration
+itself. The first one also writes the call depth counter.
+
+args:
+    *stream (CStream) -> translation state
+    *name (char) -> function name
+    nparams (size_t) -> arguments it takes
+    decl (int) -> 1 at its declaration
+
+returns:
+    (size_t) -> its index, eidos_fn<index> in the C code
+*/
+static size_t declare_fn(CStream *stream, const char *name, size_t nparams, int decl) {
+    size_t index;
+    if (strmap_get(&stream->fns, name, &index)) {
+        return index;
+    }
+    if (!stream->fns.count) {
+        emit_call_depth(stream->out);
+    }
+    index = stream->fns.count;
+    strmap_put(&stream->fns, name, index);
+    if (!decl) {
+        fprintf(stream->out, "static int64_t eidos_fn%zu(", index);
+        for (size_t i = 0; i < nparams; i++) {
+            fprintf(stream->out, "%sint64_t", i ? ", " : "");
+        }
+        fprintf(stream->out, "%s);    // %s\n", nparams ? "" : "void", name);
+    }
+    return index;
+}
+
+// what declare_vars declares
+#define DECLARE_VARS 1          // variables and arrays
+#define DECLARE_CALLS 2         // functions called
+
+/*
+Declares what the statement names that has no declaration yet, before the
+statement's function refers to it: a global for every variable (a local
+inside a function body), the globals of the arrays, and the functions it
+calls
+
+args:
+    *stream (CStream) -> translation state
+    *node (ASTNode) -> subtree to scan
+    what (int) -> DECLARE_VARS and/or DECLARE_CALLS
+*/
+static void declare_vars(CStream *stream, const ASTNode *node, int what) {
+    for (; node && node->type == AST_STMTS_NODE; node = node->data.stmts.next) {
+        declare_vars(stream, node->data.stmts.stmt, what);
+    }
+    if (!node) {
+        return;
+    }
+
+    const char *name = NULL;
+    switch (node->type) {
+    case AST_IDENTIFIER_NODE:
+        name = node->data.identifier.name;
+        break;
+    case AST_VAR_DECL_NODE:
+        name = node->data.var_decl.identifer;
+        declare_vars(stream, node->data.var_decl.value, what);
+        break;
+    case AST_ASSIGN_NODE:
+        name = node->data.assignment.identifier;
+        declare_vars(stream, node->data.assignment.value, what);
+        break;
+    case AST_READ_NODE:
+        name = node->data.read_stmt.identifier;
+        break;
+    case AST_PRINT_NODE:
+        declare_vars(stream, node->data.print_stmt.expression, what);
+        break;
+    case AST_UNARY_EXPR:
+        declare_vars(stream, node->data.unary_expr.operand, what);
+        break;
+    case AST_BINARY_EXPR:
+        declare_vars(stream, node->data.binary_expr.left, what);
+        declare_vars(stream, node->data.binary_expr.right, what);
+        break;
+    case AST_CONDITIONAL_NODE:
+        declare_vars(stream, node->data.conditional.left_expression, what);
+        declare_vars(stream, node->data.conditional.right_expression, what);
+        break;
+    case AST_ARRAY_DECL_NODE:
+        if (what & DECLARE_VARS) {
+            declare_array(stream, node->data.array_decl.identifier, node);
+        }
+        break;
+    case AST_INDEX_EXPR:
+        if (what & DECLARE_VARS) {
+            declare_array(stream, node->data.index_expr.identifier, NULL);
+        }
+        declare_vars(stream, node->data.index_expr.index, what);
+        break;
+    case AST_INDEX_ASSIGN_NODE:
+        if (what & DECLARE_VARS) {
+            declare_array(stream, node->data.index_assign.identifier, NULL);
+        }
+        declare_vars(stream, node->data.index_assign.index, what);
+        declare_vars(stream, node->data.index_assign.value, what);
+        break;
+    case AST_CALL_EXPR:
+        if (what & DECLARE_CALLS) {
+            declare_fn(stream, node->data.call_expr.name, node->data.call_expr.nargs, 0);
+        }
+        for (size_t i = 0; i < node->data.call_expr.nargs; i++) {
+            declare_vars(stream, node->data.call_expr.args[i], what);
+        }
+        break;
+    case AST_FN_DECL_NODE:
+        declare_vars(stream, node->data.fn_decl.body, what);
+        declare_vars(stream, node->data.fn_decl.ret, what);
+        break;
+    case AST_IF_STMT_NODE:
+        declare_vars(stream, node->data.if_stmt.condition, what);
+        declare_vars(stream, node->data.if_stmt.then_block, what);
+        declare_vars(stream, node->data.if_stmt.else_block, what);
+        break;
+    case AST_FOR_LOOP_NODE:
+        declare_vars(stream, node->data.for_loop.initializer, what);
+        declare_vars(stream, node->data.for_loop.condition, what);
+        declare_vars(stream, node->data.for_loop.step, what);
+        declare_vars(stream, node->data.for_loop.for_block, what);
+        break;
+    case AST_WHILE_LOOP_NODE:
+        declare_vars(stream, node->data.while_loop.condition, what);
+        declare_vars(stream, node->data.while_loop.while_block, what);
+        break;
+    default:
+        break;
+    }
+
+    size_t index;
+    if (!name || !(what & DECLARE_VARS)) {
+        return;
+    }
+    if (stream->in_fn) {
+        if (!strmap_get(&stream->locals, name, &index)) {
+            index = stream->locals.count;
+            strmap_put(&stream->locals, name, index);
+            fprintf(stream->out, "    int64_t v%zu = 0;    // %s\n", index, name);
+        }
+    } else if (!strmap_get(&stream->vars, name, &index)) {
+        index = stream->vars.count;
+        strmap_put(&stream->vars, name, index);
+        // variables start at 0, which a static global already is
+        fprintf(stream->out, "static int64_t g%zu;    // %s\n", index, name);
+    }
+}
+
+/*
+C spelling of a variable: its global, or inside a function body its local
+*/
+static void var_operand(const CStream *stream, const char *name, COperand operand) {
+    size_t index = 0;
+    if (stream->in_fn) {
+        strmap_get(&stream->locals, name, &index);
+        snprintf(operand, sizeof(COperand), "v%zu", index);
+    } else {
+        strmap_get(&stream->vars, name, &index);
+        snprintf(operand, sizeof(COperand), "g%zu", index);
+    }
+}
+
+static size_t array_of(const CStream *stream, const char *name) {
+    size_t global = 0;
+    strmap_get(&stream->arrays, name, &global);
+    return global;
+}
+
+/*
+Writes the temporaries computing an expression, operands first and left to
+right, so division traps fire in the order the interpreter raises them
+
+args:
+    *stream (CStream) -> translation state
+    *node (ASTNode) -> expression
+    depth (int) -> indentation level
+    operand (COperand) -> receives the C spelling of the value
+*/
+static void stream_expr(CStream *stream, const ASTNode *node, int depth, COperand operand) {
+    FILE *out = stream->out;
+    COperand l, r;
+
+    switch (node->type) {
+    case AST_INTAGER_LIT_NODE:
+        format_const(node->data.int_lit.value, operand, sizeof(COperand));
+        return;
+
+    case AST_IDENTIFIER_NODE:
+        var_operand(stream, node->data.identifier.name, operand);
+        return;
+
+    case AST_BINARY_EXPR: {
+        stream_expr(stream, node->data.binary_expr.left, depth, l);
+        stream_expr(stream, node->data.binary_expr.right, depth, r);
+        char op = node->data.binary_expr.op[0];
+        fprintf(out, "%*sint64_t t%zu = ", depth * 4, "", stream->temps);
+        if (op == '/') {
+            fprintf(out, "eidos_div(%s, %s, %zu, %zu);\n", l, r, node->line, node->col);
+        } else {
+            fprintf(out, "WRAP(%s, %c, %s);\n", l, op, r);
+        }
+        break;
+    }
+
+    case AST_UNARY_EXPR:
+        stream_expr(stream, node->data.unary_expr.operand, depth, l);
+        fprintf(out, node->data.unary_expr.op[0] == '!' ? "%*sint64_t t%zu = %s == 0;\n"
+                                                       : "%*sint64_t t%zu = WRAP(0, -, %s);\n",
+                depth * 4, "", stream->temps, l);
+        break;
+
+    case AST_CONDITIONAL_NODE:
+        stream_expr(stream, node->data.conditional.left_expression, depth, l);
+        stream_expr(stream, node->data.conditional.right_expression, depth, r);
+        fprintf(out, "%*sint64_t t%zu = %s %s %s;\n", depth * 4, "", stream->temps,
+                l, node->data.conditional.comparison_op, r);
+        break;
+
+    case AST_INDEX_EXPR: {
+        size_t array = array_of(stream, node->data.index_expr.identifier);
+        stream_expr(stream, node->data.index_expr.index, depth, l);
+        fprintf(out, "%*sint64_t t%zu = a%zu[eidos_index(%s, n%zu, %zu, %zu)];\n", depth * 4, "",
+                stream->temps, array, l, array, node->line, node->col);
+        break;
+    }
+
+    case AST_CALL_EXPR: {
+        // the arguments are computed first, as in the IR, then the call counts its depth
+        size_t nargs = node->data.call_expr.nargs;
+        COperand *args = eidos_malloc((nargs ? nargs : 1) * sizeof(COperand));
+        if (!args) {
+            eidos_fatal("Failed to allocate call arguments");
+        }
+        for (size_t i = 0; i < nargs; i++) {
+            stream_expr(stream, node->data.call_expr.args[i], depth, args[i]);
+        }
+        size_t index = 0;
+        strmap_get(&stream->fns, node->data.call_expr.name, &index);
+        fprintf(out, "%*seidos_enter(%zu, %zu);\n", depth * 4, "", node->line, node->col);
+        fprintf(out, "%*sint64_t t%zu = eidos_fn%zu(", depth * 4, "", stream->temps, index);
+        for (size_t i = 0; i < nargs; i++) {
+            fprintf(out, "%s%s", i ? ", " : "", args[i]);
+        }
+        fprintf(out, ");\n%*seidos_depth--;\n", depth * 4, "");
+        eidos_free(args);
+        break;
+    }
+
+    default:
+        snprintf(operand, sizeof(COperand), "0");
+        return;
+    }
+
+    snprintf(operand, sizeof(COperand), "t%zu", stream->temps++);
+}
+
+static void stream_stmts(CStream *stream, const ASTNode *list, int depth);
+
+/*
+Writes one statement at the given indentation level
+
+args:
+    *stream (CStream) -> translation state
+    *node (ASTNode) -> statement
+    depth (int) -> indentation level
+*/
+static void stream_stmt(CStream *stream, const ASTNode *node, int depth) {
+    FILE *out = stream->out;
+    int pad = depth * 4;
+    COperand v;
+
+    switch (node->type) {
+    case AST_VAR_DECL_NODE:
+    case AST_ASSIGN_NODE: {
+        int decl = node->type == AST_VAR_DECL_NODE;
+        const char *name = decl ? node->data.var_decl.identifer : node->data.assignment.identifier;
+        COperand var;
+        stream_expr(stream, decl ? node->data.var_decl.value : node->data.assignment.value, depth, v);
+        var_operand(stream, name, var);
+        fprintf(out, "%*s%s = %s;    // %s\n", pad, "", var, v, name);
+        break;
+    }
+
+    case AST_UNARY_EXPR: {
+        // x++ / --x as a statement
+        var_operand(stream, node->data.unary_expr.operand->data.identifier.name, v);
+        fprintf(out, "%*s%s = WRAP(%s, %c, 1);\n", pad, "", v, v, node->data.unary_expr.op[0]);
+        break;
+    }
+
+    case AST_PRINT_NODE:
+        stream_expr(stream, node->data.print_stmt.expression, depth, v);
+        fprintf(out, "%*seidos_print_int(&eidos_out, %s);\n", pad, "", v);
+        break;
+
+    case AST_READ_NODE:
+        var_operand(stream, node->data.read_stmt.identifier, v);
+        fprintf(out, "%*s%s = eidos_read(%zu, %zu);\n", pad, "", v, node->line, node->col);
+        break;
+
+    case AST_INDEX_ASSIGN_NODE: {
+        // the index and the value are computed before the bounds are checked, as in the IR
+        size_t array = array_of(stream, node->data.index_assign.identifier);
+        COperand index;
+        stream_expr(stream, node->data.index_assign.index, depth, index);
+        stream_expr(stream, node->data.index_assign.value, depth, v);
+        fprintf(out, "%*sa%zu[eidos_index(%s, n%zu, %zu, %zu)] = %s;\n", pad, "",
+                array, index, array, node->line, node->col, v);
+        break;
+    }
+
+    case AST_IF_STMT_NODE:
+        stream_expr(stream, node->data.if_stmt.condition, depth, v);
+        fprintf(out, "%*sif (%s) {\n", pad, "", v);
+        stream_stmts(stream, node->data.if_stmt.then_block, depth + 1);
+        if (node->data.if_stmt.else_block) {
+            fprintf(out, "%*s} else {\n", pad, "");
+            stream_stmts(stream, node->data.if_stmt.else_block, depth + 1);
+        }
+        fprintf(out, "%*s}\n", pad, "");
+        break;
+
+    case AST_WHILE_LOOP_NODE:
+    case AST_FOR_LOOP_NODE: {
+        int is_for = node->type == AST_FOR_LOOP_NODE;
+        if (is_for) {
+            stream_stmt(stream, node->data.for_loop.initializer, depth);
+        }
+
+        // the condition's temporaries are recomputed on every trip
+        fprintf(out, "%*sfor (;;) {\n", pad, "");
+        stream_expr(stream, is_for ? node->data.for_loop.condition : node->data.while_loop.condition,
+                    depth + 1, v);
+        fprintf(out, "%*sif (!%s) {\n%*sbreak;\n%*s}\n", pad + 4, "", v, pad + 8, "", pad + 4, "");
+        stream_stmts(stream, is_for ? node->data.for_loop.for_block : node->data.while_loop.while_block,
+                     depth + 1);
+        if (is_for) {
+            stream_stmt(stream, node->data.for_loop.step, depth + 1);
+        }
+        fprintf(out, "%*s}\n", pad, "");
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+static void stream_stmts(CStream *stream, const ASTNode *list, int depth) {
+    for (; list; list = list->data.stmts.next) {
+        stream_stmt(stream, list->data.stmts.stmt, depth);
+    }
+}
+
+/* ========== PUBLIC API ========== */
+
+/*
+Writes a C program equivalent to the function
+
+args:
+    *fn (IRFunction) -> optimized function, NULL if there is no code left to run
+    *options (CEmitOptions) -> source name, precomputed output, parallel loops and vector kernels
+    *out (FILE) -> stream to write the C code to
+
+returns:
+    (size_t) -> number of loops written to run in parallel
+*/
+size_t c_emit_program(const IRFunction *fn, const CEmitOptions *options, FILE *out) {
+    CLoops loops = { NULL, NULL, 0, options->parallel_min_trips, NULL, 0 };
+    IRParLoop *pars = NULL;
+    IRVecLoop *vecs = NULL;
+    if (fn && options->parallel_loops) {
+        loops.count = ir_find_par_loops(fn, &pars);
+        loops.pars = pars;
+    }
+    if (fn && options->vectorize) {
+        loops.nvecs = ir_find_vec_loops(fn, &vecs);
+        loops.vecs = vecs;
+    }
+
+    fprintf(out, "/* generated by eidos%s%s, do not edit */\n",
+            options->source_path ? " from " : "", options->source_path ? options->source_path : "");
+
+    if (fn) {
+        // open_memstream and barriers are POSIX 2008
+        if (loops.count) {
+            fputs("#define _POSIX_C_SOURCE 200809L\n", out);
+        }
+        fputs(io_runtime, out);
+        fputs(runtime_globals, out);
+        fputs(loops.count ? runtime_parallel_trap : runtime_trap, out);
+        fputs(runtime_prelude, out);
+        if (loops.count) {
+            fputs(runtime_parallel, out);
+        }
+        if (loops.nvecs) {
+            fputs(runtime_vector, out);
+        }
+        if (fn->narrays) {
+            // aligned for the vector kernels, zero like variables
+            fputs("\n", out);
+            for (size_t i = 0; i < fn->narrays; i++) {
+                fprintf(out, "static _Alignas(32) int64_t a%zu[%" PRId64 "];    // %s\n",
+                        i, fn->arrays[i].size, fn->arrays[i].name);
+            }
+        }
+    } else {
+        fputs("#include <stdio.h>\n", out);
+    }
+
+    int *order = NULL;
+    size_t nordered = 0;
+    if (fn) {
+        order = eidos_malloc((fn->nblocks ? fn->nblocks : 1) * sizeof(int));
+        if (!order) {
+            eidos_fatal("Failed to allocate block layout");
+        }
+        nordered = ir_layout(fn, order);
+    }
+    if (fn && fn->nfuncs) {
+        emit_functions(fn, out);
+    }
+    for (size_t p = 0; p < loops.count; p++) {
+        emit_chunk_fn(fn, &pars[p], order, nordered, out);
+    }
+
+    if (options->output_len) {
+        fputs("\n// output of the part of the program evaluated at compile time\n", out);
+        fputs("static const char precomputed[] =\n", out);
+        emit_string(options->output, options->output_len, out);
+        fputs(";\n", out);
+    }
+
+    fputs("\nint main(void) {\n", out);
+    if (fn) {
+        fputs("    eidos_out_init(&eidos_out, stdout);\n", out);
+        fputs("    eidos_in_init(&eidos_in, stdin, &eidos_out);\n", out);
+    }
+    if (options->output_len) {
+        fputs(fn ? "    eidos_out_write(&eidos_out, precomputed, sizeof(precomputed) - 1);\n"
+                 : "    fwrite(precomputed, 1, sizeof(precomputed) - 1, stdout);\n", out);
+    }
+    if (fn) {
+        emit_body(fn, &loops, order, nordered, out);
+    } else {
+        fputs("    return 0;\n", out);
+    }
+    fputs("}\n", out);
+
+    size_t parallel = loops.count;
+    eidos_free(order);
+    ir_free_par_loops(pars, loops.count);
+    ir_free_vec_loops(vecs, loops.nvecs);
+    return parallel;
+}
+
+/*
+Starts a streamed translation: writes the header and the runtime
+
+args:
+    *stream (CStream) -> state to initialize
+    *source_path (char) -> named in the header comment, may be NULL
+    *out (FILE) -> stream to write the C code to
+*/
+void c_stream_begin(CStream *stream, const char *source_path, FILE *out) {
+    stream->out = out;
+    strmap_init(&stream->vars);
+    strmap_init(&stream->arrays);
+    strmap_init(&stream->fns);
+    strmap_init(&stream->locals);
+    stream->in_fn = 0;
+    stream->nstmts = 0;
+    stream->temps = 0;
+
+    fprintf(out, "/* generated by eidos%s%s, do not edit */\n",
+            source_path ? " from " : "", source_path ? source_path : "");
+    fputs(io_runtime, out);
+    fputs(runtime_globals, out);
+    fputs(runtime_trap, out);
+    fputs(runtime_prelude, out);
+}
+
+/*
+Writes a function declaration as a C function: its parameters copied into
+locals, then every other variable of the body as a local starting at 0
+
+args:
+    *stream (CStream) -> translation state
+    *decl (ASTNode) -> AST_FN_DECL_NODE
+*/
+static void stream_fn(CStream *stream, const ASTNode *decl) {
+    FILE *out = stream->out;
+    size_t nparams = decl->data.fn_decl.nparams;
+
+    // the functions it calls need a prototype in front of it
+    size_t index = declare_fn(stream, decl->data.fn_decl.name, nparams, 1);
+    declare_vars(stream, decl, DECLARE_CALLS);
+
+    fprintf(out, "// %s, line %zu\n", decl->data.fn_decl.name, decl->line);
+    fprintf(out, "static int64_t eidos_fn%zu(", index);
+    for (size_t i = 0; i < nparams; i++) {
+        fprintf(out, "%sint64_t p%zu", i ? ", " : "", i);
+    }
+    fputs(nparams ? ") {\n" : "void) {\n", out);
+
+    stream->in_fn = 1;
+    strmap_free(&stream->locals);
+    strmap_init(&stream->locals);
+    for (size_t i = 0; i < nparams; i++) {
+        strmap_put(&stream->locals, decl->data.fn_decl.params[i], i);
+        fprintf(out, "    int64_t v%zu = p%zu;    // %s\n", i, i, decl->data.fn_decl.params[i]);
+    }
+    declare_vars(stream, decl, DECLARE_VARS);
+
+    COperand v;
+    stream->temps = 0;
+    stream_stmts(stream, decl->data.fn_decl.body, 1);
+    stream_expr(stream, decl->data.fn_decl.ret, 1, v);
+    fprintf(out, "    return %s;\n}\n", v);
+    stream->in_fn = 0;
+}
+
+/*
+Writes the next top-level statement as a function of its own, or a function
+declaration as the C function it stands for
+
+args:
+    *stream (CStream) -> translation state
+    *stmt (ASTNode) -> checked statement, not referenced after the call
+*/
+void c_stream_stmt(CStream *stream, const ASTNode *stmt) {
+    fputs("\n", stream->out);
+    if (stmt->type == AST_FN_DECL_NODE) {
+        stream_fn(stream, stmt);
+        return;
+    }
+    declare_vars(stream, stmt, DECLARE_VARS | DECLARE_CALLS);
+
+    fprintf(stream->out, "static void s%zu(void) {\n", stream->nstmts++);
+    stream->temps = 0;
+    stream_stmt(stream, stmt, 1);
+    fputs("}\n", stream->out);
+}
+
+/*
+Writes main, which runs the statement functions in order, and frees the state
+
+args:
+    *stream (CStream) -> translation state after the last statement
+*/
+void c_stream_end(CStream *stream) {
+    FILE *out = stream->out;
+
+    fputs("\nint main(void) {\n", out);
+    fputs("    eidos_out_init(&eidos_out, stdout);\n", out);
+    fputs("    eidos_in_init(&eidos_in, stdin, &eidos_out);\n", out);
+    for (size_t i = 0; i < stream->nstmts; i++) {
+        fprintf(out, "    s%zu();\n", i);
+    }
+    fputs("    return eidos_out_flush(&eidos_out) ? 1 : 0;\n", out);
+    fputs("}\n", out);
+
+    strmap_free(&stream->vars);
+    strmap_free(&stream->arrays);
+    strmap_free(&stream->fns);
+    strmap_free(&stream->locals);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+/*
+C code generator.
+
+Translates an optimized IRFunction into a standalone C99 program: every SSA
+value becomes a local int64_t, every block a label, and phis become parallel
+copies on the edges that feed them. Arithmetic wraps and division traps the
+same way the interpreter (ir/interp.h) does, so the compiled program prints
+exactly what `eidos --run` prints. Arrays are static, 32-byte aligned
+int64_t storage; loops over them that qualify (ir/vecloop.h) get a vector
+kernel in front that runs whole blocks of iterations with the bounds of
+every access checked once.
+
+The c_stream_* functions translate a program one top-level statement at a
+time, straight from the AST (`--stream`): every variable becomes a global,
+every statement a function that main calls in order; an array is a pointer
+and a size, which its declaration defines wherever it appears, so statements
+before it can already name it. A function declaration becomes a C function
+with its variables as locals; a call to one declared further on goes through
+a prototype written at the first call. Nothing of a statement
+is kept once it is written, so memory stays bounded by the largest
+statement and the number of distinct variables and functions.
+*/
+
+#include <stdio.h>
+#include "../ir/ir.h"
+#include "../parser/ast.h"
+#include "../util/strmap.h"
+
+typedef struct CEmitOptions {
+    const char *source_path;    // named in the header comment, may be NULL
+    const char *output;         // written before the program runs (precomputed), may be NULL
+    size_t output_len;
+    int parallel_loops;         // run independent for loops on threads (ir/parloop.h)
+    size_t parallel_min_trips;  // ... when they have at least this many iterations
+    int vectorize;              // run element-wise array loops in vector kernels (ir/vecloop.h)
+} CEmitOptions;
+
+typedef struct CStream {
+    FILE *out;
+    StrMap vars;                // variable name -> index of its global
+    StrMap arrays;              // array name -> index of its globals
+    StrMap fns;                 // function name -> index of its eidos_fn
+    StrMap locals;              // variable name -> local, in the function being written
+    int in_fn;                  // 1 while writing a function body
+    size_t nstmts;              // statement functions written so far
+    size_t temps;               // temporaries of the statement being written
+} CStream;
+
+
+/* ========== Public API Functions ========== */
+
+/*
+Writes the C translation of fn to out. fn may be NULL when the whole program
+was precomputed, the generated program then only writes options->output.
+Returns the number of loops that run in parallel.
+*/
+size_t c_emit_program(const IRFunction *fn, const CEmitOptions *options, FILE *out);
+
+/*
+Streaming translation: begin writes the runtime, stmt writes one top-level
+statement (which the caller may free afterwards), end writes main.
+*/
+void c_stream_begin(CStream *stream, const char *source_path, FILE *out);
+void c_stream_stmt(CStream *stream, const ASTNode *stmt);
+void c_stream_end(CStream *stream);
@@ -0,0 +1,445 @@
+#include "batch.h"
+#include "pool.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct Job {
+    const char *path;
+    int failed;
+    char *diag;                 // copied out of the worker's context, NULL if none
+    const char *io_error;       // "Can't read" / "Failed to write output", with io_errno
+    int io_errno;               // strerror isn't thread-safe, formatted when printed
+    char *output;               // stdout output, NULL when written to a file
+    size_t output_len;
+    int done;                   // guarded by Batch.lock
+} Job;
+
+// one worker's run of jobs, [head, tail) of the job array
+typedef struct Deque {
+    pthread_mutex_t lock;
+    size_t head;
+    size_t tail;
+} Deque;
+
+typedef struct Worker {
+    pthread_t thread;
+    struct Batch *batch;
+    size_t index;
+    Deque deque;
+    Pool pool;                  // memory of the worker's context, warm across files
+    char *source;               // read buffer, reused for every file
+    size_t source_cap;
+    size_t compiled;
+    size_t stolen;
+} Worker;
+
+typedef struct Batch {
+    const BatchOptions *options;
+    Job *jobs;
+    size_t njobs;
+    Worker *workers;
+    size_t nworkers;
+    pthread_mutex_t lock;       // Job.done
+    pthread_cond_t finished;
+} Batch;
+
+/* ===== Helper Functions ===== */
+
+static double now_millis(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void *xmalloc(size_t size) {
+    void *p = malloc(size);
+    if (!p) {
+        fprintf(stderr, "Error: Failed to allocate batch state\n");
+        exit(1);
+    }
+    return p;
+}
+
+static char *xstrndup(const char *s, size_t len) {
+    char *copy = xmalloc(len + 1);
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+static void push_path(const char *path, size_t len, char ***paths, size_t *count, size_t *cap) {
+    if (*count == *cap) {
+        *cap = *cap ? *cap * 2 : 64;
+        *paths = realloc(*paths, *cap * sizeof(char*));
+        if (!*paths) {
+            fprintf(stderr, "Error: Failed to allocate input list\n");
+            exit(1);
+        }
+    }
+    (*paths)[(*count)++] = xstrndup(path, len);
+}
+
+/*
+Adds an input, or the inputs listed in an @file
+
+args:
+    *arg (char) -> path or "@list"
+    ***paths (char) -> growing array of paths, each malloc'd
+    *count, *cap (size_t) -> its length and capacity
+
+returns:
+    (int) -> 0, -1 if a list can't be read
+*/
+static int add_input(const char *arg, char ***paths, size_t *count, size_t *cap) {
+    if (arg[0] != '@') {
+        push_path(arg, strlen(arg), paths, count, cap);
+        return 0;
+    }
+
+    FILE *list = fopen(arg + 1, "r");
+    if (!list) {
+        fprintf(stderr, "ERROR: Can't read list '%s': %s\n", arg + 1, strerror(errno));
+        return -1;
+    }
+
+    char *line = NULL;
+    size_t line_cap = 0;
+    ssize_t len;
+    while ((len = getline(&line, &line_cap, list)) != -1) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r' ||
+                           line[len - 1] == ' ' || line[len - 1] == '\t')) {
+            line[--len] = '\0';
+        }
+        if (len > 0) {
+            // a list names files, not further lists
+            push_path(line, (size_t)len, paths, count, cap);
+        }
+    }
+    free(line);
+    fclose(list);
+    return 0;
+}
+
+/*
+Reads a source file into the worker's buffer
+
+returns:
+    (long) -> length, -1 with errno set on failure
+*/
+static long read_source(Worker *w, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return -1;
+    }
+
+    size_t len = 0;
+    for (;;) {
+        if (len == w->source_cap) {
+            size_t cap = w->source_cap ? w->source_cap * 2 : 64 * 1024;
+            char *bigger = realloc(w->source, cap);
+            if (!bigger) {
+                fclose(f);
+                errno = ENOMEM;
+                return -1;
+            }
+            w->source = bigger;
+            w->source_cap = cap;
+        }
+        size_t n = fread(w->source + len, 1, w->source_cap - len, f);
+        len += n;
+        if (n == 0) {
+            break;
+        }
+    }
+
+    int failed = ferror(f);
+    fclose(f);
+    if (failed) {
+        errno = EIO;
+        return -1;
+    }
+    return (long)len;
+}
+
+// file.e -> file<extension>
+static char *output_path_for(const char *source_path, const char *extension) {
+    size_t len = strlen(source_path);
+    if (len > 2 && strcmp(source_path + len - 2, ".e") == 0) {
+        len -= 2;
+    }
+    size_t ext_len = strlen(extension);
+    char *path = xmalloc(len + ext_len + 1);
+    memcpy(path, source_path, len);
+    memcpy(path + len, extension, ext_len + 1);
+    return path;
+}
+
+static int write_output(const char *path, const char *data, size_t len) {
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        return -1;
+    }
+    size_t written = fwrite(data, 1, len, f);
+    if (fclose(f) != 0 || written != len) {
+        remove(path);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+Compiles one job with the worker's context and records the result
+
+args:
+    *w (Worker) -> worker running the job
+    *ctx (EidosContext) -> the worker's context
+    *job (Job) -> job to run
+*/
+static void run_job(Worker *w, EidosContext *ctx, Job *job) {
+    const BatchOptions *options = w->batch->options;
+
+    long len = read_source(w, job->path);
+    if (len < 0) {
+        job->io_error = "Can't read";
+        job->io_errno = errno;
+        job->failed = 1;
+        return;
+    }
+
+    EidosOptions compile = options->compile;
+    compile.name = job->path;
+    EidosStatus status = eidos_compile(ctx, w->source, (size_t)len, &compile);
+
+    const char *diag = eidos_diagnostics(ctx);
+    if (diag[0]) {
+        job->diag = xstrndup(diag, strlen(diag));
+    }
+    if (status != EIDOS_OK) {
+        if (status == EIDOS_NO_MEMORY && !job->diag) {
+            job->diag = xstrndup("Error: Out of memory\n", 21);
+        }
+        job->failed = 1;
+        return;
+    }
+
+    size_t out_len;
+    const char *out = eidos_output(ctx, &out_len);
+    if (!options->extension) {
+        job->output = xstrndup(out, out_len);
+        job->output_len = out_len;
+        return;
+    }
+
+    char *out_path = output_path_for(job->path, options->extension);
+    if (write_output(out_path, out, out_len) != 0) {
+        job->io_error = "Failed to write output";
+        job->io_errno = errno;
+        job->failed = 1;
+    }
+    free(out_path);
+}
+
+// next job of the worker's own run, front first so output drains in order
+static int take_own(Worker *w, size_t *job) {
+    int found = 0;
+    pthread_mutex_lock(&w->deque.lock);
+    if (w->deque.head < w->deque.tail) {
+        *job = w->deque.head++;
+        found = 1;
+    }
+    pthread_mutex_unlock(&w->deque.lock);
+    return found;
+}
+
+// last job of the first other worker that has any left
+static int steal(Worker *w, size_t *job) {
+    Batch *batch = w->batch;
+    for (size_t k = 1; k < batch->nworkers; k++) {
+        Deque *victim = &batch->workers[(w->index + k) % batch->nworkers].deque;
+        int found = 0;
+        pthread_mutex_lock(&victim->lock);
+        if (victim->head < victim->tail) {
+            *job = --victim->tail;
+            found = 1;
+        }
+        pthread_mutex_unlock(&victim->lock);
+        if (found) {
+            w->stolen++;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void *work(void *arg) {
+    Worker *w = arg;
+    Batch *batch = w->batch;
+
+    EidosAllocator allocator = pool_allocator(&w->pool);
+    EidosContext *ctx = eidos_context_new(&allocator);
+    if (!ctx) {
+        fprintf(stderr, "Error: Failed to allocate compilation context\n");
+        exit(1);
+    }
+
+    size_t index;
+    while (take_own(w, &index) || steal(w, &index)) {
+        run_job(w, ctx, &batch->jobs[index]);
+        w->compiled++;
+
+        pthread_mutex_lock(&batch->lock);
+        batch->jobs[index].done = 1;
+        pthread_cond_broadcast(&batch->finished);
+        pthread_mutex_unlock(&batch->lock);
+    }
+
+    eidos_context_free(ctx);
+    return NULL;
+}
+
+// diagnostics of a job, every line prefixed with its file
+static void print_diag(const Job *job) {
+    if (job->io_error) {
+        fprintf(stderr, "%s: Error: %s: %s\n", job->path, job->io_error, strerror(job->io_errno));
+    }
+    const char *line = job->diag ? job->diag : "";
+    while (*line) {
+        const char *end = strchr(line, '\n');
+        size_t len = end ? (size_t)(end - line) : strlen(line);
+        fprintf(stderr, "%s: %.*s\n", job->path, (int)len, line);
+        line += len + (end != NULL);
+    }
+}
+
+
+/* ========== PUBLIC API ========== */
+
+/*
+Compiles a batch of files on a work-stealing pool
+
+args:
+    **inputs (char) -> source paths and @lists, in output order
+    count (size_t) -> number of inputs
+    *options (BatchOptions) -> what to produce
+
+returns:
+    (int) -> 0 if every file compiled, 1 if any failed, -1 if an input list can't be read
+*/
+int batch_compile(char **inputs, size_t count, const BatchOptions *options) {
+    char **paths = NULL;
+    size_t npaths = 0, cap = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (add_input(inputs[i], &paths, &npaths, &cap) != 0) {
+            for (size_t k = 0; k < npaths; k++) {
+                free(paths[k]);
+            }
+            free(paths);
+            return -1;
+        }
+    }
+
+    double start = now_millis();
+
+    Batch batch;
+    batch.options = options;
+    batch.njobs = npaths;
+    batch.jobs = calloc(npaths ? npaths : 1, sizeof(Job));
+    if (!batch.jobs) {
+        fprintf(stderr, "Error: Failed to allocate batch state\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < npaths; i++) {
+        batch.jobs[i].path = paths[i];
+    }
+
+    size_t nworkers = options->threads;
+    if (nworkers == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        nworkers = online > 0 ? (size_t)online : 1;
+    }
+    if (nworkers > npaths) {
+        nworkers = npaths ? npaths : 1;
+    }
+    batch.nworkers = nworkers;
+    batch.workers = calloc(nworkers, sizeof(Worker));
+    if (!batch.workers) {
+        fprintf(stderr, "Error: Failed to allocate batch state\n");
+        exit(1);
+    }
+    pthread_mutex_init(&batch.lock, NULL);
+    pthread_cond_init(&batch.finished, NULL);
+
+    // contiguous runs: neighbouring files finish close together, so output drains steadily
+    for (size_t k = 0; k < nworkers; k++) {
+        Worker *w = &batch.workers[k];
+        w->batch = &batch;
+        w->index = k;
+        w->deque.head = npaths * k / nworkers;
+        w->deque.tail = npaths * (k + 1) / nworkers;
+        pthread_mutex_init(&w->deque.lock, NULL);
+    }
+    for (size_t k = 0; k < nworkers; k++) {
+        if (pthread_create(&batch.workers[k].thread, NULL, work, &batch.workers[k]) != 0) {
+            fprintf(stderr, "Error: Failed to start worker thread\n");
+            exit(1);
+        }
+    }
+
+    // report in input order as soon as each file and those before it are done
+    size_t failed = 0;
+    for (size_t i = 0; i < npaths; i++) {
+        Job *job = &batch.jobs[i];
+        pthread_mutex_lock(&batch.lock);
+        while (!job->done) {
+            pthread_cond_wait(&batch.finished, &batch.lock);
+        }
+        pthread_mutex_unlock(&batch.lock);
+
+        print_diag(job);
+        if (job->output) {
+            fwrite(job->output, 1, job->output_len, stdout);
+        }
+        failed += job->failed;
+        free(job->diag);
+        free(job->output);
+    }
+    fflush(stdout);
+
+    // every worker must be gone before any deque goes, the others may still try to steal from it
+    for (size_t k = 0; k < nworkers; k++) {
+        pthread_join(batch.workers[k].thread, NULL);
+    }
+    size_t stolen = 0, allocations = 0, recycled = 0;
+    for (size_t k = 0; k < nworkers; k++) {
+        Worker *w = &batch.workers[k];
+        stolen += w->stolen;
+        allocations += w->pool.allocations;
+        recycled += w->pool.recycled;
+        pool_free(&w->pool);
+        free(w->source);
+        pthread_mutex_destroy(&w->deque.lock);
+    }
+
+    if (options->print_stats) {
+        fprintf(stderr, "batch: %zu files, %zu failed, %zu threads, %zu stolen, %.1f ms\n",
+                npaths, failed, nworkers, stolen, now_millis() - start);
+        fprintf(stderr, "batch: %zu allocations, %.1f%% reused from worker pools\n",
+                allocations, allocations ? 100.0 * recycled / allocations : 0.0);
+    }
+
+    pthread_cond_destroy(&batch.finished);
+    pthread_mutex_destroy(&batch.lock);
+    free(batch.workers);
+    free(batch.jobs);
+    for (size_t i = 0; i < npaths; i++) {
+        free(paths[i]);
+    }
+    free(paths);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+/*
+Batch compilation: `eidos compile a.e b.e ...`, `eidos --emit-c @list.txt`.
+
+Compiles many source files in one process on a pool of worker threads. The
+files are dealt out to the workers in contiguous runs; a worker that runs
+out takes files from the end of another worker's run (work stealing), so a
+few slow files don't leave the other threads idle.
+
+Each worker compiles through its own libeidos context (lib/eidos.h), whose
+allocator keeps the blocks of one compilation on free lists for the next,
+and reuses one buffer for reading sources. Diagnostics, and output that goes
+to stdout, are printed in input order no matter which worker finishes first.
+*/
+
+#include <stddef.h>
+#include "../lib/eidos.h"
+
+typedef struct BatchOptions {
+    EidosOptions compile;       // target and optimizations of every file
+    const char *extension;      // output file next to each source (".c", ".eidb"), NULL for stdout
+    size_t threads;             // workers, 0 for one per online CPU
+    int print_stats;            // summary on stderr
+} BatchOptions;
+
+
+/* ========== Public API Functions ========== */
+
+/*
+Compiles every input. An input "@file" names a list of inputs, one per line;
+blank lines are skipped.
+
+Diagnostics are printed to stderr prefixed with the file they belong to.
+
+returns:
+    (int) -> 0 if every file compiled, 1 otherwise
+*/
+int batch_compile(char **inputs, size_t count, const BatchOptions *options);
@@ -0,0 +1,59 @@
+#include "pool.h"
+#include <stdlib.h>
+
+/* ===== Helper Functions ===== */
+
+static int size_class(size_t size) {
+    int c = 0;
+    size_t cap = 16;
+    while (cap < size && c < POOL_CLASSES) {
+        cap <<= 1;
+        c++;
+    }
+    return c;
+}
+
+static void *pool_alloc(void *user, size_t size) {
+    Pool *pool = user;
+    int c = size_class(size);
+    pool->allocations++;
+    if (c == POOL_CLASSES) {
+        return malloc(size);
+    }
+    void *block = pool->free[c];
+    if (block) {
+        pool->free[c] = *(void**)block;
+        pool->recycled++;
+        return block;
+    }
+    return malloc((size_t)16 << c);
+}
+
+static void pool_release(void *user, void *ptr, size_t size) {
+    Pool *pool = user;
+    int c = size_class(size);
+    if (c == POOL_CLASSES) {
+        free(ptr);
+        return;
+    }
+    *(void**)ptr = pool->free[c];
+    pool->free[c] = ptr;
+}
+
+
+/* ========== PUBLIC API ========== */
+
+EidosAllocator pool_allocator(Pool *pool) {
+    EidosAllocator allocator = { pool_alloc, pool_release, pool };
+    return allocator;
+}
+
+void pool_free(Pool *pool) {
+    for (int c = 0; c < POOL_CLASSES; c++) {
+        while (pool->free[c]) {
+            void *next = *(void**)pool->free[c];
+            free(pool->free[c]);
+            pool->free[c] = next;
+        }
+    }
+}
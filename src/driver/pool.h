@@ -0,0 +1,36 @@
+#pragma once
+
+/*
+A recycling allocator for long-lived compiler contexts (batch workers, the
+compile server).
+
+Blocks a context gives back are kept on per-size-class free lists instead of
+returning to malloc, so the next compilation on the same thread finds its
+memory warm. A pool belongs to one thread; plug it into a context with
+pool_allocator().
+*/
+
+#include <stddef.h>
+#include "../lib/eidos.h"
+
+// size classes a pool recycles: 16 bytes .. 64 KiB, larger blocks go to malloc
+#define POOL_CLASSES 13
+
+typedef struct Pool {
+    void *free[POOL_CLASSES];
+    size_t allocations;         // blocks handed out
+    size_t recycled;            // ... of which came off a free list
+} Pool;
+
+
+/* ========== Public API Functions ========== */
+
+/*
+An EidosAllocator drawing from `pool`
+*/
+EidosAllocator pool_allocator(Pool *pool);
+
+/*
+Returns every block on the free lists to malloc
+*/
+void pool_free(Pool *pool);
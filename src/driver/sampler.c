@@ -0,0 +1,81 @@
+#include "sampler.h"
+#include <signal.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+// the profile SIGPROF ticks go to, set while a sampled run is in progress
+static _Atomic(IRProfile *) sampled;
+
+/* ===== Helper Functions ===== */
+
+static void on_tick(int sig) {
+    (void)sig;
+    IRProfile *profile = atomic_load(&sampled);
+    if (!profile) {
+        return;
+    }
+    profile->ticks++;
+    int block = profile->current_block;
+    if (block >= 0) {
+        profile->block_ticks[block]++;
+    }
+}
+
+static double cpu_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* ========== PUBLIC API ========== */
+
+/*
+Runs a function under the profiler and the sampling timer
+
+args:
+    *fn (IRFunction) -> function to run
+    *in (FILE) -> where read() takes integers from
+    *out (FILE) -> where print() writes to
+    *stats (IRExecStats) -> execution counters, may be NULL
+    trips (int) -> 1 to also record the trip counts of every loop
+    *profile (IRProfile) -> receives the counters and ticks
+
+returns:
+    (int) -> 0 on success, 1 on a runtime error
+*/
+int sampler_run(const IRFunction *fn, FILE *in, FILE *out, IRExecStats *stats, int trips, IRProfile *profile) {
+    ir_profile_init(fn, trips, profile);
+
+    // another thread's run has the timer: this one is only counted
+    IRProfile *none = NULL;
+    if (!atomic_compare_exchange_strong(&sampled, &none, profile)) {
+        double start = cpu_ms();
+        int status = ir_interpret_profiled(fn, in, out, stats, profile);
+        profile->run_ms = cpu_ms() - start;
+        return status;
+    }
+    profile->sampled = 1;
+
+    struct sigaction action, previous;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_tick;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, &previous);
+
+    struct itimerval timer = { { 0, IR_PROFILE_TICK_MS * 1000 }, { 0, IR_PROFILE_TICK_MS * 1000 } };
+    struct itimerval stop;
+    memset(&stop, 0, sizeof(stop));
+
+    double start = cpu_ms();
+    setitimer(ITIMER_PROF, &timer, NULL);
+    int status = ir_interpret_profiled(fn, in, out, stats, profile);
+    setitimer(ITIMER_PROF, &stop, NULL);
+    profile->run_ms = cpu_ms() - start;
+
+    sigaction(SIGPROF, &previous, NULL);
+    atomic_store(&sampled, NULL);
+    return status;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+/*
+The sampling timer of --profile and --profile-gen.
+
+A 1 ms CPU-time timer (ITIMER_PROF) raises SIGPROF, and the handler adds a
+tick to the block the interpreter is running (IRProfile.current_block). The
+timer and the handler belong to the process, so they live here in the eidos
+binary and not in libeidos, which keeps no global state: the library only
+counts blocks (ir_profile_count).
+
+One run at a time has the timer. A run that starts on another thread while
+one is sampled is only counted, with `sampled` 0 in its profile.
+*/
+
+#include <stdio.h>
+#include "../ir/interp.h"
+#include "../ir/profile.h"
+
+
+/* ========== Public API Functions ========== */
+
+/*
+Runs fn like ir_interpret while counting and sampling it, with loop trip
+counts if `trips` is 1. The profile must be freed with ir_profile_free.
+*/
+int sampler_run(const IRFunction *fn, FILE *in, FILE *out, IRExecStats *stats, int trips, IRProfile *profile);
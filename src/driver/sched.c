@@ -0,0 +1,427 @@
+#include "sched.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// SchedTask.state
+enum {
+    TASK_READY,                 // in the run queue
+    TASK_RUNNING,               // a worker is resuming it
+    TASK_BLOCKED,               // in read() with nothing fed, out of the queue
+    TASK_DONE,
+};
+
+struct Sched {
+    SchedOptions options;
+    pthread_t *threads;
+    size_t nthreads;
+
+    pthread_mutex_t lock;       // everything below, and every task's state, next and inbox
+    pthread_cond_t work;        // a task became ready, or the scheduler is stopping
+    pthread_cond_t idle;        // the last live task finished
+    SchedTask *head;            // run queue, longest ready first
+    SchedTask *tail;
+    SchedTask *live_head;       // every task not done, whatever its state
+    size_t queue_len;
+    size_t queue_max;
+    size_t live;
+    size_t blocked;
+    uint64_t spawned;
+    uint64_t slices;
+    double max_wait;
+    int stopping;
+};
+
+/* ===== Helper Functions ===== */
+
+static double now_millis(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void *xmalloc(size_t size) {
+    void *p = malloc(size ? size : 1);
+    if (!p) {
+        fprintf(stderr, "Error: Failed to allocate scheduler state\n");
+        exit(1);
+    }
+    return p;
+}
+
+// makes room for `need` bytes in a growable byte array
+static void reserve(char **data, size_t *cap, size_t need) {
+    if (need > *cap) {
+        size_t new_cap = *cap ? *cap : 256;
+        while (new_cap < need) {
+            new_cap *= 2;
+        }
+        *data = realloc(*data, new_cap);
+        if (!*data) {
+            fprintf(stderr, "Error: Failed to allocate scheduler state\n");
+            exit(1);
+        }
+        *cap = new_cap;
+    }
+}
+
+// puts a task at the tail of the run queue, with s->lock held
+static void enqueue(Sched *s, SchedTask *t, double now) {
+    t->state = TASK_READY;
+    t->queued = now;
+    t->next = NULL;
+    if (s->tail) {
+        s->tail->next = t;
+    } else {
+        s->head = t;
+    }
+    s->tail = t;
+    s->queue_len++;
+    if (s->queue_len > s->queue_max) {
+        s->queue_max = s->queue_len;
+    }
+    pthread_cond_signal(&s->work);
+}
+
+/*
+Moves what the VM printed during a slice to the task's output, up to
+max_output bytes in all
+
+returns:
+    (int) -> 1 if the program printed more than that, whose rest is dropped
+*/
+static int take_output(SchedTask *t, size_t max_output) {
+    size_t len = t->vm.output_len;
+    int over = max_output && len > max_output - t->output_len;
+    if (over) {
+        len = max_output - t->output_len;
+    }
+    if (len) {
+        reserve(&t->output, &t->output_cap, t->output_len + len + 1);
+        memcpy(t->output + t->output_len, t->vm.output, len);
+        t->output_len += len;
+        t->output[t->output_len] = '\0';
+    }
+    t->vm.output_len = 0;
+    return over;
+}
+
+// takes a finished task off the live list, with s->lock held
+static void unlink_live(Sched *s, SchedTask *t) {
+    if (t->live_prev) {
+        t->live_prev->live_next = t->live_next;
+    } else {
+        s->live_head = t->live_next;
+    }
+    if (t->live_next) {
+        t->live_next->live_prev = t->live_prev;
+    }
+    t->live_prev = t->live_next = NULL;
+}
+
+/*
+Resumes one task for a slice and decides where it goes next: back in the
+queue, parked until it is fed, or to its callback. A cancelled task goes
+to its callback without running. Called and returns with s->lock held.
+
+args:
+    *s (Sched) -> scheduler
+    *t (SchedTask) -> task just taken off the queue
+*/
+static void run_slice(Sched *s, SchedTask *t) {
+    double now = now_millis();
+    double wait = now - t->queued;
+    if (wait > t->max_wait) {
+        t->max_wait = wait;
+    }
+    if (wait > s->max_wait) {
+        s->max_wait = wait;
+    }
+    s->slices++;
+    t->state = TASK_RUNNING;
+    // input that arrived while it was waiting its turn
+    if (t->inbox_len) {
+        bc_vm_feed(&t->vm, t->inbox, t->inbox_len);
+        t->inbox_len = 0;
+    }
+    if (t->inbox_closed && !t->vm.input_closed) {
+        bc_vm_close_input(&t->vm);
+    }
+    int cancelled = t->cancelled;
+    pthread_mutex_unlock(&s->lock);
+
+    uint64_t budget = s->options.slice;
+    uint64_t max_steps = s->options.max_steps;
+    if (max_steps && (!budget || max_steps - t->vm.executed < budget)) {
+        budget = max_steps - t->vm.executed;
+    }
+    BCVMStatus status = BC_VM_YIELD;
+    int over = 0;
+    if (!cancelled && s->options.wanted && !s->options.wanted(t->user)) {
+        cancelled = 1;
+    }
+    if (!cancelled) {
+        status = bc_vm_resume(&t->vm, budget);
+        t->slices++;
+        over = take_output(t, s->options.max_output);
+    }
+    now = now_millis();
+
+    pthread_mutex_lock(&s->lock);
+    cancelled |= t->cancelled;
+    if (over) {
+        t->result = SCHED_ERROR;
+        snprintf(t->vm.error, sizeof(t->vm.error), "Error: Output exceeds %zu bytes\n", s->options.max_output);
+    } else if (cancelled && (status == BC_VM_YIELD || status == BC_VM_BLOCKED)) {
+        t->result = SCHED_CANCELLED;
+        snprintf(t->vm.error, sizeof(t->vm.error), "Error: Cancelled after %llu instructions\n",
+                 (unsigned long long)t->vm.executed);
+    } else {
+        switch (status) {
+        case BC_VM_YIELD:
+            if (!max_steps || t->vm.executed < max_steps) {
+                enqueue(s, t, now);
+                return;
+            }
+            t->result = SCHED_STOPPED;
+            snprintf(t->vm.error, sizeof(t->vm.error), "Error: Stopped after %llu instructions\n",
+                     (unsigned long long)t->vm.executed);
+            break;
+        case BC_VM_BLOCKED:
+            // fed, or closed, while it ran
+            if (t->inbox_len || (t->inbox_closed && !t->vm.input_closed)) {
+                enqueue(s, t, now);
+            } else {
+                t->state = TASK_BLOCKED;
+                s->blocked++;
+            }
+            return;
+        case BC_VM_DONE:
+            t->result = SCHED_DONE;
+            break;
+        case BC_VM_ERROR:
+            t->result = SCHED_ERROR;
+            break;
+        }
+    }
+
+    t->state = TASK_DONE;
+    t->finished = now;
+    unlink_live(s, t);
+    pthread_mutex_unlock(&s->lock);
+    // the task is the callback's from here on, it may free it
+    if (t->done) {
+        t->done(t, t->user);
+    }
+    pthread_mutex_lock(&s->lock);
+    // counted as live until its callback is over, so sched_wait sees every result
+    s->live--;
+    if (!s->live) {
+        pthread_cond_broadcast(&s->idle);
+    }
+}
+
+static void *work(void *arg) {
+    Sched *s = arg;
+    pthread_mutex_lock(&s->lock);
+    for (;;) {
+        while (!s->head && !s->stopping) {
+            pthread_cond_wait(&s->work, &s->lock);
+        }
+        if (!s->head) {
+            break;
+        }
+        SchedTask *t = s->head;
+        s->head = t->next;
+        if (!s->head) {
+            s->tail = NULL;
+        }
+        s->queue_len--;
+        run_slice(s, t);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+
+/* ========== PUBLIC API ========== */
+
+/*
+Starts a scheduler
+
+args:
+    *options (SchedOptions) -> workers, slice and step limit, copied
+
+returns:
+    (Sched*) -> the scheduler, NULL if a worker thread couldn't start
+*/
+Sched *sched_start(const SchedOptions *options) {
+    Sched *s = calloc(1, sizeof(Sched));
+    if (!s) {
+        return NULL;
+    }
+    s->options = *options;
+    s->nthreads = options->threads;
+    if (s->nthreads == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        s->nthreads = online > 0 ? (size_t)online : 1;
+    }
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->work, NULL);
+    pthread_cond_init(&s->idle, NULL);
+
+    s->threads = xmalloc(s->nthreads * sizeof(pthread_t));
+    for (size_t k = 0; k < s->nthreads; k++) {
+        if (pthread_create(&s->threads[k], NULL, work, s) != 0) {
+            s->nthreads = k;
+            sched_stop(s);
+            return NULL;
+        }
+    }
+    return s;
+}
+
+/*
+Adds a program to the run queue
+
+args:
+    *s (Sched) -> scheduler
+    *image (void) -> bytecode image, len bytes, copied
+    *input (char) -> input_len bytes already fed, copied
+    close_input (int) -> 1 if that is all the input there is
+    done (function) -> called on a worker thread when the task has finished, may be NULL
+    *user (void) -> passed to `done`
+
+returns:
+    (SchedTask*) -> the task, NULL if the image is not valid (reported)
+*/
+SchedTask *sched_spawn(Sched *s, const void *image, size_t len, const char *input, size_t input_len,
+                       int close_input, void (*done)(SchedTask *task, void *user), void *user) {
+    SchedTask *t = calloc(1, sizeof(SchedTask));
+    if (!t) {
+        fprintf(stderr, "Error: Failed to allocate scheduler state\n");
+        exit(1);
+    }
+    // malloc's alignment is enough to read the image in place
+    t->data = xmalloc(len);
+    memcpy(t->data, image, len);
+    if (bc_open_image(t->data, len, "image", &t->image) != 0) {
+        free(t->data);
+        free(t);
+        return NULL;
+    }
+    bc_vm_init(&t->vm, &t->image);
+    if (input_len) {
+        bc_vm_feed(&t->vm, input, input_len);
+    }
+    if (close_input) {
+        bc_vm_close_input(&t->vm);
+        t->inbox_closed = 1;
+    }
+    t->done = done;
+    t->user = user;
+    t->spawned = now_millis();
+
+    pthread_mutex_lock(&s->lock);
+    s->live++;
+    s->spawned++;
+    t->live_next = s->live_head;
+    if (s->live_head) {
+        s->live_head->live_prev = t;
+    }
+    s->live_head = t;
+    enqueue(s, t, t->spawned);
+    pthread_mutex_unlock(&s->lock);
+    return t;
+}
+
+/*
+Gives a task more input, waking it if it waits in read()
+
+args:
+    *s (Sched) -> scheduler
+    *task (SchedTask) -> task that hasn't finished
+    *input (char) -> len bytes, copied
+*/
+void sched_feed(Sched *s, SchedTask *task, const char *input, size_t len) {
+    pthread_mutex_lock(&s->lock);
+    reserve(&task->inbox, &task->inbox_cap, task->inbox_len + len);
+    memcpy(task->inbox + task->inbox_len, input, len);
+    task->inbox_len += len;
+    if (task->state == TASK_BLOCKED) {
+        s->blocked--;
+        enqueue(s, task, now_millis());
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+void sched_close_input(Sched *s, SchedTask *task) {
+    pthread_mutex_lock(&s->lock);
+    task->inbox_closed = 1;
+    if (task->state == TASK_BLOCKED) {
+        s->blocked--;
+        enqueue(s, task, now_millis());
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+void sched_wait(Sched *s) {
+    pthread_mutex_lock(&s->lock);
+    while (s->live) {
+        pthread_cond_wait(&s->idle, &s->lock);
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+void sched_stats(Sched *s, SchedStats *stats) {
+    pthread_mutex_lock(&s->lock);
+    stats->threads = s->nthreads;
+    stats->live = s->live;
+    stats->blocked = s->blocked;
+    stats->queue_max = s->queue_max;
+    stats->spawned = s->spawned;
+    stats->slices = s->slices;
+    stats->max_wait = s->max_wait;
+    pthread_mutex_unlock(&s->lock);
+}
+
+void sched_stop(Sched *s) {
+    pthread_mutex_lock(&s->lock);
+    // a program that never ends, or waits for input that never comes, must not hold up the stop
+    double now = now_millis();
+    for (SchedTask *t = s->live_head; t; t = t->live_next) {
+        t->cancelled = 1;
+        if (t->state == TASK_BLOCKED) {
+            s->blocked--;
+            enqueue(s, t, now);
+        }
+    }
+    while (s->live) {
+        pthread_cond_wait(&s->idle, &s->lock);
+    }
+    s->stopping = 1;
+    pthread_cond_broadcast(&s->work);
+    pthread_mutex_unlock(&s->lock);
+    for (size_t k = 0; k < s->nthreads; k++) {
+        pthread_join(s->threads[k], NULL);
+    }
+    pthread_cond_destroy(&s->idle);
+    pthread_cond_destroy(&s->work);
+    pthread_mutex_destroy(&s->lock);
+    free(s->threads);
+    free(s);
+}
+
+void sched_task_free(SchedTask *task) {
+    if (!task) {
+        return;
+    }
+    bc_vm_free(&task->vm);
+    free(task->data);
+    free(task->output);
+    free(task->inbox);
+    free(task);
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+/*
+M:N scheduler: many bytecode programs (tasks) on a fixed pool of worker
+threads.
+
+Every task is a resumable VM (bytecode/bytecode.h). A worker takes the task
+at the head of the run queue, resumes it for one slice of instructions and
+puts it back at the tail. Busy programs take turns a slice at a time, and a
+program stuck in a loop never holds a worker for longer than one slice. A
+task whose read() has run out of input leaves the queue until sched_feed
+gives it more. A task that ends, fails, runs out of max_steps or prints more
+than max_output goes to its done callback.
+
+A task can be cancelled, and then ends at its next slice. This happens when
+the `wanted` hook, asked between slices, says nobody waits for it anymore,
+and for every task still live when sched_stop is called.
+
+Tasks are spawned and fed from any thread; the scheduler's lock guards the
+queue and the input waiting to reach each task.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include "../bytecode/bytecode.h"
+
+// instructions per slice when the caller has no better idea, about 20-50 us of a typical loop
+#define SCHED_SLICE 20000
+
+typedef struct SchedOptions {
+    size_t threads;             // workers, 0 for one per online CPU
+    uint64_t slice;             // instructions per slice, 0 to run every task to its end in one
+    uint64_t max_steps;         // instructions a task may execute, 0 for no limit
+    size_t max_output;          // bytes a task may print, 0 for no limit
+    int (*wanted)(void *user);  // may be NULL; called with a task's `user` between slices, 0 cancels it
+} SchedOptions;
+
+typedef enum SchedResult {
+    SCHED_DONE,                 // the program ended
+    SCHED_ERROR,                // runtime error, or it printed more than max_output
+    SCHED_STOPPED,              // max_steps ran out
+    SCHED_CANCELLED,            // unwanted, or the scheduler stopped
+} SchedResult;
+
+typedef struct Sched Sched;
+
+typedef struct SchedTask {
+    // set once the task is done, before its callback runs
+    SchedResult result;
+    char *output;               // everything it printed, output_len bytes
+    size_t output_len;
+    uint64_t slices;            // times a worker resumed it
+    double spawned;             // ms on CLOCK_MONOTONIC
+    double finished;
+    double max_wait;            // longest ms it was ready to run but not running
+    BCVM vm;                    // vm.executed; vm.error holds the message of an error or stop
+
+    // owned by the scheduler
+    void (*done)(struct SchedTask *task, void *user);
+    void *user;
+    void *data;                 // copy of the image, 8-byte aligned
+    BCImage image;
+    int state;
+    int cancelled;
+    struct SchedTask *next;     // in the run queue
+    struct SchedTask *live_prev, *live_next;    // every task not done, for sched_stop
+    double queued;              // when it last became ready
+    char *inbox;                // fed while the task was running or queued
+    size_t inbox_len;
+    size_t inbox_cap;
+    int inbox_closed;
+    size_t output_cap;
+} SchedTask;
+
+// counters of a scheduler, for reports
+typedef struct SchedStats {
+    size_t threads;
+    size_t live;                // tasks spawned and not done
+    size_t blocked;             // ... of which are waiting for input
+    size_t queue_max;           // most tasks ever ready at once
+    uint64_t spawned;
+    uint64_t slices;
+    double max_wait;            // longest ms any task was ready but not running
+} SchedStats;
+
+
+/* ========== Public API Functions ========== */
+
+/*
+Starts the workers. NULL if they can't be started.
+*/
+Sched *sched_start(const SchedOptions *options);
+
+/*
+Adds a program: `image` (copied) with `input` (copied) already fed, and
+closed after it if close_input is 1. `done` runs on a worker thread once the
+task has finished and left the scheduler; it owns the task from then on and
+releases it with sched_task_free. NULL if the image is not valid.
+*/
+SchedTask *sched_spawn(Sched *s, const void *image, size_t len, const char *input, size_t input_len,
+                       int close_input, void (*done)(SchedTask *task, void *user), void *user);
+
+/*
+More input for a task that hasn't finished; a task waiting in read() becomes
+ready again
+*/
+void sched_feed(Sched *s, SchedTask *task, const char *input, size_t len);
+
+/*
+Ends a task's input, after which a read() with nothing left fails
+*/
+void sched_close_input(Sched *s, SchedTask *task);
+
+/*
+Waits until every task spawned so far has finished
+*/
+void sched_wait(Sched *s);
+
+void sched_stats(Sched *s, SchedStats *stats);
+
+/*
+Cancels every task still live, waits for their callbacks (each task ends
+within a slice), then stops the workers and frees the scheduler
+*/
+void sched_stop(Sched *s);
+
+/*
+Releases a finished task
+*/
+void sched_task_free(SchedTask *task);
@@ -0,0 +1,939 @@
+#include "server.h"
+#include "pool.h"
+#include "sched.h"
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+// connections accepted but not picked up by a worker yet
+#define QUEUE_CAPACITY 1024
+
+// request latencies kept for the percentiles
+#define LATENCY_SAMPLES 8192
+
+#define CACHE_BUCKETS 4096
+
+// a growable byte buffer a worker reuses for every request
+typedef struct Buffer {
+    char *data;
+    size_t len;
+    size_t cap;
+} Buffer;
+
+// a cached compilation, keyed by its normalized request header and strings
+typedef struct Entry {
+    uint64_t hash;
+    char *key;
+    size_t key_len;
+    int32_t status;
+    char *diag;
+    size_t diag_len;
+    char *output;
+    size_t output_len;
+    struct Entry *chain;        // next in the bucket
+    struct Entry *newer;        // LRU list
+    struct Entry *older;
+} Entry;
+
+typedef struct Cache {
+    pthread_mutex_t lock;
+    Entry *buckets[CACHE_BUCKETS];
+    Entry lru;                  // sentinel: lru.newer is the oldest entry, lru.older the newest
+    size_t bytes;
+    size_t budget;
+    size_t entries;
+    uint64_t hits;
+    uint64_t misses;
+} Cache;
+
+typedef struct Pending {
+    int fd;
+    double accepted;            // ms, for the latency
+} Pending;
+
+// a SERVER_RUN handed to the scheduler, answered when its program finishes
+typedef struct Run {
+    struct Server *server;
+    int fd;
+    double accepted;
+    uint32_t cached;
+    Buffer diag;                // the compilation's, the run's error is added to it
+} Run;
+
+typedef struct Worker {
+    pthread_t thread;
+    struct Server *server;
+    Pool pool;                  // memory of the worker's context, warm across requests
+    Buffer request;             // name, passes, source and input of the current request
+    Buffer diag;
+    Buffer output;
+    Buffer key;
+} Worker;
+
+typedef struct Server {
+    const ServerOptions *options;
+    int listen_fd;
+    double started;
+
+    pthread_mutex_t lock;       // everything below
+    pthread_cond_t work;        // a connection was queued, or the server is stopping
+    pthread_cond_t room;        // the queue has room again
+    Pending queue[QUEUE_CAPACITY];
+    size_t queue_head;
+    size_t queue_len;
+    size_t queue_max;
+    int stopping;
+
+    uint64_t requests[SERVER_STOP + 1];
+    double latency[LATENCY_SAMPLES];
+    uint64_t latency_count;
+    double latency_max;
+    uint64_t pool_allocations;
+    uint64_t pool_recycled;
+
+    Cache cache;
+    Worker *workers;
+    size_t nworkers;
+    Sched *sched;               // runs the programs of SERVER_RUN
+} Server;
+
+// set by SIGINT/SIGTERM
+static volatile sig_atomic_t interrupted;
+
+/* ===== Helper Functions ===== */
+
+static double now_millis(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void on_signal(int sig) {
+    (void)sig;
+    interrupted = 1;
+}
+
+static void *xmalloc(size_t size) {
+    void *p = malloc(size ? size : 1);
+    if (!p) {
+        fprintf(stderr, "Error: Failed to allocate server state\n");
+        exit(1);
+    }
+    return p;
+}
+
+static void buffer_reserve(Buffer *b, size_t len) {
+    if (len > b->cap) {
+        size_t cap = b->cap ? b->cap : 4096;
+        while (cap < len) {
+            cap *= 2;
+        }
+        b->data = realloc(b->data, cap);
+        if (!b->data) {
+            fprintf(stderr, "Error: Failed to allocate server buffer\n");
+            exit(1);
+        }
+        b->cap = cap;
+    }
+}
+
+static void buffer_set(Buffer *b, const char *data, size_t len) {
+    buffer_reserve(b, len + 1);
+    if (len) {
+        memcpy(b->data, data, len);
+    }
+    b->data[len] = '\0';
+    b->len = len;
+}
+
+static void buffer_append(Buffer *b, const char *data, size_t len) {
+    buffer_reserve(b, b->len + len + 1);
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+    b->data[b->len] = '\0';
+}
+
+static int read_full(int fd, void *data, size_t len) {
+    char *p = data;
+    while (len) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int write_full(int fd, const void *data, size_t len) {
+    const char *p = data;
+    while (len) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int connect_to(const char *path) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+static uint64_t hash_bytes(uint64_t h, const char *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)data[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/* ----- cache ----- */
+
+static void lru_unlink(Entry *e) {
+    e->newer->older = e->older;
+    e->older->newer = e->newer;
+}
+
+static void lru_push_newest(Cache *c, Entry *e) {
+    e->newer = &c->lru;
+    e->older = c->lru.older;
+    c->lru.older->newer = e;
+    c->lru.older = e;
+}
+
+static size_t entry_bytes(const Entry *e) {
+    return sizeof(Entry) + e->key_len + e->diag_len + e->output_len;
+}
+
+static void evict_oldest(Cache *c) {
+    Entry *e = c->lru.newer;
+    lru_unlink(e);
+    Entry **link = &c->buckets[e->hash % CACHE_BUCKETS];
+    while (*link != e) {
+        link = &(*link)->chain;
+    }
+    *link = e->chain;
+
+    c->bytes -= entry_bytes(e);
+    c->entries--;
+    free(e->key);
+    free(e->diag);
+    free(e->output);
+    free(e);
+}
+
+/*
+Looks a compilation up and copies its result to the worker's buffers
+
+returns:
+    (int) -> 1 on a hit
+*/
+static int cache_get(Cache *c, uint64_t hash, const Buffer *key, int32_t *status, Buffer *diag, Buffer *output) {
+    if (!c->budget) {
+        return 0;
+    }
+    int hit = 0;
+    pthread_mutex_lock(&c->lock);
+    for (Entry *e = c->buckets[hash % CACHE_BUCKETS]; e; e = e->chain) {
+        if (e->hash == hash && e->key_len == key->len && memcmp(e->key, key->data, key->len) == 0) {
+            lru_unlink(e);
+            lru_push_newest(c, e);
+            *status = e->status;
+            buffer_set(diag, e->diag, e->diag_len);
+            buffer_set(output, e->output, e->output_len);
+            hit = 1;
+            break;
+        }
+    }
+    if (hit) {
+        c->hits++;
+    } else {
+        c->misses++;
+    }
+    pthread_mutex_unlock(&c->lock);
+    return hit;
+}
+
+static char *copy_bytes(const char *data, size_t len) {
+    char *copy = xmalloc(len);
+    if (len) {
+        memcpy(copy, data, len);
+    }
+    return copy;
+}
+
+static char *copy_string(const char *data, size_t len) {
+    char *copy = xmalloc(len + 1);
+    memcpy(copy, data, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+static void cache_put(Cache *c, uint64_t hash, const Buffer *key, int32_t status,
+                      const char *diag, size_t diag_len, const char *output, size_t output_len) {
+    if (!c->budget) {
+        return;
+    }
+    Entry *e = xmalloc(sizeof(Entry));
+    e->hash = hash;
+    e->key = copy_bytes(key->data, key->len);
+    e->key_len = key->len;
+    e->status = status;
+    e->diag = copy_bytes(diag, diag_len);
+    e->diag_len = diag_len;
+    e->output = copy_bytes(output, output_len);
+    e->output_len = output_len;
+
+    pthread_mutex_lock(&c->lock);
+    // another worker may have compiled the same request meanwhile, keep one copy
+    for (Entry *old = c->buckets[hash % CACHE_BUCKETS]; old; old = old->chain) {
+        if (old->hash == hash && old->key_len == key->len && memcmp(old->key, key->data, key->len) == 0) {
+            pthread_mutex_unlock(&c->lock);
+            free(e->key);
+            free(e->diag);
+            free(e->output);
+            free(e);
+            return;
+        }
+    }
+    if (entry_bytes(e) <= c->budget) {
+        while (c->bytes + entry_bytes(e) > c->budget) {
+            evict_oldest(c);
+        }
+        e->chain = c->buckets[hash % CACHE_BUCKETS];
+        c->buckets[hash % CACHE_BUCKETS] = e;
+        lru_push_newest(c, e);
+        c->bytes += entry_bytes(e);
+        c->entries++;
+        e = NULL;
+    }
+    pthread_mutex_unlock(&c->lock);
+
+    if (e) {
+        free(e->key);
+        free(e->diag);
+        free(e->output);
+        free(e);
+    }
+}
+
+/* ----- requests ----- */
+
+// w is NULL for a run the scheduler finished
+static void record(Server *server, ServerKind kind, double accepted, Worker *w) {
+    double latency = now_millis() - accepted;
+    pthread_mutex_lock(&server->lock);
+    server->requests[kind]++;
+    server->latency[server->latency_count % LATENCY_SAMPLES] = latency;
+    server->latency_count++;
+    if (latency > server->latency_max) {
+        server->latency_max = latency;
+    }
+    // published here so the stats request doesn't read another thread's pool
+    if (w) {
+        server->pool_allocations += w->pool.allocations;
+        server->pool_recycled += w->pool.recycled;
+        w->pool.allocations = 0;
+        w->pool.recycled = 0;
+    }
+    pthread_mutex_unlock(&server->lock);
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, size_t n, double p) {
+    size_t rank = (size_t)(p * (double)n + 0.999999);
+    return sorted[rank ? rank - 1 : 0];
+}
+
+// SERVER_STATS: the report, a few "server: ..." lines like --stats prints
+static void format_stats(Server *server, Buffer *out) {
+    char line[256];
+    out->len = 0;
+
+    pthread_mutex_lock(&server->lock);
+    size_t n = server->latency_count < LATENCY_SAMPLES ? (size_t)server->latency_count : LATENCY_SAMPLES;
+    double *sorted = xmalloc(n * sizeof(double));
+    memcpy(sorted, server->latency, n * sizeof(double));
+    uint64_t compile = server->requests[SERVER_COMPILE], run = server->requests[SERVER_RUN];
+    uint64_t stats = server->requests[SERVER_STATS];
+    double latency_max = server->latency_max;
+    size_t depth = server->queue_len, depth_max = server->queue_max;
+    uint64_t allocations = server->pool_allocations, recycled = server->pool_recycled;
+    pthread_mutex_unlock(&server->lock);
+
+    pthread_mutex_lock(&server->cache.lock);
+    uint64_t hits = server->cache.hits, misses = server->cache.misses;
+    size_t entries = server->cache.entries, bytes = server->cache.bytes;
+    pthread_mutex_unlock(&server->cache.lock);
+
+    snprintf(line, sizeof(line), "server: %llu requests (%llu compile, %llu run, %llu stats), %zu workers, up %.1f s\n",
+             (unsigned long long)(compile + run + stats), (unsigned long long)compile,
+             (unsigned long long)run, (unsigned long long)stats, server->nworkers,
+             (now_millis() - server->started) / 1e3);
+    buffer_append(out, line, strlen(line));
+
+    if (n) {
+        qsort(sorted, n, sizeof(double), compare_doubles);
+        snprintf(line, sizeof(line), "server: latency p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, max %.3f ms (last %zu requests)\n",
+                 percentile(sorted, n, 0.50), percentile(sorted, n, 0.90), percentile(sorted, n, 0.99),
+                 latency_max, n);
+        buffer_append(out, line, strlen(line));
+    }
+    free(sorted);
+
+    snprintf(line, sizeof(line), "server: queue depth %zu now, %zu at most\n", depth, depth_max);
+    buffer_append(out, line, strlen(line));
+    snprintf(line, sizeof(line), "server: cache %llu hits, %llu misses, %zu entries, %.1f of %.1f KiB\n",
+             (unsigned long long)hits, (unsigned long long)misses, entries,
+             bytes / 1024.0, server->cache.budget / 1024.0);
+    buffer_append(out, line, strlen(line));
+    snprintf(line, sizeof(line), "server: worker pools %llu allocations, %.1f%% reused\n",
+             (unsigned long long)allocations, allocations ? 100.0 * recycled / allocations : 0.0);
+    buffer_append(out, line, strlen(line));
+
+    SchedStats sched;
+    sched_stats(server->sched, &sched);
+    snprintf(line, sizeof(line), "server: runs %zu in progress, %llu slices, longest wait for a slice %.3f ms\n",
+             sched.live, (unsigned long long)sched.slices, sched.max_wait);
+    buffer_append(out, line, strlen(line));
+}
+
+/*
+Compiles a request's source for `target`, through the cache
+
+args:
+    *w (Worker) -> worker, w->diag and w->output receive the result
+    *ctx (EidosContext) -> the worker's context
+    *req (ServerRequest) -> request header
+    target (EidosTarget) -> what to produce
+    *cached (uint32_t) -> set to 1 on a cache hit
+
+returns:
+    (int32_t) -> EidosStatus
+*/
+static int32_t compile_cached(Worker *w, EidosContext *ctx, const ServerRequest *req,
+                              EidosTarget target, uint32_t *cached) {
+    const char *name = w->request.data;
+    const char *passes = name + req->name_len;
+    const char *source = passes + req->passes_len;
+
+    // everything the result depends on: the options and the three strings
+    ServerRequest normalized = *req;
+    normalized.kind = SERVER_COMPILE;
+    normalized.target = target;
+    normalized.input_len = 0;
+    size_t strings = req->name_len + req->passes_len + req->source_len;
+    w->key.len = 0;
+    buffer_append(&w->key, (const char*)&normalized, sizeof(normalized));
+    buffer_append(&w->key, w->request.data, strings);
+    uint64_t hash = hash_bytes(0xcbf29ce484222325ULL, w->key.data, w->key.len);
+
+    int32_t status;
+    if (cache_get(&w->server->cache, hash, &w->key, &status, &w->diag, &w->output)) {
+        *cached = 1;
+        return status;
+    }
+
+    EidosOptions options;
+    eidos_default_options(&options);
+    options.target = target;
+    options.fold = !(req->flags & SERVER_NO_FOLD);
+    options.unroll = !(req->flags & SERVER_NO_UNROLL);
+    options.pe = !(req->flags & SERVER_NO_PE);
+    options.cse = !(req->flags & SERVER_NO_CSE);
+    options.vectorize = !(req->flags & SERVER_NO_VECTORIZE);
+    options.peephole = !(req->flags & SERVER_NO_PEEPHOLE);
+    options.unroll_full = req->unroll_full;
+    options.unroll_factor = req->unroll_factor;
+    options.unroll_budget = req->unroll_budget;
+    options.pe_steps = req->pe_steps;
+    options.pe_millis = req->pe_millis;
+
+    // the strings aren't NUL terminated in the request buffer
+    char *name_copy = req->name_len ? copy_string(name, req->name_len) : NULL;
+    char *passes_copy = req->passes_len ? copy_string(passes, req->passes_len) : NULL;
+    options.name = name_copy;
+    options.passes = passes_copy;
+
+    status = eidos_compile(ctx, source, req->source_len, &options);
+    free(name_copy);
+    free(passes_copy);
+
+    const char *diag = eidos_diagnostics(ctx);
+    size_t output_len = 0;
+    const char *output = eidos_output(ctx, &output_len);
+    buffer_set(&w->diag, diag, strlen(diag));
+    buffer_set(&w->output, output, output ? output_len : 0);
+
+    // a compilation that ran out of memory may well succeed next time
+    if (status != EIDOS_NO_MEMORY) {
+        cache_put(&w->server->cache, hash, &w->key, status, w->diag.data, w->diag.len,
+                  w->output.data, w->output.len);
+    }
+    return status;
+}
+
+static void respond(int fd, int32_t status, uint32_t cached, const Buffer *diag, const Buffer *output) {
+    ServerResponse response;
+    memset(&response, 0, sizeof(response));
+    memcpy(response.magic, SERVER_RESPONSE_MAGIC, 4);
+    response.status = status;
+    response.cached = cached;
+    response.diag_len = diag->len;
+    response.output_len = output->len;
+
+    // a client that went away is its own problem
+    if (write_full(fd, &response, sizeof(response)) == 0 && write_full(fd, diag->data, diag->len) == 0) {
+        write_full(fd, output->data, output->len);
+    }
+}
+
+// the scheduler's callback of a SERVER_RUN: answers it and closes the connection
+static void run_done(SchedTask *task, void *user) {
+    Run *run = user;
+    Buffer output = { task->output, task->output_len, task->output_cap };
+    if (task->result != SCHED_DONE) {
+        buffer_append(&run->diag, task->vm.error, strlen(task->vm.error));
+    }
+    respond(run->fd, task->result == SCHED_DONE ? EIDOS_OK : EIDOS_ERROR, run->cached, &run->diag, &output);
+    close(run->fd);
+    record(run->server, SERVER_RUN, run->accepted, NULL);
+    free(run->diag.data);
+    free(run);
+    sched_task_free(task);
+}
+
+// the scheduler's `wanted` hook: 0 once the client of a SERVER_RUN has hung up
+static int client_waiting(void *user) {
+    Run *run = user;
+    struct pollfd pfd = { run->fd, POLLIN, 0 };
+    if (poll(&pfd, 1, 0) <= 0) {
+        return 1;
+    }
+    if (pfd.revents & (POLLHUP | POLLERR | POLLNVAL)) {
+        return 0;
+    }
+    // readable: the end of the stream, or bytes the protocol has no use for
+    char c;
+    ssize_t n = recv(run->fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    return n > 0 || (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR));
+}
+
+static void stop(Server *server) {
+    pthread_mutex_lock(&server->lock);
+    server->stopping = 1;
+    pthread_cond_broadcast(&server->work);
+    pthread_mutex_unlock(&server->lock);
+    // wakes the accept loop
+    shutdown(server->listen_fd, SHUT_RDWR);
+}
+
+/*
+Reads one request from a connection, answers it and records its latency.
+A SERVER_RUN is only compiled here; its program goes to the scheduler,
+which answers once it has finished.
+
+args:
+    *w (Worker) -> worker handling it
+    *ctx (EidosContext) -> the worker's context
+    *p (Pending) -> the connection
+
+returns:
+    (int) -> 1 if the connection went to the scheduler, which closes it
+*/
+static int handle(Worker *w, EidosContext *ctx, const Pending *p) {
+    Server *server = w->server;
+    ServerRequest req;
+    buffer_set(&w->diag, "", 0);
+    buffer_set(&w->output, "", 0);
+
+    if (read_full(p->fd, &req, sizeof(req)) != 0 || memcmp(req.magic, SERVER_REQUEST_MAGIC, 4) != 0 ||
+        req.kind > SERVER_STOP) {
+        return 0;
+    }
+    uint64_t body = req.name_len + req.passes_len + req.source_len + req.input_len;
+    if (req.name_len > SERVER_MAX_REQUEST || req.passes_len > SERVER_MAX_REQUEST ||
+        req.source_len > SERVER_MAX_REQUEST || req.input_len > SERVER_MAX_REQUEST ||
+        body > SERVER_MAX_REQUEST) {
+        const char *too_big = "Error: Request too large\n";
+        buffer_set(&w->diag, too_big, strlen(too_big));
+        respond(p->fd, EIDOS_BAD_OPTIONS, 0, &w->diag, &w->output);
+        return 0;
+    }
+    buffer_reserve(&w->request, body + 1);
+    if (read_full(p->fd, w->request.data, body) != 0) {
+        return 0;
+    }
+    w->request.len = body;
+
+    int32_t status = EIDOS_OK;
+    uint32_t cached = 0;
+    switch ((ServerKind)req.kind) {
+    case SERVER_COMPILE:
+        if (req.target > EIDOS_TARGET_TOKENS) {
+            const char *bad = "ERROR: Unknown target.\n";
+            buffer_set(&w->diag, bad, strlen(bad));
+            status = EIDOS_BAD_OPTIONS;
+            break;
+        }
+        status = compile_cached(w, ctx, &req, (EidosTarget)req.target, &cached);
+        break;
+    case SERVER_RUN: {
+        status = compile_cached(w, ctx, &req, EIDOS_TARGET_IMAGE, &cached);
+        if (status != EIDOS_OK) {
+            break;
+        }
+        // a program may run for a long time, or wait forever: it takes turns with the others
+        const char *input = w->request.data + req.name_len + req.passes_len + req.source_len;
+        Run *run = xmalloc(sizeof(Run));
+        run->server = server;
+        run->fd = p->fd;
+        run->accepted = p->accepted;
+        run->cached = cached;
+        memset(&run->diag, 0, sizeof(Buffer));
+        buffer_set(&run->diag, w->diag.data, w->diag.len);
+        if (sched_spawn(server->sched, w->output.data, w->output.len, input, req.input_len, 1,
+                        run_done, run)) {
+            return 1;
+        }
+        free(run->diag.data);
+        free(run);
+        const char *unusable = "Error: Compiled image is not usable\n";
+        buffer_append(&w->diag, unusable, strlen(unusable));
+        buffer_set(&w->output, "", 0);
+        status = EIDOS_BAD_OPTIONS;
+        break;
+    }
+    case SERVER_STATS:
+        format_stats(server, &w->output);
+        break;
+    case SERVER_STOP:
+        stop(server);
+        break;
+    }
+
+    respond(p->fd, status, cached, &w->diag, &w->output);
+    record(server, (ServerKind)req.kind, p->accepted, w);
+    return 0;
+}
+
+static void *work(void *arg) {
+    Worker *w = arg;
+    Server *server = w->server;
+
+    EidosAllocator allocator = pool_allocator(&w->pool);
+    EidosContext *ctx = eidos_context_new(&allocator);
+    if (!ctx) {
+        fprintf(stderr, "Error: Failed to allocate compilation context\n");
+        exit(1);
+    }
+
+    for (;;) {
+        pthread_mutex_lock(&server->lock);
+        while (server->queue_len == 0 && !server->stopping) {
+            pthread_cond_wait(&server->work, &server->lock);
+        }
+        // queued requests are still answered when stopping
+        if (server->queue_len == 0) {
+            pthread_mutex_unlock(&server->lock);
+            break;
+        }
+        Pending p = server->queue[server->queue_head];
+        server->queue_head = (server->queue_head + 1) % QUEUE_CAPACITY;
+        server->queue_len--;
+        pthread_cond_signal(&server->room);
+        pthread_mutex_unlock(&server->lock);
+
+        if (!handle(w, ctx, &p)) {
+            close(p.fd);
+        }
+    }
+
+    eidos_context_free(ctx);
+    return NULL;
+}
+
+static int listen_on(const char *path) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "ERROR: Socket path '%s' is too long.\n", path);
+        return -1;
+    }
+
+    // a socket file nobody answers on was left by a server that died
+    int other = connect_to(path);
+    if (other >= 0) {
+        close(other);
+        fprintf(stderr, "ERROR: A server is already listening on %s.\n", path);
+        return -1;
+    }
+    unlink(path);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    // only the user who started the server may talk to it
+    mode_t old_mask = umask(077);
+    int bound = bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+    umask(old_mask);
+    if (bound != 0 || listen(fd, 128) != 0) {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+
+/* ========== PUBLIC API ========== */
+
+const char *server_default_socket(void) {
+    static char path[108];
+    const char *env = getenv("EIDOS_SOCKET");
+    if (env && *env) {
+        return env;
+    }
+    snprintf(path, sizeof(path), "/tmp/eidos-%u.sock", (unsigned)getuid());
+    return path;
+}
+
+/*
+Runs the server
+
+args:
+    *options (ServerOptions) -> socket, workers, cache and run budget
+
+returns:
+    (int) -> 0 after a SERVER_STOP or signal, 1 if it couldn't start
+*/
+int server_main(const ServerOptions *options) {
+    Server *server = calloc(1, sizeof(Server));
+    if (!server) {
+        fprintf(stderr, "Error: Failed to allocate server state\n");
+        return 1;
+    }
+    server->options = options;
+    server->listen_fd = listen_on(options->socket_path);
+    if (server->listen_fd < 0) {
+        free(server);
+        return 1;
+    }
+    server->started = now_millis();
+    pthread_mutex_init(&server->lock, NULL);
+    pthread_cond_init(&server->work, NULL);
+    pthread_cond_init(&server->room, NULL);
+    pthread_mutex_init(&server->cache.lock, NULL);
+    server->cache.budget = options->cache_bytes;
+    server->cache.lru.newer = server->cache.lru.older = &server->cache.lru;
+
+    // no SA_RESTART: a signal interrupts accept()
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    size_t nworkers = options->threads;
+    if (nworkers == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        nworkers = online > 0 ? (size_t)online : 1;
+    }
+    server->nworkers = nworkers;
+
+    // workers start with the signals blocked, so they land on the thread in accept()
+    sigset_t signals, old_signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, &old_signals);
+    SchedOptions sched_options = { nworkers, SCHED_SLICE, options->run_steps, SERVER_MAX_OUTPUT, client_waiting };
+    server->sched = sched_start(&sched_options);
+    if (!server->sched) {
+        fprintf(stderr, "Error: Failed to start worker thread\n");
+        exit(1);
+    }
+    server->workers = calloc(nworkers, sizeof(Worker));
+    if (!server->workers) {
+        fprintf(stderr, "Error: Failed to allocate server state\n");
+        exit(1);
+    }
+    for (size_t k = 0; k < nworkers; k++) {
+        server->workers[k].server = server;
+        if (pthread_create(&server->workers[k].thread, NULL, work, &server->workers[k]) != 0) {
+            fprintf(stderr, "Error: Failed to start worker thread\n");
+            exit(1);
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+    fprintf(stderr, "server: listening on %s with %zu workers\n", options->socket_path, nworkers);
+
+    for (;;) {
+        int fd = accept(server->listen_fd, NULL, NULL);
+        double accepted = now_millis();
+
+        pthread_mutex_lock(&server->lock);
+        int stopping = server->stopping || interrupted;
+        pthread_mutex_unlock(&server->lock);
+        if (fd < 0) {
+            if (stopping) {
+                break;
+            }
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            perror("accept");
+            break;
+        }
+        if (stopping) {
+            close(fd);
+            break;
+        }
+
+        // a client that connects and never sends must not hold a worker forever
+        struct timeval timeout = { 10, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        pthread_mutex_lock(&server->lock);
+        while (server->queue_len == QUEUE_CAPACITY) {
+            pthread_cond_wait(&server->room, &server->lock);
+        }
+        Pending p = { fd, accepted };
+        server->queue[(server->queue_head + server->queue_len) % QUEUE_CAPACITY] = p;
+        server->queue_len++;
+        if (server->queue_len > server->queue_max) {
+            server->queue_max = server->queue_len;
+        }
+        pthread_cond_signal(&server->work);
+        pthread_mutex_unlock(&server->lock);
+    }
+
+    pthread_mutex_lock(&server->lock);
+    server->stopping = 1;
+    pthread_cond_broadcast(&server->work);
+    pthread_mutex_unlock(&server->lock);
+    for (size_t k = 0; k < nworkers; k++) {
+        Worker *w = &server->workers[k];
+        pthread_join(w->thread, NULL);
+        pool_free(&w->pool);
+        free(w->request.data);
+        free(w->diag.data);
+        free(w->output.data);
+        free(w->key.data);
+    }
+    // runs still going are cancelled, and answered as such
+    sched_stop(server->sched);
+
+    close(server->listen_fd);
+    unlink(options->socket_path);
+    while (server->cache.entries) {
+        evict_oldest(&server->cache);
+    }
+    pthread_mutex_destroy(&server->cache.lock);
+    pthread_cond_destroy(&server->room);
+    pthread_cond_destroy(&server->work);
+    pthread_mutex_destroy(&server->lock);
+    free(server->workers);
+    free(server);
+    fprintf(stderr, "server: stopped\n");
+    return 0;
+}
+
+/*
+Sends one request to a server and reads its answer
+
+args:
+    *socket_path (char) -> server socket
+    *request (ServerRequest) -> header, magic and lengths included
+    *name, *passes, *source, *input (char) -> the strings the header announces
+    *response (ServerResponse) -> receives the answer's header
+    **diag, **output (char) -> receive the answer's strings, malloc'd
+
+returns:
+    (int) -> 0, -1 if no server is listening, -2 if the exchange failed
+*/
+int server_request(const char *socket_path, const ServerRequest *request, const char *name,
+                   const char *passes, const char *source, const char *input,
+                   ServerResponse *response, char **diag, char **output) {
+    int fd = connect_to(socket_path);
+    if (fd < 0) {
+        return -1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    *diag = NULL;
+    *output = NULL;
+    if (write_full(fd, request, sizeof(ServerRequest)) != 0 ||
+        write_full(fd, name, request->name_len) != 0 ||
+        write_full(fd, passes, request->passes_len) != 0 ||
+        write_full(fd, source, request->source_len) != 0 ||
+        write_full(fd, input, request->input_len) != 0 ||
+        read_full(fd, response, sizeof(ServerResponse)) != 0 ||
+        memcmp(response->magic, SERVER_RESPONSE_MAGIC, 4) != 0) {
+        close(fd);
+        return -2;
+    }
+
+    *diag = malloc(response->diag_len + 1);
+    *output = malloc(response->output_len + 1);
+    if (!*diag || !*output || read_full(fd, *diag, response->diag_len) != 0 ||
+        read_full(fd, *output, response->output_len) != 0) {
+        free(*diag);
+        free(*output);
+        *diag = *output = NULL;
+        close(fd);
+        return -2;
+    }
+    (*diag)[response->diag_len] = '\0';
+    (*output)[response->output_len] = '\0';
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+/*
+Compile server: `eidos --server` keeps a warm compiler running behind a Unix
+domain socket, `eidos --client ...` forwards a command line to it.
+
+Each connection carries one request and its answer, both a fixed header
+followed by the byte strings it announces:
+
+    request:  ServerRequest, name, passes, source, input
+    response: ServerResponse, diagnostics, output
+
+A compile request names an EidosTarget and the optimization options; EIDOS
+runs are requests for SERVER_RUN, which compiles the source to a bytecode
+image and runs it with `input` as stdin. The server answers with the
+EidosStatus, what eidos would have printed to stderr, and the output.
+
+Requests are queued for a pool of worker threads, each with its own
+libeidos context on a recycling allocator (driver/pool.h). The program of a
+SERVER_RUN is not run by the worker that compiled it but by a scheduler
+(driver/sched.h) with as many threads, in slices of SCHED_SLICE
+instructions, so a program that never ends holds no thread. A run is
+cancelled when its client disconnects, stops after --run-steps
+instructions (SERVER_RUN_STEPS unless given) and fails once it has printed
+SERVER_MAX_OUTPUT bytes; clients keep the connection open until the answer
+comes. Stopping the server cancels the runs still going. Results are
+cached by their complete request (options and source), so a repeated
+compile is a lookup, and a repeated run skips straight to the bytecode.
+SERVER_STATS reports request counts, latency percentiles, queue depth and
+cache use.
+
+Both sides are the same binary on the same machine, so headers are sent in
+native byte order.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include "../lib/eidos.h"
+
+#define SERVER_REQUEST_MAGIC "EIDQ"
+#define SERVER_RESPONSE_MAGIC "EIDR"
+
+// largest request a server accepts, in bytes after the header
+#define SERVER_MAX_REQUEST (256u << 20)
+
+// instructions a SERVER_RUN may execute unless --run-steps says otherwise, a few seconds
+#define SERVER_RUN_STEPS 1000000000ULL
+
+// most output a SERVER_RUN may print, in bytes
+#define SERVER_MAX_OUTPUT (64u << 20)
+
+typedef enum ServerKind {
+    SERVER_COMPILE,             // produce target's output
+    SERVER_RUN,                 // compile to an image and run it on `input`
+    SERVER_STATS,               // text report of the server's counters
+    SERVER_STOP,                // finish queued requests and exit
+} ServerKind;
+
+// option bits of ServerRequest.flags
+#define SERVER_NO_FOLD      1u
+#define SERVER_NO_UNROLL    2u
+#define SERVER_NO_PE        4u
+#define SERVER_NO_CSE       8u
+#define SERVER_NO_VECTORIZE 16u
+#define SERVER_NO_PEEPHOLE  32u
+
+typedef struct ServerRequest {
+    char magic[4];              // SERVER_REQUEST_MAGIC
+    uint32_t kind;              // ServerKind
+    uint32_t target;            // EidosTarget of SERVER_COMPILE
+    uint32_t flags;             // SERVER_NO_*
+    uint64_t unroll_full;
+    uint64_t unroll_factor;
+    uint64_t unroll_budget;
+    uint64_t pe_steps;
+    double pe_millis;
+    uint64_t name_len;          // source name, used in generated code
+    uint64_t passes_len;        // --passes list, 0 for the default pipeline
+    uint64_t source_len;
+    uint64_t input_len;         // stdin of SERVER_RUN
+} ServerRequest;
+
+typedef struct ServerResponse {
+    char magic[4];              // SERVER_RESPONSE_MAGIC
+    int32_t status;             // EidosStatus
+    uint32_t cached;            // 1 if the compilation came from the cache
+    uint32_t unused;
+    uint64_t diag_len;
+    uint64_t output_len;
+} ServerResponse;
+
+typedef struct ServerOptions {
+    const char *socket_path;
+    size_t threads;             // workers, 0 for one per online CPU
+    size_t cache_bytes;         // cache budget, 0 for no cache
+    uint64_t run_steps;         // instructions a SERVER_RUN may execute, 0 for no limit
+} ServerOptions;
+
+
+/* ========== Public API Functions ========== */
+
+/*
+Socket path used when none is given: $EIDOS_SOCKET, else
+/tmp/eidos-<uid>.sock. Returns a static buffer.
+*/
+const char *server_default_socket(void);
+
+/*
+Serves requests until a SERVER_STOP arrives. Returns the exit status.
+*/
+int server_main(const ServerOptions *options);
+
+/*
+Sends one request and waits for the answer
+
+args:
+    *socket_path (char) -> server socket
+    *request (ServerRequest) -> header, lengths included
+    *name, *passes, *source, *input (char) -> the strings the header announces
+    *response (ServerResponse) -> filled in
+    **diag, **output (char) -> receive the malloc'd strings of the answer, NUL terminated
+
+returns:
+    (int) -> 0, -1 if no server is listening (errno set), -2 if the exchange failed
+*/
+int server_request(const char *socket_path, const ServerRequest *request, const char *name,
+                   const char *passes, const char *source, const char *input,
+                   ServerResponse *response, char **diag, char **output);
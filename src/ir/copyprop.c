@@ -0,0 +1,132 @@
+#include "passes.h"
+#include "../util/context.h"
+#include <stdlib.h>
+
+/* ===== Helper Functions ===== */
+
+/*
+Follows forwarding links to the value a use should point at
+
+args:
+    *repl (int) -> forwarding table, repl[v] == v for values that stay
+    v (int) -> value id
+
+returns:
+    (int) -> final value id
+*/
+static int find(int *repl, int v) {
+    while (repl[v] != v) {
+        repl[v] = repl[repl[v]];    // path halving
+        v = repl[v];
+    }
+    return v;
+}
+
+
+/* ========== PUBLIC API ========== */
+
+/*
+Copy propagation
+
+args:
+    *fn (IRFunction) -> function to rewrite
+
+returns:
+    (size_t) -> number of copies and phis removed
+*/
+size_t ir_pass_copy_propagation(IRFunction *fn) {
+    int *repl = eidos_malloc((fn->ninsts ? fn->ninsts : 1) * sizeof(int));
+    if (!repl) {
+        eidos_fatal("Failed to allocate copy propagation table");
+    }
+    for (size_t v = 0; v < fn->ninsts; v++) {
+        repl[v] = (int)v;
+    }
+
+    // a phi can only become trivial once the phis feeding it have, so iterate
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+
+        for (size_t i = 0; i < fn->nblocks; i++) {
+            IRBlock *bb = &fn->blocks[i];
+            if (bb->dead) {
+                continue;
+            }
+
+            for (size_t p = 0; p < bb->nphis; p++) {
+                int phi = bb->phis[p];
+                if (repl[phi] != phi) {
+                    continue;
+                }
+
+                IRInst *in = &fn->insts[phi];
+                int unique = -1;
+                int trivial = 1;
+
+                for (size_t a = 0; a < in->nphi; a++) {
+                    int arg = find(repl, in->phi_args[a]);
+                    if (arg == phi || arg == unique) {
+                        continue;
+                    }
+                    if (unique >= 0) {
+                        trivial = 0;
+                        break;
+                    }
+                    unique = arg;
+                }
+
+                if (trivial && unique >= 0) {
+                    repl[phi] = unique;
+                    changed = 1;
+                }
+            }
+
+            for (size_t k = 0; k < bb->ninsts; k++) {
+                int v = bb->insts[k];
+                if (fn->insts[v].op == IR_COPY && repl[v] == v) {
+                    repl[v] = find(repl, fn->insts[v].a);
+                    changed = 1;
+                }
+            }
+        }
+    }
+
+    // rewrite every use, then drop what was forwarded
+    for (size_t i = 0; i < fn->nblocks; i++) {
+        IRBlock *bb = &fn->blocks[i];
+        if (bb->dead) {
+            continue;
+        }
+
+        for (size_t p = 0; p < bb->nphis; p++) {
+            IRInst *in = &fn->insts[bb->phis[p]];
+            for (size_t a = 0; a < in->nphi; a++) {
+                in->phi_args[a] = find(repl, in->phi_args[a]);
+            }
+        }
+        for (size_t k = 0; k < bb->ninsts; k++) {
+            IRInst *in = &fn->insts[bb->insts[k]];
+            for (size_t o = 0; o < ir_num_operands(in); o++) {
+                int *op = ir_operand(in, o);
+                *op = find(repl, *op);
+            }
+        }
+        if (bb->term == TERM_BR) {
+            bb->cond = find(repl, bb->cond);
+        }
+    }
+
+    char *keep = eidos_malloc(fn->ninsts ? fn->ninsts : 1);
+    if (!keep) {
+        eidos_fatal("Failed to allocate copy propagation table");
+    }
+    for (size_t v = 0; v < fn->ninsts; v++) {
+        keep[v] = repl[v] == (int)v;
+    }
+    size_t removed = ir_delete_insts(fn, keep);
+
+    eidos_free(keep);
+    eidos_free(repl);
+    return removed;
+}
@@ -0,0 +1,61 @@
+#include "passes.h"
+#include "../util/context.h"
+#include <stdlib.h>
+
+/* ========== PUBLIC API ========== */
+
+/*
+Dead-store elimination: mark everything printing, reading, branching or
+trapping depends on, then sweep the rest
+
+args:
+    *fn (IRFunction) -> function to rewrite
+
+returns:
+    (size_t) -> number of definitions removed
+*/
+size_t ir_pass_dead_stores(IRFunction *fn) {
+    char *live = eidos_calloc(fn->ninsts ? fn->ninsts : 1, 1);
+    int *work = eidos_malloc((fn->ninsts ? fn->ninsts : 1) * sizeof(int));
+    if (!live || !work) {
+        eidos_fatal("Failed to allocate dead store state");
+    }
+
+    size_t top = 0;
+
+    for (size_t i = 0; i < fn->nblocks; i++) {
+        IRBlock *bb = &fn->blocks[i];
+        if (bb->dead) {
+            continue;
+        }
+
+        for (size_t k = 0; k < bb->ninsts; k++) {
+            int v = bb->insts[k];
+            if (ir_has_side_effects(fn, &fn->insts[v]) && !live[v]) {
+                live[v] = 1;
+                work[top++] = v;
+            }
+        }
+        if (bb->term == TERM_BR && !live[bb->cond]) {
+            live[bb->cond] = 1;
+            work[top++] = bb->cond;
+        }
+    }
+
+    while (top) {
+        IRInst *in = &fn->insts[work[--top]];
+        for (size_t o = 0; o < ir_num_operands(in); o++) {
+            int op = *ir_operand(in, o);
+            if (!live[op]) {
+                live[op] = 1;
+                work[top++] = op;
+            }
+        }
+    }
+
+    size_t removed = ir_delete_insts(fn, live);
+
+    eidos_free(work);
+    eidos_free(live);
+    return removed;
+}
@@ -0,0 +1,419 @@
+#include "passes.h"
+#include "../util/context.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+Function inlining.
+
+Replaces a call by a copy of the function's blocks, which saves the call
+itself and lets the passes after this one fold the arguments into the body.
+Only leaf functions are inlined, the ones that call nothing, so inlining
+always ends and a recursive function is never copied into itself.
+
+The cost of a function is its instruction count. A call in a loop body runs
+once per iteration, so it may pull in a bigger function (IR_INLINE_HOT_COST)
+than a call running once (IR_INLINE_COST). Functions with loops are left
+alone, their IRLoop records would have to be nested into the caller's.
+
+A function with a single block is spliced into the calling block in place.
+Otherwise the calling block is split after the call: the first part jumps to
+the copy of the function's entry, its return block jumps to the second part,
+which takes over the terminator. Calls in a loop header stay, so a header
+keeps evaluating its condition.
+*/
+
+/* ===== Helper Functions ===== */
+
+/*
+Cost of inlining a function, 0 if it can't be inlined
+
+args:
+    *callee (IRFunction) -> the called function
+
+returns:
+    (size_t) -> its live instruction count, 0 if it calls, loops or returns twice
+*/
+static size_t inline_cost(const IRFunction *callee) {
+    size_t rets = 0;
+
+    if (callee->nloops) {
+        return 0;
+    }
+    for (size_t i = 0; i < callee->nblocks; i++) {
+        const IRBlock *bb = &callee->blocks[i];
+        if (bb->dead) {
+            continue;
+        }
+        for (size_t k = 0; k < bb->ninsts; k++) {
+            if (callee->insts[bb->insts[k]].op == IR_CALL) {
+                return 0;
+            }
+        }
+        rets += bb->term == TERM_RET;
+    }
+    if (rets != 1) {
+        return 0;
+    }
+    return ir_count_insts(callee);
+}
+
+/*
+Moves the instructions after position k of a block into a new block, which
+also takes over the block's terminator and outgoing edges
+
+returns:
+    (int) -> the new block's id
+*/
+static int split_after(IRFunction *fn, int block, size_t k) {
+    IRBlock *src = &fn->blocks[block];
+    int next = ir_new_block(fn, src->role, src->line, src->col);
+
+    // ir_new_block may have moved the blocks
+    src = &fn->blocks[block];
+    IRBlock *dst = &fn->blocks[next];
+
+    for (size_t i = k + 1; i < src->ninsts; i++) {
+        int v = src->insts[i];
+        fn->insts[v].block = next;
+        if (dst->ninsts == dst->insts_cap) {
+            dst->insts_cap = dst->insts_cap ? dst->insts_cap * 2 : 8;
+            dst->insts = eidos_realloc(dst->insts, dst->insts_cap * sizeof(int));
+            if (!dst->insts) {
+                eidos_fatal("Failed to allocate inlined block");
+            }
+        }
+        dst->insts[dst->ninsts++] = v;
+    }
+    src->ninsts = k + 1;
+
+    dst->term = src->term;
+    dst->cond = src->cond;
+    dst->succ[0] = src->succ[0];
+    dst->succ[1] = src->succ[1];
+    dst->likely = src->likely;
+    dst->cold = src->cold;
+
+    // same slot in the successors' pred lists, so their phis stay in order
+    for (int s = 0; s < 2; s++) {
+        int succ = dst->succ[s];
+        if (succ < 0 || (s == 1 && succ == dst->succ[0])) {
+            continue;
+        }
+        IRBlock *sb = &fn->blocks[succ];
+        for (size_t p = 0; p < sb->npreds; p++) {
+            if (sb->preds[p] == block) {
+                sb->preds[p] = next;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < fn->nloops; i++) {
+        if (fn->loops[i].preheader == block) {
+            fn->loops[i].preheader = next;
+        }
+        if (fn->loops[i].latch == block) {
+            fn->loops[i].latch = next;
+        }
+    }
+
+    src->term = TERM_NONE;
+    src->cond = -1;
+    src->succ[0] = -1;
+    src->succ[1] = -1;
+    src->likely = 0;
+    return next;
+}
+
+/*
+Copies an instruction of the callee into a block of the caller, operands
+still naming callee values
+
+returns:
+    (int) -> value id of the copy
+*/
+static int clone_inst(IRFunction *fn, int block, const IRInst *in) {
+    int v = in->op == IR_PHI ? ir_new_phi(fn, block) : ir_emit(fn, block, in->op, in->a, in->b, in->imm);
+    IRInst *copy = &fn->insts[v];
+    copy->imm = in->imm;
+    copy->line = in->line;
+    copy->col = in->col;
+    if (in->nphi) {
+        copy->phi_args = eidos_malloc(in->nphi * sizeof(int));
+        if (!copy->phi_args) {
+            eidos_fatal("Failed to allocate inlined phi");
+        }
+        memcpy(copy->phi_args, in->phi_args, in->nphi * sizeof(int));
+        copy->nphi = in->nphi;
+    }
+    return v;
+}
+
+/*
+Points the operands of a copied instruction at the caller's values
+*/
+static void remap_operands(IRFunction *fn, int v, const int *vmap) {
+    IRInst *in = &fn->insts[v];
+    for (size_t o = 0; o < ir_num_operands(in); o++) {
+        int *op = ir_operand(in, o);
+        *op = vmap[*op];
+    }
+}
+
+/*
+Turns the call into a copy of the value the callee returns
+*/
+static void call_to_copy(IRFunction *fn, int call, int value) {
+    IRInst *in = &fn->insts[call];
+    eidos_free(in->phi_args);
+    in->phi_args = NULL;
+    in->nphi = 0;
+    in->op = IR_COPY;
+    in->a = value;
+    in->b = -1;
+    in->imm = 0;
+}
+
+/*
+Inlines a single block function: its instructions go right before the call
+
+args:
+    *fn (IRFunction) -> caller
+    block (int) -> block of the call
+    k (size_t) -> position of the call in the block
+    *callee (IRFunction) -> called function
+    *vmap (int) -> scratch, callee->ninsts long
+*/
+static void inline_in_place(IRFunction *fn, int block, size_t k, const IRFunction *callee, int *vmap) {
+    int call = fn->blocks[block].insts[k];
+    const IRBlock *body = &callee->blocks[callee->entry];
+    size_t before = fn->blocks[block].ninsts;
+    int ret = -1;
+
+    for (size_t i = 0; i < body->ninsts; i++) {
+        int old = body->insts[i];
+        const IRInst *in = &callee->insts[old];
+        if (in->op == IR_PARAM) {
+            vmap[old] = fn->insts[call].phi_args[in->imm];
+        } else if (in->op == IR_RETURN) {
+            ret = vmap[in->a];
+        } else {
+            vmap[old] = clone_inst(fn, block, in);
+            remap_operands(fn, vmap[old], vmap);
+        }
+    }
+
+    // the copies were appended, rotate them in front of the call
+    IRBlock *bb = &fn->blocks[block];
+    size_t added = bb->ninsts - before;
+    if (added) {
+        int *tail = eidos_malloc(added * sizeof(int));
+        if (!tail) {
+            eidos_fatal("Failed to allocate inlined block");
+        }
+        memcpy(tail, &bb->insts[before], added * sizeof(int));
+        memmove(&bb->insts[k + added], &bb->insts[k], (before - k) * sizeof(int));
+        memcpy(&bb->insts[k], tail, added * sizeof(int));
+        eidos_free(tail);
+    }
+
+    call_to_copy(fn, call, ret);
+}
+
+/*
+Inlines a function with several blocks by splitting the calling block
+
+args:
+    *fn (IRFunction) -> caller
+    block (int) -> block of the call
+    k (size_t) -> position of the call in the block
+    *callee (IRFunction) -> called function
+    *vmap (int) -> scratch, callee->ninsts long
+    *bmap (int) -> scratch, callee->nblocks long
+*/
+static void inline_split(IRFunction *fn, int block, size_t k, const IRFunction *callee, int *vmap, int *bmap) {
+    int call = fn->blocks[block].insts[k];
+    int cont = split_after(fn, block, k);
+    int ret = -1;
+
+    for (size_t b = 0; b < callee->nblocks; b++) {
+        const IRBlock *cb = &callee->blocks[b];
+        bmap[b] = cb->dead ? -1 : ir_new_block(fn, cb->role, cb->line, cb->col);
+    }
+
+    // copy first: phis and operands may name values of blocks copied later
+    for (size_t b = 0; b < callee->nblocks; b++) {
+        const IRBlock *cb = &callee->blocks[b];
+        if (cb->dead) {
+            continue;
+        }
+        for (size_t i = 0; i < cb->nphis; i++) {
+            vmap[cb->phis[i]] = clone_inst(fn, bmap[b], &callee->insts[cb->phis[i]]);
+        }
+        for (size_t i = 0; i < cb->ninsts; i++) {
+            int old = cb->insts[i];
+            const IRInst *in = &callee->insts[old];
+            if (in->op == IR_PARAM) {
+                vmap[old] = fn->insts[call].phi_args[in->imm];
+            } else if (in->op != IR_RETURN) {
+                vmap[old] = clone_inst(fn, bmap[b], in);
+            }
+        }
+    }
+
+    for (size_t b = 0; b < callee->nblocks; b++) {
+        const IRBlock *cb = &callee->blocks[b];
+        if (cb->dead) {
+            continue;
+        }
+        IRBlock *nb = &fn->blocks[bmap[b]];
+        for (size_t i = 0; i < nb->nphis; i++) {
+            remap_operands(fn, nb->phis[i], vmap);
+        }
+        for (size_t i = 0; i < nb->ninsts; i++) {
+            remap_operands(fn, nb->insts[i], vmap);
+        }
+        for (size_t p = 0; p < cb->npreds; p++) {
+            ir_add_pred(fn, bmap[b], bmap[cb->preds[p]]);
+        }
+
+        nb = &fn->blocks[bmap[b]];
+        nb->likely = cb->likely;
+        if (cb->term == TERM_RET) {
+            // the IR_RETURN was left out, its block ends the copy
+            ret = vmap[callee->insts[cb->insts[cb->ninsts - 1]].a];
+            nb->term = TERM_JMP;
+            nb->succ[0] = cont;
+            ir_add_pred(fn, cont, bmap[b]);
+            continue;
+        }
+        nb->term = cb->term;
+        nb->cond = cb->cond >= 0 ? vmap[cb->cond] : -1;
+        nb->succ[0] = cb->succ[0] >= 0 ? bmap[cb->succ[0]] : -1;
+        nb->succ[1] = cb->succ[1] >= 0 ? bmap[cb->succ[1]] : -1;
+    }
+
+    IRBlock *bb = &fn->blocks[block];
+    bb->term = TERM_JMP;
+    bb->succ[0] = bmap[callee->entry];
+    ir_add_pred(fn, bmap[callee->entry], block);
+
+    call_to_copy(fn, call, ret);
+}
+
+/*
+Marks the blocks of every intact loop, and the loop headers
+
+args:
+    *fn (IRFunction) -> function
+    *hot (char) -> receives 1 per block inside a loop, fn->nblocks long
+    *header (char) -> receives 1 per loop header, fn->nblocks long
+*/
+static void mark_loops(const IRFunction *fn, char *hot, char *header) {
+    char *in_loop = eidos_calloc(fn->nblocks ? fn->nblocks : 1, 1);
+    int *blocks = eidos_malloc((fn->nblocks ? fn->nblocks : 1) * sizeof(int));
+    if (!in_loop || !blocks) {
+        eidos_fatal("Failed to allocate inliner state");
+    }
+    memset(hot, 0, fn->nblocks);
+    memset(header, 0, fn->nblocks);
+
+    for (size_t i = 0; i < fn->nloops; i++) {
+        header[fn->loops[i].header] = 1;
+        size_t n = ir_loop_body(fn, &fn->loops[i], in_loop, blocks);
+        for (size_t b = 0; b < n; b++) {
+            hot[blocks[b]] = 1;
+            in_loop[blocks[b]] = 0;
+        }
+    }
+    eidos_free(blocks);
+    eidos_free(in_loop);
+}
+
+
+/* ========== PUBLIC API ========== */
+
+/*
+Inlines the calls to small leaf functions
+
+args:
+    *fn (IRFunction) -> function to rewrite
+
+returns:
+    (size_t) -> number of calls inlined
+*/
+size_t ir_pass_inline(IRFunction *fn) {
+    if (!fn->nfuncs) {
+        return 0;
+    }
+
+    size_t *cost = eidos_malloc(fn->nfuncs * sizeof(size_t));
+    if (!cost) {
+        eidos_fatal("Failed to allocate inliner state");
+    }
+    size_t max_insts = 1, max_blocks = 1;
+    for (size_t i = 0; i < fn->nfuncs; i++) {
+        const IRFunction *callee = fn->funcs[i];
+        cost[i] = callee == fn ? 0 : inline_cost(callee);
+        if (callee->ninsts > max_insts) {
+            max_insts = callee->ninsts;
+        }
+        if (callee->nblocks > max_blocks) {
+            max_blocks = callee->nblocks;
+        }
+    }
+
+    char *hot = eidos_malloc(fn->nblocks ? fn->nblocks : 1);
+    char *header = eidos_malloc(fn->nblocks ? fn->nblocks : 1);
+    int *vmap = eidos_malloc(max_insts * sizeof(int));
+    int *bmap = eidos_malloc(max_blocks * sizeof(int));
+    if (!hot || !header || !vmap || !bmap) {
+        eidos_fatal("Failed to allocate inliner state");
+    }
+    mark_loops(fn, hot, header);
+
+    size_t inlined = 0;
+
+    for (size_t b = 0; b < fn->nblocks; b++) {
+        if (fn->blocks[b].dead || header[b]) {
+            continue;
+        }
+
+        for (size_t k = 0; k < fn->blocks[b].ninsts; k++) {
+            const IRInst *in = &fn->insts[fn->blocks[b].insts[k]];
+            if (in->op != IR_CALL) {
+                continue;
+            }
+            size_t c = cost[in->imm];
+            if (c == 0 || c > (hot[b] ? IR_INLINE_HOT_COST : IR_INLINE_COST)) {
+                continue;
+            }
+
+            const IRFunction *callee = fn->funcs[in->imm];
+            inlined++;
+            if (ir_count_blocks(callee) == 1) {
+                inline_in_place(fn, (int)b, k, callee, vmap);
+                continue;
+            }
+
+            // the new blocks run as often as the one they were split from
+            size_t first = fn->nblocks;
+            inline_split(fn, (int)b, k, callee, vmap, bmap);
+            hot = eidos_realloc(hot, fn->nblocks);
+            header = eidos_realloc(header, fn->nblocks);
+            if (!hot || !header) {
+                eidos_fatal("Failed to allocate inliner state");
+            }
+            memset(&hot[first], hot[b], fn->nblocks - first);
+            memset(&header[first], 0, fn->nblocks - first);
+            break;      // the rest of the block moved to a new one, scanned when the loop gets there
+        }
+    }
+
+    eidos_free(bmap);
+    eidos_free(vmap);
+    eidos_free(header);
+    eidos_free(hot);
+    eidos_free(cost);
+    return inlined;
+}
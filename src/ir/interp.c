@@ -0,0 +1,479 @@
+#include "interp.h"
+#include "profile.h"
+#include "../util/context.h"
+#include "../runtime/eidos_io.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* ===== Helper Functions ===== */
+
+static void runtime_error(const IRInst *in, const char *message) {
+    eidos_diag("Runtime Error at line %zu, column %zu: %s\n", in->line, in->col, message);
+}
+
+/*
+Zero-filled storage for every array of the function
+
+returns:
+    (int64_t**) -> one allocation per array, free with free_arrays
+*/
+static int64_t **alloc_arrays(const IRFunction *fn) {
+    int64_t **arrays = eidos_calloc(fn->narrays ? fn->narrays : 1, sizeof(int64_t*));
+    if (!arrays) {
+        eidos_fatal("Failed to allocate arrays");
+    }
+    for (size_t i = 0; i < fn->narrays; i++) {
+        arrays[i] = eidos_calloc((size_t)fn->arrays[i].size, sizeof(int64_t));
+        if (!arrays[i]) {
+            eidos_fatal("Failed to allocate array '%s'", fn->arrays[i].name);
+        }
+    }
+    return arrays;
+}
+
+static void free_arrays(const IRFunction *fn, int64_t **arrays) {
+    for (size_t i = 0; i < fn->narrays; i++) {
+        eidos_free(arrays[i]);
+    }
+    eidos_free(arrays);
+}
+
+/*
+Evaluates the phis of a block for the edge control arrived on. All phis read
+their arguments before any is written, they behave as one parallel copy.
+
+args:
+    *fn (IRFunction) -> function
+    *bb (IRBlock) -> block being entered
+    from (int) -> predecessor block id
+    *values (int64_t) -> value table
+    *scratch (int64_t) -> temporary space, at least bb->nphis long
+*/
+static void enter_block(const IRFunction *fn, const IRBlock *bb, int from,
+                        int64_t *values, int64_t *scratch) {
+    size_t edge = 0;
+    while (edge < bb->npreds && bb->preds[edge] != from) {
+        edge++;
+    }
+
+    for (size_t i = 0; i < bb->nphis; i++) {
+        scratch[i] = values[fn->insts[bb->phis[i]].phi_args[edge]];
+    }
+    for (size_t i = 0; i < bb->nphis; i++) {
+        values[bb->phis[i]] = scratch[i];
+    }
+}
+
+
+/*
+Follows the loops of a --profile-gen run: entering a header from outside
+starts a loop, coming back from the latch is one more trip, and reaching the
+exit from the header files the trip count
+
+args:
+    *fn (IRFunction) -> function running
+    *profile (IRProfile) -> counters with loop_trips set up
+    func (int) -> its index in the profile (ir_profile_function)
+    prev (int) -> block control came from, -1 at the start
+    cur (int) -> block being entered
+*/
+static void count_trips(const IRFunction *fn, IRProfile *profile, int func, int prev, int cur) {
+    size_t block = profile->block_base[func] + (size_t)cur;
+    int loop = profile->header_loop[block];
+    if (loop >= 0) {
+        IRLoopTrips *trips = &profile->loop_trips[profile->loop_base[func] + (size_t)loop];
+        trips->current = prev == fn->loops[loop].preheader ? 0 : trips->current + 1;
+    }
+    loop = profile->exit_loop[block];
+    if (loop >= 0 && prev == fn->loops[loop].header) {
+        IRLoopTrips *trips = &profile->loop_trips[profile->loop_base[func] + (size_t)loop];
+        trips->buckets[ir_trip_bucket(trips->current)]++;
+    }
+}
+
+// A call in progress: where the caller resumes once the callee returns
+typedef struct Frame {
+    const IRFunction *fn;   // the caller
+    int func;               // its index in a profile, 0 for main
+    size_t base;            // its values in the value stack
+    int block;              // block of the call
+    size_t next;            // instruction after the call
+    int prev;               // block control came from into `block`
+    int dst;                // the call's value id
+} Frame;
+
+/*
+Makes room for `need` values on the value stack, which may move
+
+args:
+    **stack (int64_t) -> value stack, reallocated
+    *cap (size_t) -> its capacity in values, updated
+    need (size_t) -> values it must hold
+*/
+static void reserve_values(int64_t **stack, size_t *cap, size_t need) {
+    if (need <= *cap) {
+        return;
+    }
+    while (*cap < need) {
+        *cap *= 2;
+    }
+    *stack = eidos_realloc(*stack, *cap * sizeof(int64_t));
+    if (!*stack) {
+        eidos_fatal("Failed to allocate call frames");
+    }
+}
+
+static double now_millis(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/*
+Runs a function, the core of ir_interpret and ir_evaluate.
+
+Calls don't recurse in C. Every function gets a fixed-size frame of values
+on one value stack: its fn->ninsts values followed by its parameters, which
+the caller stores there before jumping to the callee's entry. The stack and
+the list of calls in progress are pooled, they only grow, so a call costs no
+allocation once the deepest call chain has been seen. Programs without
+calls never allocate either.
+
+args:
+    *fn (IRFunction) -> function to run
+    *in (FILE) -> where read() takes integers from, NULL makes read() an error
+    *out (FILE) -> where print() writes to
+    *limits (IRExecLimits) -> budget, NULL for none
+    quiet (int) -> 1 to not report runtime errors
+    *exit_values (int64_t) -> receives fn->exit_values, may be NULL
+    *stats (IRExecStats) -> execution counters, may be NULL
+    *profile (IRProfile) -> block counters of a profiled run, NULL when not profiling
+
+returns:
+    (IRExecStatus) -> how the run ended
+*/
+static IRExecStatus execute(const IRFunction *fn, FILE *in, FILE *out, const IRExecLimits *limits,
+                            int quiet, int64_t *exit_values, IRExecStats *stats, IRProfile *profile) {
+    size_t stack_cap = fn->ninsts ? fn->ninsts : 1;
+    int64_t *stack = eidos_calloc(stack_cap, sizeof(int64_t));
+    int64_t *values = stack;
+    size_t max_phis = 1;
+    for (size_t f = 0; f <= fn->nfuncs; f++) {
+        const IRFunction *g = f < fn->nfuncs ? fn->funcs[f] : fn;
+        for (size_t i = 0; i < g->nblocks; i++) {
+            if (g->blocks[i].nphis > max_phis) {
+                max_phis = g->blocks[i].nphis;
+            }
+        }
+    }
+    int64_t *scratch = eidos_malloc(max_phis * sizeof(int64_t));
+    EidosOut *print_out = eidos_malloc(sizeof(EidosOut));
+    EidosIn *read_in = eidos_malloc(sizeof(EidosIn));
+    if (!values || !scratch || !print_out || !read_in) {
+        eidos_fatal("Failed to allocate interpreter state");
+    }
+    int64_t **arrays = alloc_arrays(fn);
+
+    eidos_out_init(print_out, out);
+    eidos_in_init(read_in, in, print_out);
+
+    uint64_t max_insts = limits && limits->max_insts ? limits->max_insts : UINT64_MAX;
+    double deadline = limits && limits->max_millis > 0 ? now_millis() + limits->max_millis : 0;
+    size_t max_output = limits ? limits->max_output : 0;
+    uint64_t next_clock_check = 1 << 16;
+
+    uint64_t insts = 0;
+    uint64_t blocks = 0;
+    uint64_t op_counts[IR_OP_COUNT] = {0};
+    IRExecStatus status = EXEC_OK;
+    int prev = -1;
+    int cur = fn->entry;
+
+    const IRFunction *cf = fn;  // function running
+    int func = 0;               // its index in a profile, 0 for main, f + 1 for fn->funcs[f]
+    size_t base = 0;            // its frame in the value stack
+    size_t resume = 0;          // instruction to go on from, 0 when entering a block
+    Frame *frames = NULL;
+    size_t depth = 0, frames_cap = 0;
+
+    while (cur >= 0) {
+        const IRBlock *bb = &cf->blocks[cur];
+        size_t k = resume;
+        if (resume) {
+            goto run;
+        }
+        blocks++;
+
+        if (profile) {
+            size_t counter = profile->block_base[func] + (size_t)cur;
+            profile->block_counts[counter]++;
+            profile->current_block = (sig_atomic_t)counter;
+            if (profile->loop_trips) {
+                count_trips(cf, profile, func, prev, cur);
+            }
+        }
+
+        // budgets are checked per block, the clock and the output only now and then
+        if (insts > max_insts) {
+            status = EXEC_LIMIT;
+            goto done;
+        }
+        if ((deadline || max_output) && insts >= next_clock_check) {
+            next_clock_check = insts + (1 << 16);
+            if (deadline && now_millis() > deadline) {
+                status = EXEC_LIMIT;
+                goto done;
+            }
+            if (max_output && (size_t)ftell(out) + print_out->len > max_output) {
+                status = EXEC_LIMIT;
+                goto done;
+            }
+        }
+
+        if (bb->nphis) {
+            enter_block(cf, bb, prev, values, scratch);
+            insts += bb->nphis;
+            op_counts[IR_PHI] += bb->nphis;
+        }
+
+    run:
+        for (; k < bb->ninsts; k++) {
+            int v = bb->insts[k];
+            const IRInst *ins = &cf->insts[v];
+            int64_t a = ins->a >= 0 ? values[ins->a] : 0;
+            int64_t b = ins->b >= 0 ? values[ins->b] : 0;
+            op_counts[ins->op]++;
+
+            switch (ins->op) {
+            case IR_CONST: values[v] = ins->imm; break;
+            case IR_ADD:   values[v] = eidos_add(a, b); break;
+            case IR_SUB:   values[v] = eidos_sub(a, b); break;
+            case IR_MUL:   values[v] = eidos_mul(a, b); break;
+            case IR_NEG:   values[v] = eidos_neg(a); break;
+            case IR_NOT:   values[v] = eidos_not(a); break;
+            case IR_COPY:  values[v] = a; break;
+            case IR_CMP:   values[v] = eidos_compare((CmpOp)ins->imm, a, b); break;
+            case IR_DIV:
+                if (b == 0) {
+                    eidos_out_flush(print_out);
+                    if (!quiet) {
+                        runtime_error(ins, "division by zero");
+                    }
+                    status = EXEC_RUNTIME_ERROR;
+                    goto done;
+                }
+                values[v] = eidos_div(a, b);
+                break;
+            case IR_READ: {
+                int result = eidos_read_int(read_in, &values[v]);
+                if (result != EIDOS_READ_OK) {
+                    eidos_out_flush(print_out);
+                    if (!quiet) {
+                        runtime_error(ins, result == EIDOS_READ_RANGE ? "read() integer out of range"
+                                                                      : "read() expected an integer");
+                    }
+                    status = EXEC_RUNTIME_ERROR;
+                    goto done;
+                }
+                break;
+            }
+            case IR_PRINT:
+                eidos_print_int(print_out, a);
+                break;
+            case IR_LOAD:
+            case IR_STORE:
+                if ((uint64_t)a >= (uint64_t)cf->arrays[ins->imm].size) {
+                    eidos_out_flush(print_out);
+                    if (!quiet) {
+                        runtime_error(ins, "array index out of bounds");
+                    }
+                    status = EXEC_RUNTIME_ERROR;
+                    goto done;
+                }
+                if (ins->op == IR_LOAD) {
+                    values[v] = arrays[ins->imm][a];
+                } else {
+                    arrays[ins->imm][a] = b;
+                }
+                break;
+            case IR_PARAM:
+                values[v] = values[cf->ninsts + ins->imm];
+                break;
+            case IR_CALL: {
+                if (depth == IR_MAX_CALL_DEPTH) {
+                    eidos_out_flush(print_out);
+                    if (!quiet) {
+                        runtime_error(ins, "call depth limit exceeded");
+                    }
+                    status = EXEC_RUNTIME_ERROR;
+                    goto done;
+                }
+                if (depth == frames_cap) {
+                    frames_cap = frames_cap ? frames_cap * 2 : 16;
+                    frames = eidos_realloc(frames, frames_cap * sizeof(Frame));
+                    if (!frames) {
+                        eidos_fatal("Failed to allocate call frames");
+                    }
+                }
+                Frame *f = &frames[depth++];
+                f->fn = cf;
+                f->func = func;
+                f->base = base;
+                f->block = cur;
+                f->next = k + 1;
+                f->prev = prev;
+                f->dst = v;
+
+                const IRFunction *callee = cf->funcs[ins->imm];
+                size_t callee_base = base + cf->ninsts + cf->nparams;
+                reserve_values(&stack, &stack_cap, callee_base + callee->ninsts + callee->nparams);
+                values = stack + base;
+                for (size_t i = 0; i < ins->nphi; i++) {
+                    stack[callee_base + callee->ninsts + i] = values[ins->phi_args[i]];
+                }
+
+                insts += k + 1 - resume;
+                cf = callee;
+                func = (int)ins->imm + 1;
+                base = callee_base;
+                values = stack + base;
+                prev = -1;
+                cur = cf->entry;
+                resume = 0;
+                goto next_block;
+            }
+            case IR_RETURN: {
+                const Frame *f = &frames[--depth];
+                insts += k + 1 - resume;
+                cf = f->fn;
+                func = f->func;
+                base = f->base;
+                values = stack + base;
+                values[f->dst] = a;
+                prev = f->prev;
+                cur = f->block;
+                resume = f->next;
+                if (profile) {
+                    // back in the caller's block, which isn't entered again
+                    profile->current_block = (sig_atomic_t)(profile->block_base[func] + (size_t)cur);
+                }
+                goto next_block;
+            }
+            case IR_PHI:
+            case IR_OP_COUNT:
+                break;
+            }
+        }
+        insts += bb->ninsts - resume;
+        resume = 0;
+
+        prev = cur;
+        switch (bb->term) {
+        case TERM_JMP: cur = bb->succ[0]; break;
+        case TERM_BR:  cur = bb->succ[values[bb->cond] != 0 ? 0 : 1]; break;
+        default:       cur = -1; break;
+        }
+    next_block:;
+    }
+
+    if (exit_values && fn->exit_values) {
+        for (size_t i = 0; i < fn->nvars; i++) {
+            exit_values[i] = fn->exit_values[i] >= 0 ? values[fn->exit_values[i]] : 0;
+        }
+    }
+
+done:
+    if (profile) {
+        profile->current_block = -1;
+    }
+    eidos_out_flush(print_out);
+    if (stats) {
+        stats->insts_executed = insts;
+        stats->blocks_executed = blocks;
+        memcpy(stats->op_counts, op_counts, sizeof(op_counts));
+    }
+
+    free_arrays(fn, arrays);
+    eidos_free(frames);
+    eidos_free(read_in);
+    eidos_free(print_out);
+    eidos_free(scratch);
+    eidos_free(stack);
+    return status;
+}
+
+
+/* ========== PUBLIC API ========== */
+
+/*
+Interprets an IR function
+
+args:
+    *fn (IRFunction) -> function to run
+    *in (FILE) -> where read() takes integers from
+    *out (FILE) -> where print() writes to
+    *stats (IRExecStats) -> execution counters, may be NULL
+
+returns:
+    (int) -> 0 on success, 1 on a runtime error
+*/
+int ir_interpret(const IRFunction *fn, FILE *in, FILE *out, IRExecStats *stats) {
+    return execute(fn, in, out, NULL, 0, NULL, stats, NULL) == EXEC_OK ? 0 : 1;
+}
+
+/*
+Interprets an IR function, counting the blocks it runs
+
+args:
+    *fn (IRFunction) -> function to run
+    *in (FILE) -> where read() takes integers from
+    *out (FILE) -> where print() writes to
+    *stats (IRExecStats) -> execution counters, may be NULL
+    *profile (IRProfile) -> counters set up by ir_profile_init, block_counts zeroed
+
+returns:
+    (int) -> 0 on success, 1 on a runtime error
+*/
+int ir_interpret_profiled(const IRFunction *fn, FILE *in, FILE *out, IRExecStats *stats, IRProfile *profile) {
+    return execute(fn, in, out, NULL, 0, NULL, stats, profile) == EXEC_OK ? 0 : 1;
+}
+
+/*
+Evaluates a read-free function at compile time
+
+args:
+    *fn (IRFunction) -> function to run
+    *out (FILE) -> where print() writes to
+    *limits (IRExecLimits) -> budget, NULL for none
+    *exit_values (int64_t) -> receives the final value of every variable, may be NULL
+    *stats (IRExecStats) -> execution counters, may be NULL
+
+returns:
+    (IRExecStatus) -> EXEC_OK, or why the evaluation gave up
+*/
+IRExecStatus ir_evaluate(const IRFunction *fn, FILE *out, const IRExecLimits *limits,
+                         int64_t *exit_values, IRExecStats *stats) {
+    return execute(fn, NULL, out, limits, 1, exit_values, stats, NULL);
+}
+
+/*
+Prints the totals and the count of every op that ran at least once
+
+args:
+    *stats (IRExecStats) -> counters from ir_interpret
+    *out (FILE) -> where to print
+*/
+void ir_print_exec_stats(const IRExecStats *stats, FILE *out) {
+    fprintf(out, "run: %llu instructions, %llu blocks executed\n",
+            (unsigned long long)stats->insts_executed,
+            (unsigned long long)stats->blocks_executed);
+
+    fprintf(out, "run ops:");
+    for (int op = 0; op < IR_OP_COUNT; op++) {
+        if (stats->op_counts[op]) {
+            fprintf(out, " %s %llu", ir_op_name((IROp)op), (unsigned long long)stats->op_counts[op]);
+        }
+    }
+    fprintf(out, "\n");
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+/*
+Reference interpreter for the SSA IR.
+
+Runs an IRFunction directly, block by block. It is the simplest execution
+backend and the yardstick the optimization passes are checked against: a
+program must print the same thing before and after any pipeline.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include "ir.h"
+
+typedef struct IRExecStats {
+    uint64_t insts_executed;    // instructions evaluated, phis included
+    uint64_t blocks_executed;   // blocks entered
+    uint64_t op_counts[IR_OP_COUNT];    // instructions evaluated, per op
+} IRExecStats;
+
+
+// Limits for compile-time evaluation, see ir_evaluate
+typedef struct IRExecLimits {
+    uint64_t max_insts;         // stop after this many instructions, 0 for no limit
+    double max_millis;          // stop after this much wall time, 0 for no limit
+    size_t max_output;          // stop once about this many bytes are printed, 0 for no limit
+} IRExecLimits;
+
+// Block counters of a profiled run, see profile.h
+typedef struct IRProfile IRProfile;
+
+typedef enum IRExecStatus {
+    EXEC_OK,
+    EXEC_RUNTIME_ERROR,         // division by zero, bad input, index out of bounds
+    EXEC_LIMIT,                 // IRExecLimits ran out
+} IRExecStatus;
+
+
+/* ========== Public API Functions ========== */
+
+/*
+Runs the function reading integers from `in` and printing to `out`.
+Returns 0 on success, 1 after reporting a runtime error (division by zero,
+bad input, array index out of bounds). `stats` may be NULL.
+*/
+int ir_interpret(const IRFunction *fn, FILE *in, FILE *out, IRExecStats *stats);
+
+/*
+ir_interpret, also counting every block entry into profile->block_counts and
+keeping profile->current_block up to date for the sampling timer. The
+counters come from ir_profile_init.
+*/
+int ir_interpret_profiled(const IRFunction *fn, FILE *in, FILE *out, IRExecStats *stats, IRProfile *profile);
+
+/*
+Runs a function at compile time: no input, output to `out`, no diagnostics.
+If `exit_values` is given it receives the value of every variable when the
+program ends (fn must come from ir_build_for_eval), 0 for those not recorded.
+*/
+IRExecStatus ir_evaluate(const IRFunction *fn, FILE *out, const IRExecLimits *limits,
+                         int64_t *exit_values, IRExecStats *stats);
+
+/*
+Prints the execution counters ("run: ..." lines) for --stats
+*/
+void ir_print_exec_stats(const IRExecStats *stats, FILE *out);
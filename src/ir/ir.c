@@ -0,0 +1,657 @@
+#include "ir.h"
+#include "../util/context.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* ===== Helper Functions ===== */
+
+/*
+Grows a dynamic array so it can hold at least one more element
+
+args:
+    **items (void) -> array to grow, reallocated in place
+    *cap (size_t) -> current capacity, updated
+    count (size_t) -> elements in use
+    size (size_t) -> size of one element
+*/
+static void reserve_one(void **items, size_t *cap, size_t count, size_t size) {
+    if (count < *cap) {
+        return;
+    }
+
+    *cap = *cap ? *cap * 2 : 8;
+    *items = eidos_realloc(*items, *cap * size);
+    if (!*items) {
+        eidos_fatal("Failed to allocate IR storage");
+    }
+}
+
+/*
+Removes the first occurrence of value from an int array, keeping order
+
+args:
+    *items (int) -> array
+    *count (size_t) -> number of elements, updated
+    value (int) -> element to remove
+
+returns:
+    (int) -> index the element was at, -1 if absent
+*/
+static int remove_int(int *items, size_t *count, int value) {
+    for (size_t i = 0; i < *count; i++) {
+        if (items[i] == value) {
+            memmove(&items[i], &items[i + 1], (*count - i - 1) * sizeof(int));
+            (*count)--;
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+const char *ir_op_name(IROp op) {
+    switch (op) {
+    case IR_CONST: return "const";
+    case IR_ADD:   return "add";
+    case IR_SUB:   return "sub";
+    case IR_MUL:   return "mul";
+    case IR_DIV:   return "div";
+    case IR_NEG:   return "neg";
+    case IR_NOT:   return "not";
+    case IR_CMP:   return "cmp";
+    case IR_COPY:  return "copy";
+    case IR_PHI:   return "phi";
+    case IR_READ:  return "read";
+    case IR_PRINT: return "print";
+    case IR_LOAD:  return "load";
+    case IR_STORE: return "store";
+    case IR_PARAM: return "param";
+    case IR_CALL:  return "call";
+    case IR_RETURN: return "return";
+    case IR_OP_COUNT: break;
+    }
+    return "?";
+}
+
+static const char *cmp_name(int64_t cmp) {
+    switch ((CmpOp)cmp) {
+    case CMP_EQ: return "eq";
+    case CMP_NE: return "ne";
+    case CMP_LT: return "lt";
+    case CMP_GT: return "gt";
+    case CMP_LE: return "le";
+    case CMP_GE: return "ge";
+    }
+    return "?";
+}
+
+static const char *role_name(IRBlockRole role) {
+    switch (role) {
+    case BLOCK_ENTRY:       return "entry";
+    case BLOCK_THEN:        return "then";
+    case BLOCK_ELSE:        return "else";
+    case BLOCK_JOIN:        return "join";
+    case BLOCK_LOOP_HEADER: return "loop.header";
+    case BLOCK_LOOP_BODY:   return "loop.body";
+    case BLOCK_LOOP_STEP:   return "loop.step";
+    case BLOCK_LOOP_EXIT:   return "loop.exit";
+    }
+    return "?";
+}
+
+/*
+Prints one instruction on its own line
+
+args:
+    *fn (IRFunction) -> owning function
+    value (int) -> value id of the instruction
+    *out (FILE) -> stream to print to
+*/
+static void dump_inst(const IRFunction *fn, int value, FILE *out) {
+    const IRInst *in = &fn->insts[value];
+
+    fputs("    ", out);
+    if (!ir_is_void(in)) {
+        fprintf(out, "v%d = ", value);
+    }
+    fputs(ir_op_name(in->op), out);
+
+    switch (in->op) {
+    case IR_CONST:
+        fprintf(out, " %lld", (long long)in->imm);
+        break;
+    case IR_CMP:
+        fprintf(out, ".%s v%d, v%d", cmp_name(in->imm), in->a, in->b);
+        break;
+    case IR_PHI:
+        for (size_t i = 0; i < in->nphi; i++) {
+            fprintf(out, "%s[v%d, bb%d]", i ? ", " : " ", in->phi_args[i],
+                    fn->blocks[in->block].preds[i]);
+        }
+        break;
+    case IR_READ:
+        break;
+    case IR_PARAM:
+        fprintf(out, " %lld", (long long)in->imm);
+        break;
+    case IR_CALL:
+        fprintf(out, " %s(", fn->funcs[in->imm]->name);
+        for (size_t i = 0; i < in->nphi; i++) {
+            fprintf(out, "%sv%d", i ? ", " : "", in->phi_args[i]);
+        }
+        fputc(')', out);
+        break;
+    case IR_LOAD:
+        fprintf(out, " %s[v%d]", fn->arrays[in->imm].name, in->a);
+        break;
+    case IR_STORE:
+        fprintf(out, " %s[v%d], v%d", fn->arrays[in->imm].name, in->a, in->b);
+        break;
+    default:
+        fprintf(out, " v%d", in->a);
+        if (in->b >= 0) {
+            fprintf(out, ", v%d", in->b);
+        }
+        break;
+    }
+
+    if (in->var >= 0) {
+        fprintf(out, "    ; %s", fn->var_names[in->var]);
+    }
+    fputc('\n', out);
+}
+
+/*
+Prints one function, one block at a time with its predecessors
+
+args:
+    *fn (IRFunction) -> function to print
+    *out (FILE) -> stream to print to
+*/
+static void dump_function(const IRFunction *fn, FILE *out) {
+    if (fn->name) {
+        fprintf(out, "function %s(%zu params, %zu blocks, %zu values)\n",
+                fn->name, fn->nparams, ir_count_blocks(fn), ir_count_insts(fn));
+    } else {
+        fprintf(out, "function main (%zu blocks, %zu values)\n",
+                ir_count_blocks(fn), ir_count_insts(fn));
+    }
+
+    for (size_t i = 0; i < fn->nblocks; i++) {
+        const IRBlock *bb = &fn->blocks[i];
+        if (bb->dead) {
+            continue;
+        }
+
+        fprintf(out, "  bb%d:    ; %s%s, line %zu", bb->id, role_name(bb->role), bb->cold ? ", cold" : "", bb->line);
+        if (bb->npreds) {
+            fputs(", preds", out);
+            for (size_t p = 0; p < bb->npreds; p++) {
+                fprintf(out, " bb%d", bb->preds[p]);
+            }
+        }
+        fputc('\n', out);
+
+        for (size_t p = 0; p < bb->nphis; p++) {
+            dump_inst(fn, bb->phis[p], out);
+        }
+        for (size_t p = 0; p < bb->ninsts; p++) {
+            dump_inst(fn, bb->insts[p], out);
+        }
+
+        switch (bb->term) {
+        case TERM_JMP:
+            fprintf(out, "    jmp bb%d\n", bb->succ[0]);
+            break;
+        case TERM_BR:
+            fprintf(out, "    br v%d, bb%d, bb%d", bb->cond, bb->succ[0], bb->succ[1]);
+            if (bb->likely) {
+                fprintf(out, "    ; likely bb%d", bb->succ[bb->likely > 0 ? 0 : 1]);
+            }
+            fputc('\n', out);
+            break;
+        case TERM_RET:
+            fputs("    ret\n", out);
+            break;
+        default:
+            fputs("    <no terminator>\n", out);
+            break;
+        }
+    }
+}
+
+static int compare_ints(const void *a, const void *b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+// 1 if a recorded loop still has the shape ir_build gave it
+static int loop_intact(const IRFunction *fn, const IRLoop *loop) {
+    const IRBlock *pre = &fn->blocks[loop->preheader];
+    const IRBlock *header = &fn->blocks[loop->header];
+    const IRBlock *latch = &fn->blocks[loop->latch];
+
+    if (pre->dead || header->dead || latch->dead) {
+        return 0;
+    }
+    if (pre->term != TERM_JMP || pre->succ[0] != loop->header) {
+        return 0;
+    }
+    if (latch->term != TERM_JMP || latch->succ[0] != loop->header) {
+        return 0;
+    }
+    if (header->npreds != 2 || loop->preheader == loop->latch) {
+        return 0;
+    }
+    return (header->preds[0] == loop->preheader && header->preds[1] == loop->latch) ||
+           (header->preds[1] == loop->preheader && header->preds[0] == loop->latch);
+}
+
+
+/* ========== PUBLIC API ========== */
+
+IRFunction *ir_new_function(void) {
+    IRFunction *fn = eidos_calloc(1, sizeof(IRFunction));
+    if (!fn) {
+        eidos_fatal("Failed to allocate IR function");
+    }
+    fn->entry = -1;
+    return fn;
+}
+
+void ir_free_function(IRFunction *fn) {
+    if (!fn) {
+        return;
+    }
+
+    if (!fn->name) {
+        for (size_t i = 0; i < fn->nfuncs; i++) {
+            ir_free_function(fn->funcs[i]);
+        }
+        eidos_free(fn->funcs);
+    }
+    eidos_free(fn->name);
+
+    for (size_t i = 0; i < fn->ninsts; i++) {
+        eidos_free(fn->insts[i].phi_args);
+    }
+    for (size_t i = 0; i < fn->nblocks; i++) {
+        eidos_free(fn->blocks[i].phis);
+        eidos_free(fn->blocks[i].insts);
+        eidos_free(fn->blocks[i].preds);
+    }
+    for (size_t i = 0; i < fn->nvars; i++) {
+        eidos_free(fn->var_names[i]);
+    }
+    for (size_t i = 0; i < fn->narrays; i++) {
+        eidos_free(fn->arrays[i].name);
+    }
+
+    eidos_free(fn->var_names);
+    eidos_free(fn->arrays);
+    eidos_free(fn->loops);
+    eidos_free(fn->exit_values);
+    eidos_free(fn->insts);
+    eidos_free(fn->blocks);
+    eidos_free(fn);
+}
+
+/*
+Appends a new empty block
+
+args:
+    *fn (IRFunction) -> function to add to
+    role (IRBlockRole) -> what the block is for
+    line, col (size_t) -> position of the statement creating it
+
+returns:
+    (int) -> block id
+*/
+int ir_new_block(IRFunction *fn, IRBlockRole role, size_t line, size_t col) {
+    reserve_one((void**)&fn->blocks, &fn->blocks_cap, fn->nblocks, sizeof(IRBlock));
+
+    IRBlock *b = &fn->blocks[fn->nblocks];
+    memset(b, 0, sizeof(IRBlock));
+    b->id = (int)fn->nblocks;
+    b->role = role;
+    b->line = line;
+    b->col = col;
+    b->term = TERM_NONE;
+    b->cond = -1;
+    b->succ[0] = -1;
+    b->succ[1] = -1;
+
+    return (int)fn->nblocks++;
+}
+
+/*
+Creates an instruction without placing it in a block
+
+returns:
+    (int) -> value id
+*/
+static int new_inst(IRFunction *fn, int block, IROp op, int a, int b, int64_t imm) {
+    reserve_one((void**)&fn->insts, &fn->insts_cap, fn->ninsts, sizeof(IRInst));
+
+    IRInst *in = &fn->insts[fn->ninsts];
+    memset(in, 0, sizeof(IRInst));
+    in->op = op;
+    in->block = block;
+    in->a = a;
+    in->b = b;
+    in->imm = imm;
+    in->var = -1;
+
+    return (int)fn->ninsts++;
+}
+
+/*
+Appends an instruction at the end of a block
+
+args:
+    *fn (IRFunction) -> function
+    block (int) -> block to append to
+    op (IROp) -> operation
+    a, b (int) -> operand value ids, -1 if unused
+    imm (int64_t) -> immediate (constant value or CmpOp)
+
+returns:
+    (int) -> value id of the new instruction
+*/
+int ir_emit(IRFunction *fn, int block, IROp op, int a, int b, int64_t imm) {
+    int v = new_inst(fn, block, op, a, b, imm);
+
+    IRBlock *bb = &fn->blocks[block];
+    reserve_one((void**)&bb->insts, &bb->insts_cap, bb->ninsts, sizeof(int));
+    bb->insts[bb->ninsts++] = v;
+
+    return v;
+}
+
+/*
+Creates a phi with no arguments at the top of a block
+
+returns:
+    (int) -> value id of the phi
+*/
+int ir_new_phi(IRFunction *fn, int block) {
+    int v = new_inst(fn, block, IR_PHI, -1, -1, 0);
+
+    IRBlock *bb = &fn->blocks[block];
+    reserve_one((void**)&bb->phis, &bb->phis_cap, bb->nphis, sizeof(int));
+    bb->phis[bb->nphis++] = v;
+
+    return v;
+}
+
+void ir_add_pred(IRFunction *fn, int to, int from) {
+    IRBlock *bb = &fn->blocks[to];
+    reserve_one((void**)&bb->preds, &bb->preds_cap, bb->npreds, sizeof(int));
+    bb->preds[bb->npreds++] = from;
+}
+
+/*
+Removes one from -> to edge from `to`'s predecessor list and the phi
+arguments flowing along it. The terminator of `from` is left to the caller.
+*/
+void ir_remove_edge(IRFunction *fn, int from, int to) {
+    IRBlock *bb = &fn->blocks[to];
+    int idx = remove_int(bb->preds, &bb->npreds, from);
+    if (idx < 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < bb->nphis; i++) {
+        IRInst *phi = &fn->insts[bb->phis[i]];
+        memmove(&phi->phi_args[idx], &phi->phi_args[idx + 1],
+                (phi->nphi - idx - 1) * sizeof(int));
+        phi->nphi--;
+    }
+}
+
+void ir_delete_inst(IRFunction *fn, int value) {
+    IRInst *in = &fn->insts[value];
+    if (in->block < 0) {
+        return;
+    }
+
+    IRBlock *bb = &fn->blocks[in->block];
+    if (in->op == IR_PHI) {
+        remove_int(bb->phis, &bb->nphis, value);
+    } else {
+        remove_int(bb->insts, &bb->ninsts, value);
+    }
+    in->block = -1;
+}
+
+/*
+Deletes every instruction whose flag is 0, one pass over each block, where
+ir_delete_inst would shift a block's list once per deletion
+
+args:
+    *fn (IRFunction) -> function
+    *keep (char) -> one flag per value
+
+returns:
+    (size_t) -> number of instructions deleted
+*/
+size_t ir_delete_insts(IRFunction *fn, const char *keep) {
+    size_t removed = 0;
+    for (size_t b = 0; b < fn->nblocks; b++) {
+        IRBlock *bb = &fn->blocks[b];
+        int *lists[2] = { bb->phis, bb->insts };
+        size_t *counts[2] = { &bb->nphis, &bb->ninsts };
+        for (int l = 0; l < 2; l++) {
+            size_t n = 0;
+            for (size_t i = 0; i < *counts[l]; i++) {
+                int v = lists[l][i];
+                if (keep[v]) {
+                    lists[l][n++] = v;
+                } else {
+                    fn->insts[v].block = -1;
+                    removed++;
+                }
+            }
+            *counts[l] = n;
+        }
+    }
+    return removed;
+}
+
+void ir_make_const(IRFunction *fn, int value, int64_t constant) {
+    IRInst *in = &fn->insts[value];
+    IRBlock *bb = &fn->blocks[in->block];
+
+    if (in->op == IR_PHI) {
+        // constants live with the ordinary instructions, ahead of any user
+        remove_int(bb->phis, &bb->nphis, value);
+        reserve_one((void**)&bb->insts, &bb->insts_cap, bb->ninsts, sizeof(int));
+        memmove(&bb->insts[1], &bb->insts[0], bb->ninsts * sizeof(int));
+        bb->insts[0] = value;
+        bb->ninsts++;
+
+        eidos_free(in->phi_args);
+        in->phi_args = NULL;
+        in->nphi = 0;
+    }
+
+    in->op = IR_CONST;
+    in->imm = constant;
+    in->a = -1;
+    in->b = -1;
+}
+
+void ir_move_inst(IRFunction *fn, int value, int block) {
+    IRInst *in = &fn->insts[value];
+    IRBlock *from = &fn->blocks[in->block];
+    remove_int(from->insts, &from->ninsts, value);
+
+    IRBlock *to = &fn->blocks[block];
+    reserve_one((void**)&to->insts, &to->insts_cap, to->ninsts, sizeof(int));
+    to->insts[to->ninsts++] = value;
+    in->block = block;
+}
+
+void ir_add_loop(IRFunction *fn, const IRLoop *loop) {
+    reserve_one((void**)&fn->loops, &fn->loops_cap, fn->nloops, sizeof(IRLoop));
+    fn->loops[fn->nloops++] = *loop;
+}
+
+/*
+Finds the blocks of a loop: the header plus everything that reaches the
+latch without going through the header. Costs time in the size of the loop,
+not of the function, so passes visiting every loop stay linear.
+
+args:
+    *fn (IRFunction) -> function
+    *loop (IRLoop) -> recorded loop
+    *in_loop (char) -> one flag per block, 0 for every block of the loop on entry
+    *blocks (int) -> output, room for fn->nblocks
+
+returns:
+    (size_t) -> number of blocks, 0 if passes changed the loop beyond recognition
+*/
+size_t ir_loop_body(const IRFunction *fn, const IRLoop *loop, char *in_loop, int *blocks) {
+    if (!loop_intact(fn, loop)) {
+        return 0;
+    }
+
+    size_t n = 0;
+    in_loop[loop->header] = 1;
+    blocks[n++] = loop->header;
+    if (!in_loop[loop->latch]) {
+        in_loop[loop->latch] = 1;
+        blocks[n++] = loop->latch;
+    }
+    // the list doubles as the work list
+    for (size_t next = 1; next < n; next++) {
+        const IRBlock *bb = &fn->blocks[blocks[next]];
+        for (size_t i = 0; i < bb->npreds; i++) {
+            int p = bb->preds[i];
+            if (!in_loop[p]) {
+                in_loop[p] = 1;
+                blocks[n++] = p;
+            }
+        }
+    }
+
+    qsort(blocks, n, sizeof(int), compare_ints);
+    return n;
+}
+
+/*
+ir_loop_body for callers that only want the flags, clearing the rest
+
+args:
+    *fn (IRFunction) -> function
+    *loop (IRLoop) -> recorded loop
+    *in_loop (char) -> output, one flag per block
+
+returns:
+    (int) -> 1 if the loop is intact, 0 if passes changed it beyond recognition
+*/
+int ir_loop_blocks(const IRFunction *fn, const IRLoop *loop, char *in_loop) {
+    if (!loop_intact(fn, loop)) {
+        return 0;
+    }
+
+    memset(in_loop, 0, fn->nblocks);
+    int *blocks = eidos_malloc(fn->nblocks * sizeof(int));
+    if (!blocks) {
+        eidos_fatal("Failed to allocate loop walk");
+    }
+    ir_loop_body(fn, loop, in_loop, blocks);
+    eidos_free(blocks);
+    return 1;
+}
+
+int ir_is_void(const IRInst *inst) {
+    return inst->op == IR_PRINT || inst->op == IR_STORE || inst->op == IR_RETURN;
+}
+
+size_t ir_num_operands(const IRInst *inst) {
+    if (inst->op == IR_PHI || inst->op == IR_CALL) {
+        return inst->nphi;
+    }
+    return (inst->a >= 0) + (inst->b >= 0);
+}
+
+int *ir_operand(IRInst *inst, size_t i) {
+    if (inst->op == IR_PHI || inst->op == IR_CALL) {
+        return &inst->phi_args[i];
+    }
+    return i == 0 ? &inst->a : &inst->b;
+}
+
+int ir_has_side_effects(const IRFunction *fn, const IRInst *inst) {
+    switch (inst->op) {
+    case IR_PRINT:
+    case IR_READ:
+    case IR_LOAD:
+    case IR_STORE:
+    case IR_CALL:
+    case IR_RETURN:
+        return 1;
+    case IR_DIV: {
+        // only a division by a known non-zero constant is free to drop
+        const IRInst *d = &fn->insts[inst->b];
+        return d->op != IR_CONST || d->imm == 0;
+    }
+    default:
+        return 0;
+    }
+}
+
+size_t ir_count_blocks(const IRFunction *fn) {
+    size_t n = 0;
+    for (size_t i = 0; i < fn->nblocks; i++) {
+        n += !fn->blocks[i].dead;
+    }
+    return n;
+}
+
+size_t ir_count_insts(const IRFunction *fn) {
+    size_t n = 0;
+    for (size_t i = 0; i < fn->nblocks; i++) {
+        if (!fn->blocks[i].dead) {
+            n += fn->blocks[i].nphis + fn->blocks[i].ninsts;
+        }
+    }
+    return n;
+}
+
+/*
+Lays the live blocks out for emission, cold ones last
+
+args:
+    *fn (IRFunction) -> function
+    *order (int) -> receives block ids, fn->nblocks long
+
+returns:
+    (size_t) -> number of ids written
+*/
+size_t ir_layout(const IRFunction *fn, int *order) {
+    size_t n = 0;
+    for (int cold = 0; cold <= 1; cold++) {
+        for (size_t i = 0; i < fn->nblocks; i++) {
+            if (!fn->blocks[i].dead && fn->blocks[i].cold == cold) {
+                order[n++] = (int)i;
+            }
+        }
+    }
+    return n;
+}
+
+/*
+Prints main, then the functions of the program
+
+args:
+    *fn (IRFunction) -> main
+    *out (FILE) -> stream to print to
+*/
+void ir_dump(const IRFunction *fn, FILE *out) {
+    dump_function(fn, out);
+    for (size_t i = 0; i < fn->nfuncs; i++) {
+        fputc('\n', out);
+        dump_function(fn->funcs[i], out);
+    }
+}
@@ -0,0 +1,294 @@
+#pragma once
+
+/*
+Mid-level intermediate representation of an Eidos program.
+
+A program lowers to one IRFunction, main, plus one per function it
+declares (IRFunction.funcs): each a control-flow graph of basic blocks in
+SSA form. Every instruction that produces a value is identified by its index
+in IRFunction.insts (printed as v<N>), and is defined exactly once. Phis sit
+at the top of a block, with one incoming value per predecessor, in the same
+order as IRBlock.preds. Blocks end in exactly one terminator.
+
+Optimizations run over this IR through the pass manager (passes.h), and every
+execution backend consumes it instead of walking the tree shape in ast.h.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "../parser/ast.h"
+#include "../util/arith.h"
+#include "../util/strmap.h"
+
+typedef enum IROp {
+    IR_CONST,       // imm
+    IR_ADD,         // a + b
+    IR_SUB,         // a - b
+    IR_MUL,         // a * b
+    IR_DIV,         // a / b, traps on b == 0
+    IR_NEG,         // -a
+    IR_NOT,         // !a
+    IR_CMP,         // a <imm as CmpOp> b, yields 0 or 1
+    IR_COPY,        // a, a plain rename (let y = x;)
+    IR_PHI,         // one of phi_args, picked by the edge control came from
+    IR_READ,        // next integer from input
+    IR_PRINT,       // prints a, produces no value
+    IR_LOAD,        // element a of array imm, traps when out of bounds
+    IR_STORE,       // element a of array imm = b, produces no value, traps like IR_LOAD
+    IR_PARAM,       // parameter imm of the function, in its entry block
+    IR_CALL,        // funcs[imm] called with phi_args (nphi of them), traps past IR_MAX_CALL_DEPTH
+    IR_RETURN,      // returns a from a function, produces no value, last in the block ending in TERM_RET
+    IR_OP_COUNT,    // number of ops, not an op
+} IROp;
+
+typedef enum IRTermKind {
+    TERM_NONE,      // block still being built
+    TERM_JMP,       // goto succ[0]
+    TERM_BR,        // cond != 0 ? succ[0] : succ[1]
+    TERM_RET,       // end of program, or of a function after its IR_RETURN
+} IRTermKind;
+
+// What a block was created for, kept for dumps and for loop aware passes
+typedef enum IRBlockRole {
+    BLOCK_ENTRY,
+    BLOCK_THEN,
+    BLOCK_ELSE,
+    BLOCK_JOIN,
+    BLOCK_LOOP_HEADER,  // evaluates the loop condition
+    BLOCK_LOOP_BODY,
+    BLOCK_LOOP_STEP,    // for-loop step, the latch
+    BLOCK_LOOP_EXIT,
+} IRBlockRole;
+
+typedef struct IRInst {
+    IROp op;
+    int block;          // owning block, -1 once the instruction is deleted
+    int64_t imm;        // IR_CONST value, IR_CMP comparison (CmpOp), IR_LOAD/IR_STORE array
+    int a;              // first operand (value id), -1 if unused
+    int b;              // second operand (value id), -1 if unused
+    int *phi_args;      // IR_PHI incoming values, one per predecessor; IR_CALL arguments
+    size_t nphi;
+    int var;            // source variable this value was defined for, -1 for temporaries
+    size_t line;        // source position, for diagnostics
+    size_t col;
+} IRInst;
+
+typedef struct IRBlock {
+    int id;
+    int dead;           // 1 once removed from the graph
+    IRBlockRole role;
+    size_t line;        // position of the statement that created the block
+    size_t col;
+
+    int *phis;          // IR_PHI value ids, always evaluated first
+    size_t nphis;
+    size_t phis_cap;
+
+    int *insts;         // other value ids, in execution order
+    size_t ninsts;
+    size_t insts_cap;
+
+    int *preds;         // predecessor block ids, phi args follow this order
+    size_t npreds;
+    size_t preds_cap;
+
+    IRTermKind term;
+    int cond;           // TERM_BR condition value
+    int succ[2];        // successor block ids, -1 if unused
+
+    // from a recorded profile (--profile-use), 0 without one
+    int likely;         // TERM_BR: 1 if succ[0] is usually taken, -1 if succ[1] is
+    int cold;           // 1 if the block rarely runs, laid out after all the others
+} IRBlock;
+
+// A loop lowered from an AST_FOR_LOOP_NODE or AST_WHILE_LOOP_NODE
+typedef struct IRLoop {
+    int preheader;      // block ending in the only jump into the header from outside
+    int header;         // evaluates the condition, preds are {preheader, latch}
+    int latch;          // block ending in the back edge
+    int exit;
+    int is_for;
+    size_t line;        // position of the loop statement
+    size_t col;
+} IRLoop;
+
+// An array of the program, zero-filled when it starts
+typedef struct IRArray {
+    char *name;
+    int64_t size;       // elements, 1 to ARRAY_MAX_ELEMENTS (sema.h)
+} IRArray;
+
+// Calls nested deeper than this are a runtime error in every backend
+#define IR_MAX_CALL_DEPTH 10000
+
+typedef struct IRFunction {
+    char *name;         // NULL for main, the program itself
+    size_t nparams;
+
+    // the program's functions, indexed by the imm of IR_CALL; main owns the
+    // array and its entries, every function shares them
+    struct IRFunction **funcs;
+    size_t nfuncs;
+
+    IRInst *insts;      // every value ever created, indexed by value id
+    size_t ninsts;
+    size_t insts_cap;
+
+    IRBlock *blocks;    // every block ever created, indexed by block id
+    size_t nblocks;
+    size_t blocks_cap;
+
+    char **var_names;   // source variable names, indexed by IRInst.var
+    size_t nvars;
+
+    IRArray *arrays;    // indexed by the imm of IR_LOAD/IR_STORE
+    size_t narrays;
+
+    int *exit_values;   // per variable, its value when the program ends, -1 if not recorded (ir_build_for_eval only)
+
+    IRLoop *loops;      // every source loop, inner loops before the loops containing them
+    size_t nloops;
+    size_t loops_cap;
+
+    int entry;          // entry block id
+
+    size_t cse_reused;  // expressions ir_build reused instead of lowering again
+} IRFunction;
+
+
+/* ========== Public API Functions ========== */
+
+/*
+Allocates an empty function
+*/
+IRFunction *ir_new_function(void);
+
+/*
+Frees a function and everything it owns, for main its functions too
+*/
+void ir_free_function(IRFunction *fn);
+
+/*
+Appends a new empty block and returns its id
+*/
+int ir_new_block(IRFunction *fn, IRBlockRole role, size_t line, size_t col);
+
+/*
+Appends a new instruction to the end of a block and returns its value id
+*/
+int ir_emit(IRFunction *fn, int block, IROp op, int a, int b, int64_t imm);
+
+/*
+Creates an empty phi at the top of a block and returns its value id
+*/
+int ir_new_phi(IRFunction *fn, int block);
+
+/*
+Adds an edge from -> to in the predecessor list of `to` (terminators are set separately)
+*/
+void ir_add_pred(IRFunction *fn, int to, int from);
+
+/*
+Removes the edge from -> to, dropping the matching argument of every phi in `to`
+*/
+void ir_remove_edge(IRFunction *fn, int from, int to);
+
+/*
+Deletes an instruction from its block; its value id stays reserved
+*/
+void ir_delete_inst(IRFunction *fn, int value);
+
+/*
+Deletes every instruction whose flag in `keep` (one per value) is 0, in one
+pass over the blocks. Returns how many.
+*/
+size_t ir_delete_insts(IRFunction *fn, const char *keep);
+
+/*
+Turns an instruction (phis included) into IR_CONST in place, keeping its value id
+*/
+void ir_make_const(IRFunction *fn, int value, int64_t constant);
+
+/*
+Moves a non-phi instruction to the end of another block, keeping its value id
+*/
+void ir_move_inst(IRFunction *fn, int value, int block);
+
+/*
+Records a loop, see IRLoop
+*/
+void ir_add_loop(IRFunction *fn, const IRLoop *loop);
+
+/*
+Checks that a recorded loop still has its original shape (earlier passes may
+have deleted its back edge or blocks). If so, fills in_loop (one flag per
+block, caller allocated) with the blocks of the loop and returns 1.
+*/
+int ir_loop_blocks(const IRFunction *fn, const IRLoop *loop, char *in_loop);
+
+/*
+The same for passes that visit every loop: in_loop must be 0 for the loop's
+blocks on entry, and `blocks` (fn->nblocks long) receives them in block
+order. Returns how many, 0 if the loop lost its shape. Clearing those flags
+afterwards leaves in_loop ready for the next loop, so the walk costs the size
+of the loop rather than of the function.
+*/
+size_t ir_loop_body(const IRFunction *fn, const IRLoop *loop, char *in_loop, int *blocks);
+
+/*
+1 if the instruction produces no value (IR_PRINT, IR_STORE, IR_RETURN)
+*/
+int ir_is_void(const IRInst *inst);
+
+/*
+Number of value operands of an instruction, and a pointer to the i-th one
+*/
+size_t ir_num_operands(const IRInst *inst);
+int *ir_operand(IRInst *inst, size_t i);
+
+/*
+1 if the instruction has an effect beyond producing its value
+(printing, consuming input, touching an array, a division that may trap,
+calling or returning)
+*/
+int ir_has_side_effects(const IRFunction *fn, const IRInst *inst);
+
+/*
+Order the backends emit blocks in: live blocks by id, so most jumps fall
+through, with cold blocks moved after all the others. `order` must hold
+fn->nblocks ids; returns how many it got.
+*/
+size_t ir_layout(const IRFunction *fn, int *order);
+
+/*
+Number of live blocks / instructions, for statistics
+*/
+size_t ir_count_blocks(const IRFunction *fn);
+size_t ir_count_insts(const IRFunction *fn);
+
+/*
+Mnemonic of an op as printed in dumps ("add", "phi", ...)
+*/
+const char *ir_op_name(IROp op);
+
+/*
+Prints the function in a readable textual form, main followed by its functions
+*/
+void ir_dump(const IRFunction *fn, FILE *out);
+
+/*
+Lowers a checked (sema.h) and usually folded program to SSA form, main and
+every function it declares.
+Returns NULL after printing diagnostics if the tree holds a node that
+cannot be lowered.
+*/
+IRFunction *ir_build(const ASTNode *program);
+
+/*
+Like ir_build, but also records IRFunction.exit_values so ir_evaluate can
+report the state the program ends in, for the variables named in `live`
+only: each one recorded can place a phi at every join before the end. The
+values are only meaningful until a pass rewrites the function.
+*/
+IRFunction *ir_build_for_eval(const ASTNode *program, const StrMap *live);
@@ -0,0 +1,918 @@
+#include "ir.h"
+#include "../util/context.h"
+#include "../util/strmap.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+AST -> SSA lowering.
+
+Uses the on-the-fly construction from Braun et al., "Simple and Efficient
+Construction of Static Single Assignment Form": every block remembers the
+current value of each variable it writes, reads look the value up through the
+predecessors and place phis only where two definitions meet. Blocks whose
+predecessors are not all known yet (loop headers) are "unsealed"; reads in them
+get placeholder phis that are completed when the block is sealed.
+
+Phis that turn out to be redundant are left in place, copy propagation
+(passes.h) removes them.
+
+Expressions interned by hash-consing (optimizer/hashcons.h) carry a hash_id.
+Within one block, an expression with the same id is lowered once: the value
+is reused as long as no variable it reads was written in between.
+
+Arrays are not variables: they live in memory for the whole run, every
+element read is an IR_LOAD and every element write an IR_STORE, kept in
+program order. hashcons never shares an index expression, so loads are not
+reused either.
+
+Each declared function is built on its own, with a Builder of its own:
+its parameters are its first variables, defined by IR_PARAM in its entry
+block, and its return value is handed back by the IR_RETURN ending its last
+block. A call is an IR_CALL naming the function by its index in
+IRFunction.funcs; hashcons never shares a call, so every call is lowered.
+*/
+
+// (block, variable) -> value, open addressing
+typedef struct DefEntry {
+    uint64_t key;       // block << 32 | var, 0 marks an empty slot (keys are stored +1)
+    int value;
+} DefEntry;
+
+typedef struct DefMap {
+    DefEntry *slots;
+    size_t capacity;
+    size_t count;
+} DefMap;
+
+// placeholder phi created in an unsealed block
+typedef struct PendingPhi {
+    int var;
+    int phi;
+} PendingPhi;
+
+typedef struct BlockState {
+    int sealed;
+    PendingPhi *pending;
+    size_t npending;
+    size_t pending_cap;
+} BlockState;
+
+// value of a hash-consed expression lowered earlier
+typedef struct CSEEntry {
+    int block;              // block it was lowered in, -1 if none
+    int value;
+    size_t stamp;           // write counter when it was lowered
+} CSEEntry;
+
+typedef struct Builder {
+    IRFunction *fn;
+    StrMap vars;            // variable name -> var index
+    StrMap arrays;          // array name -> index into fn->arrays
+    const StrMap *funcs;    // function name -> index into fn->funcs
+    DefMap defs;
+    BlockState *blocks;     // builder-only state, indexed by block id
+    size_t blocks_cap;
+    int cur;                // block instructions are appended to
+    int errors;
+
+    CSEEntry *cse;          // indexed by ASTNode.hash_id
+    size_t cse_cap;
+    size_t *last_write;     // per variable, write counter of its latest write
+    size_t last_write_cap;
+    size_t writes;          // write counter
+} Builder;
+
+/* ===== Helper Functions ===== */
+
+static uint64_t def_key(int block, int var) {
+    return (((uint64_t)(uint32_t)block << 32) | (uint32_t)var) + 1;
+}
+
+static size_t def_hash(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (size_t)key;
+}
+
+static void defs_put(DefMap *m, int block, int var, int value);
+
+static void defs_grow(DefMap *m) {
+    DefMap bigger;
+    bigger.capacity = m->capacity ? m->capacity * 2 : 64;
+    bigger.count = 0;
+    bigger.slots = eidos_calloc(bigger.capacity, sizeof(DefEntry));
+    if (!bigger.slots) {
+        eidos_fatal("Failed to allocate SSA definition table");
+    }
+
+    for (size_t i = 0; i < m->capacity; i++) {
+        if (m->slots[i].key) {
+            uint64_t k = m->slots[i].key - 1;
+            defs_put(&bigger, (int)(k >> 32), (int)(uint32_t)k, m->slots[i].value);
+        }
+    }
+
+    eidos_free(m->slots);
+    *m = bigger;
+}
+
+static void defs_put(DefMap *m, int block, int var, int value) {
+    if ((m->count + 1) * 4 > m->capacity * 3) {
+        defs_grow(m);
+    }
+
+    uint64_t key = def_key(block, var);
+    size_t mask = m->capacity - 1;
+    size_t i = def_hash(key) & mask;
+
+    while (m->slots[i].key && m->slots[i].key != key) {
+        i = (i + 1) & mask;
+    }
+    if (!m->slots[i].key) {
+        m->slots[i].key = key;
+        m->count++;
+    }
+    m->slots[i].value = value;
+}
+
+static int defs_get(const DefMap *m, int block, int var, int *value) {
+    if (!m->count) {
+        return 0;
+    }
+
+    uint64_t key = def_key(block, var);
+    size_t mask = m->capacity - 1;
+    size_t i = def_hash(key) & mask;
+
+    while (m->slots[i].key) {
+        if (m->slots[i].key == key) {
+            *value = m->slots[i].value;
+            return 1;
+        }
+        i = (i + 1) & mask;
+    }
+    return 0;
+}
+
+/*
+Creates a block and its builder-side state
+
+returns:
+    (int) -> block id
+*/
+static int new_block(Builder *b, IRBlockRole role, const ASTNode *node) {
+    int id = ir_new_block(b->fn, role, node->line, node->col);
+
+    if ((size_t)id >= b->blocks_cap) {
+        size_t old = b->blocks_cap;
+        b->blocks_cap = b->blocks_cap ? b->blocks_cap * 2 : 16;
+        b->blocks = eidos_realloc(b->blocks, b->blocks_cap * sizeof(BlockState));
+        if (!b->blocks) {
+            eidos_fatal("Failed to allocate SSA builder state");
+        }
+        memset(&b->blocks[old], 0, (b->blocks_cap - old) * sizeof(BlockState));
+    }
+
+    return id;
+}
+
+static int emit(Builder *b, IROp op, int x, int y, int64_t imm, const ASTNode *node) {
+    int v = ir_emit(b->fn, b->cur, op, x, y, imm);
+    b->fn->insts[v].line = node->line;
+    b->fn->insts[v].col = node->col;
+    return v;
+}
+
+static void jump(Builder *b, int from, int to) {
+    IRBlock *bb = &b->fn->blocks[from];
+    bb->term = TERM_JMP;
+    bb->succ[0] = to;
+    ir_add_pred(b->fn, to, from);
+}
+
+static void branch(Builder *b, int from, int cond, int if_true, int if_false) {
+    IRBlock *bb = &b->fn->blocks[from];
+    bb->term = TERM_BR;
+    bb->cond = cond;
+    bb->succ[0] = if_true;
+    bb->succ[1] = if_false;
+    ir_add_pred(b->fn, if_true, from);
+    ir_add_pred(b->fn, if_false, from);
+}
+
+static void write_variable(Builder *b, int var, int block, int value) {
+    defs_put(&b->defs, block, var, value);
+}
+
+/*
+Records that a statement assigned a variable, invalidating the expressions
+that read it for common-subexpression elimination
+*/
+static void note_write(Builder *b, int var) {
+    if ((size_t)var >= b->last_write_cap) {
+        size_t old = b->last_write_cap;
+        b->last_write_cap = (size_t)var + 1 > old * 2 ? (size_t)var + 1 : old * 2;
+        b->last_write = eidos_realloc(b->last_write, b->last_write_cap * sizeof(size_t));
+        if (!b->last_write) {
+            eidos_fatal("Failed to allocate SSA builder state");
+        }
+        memset(&b->last_write[old], 0, (b->last_write_cap - old) * sizeof(size_t));
+    }
+    b->last_write[var] = ++b->writes;
+}
+
+static int read_variable(Builder *b, int var, int block);
+
+static void add_phi_operands(Builder *b, int var, int phi) {
+    IRFunction *fn = b->fn;
+    int block = fn->insts[phi].block;
+    size_t npreds = fn->blocks[block].npreds;
+
+    // reading a predecessor may append to insts, so never hold pointers across it
+    int *args = eidos_malloc((npreds ? npreds : 1) * sizeof(int));
+    if (!args) {
+        eidos_fatal("Failed to allocate phi arguments");
+    }
+
+    for (size_t i = 0; i < npreds; i++) {
+        args[i] = read_variable(b, var, fn->blocks[block].preds[i]);
+    }
+
+    fn->insts[phi].phi_args = args;
+    fn->insts[phi].nphi = npreds;
+}
+
+/*
+Finds the value of a variable at the end of a block, placing phis as needed
+
+args:
+    *b (Builder) -> builder
+    var (int) -> variable index
+    block (int) -> block to read in
+
+returns:
+    (int) -> value id
+*/
+static int read_variable(Builder *b, int var, int block) {
+    IRFunction *fn = b->fn;
+    int value;
+
+    // walk straight-line chains iteratively, generated code can nest them deeply
+    int start = block;
+    while (!defs_get(&b->defs, block, var, &value)) {
+        if (b->blocks[block].sealed && fn->blocks[block].npreds == 1) {
+            block = fn->blocks[block].preds[0];
+            continue;
+        }
+
+        if (!b->blocks[block].sealed) {
+            // predecessors still unknown: placeholder completed by seal_block
+            value = ir_new_phi(fn, block);
+            fn->insts[value].var = var;
+
+            BlockState *st = &b->blocks[block];
+            if (st->npending == st->pending_cap) {
+                st->pending_cap = st->pending_cap ? st->pending_cap * 2 : 4;
+                st->pending = eidos_realloc(st->pending, st->pending_cap * sizeof(PendingPhi));
+                if (!st->pending) {
+                    eidos_fatal("Failed to allocate pending phis");
+                }
+            }
+            st->pending[st->npending].var = var;
+            st->pending[st->npending].phi = value;
+            st->npending++;
+            write_variable(b, var, block, value);
+        } else if (fn->blocks[block].npreds == 0) {
+            // reached the entry without a definition: variables start at 0
+            value = ir_emit(fn, block, IR_CONST, -1, -1, 0);
+            fn->insts[value].var = var;
+            write_variable(b, var, block, value);
+        } else {
+            // join point: the phi is recorded first so loops terminate
+            value = ir_new_phi(fn, block);
+            fn->insts[value].var = var;
+            write_variable(b, var, block, value);
+            add_phi_operands(b, var, value);
+        }
+        break;
+    }
+
+    // remember the answer along the chain we walked
+    for (int walk = start; walk != block; walk = fn->blocks[walk].preds[0]) {
+        write_variable(b, var, walk, value);
+    }
+
+    return value;
+}
+
+static void seal_block(Builder *b, int block) {
+    BlockState *st = &b->blocks[block];
+
+    // add_phi_operands can add new pending phis to other blocks, not this one
+    for (size_t i = 0; i < st->npending; i++) {
+        add_phi_operands(b, st->pending[i].var, st->pending[i].phi);
+    }
+
+    eidos_free(st->pending);
+    st->pending = NULL;
+    st->npending = 0;
+    st->sealed = 1;
+}
+
+/*
+Returns the index of a variable name, adding it if `define` is set
+
+returns:
+    (int) -> variable index, -1 if unknown and not defining
+*/
+static int var_index(Builder *b, const char *name, int define) {
+    size_t idx;
+    if (strmap_get(&b->vars, name, &idx)) {
+        return (int)idx;
+    }
+    if (!define) {
+        return -1;
+    }
+
+    IRFunction *fn = b->fn;
+    fn->var_names = eidos_realloc(fn->var_names, (fn->nvars + 1) * sizeof(char*));
+    if (!fn->var_names) {
+        eidos_fatal("Failed to allocate variable names");
+    }
+    fn->var_names[fn->nvars] = eidos_strdup(name);
+    strmap_put(&b->vars, name, fn->nvars);
+
+    return (int)fn->nvars++;
+}
+
+/*
+Registers an array declaration, sema_check made sure there is one per name
+*/
+static void add_array(Builder *b, const ASTNode *node) {
+    IRFunction *fn = b->fn;
+    size_t idx;
+    if (strmap_get(&b->arrays, node->data.array_decl.identifier, &idx)) {
+        return;
+    }
+
+    fn->arrays = eidos_realloc(fn->arrays, (fn->narrays + 1) * sizeof(IRArray));
+    if (!fn->arrays) {
+        eidos_fatal("Failed to allocate arrays");
+    }
+    fn->arrays[fn->narrays].name = eidos_strdup(node->data.array_decl.identifier);
+    fn->arrays[fn->narrays].size = node->data.array_decl.size;
+    strmap_put(&b->arrays, node->data.array_decl.identifier, fn->narrays);
+    fn->narrays++;
+}
+
+/*
+Index of a declared array, reporting it if there is none
+
+returns:
+    (int) -> index into fn->arrays, -1 after reporting
+*/
+static int array_index(Builder *b, const char *name, const ASTNode *node) {
+    size_t idx;
+    if (strmap_get(&b->arrays, name, &idx)) {
+        return (int)idx;
+    }
+    eidos_diag("Error at line %zu, column %zu: use of undeclared array\n", node->line, node->col);
+    b->errors++;
+    return -1;
+}
+
+/*
+Registers every variable the program defines (let, =, read, for init) and
+every array it declares
+*/
+static void collect_vars(Builder *b, const ASTNode *node) {
+    for (; node && node->type == AST_STMTS_NODE; node = node->data.stmts.next) {
+        collect_vars(b, node->data.stmts.stmt);
+    }
+    if (!node) {
+        return;
+    }
+
+    switch (node->type) {
+    case AST_PROGRAM_NODE:
+        collect_vars(b, node->data.program.stmts);
+        break;
+    case AST_VAR_DECL_NODE:
+        var_index(b, node->data.var_decl.identifer, 1);
+        break;
+    case AST_ASSIGN_NODE:
+        var_index(b, node->data.assignment.identifier, 1);
+        break;
+    case AST_READ_NODE:
+        var_index(b, node->data.read_stmt.identifier, 1);
+        break;
+    case AST_ARRAY_DECL_NODE:
+        add_array(b, node);
+        break;
+    case AST_IF_STMT_NODE:
+        collect_vars(b, node->data.if_stmt.then_block);
+        collect_vars(b, node->data.if_stmt.else_block);
+        break;
+    case AST_FOR_LOOP_NODE:
+        collect_vars(b, node->data.for_loop.initializer);
+        collect_vars(b, node->data.for_loop.for_block);
+        break;
+    case AST_WHILE_LOOP_NODE:
+        collect_vars(b, node->data.while_loop.while_block);
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+Variable index of a name that is read. sema_check already rejected names that
+are never defined; a name can still be unknown here if folding deleted its only
+definition in a dead branch, and then it simply reads as 0.
+*/
+static int lookup_var(Builder *b, const char *name) {
+    return var_index(b, name, 1);
+}
+
+/*
+1 if no variable the expression reads was written after `stamp`
+*/
+static int unchanged_since(Builder *b, const ASTNode *node, size_t stamp) {
+    size_t idx;
+
+    switch (node->type) {
+    case AST_IDENTIFIER_NODE:
+        if (!strmap_get(&b->vars, node->data.identifier.name, &idx)) {
+            return 1;
+        }
+        return idx >= b->last_write_cap || b->last_write[idx] <= stamp;
+    case AST_BINARY_EXPR:
+        return unchanged_since(b, node->data.binary_expr.left, stamp) &&
+               unchanged_since(b, node->data.binary_expr.right, stamp);
+    case AST_UNARY_EXPR:
+        return unchanged_since(b, node->data.unary_expr.operand, stamp);
+    case AST_CONDITIONAL_NODE:
+        return unchanged_since(b, node->data.conditional.left_expression, stamp) &&
+               unchanged_since(b, node->data.conditional.right_expression, stamp);
+    default:
+        return 1;
+    }
+}
+
+static int lower_expr_uncached(Builder *b, const ASTNode *node);
+
+/*
+Lowers an expression into the current block, reusing the value of an equal
+hash-consed expression lowered earlier in the block when it is still valid
+
+returns:
+    (int) -> value id holding the result
+*/
+static int lower_expr(Builder *b, const ASTNode *node) {
+    // leaves are as cheap to re-read as to reuse
+    if (!node->hash_id || node->type == AST_INTAGER_LIT_NODE ||
+        node->type == AST_IDENTIFIER_NODE) {
+        return lower_expr_uncached(b, node);
+    }
+
+    size_t id = node->hash_id;
+    if (id < b->cse_cap) {
+        CSEEntry *e = &b->cse[id];
+        if (e->block == b->cur && unchanged_since(b, node, e->stamp)) {
+            b->fn->cse_reused++;
+            return e->value;
+        }
+    }
+
+    int value = lower_expr_uncached(b, node);
+
+    if (id >= b->cse_cap) {
+        size_t old = b->cse_cap;
+        b->cse_cap = id + 1 > old * 2 ? id + 1 : old * 2;
+        b->cse = eidos_realloc(b->cse, b->cse_cap * sizeof(CSEEntry));
+        if (!b->cse) {
+            eidos_fatal("Failed to allocate CSE table");
+        }
+        for (size_t i = old; i < b->cse_cap; i++) {
+            b->cse[i].block = -1;
+        }
+    }
+    b->cse[id].block = b->cur;
+    b->cse[id].value = value;
+    b->cse[id].stamp = b->writes;
+    return value;
+}
+
+/*
+Lowers an expression into the current block
+
+returns:
+    (int) -> value id holding the result
+*/
+static int lower_expr_uncached(Builder *b, const ASTNode *node) {
+    switch (node->type) {
+
+    case AST_INTAGER_LIT_NODE:
+        return emit(b, IR_CONST, -1, -1, node->data.int_lit.value, node);
+
+    case AST_IDENTIFIER_NODE: {
+        int var = lookup_var(b, node->data.identifier.name);
+        return read_variable(b, var, b->cur);
+    }
+
+    case AST_BINARY_EXPR: {
+        int l = lower_expr(b, node->data.binary_expr.left);
+        int r = lower_expr(b, node->data.binary_expr.right);
+        IROp op = IR_ADD;
+        switch (node->data.binary_expr.op[0]) {
+        case '+': op = IR_ADD; break;
+        case '-': op = IR_SUB; break;
+        case '*': op = IR_MUL; break;
+        case '/': op = IR_DIV; break;
+        }
+        return emit(b, op, l, r, 0, node);
+    }
+
+    case AST_UNARY_EXPR: {
+        int v = lower_expr(b, node->data.unary_expr.operand);
+        return emit(b, node->data.unary_expr.op[0] == '!' ? IR_NOT : IR_NEG, v, -1, 0, node);
+    }
+
+    case AST_CONDITIONAL_NODE: {
+        int l = lower_expr(b, node->data.conditional.left_expression);
+        int r = lower_expr(b, node->data.conditional.right_expression);
+        CmpOp cmp = CMP_EQ;
+        cmp_op_from_lexeme(node->data.conditional.comparison_op, &cmp);
+        return emit(b, IR_CMP, l, r, cmp, node);
+    }
+
+    case AST_INDEX_EXPR: {
+        int array = array_index(b, node->data.index_expr.identifier, node);
+        int i = lower_expr(b, node->data.index_expr.index);
+        if (array < 0) {
+            return emit(b, IR_CONST, -1, -1, 0, node);
+        }
+        return emit(b, IR_LOAD, i, -1, array, node);
+    }
+
+    case AST_CALL_EXPR: {
+        size_t callee = 0;
+        size_t nargs = node->data.call_expr.nargs;
+        if (!strmap_get(b->funcs, node->data.call_expr.name, &callee)) {
+            eidos_diag("Error at line %zu, column %zu: call to undeclared function\n", node->line, node->col);
+            b->errors++;
+            return emit(b, IR_CONST, -1, -1, 0, node);
+        }
+
+        int *args = eidos_malloc((nargs ? nargs : 1) * sizeof(int));
+        if (!args) {
+            eidos_fatal("Failed to allocate call arguments");
+        }
+        for (size_t i = 0; i < nargs; i++) {
+            args[i] = lower_expr(b, node->data.call_expr.args[i]);
+        }
+        int v = emit(b, IR_CALL, -1, -1, (int64_t)callee, node);
+        b->fn->insts[v].phi_args = args;
+        b->fn->insts[v].nphi = nargs;
+        return v;
+    }
+
+    default:
+        eidos_diag("Error at line %zu, column %zu: unexpected node in expression\n",
+                node->line, node->col);
+        b->errors++;
+        return emit(b, IR_CONST, -1, -1, 0, node);
+    }
+}
+
+/*
+Lowers `name = value` given the AST of the value
+*/
+static void lower_assign(Builder *b, const char *name, const ASTNode *value, const ASTNode *node) {
+    int var = var_index(b, name, 0);
+    int v = lower_expr(b, value);
+
+    // a bare rename keeps a copy so the new name shows up in dumps
+    if (value->type == AST_IDENTIFIER_NODE) {
+        v = emit(b, IR_COPY, v, -1, 0, node);
+    }
+    if (b->fn->insts[v].var < 0) {
+        b->fn->insts[v].var = var;
+    }
+
+    write_variable(b, var, b->cur, v);
+    note_write(b, var);
+}
+
+static void lower_stmts(Builder *b, const ASTNode *list);
+
+static void lower_stmt(Builder *b, const ASTNode *node) {
+    IRFunction *fn = b->fn;
+
+    switch (node->type) {
+
+    case AST_VAR_DECL_NODE:
+        lower_assign(b, node->data.var_decl.identifer, node->data.var_decl.value, node);
+        break;
+
+    case AST_ASSIGN_NODE:
+        lower_assign(b, node->data.assignment.identifier, node->data.assignment.value, node);
+        break;
+
+    case AST_UNARY_EXPR: {
+        // x++ / --x as a statement
+        const ASTNode *operand = node->data.unary_expr.operand;
+        int var = lookup_var(b, operand->data.identifier.name);
+        int old = read_variable(b, var, b->cur);
+        int one = emit(b, IR_CONST, -1, -1, 1, node);
+        int v = emit(b, node->data.unary_expr.op[0] == '+' ? IR_ADD : IR_SUB, old, one, 0, node);
+        fn->insts[v].var = var;
+        write_variable(b, var, b->cur, v);
+        note_write(b, var);
+        break;
+    }
+
+    case AST_PRINT_NODE: {
+        int v = lower_expr(b, node->data.print_stmt.expression);
+        emit(b, IR_PRINT, v, -1, 0, node);
+        break;
+    }
+
+    case AST_READ_NODE: {
+        int var = var_index(b, node->data.read_stmt.identifier, 0);
+        int v = emit(b, IR_READ, -1, -1, 0, node);
+        fn->insts[v].var = var;
+        write_variable(b, var, b->cur, v);
+        note_write(b, var);
+        break;
+    }
+
+    case AST_ARRAY_DECL_NODE:
+        // storage is zero-filled before the program starts
+        break;
+
+    case AST_FN_DECL_NODE:
+        // built on its own by build_fn
+        break;
+
+    case AST_INDEX_ASSIGN_NODE: {
+        int array = array_index(b, node->data.index_assign.identifier, node);
+        int i = lower_expr(b, node->data.index_assign.index);
+        int v = lower_expr(b, node->data.index_assign.value);
+        if (array >= 0) {
+            emit(b, IR_STORE, i, v, array, node);
+        }
+        break;
+    }
+
+    case AST_IF_STMT_NODE: {
+        int cond = lower_expr(b, node->data.if_stmt.condition);
+        int then_bb = new_block(b, BLOCK_THEN, node);
+        int else_bb = node->data.if_stmt.else_block ? new_block(b, BLOCK_ELSE, node) : -1;
+        int join_bb = new_block(b, BLOCK_JOIN, node);
+
+        branch(b, b->cur, cond, then_bb, else_bb >= 0 ? else_bb : join_bb);
+
+        seal_block(b, then_bb);
+        b->cur = then_bb;
+        lower_stmts(b, node->data.if_stmt.then_block);
+        jump(b, b->cur, join_bb);
+
+        if (else_bb >= 0) {
+            seal_block(b, else_bb);
+            b->cur = else_bb;
+            lower_stmts(b, node->data.if_stmt.else_block);
+            jump(b, b->cur, join_bb);
+        }
+
+        seal_block(b, join_bb);
+        b->cur = join_bb;
+        break;
+    }
+
+    case AST_WHILE_LOOP_NODE:
+    case AST_FOR_LOOP_NODE: {
+        int is_for = node->type == AST_FOR_LOOP_NODE;
+
+        if (is_for) {
+            lower_stmt(b, node->data.for_loop.initializer);
+        }
+
+        IRLoop loop;
+        loop.preheader = b->cur;
+        loop.is_for = is_for;
+        loop.line = node->line;
+        loop.col = node->col;
+
+        int header = new_block(b, BLOCK_LOOP_HEADER, node);
+        jump(b, b->cur, header);
+
+        // the back edge isn't known yet, so the header stays unsealed
+        b->cur = header;
+        int cond = lower_expr(b, is_for ? node->data.for_loop.condition
+                                        : node->data.while_loop.condition);
+
+        int body = new_block(b, BLOCK_LOOP_BODY, node);
+        int exit_bb = new_block(b, BLOCK_LOOP_EXIT, node);
+        branch(b, b->cur, cond, body, exit_bb);
+
+        seal_block(b, body);
+        b->cur = body;
+        lower_stmts(b, is_for ? node->data.for_loop.for_block : node->data.while_loop.while_block);
+
+        if (is_for) {
+            int step = new_block(b, BLOCK_LOOP_STEP, node);
+            jump(b, b->cur, step);
+            seal_block(b, step);
+            b->cur = step;
+            lower_stmt(b, node->data.for_loop.step);
+        }
+
+        jump(b, b->cur, header);
+        seal_block(b, header);
+        seal_block(b, exit_bb);
+
+        // recorded after the body, so inner loops come first
+        loop.header = header;
+        loop.latch = b->cur;
+        loop.exit = exit_bb;
+        ir_add_loop(fn, &loop);
+
+        b->cur = exit_bb;
+        break;
+    }
+
+    default:
+        eidos_diag("Error at line %zu, column %zu: unexpected node in statement list\n",
+                node->line, node->col);
+        b->errors++;
+        break;
+    }
+}
+
+static void lower_stmts(Builder *b, const ASTNode *list) {
+    for (; list; list = list->data.stmts.next) {
+        lower_stmt(b, list->data.stmts.stmt);
+    }
+}
+
+
+/*
+Sets up a builder for a new function
+*/
+static void builder_init(Builder *b, const StrMap *funcs) {
+    memset(b, 0, sizeof(Builder));
+    strmap_init(&b->vars);
+    strmap_init(&b->arrays);
+    b->funcs = funcs;
+    b->fn = ir_new_function();
+}
+
+/*
+Releases a builder's state, but not the function it built
+
+returns:
+    (int) -> number of errors it reported
+*/
+static int builder_free(Builder *b) {
+    for (size_t i = 0; i < b->fn->nblocks; i++) {
+        eidos_free(b->blocks[i].pending);
+    }
+    eidos_free(b->blocks);
+    eidos_free(b->cse);
+    eidos_free(b->last_write);
+    eidos_free(b->defs.slots);
+    strmap_free(&b->vars);
+    strmap_free(&b->arrays);
+    return b->errors;
+}
+
+/*
+Lowers a function declaration
+
+args:
+    *decl (ASTNode) -> AST_FN_DECL_NODE
+    *funcs (StrMap) -> function name -> index, for the calls it makes
+    *errors (int) -> incremented by the errors reported
+
+returns:
+    (IRFunction*) -> the function, owned by main once placed in its funcs
+*/
+static IRFunction *build_fn(const ASTNode *decl, const StrMap *funcs, int *errors) {
+    Builder b;
+    builder_init(&b, funcs);
+    b.fn->name = eidos_strdup(decl->data.fn_decl.name);
+    b.fn->nparams = decl->data.fn_decl.nparams;
+    if (!b.fn->name) {
+        eidos_fatal("Failed to allocate function name");
+    }
+
+    // parameters come first, variable i is parameter i
+    for (size_t i = 0; i < decl->data.fn_decl.nparams; i++) {
+        var_index(&b, decl->data.fn_decl.params[i], 1);
+    }
+    collect_vars(&b, decl->data.fn_decl.body);
+
+    b.fn->entry = new_block(&b, BLOCK_ENTRY, decl);
+    seal_block(&b, b.fn->entry);
+    b.cur = b.fn->entry;
+
+    for (size_t i = 0; i < decl->data.fn_decl.nparams; i++) {
+        int v = emit(&b, IR_PARAM, -1, -1, (int64_t)i, decl);
+        b.fn->insts[v].var = (int)i;
+        write_variable(&b, (int)i, b.cur, v);
+    }
+
+    lower_stmts(&b, decl->data.fn_decl.body);
+    int ret = lower_expr(&b, decl->data.fn_decl.ret);
+    emit(&b, IR_RETURN, ret, -1, 0, decl->data.fn_decl.ret);
+    b.fn->blocks[b.cur].term = TERM_RET;
+
+    *errors += builder_free(&b);
+    return b.fn;
+}
+
+/*
+Lowers a program, optionally recording the value some variables end with
+
+args:
+    *program (ASTNode) -> AST_PROGRAM_NODE to lower
+    *live (StrMap) -> variables to fill IRFunction.exit_values for, NULL for none
+
+returns:
+    (IRFunction*) -> the function, NULL if errors were reported
+*/
+static IRFunction *build(const ASTNode *program, const StrMap *live) {
+    StrMap funcs;
+    strmap_init(&funcs);
+
+    Builder b;
+    builder_init(&b, &funcs);
+
+    // number the functions first, a call may come before the declaration
+    const ASTNode *s;
+    for (s = program->data.program.stmts; s; s = s->data.stmts.next) {
+        if (s->data.stmts.stmt->type == AST_FN_DECL_NODE) {
+            strmap_put(&funcs, s->data.stmts.stmt->data.fn_decl.name, b.fn->nfuncs++);
+        }
+    }
+    if (b.fn->nfuncs) {
+        b.fn->funcs = eidos_calloc(b.fn->nfuncs, sizeof(IRFunction*));
+        if (!b.fn->funcs) {
+            eidos_fatal("Failed to allocate functions");
+        }
+    }
+    size_t next = 0;
+    for (s = program->data.program.stmts; s; s = s->data.stmts.next) {
+        if (s->data.stmts.stmt->type == AST_FN_DECL_NODE) {
+            IRFunction *callee = build_fn(s->data.stmts.stmt, &funcs, &b.errors);
+            callee->funcs = b.fn->funcs;
+            callee->nfuncs = b.fn->nfuncs;
+            b.fn->funcs[next++] = callee;
+        }
+    }
+
+    collect_vars(&b, program);
+
+    b.fn->entry = new_block(&b, BLOCK_ENTRY, program);
+    seal_block(&b, b.fn->entry);
+    b.cur = b.fn->entry;
+
+    lower_stmts(&b, program->data.program.stmts);
+
+    if (live) {
+        b.fn->exit_values = eidos_malloc((b.fn->nvars ? b.fn->nvars : 1) * sizeof(int));
+        if (!b.fn->exit_values) {
+            eidos_fatal("Failed to allocate exit values");
+        }
+        for (size_t var = 0; var < b.fn->nvars; var++) {
+            size_t unused;
+            b.fn->exit_values[var] = strmap_get(live, b.fn->var_names[var], &unused)
+                                   ? read_variable(&b, (int)var, b.cur) : -1;
+        }
+    }
+    b.fn->blocks[b.cur].term = TERM_RET;
+
+    int errors = builder_free(&b);
+    strmap_free(&funcs);
+
+    if (errors) {
+        ir_free_function(b.fn);
+        return NULL;
+    }
+
+    return b.fn;
+}
+
+
+/* ========== PUBLIC API ========== */
+
+IRFunction *ir_build(const ASTNode *program) {
+    return build(program, NULL);
+}
+
+IRFunction *ir_build_for_eval(const ASTNode *program, const StrMap *live) {
+    return build(program, live);
+}
@@ -0,0 +1,99 @@
+#include "passes.h"
+#include "../util/context.h"
+#include <stdlib.h>
+
+/*
+Loop-invariant code motion.
+
+Works on the loops ir_build recorded for every for/while statement. A pure
+instruction whose operands are all defined outside the loop computes the same
+value on every iteration, so it moves to the end of the preheader and runs
+once. Loops are visited innermost first: a value hoisted out of an inner loop
+lands in code that belongs to the outer loop and can be hoisted again.
+
+Hoisting is speculative, the value is computed even when the loop runs zero
+times, which is why anything that prints, reads or may trap stays put.
+*/
+
+/* ===== Helper Functions ===== */
+
+static int is_invariant(const IRFunction *fn, const char *in_loop, const IRInst *in) {
+    if (in->op == IR_PHI || ir_has_side_effects(fn, in)) {
+        return 0;
+    }
+
+    for (size_t o = 0; o < ir_num_operands(in); o++) {
+        int op = *ir_operand((IRInst*)in, o);
+        if (in_loop[fn->insts[op].block]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+Hoists everything invariant out of one loop
+
+returns:
+    (size_t) -> number of instructions moved
+*/
+static size_t hoist_loop(IRFunction *fn, const IRLoop *loop, char *in_loop, int *blocks) {
+    size_t nblocks = ir_loop_body(fn, loop, in_loop, blocks);
+
+    size_t moved = 0;
+    int changed = 1;
+
+    // hoisting one value can make its users invariant, repeat until nothing moves
+    while (changed) {
+        changed = 0;
+
+        for (size_t i = 0; i < nblocks; i++) {
+            IRBlock *bb = &fn->blocks[blocks[i]];
+            size_t k = 0;
+            while (k < bb->ninsts) {
+                int v = bb->insts[k];
+                if (is_invariant(fn, in_loop, &fn->insts[v])) {
+                    ir_move_inst(fn, v, loop->preheader);
+                    moved++;
+                    changed = 1;
+                } else {
+                    k++;
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < nblocks; i++) {
+        in_loop[blocks[i]] = 0;
+    }
+    return moved;
+}
+
+
+/* ========== PUBLIC API ========== */
+
+/*
+Loop-invariant code motion
+
+args:
+    *fn (IRFunction) -> function to rewrite
+
+returns:
+    (size_t) -> number of instructions hoisted
+*/
+size_t ir_pass_licm(IRFunction *fn) {
+    char *in_loop = eidos_calloc(fn->nblocks ? fn->nblocks : 1, 1);
+    int *blocks = eidos_malloc((fn->nblocks ? fn->nblocks : 1) * sizeof(int));
+    if (!in_loop || !blocks) {
+        eidos_fatal("Failed to allocate loop state");
+    }
+
+    size_t moved = 0;
+    for (size_t i = 0; i < fn->nloops; i++) {
+        moved += hoist_loop(fn, &fn->loops[i], in_loop, blocks);
+    }
+
+    eidos_free(blocks);
+    eidos_free(in_loop);
+    return moved;
+}
@@ -0,0 +1,262 @@
+#include "parloop.h"
+#include "../util/arith.h"
+#include "../util/context.h"
+#include <stdlib.h>
+#include <string.h>
+
+// larger steps are left alone, a few iterations would cover the whole range anyway
+#define PAR_MAX_STEP ((int64_t)1 << 32)
+
+/* ===== Helper Functions ===== */
+
+static int defined_in(const IRFunction *fn, const char *in_loop, int v) {
+    return in_loop[fn->insts[v].block];
+}
+
+/*
+Follows the value the latch hands back to the header down to the induction
+variable, through additions of constants and copies
+
+returns:
+    (int64_t) -> total added per iteration, 0 if it isn't a constant increment
+*/
+static int64_t step_of(const IRFunction *fn, const char *in_loop, int iv, int next) {
+    int64_t step = 0;
+    size_t hops = 0;
+
+    for (int v = next; v != iv; hops++) {
+        if (hops > fn->ninsts || !defined_in(fn, in_loop, v)) {
+            return 0;
+        }
+        const IRInst *in = &fn->insts[v];
+        int64_t c;
+        if (in->op == IR_COPY) {
+            v = in->a;
+            continue;
+        }
+        if (in->op != IR_ADD) {
+            return 0;
+        }
+        if (fn->insts[in->b].op == IR_CONST) {
+            c = fn->insts[in->b].imm;
+            v = in->a;
+        } else if (fn->insts[in->a].op == IR_CONST) {
+            c = fn->insts[in->a].imm;
+            v = in->b;
+        } else {
+            return 0;
+        }
+        if (c <= 0 || c > PAR_MAX_STEP || step > PAR_MAX_STEP) {
+            return 0;
+        }
+        step += c;
+    }
+    return step <= PAR_MAX_STEP ? step : 0;
+}
+
+/*
+Adds v to the loop's environment unless it is already there
+*/
+static void add_env(IRParLoop *par, int v, size_t *cap) {
+    for (size_t i = 0; i < par->nenv; i++) {
+        if (par->env[i] == v) {
+            return;
+        }
+    }
+    if (par->nenv == *cap) {
+        *cap = *cap ? *cap * 2 : 8;
+        par->env = eidos_realloc(par->env, *cap * sizeof(int));
+        if (!par->env) {
+            eidos_fatal("Failed to allocate loop environment");
+        }
+    }
+    par->env[par->nenv++] = v;
+}
+
+/*
+Checks one loop
+
+args:
+    *fn (IRFunction) -> function
+    index (size_t) -> loop to check
+    *par (IRParLoop) -> filled in when it qualifies, in_loop already allocated
+
+returns:
+    (int) -> 1 if the loop's iterations are independent
+*/
+static int check_loop(const IRFunction *fn, size_t index, IRParLoop *par) {
+    const IRLoop *loop = &fn->loops[index];
+    char *in_loop = par->in_loop;
+
+    if (!loop->is_for || !ir_loop_blocks(fn, loop, in_loop)) {
+        return 0;
+    }
+
+    // the only value carried from one iteration to the next is the induction variable
+    const IRBlock *header = &fn->blocks[loop->header];
+    if (header->nphis != 1 || header->term != TERM_BR) {
+        return 0;
+    }
+    int iv = header->phis[0];
+    int pre_edge = header->preds[0] == loop->preheader ? 0 : 1;
+    int init = fn->insts[iv].phi_args[pre_edge];
+    int next = fn->insts[iv].phi_args[1 - pre_edge];
+
+    if (!in_loop[header->succ[0]] || in_loop[header->succ[1]]) {
+        return 0;
+    }
+
+    // iv < bound, iv <= bound, or the same written the other way around
+    const IRInst *cond = &fn->insts[header->cond];
+    if (cond->op != IR_CMP) {
+        return 0;
+    }
+    int bound;
+    CmpOp cmp = (CmpOp)cond->imm;
+    if (cond->a == iv && (cmp == CMP_LT || cmp == CMP_LE)) {
+        bound = cond->b;
+        par->inclusive = cmp == CMP_LE;
+    } else if (cond->b == iv && (cmp == CMP_GT || cmp == CMP_GE)) {
+        bound = cond->a;
+        par->inclusive = cmp == CMP_GE;
+    } else {
+        return 0;
+    }
+    if (defined_in(fn, in_loop, bound) || defined_in(fn, in_loop, init)) {
+        return 0;
+    }
+
+    int64_t step = step_of(fn, in_loop, iv, next);
+    if (step == 0) {
+        return 0;
+    }
+
+    // no input, no array writes, and everything the body reads from outside is fixed before it starts
+    size_t cap = 0;
+    par->nenv = 0;
+    for (size_t b = 0; b < fn->nblocks; b++) {
+        const IRBlock *bb = &fn->blocks[b];
+        if (!in_loop[b] || bb->dead) {
+            continue;
+        }
+        for (size_t k = 0; k < bb->nphis + bb->ninsts; k++) {
+            int v = k < bb->nphis ? bb->phis[k] : bb->insts[k - bb->nphis];
+            IRInst *in = &fn->insts[v];
+            if (in->op == IR_READ || in->op == IR_STORE || in->op == IR_CALL) {
+                return 0;
+            }
+            if (v == iv) {
+                continue;
+            }
+            for (size_t o = 0; o < ir_num_operands(in); o++) {
+                int op = *ir_operand(in, o);
+                if (!defined_in(fn, in_loop, op)) {
+                    add_env(par, op, &cap);
+                }
+            }
+        }
+        if (bb->term == TERM_BR && !defined_in(fn, in_loop, bb->cond)) {
+            add_env(par, bb->cond, &cap);
+        }
+    }
+
+    // and nothing but the induction variable is used after it
+    for (size_t b = 0; b < fn->nblocks; b++) {
+        const IRBlock *bb = &fn->blocks[b];
+        if (in_loop[b] || bb->dead) {
+            continue;
+        }
+        for (size_t k = 0; k < bb->nphis + bb->ninsts; k++) {
+            int v = k < bb->nphis ? bb->phis[k] : bb->insts[k - bb->nphis];
+            IRInst *in = &fn->insts[v];
+            for (size_t o = 0; o < ir_num_operands(in); o++) {
+                int op = *ir_operand(in, o);
+                if (op != iv && defined_in(fn, in_loop, op)) {
+                    return 0;
+                }
+            }
+        }
+        if (bb->term == TERM_BR && bb->cond != iv && defined_in(fn, in_loop, bb->cond)) {
+            return 0;
+        }
+    }
+
+    par->loop = (int)index;
+    par->iv = iv;
+    par->init = init;
+    par->bound = bound;
+    par->step = step;
+    return 1;
+}
+
+
+/* ========== PUBLIC API ========== */
+
+/*
+Finds the loops whose iterations can run in parallel
+
+args:
+    *fn (IRFunction) -> optimized function
+    **loops (IRParLoop) -> receives the loops found, outermost of each nest only
+
+returns:
+    (size_t) -> number of loops found
+*/
+size_t ir_find_par_loops(const IRFunction *fn, IRParLoop **loops) {
+    *loops = NULL;
+    if (!fn->nloops) {
+        return 0;
+    }
+
+    IRParLoop *found = eidos_calloc(fn->nloops, sizeof(IRParLoop));
+    char *covered = eidos_calloc(fn->nblocks, 1);
+    if (!found || !covered) {
+        eidos_fatal("Failed to allocate loop analysis");
+    }
+    size_t count = 0;
+
+    // fn->loops lists inner loops first, so walk it backwards to meet the outer ones first
+    for (size_t i = fn->nloops; i-- > 0;) {
+        if (covered[fn->loops[i].header]) {
+            continue;
+        }
+        IRParLoop *par = &found[count];
+        par->in_loop = eidos_malloc(fn->nblocks);
+        if (!par->in_loop) {
+            eidos_fatal("Failed to allocate loop analysis");
+        }
+        if (!check_loop(fn, i, par)) {
+            eidos_free(par->env);
+            eidos_free(par->in_loop);
+            memset(par, 0, sizeof(IRParLoop));
+            continue;
+        }
+        for (size_t b = 0; b < fn->nblocks; b++) {
+            covered[b] |= par->in_loop[b];
+        }
+        count++;
+    }
+
+    eidos_free(covered);
+    if (!count) {
+        eidos_free(found);
+        return 0;
+    }
+    *loops = found;
+    return count;
+}
+
+/*
+Frees what ir_find_par_loops returned
+
+args:
+    *loops (IRParLoop) -> loops, may be NULL
+    count (size_t) -> number of loops
+*/
+void ir_free_par_loops(IRParLoop *loops, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        eidos_free(loops[i].env);
+        eidos_free(loops[i].in_loop);
+    }
+    eidos_free(loops);
+}
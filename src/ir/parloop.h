@@ -0,0 +1,53 @@
+#pragma once
+
+/*
+Finds for loops whose iterations can run in parallel (--parallel-loops).
+
+Values are SSA, so anything an iteration hands to the next one is a phi of
+the loop header. A loop qualifies when its header has a single phi, the
+induction variable, which
+- starts from a value computed before the loop,
+- grows by a positive constant each iteration (possibly in several steps,
+  as partial unrolling leaves it), and
+- is compared against a bound computed before the loop with < or <=.
+
+Besides that the loop must not read input, which is a sequence, nor write
+an array another iteration may read, nor call a function (the call depth
+is counted in one place), and no value it computes other than
+the induction variable may be used after it. Array writes are not told
+apart by index, so a loop writing any array stays sequential.
+What's left is iterations that depend only on their induction variable and
+on values fixed before the loop started: they can run in any order, on any
+thread. Printing stays allowed; the C backend collects each chunk's output
+and writes the chunks in order, and replays a runtime error where the
+sequential program would have hit it.
+
+Loops nested in a qualifying loop run inside its iterations, so only the
+outermost qualifying loop of a nest is reported.
+*/
+
+#include <stdint.h>
+#include "ir.h"
+
+typedef struct IRParLoop {
+    int loop;           // index into fn->loops
+    int iv;             // header phi, the induction variable
+    int init;           // its value on entry
+    int bound;          // value it is compared against
+    int inclusive;      // 1 for iv <= bound, 0 for iv < bound
+    int64_t step;       // added once per iteration, > 0
+    char *in_loop;      // per block, 1 for the header and body (ir_loop_blocks)
+    int *env;           // values defined before the loop that it reads, the bound among them
+    size_t nenv;
+} IRParLoop;
+
+
+/* ========== Public API Functions ========== */
+
+/*
+Finds the parallel loops of fn. Returns how many there are and sets *loops
+to them, NULL if none; free with ir_free_par_loops.
+*/
+size_t ir_find_par_loops(const IRFunction *fn, IRParLoop **loops);
+
+void ir_free_par_loops(IRParLoop *loops, size_t count);
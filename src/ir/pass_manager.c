@@ -0,0 +1,136 @@
+#include "passes.h"
+#include "../util/context.h"
+#include <string.h>
+#include <time.h>
+
+// every pass the command line can name, in no particular order
+static const IRPass registry[] = {
+    { "copyprop",    "copy propagation and trivial phi removal",  ir_pass_copy_propagation },
+    { "sccp",        "sparse conditional constant propagation",   ir_pass_sccp },
+    { "unreachable", "unreachable block removal",                 ir_pass_unreachable_blocks },
+    { "licm",        "loop-invariant code motion",                ir_pass_licm },
+    { "strength",    "induction-variable strength reduction",     ir_pass_strength_reduction },
+    { "dse",         "dead-store elimination",                    ir_pass_dead_stores },
+    { "inline",      "inlining of small leaf functions",          ir_pass_inline },
+};
+
+// the pipeline used when --passes is not given
+static const char *default_pipeline =
+    "copyprop,sccp,unreachable,copyprop,inline,copyprop,sccp,unreachable,licm,strength,copyprop,sccp,licm,dse";
+
+/* ===== Helper Functions ===== */
+
+static double now_millis(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+
+/* ========== PUBLIC API ========== */
+
+const IRPass *ir_find_pass(const char *name) {
+    for (size_t i = 0; i < sizeof(registry) / sizeof(registry[0]); i++) {
+        if (strcmp(registry[i].name, name) == 0) {
+            return &registry[i];
+        }
+    }
+    return NULL;
+}
+
+void ir_pm_init(IRPassManager *pm) {
+    memset(pm, 0, sizeof(IRPassManager));
+}
+
+void ir_pm_init_default(IRPassManager *pm) {
+    ir_pm_init(pm);
+    ir_pm_add_list(pm, default_pipeline);
+}
+
+/*
+Appends the passes named in a comma separated list
+
+args:
+    *pm (IRPassManager) -> pass manager to extend
+    *list (char) -> "name,name,..." or "none"
+
+returns:
+    (int) -> 1 on success, 0 if a name is unknown or the pipeline is full
+*/
+int ir_pm_add_list(IRPassManager *pm, const char *list) {
+    if (strcmp(list, "none") == 0) {
+        return 1;
+    }
+
+    char name[64];
+    const char *p = list;
+
+    while (*p) {
+        size_t len = strcspn(p, ",");
+        if (len == 0 || len >= sizeof(name)) {
+            eidos_diag("ERROR: Bad pass list '%s'.\n", list);
+            return 0;
+        }
+        memcpy(name, p, len);
+        name[len] = '\0';
+
+        const IRPass *pass = ir_find_pass(name);
+        if (!pass) {
+            eidos_diag("ERROR: Unknown pass '%s'. Known passes:\n", name);
+            for (size_t i = 0; i < sizeof(registry) / sizeof(registry[0]); i++) {
+                eidos_diag("  %-12s %s\n", registry[i].name, registry[i].desc);
+            }
+            return 0;
+        }
+        if (pm->count == IR_MAX_PASSES) {
+            eidos_diag("ERROR: Too many passes (max %d).\n", IR_MAX_PASSES);
+            return 0;
+        }
+        pm->pipeline[pm->count++] = pass;
+
+        p += len;
+        if (*p == ',') {
+            p++;
+        }
+    }
+
+    return 1;
+}
+
+/*
+Runs every pass of the pipeline in order and times each one
+
+args:
+    *pm (IRPassManager) -> pipeline to run, results are overwritten
+    *fn (IRFunction) -> main, optimized with its functions
+*/
+void ir_pm_run(IRPassManager *pm, IRFunction *fn) {
+    pm->nresults = 0;
+
+    for (size_t i = 0; i < pm->count; i++) {
+        double start = now_millis();
+
+        // callees first, so main inlines what they became
+        size_t changes = 0;
+        for (size_t f = 0; f < fn->nfuncs; f++) {
+            changes += pm->pipeline[i]->run(fn->funcs[f]);
+        }
+        changes += pm->pipeline[i]->run(fn);
+
+        IRPassResult *r = &pm->results[pm->nresults++];
+        r->name = pm->pipeline[i]->name;
+        r->changes = changes;
+        r->millis = now_millis() - start;
+    }
+}
+
+void ir_pm_print_stats(const IRPassManager *pm, FILE *out) {
+    double total = 0;
+
+    for (size_t i = 0; i < pm->nresults; i++) {
+        const IRPassResult *r = &pm->results[i];
+        fprintf(out, "pass %-12s %6zu changes %10.3f ms\n", r->name, r->changes, r->millis);
+        total += r->millis;
+    }
+    fprintf(out, "passes total %26.3f ms\n", total);
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+/*
+Pass manager and the optimization passes that run over the SSA IR.
+
+Each pass rewrites an IRFunction in place and returns how many changes it
+made. The pass manager runs an ordered pipeline of passes and records the
+wall time and change count of each run for --stats.
+*/
+
+#include "ir.h"
+
+#define IR_MAX_PASSES 32
+
+// returns the number of changes made
+typedef size_t (*IRPassFn)(IRFunction *fn);
+
+typedef struct IRPass {
+    const char *name;       // name used on the command line (--passes=...)
+    const char *desc;       // one line description
+    IRPassFn run;
+} IRPass;
+
+typedef struct IRPassResult {
+    const char *name;
+    size_t changes;
+    double millis;          // wall time of this run
+} IRPassResult;
+
+typedef struct IRPassManager {
+    const IRPass *pipeline[IR_MAX_PASSES];
+    size_t count;
+    IRPassResult results[IR_MAX_PASSES];
+    size_t nresults;
+} IRPassManager;
+
+
+/* ========== Passes ========== */
+
+/*
+copyprop: forwards uses of copies and of phis whose incoming values are all
+the same (ignoring the phi itself) to the original value, then drops them
+*/
+size_t ir_pass_copy_propagation(IRFunction *fn);
+
+/*
+sccp: sparse conditional constant propagation (Wegman & Zadeck). Values proven
+constant become IR_CONST, branches on proven constants become jumps.
+*/
+size_t ir_pass_sccp(IRFunction *fn);
+
+/*
+unreachable: removes blocks that can no longer be reached from the entry,
+along with their edges and the phi arguments flowing along them
+*/
+size_t ir_pass_unreachable_blocks(IRFunction *fn);
+
+/*
+licm: loop-invariant code motion. Pure computations whose operands are all
+defined outside a for/while loop move to the loop's preheader.
+*/
+size_t ir_pass_licm(IRFunction *fn);
+
+/*
+strength: induction-variable strength reduction. `i * k` with i a for-loop
+counter and k loop invariant becomes a running sum updated once per iteration.
+*/
+size_t ir_pass_strength_reduction(IRFunction *fn);
+
+/*
+inline: replaces calls to small leaf functions (ones that call nothing and
+have no loop) by a copy of their body. A call in a loop may pull in up to
+IR_INLINE_HOT_COST instructions, any other call up to IR_INLINE_COST.
+*/
+#define IR_INLINE_COST 12
+#define IR_INLINE_HOT_COST 48
+
+size_t ir_pass_inline(IRFunction *fn);
+
+/*
+dse: dead-store elimination. In SSA every variable store is a definition, so
+this deletes definitions nothing reads that have no side effects.
+*/
+size_t ir_pass_dead_stores(IRFunction *fn);
+
+
+/* ========== Pass Manager ========== */
+
+/*
+Looks up a registered pass by name, NULL if there is none
+*/
+const IRPass *ir_find_pass(const char *name);
+
+/*
+Initializes an empty pipeline
+*/
+void ir_pm_init(IRPassManager *pm);
+
+/*
+Initializes the default optimization pipeline
+*/
+void ir_pm_init_default(IRPassManager *pm);
+
+/*
+Appends passes from a comma separated list of names ("sccp,dse"), "none" for
+an empty pipeline. Returns 0 and prints an error on an unknown name.
+*/
+int ir_pm_add_list(IRPassManager *pm, const char *list);
+
+/*
+Runs the pipeline in order, recording each pass's result. Every pass runs
+over the program's functions first, then over main.
+*/
+void ir_pm_run(IRPassManager *pm, IRFunction *fn);
+
+/*
+Prints one line per pass run: name, changes and time
+*/
+void ir_pm_print_stats(const IRPassManager *pm, FILE *out);
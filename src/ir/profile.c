@@ -0,0 +1,513 @@
+#include "profile.h"
+#include "../util/context.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct LineStats {
+    size_t line;
+    uint64_t executions;        // most times any instruction of the line ran
+    uint64_t instructions;      // instructions of the line executed
+    double ticks;               // timer ticks, shared out by instruction count
+} LineStats;
+
+typedef struct LoopStats {
+    const IRLoop *loop;
+    uint64_t entries;           // times control came into the loop
+    uint64_t iterations;        // times the body ran
+    uint64_t instructions;      // instructions executed inside, inner loops included
+    uint64_t ticks;
+} LoopStats;
+
+// one frame of the folded output before merging
+typedef struct Stack {
+    char *text;
+    uint64_t weight;
+} Stack;
+
+/* ===== Helper Functions ===== */
+
+// Line an instruction is reported under, its block's if the instruction has none
+static size_t inst_line(const IRFunction *fn, const IRBlock *bb, int value) {
+    size_t line = fn->insts[value].line;
+    return line ? line : bb->line;
+}
+
+static void *checked_calloc(size_t count, size_t size) {
+    void *p = eidos_calloc(count ? count : 1, size);
+    if (!p) {
+        eidos_fatal("Failed to allocate profile");
+    }
+    return p;
+}
+
+static void add_to_line(LineStats *lines, size_t line, uint64_t executions, uint64_t instructions,
+                        double ticks) {
+    LineStats *l = &lines[line];
+    l->line = line;
+    l->instructions += instructions;
+    l->ticks += ticks;
+    if (executions > l->executions) {
+        l->executions = executions;
+    }
+}
+
+/*
+Spreads the block counters of every function over source lines
+
+args:
+    *fn (IRFunction) -> profiled program
+    *profile (IRProfile) -> its counters
+    *nlines (size_t) -> receives the length of the array, highest line + 1
+
+returns:
+    (LineStats*) -> one entry per line, lines that never ran are all zero
+*/
+static LineStats *collect_lines(const IRFunction *fn, const IRProfile *profile, size_t *nlines) {
+    size_t max_line = 0;
+    for (size_t f = 0; f < profile->nfunctions; f++) {
+        const IRFunction *g = ir_profile_function(fn, f);
+        for (size_t b = 0; b < g->nblocks; b++) {
+            const IRBlock *bb = &g->blocks[b];
+            if (bb->line > max_line) {
+                max_line = bb->line;
+            }
+            for (size_t k = 0; k < bb->ninsts; k++) {
+                if (g->insts[bb->insts[k]].line > max_line) {
+                    max_line = g->insts[bb->insts[k]].line;
+                }
+            }
+        }
+    }
+
+    LineStats *lines = checked_calloc(max_line + 1, sizeof(LineStats));
+    for (size_t f = 0; f < profile->nfunctions; f++) {
+        const IRFunction *g = ir_profile_function(fn, f);
+        const uint64_t *counts = profile->block_counts + profile->block_base[f];
+        const uint64_t *block_ticks = profile->block_ticks + profile->block_base[f];
+        for (size_t b = 0; b < g->nblocks; b++) {
+            const IRBlock *bb = &g->blocks[b];
+            uint64_t count = counts[b];
+            uint64_t ticks = block_ticks[b];
+            if (bb->dead || (!count && !ticks)) {
+                continue;
+            }
+
+            // phis, and the jump of an empty block, count for the statement that made the block
+            size_t n = bb->nphis + bb->ninsts;
+            double share = n ? (double)ticks / (double)n : (double)ticks;
+            if (bb->nphis || n == 0) {
+                add_to_line(lines, bb->line, count, count * bb->nphis, share * (double)(n ? bb->nphis : 1));
+            }
+            for (size_t k = 0; k < bb->ninsts; k++) {
+                add_to_line(lines, inst_line(g, bb, bb->insts[k]), count, count, share);
+            }
+        }
+    }
+
+    *nlines = max_line + 1;
+    return lines;
+}
+
+static int hotter_line(const void *a, const void *b) {
+    const LineStats *x = a, *y = b;
+    if (x->ticks != y->ticks) {
+        return x->ticks > y->ticks ? -1 : 1;
+    }
+    if (x->instructions != y->instructions) {
+        return x->instructions > y->instructions ? -1 : 1;
+    }
+    return x->line < y->line ? -1 : x->line > y->line;
+}
+
+static int hotter_loop(const void *a, const void *b) {
+    const LoopStats *x = a, *y = b;
+    if (x->ticks != y->ticks) {
+        return x->ticks > y->ticks ? -1 : 1;
+    }
+    if (x->instructions != y->instructions) {
+        return x->instructions > y->instructions ? -1 : 1;
+    }
+    return x->loop->line < y->loop->line ? -1 : x->loop->line > y->loop->line;
+}
+
+static int by_stack(const void *a, const void *b) {
+    return strcmp(((const Stack*)a)->text, ((const Stack*)b)->text);
+}
+
+/*
+Prints source line `line` (1-based), without its indentation and cut short
+if it is long
+*/
+static void print_source_line(const char *source, size_t line, FILE *out) {
+    if (!source) {
+        return;
+    }
+    const char *p = source;
+    for (size_t l = 1; l < line && *p; l++) {
+        p = strchr(p, '\n');
+        if (!p) {
+            return;
+        }
+        p++;
+    }
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+    size_t len = strcspn(p, "\r\n");
+    if (len > 48) {
+        fprintf(out, "%.45s...", p);
+    } else {
+        fprintf(out, "%.*s", (int)len, p);
+    }
+}
+
+/*
+Finds how the recorded loops nest, for the folded stacks
+
+args:
+    *fn (IRFunction) -> function
+    *innermost (int) -> receives, per block, the innermost loop containing it or -1
+    *parent (int) -> receives, per loop, the loop directly around it or -1
+*/
+static void nest_loops(const IRFunction *fn, int *innermost, int *parent) {
+    char *in_loop = checked_calloc(fn->nblocks, 1);
+    for (size_t b = 0; b < fn->nblocks; b++) {
+        innermost[b] = -1;
+    }
+
+    // inner loops are recorded first, so a block's first loop is its innermost
+    for (size_t i = 0; i < fn->nloops; i++) {
+        parent[i] = -1;
+        if (!ir_loop_blocks(fn, &fn->loops[i], in_loop)) {
+            continue;
+        }
+        for (size_t b = 0; b < fn->nblocks; b++) {
+            if (!in_loop[b]) {
+                continue;
+            }
+            if (innermost[b] < 0) {
+                innermost[b] = (int)i;
+                continue;
+            }
+            int top = innermost[b];
+            while (parent[top] >= 0) {
+                top = parent[top];
+            }
+            if (top != (int)i) {
+                parent[top] = (int)i;
+            }
+        }
+    }
+    eidos_free(in_loop);
+}
+
+static char *stack_text(const IRFunction *fn, const int *parent, int loop, const char *name, size_t line) {
+    size_t depth = 0;
+    for (int l = loop; l >= 0; l = parent[l]) {
+        depth++;
+    }
+
+    // a function's lines sit under a frame of their own, below the program's
+    size_t cap = strlen(name) + (fn->name ? strlen(fn->name) + 5 : 0) + 32 * (depth + 1);
+    char *text = checked_calloc(cap, 1);
+    size_t len = (size_t)snprintf(text, cap, "%s", name);
+    if (fn->name) {
+        len += (size_t)snprintf(text + len, cap - len, ";fn:%s", fn->name);
+    }
+
+    // outermost loop first
+    for (size_t d = depth; d > 0; d--) {
+        int l = loop;
+        for (size_t up = 1; up < d; up++) {
+            l = parent[l];
+        }
+        const IRLoop *lp = &fn->loops[l];
+        len += (size_t)snprintf(text + len, cap - len, ";%s:%zu", lp->is_for ? "for" : "while", lp->line);
+    }
+    snprintf(text + len, cap - len, ";line %zu", line);
+    return text;
+}
+
+
+/* ========== PUBLIC API ========== */
+
+/*
+Allocates the counters of every function of the program
+
+args:
+    *fn (IRFunction) -> program to run
+    trips (int) -> 1 to also set up the trip counts of every loop
+    *profile (IRProfile) -> receives the zeroed counters
+*/
+void ir_profile_init(const IRFunction *fn, int trips, IRProfile *profile) {
+    memset(profile, 0, sizeof(IRProfile));
+    profile->current_block = -1;
+    profile->nfunctions = fn->nfuncs + 1;
+    profile->block_base = checked_calloc(profile->nfunctions, sizeof(size_t));
+    profile->loop_base = checked_calloc(profile->nfunctions, sizeof(size_t));
+    size_t nloops = 0, max_blocks = 0;
+    for (size_t f = 0; f < profile->nfunctions; f++) {
+        const IRFunction *g = ir_profile_function(fn, f);
+        profile->block_base[f] = profile->nblocks;
+        profile->loop_base[f] = nloops;
+        profile->nblocks += g->nblocks;
+        nloops += g->nloops;
+        if (g->nblocks > max_blocks) {
+            max_blocks = g->nblocks;
+        }
+    }
+    profile->block_counts = checked_calloc(profile->nblocks, sizeof(uint64_t));
+    profile->block_ticks = checked_calloc(profile->nblocks, sizeof(uint64_t));
+
+    if (trips) {
+        // only loops that kept their shape through the passes can be followed
+        profile->loop_trips = checked_calloc(nloops, sizeof(IRLoopTrips));
+        profile->header_loop = checked_calloc(profile->nblocks, sizeof(int));
+        profile->exit_loop = checked_calloc(profile->nblocks, sizeof(int));
+        char *in_loop = checked_calloc(max_blocks, 1);
+        for (size_t b = 0; b < profile->nblocks; b++) {
+            profile->header_loop[b] = -1;
+            profile->exit_loop[b] = -1;
+        }
+        for (size_t f = 0; f < profile->nfunctions; f++) {
+            const IRFunction *g = ir_profile_function(fn, f);
+            size_t base = profile->block_base[f];
+            for (size_t i = 0; i < g->nloops; i++) {
+                const IRLoop *loop = &g->loops[i];
+                if (ir_loop_blocks(g, loop, in_loop) && !g->blocks[loop->exit].dead) {
+                    profile->header_loop[base + (size_t)loop->header] = (int)i;
+                    profile->exit_loop[base + (size_t)loop->exit] = (int)i;
+                }
+            }
+        }
+        eidos_free(in_loop);
+    }
+}
+
+/*
+Runs a function counting its blocks, without the sampling timer
+
+args:
+    *fn (IRFunction) -> function to run
+    *in (FILE) -> where read() takes integers from, NULL makes read() an error
+    *out (FILE) -> where print() writes to
+    *stats (IRExecStats) -> execution counters, may be NULL
+    trips (int) -> 1 to also record the trip counts of every loop
+    *profile (IRProfile) -> receives the counters, without ticks or run time
+
+returns:
+    (int) -> 0 on success, 1 on a runtime error
+*/
+int ir_profile_count(const IRFunction *fn, FILE *in, FILE *out, IRExecStats *stats, int trips,
+                     IRProfile *profile) {
+    ir_profile_init(fn, trips, profile);
+    return ir_interpret_profiled(fn, in, out, stats, profile);
+}
+
+/*
+Prints the hottest lines and the loops
+
+args:
+    *fn (IRFunction) -> profiled function
+    *profile (IRProfile) -> its counters
+    *source (char) -> program text, for the source column, may be NULL
+    limit (size_t) -> most lines to print, 0 for all
+    *out (FILE) -> where to print
+*/
+void ir_profile_report(const IRFunction *fn, const IRProfile *profile, const char *source,
+                       size_t limit, FILE *out) {
+    size_t nlines;
+    LineStats *lines = collect_lines(fn, profile, &nlines);
+
+    uint64_t total = 0;
+    size_t ran = 0;
+    for (size_t l = 0; l < nlines; l++) {
+        total += lines[l].instructions;
+        if (lines[l].executions || lines[l].ticks > 0) {
+            lines[ran++] = lines[l];
+        }
+    }
+    qsort(lines, ran, sizeof(LineStats), hotter_line);
+
+    // the kernel may deliver fewer ticks than asked for, so they only give the split of the measured time
+    double tick_ms = profile->ticks ? profile->run_ms / (double)profile->ticks : 0;
+
+    if (profile->sampled) {
+        fprintf(out, "profile: %.1f ms of CPU time, %llu samples, %llu instructions\n", profile->run_ms,
+                (unsigned long long)profile->ticks, (unsigned long long)total);
+    } else {
+        fprintf(out, "profile: %.1f ms of CPU time, not sampled (another profiled run had the timer), "
+                "%llu instructions\n", profile->run_ms, (unsigned long long)total);
+    }
+    fprintf(out, "profile: %6s %12s %14s %7s %9s  %s\n", "line", "executions", "instructions", "instrs", "time ms",
+            "source");
+    for (size_t i = 0; i < ran && (!limit || i < limit); i++) {
+        const LineStats *l = &lines[i];
+        fprintf(out, "profile: %6zu %12llu %14llu %6.1f%% %9.1f  ", l->line, (unsigned long long)l->executions,
+                (unsigned long long)l->instructions, total ? 100.0 * (double)l->instructions / (double)total : 0.0,
+                l->ticks * tick_ms);
+        print_source_line(source, l->line, out);
+        fputs("\n", out);
+    }
+    if (limit && ran > limit) {
+        fprintf(out, "profile: ... %zu more lines\n", ran - limit);
+    }
+    eidos_free(lines);
+
+    // loops, inner loops included in the loops around them
+    size_t max_loops = 0, max_blocks = 0;
+    for (size_t f = 0; f < profile->nfunctions; f++) {
+        const IRFunction *g = ir_profile_function(fn, f);
+        max_loops += g->nloops;
+        if (g->nblocks > max_blocks) {
+            max_blocks = g->nblocks;
+        }
+    }
+    LoopStats *loops = checked_calloc(max_loops, sizeof(LoopStats));
+    char *in_loop = checked_calloc(max_blocks, 1);
+    size_t nloops = 0;
+    for (size_t f = 0; f < profile->nfunctions; f++) {
+        const IRFunction *g = ir_profile_function(fn, f);
+        const uint64_t *counts = profile->block_counts + profile->block_base[f];
+        const uint64_t *block_ticks = profile->block_ticks + profile->block_base[f];
+        for (size_t i = 0; i < g->nloops; i++) {
+            const IRLoop *loop = &g->loops[i];
+            if (!ir_loop_blocks(g, loop, in_loop)) {
+                continue;
+            }
+
+            // copies of one source loop (the IR passes may duplicate one) report together
+            LoopStats *s = NULL;
+            for (size_t k = 0; k < nloops; k++) {
+                if (loops[k].loop->line == loop->line && loops[k].loop->col == loop->col) {
+                    s = &loops[k];
+                }
+            }
+            if (!s) {
+                s = &loops[nloops++];
+                s->loop = loop;
+            }
+
+            uint64_t entries = counts[loop->preheader];
+            uint64_t header = counts[loop->header];
+            s->entries += entries;
+            s->iterations += header > entries ? header - entries : 0;
+            for (size_t b = 0; b < g->nblocks; b++) {
+                if (in_loop[b]) {
+                    const IRBlock *bb = &g->blocks[b];
+                    s->instructions += counts[b] * (bb->nphis + bb->ninsts);
+                    s->ticks += block_ticks[b];
+                }
+            }
+        }
+    }
+    qsort(loops, nloops, sizeof(LoopStats), hotter_loop);
+
+    if (nloops) {
+        fprintf(out, "profile: %6s %-6s %10s %12s %14s %7s %9s\n", "loop", "kind", "entries", "iterations",
+                "instructions", "instrs", "time ms");
+    }
+    for (size_t i = 0; i < nloops && (!limit || i < limit); i++) {
+        const LoopStats *s = &loops[i];
+        fprintf(out, "profile: %6zu %-6s %10llu %12llu %14llu %6.1f%% %9.1f\n", s->loop->line,
+                s->loop->is_for ? "for" : "while", (unsigned long long)s->entries,
+                (unsigned long long)s->iterations, (unsigned long long)s->instructions,
+                total ? 100.0 * (double)s->instructions / (double)total : 0.0,
+                (double)s->ticks * tick_ms);
+    }
+    if (limit && nloops > limit) {
+        fprintf(out, "profile: ... %zu more loops\n", nloops - limit);
+    }
+    eidos_free(in_loop);
+    eidos_free(loops);
+}
+
+/*
+Writes folded stacks for flame graphs
+
+args:
+    *fn (IRFunction) -> profiled function
+    *profile (IRProfile) -> its counters
+    *name (char) -> root frame, the program's file name
+    *out (FILE) -> where to write
+*/
+void ir_profile_folded(const IRFunction *fn, const IRProfile *profile, const char *name, FILE *out) {
+    // one stack per executed instruction, merged after sorting
+    size_t nstacks = 0, cap = 0;
+    Stack *stacks = NULL;
+    for (size_t f = 0; f < profile->nfunctions; f++) {
+        const IRFunction *g = ir_profile_function(fn, f);
+        const uint64_t *counts = profile->block_counts + profile->block_base[f];
+        int *innermost = checked_calloc(g->nblocks, sizeof(int));
+        int *parent = checked_calloc(g->nloops, sizeof(int));
+        nest_loops(g, innermost, parent);
+
+        for (size_t b = 0; b < g->nblocks; b++) {
+            const IRBlock *bb = &g->blocks[b];
+            uint64_t count = counts[b];
+            if (bb->dead || !count) {
+                continue;
+            }
+
+            for (size_t k = 0; k <= bb->ninsts; k++) {
+                // k == ninsts stands for the block's phis
+                size_t line = k < bb->ninsts ? inst_line(g, bb, bb->insts[k]) : bb->line;
+                uint64_t weight = k < bb->ninsts ? count : count * bb->nphis;
+                if (!weight) {
+                    continue;
+                }
+                if (nstacks == cap) {
+                    cap = cap ? cap * 2 : 64;
+                    stacks = eidos_realloc(stacks, cap * sizeof(Stack));
+                    if (!stacks) {
+                        eidos_fatal("Failed to allocate profile");
+                    }
+                }
+                stacks[nstacks].text = stack_text(g, parent, innermost[b], name, line);
+                stacks[nstacks].weight = weight;
+                nstacks++;
+            }
+        }
+        eidos_free(parent);
+        eidos_free(innermost);
+    }
+
+    qsort(stacks, nstacks, sizeof(Stack), by_stack);
+    for (size_t i = 0; i < nstacks;) {
+        size_t j = i;
+        uint64_t weight = 0;
+        for (; j < nstacks && strcmp(stacks[j].text, stacks[i].text) == 0; j++) {
+            weight += stacks[j].weight;
+        }
+        fprintf(out, "%s %llu\n", stacks[i].text, (unsigned long long)weight);
+        i = j;
+    }
+
+    for (size_t i = 0; i < nstacks; i++) {
+        eidos_free(stacks[i].text);
+    }
+    eidos_free(stacks);
+}
+
+/*
+Frees the counters of a profile
+
+args:
+    *profile (IRProfile) -> profile from ir_profile_init
+*/
+void ir_profile_free(IRProfile *profile) {
+    eidos_free(profile->block_counts);
+    eidos_free(profile->block_ticks);
+    eidos_free(profile->loop_trips);
+    eidos_free(profile->header_loop);
+    eidos_free(profile->exit_loop);
+    eidos_free(profile->block_base);
+    eidos_free(profile->loop_base);
+    profile->block_base = NULL;
+    profile->loop_base = NULL;
+    profile->block_counts = NULL;
+    profile->block_ticks = NULL;
+    profile->loop_trips = NULL;
+    profile->header_loop = NULL;
+    profile->exit_loop = NULL;
+}
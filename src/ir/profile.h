@@ -0,0 +1,124 @@
+#pragma once
+
+/*
+Line-level execution profiler for the IR interpreter (--profile).
+
+A profiled run keeps two things per basic block: how often it was entered,
+counted by the interpreter as it enters it, and how many ticks of a 1 ms
+CPU-time timer (SIGPROF) landed while it was running. The timer and its
+handler are the process's, so they live in the eidos binary
+(driver/sampler.h); the library only counts. The interpreter only
+increments a counter and stores the current block id per block; nothing
+reads a clock per statement. The ticks split the CPU time of the whole run,
+measured once, between the blocks.
+
+Every instruction carries the source line of the token that started it, so
+after the run a block's counts are spread over the lines of its
+instructions: a line's instructions are the times each of its instructions
+ran, its executions the most often any of them ran, and its time the
+block's ticks shared out by instruction count. Loops add up the blocks they
+contain.
+
+Every function of the program has its own counters, one run of them per
+function after main's (block_base), so the blocks of a called function count
+each time it is called and report under the lines of its body. A loop counts
+the instructions of its own blocks only, not those of the functions it calls.
+
+The profile describes the optimized program, so lines that folding or the
+IR passes removed don't show up; --no-fold and --passes=none profile the
+program closer to how it is written. --profile always skips unrolling,
+which would split a statement's counts between its copies.
+*/
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "interp.h"
+#include "ir.h"
+
+// Interval of the sampling timer, in CPU time; the kernel may round it up
+#define IR_PROFILE_TICK_MS 1
+
+// Trip count buckets: 0, 1, 2-3, 4-7, ..., the last one takes everything above
+#define IR_TRIP_BUCKETS 16
+
+// Trip counts of one recorded loop, for --profile-gen
+typedef struct IRLoopTrips {
+    uint64_t current;                       // back edges taken since the loop was last entered
+    uint64_t buckets[IR_TRIP_BUCKETS];      // times the loop ran that many trips
+} IRLoopTrips;
+
+typedef struct IRProfile {
+    uint64_t *block_counts;     // times each block was entered, indexed by block_base[f] + block id
+    uint64_t *block_ticks;      // timer ticks that landed in each block
+    uint64_t ticks;             // all ticks, including those before the first block
+    volatile sig_atomic_t current_block;    // counter of the block running now, -1 outside the run
+    double run_ms;              // CPU time of the whole run
+    int sampled;                // 1 if the timer sampled the run, 0 if another profiled run had it
+
+    // per function f (ir_profile_function), where its counters start
+    size_t *block_base;
+    size_t *loop_base;          // ... in loop_trips
+    size_t nfunctions;          // main and every fn->funcs
+    size_t nblocks;             // counters over all functions
+
+    // trip counts, NULL unless asked for
+    IRLoopTrips *loop_trips;    // indexed by loop_base[f] + loop id
+    int *header_loop;           // per block counter, the loop (of its function) it is the header of, -1 if none
+    int *exit_loop;             // per block counter, the loop it is the exit of, -1 if none
+} IRProfile;
+
+// Function f of a profile: 0 is the program itself, f is fn->funcs[f - 1]
+static inline const IRFunction *ir_profile_function(const IRFunction *fn, size_t f) {
+    return f ? fn->funcs[f - 1] : fn;
+}
+
+static inline size_t ir_trip_bucket(uint64_t trips) {
+    size_t bucket = 0;
+    while (trips && bucket < IR_TRIP_BUCKETS - 1) {
+        trips >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+
+/* ========== Public API Functions ========== */
+
+/*
+Sets up zeroed counters for every function of fn, with loop trip counts if
+`trips` is 1, ready for ir_interpret_profiled. The profile must be freed
+with ir_profile_free.
+*/
+void ir_profile_init(const IRFunction *fn, int trips, IRProfile *profile);
+
+/*
+Runs fn like ir_interpret while counting it: block counters (and trip
+counts) only, no ticks and no run time, so the counts of a run are all it
+has and they are the same every time. sampler_run (driver/sampler.h) adds
+the sampling timer.
+*/
+int ir_profile_count(const IRFunction *fn, FILE *in, FILE *out, IRExecStats *stats, int trips,
+                     IRProfile *profile);
+
+/*
+Prints the hot-lines report: every line that ran, the hottest first, with
+its source text, then every loop. `source` may be NULL, `limit` caps the
+number of lines (0 for all).
+*/
+void ir_profile_report(const IRFunction *fn, const IRProfile *profile, const char *source,
+                       size_t limit, FILE *out);
+
+/*
+Writes the profile as folded stacks ("prog.e;for:3;line 5 1200"), one per
+line of code and chain of loops around it, weighted by instructions
+executed. The lines of a function come under a frame of its name
+("prog.e;fn:square;line 2 40"). This is the input format of flamegraph.pl and most flame graph
+viewers.
+*/
+void ir_profile_folded(const IRFunction *fn, const IRProfile *profile, const char *name, FILE *out);
+
+/*
+Releases the counters of a profile
+*/
+void ir_profile_free(IRProfile *profile);
@@ -0,0 +1,389 @@
+#include "passes.h"
+#include "../util/context.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+Sparse conditional constant propagation.
+
+Values start optimistic (TOP) and only ever move down the lattice
+TOP -> CONST -> BOTTOM. Blocks are only evaluated once an edge into them is
+known to execute, so a branch on a constant keeps the dead arm from polluting
+the phis it joins into.
+*/
+
+enum { LAT_TOP, LAT_CONST, LAT_BOTTOM };
+
+typedef struct Lattice {
+    int state;
+    int64_t value;      // valid when state == LAT_CONST
+} Lattice;
+
+typedef struct Edge {
+    int from;
+    int to;
+} Edge;
+
+typedef struct SCCP {
+    IRFunction *fn;
+    Lattice *lat;           // per value
+
+    int *user_start;        // CSR of users: value -> users[user_start[v] .. user_start[v+1])
+    int *users;             // >= 0 an instruction, < 0 the terminator of block -(u + 1)
+
+    char *block_exec;       // per block
+    char **edge_exec;       // per block, per predecessor index
+
+    Edge *flow;             // CFG worklist
+    size_t nflow, flow_cap;
+    int *ssa;               // SSA worklist
+    size_t nssa, ssa_cap;
+} SCCP;
+
+/* ===== Helper Functions ===== */
+
+static void *xmalloc(size_t size) {
+    void *p = eidos_calloc(1, size ? size : 1);
+    if (!p) {
+        eidos_fatal("Failed to allocate SCCP state");
+    }
+    return p;
+}
+
+static void push_flow(SCCP *s, int from, int to) {
+    if (s->nflow == s->flow_cap) {
+        s->flow_cap = s->flow_cap ? s->flow_cap * 2 : 64;
+        s->flow = eidos_realloc(s->flow, s->flow_cap * sizeof(Edge));
+        if (!s->flow) {
+            eidos_fatal("Failed to allocate SCCP worklist");
+        }
+    }
+    s->flow[s->nflow].from = from;
+    s->flow[s->nflow].to = to;
+    s->nflow++;
+}
+
+static void push_ssa(SCCP *s, int value) {
+    if (s->nssa == s->ssa_cap) {
+        s->ssa_cap = s->ssa_cap ? s->ssa_cap * 2 : 64;
+        s->ssa = eidos_realloc(s->ssa, s->ssa_cap * sizeof(int));
+        if (!s->ssa) {
+            eidos_fatal("Failed to allocate SCCP worklist");
+        }
+    }
+    s->ssa[s->nssa++] = value;
+}
+
+/*
+Lowers a value's lattice cell, queueing its users if it moved
+*/
+static void set_lattice(SCCP *s, int v, int state, int64_t value) {
+    Lattice *l = &s->lat[v];
+
+    if (l->state == LAT_BOTTOM || state == LAT_TOP) {
+        return;
+    }
+    if (l->state == LAT_CONST) {
+        if (state == LAT_CONST && value == l->value) {
+            return;
+        }
+        state = LAT_BOTTOM;     // a constant meeting anything else is BOTTOM
+    }
+
+    l->state = state;
+    l->value = value;
+    push_ssa(s, v);
+}
+
+/*
+Builds the users table in compressed form
+*/
+static void build_users(SCCP *s) {
+    IRFunction *fn = s->fn;
+    s->user_start = xmalloc((fn->ninsts + 1) * sizeof(int));
+
+    // first count, then fill
+    for (int pass = 0; pass < 2; pass++) {
+        int *fill = pass ? xmalloc((fn->ninsts + 1) * sizeof(int)) : NULL;
+        if (pass) {
+            memcpy(fill, s->user_start, (fn->ninsts + 1) * sizeof(int));
+        }
+
+        for (size_t i = 0; i < fn->nblocks; i++) {
+            IRBlock *bb = &fn->blocks[i];
+            if (bb->dead) {
+                continue;
+            }
+
+            for (int list = 0; list < 2; list++) {
+                int *vals = list ? bb->insts : bb->phis;
+                size_t n = list ? bb->ninsts : bb->nphis;
+
+                for (size_t k = 0; k < n; k++) {
+                    IRInst *in = &fn->insts[vals[k]];
+                    for (size_t o = 0; o < ir_num_operands(in); o++) {
+                        int op = *ir_operand(in, o);
+                        if (pass) {
+                            s->users[fill[op]++] = vals[k];
+                        } else {
+                            s->user_start[op + 1]++;
+                        }
+                    }
+                }
+            }
+
+            if (bb->term == TERM_BR) {
+                if (pass) {
+                    s->users[fill[bb->cond]++] = -(bb->id + 1);
+                } else {
+                    s->user_start[bb->cond + 1]++;
+                }
+            }
+        }
+
+        if (!pass) {
+            for (size_t v = 0; v < fn->ninsts; v++) {
+                s->user_start[v + 1] += s->user_start[v];
+            }
+            s->users = xmalloc(s->user_start[fn->ninsts] * sizeof(int));
+        }
+        eidos_free(fill);
+    }
+}
+
+static void visit_phi(SCCP *s, int v) {
+    IRInst *in = &s->fn->insts[v];
+    char *exec = s->edge_exec[in->block];
+
+    for (size_t i = 0; i < in->nphi; i++) {
+        if (!exec[i]) {
+            continue;
+        }
+        Lattice *arg = &s->lat[in->phi_args[i]];
+        if (arg->state != LAT_TOP) {
+            set_lattice(s, v, arg->state, arg->value);
+        }
+    }
+}
+
+static void visit_inst(SCCP *s, int v) {
+    IRInst *in = &s->fn->insts[v];
+
+    switch (in->op) {
+    case IR_CONST:
+        set_lattice(s, v, LAT_CONST, in->imm);
+        return;
+    case IR_READ:
+    case IR_LOAD:
+    case IR_PARAM:
+    case IR_CALL:
+        set_lattice(s, v, LAT_BOTTOM, 0);
+        return;
+    case IR_PRINT:
+    case IR_STORE:
+    case IR_RETURN:
+        return;
+    default:
+        break;
+    }
+
+    Lattice *a = &s->lat[in->a];
+    Lattice *b = in->b >= 0 ? &s->lat[in->b] : NULL;
+
+    if (a->state == LAT_BOTTOM || (b && b->state == LAT_BOTTOM)) {
+        set_lattice(s, v, LAT_BOTTOM, 0);
+        return;
+    }
+    if (a->state == LAT_TOP || (b && b->state == LAT_TOP)) {
+        return;
+    }
+
+    int64_t result = 0;
+    switch (in->op) {
+    case IR_ADD:  result = eidos_add(a->value, b->value); break;
+    case IR_SUB:  result = eidos_sub(a->value, b->value); break;
+    case IR_MUL:  result = eidos_mul(a->value, b->value); break;
+    case IR_NEG:  result = eidos_neg(a->value); break;
+    case IR_NOT:  result = eidos_not(a->value); break;
+    case IR_COPY: result = a->value; break;
+    case IR_CMP:  result = eidos_compare((CmpOp)in->imm, a->value, b->value); break;
+    case IR_DIV:
+        if (b->value == 0) {
+            set_lattice(s, v, LAT_BOTTOM, 0);   // the trap has to happen at run time
+            return;
+        }
+        result = eidos_div(a->value, b->value);
+        break;
+    default:
+        set_lattice(s, v, LAT_BOTTOM, 0);
+        return;
+    }
+
+    set_lattice(s, v, LAT_CONST, result);
+}
+
+static void visit_term(SCCP *s, int block) {
+    IRBlock *bb = &s->fn->blocks[block];
+
+    switch (bb->term) {
+    case TERM_JMP:
+        push_flow(s, block, bb->succ[0]);
+        break;
+    case TERM_BR: {
+        Lattice *c = &s->lat[bb->cond];
+        if (c->state == LAT_CONST) {
+            push_flow(s, block, bb->succ[c->value != 0 ? 0 : 1]);
+        } else if (c->state == LAT_BOTTOM) {
+            push_flow(s, block, bb->succ[0]);
+            push_flow(s, block, bb->succ[1]);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static void visit_block(SCCP *s, int block) {
+    IRBlock *bb = &s->fn->blocks[block];
+
+    for (size_t i = 0; i < bb->nphis; i++) {
+        visit_phi(s, bb->phis[i]);
+    }
+    for (size_t i = 0; i < bb->ninsts; i++) {
+        visit_inst(s, bb->insts[i]);
+    }
+    visit_term(s, block);
+}
+
+/*
+Marks an edge executable, evaluating the target the first time it's reached
+
+args:
+    *s (SCCP) -> solver state
+    e (Edge) -> the edge
+*/
+static void visit_edge(SCCP *s, Edge e) {
+    IRBlock *to = &s->fn->blocks[e.to];
+    int fresh = 0;
+
+    for (size_t i = 0; i < to->npreds; i++) {
+        if (to->preds[i] == e.from && !s->edge_exec[e.to][i]) {
+            s->edge_exec[e.to][i] = 1;
+            fresh = 1;
+        }
+    }
+    if (!fresh) {
+        return;
+    }
+
+    if (!s->block_exec[e.to]) {
+        s->block_exec[e.to] = 1;
+        visit_block(s, e.to);
+    } else {
+        // only the phis can see a new incoming edge
+        for (size_t i = 0; i < to->nphis; i++) {
+            visit_phi(s, to->phis[i]);
+        }
+    }
+}
+
+
+/* ========== PUBLIC API ========== */
+
+/*
+Sparse conditional constant propagation
+
+args:
+    *fn (IRFunction) -> function to rewrite
+
+returns:
+    (size_t) -> number of values made constant plus branches resolved
+*/
+size_t ir_pass_sccp(IRFunction *fn) {
+    SCCP s;
+    memset(&s, 0, sizeof(s));
+    s.fn = fn;
+    s.lat = xmalloc(fn->ninsts * sizeof(Lattice));
+    s.block_exec = xmalloc(fn->nblocks);
+    s.edge_exec = xmalloc(fn->nblocks * sizeof(char*));
+    for (size_t i = 0; i < fn->nblocks; i++) {
+        s.edge_exec[i] = xmalloc(fn->blocks[i].npreds);
+    }
+    build_users(&s);
+
+    s.block_exec[fn->entry] = 1;
+    visit_block(&s, fn->entry);
+
+    while (s.nflow || s.nssa) {
+        if (s.nflow) {
+            visit_edge(&s, s.flow[--s.nflow]);
+            continue;
+        }
+
+        int v = s.ssa[--s.nssa];
+        for (int u = s.user_start[v]; u < s.user_start[v + 1]; u++) {
+            int user = s.users[u];
+            if (user < 0) {
+                if (s.block_exec[-user - 1]) {
+                    visit_term(&s, -user - 1);
+                }
+                continue;
+            }
+
+            IRInst *in = &fn->insts[user];
+            if (!s.block_exec[in->block]) {
+                continue;
+            }
+            if (in->op == IR_PHI) {
+                visit_phi(&s, user);
+            } else {
+                visit_inst(&s, user);
+            }
+        }
+    }
+
+    // rewrite what was proven
+    size_t changes = 0;
+
+    for (size_t v = 0; v < fn->ninsts; v++) {
+        IRInst *in = &fn->insts[v];
+        if (in->block < 0 || in->op == IR_CONST || s.lat[v].state != LAT_CONST) {
+            continue;
+        }
+        ir_make_const(fn, (int)v, s.lat[v].value);
+        changes++;
+    }
+
+    for (size_t i = 0; i < fn->nblocks; i++) {
+        IRBlock *bb = &fn->blocks[i];
+        if (bb->dead || !s.block_exec[i] || bb->term != TERM_BR || s.lat[bb->cond].state != LAT_CONST) {
+            continue;
+        }
+
+        int taken = bb->succ[s.lat[bb->cond].value != 0 ? 0 : 1];
+        int other = bb->succ[s.lat[bb->cond].value != 0 ? 1 : 0];
+        if (other != taken) {
+            ir_remove_edge(fn, bb->id, other);
+        }
+
+        bb->term = TERM_JMP;
+        bb->cond = -1;
+        bb->succ[0] = taken;
+        bb->succ[1] = -1;
+        changes++;
+    }
+
+    for (size_t i = 0; i < fn->nblocks; i++) {
+        eidos_free(s.edge_exec[i]);
+    }
+    eidos_free(s.edge_exec);
+    eidos_free(s.block_exec);
+    eidos_free(s.lat);
+    eidos_free(s.user_start);
+    eidos_free(s.users);
+    eidos_free(s.flow);
+    eidos_free(s.ssa);
+
+    return changes;
+}
@@ -0,0 +1,277 @@
+#include "passes.h"
+#include "../util/context.h"
+#include <stdlib.h>
+
+/*
+Induction-variable strength reduction.
+
+A basic induction variable is a header phi `i = phi [init, preheader],
+[i + c, latch]` with a constant step c (possibly added in several pieces), which is what `for (i = a; ...; i++)`
+lowers to. For every `i * k` inside the loop with k invariant, a new phi
+
+    j = phi [init * k, preheader], [j + c * k, latch]
+
+tracks the product and the multiplication becomes a copy of j. Products of
+i plus a constant, which unrolled loops are full of, become j plus a constant.
+Wrapping arithmetic is a ring, so j equals i * k on every iteration even on
+overflow.
+*/
+
+/* ===== Helper Functions ===== */
+
+// a reduced product phi * factor, shared by every use of the same factor
+typedef struct Reduced {
+    int factor;
+    int value;          // the new phi
+} Reduced;
+
+static int const_operand(const IRFunction *fn, int v, int64_t *value) {
+    if (fn->insts[v].op != IR_CONST) {
+        return 0;
+    }
+    *value = fn->insts[v].imm;
+    return 1;
+}
+
+// equal ids, or two constants with the same value (unrolled copies have their own)
+static int same_value(const IRFunction *fn, int a, int b) {
+    int64_t x, y;
+    return a == b || (const_operand(fn, a, &x) && const_operand(fn, b, &y) && x == y);
+}
+
+/*
+Checks whether a value is the phi plus a constant, looking through chains
+like ((i + 1) + 1) that unrolled loops produce
+
+args:
+    *fn (IRFunction) -> function
+    phi (int) -> induction variable
+    v (int) -> value to look at
+    *offset (int64_t) -> output, v - phi
+
+returns:
+    (int) -> 1 if v is phi + *offset
+*/
+static int iv_offset(const IRFunction *fn, int phi, int v, int64_t *offset) {
+    int64_t total = 0;
+    int64_t c;
+
+    while (v != phi) {
+        const IRInst *in = &fn->insts[v];
+        if (in->op == IR_ADD && const_operand(fn, in->b, &c)) {
+            v = in->a;
+        } else if (in->op == IR_ADD && const_operand(fn, in->a, &c)) {
+            v = in->b;
+        } else if (in->op == IR_SUB && const_operand(fn, in->b, &c)) {
+            c = eidos_neg(c);
+            v = in->a;
+        } else {
+            return 0;
+        }
+        total = eidos_add(total, c);
+    }
+
+    *offset = total;
+    return 1;
+}
+
+/*
+Recognizes a basic induction variable
+
+args:
+    *fn (IRFunction) -> function
+    *loop (IRLoop) -> loop whose header holds the phi
+    phi (int) -> header phi
+    *step (int64_t) -> output, amount added per iteration
+
+returns:
+    (int) -> 1 if phi is a basic induction variable
+*/
+static int induction_step(const IRFunction *fn, const IRLoop *loop, int phi, int64_t *step) {
+    const IRBlock *header = &fn->blocks[loop->header];
+    const IRInst *p = &fn->insts[phi];
+    if (p->nphi != 2) {
+        return 0;
+    }
+
+    int next = p->phi_args[header->preds[0] == loop->latch ? 0 : 1];
+    return next != phi && iv_offset(fn, phi, next, step);
+}
+
+/*
+factor * c, computed in the preheader
+
+returns:
+    (int) -> value id
+*/
+static int scaled(IRFunction *fn, const IRLoop *loop, int factor, int64_t c) {
+    int64_t k;
+    if (const_operand(fn, factor, &k)) {
+        return ir_emit(fn, loop->preheader, IR_CONST, -1, -1, eidos_mul(c, k));
+    }
+    int cv = ir_emit(fn, loop->preheader, IR_CONST, -1, -1, c);
+    return ir_emit(fn, loop->preheader, IR_MUL, factor, cv, 0);
+}
+
+/*
+Creates the induction variable j = phi * factor
+
+args:
+    *fn (IRFunction) -> function
+    *loop (IRLoop) -> loop being reduced
+    phi (int) -> basic induction variable
+    step (int64_t) -> its step
+    factor (int) -> loop-invariant multiplier
+    *at (IRInst) -> instruction whose position the new values take
+
+returns:
+    (int) -> the new phi
+*/
+static int new_product(IRFunction *fn, const IRLoop *loop, int phi, int64_t step, int factor,
+                       const IRInst *at) {
+    int from_pre = fn->blocks[loop->header].preds[0] == loop->preheader ? 0 : 1;
+    int init = fn->insts[phi].phi_args[from_pre];
+    size_t line = at->line, col = at->col;
+
+    int start = ir_emit(fn, loop->preheader, IR_MUL, init, factor, 0);
+    int delta = scaled(fn, loop, factor, step);
+    int j = ir_new_phi(fn, loop->header);
+    int next = ir_emit(fn, loop->latch, IR_ADD, j, delta, 0);
+
+    int *args = eidos_malloc(2 * sizeof(int));
+    if (!args) {
+        eidos_fatal("Failed to allocate phi arguments");
+    }
+    args[from_pre] = start;
+    args[1 - from_pre] = next;
+    fn->insts[j].phi_args = args;
+    fn->insts[j].nphi = 2;
+
+    fn->insts[j].line = fn->insts[start].line = fn->insts[next].line = line;
+    fn->insts[j].col = fn->insts[start].col = fn->insts[next].col = col;
+    return j;
+}
+
+/*
+Rewrites `mul` = (phi + offset) * factor to j + offset * factor
+
+args:
+    *fn (IRFunction) -> function
+    *loop (IRLoop) -> loop being reduced
+    j (int) -> phi * factor
+    mul (int) -> the multiplication
+    factor (int) -> loop-invariant operand of the multiplication
+    offset (int64_t) -> distance of the other operand from the phi
+*/
+static void reduce(IRFunction *fn, const IRLoop *loop, int j, int mul, int factor, int64_t offset) {
+    if (offset == 0) {
+        // a rename of j, copy propagation forwards it
+        fn->insts[mul].op = IR_COPY;
+        fn->insts[mul].a = j;
+        fn->insts[mul].b = -1;
+        return;
+    }
+
+    int bias = scaled(fn, loop, factor, offset);
+    fn->insts[mul].op = IR_ADD;
+    fn->insts[mul].a = j;
+    fn->insts[mul].b = bias;
+}
+
+static size_t reduce_loop(IRFunction *fn, const IRLoop *loop, char *in_loop, int *blocks) {
+    size_t nblocks = ir_loop_body(fn, loop, in_loop, blocks);
+    if (!nblocks) {
+        return 0;
+    }
+
+    size_t reduced = 0;
+    Reduced *products = NULL;
+    size_t nproducts = 0;
+    // new_product() adds phis to the header, only look at the ones that were there
+    size_t nphis = fn->blocks[loop->header].nphis;
+
+    for (size_t p = 0; p < nphis; p++) {
+        int phi = fn->blocks[loop->header].phis[p];
+        int64_t step;
+        if (!induction_step(fn, loop, phi, &step)) {
+            continue;
+        }
+        nproducts = 0;
+
+        for (size_t i = 0; i < nblocks; i++) {
+            const IRBlock *bb = &fn->blocks[blocks[i]];
+            for (size_t k = 0; k < bb->ninsts; k++) {
+                int v = bb->insts[k];
+                IRInst in = fn->insts[v];
+                if (in.op != IR_MUL) {
+                    continue;
+                }
+
+                int64_t offset;
+                int factor;
+                if (!in_loop[fn->insts[in.b].block] && iv_offset(fn, phi, in.a, &offset)) {
+                    factor = in.b;
+                } else if (!in_loop[fn->insts[in.a].block] && iv_offset(fn, phi, in.b, &offset)) {
+                    factor = in.a;
+                } else {
+                    continue;
+                }
+
+                int j = -1;
+                for (size_t r = 0; r < nproducts && j < 0; r++) {
+                    if (same_value(fn, products[r].factor, factor)) {
+                        j = products[r].value;
+                    }
+                }
+                if (j < 0) {
+                    j = new_product(fn, loop, phi, step, factor, &in);
+                    products = eidos_realloc(products, (nproducts + 1) * sizeof(Reduced));
+                    if (!products) {
+                        eidos_fatal("Failed to allocate strength reduction state");
+                    }
+                    products[nproducts].factor = factor;
+                    products[nproducts].value = j;
+                    nproducts++;
+                }
+
+                reduce(fn, loop, j, v, factor, offset);
+                reduced++;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < nblocks; i++) {
+        in_loop[blocks[i]] = 0;
+    }
+    eidos_free(products);
+    return reduced;
+}
+
+
+/* ========== PUBLIC API ========== */
+
+/*
+Induction-variable strength reduction
+
+args:
+    *fn (IRFunction) -> function to rewrite
+
+returns:
+    (size_t) -> number of multiplications replaced
+*/
+size_t ir_pass_strength_reduction(IRFunction *fn) {
+    char *in_loop = eidos_calloc(fn->nblocks ? fn->nblocks : 1, 1);
+    int *blocks = eidos_malloc((fn->nblocks ? fn->nblocks : 1) * sizeof(int));
+    if (!in_loop || !blocks) {
+        eidos_fatal("Failed to allocate loop state");
+    }
+
+    size_t reduced = 0;
+    for (size_t i = 0; i < fn->nloops; i++) {
+        reduced += reduce_loop(fn, &fn->loops[i], in_loop, blocks);
+    }
+
+    eidos_free(blocks);
+    eidos_free(in_loop);
+    return reduced;
+}
@@ -0,0 +1,72 @@
+#include "passes.h"
+#include "../util/context.h"
+#include <stdlib.h>
+
+/* ========== PUBLIC API ========== */
+
+/*
+Unreachable block removal
+
+args:
+    *fn (IRFunction) -> function to rewrite
+
+returns:
+    (size_t) -> number of blocks removed
+*/
+size_t ir_pass_unreachable_blocks(IRFunction *fn) {
+    char *reached = eidos_calloc(fn->nblocks ? fn->nblocks : 1, 1);
+    int *stack = eidos_malloc((fn->nblocks ? fn->nblocks : 1) * sizeof(int));
+    if (!reached || !stack) {
+        eidos_fatal("Failed to allocate reachability state");
+    }
+
+    // depth first walk from the entry
+    size_t top = 0;
+    stack[top++] = fn->entry;
+    reached[fn->entry] = 1;
+
+    while (top) {
+        IRBlock *bb = &fn->blocks[stack[--top]];
+        for (int i = 0; i < 2; i++) {
+            int succ = bb->succ[i];
+            if (succ >= 0 && !reached[succ]) {
+                reached[succ] = 1;
+                stack[top++] = succ;
+            }
+        }
+    }
+
+    size_t removed = 0;
+
+    for (size_t i = 0; i < fn->nblocks; i++) {
+        IRBlock *bb = &fn->blocks[i];
+        if (bb->dead || reached[i]) {
+            continue;
+        }
+
+        // detach from live successors first so their phis lose the argument
+        for (int s = 0; s < 2; s++) {
+            if (bb->succ[s] >= 0 && reached[bb->succ[s]]) {
+                ir_remove_edge(fn, bb->id, bb->succ[s]);
+            }
+        }
+
+        while (bb->nphis) {
+            ir_delete_inst(fn, bb->phis[bb->nphis - 1]);
+        }
+        while (bb->ninsts) {
+            ir_delete_inst(fn, bb->insts[bb->ninsts - 1]);
+        }
+
+        bb->npreds = 0;
+        bb->term = TERM_NONE;
+        bb->succ[0] = -1;
+        bb->succ[1] = -1;
+        bb->dead = 1;
+        removed++;
+    }
+
+    eidos_free(stack);
+    eidos_free(reached);
+    return removed;
+}
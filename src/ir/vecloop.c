@@ -0,0 +1,311 @@
+#include "vecloop.h"
+#include "../util/context.h"
+#include <stdlib.h>
+#include <string.h>
+
+// index offsets beyond this are not worth tracking, and keep the backend's bound checks from overflowing
+#define VEC_MAX_OFFSET ((int64_t)1 << 32)
+
+/* ===== Helper Functions ===== */
+
+/*
+Adds an access unless the loop already has it
+*/
+static void add_access(IRVecLoop *vec, int array, int64_t offset, size_t *cap) {
+    for (size_t i = 0; i < vec->naccesses; i++) {
+        if (vec->accesses[i].array == array && vec->accesses[i].offset == offset) {
+            return;
+        }
+    }
+    if (vec->naccesses == *cap) {
+        *cap = *cap ? *cap * 2 : 8;
+        vec->accesses = eidos_realloc(vec->accesses, *cap * sizeof(IRVecAccess));
+        if (!vec->accesses) {
+            eidos_fatal("Failed to allocate loop analysis");
+        }
+    }
+    vec->accesses[vec->naccesses].array = array;
+    vec->accesses[vec->naccesses].offset = offset;
+    vec->naccesses++;
+}
+
+/*
+Classifies an addition or subtraction: an index stays an index when a
+constant is added to it
+
+args:
+    *fn (IRFunction) -> function
+    *vec (IRVecLoop) -> loop being checked, kind and offset of the operands set
+    *in (IRInst) -> IR_ADD or IR_SUB
+    *offset (int64_t) -> receives the offset of an index
+
+returns:
+    (IRVecKind) -> kind of the result
+*/
+static IRVecKind add_kind(const IRFunction *fn, const IRVecLoop *vec, const IRInst *in, int64_t *offset) {
+    IRVecKind ka = (IRVecKind)vec->kind[in->a];
+    IRVecKind kb = (IRVecKind)vec->kind[in->b];
+    const IRInst *a = &fn->insts[in->a];
+    const IRInst *b = &fn->insts[in->b];
+    int64_t base, c;
+
+    if (ka == VEC_OUTSIDE && kb == VEC_OUTSIDE) {
+        return VEC_OUTSIDE;
+    }
+    if (ka == VEC_INDEX && b->op == IR_CONST) {
+        base = vec->offset[in->a];
+        c = in->op == IR_ADD ? b->imm : -b->imm;
+    } else if (in->op == IR_ADD && kb == VEC_INDEX && a->op == IR_CONST) {
+        base = vec->offset[in->b];
+        c = a->imm;
+    } else {
+        return VEC_LANES;
+    }
+    if (c < -VEC_MAX_OFFSET || c > VEC_MAX_OFFSET || base + c < -VEC_MAX_OFFSET || base + c > VEC_MAX_OFFSET) {
+        return VEC_LANES;
+    }
+    *offset = base + c;
+    return VEC_INDEX;
+}
+
+/*
+Checks one loop
+
+args:
+    *fn (IRFunction) -> function
+    index (size_t) -> loop to check
+    *vec (IRVecLoop) -> filled in when it qualifies, kind and offset already allocated
+    *in_loop (char) -> scratch, one flag per block
+
+returns:
+    (int) -> 1 if the loop can run in vector kernels
+*/
+static int check_loop(const IRFunction *fn, size_t index, IRVecLoop *vec, char *in_loop) {
+    const IRLoop *loop = &fn->loops[index];
+
+    if (!loop->is_for || !ir_loop_blocks(fn, loop, in_loop)) {
+        return 0;
+    }
+    const IRBlock *pre = &fn->blocks[loop->preheader];
+    const IRBlock *header = &fn->blocks[loop->header];
+    if (pre->term != TERM_JMP || header->nphis != 1 || header->term != TERM_BR ||
+        !in_loop[header->succ[0]] || in_loop[header->succ[1]]) {
+        return 0;
+    }
+    int iv = header->phis[0];
+    int pre_edge = header->preds[0] == loop->preheader ? 0 : 1;
+    int init = fn->insts[iv].phi_args[pre_edge];
+    int next = fn->insts[iv].phi_args[1 - pre_edge];
+
+    // the header only compares, iv < bound or iv <= bound
+    const IRInst *cond = &fn->insts[header->cond];
+    if (header->ninsts != 1 || header->insts[0] != header->cond || cond->op != IR_CMP) {
+        return 0;
+    }
+    int bound;
+    CmpOp cmp = (CmpOp)cond->imm;
+    if (cond->a == iv && (cmp == CMP_LT || cmp == CMP_LE)) {
+        bound = cond->b;
+        vec->inclusive = cmp == CMP_LE;
+    } else if (cond->b == iv && (cmp == CMP_GT || cmp == CMP_GE)) {
+        bound = cond->a;
+        vec->inclusive = cmp == CMP_GE;
+    } else {
+        return 0;
+    }
+    if (in_loop[fn->insts[bound].block] || in_loop[fn->insts[init].block]) {
+        return 0;
+    }
+
+    // the body is a straight run of blocks from the header back to it
+    size_t loop_blocks = 0;
+    for (size_t b = 0; b < fn->nblocks; b++) {
+        loop_blocks += in_loop[b] != 0;
+    }
+    size_t cap = 0;
+    size_t chain = 1;
+    vec->nbody = 0;
+    for (int b = header->succ[0]; b != loop->header; b = fn->blocks[b].succ[0], chain++) {
+        const IRBlock *bb = &fn->blocks[b];
+        if (!in_loop[b] || chain > loop_blocks || bb->nphis || bb->term != TERM_JMP) {
+            return 0;
+        }
+        if (vec->nbody + bb->ninsts > cap) {
+            cap = (vec->nbody + bb->ninsts) * 2;
+            vec->body = eidos_realloc(vec->body, cap * sizeof(int));
+            if (!vec->body) {
+                eidos_fatal("Failed to allocate loop analysis");
+            }
+        }
+        memcpy(&vec->body[vec->nbody], bb->insts, bb->ninsts * sizeof(int));
+        vec->nbody += bb->ninsts;
+    }
+    if (chain != loop_blocks) {
+        return 0;
+    }
+
+    memset(vec->kind, VEC_OUTSIDE, fn->ninsts);
+    vec->kind[iv] = VEC_INDEX;
+    vec->offset[iv] = 0;
+
+    size_t access_cap = 0;
+    int stores = 0;
+    for (size_t k = 0; k < vec->nbody; k++) {
+        int v = vec->body[k];
+        IRInst *in = &fn->insts[v];
+        IRVecKind kind = VEC_OUTSIDE;
+
+        for (size_t o = 0; o < ir_num_operands(in); o++) {
+            int op = *ir_operand(in, o);
+            if (op == header->cond) {
+                return 0;
+            }
+            if (vec->kind[op] != VEC_OUTSIDE) {
+                kind = VEC_LANES;
+            }
+        }
+
+        switch (in->op) {
+        case IR_CONST:
+            break;
+        case IR_COPY:
+            kind = (IRVecKind)vec->kind[in->a];
+            vec->offset[v] = vec->offset[in->a];
+            break;
+        case IR_ADD:
+        case IR_SUB:
+            kind = add_kind(fn, vec, in, &vec->offset[v]);
+            break;
+        case IR_MUL:
+        case IR_NEG:
+        case IR_NOT:
+        case IR_CMP:
+            break;
+        case IR_LOAD:
+        case IR_STORE:
+            if (vec->kind[in->a] != VEC_INDEX) {
+                return 0;
+            }
+            add_access(vec, (int)in->imm, vec->offset[in->a], &access_cap);
+            kind = VEC_LANES;
+            stores += in->op == IR_STORE;
+            break;
+        default:
+            return 0;
+        }
+        vec->kind[v] = (char)kind;
+    }
+    if (!stores || vec->kind[next] != VEC_INDEX || vec->offset[next] != 1) {
+        return 0;
+    }
+
+    // an array the loop writes is read and written at one offset only
+    for (size_t k = 0; k < vec->nbody; k++) {
+        const IRInst *in = &fn->insts[vec->body[k]];
+        if (in->op != IR_STORE) {
+            continue;
+        }
+        for (size_t i = 0; i < vec->naccesses; i++) {
+            if (vec->accesses[i].array == in->imm && vec->accesses[i].offset != vec->offset[in->a]) {
+                return 0;
+            }
+        }
+    }
+
+    // nothing but the induction variable is used after it
+    for (size_t b = 0; b < fn->nblocks; b++) {
+        const IRBlock *bb = &fn->blocks[b];
+        if (in_loop[b] || bb->dead) {
+            continue;
+        }
+        for (size_t k = 0; k < bb->nphis + bb->ninsts; k++) {
+            int v = k < bb->nphis ? bb->phis[k] : bb->insts[k - bb->nphis];
+            IRInst *in = &fn->insts[v];
+            for (size_t o = 0; o < ir_num_operands(in); o++) {
+                int op = *ir_operand(in, o);
+                if (op != iv && in_loop[fn->insts[op].block]) {
+                    return 0;
+                }
+            }
+        }
+        if (bb->term == TERM_BR && bb->cond != iv && in_loop[fn->insts[bb->cond].block]) {
+            return 0;
+        }
+    }
+
+    vec->loop = (int)index;
+    vec->iv = iv;
+    vec->init = init;
+    vec->bound = bound;
+    return 1;
+}
+
+
+/* ========== PUBLIC API ========== */
+
+/*
+Finds the loops that can run in vector kernels
+
+args:
+    *fn (IRFunction) -> optimized function
+    **loops (IRVecLoop) -> receives the loops found
+
+returns:
+    (size_t) -> number of loops found
+*/
+size_t ir_find_vec_loops(const IRFunction *fn, IRVecLoop **loops) {
+    *loops = NULL;
+    if (!fn->nloops || !fn->narrays) {
+        return 0;
+    }
+
+    IRVecLoop *found = eidos_calloc(fn->nloops, sizeof(IRVecLoop));
+    char *in_loop = eidos_malloc(fn->nblocks);
+    if (!found || !in_loop) {
+        eidos_fatal("Failed to allocate loop analysis");
+    }
+    size_t count = 0;
+
+    for (size_t i = 0; i < fn->nloops; i++) {
+        IRVecLoop *vec = &found[count];
+        vec->kind = eidos_malloc(fn->ninsts);
+        vec->offset = eidos_malloc(fn->ninsts * sizeof(int64_t));
+        if (!vec->kind || !vec->offset) {
+            eidos_fatal("Failed to allocate loop analysis");
+        }
+        if (!check_loop(fn, i, vec, in_loop)) {
+            eidos_free(vec->body);
+            eidos_free(vec->kind);
+            eidos_free(vec->offset);
+            eidos_free(vec->accesses);
+            memset(vec, 0, sizeof(IRVecLoop));
+            continue;
+        }
+        count++;
+    }
+
+    eidos_free(in_loop);
+    if (!count) {
+        eidos_free(found);
+        return 0;
+    }
+    *loops = found;
+    return count;
+}
+
+/*
+Frees what ir_find_vec_loops returned
+
+args:
+    *loops (IRVecLoop) -> loops, may be NULL
+    count (size_t) -> number of loops
+*/
+void ir_free_vec_loops(IRVecLoop *loops, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        eidos_free(loops[i].body);
+        eidos_free(loops[i].kind);
+        eidos_free(loops[i].offset);
+        eidos_free(loops[i].accesses);
+    }
+    eidos_free(loops);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+/*
+Finds for loops over arrays that can run several iterations at a time in
+vector registers (the C backend's vector kernels).
+
+A loop qualifies when it is a straight run of blocks (no branch besides
+the loop condition) and, like a parallel loop (parloop.h), its header has a
+single phi, the induction variable, compared against a bound computed
+before the loop with < or <=. Here it must grow by exactly 1, so the
+iterations of a block of lanes touch consecutive elements.
+
+Every value of the body is one of
+- outside: computed before the loop, or from such values and constants
+  only, the same in every iteration;
+- index: the induction variable plus a constant;
+- lanes: anything else, one value per iteration.
+Every element access must be at an index value. An array the loop stores
+to must be accessed at the same offset everywhere in the loop, so an
+iteration never touches an element another iteration writes. Division,
+input and printing are left to the scalar loop, as is anything that could
+trap besides an out-of-bounds index; the backend checks the bounds of every
+access once for all vector iterations before it starts them.
+*/
+
+#include <stdint.h>
+#include "ir.h"
+
+typedef enum IRVecKind {
+    VEC_OUTSIDE,        // the same in every iteration
+    VEC_INDEX,          // induction variable + offset
+    VEC_LANES,          // differs per iteration
+} IRVecKind;
+
+// An array and an offset from the induction variable the loop accesses it at
+typedef struct IRVecAccess {
+    int array;
+    int64_t offset;
+} IRVecAccess;
+
+typedef struct IRVecLoop {
+    int loop;           // index into fn->loops
+    int iv;             // header phi, the induction variable
+    int init;           // its value on entry
+    int bound;          // value it is compared against
+    int inclusive;      // 1 for iv <= bound, 0 for iv < bound
+    int *body;          // instructions after the header, in execution order
+    size_t nbody;
+    char *kind;         // per value id, IRVecKind of the body's values and their operands
+    int64_t *offset;    // per value id, the offset of VEC_INDEX values
+    IRVecAccess *accesses;  // distinct (array, offset) pairs, checked once per array size
+    size_t naccesses;
+} IRVecLoop;
+
+
+/* ========== Public API Functions ========== */
+
+/*
+Finds the vectorizable loops of fn. Returns how many there are and sets
+*loops to them, NULL if none; free with ir_free_vec_loops.
+*/
+size_t ir_find_vec_loops(const IRFunction *fn, IRVecLoop **loops);
+
+void ir_free_vec_loops(IRVecLoop *loops, size_t count);
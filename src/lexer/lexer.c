@@ -1,4 +1,5 @@
 #include "lexer.h"
+#include "../util/context.h"
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -49,8 +50,6 @@ args:
     *l (Lexer) -> Lexer struct at pos
     type (TokenType) -> Lexeme's corresponding token
     *lexeme (char) -> the current lexeme
-    line (size_t) -> line of current lexeme/token
-    col (size_t) -> column of current lexeme/token
 
 returns: 
     t (TokenType) -> Newly created token from lexeme
@@ -59,8 +58,8 @@ static Token make_token(Lexer *l, TokenType type, const char *lexeme) {
     Token t;
     t.tokenType = type;    
     t.lexeme = lexeme;
-    t.line = l->line;
-    t.col = l->col;
+    t.line = l->tok_line;
+    t.col = l->tok_col;
     
     return t;
 }
@@ -74,8 +73,11 @@ args:
 */
 static char *build_lexeme(Lexer *l, size_t start) {
     size_t len = l->pos - start;
-    char *lexeme = malloc(len + 1);
-    strncpy(lexeme, l->src + start, len);
+    char *lexeme = eidos_malloc(len + 1);
+    if (!lexeme) {
+        eidos_fatal("Failed to allocate lexeme");
+    }
+    memcpy(lexeme, l->src + start, len);
     lexeme[len] = '\0';
     return lexeme;
 }
@@ -84,46 +86,12 @@ static char *build_lexeme(Lexer *l, size_t start) {
 Prints token information for debugging
 
 args:
+    *out (FILE) -> where to print
     *lexeme (char) -> Lexeme string
     type (TokenType) -> Token type
 */
-static void print_token_info(const char *lexeme, TokenType type) {
-    const char *token_name = "UNKNOWN";
-    
-    switch (type) {
-        case KEYWORD_PRINT: token_name = "KEYWORD_PRINT"; break;
-        case KEYWORD_READ: token_name = "KEYWORD_READ"; break;
-        case KEYWORD_FOR: token_name = "KEYWORD_FOR"; break;
-        case KEYWORD_LET: token_name = "KEYWORD_LET"; break;
-        case KEYWORD_WHILE: token_name = "KEYWORD_WHILE"; break;
-        case KEYWORD_IF: token_name = "KEYWORD_IF"; break;
-        case KEYWORD_ELSE: token_name = "KEYWORD_ELSE"; break;
-        case IDENTIFIER: token_name = "IDENTIFIER"; break;
-        case INT_LIT: token_name = "INT_LIT"; break;
-        case PLUS_OP: token_name = "PLUS_OP"; break;
-        case SUB_OP: token_name = "SUB_OP"; break;
-        case MULT_OP: token_name = "MULT_OP"; break;
-        case DIV_OP: token_name = "DIV_OP"; break;
-        case NOT_OP: token_name = "NOT_OP"; break;
-        case INC_OP: token_name = "INC_OP"; break;
-        case DEC_OP: token_name = "DEC_OP"; break;
-        case GREATER_OP: token_name = "GREATER_OP"; break;
-        case LESSER_OP: token_name = "LESSER_OP"; break;
-        case GEQUAL_OP: token_name = "GEQUAL_OP"; break;
-        case LEQUAL_OP: token_name = "LEQUAL_OP"; break;
-        case NEQUAL_OP: token_name = "NEQUAL_OP"; break;
-        case ASSIGN_OP: token_name = "ASSIGN_OP"; break;
-        case EQUAL_OP: token_name = "EQUAL_OP"; break;
-        case LEFT_PAREN: token_name = "LEFT_PAREN"; break;
-        case RIGHT_PAREN: token_name = "RIGHT_PAREN"; break;
-        case LEFT_CURL: token_name = "LEFT_CURL"; break;
-        case RIGHT_CURL: token_name = "RIGHT_CURL"; break;
-        case SEMICOLON: token_name = "SEMICOLON"; break;
-        case EOF_TOK: token_name = "EOF_TOK"; break;
-        default: token_name = "UNKNOWN"; break;
-    }
-    
-    printf("%s %s\n", lexeme, token_name);
+static void print_token_info(FILE *out, const char *lexeme, TokenType type) {
+    fprintf(out, "%s %s\n", lexeme, token_type_name(type));
 }
 
 /*
@@ -144,6 +112,8 @@ static TokenType classify_token(const char *lexeme) {
     if (strcmp(lexeme, "while") == 0) return KEYWORD_WHILE;
     if (strcmp(lexeme, "if") == 0) return KEYWORD_IF;
     if (strcmp(lexeme, "else") == 0) return KEYWORD_ELSE;
+    if (strcmp(lexeme, "fn") == 0) return KEYWORD_FN;
+    if (strcmp(lexeme, "return") == 0) return KEYWORD_RETURN;
     
     // Operators
     if (strcmp(lexeme, "+") == 0) return PLUS_OP;
@@ -166,7 +136,10 @@ static TokenType classify_token(const char *lexeme) {
     if (strcmp(lexeme, ")") == 0) return RIGHT_PAREN;
     if (strcmp(lexeme, "{") == 0) return LEFT_CURL;
     if (strcmp(lexeme, "}") == 0) return RIGHT_CURL;
+    if (strcmp(lexeme, "[") == 0) return LEFT_BRACKET;
+    if (strcmp(lexeme, "]") == 0) return RIGHT_BRACKET;
     if (strcmp(lexeme, ";") == 0) return SEMICOLON;
+    if (strcmp(lexeme, ",") == 0) return COMMA;
 
     
     // Check if it's a number
@@ -201,6 +174,58 @@ void init_lexer(Lexer *l, const char *src) {
     l->pos = 0;
     l->line = 1;
     l->col = 1;
+    l->tok_line = 1;
+    l->tok_col = 1;
+    l->trace = NULL;
+}
+
+/*
+Returns the printable name of a token type (e.g. "KEYWORD_LET")
+
+args:
+    type (TokenType) -> Token type
+
+returns:
+    (const char*) -> Static string naming the token type
+*/
+const char *token_type_name(TokenType type) {
+    switch (type) {
+        case KEYWORD_PRINT: return "KEYWORD_PRINT";
+        case KEYWORD_READ: return "KEYWORD_READ";
+        case KEYWORD_FOR: return "KEYWORD_FOR";
+        case KEYWORD_LET: return "KEYWORD_LET";
+        case KEYWORD_WHILE: return "KEYWORD_WHILE";
+        case KEYWORD_IF: return "KEYWORD_IF";
+        case KEYWORD_ELSE: return "KEYWORD_ELSE";
+        case KEYWORD_FN: return "KEYWORD_FN";
+        case KEYWORD_RETURN: return "KEYWORD_RETURN";
+        case IDENTIFIER: return "IDENTIFIER";
+        case INT_LIT: return "INT_LIT";
+        case PLUS_OP: return "PLUS_OP";
+        case SUB_OP: return "SUB_OP";
+        case MULT_OP: return "MULT_OP";
+        case DIV_OP: return "DIV_OP";
+        case NOT_OP: return "NOT_OP";
+        case INC_OP: return "INC_OP";
+        case DEC_OP: return "DEC_OP";
+        case GREATER_OP: return "GREATER_OP";
+        case LESSER_OP: return "LESSER_OP";
+        case GEQUAL_OP: return "GEQUAL_OP";
+        case LEQUAL_OP: return "LEQUAL_OP";
+        case NEQUAL_OP: return "NEQUAL_OP";
+        case ASSIGN_OP: return "ASSIGN_OP";
+        case EQUAL_OP: return "EQUAL_OP";
+        case LEFT_PAREN: return "LEFT_PAREN";
+        case RIGHT_PAREN: return "RIGHT_PAREN";
+        case LEFT_CURL: return "LEFT_CURL";
+        case RIGHT_CURL: return "RIGHT_CURL";
+        case LEFT_BRACKET: return "LEFT_BRACKET";
+        case RIGHT_BRACKET: return "RIGHT_BRACKET";
+        case SEMICOLON: return "SEMICOLON";
+        case COMMA: return "COMMA";
+        case EOF_TOK: return "EOF_TOK";
+        default: return "UNKNOWN";
+    }
 }
 
 
@@ -224,6 +249,10 @@ Token next_token(Lexer *l) {
     
     char curr_c = peek(l);
     size_t start = l->pos;
+
+    // tokens are stamped with where they start, not where they end
+    l->tok_line = l->line;
+    l->tok_col = l->col;
     
     // check for end of input
     if (curr_c == '\0') {
@@ -238,7 +267,9 @@ Token next_token(Lexer *l) {
         }
         char *lexeme = build_lexeme(l, start);
         TokenType type = classify_token(lexeme);
-        print_token_info(lexeme, type);
+        if (l->trace) {
+            print_token_info(l->trace, lexeme, type);
+        }
         Token t = make_token(l, type, lexeme);
         return t;
     }
@@ -250,7 +281,9 @@ Token next_token(Lexer *l) {
         }
         char *lexeme = build_lexeme(l, start);
         TokenType type = classify_token(lexeme);
-        print_token_info(lexeme, type);
+        if (l->trace) {
+            print_token_info(l->trace, lexeme, type);
+        }
         Token t = make_token(l, type, lexeme);
         return t;
     }
@@ -271,8 +304,51 @@ Token next_token(Lexer *l) {
     
     char *lexeme = build_lexeme(l, start);
     TokenType type = classify_token(lexeme);
-    print_token_info(lexeme, type);
+    if (l->trace) {
+        print_token_info(l->trace, lexeme, type);
+    }
     Token t = make_token(l, type, lexeme);
     return t;
 }
 
+
+/*
+Lexes the rest of the source into a buffer
+
+args:
+    *l (Lexer) -> Lexer instance
+    *buffer (TokenBuffer) -> receives the tokens, up to and including EOF_TOK
+*/
+void lex_all(Lexer *l, TokenBuffer *buffer) {
+    buffer->tokens = NULL;
+    buffer->count = 0;
+    buffer->cap = 0;
+
+    Token t;
+    do {
+        t = next_token(l);
+        if (buffer->count == buffer->cap) {
+            buffer->cap = buffer->cap ? buffer->cap * 2 : 1024;
+            buffer->tokens = eidos_realloc(buffer->tokens, buffer->cap * sizeof(Token));
+            if (!buffer->tokens) {
+                eidos_fatal("Failed to allocate token buffer");
+            }
+        }
+        buffer->tokens[buffer->count++] = t;
+    } while (t.tokenType != EOF_TOK);
+}
+
+/*
+Frees the tokens of a buffer and their lexemes
+
+args:
+    *buffer (TokenBuffer) -> buffer filled by lex_all
+*/
+void token_buffer_free(TokenBuffer *buffer) {
+    for (size_t i = 0; i < buffer->count; i++) {
+        eidos_free((void *)buffer->tokens[i].lexeme);
+    }
+    eidos_free(buffer->tokens);
+    buffer->tokens = NULL;
+    buffer->count = 0;
+}
@@ -6,6 +6,7 @@ Simple Finite State Automata will be used to move between strings and convert le
 */
 
 #include <stddef.h>
+#include <stdio.h>
 
 // token types for this compiler
 typedef enum TokenType {
@@ -16,6 +17,8 @@ typedef enum TokenType {
     KEYWORD_WHILE,      // while
     KEYWORD_IF,         // if 
     KEYWORD_ELSE,       // else
+    KEYWORD_FN,         // fn
+    KEYWORD_RETURN,     // return
     IDENTIFIER,         // a, d, counter, x, y, z
     INT_LIT,            // 1,2,3,234,5432345
     PLUS_OP,            // +
@@ -36,7 +39,10 @@ typedef enum TokenType {
     RIGHT_PAREN,        // )
     LEFT_CURL,          // {
     RIGHT_CURL,         // }
+    LEFT_BRACKET,       // [
+    RIGHT_BRACKET,      // ]
     SEMICOLON,          // ;
+    COMMA,              // ,
     EOF_TOK,            // End-of-File
     UNKNOWN,            // Unknown token
 } TokenType;
@@ -54,8 +60,18 @@ typedef struct Lexer {
     size_t pos;             // position of lexer 
     size_t line;            // current line
     size_t col;             // current column
+    size_t tok_line;        // line where the token being built starts
+    size_t tok_col;         // column where the token being built starts
+    FILE *trace;            // where every lexeme/token pair is printed as it is scanned, NULL for nowhere
 } Lexer;
 
+// every token of a source, lexed ahead of parsing (parser/parallel.h)
+typedef struct TokenBuffer {
+    Token *tokens;          // the last one is EOF_TOK
+    size_t count;
+    size_t cap;
+} TokenBuffer;
+
 
 /* ========== Public API Functions ========== */
 
@@ -70,3 +86,15 @@ Processes the next lexeme and returns the token
 all the the request of the Syntax Parser
 */
 Token next_token(Lexer *l);
+
+/*
+Returns the printable name of a token type, used for tracing and diagnostics
+*/
+const char *token_type_name(TokenType type);
+
+/*
+Lexes everything left into `buffer`, which owns the lexemes until
+token_buffer_free
+*/
+void lex_all(Lexer *l, TokenBuffer *buffer);
+void token_buffer_free(TokenBuffer *buffer);
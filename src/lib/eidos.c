@@ -0,0 +1,490 @@
+#include "eidos.h"
+#include "pipeline.h"
+#include "../util/context.h"
+#include "../lexer/lexer.h"
+#include "../ir/profile.h"
+#include "../codegen/c_backend.h"
+#include "../bytecode/bytecode.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+The pipeline of the eidos binary (main.c, both run pipeline.h) behind the
+library API: parse, check, fold, unroll, precompute, hash-cons, lower to
+SSA, run the passes and emit the requested target.
+
+Compiler modules allocate through the context (util/context.h), so an
+abandoned compilation is cleaned up by releasing the context's live blocks.
+The exceptions are the stdio memory streams that collect generated code and
+precomputed output, which libc allocates; they are tracked here so a fatal
+error doesn't leak them.
+*/
+
+// arguments of the library call being run, see guarded()
+typedef struct Call {
+    const char *data;       // source text, or the image for eidos_run
+    size_t len;
+    const EidosOptions *options;
+    const char *input;      // eidos_run only
+    size_t input_len;
+    uint64_t max_steps;
+} Call;
+
+// libc-allocated state of one compilation, released on every exit path
+typedef struct Streams {
+    FILE *input;            // eidos_run's input
+    FILE *discard;          // where a profiled run prints
+    FILE *stream;           // target output being written
+    char *buffer;           // its open_memstream buffer
+    size_t len;
+    Pipeline pipeline;      // its precomputed output is malloc'd by open_memstream
+} Streams;
+
+/* ===== Helper Functions ===== */
+
+static void close_streams(Streams *s) {
+    if (s->input) {
+        fclose(s->input);
+        s->input = NULL;
+    }
+    if (s->discard) {
+        fclose(s->discard);
+        s->discard = NULL;
+    }
+    if (s->stream) {
+        fclose(s->stream);
+        s->stream = NULL;
+    }
+    free(s->buffer);
+    s->buffer = NULL;
+    PEResult *pe = &s->pipeline.pe_result;
+    if (pe->stream) {
+        fclose(pe->stream);
+        pe->stream = NULL;
+    }
+    free(pe->output);
+    pe->output = NULL;
+}
+
+// forget the previous call's diagnostics and result
+static void reset(EidosContext *ctx) {
+    eidos_context_release_all(ctx);
+    ctx->diag_len = 0;
+    if (ctx->diag) {
+        ctx->diag[0] = '\0';
+    }
+    if (ctx->output) {
+        eidos_context_release(ctx, ctx->output, ctx->output_len + 1);
+        ctx->output = NULL;
+        ctx->output_len = 0;
+    }
+    ctx->out_of_memory = 0;
+}
+
+// copies what the stream collected into ctx->output, which outlives the call
+static void keep_output(EidosContext *ctx, Streams *s) {
+    ctx->output = eidos_context_alloc(ctx, s->len + 1);
+    if (!ctx->output) {
+        ctx->out_of_memory = 1;
+        eidos_fatal("Failed to allocate output");
+    }
+    if (s->len) {
+        memcpy(ctx->output, s->buffer, s->len);
+    }
+    ctx->output[s->len] = '\0';
+    ctx->output_len = s->len;
+}
+
+static FILE *open_output(Streams *s) {
+    s->stream = open_memstream(&s->buffer, &s->len);
+    if (!s->stream) {
+        eidos_fatal("Failed to allocate output stream");
+    }
+    return s->stream;
+}
+
+static void close_output(Streams *s) {
+    int failed = fclose(s->stream) != 0;
+    s->stream = NULL;
+    if (failed) {
+        eidos_fatal("Failed to write output");
+    }
+}
+
+// EIDOS_TARGET_TOKENS: the lexeme dump of the eidos binary's default mode
+static EidosStatus dump_tokens(EidosContext *ctx, Lexer *lexer, Streams *s) {
+    lexer->trace = open_output(s);
+    fputs("Lexeme Token\n", lexer->trace);
+
+    Token tok;
+    do {
+        tok = next_token(lexer);
+        eidos_free((void*)tok.lexeme);
+    } while (tok.tokenType != EOF_TOK);
+
+    close_output(s);
+    keep_output(ctx, s);
+    return EIDOS_OK;
+}
+
+/*
+EIDOS_TARGET_PROFILE: runs the program with the block counters and no
+timer, which lives in the eidos binary and not in the library, and writes the
+folded stacks. What the program prints is dropped, and a runtime error ends
+the run with the counts up to it.
+
+args:
+    *fn (IRFunction) -> optimized program
+    *name (char) -> root frame, NULL for "program"
+    *s (Streams) -> libc state, s->stream open
+*/
+static void profile_folded(const IRFunction *fn, const char *name, Streams *s) {
+    s->discard = fopen("/dev/null", "w");
+    if (!s->discard) {
+        eidos_fatal("Failed to open /dev/null");
+    }
+    IRProfile profile;
+    ir_profile_count(fn, NULL, s->discard, NULL, 0, &profile);
+    ir_profile_folded(fn, &profile, name ? name : "program", s->stream);
+    ir_profile_free(&profile);
+}
+
+/*
+Runs an image, the body of eidos_run
+
+args:
+    *ctx (EidosContext) -> active context
+    *call (Call) -> image, input and budget
+    *s (Streams) -> libc state, closed by the caller
+
+returns:
+    (EidosStatus) -> result, ctx->output holds what the program printed
+*/
+static EidosStatus run(EidosContext *ctx, const Call *call, Streams *s) {
+    const char *data = call->data;
+    size_t len = call->len;
+    const char *input = call->input;
+    size_t input_len = call->input_len;
+
+    // images are read in place, which needs 8-byte alignment
+    const void *aligned = data;
+    if ((uintptr_t)data % 8 != 0) {
+        char *copy = eidos_malloc(len ? len : 1);
+        if (!copy) {
+            eidos_fatal("Failed to allocate image");
+        }
+        memcpy(copy, data, len);
+        aligned = copy;
+    }
+
+    BCImage image;
+    if (bc_open_image(aligned, len, "image", &image) != 0) {
+        return EIDOS_BAD_OPTIONS;
+    }
+
+    // fmemopen can't open an empty buffer everywhere, and read() of nothing is the same as of ""
+    s->input = fmemopen((void*)(input_len ? input : ""), input_len ? input_len : 1, "r");
+    if (!s->input) {
+        eidos_fatal("Failed to allocate input stream");
+    }
+    if (!input_len) {
+        fgetc(s->input);
+    }
+
+    uint64_t executed;
+    int result = bc_run_image(&image, s->input, open_output(s), call->max_steps, &executed);
+    close_output(s);
+    keep_output(ctx, s);
+
+    if (result == 2) {
+        eidos_diag("Error: Stopped after %llu instructions\n", (unsigned long long)executed);
+    }
+    return result == 0 ? EIDOS_OK : EIDOS_ERROR;
+}
+
+/*
+Runs the pipeline on one source buffer
+
+args:
+    *ctx (EidosContext) -> active context
+    *call (Call) -> source text and what to produce
+    *s (Streams) -> libc state, closed by the caller
+
+returns:
+    (EidosStatus) -> result, ctx->output is set on EIDOS_OK
+*/
+static EidosStatus compile(EidosContext *ctx, const Call *call, Streams *s) {
+    const char *source = call->data;
+    size_t len = call->len;
+    const EidosOptions *options = call->options;
+
+    Pipeline *p = &s->pipeline;
+    EidosStatus status = pipeline_init(p, options);
+    if (status != EIDOS_OK) {
+        return status;
+    }
+    if (options->target > EIDOS_TARGET_PROFILE) {
+        eidos_diag("ERROR: Unknown target %d.\n", (int)options->target);
+        return EIDOS_BAD_OPTIONS;
+    }
+
+    char *text = eidos_malloc(len + 1);
+    if (!text) {
+        eidos_fatal("Failed to allocate source buffer");
+    }
+    memcpy(text, source, len);
+    text[len] = '\0';
+
+    if (options->target == EIDOS_TARGET_TOKENS) {
+        Lexer lexer;
+        init_lexer(&lexer, text);
+        return dump_tokens(ctx, &lexer, s);
+    }
+
+    // as with --profile, unrolling would split a statement's counts between its copies
+    p->unroll = p->unroll && options->target != EIDOS_TARGET_PROFILE;
+    p->pe = p->pe && (options->target == EIDOS_TARGET_C || options->target == EIDOS_TARGET_IMAGE);
+    if (pipeline_parse(p, text) != EIDOS_OK || pipeline_optimize(p) != EIDOS_OK) {
+        return EIDOS_ERROR;
+    }
+    if (!p->pe_result.complete && pipeline_lower(p) != EIDOS_OK) {
+        return EIDOS_ERROR;
+    }
+    IRFunction *fn = p->fn;
+    const PEResult *pe = &p->pe_result;
+
+    if (options->target != EIDOS_TARGET_CHECK) {
+        open_output(s);
+
+        CEmitOptions c_options = { options->name, pe->output, pe->output_len, 0, 0, options->vectorize };
+        switch (options->target) {
+        case EIDOS_TARGET_C:
+            c_emit_program(fn, &c_options, s->stream);
+            break;
+        case EIDOS_TARGET_IMAGE:
+            bc_write_image(fn, pe->output, pe->output_len, options->peephole, NULL, s->stream);
+            break;
+        case EIDOS_TARGET_IR:
+            ir_dump(fn, s->stream);
+            break;
+        case EIDOS_TARGET_PROFILE:
+            profile_folded(fn, options->name, s);
+            break;
+        case EIDOS_TARGET_CHECK:
+        case EIDOS_TARGET_TOKENS:
+            break;
+        }
+        close_output(s);
+    }
+
+    keep_output(ctx, s);
+
+    pipeline_free(p);
+    eidos_free(text);
+    return EIDOS_OK;
+}
+
+
+/*
+Runs the body of a library call with ctx active, unwinding to here on a fatal
+error, and releases everything the call left behind
+
+args:
+    *ctx (EidosContext) -> context of the call
+    body (function) -> compile or run
+    *call (Call) -> its arguments
+
+returns:
+    (EidosStatus) -> what body returned, or why it was abandoned
+*/
+static EidosStatus guarded(EidosContext *ctx, EidosStatus (*body)(EidosContext*, const Call*, Streams*),
+                           const Call *call) {
+    EidosContext *previous = eidos_context_enter(ctx);
+    reset(ctx);
+
+    // on the heap: locals changed between setjmp and longjmp are indeterminate after it
+    Streams *streams = eidos_context_alloc(ctx, sizeof(Streams));
+    if (!streams) {
+        eidos_context_enter(previous);
+        return EIDOS_NO_MEMORY;
+    }
+    memset(streams, 0, sizeof(Streams));
+    EidosStatus status;
+
+    jmp_buf recover;
+    ctx->recover = &recover;
+    if (setjmp(recover) == 0) {
+        status = body(ctx, call, streams);
+    } else {
+        // eidos_abort: the diagnostics say why, the live blocks are released below
+        status = ctx->out_of_memory ? EIDOS_NO_MEMORY : EIDOS_ERROR;
+    }
+    ctx->recover = NULL;
+
+    close_streams(streams);
+    eidos_context_release(ctx, streams, sizeof(Streams));
+    eidos_context_release_all(ctx);
+    eidos_context_enter(previous);
+    return status;
+}
+
+
+/* ========== PUBLIC API ========== */
+
+/*
+Creates a compilation context
+
+args:
+    *allocator (EidosAllocator) -> where memory comes from, NULL for malloc/free
+
+returns:
+    (EidosContext*) -> the context, NULL if it couldn't be allocated
+*/
+EidosContext *eidos_context_new(const EidosAllocator *allocator) {
+    EidosContext probe;
+    memset(&probe, 0, sizeof(probe));
+    if (allocator) {
+        probe.allocator = *allocator;
+    }
+
+    EidosContext *ctx = eidos_context_alloc(&probe, sizeof(EidosContext));
+    if (!ctx) {
+        return NULL;
+    }
+    *ctx = probe;
+    ctx->live.link.prev = ctx->live.link.next = &ctx->live;
+    return ctx;
+}
+
+/*
+Releases a context, its result and diagnostics
+
+args:
+    *ctx (EidosContext) -> context to free, may be NULL
+*/
+void eidos_context_free(EidosContext *ctx) {
+    if (!ctx) {
+        return;
+    }
+    reset(ctx);
+    if (ctx->diag) {
+        eidos_context_release(ctx, ctx->diag, ctx->diag_cap);
+    }
+    eidos_context_release(ctx, ctx, sizeof(EidosContext));
+}
+
+/*
+Default options: C output with every optimization the binary runs by default
+
+args:
+    *options (EidosOptions) -> options to fill in
+*/
+void eidos_default_options(EidosOptions *options) {
+    memset(options, 0, sizeof(EidosOptions));
+    options->target = EIDOS_TARGET_C;
+    options->fold = 1;
+    options->unroll = 1;
+    options->pe = 1;
+    options->cse = 1;
+    options->vectorize = 1;
+    options->peephole = 1;
+
+    UnrollOptions unroll_options;
+    unroll_default_options(&unroll_options);
+    options->unroll_full = unroll_options.max_full_trips;
+    options->unroll_factor = unroll_options.factor;
+    options->unroll_budget = unroll_options.budget;
+
+    PEOptions pe_options;
+    pe_default_options(&pe_options);
+    options->pe_steps = pe_options.max_insts;
+    options->pe_millis = pe_options.max_millis;
+}
+
+/*
+Compiles one program
+
+args:
+    *ctx (EidosContext) -> context, not used by another thread during the call
+    *source (char) -> program text
+    len (size_t) -> length of the text
+    *options (EidosOptions) -> target and optimizations
+
+returns:
+    (EidosStatus) -> EIDOS_OK with the result in eidos_output(), or why not
+*/
+EidosStatus eidos_compile(EidosContext *ctx, const char *source, size_t len,
+                          const EidosOptions *options) {
+    Call call = { source, len, options, NULL, 0, 0 };
+    return guarded(ctx, compile, &call);
+}
+
+/*
+Runs a compiled image
+
+args:
+    *ctx (EidosContext) -> context, not used by another thread during the call
+    *image (char) -> bytes of an EIDOS_TARGET_IMAGE output
+    len (size_t) -> their length
+    *input (char) -> what read() reads, may be NULL when input_len is 0
+    input_len (size_t) -> its length
+    max_steps (unsigned long long) -> instructions the program may execute, 0 for no limit
+
+returns:
+    (EidosStatus) -> EIDOS_OK, EIDOS_ERROR on a runtime error or exhausted budget
+*/
+EidosStatus eidos_run(EidosContext *ctx, const char *image, size_t len,
+                      const char *input, size_t input_len, unsigned long long max_steps) {
+    Call call = { image, len, NULL, input, input_len, max_steps };
+    return guarded(ctx, run, &call);
+}
+
+/*
+Result of the last call
+
+args:
+    *ctx (EidosContext) -> context
+    *len (size_t) -> receives the size, may be NULL
+
+returns:
+    (const char*) -> output, NULL if the last compilation failed
+*/
+const char *eidos_output(const EidosContext *ctx, size_t *len) {
+    if (len) {
+        *len = ctx->output_len;
+    }
+    return ctx->output;
+}
+
+/*
+Diagnostics of the last compilation
+
+args:
+    *ctx (EidosContext) -> context
+
+returns:
+    (const char*) -> every message, "" if there were none
+*/
+const char *eidos_diagnostics(const EidosContext *ctx) {
+    return ctx->diag_len ? ctx->diag : "";
+}
+
+/*
+Memory accounting of a context
+
+args:
+    *ctx (EidosContext) -> context
+    *live, *peak, *allocations (size_t) -> receive the counters, each may be NULL
+*/
+void eidos_memory_stats(const EidosContext *ctx, size_t *live, size_t *peak, size_t *allocations) {
+    if (live) {
+        *live = ctx->live_bytes;
+    }
+    if (peak) {
+        *peak = ctx->peak_bytes;
+    }
+    if (allocations) {
+        *allocations = ctx->allocations;
+    }
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+/*
+libeidos: the Eidos compiler as a library (libeidos.a / libeidos.so).
+
+Everything a compilation needs lives in an EidosContext: its allocator, the
+memory of the compilation in progress, the diagnostics it produced and its
+result. Compiling never exits the process or touches global state; errors
+come back as an EidosStatus, with the same messages the eidos binary prints
+available from eidos_diagnostics().
+
+Contexts are independent, so any number of threads can compile at once as
+long as each uses its own context. A context can be reused for any number of
+compilations, one at a time; each call releases what the previous one left.
+
+    EidosContext *ctx = eidos_context_new(NULL);
+    EidosOptions options;
+    eidos_default_options(&options);
+    if (eidos_compile(ctx, source, strlen(source), &options) == EIDOS_OK) {
+        size_t len;
+        const char *c_code = eidos_output(ctx, &len);
+        ...
+    }
+    eidos_context_free(ctx);
+*/
+
+#include <stddef.h>
+
+// the only symbols libeidos.so exports, everything else is built hidden
+#if defined(__GNUC__)
+#define EIDOS_API __attribute__((visibility("default")))
+#else
+#define EIDOS_API
+#endif
+
+// Where a context gets memory from; a NULL allocator means malloc/free
+typedef struct EidosAllocator {
+    void *(*alloc)(void *user, size_t size);            // NULL when out of memory
+    void (*release)(void *user, void *ptr, size_t size);
+    void *user;
+} EidosAllocator;
+
+typedef struct EidosContext EidosContext;
+
+typedef enum EidosTarget {
+    EIDOS_TARGET_C,         // standalone C program (--emit-c)
+    EIDOS_TARGET_IMAGE,     // bytecode image (eidos compile, bytecode/bytecode.h)
+    EIDOS_TARGET_IR,        // textual SSA IR (--dump-ir)
+    EIDOS_TARGET_CHECK,     // diagnostics only, no output
+    EIDOS_TARGET_TOKENS,    // every lexeme and its token, as `eidos file.e` prints them
+    EIDOS_TARGET_PROFILE,   // folded stacks of a profiled run with no input (--profile-folded), counts only
+} EidosTarget;
+
+typedef struct EidosOptions {
+    EidosTarget target;
+    const char *name;       // source name used in generated code, may be NULL
+    const char *passes;     // IR pass list (--passes=), NULL for the default pipeline
+    int fold;               // constant folding (default 1)
+    int unroll;             // loop unrolling (default 1)
+    int pe;                 // precompute read-free code (default 1)
+    int cse;                // hash-consing and CSE (default 1)
+    size_t unroll_full;     // fully unroll loops of at most this many trips (default 16)
+    size_t unroll_factor;   // bodies per iteration for longer loops, < 2 disables (default 4)
+    size_t unroll_budget;   // AST nodes unrolling may add (default 4096)
+    unsigned long long pe_steps;    // instructions precomputing may execute (default 50000000)
+    double pe_millis;       // milliseconds precomputing may take (default 1000)
+    int vectorize;          // vector kernels for array loops in C output (default 1)
+    int peephole;           // instruction selection and peephole pass for images (default 1)
+} EidosOptions;
+
+typedef enum EidosStatus {
+    EIDOS_OK,
+    EIDOS_ERROR,            // the program has errors, see eidos_diagnostics
+    EIDOS_NO_MEMORY,        // the allocator ran out
+    EIDOS_BAD_OPTIONS,      // unknown pass, bad target
+} EidosStatus;
+
+
+/* ========== Public API Functions ========== */
+
+/*
+Creates a context using `allocator` (copied, may be NULL). NULL if the
+allocator can't provide the context itself.
+*/
+EIDOS_API EidosContext *eidos_context_new(const EidosAllocator *allocator);
+
+/*
+Releases a context and everything it still owns
+*/
+EIDOS_API void eidos_context_free(EidosContext *ctx);
+
+/*
+Fills in the defaults: C target, every optimization on
+*/
+EIDOS_API void eidos_default_options(EidosOptions *options);
+
+/*
+Compiles `len` bytes of source (no NUL terminator needed)
+*/
+EIDOS_API EidosStatus eidos_compile(EidosContext *ctx, const char *source, size_t len,
+                                    const EidosOptions *options);
+
+/*
+Result of the last successful eidos_compile, or what the program of the last
+eidos_run printed; valid until the next call on the context. Always NUL
+terminated, binary results included; *len (may be NULL) gets the size.
+*/
+EIDOS_API const char *eidos_output(const EidosContext *ctx, size_t *len);
+
+/*
+Runs a bytecode image (the output of EIDOS_TARGET_IMAGE) with `input` as what
+read() reads. The output is what the program printed, also after a runtime
+error; EIDOS_ERROR means a runtime error, or that more than max_steps
+instructions (0 for no limit) ran. EIDOS_BAD_OPTIONS if it is not a valid
+image.
+*/
+EIDOS_API EidosStatus eidos_run(EidosContext *ctx, const char *image, size_t len,
+                                const char *input, size_t input_len, unsigned long long max_steps);
+
+/*
+Diagnostics of the last eidos_compile, "" if there were none
+*/
+EIDOS_API const char *eidos_diagnostics(const EidosContext *ctx);
+
+/*
+Bytes the current compilation holds / held at most, and blocks allocated
+over the context's lifetime
+*/
+EIDOS_API void eidos_memory_stats(const EidosContext *ctx, size_t *live, size_t *peak, size_t *allocations);
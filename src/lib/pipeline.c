@@ -0,0 +1,153 @@
+#include "pipeline.h"
+#include "../util/context.h"
+#include "../lexer/lexer.h"
+#include "../semantic/sema.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+/* ========== PUBLIC API ========== */
+
+/*
+Copies the options into a pipeline and sets up its pass manager
+
+args:
+    *p (Pipeline) -> pipeline to set up
+    *options (EidosOptions) -> optimizations and their limits, passes
+
+returns:
+    (EidosStatus) -> EIDOS_OK, EIDOS_BAD_OPTIONS for an unknown pass
+*/
+EidosStatus pipeline_init(Pipeline *p, const EidosOptions *options) {
+    memset(p, 0, sizeof(Pipeline));
+    p->fold = options->fold;
+    p->unroll = options->unroll;
+    p->pe = options->pe;
+    p->cse = options->cse;
+    p->parse_jobs = 1;
+    p->report = &p->no_report;
+
+    unroll_default_options(&p->unroll_options);
+    p->unroll_options.max_full_trips = options->unroll_full;
+    p->unroll_options.factor = options->unroll_factor;
+    p->unroll_options.budget = options->unroll_budget;
+    p->pe_options.max_insts = options->pe_steps;
+    p->pe_options.max_millis = options->pe_millis;
+
+    // an unknown pass is a caller mistake, report it before doing any work
+    if (options->passes) {
+        ir_pm_init(&p->pm);
+        if (!ir_pm_add_list(&p->pm, options->passes)) {
+            return EIDOS_BAD_OPTIONS;
+        }
+    } else {
+        ir_pm_init_default(&p->pm);
+    }
+    return EIDOS_OK;
+}
+
+/*
+Parses and checks a program
+
+args:
+    *p (Pipeline) -> pipeline, p->program is set
+    *source (char) -> NUL terminated source text, kept alive by the caller
+
+returns:
+    (EidosStatus) -> EIDOS_OK, EIDOS_ERROR if the checks failed
+*/
+EidosStatus pipeline_parse(Pipeline *p, const char *source) {
+    Lexer lexer;
+    init_lexer(&lexer, source);
+
+    TIME_BEGIN(p->report, TIME_PARSE);
+    p->program = parse_program_parallel(&lexer, p->parse_jobs, &p->parse_stats);
+    TIME_END(p->report);
+
+    TIME_BEGIN(p->report, TIME_SEMA);
+    size_t errors = sema_check(p->program);
+    TIME_END(p->report);
+    return errors ? EIDOS_ERROR : EIDOS_OK;
+}
+
+/*
+Folds, unrolls, precomputes and hash-conses the checked program, each if on
+
+args:
+    *p (Pipeline) -> parsed pipeline
+
+returns:
+    (EidosStatus) -> EIDOS_OK, EIDOS_ERROR if folding reported an error
+*/
+EidosStatus pipeline_optimize(Pipeline *p) {
+    if (p->fold) {
+        TIME_BEGIN(p->report, TIME_FOLD);
+        fold_program(p->program, &p->fold_stats);
+        TIME_END(p->report);
+        if (p->fold_stats.errors) {
+            return EIDOS_ERROR;
+        }
+    }
+    if (p->unroll) {
+        TIME_BEGIN(p->report, TIME_UNROLL);
+        unroll_program(p->program, &p->unroll_options, &p->unroll_stats);
+        TIME_END(p->report);
+    }
+    if (p->pe) {
+        TIME_BEGIN(p->report, TIME_PE);
+        pe_program(p->program, &p->pe_options, &p->pe_result);
+        TIME_END(p->report);
+    }
+
+    // the tree is final from here on, so subtrees can be shared
+    if (p->cse) {
+        TIME_BEGIN(p->report, TIME_HASHCONS);
+        hashcons_program(p->program, &p->hashcons_stats);
+        TIME_END(p->report);
+    }
+    return EIDOS_OK;
+}
+
+/*
+Lowers the optimized program to SSA IR and runs the pass pipeline
+
+args:
+    *p (Pipeline) -> optimized pipeline, p->fn is set
+
+returns:
+    (EidosStatus) -> EIDOS_OK, EIDOS_ERROR if the IR couldn't be built
+*/
+EidosStatus pipeline_lower(Pipeline *p) {
+    TIME_BEGIN(p->report, TIME_IR_BUILD);
+    p->fn = ir_build(p->program);
+    TIME_END(p->report);
+    if (!p->fn) {
+        return EIDOS_ERROR;
+    }
+    p->blocks_before = ir_count_blocks(p->fn);
+    p->insts_before = ir_count_insts(p->fn);
+
+    TIME_BEGIN(p->report, TIME_IR_PASSES);
+    ir_pm_run(&p->pm, p->fn);
+    TIME_END(p->report);
+    return EIDOS_OK;
+}
+
+/*
+Releases what the stages built
+
+args:
+    *p (Pipeline) -> pipeline
+*/
+void pipeline_free(Pipeline *p) {
+    if (p->fn) {
+        ir_free_function(p->fn);
+        p->fn = NULL;
+    }
+    if (p->program) {
+        ast_free(p->program);
+        p->program = NULL;
+    }
+    free(p->pe_result.output);
+    p->pe_result.output = NULL;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+/*
+The compile pipeline shared by the library (eidos_compile) and the eidos
+binary (main.c): parse, check, fold, unroll, precompute, hash-cons, lower to
+SSA and run the IR passes. What happens to the result differs between the
+two (memory streams in the library; files, stdout, the interpreter and the
+profiler in the binary), so the callers emit it themselves.
+
+The stages run in order and each reports whether the program is still good:
+
+    pipeline_init       options, and the pass list checked before any work
+    pipeline_parse      parse and semantic checks
+    pipeline_optimize   fold, unroll, precompute, hash-cons
+    pipeline_lower      build the IR and run the passes
+
+Between the stages the caller may look at or annotate the tree, as
+--profile-use does after the checks and --dump-ast after the optimizations.
+Everything is allocated with eidos_malloc, so inside a library context a
+fatal error releases it; pipeline_free releases it otherwise.
+*/
+
+#include <stddef.h>
+#include "eidos.h"
+#include "../parser/ast.h"
+#include "../parser/parallel.h"
+#include "../optimizer/fold.h"
+#include "../optimizer/unroll.h"
+#include "../optimizer/partial_eval.h"
+#include "../optimizer/hashcons.h"
+#include "../ir/ir.h"
+#include "../ir/passes.h"
+#include "../util/time_report.h"
+
+typedef struct Pipeline {
+    // what to run, from the EidosOptions; callers may turn stages off
+    int fold;
+    int unroll;
+    int pe;                     // only for compiled targets, --run runs everything
+    int cse;
+    UnrollOptions unroll_options;   // loop_factor may be set for a profile
+    PEOptions pe_options;
+    IRPassManager pm;
+    size_t parse_jobs;          // threads parsing a large source outside a context, 1 for sequential
+    TimeReport *report;         // phases are timed into it, a disabled one by default
+    TimeReport no_report;
+
+    // what it did
+    ASTNode *program;
+    IRFunction *fn;             // NULL until lowered
+    PEResult pe_result;         // precomputed output, freed by pipeline_free
+    ParseStats parse_stats;
+    FoldStats fold_stats;
+    UnrollStats unroll_stats;
+    HashConsStats hashcons_stats;
+    size_t blocks_before;       // IR size before the passes
+    size_t insts_before;
+} Pipeline;
+
+
+/* ========== Public API Functions ========== */
+
+/*
+Sets up a pipeline from the options. Returns EIDOS_BAD_OPTIONS, after
+reporting it, if the pass list names an unknown pass.
+*/
+EidosStatus pipeline_init(Pipeline *p, const EidosOptions *options);
+
+/*
+Parses the NUL terminated source and checks it. Syntax errors abort, as in
+parse_program; EIDOS_ERROR if the checks reported errors.
+*/
+EidosStatus pipeline_parse(Pipeline *p, const char *source);
+
+/*
+Runs the AST optimizations that are on. EIDOS_ERROR if folding found an
+error, the remaining ones are skipped then.
+*/
+EidosStatus pipeline_optimize(Pipeline *p);
+
+/*
+Builds the SSA IR of the program and runs the passes on it. EIDOS_ERROR if
+the program can't be lowered.
+*/
+EidosStatus pipeline_lower(Pipeline *p);
+
+/*
+Frees the tree, the IR and the precomputed output
+*/
+void pipeline_free(Pipeline *p);
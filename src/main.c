@@ -1,17 +1,46 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "lexer/lexer.h"
+#include "parser/parser.h"
+#include "parser/parallel.h"
+#include "semantic/sema.h"
+#include "optimizer/fold.h"
+#include "optimizer/unroll.h"
+#include "optimizer/partial_eval.h"
+#include "optimizer/hashcons.h"
+#include "optimizer/pgo.h"
+#include "ir/ir.h"
+#include "ir/passes.h"
+#include "ir/interp.h"
+#include "ir/profile.h"
+#include "ir/vecloop.h"
+#include "codegen/c_backend.h"
+#include "bytecode/bytecode.h"
+#include "driver/batch.h"
+#include "driver/server.h"
+#include "driver/sampler.h"
+#include "lib/pipeline.h"
+#include "util/context.h"
+#include "util/time_report.h"
+
+// --time-report, off unless asked for
+static TimeReport report;
 
 static char *read_file(const char *path) {
     /*
     Opens/Reads file given as cli argument
 
     args:
-        *path (char) -> Pointer to file object 
+        *path (char) -> Pointer to file object
 
     returns:
-        
+        buffer (char) -> NUL terminated contents of the file
     */
     FILE *f = fopen(path, "rb");
     if (!f) {
@@ -23,7 +52,7 @@ static char *read_file(const char *path) {
     long size = ftell(f);
     rewind(f);
 
-    char *buffer = malloc(size + 1);
+    char *buffer = eidos_malloc(size + 1);
     fread(buffer, 1, size, f);
     buffer[size] = '\0';
 
@@ -31,37 +60,1048 @@ static char *read_file(const char *path) {
     return buffer;
 }
 
-int main(int argc, char *argv[]) {
+static int parse_size_option(const char *text, size_t *value) {
+    /*
+    Parses the non-negative number of a --name=N option
+
+    args:
+        *text (char) -> text after the '='
+        *value (size_t) -> set on success
+
+    returns:
+        (int) -> 1 on success, 0 if text is not a number
+    */
+    char *end;
+    if (*text < '0' || *text > '9') {
+        return 0;
+    }
+    unsigned long long n = strtoull(text, &end, 10);
+    if (*end != '\0') {
+        return 0;
+    }
+    *value = (size_t)n;
+    return 1;
+}
+
+static int write_folded(const IRFunction *fn, const IRProfile *prof, const char *source_path,
+                        const char *folded_path) {
+    /*
+    Writes the folded stacks of --profile-folded
+
+    args:
+        *fn (IRFunction) -> profiled function
+        *prof (IRProfile) -> its counters
+        *source_path (char) -> the program, its file name is the root frame
+        *folded_path (char) -> file to write
 
-    if (argc != 2) {
-        printf("EEOR: Not enough arguments given. Exiting now.\n");
+    returns:
+        (int) -> 0, -1 after reporting that the file can't be written
+    */
+    FILE *out = fopen(folded_path, "w");
+    if (!out) {
+        fprintf(stderr, "Error: Could not open %s\n", folded_path);
+        return -1;
+    }
+
+    const char *name = strrchr(source_path, '/');
+    ir_profile_folded(fn, prof, name ? name + 1 : source_path, out);
+    if (fclose(out) != 0) {
+        fprintf(stderr, "Error: Failed to write %s\n", folded_path);
         return -1;
-    } 
-    if (argv == NULL) {
-        printf("ERROR: File not given. Exiting Now.\n");
-        return -2;
     }
+    return 0;
+}
 
-    char *source = read_file(argv[1]);
+static int run_image(const char *path, int print_stats) {
+    /*
+    `eidos run file.eidb`: maps a compiled image and executes it
+
+    args:
+        *path (char) -> image file
+        print_stats (int) -> 1 to report the executed instruction count
+
+    returns:
+        (int) -> exit status
+    */
+    BCImage image;
+    TIME_BEGIN(&report, TIME_READ);
+    int loaded = bc_load_image(path, &image);
+    TIME_END(&report);
+    if (loaded != 0) {
+        return 1;
+    }
+
+    uint64_t executed;
+    TIME_BEGIN(&report, TIME_RUN);
+    int status = bc_run_image(&image, stdin, stdout, 0, &executed);
+    TIME_END(&report);
+    if (print_stats) {
+        fprintf(stderr, "run: %llu bytecode instructions\n", (unsigned long long)executed);
+    }
+
+    bc_unload_image(&image);
+    time_report_finish(&report, stderr);
+    return status;
+}
+
+// file.e -> file.eidb
+static char *image_path_for(const char *source_path) {
+    size_t len = strlen(source_path);
+    if (len > 2 && strcmp(source_path + len - 2, ".e") == 0) {
+        len -= 2;
+    }
+    char *path = malloc(len + 6);
+    if (!path) {
+        fprintf(stderr, "Error: Failed to allocate path\n");
+        exit(1);
+    }
+    memcpy(path, source_path, len);
+    strcpy(path + len, ".eidb");
+    return path;
+}
+
+static int batch_main(char **inputs, size_t ninputs, const char *passes, int compile, int emit_c,
+                      int dump_ir, const EidosOptions *compile_options, size_t threads, int print_stats) {
+    /*
+    Several source files (or @lists of them): compiles them all in this
+    process, see driver/batch.h
+
+    args:
+        **inputs (char) -> source files and @lists
+        ninputs (size_t) -> how many
+        *passes (char) -> --passes list, NULL for the default
+        compile, emit_c, dump_ir (int) -> what to produce, exactly one set
+        *compile_options (EidosOptions) -> optimizations from the command line
+        threads (size_t) -> --jobs, 0 for one per CPU
+        print_stats (int) -> 1 for a summary
+
+    returns:
+        (int) -> exit status
+    */
+    if (compile + emit_c + dump_ir != 1) {
+        fprintf(stderr, "ERROR: Several source files need exactly one of compile, --emit-c or --dump-ir.\n");
+        return -1;
+    }
+
+    // check the pass list once here instead of failing every file
+    if (passes) {
+        IRPassManager pm;
+        ir_pm_init(&pm);
+        if (!ir_pm_add_list(&pm, passes)) {
+            return -1;
+        }
+    }
+
+    BatchOptions options;
+    options.compile = *compile_options;
+    options.compile.passes = passes;
+    options.compile.target = compile ? EIDOS_TARGET_IMAGE : emit_c ? EIDOS_TARGET_C : EIDOS_TARGET_IR;
+    options.extension = compile ? ".eidb" : emit_c ? ".c" : NULL;
+    options.threads = threads;
+    options.print_stats = print_stats;
+    return batch_compile(inputs, ninputs, &options);
+}
+
+// temporary file --stream writes to, removed if the compilation stops part way
+static char *partial_output;
+
+static void remove_partial_output(void) {
+    if (partial_output) {
+        unlink(partial_output);
+    }
+}
+
+static FILE *open_stream_output(const char *path, char **target) {
+    /*
+    Opens the -o file of --stream. A regular file, or one that doesn't exist
+    yet, is written as a new file in the same directory and renamed over it
+    once complete: a compilation that stops part way leaves the old file alone
+    and only removes what it created. Anything else (/dev/null, a pipe) is
+    written directly and never removed.
+
+    args:
+        *path (char) -> -o file
+        **target (char) -> receives the path to rename onto, malloc'd, NULL if written directly
+
+    returns:
+        (FILE*) -> the file, NULL on failure (reported)
+    */
+    *target = NULL;
+    struct stat st;
+    int exists = stat(path, &st) == 0;
+    if (exists && !S_ISREG(st.st_mode)) {
+        FILE *out = fopen(path, "w");
+        if (!out) {
+            perror("fopen");
+        }
+        return out;
+    }
+
+    // through a symlink, the file it points to is the one replaced
+    char *resolved = exists ? realpath(path, NULL) : strdup(path);
+    if (!resolved) {
+        perror("realpath");
+        return NULL;
+    }
+    const char *slash = strrchr(resolved, '/');
+    size_t dir_len = slash ? (size_t)(slash - resolved) + 1 : 0;
+    char *temp = malloc(strlen(resolved) + 16);
+    if (!temp) {
+        fprintf(stderr, "Error: Failed to allocate output path\n");
+        free(resolved);
+        return NULL;
+    }
+    sprintf(temp, "%.*s.%s.XXXXXX", (int)dir_len, resolved, resolved + dir_len);
+
+    int fd = mkstemp(temp);
+    if (fd < 0) {
+        perror("mkstemp");
+        free(temp);
+        free(resolved);
+        return NULL;
+    }
+    partial_output = temp;
+    atexit(remove_partial_output);
+
+    // mkstemp makes it 0600, give it the mode the file has or fopen would have given it
+    mode_t mask = umask(0);
+    umask(mask);
+    fchmod(fd, exists ? st.st_mode & 07777 : 0666 & ~mask);
+    FILE *out = fdopen(fd, "w");
+    if (!out) {
+        perror("fdopen");
+        close(fd);
+        free(resolved);
+        return NULL;
+    }
+    *target = resolved;
+    return out;
+}
+
+static int stream_main(const char *path, const char *output_path, int print_stats) {
+    /*
+    `eidos --emit-c --stream file.e`: parses, checks and translates one
+    top-level statement at a time and frees it before reading on, so memory
+    is bounded by the largest statement instead of the file. The source is
+    mapped, and the pages the lexer has moved past are dropped as it goes.
+
+    args:
+        *path (char) -> source file
+        *output_path (char) -> -o file, NULL for stdout
+        print_stats (int) -> 1 to report statement counts and peak memory
+
+    returns:
+        (int) -> exit status
+    */
+    TIME_BEGIN(&report, TIME_READ);
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror("open");
+        return 1;
+    }
+    size_t size = (size_t)st.st_size;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+
+    // the file is mapped over anonymous memory one page longer, whose zeros end the source
+    size_t span = (size / page + 1) * page;
+    char *source = mmap(NULL, span, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (source == MAP_FAILED ||
+        (size && mmap(source, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)) {
+        perror("mmap");
+        close(fd);
+        return 1;
+    }
+    close(fd);
+    madvise(source, span, MADV_SEQUENTIAL);
+    TIME_END(&report);
+
+    char *target = NULL;
+    FILE *out = output_path ? open_stream_output(output_path, &target) : stdout;
+    if (!out) {
+        munmap(source, span);
+        return 1;
+    }
 
     Lexer lexer;
     init_lexer(&lexer, source);
+    TIME_BEGIN(&report, TIME_PARSE);
+    Parser *parser = parser_init(&lexer);
+    TIME_END(&report);
+
+    SemaStream sema;
+    sema_stream_init(&sema);
+    CStream c_stream;
+    c_stream_begin(&c_stream, path, out);
+
+    size_t statements = 0;
+    size_t largest = 0;
+    size_t released = 0;
+    for (;;) {
+        TIME_BEGIN(&report, TIME_PARSE);
+        ASTNode *stmt = parse_top_level_stmt(parser);
+        TIME_END(&report);
+        if (!stmt) {
+            break;
+        }
+
+        TIME_BEGIN(&report, TIME_SEMA);
+        sema_stream_stmt(&sema, stmt);
+        TIME_END(&report);
+        TIME_BEGIN(&report, TIME_EMIT_C);
+        c_stream_stmt(&c_stream, stmt);
+        TIME_END(&report);
+
+        size_t nodes = ast_count_nodes(stmt);
+        if (nodes > largest) {
+            largest = nodes;
+        }
+        statements++;
+        ast_free(stmt);
+
+        // the lexer never reads behind itself, drop what it passed a MiB at a time
+        size_t done = lexer.pos / page * page;
+        if (done - released >= (1u << 20)) {
+            madvise(source + released, done - released, MADV_DONTNEED);
+            released = done;
+        }
+    }
+    parser_free(parser);
+
+    size_t variables = c_stream.vars.count;
+    c_stream_end(&c_stream);
+
+    TIME_BEGIN(&report, TIME_SEMA);
+    int status = sema_stream_finish(&sema) ? 1 : 0;
+    TIME_END(&report);
+    if (out != stdout ? fclose(out) != 0 : fflush(out) != 0) {
+        fprintf(stderr, "Error: Failed to write %s\n", output_path ? output_path : "stdout");
+        status = 1;
+    }
+    if (status == 0 && target) {
+        if (rename(partial_output, target) != 0) {
+            perror("rename");
+            status = 1;
+        } else {
+            free(partial_output);
+            partial_output = NULL;
+        }
+    }
+    free(target);
+    munmap(source, span);
+
+    if (print_stats) {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        fprintf(stderr, "stream: %zu statements, %zu variables, largest statement %zu nodes\n",
+                statements, variables, largest);
+        fprintf(stderr, "stream: %zu bytes of source, peak RSS %ld KiB\n", size, usage.ru_maxrss);
+    }
+    time_report_finish(&report, stderr);
+    return status;
+}
+
+static char *read_stdin(size_t *len) {
+    /*
+    Reads all of stdin, for a run forwarded to the compile server
+
+    args:
+        *len (size_t) -> receives the length
+
+    returns:
+        (char*) -> the bytes, malloc'd
+    */
+    size_t cap = 4096;
+    char *data = malloc(cap);
+    *len = 0;
+    for (;;) {
+        if (!data) {
+            fprintf(stderr, "Error: Failed to allocate input\n");
+            exit(1);
+        }
+        size_t n = fread(data + *len, 1, cap - *len, stdin);
+        *len += n;
+        if (n == 0) {
+            return data;
+        }
+        if (*len == cap) {
+            cap *= 2;
+            data = realloc(data, cap);
+        }
+    }
+}
+
+static int forward(const char *socket_path, ServerKind kind, EidosTarget target, const char *path,
+                   const EidosOptions *options, const char *output_path, int *status) {
+    /*
+    --client: has the compile server do what this command line asks for
 
-    Token tok;
-    printf("Lexeme Token\n");
+    args:
+        *socket_path (char) -> server socket
+        kind (ServerKind) -> SERVER_COMPILE or SERVER_RUN
+        target (EidosTarget) -> what SERVER_COMPILE produces
+        *path (char) -> source file
+        *options (EidosOptions) -> optimizations from the command line
+        *output_path (char) -> -o, NULL for the default
+        *status (int) -> receives the exit status
 
-    // TODO: Driver logic 
-    do {
-        tok = next_token(&lexer);
+    returns:
+        (int) -> 1 if the server answered, 0 if none is listening
+    */
+    ServerRequest req;
+    memset(&req, 0, sizeof(req));
+    memcpy(req.magic, SERVER_REQUEST_MAGIC, 4);
+    req.kind = kind;
+    req.target = target;
+    req.flags = (options->fold ? 0 : SERVER_NO_FOLD) | (options->unroll ? 0 : SERVER_NO_UNROLL) |
+                (options->pe ? 0 : SERVER_NO_PE) | (options->cse ? 0 : SERVER_NO_CSE) |
+                (options->vectorize ? 0 : SERVER_NO_VECTORIZE) | (options->peephole ? 0 : SERVER_NO_PEEPHOLE);
+    req.unroll_full = options->unroll_full;
+    req.unroll_factor = options->unroll_factor;
+    req.unroll_budget = options->unroll_budget;
+    req.pe_steps = options->pe_steps;
+    req.pe_millis = options->pe_millis;
 
-        if (tok.lexeme) {
-            free((void *)tok.lexeme);
+    char *source = read_file(path);
+    size_t input_len = 0;
+    char *input = kind == SERVER_RUN ? read_stdin(&input_len) : NULL;
+    req.name_len = strlen(path);
+    req.passes_len = options->passes ? strlen(options->passes) : 0;
+    req.source_len = strlen(source);
+    req.input_len = input_len;
+
+    ServerResponse response;
+    char *diag, *output;
+    int sent = server_request(socket_path, &req, path, options->passes, source, input,
+                              &response, &diag, &output);
+    eidos_free(source);
+    free(input);
+    if (sent == -1) {
+        return 0;
+    }
+    if (sent != 0) {
+        fprintf(stderr, "Error: Lost the connection to the compile server\n");
+        *status = 1;
+        return 1;
+    }
+
+    *status = response.status == EIDOS_OK ? 0 : response.status == EIDOS_BAD_OPTIONS ? -1 : 1;
+    if (kind == SERVER_RUN) {
+        // what the program printed comes before its runtime error, as with --run
+        fwrite(output, 1, response.output_len, stdout);
+        fflush(stdout);
+        fputs(diag, stderr);
+    } else {
+        fputs(diag, stderr);
+        if (response.status == EIDOS_OK && target == EIDOS_TARGET_IMAGE) {
+            char *image_path = output_path ? strdup(output_path) : image_path_for(path);
+            FILE *f = fopen(image_path, "wb");
+            if (!f || fwrite(output, 1, response.output_len, f) != response.output_len || fclose(f) != 0) {
+                fprintf(stderr, "Error: Failed to write %s\n", image_path);
+                *status = 1;
+            }
+            free(image_path);
+        } else if (response.status == EIDOS_OK && target == EIDOS_TARGET_C && output_path) {
+            FILE *f = fopen(output_path, "w");
+            if (!f) {
+                perror("fopen");
+                *status = 1;
+            } else {
+                fwrite(output, 1, response.output_len, f);
+                fclose(f);
+            }
+        } else if (response.status == EIDOS_OK) {
+            fwrite(output, 1, response.output_len, stdout);
         }
-    } while (tok.tokenType != EOF_TOK);
+    }
 
-    free(source);
+    free(diag);
+    free(output);
+    return 1;
+}
 
+static int control(const char *socket_path, ServerKind kind) {
+    /*
+    --server-stats / --server-stop
+
+    args:
+        *socket_path (char) -> server socket
+        kind (ServerKind) -> SERVER_STATS or SERVER_STOP
+
+    returns:
+        (int) -> exit status
+    */
+    ServerRequest req;
+    memset(&req, 0, sizeof(req));
+    memcpy(req.magic, SERVER_REQUEST_MAGIC, 4);
+    req.kind = kind;
+
+    ServerResponse response;
+    char *diag, *output;
+    if (server_request(socket_path, &req, "", "", "", "", &response, &diag, &output) != 0) {
+        fprintf(stderr, "ERROR: No compile server answers on %s.\n", socket_path);
+        return 1;
+    }
+    fputs(output, stdout);
+    free(diag);
+    free(output);
     return 0;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: eidos [options] <file.e>\n");
+    fprintf(stderr, "       eidos compile <file.e> [-o file.eidb] [options]\n");
+    fprintf(stderr, "       eidos run <file.eidb | file.e> [options]\n");
+    fprintf(stderr, "       eidos compile|--emit-c|--dump-ir <file.e | @list>... [--jobs=N] [options]\n");
+    fprintf(stderr, "       eidos --server [--socket=PATH] [--jobs=N] [--cache-size=MB] [--run-steps=N]\n");
+    fprintf(stderr, "       eidos --client [--socket=PATH] <any single-file command line>\n");
+    fprintf(stderr, "       eidos --server-stats | --server-stop [--socket=PATH]\n");
+    fprintf(stderr, "  (no options)         print every lexeme and its token\n");
+    fprintf(stderr, "  --dump-ast           parse and print the optimized AST\n");
+    fprintf(stderr, "  --dump-ir            print the SSA IR after the pass pipeline\n");
+    fprintf(stderr, "  --run                run the program\n");
+    fprintf(stderr, "  --profile            run the program and report its hottest lines and loops\n");
+    fprintf(stderr, "  --profile-folded=FILE  also write folded stacks for flame graphs (implies --profile)\n");
+    fprintf(stderr, "  --profile-gen=FILE   run the program and record its branch and loop counts in FILE\n");
+    fprintf(stderr, "  --profile-use=FILE   optimize with the counts recorded in FILE\n");
+    fprintf(stderr, "  --emit-c             compile to C (stdout, or the file given with -o)\n");
+    fprintf(stderr, "  -o FILE              where --emit-c or compile writes to\n");
+    fprintf(stderr, "  --stream             with --emit-c: translate statement by statement in bounded memory,\n");
+    fprintf(stderr, "                       without the AST and IR optimizations\n");
+    fprintf(stderr, "  --parallel-loops     with --emit-c: run for loops with independent iterations on threads\n");
+    fprintf(stderr, "                       (compile the C with -pthread, EIDOS_THREADS sets the thread count)\n");
+    fprintf(stderr, "  --parallel-min-trips=N  fewest iterations a loop runs in parallel with (default 10000)\n");
+    fprintf(stderr, "  --stats              print optimizer statistics and per-pass timing\n");
+    fprintf(stderr, "  --time-report        print wall time, CPU time and allocations of every phase\n");
+    fprintf(stderr, "  --perf-counters      add cycles, instructions, branch and cache misses (implies --time-report)\n");
+    fprintf(stderr, "  --no-fold            skip constant folding and propagation\n");
+    fprintf(stderr, "  --passes=LIST        comma separated IR passes to run, or 'none'\n");
+    fprintf(stderr, "  --no-unroll          skip loop unrolling\n");
+    fprintf(stderr, "  --unroll-full=N      fully unroll loops of at most N trips (default 16)\n");
+    fprintf(stderr, "  --unroll-factor=N    bodies per iteration for longer loops, 1 to disable (default 4)\n");
+    fprintf(stderr, "  --unroll-budget=N    AST nodes unrolling may add (default 4096)\n");
+    fprintf(stderr, "  --no-pe              don't precompute the read-free start of the program\n");
+    fprintf(stderr, "  --pe-steps=N         instructions precomputing may execute (default 50000000)\n");
+    fprintf(stderr, "  --pe-time=MS         milliseconds precomputing may take (default 1000)\n");
+    fprintf(stderr, "  --no-cse             don't share repeated expressions or reuse their values\n");
+    fprintf(stderr, "  --no-vectorize       with --emit-c: no vector kernels for loops over arrays\n");
+    fprintf(stderr, "  --no-peephole        with compile: one bytecode instruction per IR instruction, no peephole pass\n");
+    fprintf(stderr, "  --jobs=N             threads compiling several files or serving (default: one per CPU),\n");
+    fprintf(stderr, "                       or parsing a large file (default: 1)\n");
+    fprintf(stderr, "  --socket=PATH        compile server socket (default $EIDOS_SOCKET or /tmp/eidos-UID.sock)\n");
+    fprintf(stderr, "  --cache-size=MB      memory the server may cache results in (default 64, 0 for none)\n");
+    fprintf(stderr, "  --run-steps=N        instructions a program run by the server may execute, 0 for no limit (default 1000000000)\n");
+}
+
+int main(int argc, char *argv[]) {
+
+    const char *path = NULL;
+    size_t ninputs = 0;
+    size_t jobs = 0;
+    const char *passes = NULL;
+    int dump_ast = 0;
+    int dump_ir = 0;
+    int run = 0;
+    int profile = 0;
+    const char *folded_path = NULL;
+    const char *profile_gen = NULL;
+    const char *profile_use = NULL;
+    int print_stats = 0;
+    int fold = 1;
+    int unroll = 1;
+    int emit_c = 0;
+    int stream = 0;
+    int parallel_loops = 0;
+    size_t parallel_min_trips = 10000;
+    int time_report = 0;
+    int perf_counters = 0;
+    const char *output_path = NULL;
+    int pe = 1;
+    int cse = 1;
+    int vectorize = 1;
+    int peephole = 1;
+    int compile = 0;
+    int run_command = 0;
+    int server = 0;
+    int client = 0;
+    int server_control = -1;
+    ServerOptions server_options = { NULL, 0, 64u << 20, SERVER_RUN_STEPS };
+    UnrollOptions unroll_options;
+    unroll_default_options(&unroll_options);
+    PEOptions pe_options;
+    pe_default_options(&pe_options);
+
+    // `eidos --client compile ...` forwards the subcommand too
+    int first = 1;
+    if (argc > 1 && strcmp(argv[1], "--client") == 0) {
+        client = 1;
+        first = 2;
+    }
+    if (argc > first && strcmp(argv[first], "compile") == 0) {
+        compile = 1;
+        first++;
+    } else if (argc > first && strcmp(argv[first], "run") == 0) {
+        run_command = 1;
+        first++;
+    }
+
+    // source files are gathered at the front of argv, past the subcommand
+    char **inputs = argv + first;
+    for (int i = first; i < argc; i++) {
+        if (strcmp(argv[i], "--dump-ast") == 0) {
+            dump_ast = 1;
+        } else if (strcmp(argv[i], "--dump-ir") == 0) {
+            dump_ir = 1;
+        } else if (strcmp(argv[i], "--run") == 0) {
+            run = 1;
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            run = 1;
+            profile = 1;
+        } else if (strncmp(argv[i], "--profile-folded=", 17) == 0) {
+            run = 1;
+            profile = 1;
+            folded_path = argv[i] + 17;
+        } else if (strncmp(argv[i], "--profile-gen=", 14) == 0) {
+            run = 1;
+            profile_gen = argv[i] + 14;
+        } else if (strncmp(argv[i], "--profile-use=", 14) == 0) {
+            profile_use = argv[i] + 14;
+        } else if (strcmp(argv[i], "--emit-c") == 0) {
+            emit_c = 1;
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            stream = 1;
+        } else if (strcmp(argv[i], "--parallel-loops") == 0) {
+            parallel_loops = 1;
+        } else if (strncmp(argv[i], "--parallel-min-trips=", 21) == 0) {
+            if (!parse_size_option(argv[i] + 21, &parallel_min_trips) || parallel_min_trips == 0) {
+                fprintf(stderr, "ERROR: Bad value in '%s'.\n", argv[i]);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "-o") == 0) {
+            if (i + 1 == argc) {
+                fprintf(stderr, "ERROR: -o needs a file name.\n");
+                return -1;
+            }
+            output_path = argv[++i];
+        } else if (strncmp(argv[i], "--passes=", 9) == 0) {
+            passes = argv[i] + 9;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            print_stats = 1;
+        } else if (strcmp(argv[i], "--time-report") == 0) {
+            time_report = 1;
+        } else if (strcmp(argv[i], "--perf-counters") == 0) {
+            time_report = 1;
+            perf_counters = 1;
+        } else if (strcmp(argv[i], "--no-fold") == 0) {
+            fold = 0;
+        } else if (strcmp(argv[i], "--no-unroll") == 0) {
+            unroll = 0;
+        } else if (strncmp(argv[i], "--unroll-full=", 14) == 0) {
+            if (!parse_size_option(argv[i] + 14, &unroll_options.max_full_trips)) {
+                fprintf(stderr, "ERROR: Bad value in '%s'.\n", argv[i]);
+                return -1;
+            }
+        } else if (strncmp(argv[i], "--unroll-factor=", 16) == 0) {
+            if (!parse_size_option(argv[i] + 16, &unroll_options.factor)) {
+                fprintf(stderr, "ERROR: Bad value in '%s'.\n", argv[i]);
+                return -1;
+            }
+        } else if (strncmp(argv[i], "--unroll-budget=", 16) == 0) {
+            if (!parse_size_option(argv[i] + 16, &unroll_options.budget)) {
+                fprintf(stderr, "ERROR: Bad value in '%s'.\n", argv[i]);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--no-pe") == 0) {
+            pe = 0;
+        } else if (strncmp(argv[i], "--pe-steps=", 11) == 0) {
+            size_t steps;
+            if (!parse_size_option(argv[i] + 11, &steps)) {
+                fprintf(stderr, "ERROR: Bad value in '%s'.\n", argv[i]);
+                return -1;
+            }
+            pe_options.max_insts = steps;
+        } else if (strncmp(argv[i], "--pe-time=", 10) == 0) {
+            size_t millis;
+            if (!parse_size_option(argv[i] + 10, &millis)) {
+                fprintf(stderr, "ERROR: Bad value in '%s'.\n", argv[i]);
+                return -1;
+            }
+            pe_options.max_millis = (double)millis;
+        } else if (strcmp(argv[i], "--no-cse") == 0) {
+            cse = 0;
+        } else if (strcmp(argv[i], "--no-vectorize") == 0) {
+            vectorize = 0;
+        } else if (strcmp(argv[i], "--no-peephole") == 0) {
+            peephole = 0;
+        } else if (strncmp(argv[i], "--jobs=", 7) == 0) {
+            if (!parse_size_option(argv[i] + 7, &jobs) || jobs == 0) {
+                fprintf(stderr, "ERROR: Bad value in '%s'.\n", argv[i]);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--server") == 0) {
+            server = 1;
+        } else if (strcmp(argv[i], "--client") == 0) {
+            client = 1;
+        } else if (strcmp(argv[i], "--server-stats") == 0) {
+            server_control = SERVER_STATS;
+        } else if (strcmp(argv[i], "--server-stop") == 0) {
+            server_control = SERVER_STOP;
+        } else if (strncmp(argv[i], "--socket=", 9) == 0) {
+            server_options.socket_path = argv[i] + 9;
+        } else if (strncmp(argv[i], "--cache-size=", 13) == 0) {
+            size_t megabytes;
+            if (!parse_size_option(argv[i] + 13, &megabytes)) {
+                fprintf(stderr, "ERROR: Bad value in '%s'.\n", argv[i]);
+                return -1;
+            }
+            server_options.cache_bytes = megabytes << 20;
+        } else if (strncmp(argv[i], "--run-steps=", 12) == 0) {
+            size_t steps;
+            if (!parse_size_option(argv[i] + 12, &steps)) {
+                fprintf(stderr, "ERROR: Bad value in '%s'.\n", argv[i]);
+                return -1;
+            }
+            server_options.run_steps = steps;
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "ERROR: Unknown option '%s'.\n", argv[i]);
+            usage();
+            return -1;
+        } else {
+            inputs[ninputs++] = argv[i];
+        }
+    }
+
+    if (!server_options.socket_path) {
+        server_options.socket_path = server_default_socket();
+    }
+    if (server) {
+        server_options.threads = jobs;
+        return server_main(&server_options);
+    }
+    if (server_control >= 0) {
+        return control(server_options.socket_path, (ServerKind)server_control);
+    }
+
+#ifdef EIDOS_NO_TIME_REPORT
+    if (time_report) {
+        fprintf(stderr, "ERROR: This eidos was built without --time-report.\n");
+        return -1;
+    }
+#endif
+
+    if (ninputs == 0) {
+        printf("ERROR: File not given. Exiting Now.\n");
+        usage();
+        return -2;
+    }
+
+    EidosOptions compile_options;
+    eidos_default_options(&compile_options);
+    compile_options.passes = passes;
+    compile_options.fold = fold;
+    compile_options.unroll = unroll;
+    compile_options.pe = pe;
+    compile_options.cse = cse;
+    compile_options.vectorize = vectorize;
+    compile_options.peephole = peephole;
+    compile_options.unroll_full = unroll_options.max_full_trips;
+    compile_options.unroll_factor = unroll_options.factor;
+    compile_options.unroll_budget = unroll_options.budget;
+    compile_options.pe_steps = pe_options.max_insts;
+    compile_options.pe_millis = pe_options.max_millis;
+
+    if (parallel_loops && (!emit_c || stream)) {
+        fprintf(stderr, "ERROR: --parallel-loops only goes with --emit-c, without --stream.\n");
+        return -1;
+    }
+
+    if (stream) {
+        if (!emit_c || compile || run || run_command || dump_ast || dump_ir) {
+            fprintf(stderr, "ERROR: --stream only goes with --emit-c.\n");
+            return -1;
+        }
+        if (ninputs > 1 || inputs[0][0] == '@') {
+            fprintf(stderr, "ERROR: --stream takes a single source file.\n");
+            return -1;
+        }
+        time_report_init(&report, time_report, perf_counters);
+        return stream_main(inputs[0], output_path, print_stats);
+    }
+
+    if (ninputs > 1 || inputs[0][0] == '@') {
+        if (output_path) {
+            fprintf(stderr, "ERROR: -o takes a single source file.\n");
+            return -1;
+        }
+        if (run || run_command || dump_ast || time_report || profile_use || parallel_loops) {
+            fprintf(stderr, "ERROR: --run, --profile, --profile-gen, --profile-use, --parallel-loops, --dump-ast "
+                            "and --time-report take a single source file.\n");
+            return -1;
+        }
+        return batch_main(inputs, ninputs, passes, compile, emit_c, dump_ir,
+                          &compile_options, jobs, print_stats);
+    }
+    path = inputs[0];
 
-    
-}
\ No newline at end of file
+    // the server does one thing per request; anything else, or no server, runs here
+    int modes = emit_c + compile + dump_ir + (run || run_command);
+    if (client && !dump_ast && !print_stats && !time_report && !profile && !profile_gen && !profile_use && !parallel_loops && modes <= 1 && !(run_command && bc_is_image(path))) {
+        ServerKind kind = run || run_command ? SERVER_RUN : SERVER_COMPILE;
+        EidosTarget target = emit_c ? EIDOS_TARGET_C : compile ? EIDOS_TARGET_IMAGE
+                           : dump_ir ? EIDOS_TARGET_IR : EIDOS_TARGET_TOKENS;
+        int status;
+        if (forward(server_options.socket_path, kind, target, path, &compile_options, output_path, &status)) {
+            return status;
+        }
+    }
+
+    // unrolled copies of a statement would each get their own share of its counts
+    if (profile || profile_gen) {
+        unroll = 0;
+        compile_options.unroll = 0;
+    }
+
+    time_report_init(&report, time_report, perf_counters);
+
+    // a compiled image runs as-is, there is nothing to lex or parse
+    if (run_command && bc_is_image(path)) {
+        if (profile || profile_gen) {
+            fprintf(stderr, "ERROR: --profile and --profile-gen run source files, not compiled images.\n");
+            return -1;
+        }
+        return run_image(path, print_stats);
+    }
+    if (run_command) {
+        run = 1;
+    }
+
+    TIME_BEGIN(&report, TIME_READ);
+    char *source = read_file(path);
+    TIME_END(&report);
+
+    // legacy mode: dump lexemes, this is what test_lexer.sh checks against
+    if (!dump_ast && !dump_ir && !run && !print_stats && !emit_c && !compile) {
+        Lexer lexer;
+        init_lexer(&lexer, source);
+        Token tok;
+        lexer.trace = stdout;
+        printf("Lexeme Token\n");
+
+        TIME_BEGIN(&report, TIME_LEX);
+        do {
+            tok = next_token(&lexer);
+
+            if (tok.lexeme) {
+                eidos_free((void *)tok.lexeme);
+            }
+        } while (tok.tokenType != EOF_TOK);
+        TIME_END(&report);
+
+        eidos_free(source);
+        time_report_finish(&report, stderr);
+        return 0;
+    }
+
+    // the same pipeline as libeidos, timed into the report
+    Pipeline pipeline;
+    if (pipeline_init(&pipeline, &compile_options) != EIDOS_OK) {
+        eidos_free(source);
+        return -1;
+    }
+    pipeline.report = &report;
+    // it takes more memory and was never measured faster, so only --jobs=N asks for it
+    pipeline.parse_jobs = jobs > 1 ? jobs : 1;
+    // precomputed output only makes sense for a compiled artifact, --run runs everything
+    pipeline.pe = pe && (emit_c || compile) && !run;
+
+    if (pipeline_parse(&pipeline, source) != EIDOS_OK) {
+        pipeline_free(&pipeline);
+        eidos_free(source);
+        time_report_finish(&report, stderr);
+        return 1;
+    }
+    ASTNode *program = pipeline.program;
+
+    // records are keyed by the tree as written, before anything rewrites it
+    PGOProfile pgo;
+    int use_pgo = profile_gen || profile_use;
+    if (use_pgo) {
+        pgo_init(&pgo, program, source);
+    }
+    if (profile_use) {
+        if (pgo_load(&pgo, profile_use) != 0) {
+            pgo_free(&pgo);
+            pipeline_free(&pipeline);
+            eidos_free(source);
+            return -1;
+        }
+        if (pgo.stale) {
+            fprintf(stderr, "pgo: %zu stale records ignored, their statements changed since %s was recorded\n",
+                    pgo.stale, profile_use);
+        }
+        pipeline.unroll_options.loop_factor = pgo_unroll_factor;
+        pipeline.unroll_options.loop_factor_user = &pgo;
+    }
+
+    int status = pipeline_optimize(&pipeline) == EIDOS_OK ? 0 : 1;
+    const PEResult *pe_result = &pipeline.pe_result;
+    int use_pe = pipeline.pe && status == 0;
+
+    if (dump_ast) {
+        ast_dump(program, stdout);
+    }
+
+    if (print_stats) {
+        parse_print_stats(&pipeline.parse_stats, stderr);
+    }
+    if (print_stats && fold) {
+        fold_print_stats(&pipeline.fold_stats, stderr);
+    }
+    if (print_stats && unroll) {
+        unroll_print_stats(&pipeline.unroll_stats, stderr);
+    }
+    if (print_stats && use_pe) {
+        pe_print_stats(pe_result, stderr);
+    }
+    if (print_stats && cse && status == 0) {
+        hashcons_print_stats(&pipeline.hashcons_stats, stderr);
+    }
+
+    FILE *c_out = NULL;
+    CEmitOptions c_options = { path, pe_result->output, pe_result->output_len, parallel_loops, parallel_min_trips,
+                               vectorize };
+    if (emit_c && status == 0) {
+        c_out = output_path ? fopen(output_path, "w") : stdout;
+        if (!c_out) {
+            perror("fopen");
+            status = 1;
+        }
+    }
+
+    FILE *image_out = NULL;
+    char *image_path = NULL;
+    if (compile && status == 0) {
+        image_path = output_path && !emit_c ? strdup(output_path) : image_path_for(path);
+        image_out = fopen(image_path, "wb");
+        if (!image_out) {
+            perror("fopen");
+            status = 1;
+        }
+    }
+
+    // a fully precomputed program has no code left to compile
+    if (c_out && pe_result->complete) {
+        TIME_BEGIN(&report, TIME_EMIT_C);
+        c_emit_program(NULL, &c_options, c_out);
+        TIME_END(&report);
+    }
+    if (image_out && pe_result->complete) {
+        TIME_BEGIN(&report, TIME_BYTECODE);
+        if (bc_write_image(NULL, pe_result->output, pe_result->output_len, peephole, NULL, image_out) != 0) {
+            status = 1;
+        }
+        TIME_END(&report);
+    }
+
+    // everything past the AST works on the SSA IR
+    int lower = c_out || image_out;
+    if (status == 0 && (dump_ir || run || print_stats || (lower && !pe_result->complete))) {
+        if (pipeline_lower(&pipeline) != EIDOS_OK) {
+            status = 1;
+        } else {
+            IRFunction *fn = pipeline.fn;
+            if (profile_use) {
+                pgo_annotate(&pgo, fn);
+            }
+
+            if (dump_ir) {
+                ir_dump(fn, stdout);
+            }
+            if (c_out && !pe_result->complete) {
+                TIME_BEGIN(&report, TIME_EMIT_C);
+                size_t parallel = c_emit_program(fn, &c_options, c_out);
+                TIME_END(&report);
+                if (print_stats && parallel_loops) {
+                    fprintf(stderr, "parallel: %zu loops run on threads\n", parallel);
+                }
+                if (print_stats && vectorize) {
+                    IRVecLoop *vecs;
+                    size_t nvecs = ir_find_vec_loops(fn, &vecs);
+                    fprintf(stderr, "vector: %zu loops run in vector kernels\n", nvecs);
+                    ir_free_vec_loops(vecs, nvecs);
+                }
+            }
+            if (image_out && !pe_result->complete) {
+                BCPeepholeStats peephole_stats;
+                TIME_BEGIN(&report, TIME_BYTECODE);
+                if (bc_write_image(fn, pe_result->output, pe_result->output_len, peephole, &peephole_stats, image_out) != 0) {
+                    status = 1;
+                }
+                TIME_END(&report);
+                if (print_stats && peephole) {
+                    bc_print_peephole_stats(&peephole_stats, stderr);
+                }
+            }
+            if (print_stats) {
+                fprintf(stderr, "ir: %zu -> %zu blocks, %zu -> %zu values\n", pipeline.blocks_before,
+                        ir_count_blocks(fn), pipeline.insts_before, ir_count_insts(fn));
+                if (cse) {
+                    fprintf(stderr, "cse: %zu expressions reused\n", fn->cse_reused);
+                }
+                ir_pm_print_stats(&pipeline.pm, stderr);
+            }
+            if (run) {
+                IRExecStats exec;
+                IRProfile prof;
+                TIME_BEGIN(&report, TIME_RUN);
+                if (profile || profile_gen) {
+                    status = sampler_run(fn, stdin, stdout, &exec, profile_gen != NULL, &prof);
+                } else {
+                    status = ir_interpret(fn, stdin, stdout, &exec);
+                }
+                TIME_END(&report);
+                if (profile) {
+                    ir_profile_report(fn, &prof, source, 20, stderr);
+                    if (folded_path && write_folded(fn, &prof, path, folded_path) != 0) {
+                        status = 1;
+                    }
+                }
+                if (profile_gen) {
+                    pgo_record_run(&pgo, fn, &prof);
+                    if (pgo_write(&pgo, profile_gen) != 0) {
+                        status = 1;
+                    }
+                }
+                if (profile || profile_gen) {
+                    ir_profile_free(&prof);
+                }
+                if (print_stats) {
+                    ir_print_exec_stats(&exec, stderr);
+                }
+            }
+        }
+    }
+
+    if (c_out && c_out != stdout) {
+        fclose(c_out);
+    }
+    if (image_out && fclose(image_out) != 0) {
+        status = 1;
+    }
+    if (image_out && status != 0) {
+        fprintf(stderr, "Error: Failed to write %s\n", image_path);
+        remove(image_path);
+    }
+    if (print_stats && profile_use) {
+        pgo_print_stats(&pgo, stderr);
+    }
+    if (use_pgo) {
+        pgo_free(&pgo);
+    }
+    free(image_path);
+    pipeline_free(&pipeline);
+    eidos_free(source);
+
+    time_report_finish(&report, stderr);
+    return status;
+}
@@ -0,0 +1,533 @@
+#include "fold.h"
+#include "../util/context.h"
+#include "../util/arith.h"
+#include "../util/strmap.h"
+#include <string.h>
+
+// Per variable facts gathered before folding
+typedef struct VarInfo {
+    size_t defs;        // places that write the variable: let, =, ++/--, read, for init
+    int bound;          // 1 while its constant value is known to be in effect
+    int64_t value;      // the constant, valid while bound
+} VarInfo;
+
+typedef struct FoldState {
+    StrMap names;       // variable name -> index into vars
+    VarInfo *vars;
+    size_t var_count;
+    size_t var_cap;
+
+    size_t *scope;      // indices of vars bound so far, unwound at block exit
+    size_t scope_len;
+    size_t scope_cap;
+
+    const StrMap *arrays;   // array name -> number of elements, every array is top level
+    FoldStats *stats;
+} FoldState;
+
+/* ===== Helper Functions ===== */
+
+/*
+Returns the VarInfo for a name, creating it on first sight
+
+args:
+    *st (FoldState) -> fold state
+    *name (char) -> variable name
+
+returns:
+    (VarInfo*) -> info record for name
+*/
+static VarInfo *var_info(FoldState *st, const char *name) {
+    size_t idx;
+    if (strmap_get(&st->names, name, &idx)) {
+        return &st->vars[idx];
+    }
+
+    if (st->var_count == st->var_cap) {
+        st->var_cap = st->var_cap ? st->var_cap * 2 : 16;
+        st->vars = eidos_realloc(st->vars, st->var_cap * sizeof(VarInfo));
+        if (!st->vars) {
+            eidos_fatal("Failed to allocate fold variable table");
+        }
+    }
+
+    idx = st->var_count++;
+    st->vars[idx].defs = 0;
+    st->vars[idx].bound = 0;
+    st->vars[idx].value = 0;
+    strmap_put(&st->names, name, idx);
+
+    return &st->vars[idx];
+}
+
+/*
+Counts every definition of every variable in the subtree
+
+args:
+    *st (FoldState) -> fold state
+    *node (ASTNode) -> subtree to scan
+*/
+static void count_defs(FoldState *st, const ASTNode *node) {
+    for (; node && node->type == AST_STMTS_NODE; node = node->data.stmts.next) {
+        count_defs(st, node->data.stmts.stmt);
+    }
+
+    if (!node) {
+        return;
+    }
+
+    switch (node->type) {
+    case AST_PROGRAM_NODE:
+        count_defs(st, node->data.program.stmts);
+        break;
+    case AST_VAR_DECL_NODE:
+        var_info(st, node->data.var_decl.identifer)->defs++;
+        break;
+    case AST_ASSIGN_NODE:
+        var_info(st, node->data.assignment.identifier)->defs++;
+        break;
+    case AST_READ_NODE:
+        var_info(st, node->data.read_stmt.identifier)->defs++;
+        break;
+    case AST_UNARY_EXPR:
+        if (node->data.unary_expr.operand->type == AST_IDENTIFIER_NODE &&
+            (strcmp(node->data.unary_expr.op, "++") == 0 || strcmp(node->data.unary_expr.op, "--") == 0)) {
+            var_info(st, node->data.unary_expr.operand->data.identifier.name)->defs++;
+        }
+        break;
+    case AST_IF_STMT_NODE:
+        count_defs(st, node->data.if_stmt.then_block);
+        count_defs(st, node->data.if_stmt.else_block);
+        break;
+    case AST_FOR_LOOP_NODE:
+        count_defs(st, node->data.for_loop.initializer);
+        count_defs(st, node->data.for_loop.step);
+        count_defs(st, node->data.for_loop.for_block);
+        break;
+    case AST_WHILE_LOOP_NODE:
+        count_defs(st, node->data.while_loop.while_block);
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+Marks a single-definition variable as holding a known constant until the
+enclosing block is left
+
+args:
+    *st (FoldState) -> fold state
+    *name (char) -> variable name
+    value (int64_t) -> its constant value
+*/
+static void bind_constant(FoldState *st, const char *name, int64_t value) {
+    size_t idx;
+    strmap_get(&st->names, name, &idx);     // count_defs saw every name
+
+    if (st->vars[idx].defs != 1) {
+        return;
+    }
+
+    if (st->scope_len == st->scope_cap) {
+        st->scope_cap = st->scope_cap ? st->scope_cap * 2 : 16;
+        st->scope = eidos_realloc(st->scope, st->scope_cap * sizeof(size_t));
+        if (!st->scope) {
+            eidos_fatal("Failed to allocate fold scope stack");
+        }
+    }
+
+    st->vars[idx].bound = 1;
+    st->vars[idx].value = value;
+    st->scope[st->scope_len++] = idx;
+}
+
+/*
+Replaces an expression node by a literal, keeping its source position
+
+args:
+    *node (ASTNode) -> node to replace, freed
+    value (int64_t) -> value of the literal
+
+returns:
+    (ASTNode*) -> the new literal node
+*/
+static ASTNode *replace_with_literal(ASTNode *node, int64_t value) {
+    ASTNode *lit = ast_new_int_lit(value, node->line, node->col);
+    ast_free(node);
+    return lit;
+}
+
+static int is_literal(const ASTNode *node) {
+    return node && node->type == AST_INTAGER_LIT_NODE;
+}
+
+/*
+Reports a constant index outside its array, which could only trap at run time
+
+args:
+    *st (FoldState) -> fold state
+    *node (ASTNode) -> the indexing node, for its position
+    *name (char) -> array indexed
+    *index (ASTNode) -> the folded index
+*/
+static void check_index(FoldState *st, const ASTNode *node, const char *name, const ASTNode *index) {
+    size_t size;
+    if (!is_literal(index) || !strmap_get(st->arrays, name, &size)) {
+        return;
+    }
+
+    int64_t i = index->data.int_lit.value;
+    if (i < 0 || (uint64_t)i >= size) {
+        eidos_diag("Error at line %zu, column %zu: index %lld is out of bounds of array '%s' of %zu elements\n",
+                node->line, node->col, (long long)i, name, size);
+        st->stats->errors++;
+    }
+}
+
+/*
+Folds an expression bottom up
+
+args:
+    *st (FoldState) -> fold state
+    *node (ASTNode) -> expression to fold, may be freed
+
+returns:
+    (ASTNode*) -> the folded expression (node itself or its replacement)
+*/
+static ASTNode *fold_expr(FoldState *st, ASTNode *node) {
+    if (!node) {
+        return NULL;
+    }
+
+    switch (node->type) {
+
+    case AST_IDENTIFIER_NODE: {
+        size_t idx;
+        if (strmap_get(&st->names, node->data.identifier.name, &idx) && st->vars[idx].bound) {
+            st->stats->constants_propagated++;
+            return replace_with_literal(node, st->vars[idx].value);
+        }
+        return node;
+    }
+
+    case AST_UNARY_EXPR: {
+        const char *op = node->data.unary_expr.op;
+
+        // ++/-- write their operand, it must stay an identifier
+        if (strcmp(op, "++") == 0 || strcmp(op, "--") == 0) {
+            return node;
+        }
+
+        node->data.unary_expr.operand = fold_expr(st, node->data.unary_expr.operand);
+        if (!is_literal(node->data.unary_expr.operand)) {
+            return node;
+        }
+
+        int64_t v = node->data.unary_expr.operand->data.int_lit.value;
+        st->stats->nodes_folded++;
+        return replace_with_literal(node, op[0] == '-' ? eidos_neg(v) : eidos_not(v));
+    }
+
+    case AST_BINARY_EXPR: {
+        node->data.binary_expr.left = fold_expr(st, node->data.binary_expr.left);
+        node->data.binary_expr.right = fold_expr(st, node->data.binary_expr.right);
+
+        ASTNode *left = node->data.binary_expr.left;
+        ASTNode *right = node->data.binary_expr.right;
+        char op = node->data.binary_expr.op[0];
+
+        if (op == '/' && is_literal(right) && right->data.int_lit.value == 0) {
+            eidos_diag("Error at line %zu, column %zu: division by constant zero\n",
+                    node->line, node->col);
+            st->stats->errors++;
+            return node;
+        }
+
+        if (!is_literal(left) || !is_literal(right)) {
+            return node;
+        }
+
+        int64_t a = left->data.int_lit.value;
+        int64_t b = right->data.int_lit.value;
+        int64_t result = 0;
+
+        switch (op) {
+        case '+': result = eidos_add(a, b); break;
+        case '-': result = eidos_sub(a, b); break;
+        case '*': result = eidos_mul(a, b); break;
+        case '/': result = eidos_div(a, b); break;
+        default:  return node;
+        }
+
+        st->stats->nodes_folded++;
+        return replace_with_literal(node, result);
+    }
+
+    case AST_CALL_EXPR:
+        for (size_t i = 0; i < node->data.call_expr.nargs; i++) {
+            node->data.call_expr.args[i] = fold_expr(st, node->data.call_expr.args[i]);
+        }
+        return node;
+
+    case AST_INDEX_EXPR:
+        // elements aren't tracked, only the index folds
+        node->data.index_expr.index = fold_expr(st, node->data.index_expr.index);
+        check_index(st, node, node->data.index_expr.identifier, node->data.index_expr.index);
+        return node;
+
+    case AST_CONDITIONAL_NODE: {
+        node->data.conditional.left_expression = fold_expr(st, node->data.conditional.left_expression);
+        node->data.conditional.right_expression = fold_expr(st, node->data.conditional.right_expression);
+
+        ASTNode *left = node->data.conditional.left_expression;
+        ASTNode *right = node->data.conditional.right_expression;
+        CmpOp op;
+
+        if (!is_literal(left) || !is_literal(right) ||
+            !cmp_op_from_lexeme(node->data.conditional.comparison_op, &op)) {
+            return node;
+        }
+
+        st->stats->nodes_folded++;
+        return replace_with_literal(node, eidos_compare(op, left->data.int_lit.value,
+                                                          right->data.int_lit.value));
+    }
+
+    default:
+        return node;
+    }
+}
+
+static void fold_block(FoldState *st, ASTNode **link);
+static void fold_fn(ASTNode *fn, const StrMap *arrays, FoldStats *stats);
+
+/*
+Folds one statement
+
+args:
+    *st (FoldState) -> fold state
+    *stmt (ASTNode) -> statement to fold
+    **replacement (ASTNode) -> set to the statement list replacing stmt (may be NULL)
+
+returns:
+    (int) -> 1 if stmt was consumed and *replacement should be spliced in its place
+*/
+static int fold_stmt(FoldState *st, ASTNode *stmt, ASTNode **replacement) {
+    switch (stmt->type) {
+
+    case AST_VAR_DECL_NODE:
+        stmt->data.var_decl.value = fold_expr(st, stmt->data.var_decl.value);
+        if (is_literal(stmt->data.var_decl.value)) {
+            bind_constant(st, stmt->data.var_decl.identifer, stmt->data.var_decl.value->data.int_lit.value);
+        }
+        return 0;
+
+    case AST_ASSIGN_NODE:
+        stmt->data.assignment.value = fold_expr(st, stmt->data.assignment.value);
+        return 0;
+
+    case AST_INDEX_ASSIGN_NODE:
+        stmt->data.index_assign.index = fold_expr(st, stmt->data.index_assign.index);
+        stmt->data.index_assign.value = fold_expr(st, stmt->data.index_assign.value);
+        check_index(st, stmt, stmt->data.index_assign.identifier, stmt->data.index_assign.index);
+        return 0;
+
+    case AST_PRINT_NODE:
+        stmt->data.print_stmt.expression = fold_expr(st, stmt->data.print_stmt.expression);
+        return 0;
+
+    case AST_IF_STMT_NODE: {
+        stmt->data.if_stmt.condition = fold_expr(st, stmt->data.if_stmt.condition);
+
+        if (!is_literal(stmt->data.if_stmt.condition)) {
+            fold_block(st, &stmt->data.if_stmt.then_block);
+            fold_block(st, &stmt->data.if_stmt.else_block);
+            return 0;
+        }
+
+        // the surviving arm is spliced into the enclosing list and folded there
+        if (stmt->data.if_stmt.condition->data.int_lit.value != 0) {
+            *replacement = stmt->data.if_stmt.then_block;
+            stmt->data.if_stmt.then_block = NULL;
+        } else {
+            *replacement = stmt->data.if_stmt.else_block;
+            stmt->data.if_stmt.else_block = NULL;
+        }
+
+        ast_free(stmt);
+        st->stats->branches_removed++;
+        return 1;
+    }
+
+    case AST_WHILE_LOOP_NODE:
+        stmt->data.while_loop.condition = fold_expr(st, stmt->data.while_loop.condition);
+
+        if (is_literal(stmt->data.while_loop.condition) &&
+            stmt->data.while_loop.condition->data.int_lit.value == 0) {
+            *replacement = NULL;
+            ast_free(stmt);
+            st->stats->branches_removed++;
+            return 1;
+        }
+
+        fold_block(st, &stmt->data.while_loop.while_block);
+        return 0;
+
+    case AST_FOR_LOOP_NODE: {
+        ASTNode *init = stmt->data.for_loop.initializer;
+        init->data.assignment.value = fold_expr(st, init->data.assignment.value);
+        stmt->data.for_loop.condition = fold_expr(st, stmt->data.for_loop.condition);
+
+        if (is_literal(stmt->data.for_loop.condition) &&
+            stmt->data.for_loop.condition->data.int_lit.value == 0) {
+            // the initializer still runs once, keep it as a plain assignment
+            ASTNode *list = ast_new_node(AST_STMTS_NODE, init->line, init->col);
+            list->data.stmts.stmt = init;
+            list->data.stmts.next = NULL;
+            stmt->data.for_loop.initializer = NULL;
+
+            *replacement = list;
+            ast_free(stmt);
+            st->stats->branches_removed++;
+            return 1;
+        }
+
+        fold_block(st, &stmt->data.for_loop.for_block);
+        return 0;
+    }
+
+    case AST_FN_DECL_NODE:
+        fold_fn(stmt, st->arrays, st->stats);
+        return 0;
+
+    default:
+        return 0;
+    }
+}
+
+/*
+Folds a statement list in place, splicing in the arms of pruned branches
+
+args:
+    *st (FoldState) -> fold state
+    **link (ASTNode) -> pointer to the head of the list
+*/
+static void fold_stmts(FoldState *st, ASTNode **link) {
+    while (*link) {
+        ASTNode *item = *link;
+        ASTNode *replacement = NULL;
+
+        if (!fold_stmt(st, item->data.stmts.stmt, &replacement)) {
+            link = &item->data.stmts.next;
+            continue;
+        }
+
+        ASTNode *rest = item->data.stmts.next;
+        eidos_free(item);     // the statement itself was consumed by fold_stmt
+
+        if (replacement) {
+            ASTNode *tail = replacement;
+            while (tail->data.stmts.next) {
+                tail = tail->data.stmts.next;
+            }
+            tail->data.stmts.next = rest;
+            *link = replacement;    // not folded yet, the loop picks it up next
+        } else {
+            *link = rest;
+        }
+    }
+}
+
+/*
+Folds a nested block; constants declared inside stop being known when it ends
+
+args:
+    *st (FoldState) -> fold state
+    **link (ASTNode) -> pointer to the head of the block's list
+*/
+static void fold_block(FoldState *st, ASTNode **link) {
+    size_t saved = st->scope_len;
+
+    fold_stmts(st, link);
+
+    while (st->scope_len > saved) {
+        st->vars[st->scope[--st->scope_len]].bound = 0;
+    }
+}
+
+/*
+Folds a function's body and return value. They have variables of their own,
+so they get a state of their own; the parameters count as definitions.
+
+args:
+    *fn (ASTNode) -> AST_FN_DECL_NODE to rewrite in place
+    *arrays (StrMap) -> the program's arrays and their sizes
+    *stats (FoldStats) -> counters to add to
+*/
+static void fold_fn(ASTNode *fn, const StrMap *arrays, FoldStats *stats) {
+    FoldState st;
+    memset(&st, 0, sizeof(st));
+    strmap_init(&st.names);
+    st.arrays = arrays;
+    st.stats = stats;
+
+    for (size_t i = 0; i < fn->data.fn_decl.nparams; i++) {
+        var_info(&st, fn->data.fn_decl.params[i])->defs++;
+    }
+    count_defs(&st, fn->data.fn_decl.body);
+    fold_stmts(&st, &fn->data.fn_decl.body);
+    fn->data.fn_decl.ret = fold_expr(&st, fn->data.fn_decl.ret);
+
+    strmap_free(&st.names);
+    eidos_free(st.vars);
+    eidos_free(st.scope);
+}
+
+
+/* ========== PUBLIC API ========== */
+
+/*
+Constant folds and propagates over the whole program
+
+args:
+    *program (ASTNode) -> AST_PROGRAM_NODE to rewrite in place
+    *stats (FoldStats) -> counters to add to
+*/
+void fold_program(ASTNode *program, FoldStats *stats) {
+    StrMap arrays;
+    strmap_init(&arrays);
+    for (const ASTNode *item = program->data.program.stmts; item; item = item->data.stmts.next) {
+        const ASTNode *stmt = item->data.stmts.stmt;
+        if (stmt->type == AST_ARRAY_DECL_NODE && stmt->data.array_decl.size > 0) {
+            strmap_put(&arrays, stmt->data.array_decl.identifier, (size_t)stmt->data.array_decl.size);
+        }
+    }
+
+    FoldState st;
+    memset(&st, 0, sizeof(st));
+    strmap_init(&st.names);
+    st.arrays = &arrays;
+    st.stats = stats;
+
+    count_defs(&st, program);
+    fold_block(&st, &program->data.program.stmts);
+
+    strmap_free(&arrays);
+    strmap_free(&st.names);
+    eidos_free(st.vars);
+    eidos_free(st.scope);
+}
+
+/*
+Prints fold counters on one line
+
+args:
+    *stats (FoldStats) -> counters to print
+    *out (FILE) -> stream to print to
+*/
+void fold_print_stats(const FoldStats *stats, FILE *out) {
+    fprintf(out, "fold: %zu nodes folded, %zu constants propagated, %zu branches removed, %zu errors\n",
+            stats->nodes_folded, stats->constants_propagated,
+            stats->branches_removed, stats->errors);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+/*
+Constant folding and propagation over the AST.
+
+Runs right after parsing and rewrites the tree in place:
+- AST_BINARY_EXPR / AST_UNARY_EXPR / AST_CONDITIONAL_NODE over literals become literals
+- variables with exactly one definition, a `let` to a constant, are replaced by
+  that constant wherever the declaration is known to have run
+- if statements (and while loops) whose condition is constant lose their dead arm
+- division by a constant zero is reported as an error instead of being folded,
+  and so is a constant index outside its array
+*/
+
+#include "../parser/ast.h"
+
+typedef struct FoldStats {
+    size_t nodes_folded;            // expression nodes replaced by a literal
+    size_t constants_propagated;    // identifier uses replaced by their constant value
+    size_t branches_removed;        // if/else arms and never-entered while loops dropped
+    size_t errors;                  // diagnostics reported (division by constant zero, constant index out of bounds)
+} FoldStats;
+
+
+/* ========== Public API Functions ========== */
+
+/*
+Folds the whole program in place and accumulates counters into *stats.
+Diagnostics are printed to stderr; the program should not be compiled further
+when stats->errors is non-zero.
+*/
+void fold_program(ASTNode *program, FoldStats *stats);
+
+/*
+Prints the counters of a fold run as one line to the stream
+*/
+void fold_print_stats(const FoldStats *stats, FILE *out);
@@ -0,0 +1,316 @@
+#include "hashcons.h"
+#include "../util/context.h"
+#include <stdint.h>
+#include <string.h>
+
+typedef struct HashCons {
+    ASTNode **slots;        // canonical nodes, open addressing
+    size_t capacity;
+    size_t count;
+    HashConsStats *stats;
+} HashCons;
+
+/* ===== Helper Functions ===== */
+
+static uint64_t mix(uint64_t h, uint64_t x) {
+    h ^= x + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    return h;
+}
+
+static uint64_t hash_string(uint64_t h, const char *s) {
+    // FNV-1a, folded into the running hash
+    uint64_t f = 0xcbf29ce484222325ULL;
+    for (; *s; s++) {
+        f = (f ^ (unsigned char)*s) * 0x100000001b3ULL;
+    }
+    return mix(h, f);
+}
+
+/*
+murmur3's fmix64: every input bit reaches the low bits the table masks with
+*/
+static uint64_t finish(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/*
+Hash of a node whose children are already interned. Children are known by
+their hash_id, small consecutive integers that mix() alone leaves clustered
+in the low bits.
+*/
+static uint64_t node_hash(const ASTNode *n) {
+    uint64_t h = mix(0, n->type);
+
+    switch (n->type) {
+    case AST_INTAGER_LIT_NODE:
+        h = mix(h, (uint64_t)n->data.int_lit.value);
+        break;
+    case AST_IDENTIFIER_NODE:
+        h = hash_string(h, n->data.identifier.name);
+        break;
+    case AST_UNARY_EXPR:
+        h = hash_string(h, n->data.unary_expr.op);
+        h = mix(h, n->data.unary_expr.operand->hash_id);
+        break;
+    case AST_BINARY_EXPR:
+        h = hash_string(h, n->data.binary_expr.op);
+        h = mix(h, n->data.binary_expr.left->hash_id);
+        h = mix(h, n->data.binary_expr.right->hash_id);
+        break;
+    case AST_CONDITIONAL_NODE:
+        h = hash_string(h, n->data.conditional.comparison_op);
+        h = mix(h, n->data.conditional.left_expression->hash_id);
+        h = mix(h, n->data.conditional.right_expression->hash_id);
+        break;
+    default:
+        break;
+    }
+    return finish(h);
+}
+
+/*
+1 if two nodes with interned children are structurally identical
+*/
+static int node_equal(const ASTNode *a, const ASTNode *b) {
+    if (a->type != b->type) {
+        return 0;
+    }
+
+    switch (a->type) {
+    case AST_INTAGER_LIT_NODE:
+        return a->data.int_lit.value == b->data.int_lit.value;
+    case AST_IDENTIFIER_NODE:
+        return strcmp(a->data.identifier.name, b->data.identifier.name) == 0;
+    case AST_UNARY_EXPR:
+        return strcmp(a->data.unary_expr.op, b->data.unary_expr.op) == 0 &&
+               a->data.unary_expr.operand == b->data.unary_expr.operand;
+    case AST_BINARY_EXPR:
+        return strcmp(a->data.binary_expr.op, b->data.binary_expr.op) == 0 &&
+               a->data.binary_expr.left == b->data.binary_expr.left &&
+               a->data.binary_expr.right == b->data.binary_expr.right;
+    case AST_CONDITIONAL_NODE:
+        return strcmp(a->data.conditional.comparison_op, b->data.conditional.comparison_op) == 0 &&
+               a->data.conditional.left_expression == b->data.conditional.left_expression &&
+               a->data.conditional.right_expression == b->data.conditional.right_expression;
+    default:
+        return 0;
+    }
+}
+
+/*
+Memory one expression node holds on its own (children not included)
+*/
+static size_t node_bytes(const ASTNode *n) {
+    size_t bytes = sizeof(ASTNode);
+
+    switch (n->type) {
+    case AST_IDENTIFIER_NODE:  return bytes + strlen(n->data.identifier.name) + 1;
+    case AST_UNARY_EXPR:       return bytes + strlen(n->data.unary_expr.op) + 1;
+    case AST_BINARY_EXPR:      return bytes + strlen(n->data.binary_expr.op) + 1;
+    case AST_CONDITIONAL_NODE: return bytes + strlen(n->data.conditional.comparison_op) + 1;
+    case AST_INDEX_EXPR:       return bytes + strlen(n->data.index_expr.identifier) + 1;
+    case AST_CALL_EXPR:        return bytes + strlen(n->data.call_expr.name) + 1 +
+                                      n->data.call_expr.nargs * sizeof(ASTNode*);
+    default:                   return bytes;
+    }
+}
+
+static void table_grow(HashCons *hc) {
+    size_t old_capacity = hc->capacity;
+    ASTNode **old = hc->slots;
+
+    hc->capacity = old_capacity ? old_capacity * 2 : 256;
+    hc->slots = eidos_calloc(hc->capacity, sizeof(ASTNode*));
+    if (!hc->slots) {
+        eidos_fatal("Failed to allocate hash-consing table");
+    }
+
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old[i]) {
+            size_t j = node_hash(old[i]) & (hc->capacity - 1);
+            while (hc->slots[j]) {
+                j = (j + 1) & (hc->capacity - 1);
+            }
+            hc->slots[j] = old[i];
+        }
+    }
+    eidos_free(old);
+}
+
+/*
+Interns an expression bottom-up
+
+args:
+    *hc (HashCons) -> table
+    *n (ASTNode) -> expression, the caller's reference is consumed
+
+returns:
+    (ASTNode*) -> the canonical node, with a reference for the caller
+*/
+static ASTNode *intern(HashCons *hc, ASTNode *n) {
+    if (!n) {
+        return NULL;
+    }
+
+    hc->stats->nodes_before++;
+    hc->stats->bytes_before += node_bytes(n);
+
+    int shareable = 1;
+    switch (n->type) {
+    case AST_INTAGER_LIT_NODE:
+    case AST_IDENTIFIER_NODE:
+        break;
+    case AST_UNARY_EXPR:
+        n->data.unary_expr.operand = intern(hc, n->data.unary_expr.operand);
+        shareable = n->data.unary_expr.operand->hash_id != 0;
+        break;
+    case AST_BINARY_EXPR: {
+        n->data.binary_expr.left = intern(hc, n->data.binary_expr.left);
+        n->data.binary_expr.right = intern(hc, n->data.binary_expr.right);
+        const ASTNode *r = n->data.binary_expr.right;
+        shareable = n->data.binary_expr.left->hash_id && r->hash_id;
+        if (n->data.binary_expr.op[0] == '/' &&
+            (r->type != AST_INTAGER_LIT_NODE || r->data.int_lit.value == 0)) {
+            shareable = 0;
+        }
+        break;
+    }
+    case AST_CONDITIONAL_NODE:
+        n->data.conditional.left_expression = intern(hc, n->data.conditional.left_expression);
+        n->data.conditional.right_expression = intern(hc, n->data.conditional.right_expression);
+        shareable = n->data.conditional.left_expression->hash_id &&
+                    n->data.conditional.right_expression->hash_id;
+        break;
+    case AST_INDEX_EXPR:
+        // an element read depends on every store before it, so it is never shared
+        n->data.index_expr.index = intern(hc, n->data.index_expr.index);
+        shareable = 0;
+        break;
+    case AST_CALL_EXPR:
+        // a call may print, so two of them are two calls
+        for (size_t i = 0; i < n->data.call_expr.nargs; i++) {
+            n->data.call_expr.args[i] = intern(hc, n->data.call_expr.args[i]);
+        }
+        shareable = 0;
+        break;
+    default:
+        shareable = 0;
+        break;
+    }
+
+    if (!shareable) {
+        hc->stats->nodes_after++;
+        hc->stats->bytes_after += node_bytes(n);
+        return n;
+    }
+
+    if ((hc->count + 1) * 4 > hc->capacity * 3) {
+        table_grow(hc);
+    }
+
+    size_t mask = hc->capacity - 1;
+    size_t i = node_hash(n) & mask;
+    while (hc->slots[i]) {
+        if (node_equal(hc->slots[i], n)) {
+            ASTNode *canonical = hc->slots[i];
+            canonical->refs++;
+            ast_free(n);    // drops n's references to the (shared) children too
+            return canonical;
+        }
+        i = (i + 1) & mask;
+    }
+
+    hc->slots[i] = n;
+    hc->count++;
+    n->hash_id = ++hc->stats->classes;
+    hc->stats->nodes_after++;
+    hc->stats->bytes_after += node_bytes(n);
+    return n;
+}
+
+static void intern_stmts(HashCons *hc, ASTNode *list);
+
+static void intern_stmt(HashCons *hc, ASTNode *stmt) {
+    switch (stmt->type) {
+    case AST_VAR_DECL_NODE:
+        stmt->data.var_decl.value = intern(hc, stmt->data.var_decl.value);
+        break;
+    case AST_ASSIGN_NODE:
+        stmt->data.assignment.value = intern(hc, stmt->data.assignment.value);
+        break;
+    case AST_PRINT_NODE:
+        stmt->data.print_stmt.expression = intern(hc, stmt->data.print_stmt.expression);
+        break;
+    case AST_INDEX_ASSIGN_NODE:
+        stmt->data.index_assign.index = intern(hc, stmt->data.index_assign.index);
+        stmt->data.index_assign.value = intern(hc, stmt->data.index_assign.value);
+        break;
+    case AST_IF_STMT_NODE:
+        stmt->data.if_stmt.condition = intern(hc, stmt->data.if_stmt.condition);
+        intern_stmts(hc, stmt->data.if_stmt.then_block);
+        intern_stmts(hc, stmt->data.if_stmt.else_block);
+        break;
+    case AST_FOR_LOOP_NODE:
+        intern_stmt(hc, stmt->data.for_loop.initializer);
+        stmt->data.for_loop.condition = intern(hc, stmt->data.for_loop.condition);
+        intern_stmts(hc, stmt->data.for_loop.for_block);
+        break;
+    case AST_WHILE_LOOP_NODE:
+        stmt->data.while_loop.condition = intern(hc, stmt->data.while_loop.condition);
+        intern_stmts(hc, stmt->data.while_loop.while_block);
+        break;
+    case AST_FN_DECL_NODE:
+        intern_stmts(hc, stmt->data.fn_decl.body);
+        stmt->data.fn_decl.ret = intern(hc, stmt->data.fn_decl.ret);
+        break;
+    default:
+        break;
+    }
+}
+
+static void intern_stmts(HashCons *hc, ASTNode *list) {
+    for (; list; list = list->data.stmts.next) {
+        intern_stmt(hc, list->data.stmts.stmt);
+    }
+}
+
+
+/* ========== PUBLIC API ========== */
+
+/*
+Shares every repeated pure subexpression of the program
+
+args:
+    *program (ASTNode) -> AST_PROGRAM_NODE, turned into a DAG in place
+    *stats (HashConsStats) -> counters to fill
+*/
+void hashcons_program(ASTNode *program, HashConsStats *stats) {
+    HashCons hc;
+    memset(&hc, 0, sizeof(hc));
+    memset(stats, 0, sizeof(HashConsStats));
+    hc.stats = stats;
+
+    intern_stmts(&hc, program->data.program.stmts);
+
+    eidos_free(hc.slots);
+}
+
+/*
+Prints hash-consing counters on one line
+
+args:
+    *stats (HashConsStats) -> counters to print
+    *out (FILE) -> stream to print to
+*/
+void hashcons_print_stats(const HashConsStats *stats, FILE *out) {
+    double saved = stats->bytes_before
+        ? 100.0 * (double)(stats->bytes_before - stats->bytes_after) / (double)stats->bytes_before
+        : 0.0;
+    fprintf(out, "hashcons: %zu -> %zu expression nodes, %zu -> %zu bytes (%.1f%% saved)\n",
+            stats->nodes_before, stats->nodes_after, stats->bytes_before, stats->bytes_after, saved);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+/*
+Hash-consing of expression subtrees.
+
+Runs once the AST has stopped changing (after folding, unrolling and partial
+evaluation) and turns the expression trees into a DAG: every structurally
+identical pure subexpression is replaced by one shared node, found through a
+table keyed on (node type, operator, child classes, literal value or name).
+Each class gets a hash_id; ir_build uses the ids to evaluate a repeated
+expression once per basic block when no variable it reads was assigned in
+between (common-subexpression elimination).
+
+A division whose divisor is not a nonzero literal is never shared: it can
+trap, and the runtime error has to point at the division that failed.
+*/
+
+#include "../parser/ast.h"
+
+typedef struct HashConsStats {
+    size_t nodes_before;        // expression nodes in the tree
+    size_t nodes_after;         // distinct expression nodes left
+    size_t bytes_before;        // memory held by them, strings included
+    size_t bytes_after;
+    size_t classes;             // hash_ids handed out
+} HashConsStats;
+
+
+/* ========== Public API Functions ========== */
+
+/*
+Interns every expression of the program in place
+*/
+void hashcons_program(ASTNode *program, HashConsStats *stats);
+
+/*
+Prints the node and memory reduction as one line to the stream
+*/
+void hashcons_print_stats(const HashConsStats *stats, FILE *out);
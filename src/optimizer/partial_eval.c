@@ -0,0 +1,365 @@
+#include "partial_eval.h"
+#include "../util/context.h"
+#include "../ir/ir.h"
+#include "../ir/interp.h"
+#include <string.h>
+#include <time.h>
+
+/* ===== Helper Functions ===== */
+
+static double now_millis(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/*
+1 if the subtree contains a read() statement
+*/
+static int contains_read(const ASTNode *node) {
+    for (; node && node->type == AST_STMTS_NODE; node = node->data.stmts.next) {
+        if (contains_read(node->data.stmts.stmt)) {
+            return 1;
+        }
+    }
+    if (!node) {
+        return 0;
+    }
+
+    switch (node->type) {
+    case AST_READ_NODE:
+        return 1;
+    case AST_IF_STMT_NODE:
+        return contains_read(node->data.if_stmt.then_block) ||
+               contains_read(node->data.if_stmt.else_block);
+    case AST_FOR_LOOP_NODE:
+        return contains_read(node->data.for_loop.for_block);
+    case AST_WHILE_LOOP_NODE:
+        return contains_read(node->data.while_loop.while_block);
+    default:
+        return 0;
+    }
+}
+
+/*
+1 if the subtree stores to an array element
+*/
+static int contains_array_write(const ASTNode *node) {
+    for (; node && node->type == AST_STMTS_NODE; node = node->data.stmts.next) {
+        if (contains_array_write(node->data.stmts.stmt)) {
+            return 1;
+        }
+    }
+    if (!node) {
+        return 0;
+    }
+
+    switch (node->type) {
+    case AST_INDEX_ASSIGN_NODE:
+        return 1;
+    case AST_IF_STMT_NODE:
+        return contains_array_write(node->data.if_stmt.then_block) ||
+               contains_array_write(node->data.if_stmt.else_block);
+    case AST_FOR_LOOP_NODE:
+        return contains_array_write(node->data.for_loop.for_block);
+    case AST_WHILE_LOOP_NODE:
+        return contains_array_write(node->data.while_loop.while_block);
+    default:
+        return 0;
+    }
+}
+
+/*
+Adds every variable the subtree reads to `used`: the values the rest of the
+program needs from the prefix
+*/
+static void collect_uses(const ASTNode *node, StrMap *used) {
+    for (; node && node->type == AST_STMTS_NODE; node = node->data.stmts.next) {
+        collect_uses(node->data.stmts.stmt, used);
+    }
+    if (!node) {
+        return;
+    }
+
+    switch (node->type) {
+    case AST_VAR_DECL_NODE:
+        collect_uses(node->data.var_decl.value, used);
+        break;
+    case AST_ASSIGN_NODE:
+        collect_uses(node->data.assignment.value, used);
+        break;
+    case AST_INDEX_ASSIGN_NODE:
+        collect_uses(node->data.index_assign.index, used);
+        collect_uses(node->data.index_assign.value, used);
+        break;
+    case AST_IF_STMT_NODE:
+        collect_uses(node->data.if_stmt.condition, used);
+        collect_uses(node->data.if_stmt.then_block, used);
+        collect_uses(node->data.if_stmt.else_block, used);
+        break;
+    case AST_FOR_LOOP_NODE:
+        collect_uses(node->data.for_loop.initializer, used);
+        collect_uses(node->data.for_loop.condition, used);
+        collect_uses(node->data.for_loop.step, used);
+        collect_uses(node->data.for_loop.for_block, used);
+        break;
+    case AST_WHILE_LOOP_NODE:
+        collect_uses(node->data.while_loop.condition, used);
+        collect_uses(node->data.while_loop.while_block, used);
+        break;
+    case AST_PRINT_NODE:
+        collect_uses(node->data.print_stmt.expression, used);
+        break;
+    case AST_BINARY_EXPR:
+        collect_uses(node->data.binary_expr.left, used);
+        collect_uses(node->data.binary_expr.right, used);
+        break;
+    case AST_CONDITIONAL_NODE:
+        collect_uses(node->data.conditional.left_expression, used);
+        collect_uses(node->data.conditional.right_expression, used);
+        break;
+    case AST_UNARY_EXPR:
+        collect_uses(node->data.unary_expr.operand, used);
+        break;
+    case AST_INDEX_EXPR:
+        collect_uses(node->data.index_expr.index, used);
+        break;
+    case AST_CALL_EXPR:
+        for (size_t i = 0; i < node->data.call_expr.nargs; i++) {
+            collect_uses(node->data.call_expr.args[i], used);
+        }
+        break;
+    case AST_IDENTIFIER_NODE:
+        strmap_put(used, node->data.identifier.name, 0);
+        break;
+    default:
+        // reads and array declarations read nothing, functions only their parameters
+        break;
+    }
+}
+
+/*
+Builds `let name = value;` as a one item statement list
+*/
+static ASTNode *new_let(const char *name, int64_t value, const ASTNode *at) {
+    ASTNode *decl = ast_new_node(AST_VAR_DECL_NODE, at->line, at->col);
+    decl->data.var_decl.identifer = eidos_strdup(name);
+    if (!decl->data.var_decl.identifer) {
+        eidos_fatal("Failed to allocate partial evaluation result");
+    }
+    decl->data.var_decl.value = ast_new_int_lit(value, at->line, at->col);
+
+    ASTNode *item = ast_new_node(AST_STMTS_NODE, at->line, at->col);
+    item->data.stmts.stmt = decl;
+    return item;
+}
+
+/*
+Runs the prefix program and captures its output and final variable values
+
+args:
+    *prefix (ASTNode) -> AST_PROGRAM_NODE holding the read-free statements
+    *live (StrMap) -> variables the rest of the program reads
+    *options (PEOptions) -> budget
+    *result (PEResult) -> output, fallback reason
+    **fn_out (IRFunction) -> the evaluated function (variable names), caller frees
+    **values (int64_t) -> final value of every variable of *fn_out, 0 unless live, caller frees
+
+returns:
+    (int) -> 1 if the evaluation finished
+*/
+static int evaluate(const ASTNode *prefix, const StrMap *live, const PEOptions *options, PEResult *result,
+                    IRFunction **fn_out, int64_t **values) {
+    // lowering the prefix is part of the time budget
+    double start = now_millis();
+    IRFunction *fn = ir_build_for_eval(prefix, live);
+    if (!fn) {
+        result->fallback = "could not lower the program";
+        return 0;
+    }
+    double left = options->max_millis - (now_millis() - start);
+    if (options->max_millis > 0 && left <= 0) {
+        result->fallback = "budget exhausted";
+        ir_free_function(fn);
+        return 0;
+    }
+
+    *values = eidos_malloc((fn->nvars ? fn->nvars : 1) * sizeof(int64_t));
+    if (!*values) {
+        eidos_fatal("Failed to allocate partial evaluation state");
+    }
+
+    // kept in the result so a library call unwound half way can close it
+    result->stream = open_memstream(&result->output, &result->output_len);
+    if (!result->stream) {
+        eidos_fatal("Failed to allocate partial evaluation output");
+    }
+
+    IRExecLimits limits;
+    limits.max_insts = options->max_insts;
+    limits.max_millis = options->max_millis > 0 ? left : 0;
+    limits.max_output = PE_MAX_OUTPUT;
+
+    IRExecStats stats;
+    IRExecStatus status = ir_evaluate(fn, result->stream, &limits, *values, &stats);
+    fclose(result->stream);
+    result->stream = NULL;
+    result->insts_executed = stats.insts_executed;
+
+    if (status != EXEC_OK) {
+        result->fallback = status == EXEC_RUNTIME_ERROR ? "runtime error"
+                         : result->output_len > PE_MAX_OUTPUT ? "output too large" : "budget exhausted";
+        free(result->output);    // open_memstream allocates with malloc
+        result->output = NULL;
+        result->output_len = 0;
+        eidos_free(*values);
+        *values = NULL;
+        ir_free_function(fn);
+        return 0;
+    }
+
+    *fn_out = fn;
+    return 1;
+}
+
+
+/* ========== PUBLIC API ========== */
+
+void pe_default_options(PEOptions *options) {
+    options->max_insts = 50000000;
+    options->max_millis = 1000;
+}
+
+/*
+Replaces the read-free prefix of a program by the state it computes
+
+args:
+    *program (ASTNode) -> AST_PROGRAM_NODE, rewritten in place on success
+    *options (PEOptions) -> budget
+    *result (PEResult) -> what happened, output must be freed by the caller
+*/
+void pe_program(ASTNode *program, const PEOptions *options, PEResult *result) {
+    memset(result, 0, sizeof(PEResult));
+
+    // functions are read-free and may be called from anywhere: move them to the front, into the prefix
+    ASTNode *fns = NULL;
+    ASTNode **fns_tail = &fns;
+    for (ASTNode **link = &program->data.program.stmts; *link;) {
+        ASTNode *item = *link;
+        if (item->data.stmts.stmt->type == AST_FN_DECL_NODE) {
+            *link = item->data.stmts.next;
+            *fns_tail = item;
+            fns_tail = &item->data.stmts.next;
+        } else {
+            link = &item->data.stmts.next;
+        }
+    }
+    *fns_tail = program->data.program.stmts;
+    program->data.program.stmts = fns;
+
+    ASTNode *stmts = program->data.program.stmts;
+    ASTNode *last = NULL;
+    size_t count = 0;
+
+    int in_prefix = 1;
+
+    // only variables are handed to the rest of the program, so arrays must still be zero when it starts
+    int reads = 0;
+    for (ASTNode *item = stmts; item; item = item->data.stmts.next) {
+        reads |= contains_read(item->data.stmts.stmt);
+    }
+
+    for (ASTNode *item = stmts; item; item = item->data.stmts.next) {
+        result->stmts_total++;
+        const ASTNode *stmt = item->data.stmts.stmt;
+        if (in_prefix && !contains_read(stmt) && !(reads && contains_array_write(stmt))) {
+            last = item;
+            count++;
+        } else {
+            in_prefix = 0;
+        }
+    }
+
+    if (count == 0) {
+        result->fallback = !stmts ? "empty program"
+                         : contains_read(stmts->data.stmts.stmt) ? "program starts with read()"
+                         : "program starts with an array write";
+        return;
+    }
+
+    // evaluate the prefix on its own by cutting the list after it
+    ASTNode *rest = last->data.stmts.next;
+    last->data.stmts.next = NULL;
+
+    ASTNode prefix;
+    memset(&prefix, 0, sizeof(prefix));
+    prefix.type = AST_PROGRAM_NODE;
+    prefix.line = program->line;
+    prefix.col = program->col;
+    prefix.data.program.stmts = stmts;
+
+    StrMap live;
+    strmap_init(&live);
+    collect_uses(rest, &live);
+
+    IRFunction *fn = NULL;
+    int64_t *values = NULL;
+    int evaluated = evaluate(&prefix, &live, options, result, &fn, &values);
+    strmap_free(&live);
+    if (!evaluated) {
+        last->data.stmts.next = rest;
+        return;
+    }
+
+    // the rest of the program starts from the state the prefix left behind
+    ASTNode *head = rest;
+    if (rest) {
+        for (size_t var = fn->nvars; var-- > 0;) {
+            if (values[var] != 0) {
+                ASTNode *item = new_let(fn->var_names[var], values[var], rest->data.stmts.stmt);
+                item->data.stmts.next = head;
+                head = item;
+            }
+        }
+
+        // and the arrays the prefix declared, still all zeros, and the functions
+        ASTNode *decls = NULL;
+        ASTNode **tail = &decls;
+        for (ASTNode *item = stmts; item; item = item->data.stmts.next) {
+            if (item->data.stmts.stmt->type == AST_ARRAY_DECL_NODE ||
+                item->data.stmts.stmt->type == AST_FN_DECL_NODE) {
+                *tail = ast_new_node(AST_STMTS_NODE, item->line, item->col);
+                (*tail)->data.stmts.stmt = ast_clone(item->data.stmts.stmt);
+                tail = &(*tail)->data.stmts.next;
+            }
+        }
+        *tail = head;
+        head = decls;
+    }
+
+    ast_free(stmts);
+    program->data.program.stmts = head;
+    result->stmts_evaluated = count;
+    result->complete = rest == NULL;
+
+    eidos_free(values);
+    ir_free_function(fn);
+}
+
+/*
+Prints partial evaluation results on one line
+
+args:
+    *result (PEResult) -> what pe_program did
+    *out (FILE) -> stream to print to
+*/
+void pe_print_stats(const PEResult *result, FILE *out) {
+    if (result->fallback) {
+        fprintf(out, "pe: not applied (%s)\n", result->fallback);
+        return;
+    }
+    fprintf(out, "pe: %zu/%zu statements precomputed, %zu bytes of output, %llu instructions%s\n",
+            result->stmts_evaluated, result->stmts_total, result->output_len,
+            (unsigned long long)result->insts_executed,
+            result->complete ? ", nothing left to run" : "");
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+/*
+Partial evaluation of the read-free start of a program.
+
+Everything up to the first top-level statement that contains a read() depends
+only on the source, so it is run at compile time by the IR interpreter under
+an instruction and time budget. On success the statements are removed and
+replaced by `let` statements restoring the variables they left behind, and
+their output is handed to the code generator to be written verbatim. A
+program without any read() compiles to nothing but its output.
+
+Arrays are not carried over: in a program that reads, the prefix also stops
+at the first statement writing an array element, and the array declarations
+it holds are kept for the rest of the program.
+
+Only the variables the rest of the program reads are carried over, and only
+those get their final value recorded when the prefix is lowered to IR.
+
+If the budget runs out, the output grows past PE_MAX_OUTPUT, or the
+evaluation hits a runtime error, the program is left untouched and compiles
+normally, the error then happens at run time. The time budget includes
+lowering the prefix.
+*/
+
+#include <stdint.h>
+#include "../parser/ast.h"
+
+// precomputed output kept at most; a program printing more is left to run
+#define PE_MAX_OUTPUT (1 << 20)
+
+typedef struct PEOptions {
+    uint64_t max_insts;         // IR instructions the evaluation may execute
+    double max_millis;          // wall time it may take
+} PEOptions;
+
+typedef struct PEResult {
+    char *output;               // precomputed output, owned by the caller (free)
+    size_t output_len;
+    FILE *stream;               // writes output while evaluating, NULL once closed
+    size_t stmts_evaluated;     // top-level statements replaced
+    size_t stmts_total;         // top-level statements before evaluation
+    int complete;               // 1 if nothing is left to run
+    uint64_t insts_executed;
+    const char *fallback;       // why nothing was evaluated, NULL on success
+} PEResult;
+
+
+/* ========== Public API Functions ========== */
+
+/*
+Fills in the default budget
+*/
+void pe_default_options(PEOptions *options);
+
+/*
+Evaluates the read-free prefix of the program in place, see above
+*/
+void pe_program(ASTNode *program, const PEOptions *options, PEResult *result);
+
+/*
+Prints what partial evaluation did as one line to the stream
+*/
+void pe_print_stats(const PEResult *result, FILE *out);
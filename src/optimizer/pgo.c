@@ -0,0 +1,665 @@
+#include "pgo.h"
+#include "../util/context.h"
+#include "../util/strmap.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct Collector {
+    PGORecord *records;
+    size_t count;
+    size_t cap;
+} Collector;
+
+/* ===== Helper Functions ===== */
+
+static uint64_t mix(uint64_t h, uint64_t x) {
+    h ^= x + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    return h;
+}
+
+static uint64_t hash_bytes(uint64_t h, const char *s, size_t len) {
+    // FNV-1a, folded into the running hash
+    uint64_t f = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        f = (f ^ (unsigned char)s[i]) * 0x100000001b3ULL;
+    }
+    return mix(h, f);
+}
+
+static uint64_t hash_string(uint64_t h, const char *s) {
+    return hash_bytes(h, s, strlen(s));
+}
+
+static void add_record(Collector *c, PGOKind kind, const ASTNode *node, uint64_t hash) {
+    if (c->count == c->cap) {
+        c->cap = c->cap ? c->cap * 2 : 16;
+        c->records = eidos_realloc(c->records, c->cap * sizeof(PGORecord));
+        if (!c->records) {
+            eidos_fatal("Failed to allocate profile records");
+        }
+    }
+    PGORecord *r = &c->records[c->count++];
+    memset(r, 0, sizeof(PGORecord));
+    r->kind = kind;
+    r->line = node->line;
+    r->col = node->col;
+    r->tree_hash = hash;
+}
+
+/*
+Hashes a tree, adding a record for every if statement and loop in it
+
+args:
+    *c (Collector) -> records found so far
+    *node (ASTNode) -> subtree, may be NULL
+
+returns:
+    (uint64_t) -> hash of the subtree's shape, operators, names and literals
+*/
+static uint64_t walk(Collector *c, const ASTNode *node) {
+    if (!node) {
+        return 0x5bd1e995;
+    }
+
+    uint64_t h = mix(0, (uint64_t)node->type + 1);
+    switch (node->type) {
+    case AST_PROGRAM_NODE:
+        return mix(h, walk(c, node->data.program.stmts));
+
+    case AST_STMTS_NODE:
+        // lists are walked iteratively so long programs don't blow the stack
+        for (; node; node = node->data.stmts.next) {
+            h = mix(h, walk(c, node->data.stmts.stmt));
+        }
+        return h;
+
+    case AST_VAR_DECL_NODE:
+        h = hash_string(h, node->data.var_decl.identifer);
+        return mix(h, walk(c, node->data.var_decl.value));
+
+    case AST_ASSIGN_NODE:
+        h = hash_string(h, node->data.assignment.identifier);
+        return mix(h, walk(c, node->data.assignment.value));
+
+    case AST_IF_STMT_NODE:
+        h = mix(h, walk(c, node->data.if_stmt.condition));
+        h = mix(h, walk(c, node->data.if_stmt.then_block));
+        h = mix(h, walk(c, node->data.if_stmt.else_block));
+        add_record(c, PGO_BRANCH, node, h);
+        return h;
+
+    case AST_FOR_LOOP_NODE:
+        h = mix(h, walk(c, node->data.for_loop.initializer));
+        h = mix(h, walk(c, node->data.for_loop.condition));
+        h = mix(h, walk(c, node->data.for_loop.step));
+        h = mix(h, walk(c, node->data.for_loop.for_block));
+        add_record(c, PGO_LOOP, node, h);
+        return h;
+
+    case AST_WHILE_LOOP_NODE:
+        h = mix(h, walk(c, node->data.while_loop.condition));
+        h = mix(h, walk(c, node->data.while_loop.while_block));
+        add_record(c, PGO_LOOP, node, h);
+        return h;
+
+    case AST_PRINT_NODE:
+        return mix(h, walk(c, node->data.print_stmt.expression));
+
+    case AST_READ_NODE:
+        return hash_string(h, node->data.read_stmt.identifier);
+
+    case AST_ARRAY_DECL_NODE:
+        h = hash_string(h, node->data.array_decl.identifier);
+        return mix(h, (uint64_t)node->data.array_decl.size);
+
+    case AST_INDEX_ASSIGN_NODE:
+        h = hash_string(h, node->data.index_assign.identifier);
+        h = mix(h, walk(c, node->data.index_assign.index));
+        return mix(h, walk(c, node->data.index_assign.value));
+
+    case AST_INDEX_EXPR:
+        h = hash_string(h, node->data.index_expr.identifier);
+        return mix(h, walk(c, node->data.index_expr.index));
+
+    case AST_FN_DECL_NODE:
+        h = hash_string(h, node->data.fn_decl.name);
+        for (size_t i = 0; i < node->data.fn_decl.nparams; i++) {
+            h = hash_string(h, node->data.fn_decl.params[i]);
+        }
+        h = mix(h, walk(c, node->data.fn_decl.body));
+        return mix(h, walk(c, node->data.fn_decl.ret));
+
+    case AST_CALL_EXPR:
+        h = hash_string(h, node->data.call_expr.name);
+        for (size_t i = 0; i < node->data.call_expr.nargs; i++) {
+            h = mix(h, walk(c, node->data.call_expr.args[i]));
+        }
+        return h;
+
+    case AST_BINARY_EXPR:
+        h = mix(h, walk(c, node->data.binary_expr.left));
+        h = hash_string(h, node->data.binary_expr.op);
+        return mix(h, walk(c, node->data.binary_expr.right));
+
+    case AST_CONDITIONAL_NODE:
+        h = mix(h, walk(c, node->data.conditional.left_expression));
+        h = hash_string(h, node->data.conditional.comparison_op);
+        return mix(h, walk(c, node->data.conditional.right_expression));
+
+    case AST_UNARY_EXPR:
+        h = hash_string(h, node->data.unary_expr.op);
+        h = mix(h, (uint64_t)node->data.unary_expr.is_prefix);
+        return mix(h, walk(c, node->data.unary_expr.operand));
+
+    case AST_IDENTIFIER_NODE:
+        return hash_string(h, node->data.identifier.name);
+
+    case AST_INTAGER_LIT_NODE:
+        return mix(h, (uint64_t)node->data.int_lit.value);
+    }
+    return h;
+}
+
+static int by_position(const void *a, const void *b) {
+    const PGORecord *x = a, *y = b;
+    if (x->line != y->line) {
+        return x->line < y->line ? -1 : 1;
+    }
+    if (x->col != y->col) {
+        return x->col < y->col ? -1 : 1;
+    }
+    return (int)x->kind - (int)y->kind;
+}
+
+static PGORecord *find(const PGOProfile *profile, PGOKind kind, size_t line, size_t col) {
+    PGORecord key;
+    memset(&key, 0, sizeof(key));
+    key.kind = kind;
+    key.line = line;
+    key.col = col;
+    return bsearch(&key, profile->records, profile->nrecords, sizeof(PGORecord), by_position);
+}
+
+static int by_scope(const void *a, const void *b) {
+    const PGORecord *x = *(PGORecord *const *)a, *y = *(PGORecord *const *)b;
+    if (x->scope != y->scope) {
+        return x->scope < y->scope ? -1 : 1;
+    }
+    if (x->scope_line != y->scope_line) {
+        return x->scope_line < y->scope_line ? -1 : 1;
+    }
+    if (x->col != y->col) {
+        return x->col < y->col ? -1 : 1;
+    }
+    return (int)x->kind - (int)y->kind;
+}
+
+static PGORecord *find_in_scope(const PGOProfile *profile, PGOKind kind, uint64_t scope, size_t line,
+                                size_t col) {
+    PGORecord key;
+    memset(&key, 0, sizeof(key));
+    key.kind = kind;
+    key.scope = scope;
+    key.scope_line = line;
+    key.col = col;
+    PGORecord *keyp = &key;
+    PGORecord **r = bsearch(&keyp, profile->by_scope, profile->nrecords, sizeof(PGORecord *), by_scope);
+    return r ? *r : NULL;
+}
+
+/*
+Gives the records of one top-level statement their scope
+
+args:
+    *c (Collector) -> records, those from `first` on belong to the statement
+    first (size_t) -> first record of the statement
+    *stmt (ASTNode) -> top-level statement
+    hash (uint64_t) -> its tree hash
+    *copies (StrMap) -> how many top-level statements had each tree hash so far
+*/
+static void set_scope(Collector *c, size_t first, const ASTNode *stmt, uint64_t hash, StrMap *copies) {
+    uint64_t scope;
+    if (stmt->type == AST_FN_DECL_NODE) {
+        // a function keeps its records however its body changes elsewhere
+        scope = hash_string(hash_string(0, "fn"), stmt->data.fn_decl.name);
+    } else {
+        // identical top-level statements are told apart by which copy they are
+        char key[24];
+        size_t copy = 0;
+        snprintf(key, sizeof(key), "%016" PRIx64, hash);
+        strmap_get(copies, key, &copy);
+        strmap_put(copies, key, copy + 1);
+        scope = mix(hash, (uint64_t)copy);
+    }
+    for (size_t i = first; i < c->count; i++) {
+        c->records[i].scope = scope;
+        c->records[i].scope_line = c->records[i].line - stmt->line;
+    }
+}
+
+static uint64_t percent_of(uint64_t part, uint64_t whole) {
+    return whole ? part * 100 / whole : 0;
+}
+
+/*
+Marks a then/else part or a loop body cold: every block reachable from
+`start` before control gets back to a block of the statement itself (its
+join, or its header). Nothing is marked if the walk reaches the end of the
+program, which means the passes reshaped the statement.
+
+args:
+    *profile (PGOProfile) -> counters
+    *fn (IRFunction) -> function
+    start (int) -> first block of the part
+    stop_role (IRBlockRole) -> role of the statement's blocks that end the part
+    *seen (char) -> scratch, fn->nblocks long, all zero
+    *stack (int) -> scratch, fn->nblocks long
+*/
+static void mark_cold(PGOProfile *profile, IRFunction *fn, int start, IRBlockRole stop_role,
+                      char *seen, int *stack) {
+    const IRBlock *first = &fn->blocks[start];
+    size_t line = first->line, col = first->col;
+    size_t top = 0, nseen = 0;
+    int leaked = 0;
+
+    seen[start] = 1;
+    stack[top++] = start;
+
+    // the stack doubles as the list of visited blocks: entries below `nseen` are done
+    while (nseen < top) {
+        const IRBlock *bb = &fn->blocks[stack[nseen++]];
+        if (bb->term == TERM_RET) {
+            leaked = 1;
+            break;
+        }
+        for (int s = 0; s < 2; s++) {
+            int next = bb->succ[s];
+            if (next < 0 || seen[next]) {
+                continue;
+            }
+            const IRBlock *nb = &fn->blocks[next];
+            if (nb->role == stop_role && nb->line == line && nb->col == col) {
+                continue;
+            }
+            seen[next] = 1;
+            stack[top++] = next;
+        }
+    }
+
+    for (size_t i = 0; i < top; i++) {
+        if (!leaked && !fn->blocks[stack[i]].cold) {
+            fn->blocks[stack[i]].cold = 1;
+            profile->blocks_cold++;
+        }
+        seen[stack[i]] = 0;
+    }
+}
+
+static void hint_branch(PGOProfile *profile, IRBlock *bb, uint64_t first, uint64_t second) {
+    uint64_t total = first + second;
+    if (!total) {
+        return;
+    }
+    if (percent_of(first, total) >= PGO_LIKELY_PERCENT) {
+        bb->likely = 1;
+        profile->branches_hinted++;
+    } else if (percent_of(second, total) >= PGO_LIKELY_PERCENT) {
+        bb->likely = -1;
+        profile->branches_hinted++;
+    }
+}
+
+/*
+Marks the likely branches and cold blocks of one function
+
+args:
+    *profile (PGOProfile) -> loaded profile
+    *fn (IRFunction) -> optimized function
+*/
+static void annotate_function(PGOProfile *profile, IRFunction *fn) {
+    char *seen = eidos_calloc(fn->nblocks ? fn->nblocks : 1, 1);
+    int *stack = eidos_malloc((fn->nblocks ? fn->nblocks : 1) * sizeof(int));
+    if (!seen || !stack) {
+        eidos_fatal("Failed to allocate profile layout");
+    }
+
+    for (size_t b = 0; b < fn->nblocks; b++) {
+        IRBlock *bb = &fn->blocks[b];
+        if (bb->dead || bb->term != TERM_BR) {
+            continue;
+        }
+        IRBlock *yes = &fn->blocks[bb->succ[0]];
+        IRBlock *no = &fn->blocks[bb->succ[1]];
+
+        if (yes->role == BLOCK_THEN) {
+            const PGORecord *r = find(profile, PGO_BRANCH, yes->line, yes->col);
+            if (!r || !r->has_data) {
+                continue;
+            }
+            uint64_t total = r->taken + r->not_taken;
+            hint_branch(profile, bb, r->taken, r->not_taken);
+            if (percent_of(r->taken, total) <= PGO_COLD_PERCENT && (r->taken == 0 || total >= 100)) {
+                mark_cold(profile, fn, yes->id, BLOCK_JOIN, seen, stack);
+            }
+            if (no->role == BLOCK_ELSE && percent_of(r->not_taken, total) <= PGO_COLD_PERCENT &&
+                (r->not_taken == 0 || total >= 100)) {
+                mark_cold(profile, fn, no->id, BLOCK_JOIN, seen, stack);
+            }
+        } else if (yes->role == BLOCK_LOOP_BODY) {
+            const PGORecord *r = find(profile, PGO_LOOP, yes->line, yes->col);
+            if (!r || !r->has_data) {
+                continue;
+            }
+            uint64_t entries = 0;
+            for (size_t k = 0; k < IR_TRIP_BUCKETS; k++) {
+                entries += r->trips[k];
+            }
+            hint_branch(profile, bb, r->iterations, entries);
+            if (r->iterations == 0) {
+                mark_cold(profile, fn, yes->id, BLOCK_LOOP_HEADER, seen, stack);
+            }
+        }
+    }
+
+    eidos_free(stack);
+    eidos_free(seen);
+}
+
+
+/* ========== PUBLIC API ========== */
+
+/*
+Creates the records of a program
+
+args:
+    *profile (PGOProfile) -> profile to set up
+    *program (ASTNode) -> checked, not yet optimized program
+    *source (char) -> its text, for the source hash
+*/
+void pgo_init(PGOProfile *profile, const ASTNode *program, const char *source) {
+    memset(profile, 0, sizeof(PGOProfile));
+
+    Collector c = { NULL, 0, 0 };
+    StrMap copies;
+    strmap_init(&copies);
+    for (const ASTNode *list = program->data.program.stmts; list; list = list->data.stmts.next) {
+        const ASTNode *stmt = list->data.stmts.stmt;
+        size_t first = c.count;
+        uint64_t hash = walk(&c, stmt);
+        if (stmt) {
+            set_scope(&c, first, stmt, hash, &copies);
+        }
+    }
+    strmap_free(&copies);
+    qsort(c.records, c.count, sizeof(PGORecord), by_position);
+
+    profile->records = c.records;
+    profile->nrecords = c.count;
+    profile->by_scope = eidos_malloc((c.count ? c.count : 1) * sizeof(PGORecord *));
+    if (!profile->by_scope) {
+        eidos_fatal("Failed to allocate profile records");
+    }
+    for (size_t i = 0; i < c.count; i++) {
+        profile->by_scope[i] = &c.records[i];
+    }
+    qsort(profile->by_scope, c.count, sizeof(PGORecord *), by_scope);
+    profile->source_hash = hash_string(0, source);
+}
+
+/*
+Adds up the counters of a profiled run per statement
+
+args:
+    *profile (PGOProfile) -> records to fill
+    *fn (IRFunction) -> function that ran, built without unrolling
+    *run (IRProfile) -> its counters, with trip counts
+*/
+void pgo_record_run(PGOProfile *profile, const IRFunction *fn, const IRProfile *run) {
+    for (size_t f = 0; f < run->nfunctions; f++) {
+        const IRFunction *g = ir_profile_function(fn, f);
+        const uint64_t *counts = run->block_counts + run->block_base[f];
+
+        // an if's then block is entered as often as the condition held
+        for (size_t b = 0; b < g->nblocks; b++) {
+            const IRBlock *bb = &g->blocks[b];
+            if (bb->dead || bb->role != BLOCK_THEN || bb->npreds != 1) {
+                continue;
+            }
+            const IRBlock *branch = &g->blocks[bb->preds[0]];
+            PGORecord *r = find(profile, PGO_BRANCH, bb->line, bb->col);
+            if (!r || branch->term != TERM_BR || branch->succ[0] != (int)b) {
+                continue;
+            }
+            uint64_t evaluated = counts[branch->id];
+            uint64_t taken = counts[b];
+            r->has_data = 1;
+            r->taken += taken;
+            r->not_taken += evaluated > taken ? evaluated - taken : 0;
+        }
+
+        for (size_t i = 0; i < g->nloops; i++) {
+            const IRLoop *loop = &g->loops[i];
+            if (!run->loop_trips || run->header_loop[run->block_base[f] + (size_t)loop->header] != (int)i) {
+                continue;
+            }
+            PGORecord *r = find(profile, PGO_LOOP, loop->line, loop->col);
+            if (!r) {
+                continue;
+            }
+            const IRLoopTrips *trips = &run->loop_trips[run->loop_base[f] + i];
+            uint64_t entries = counts[loop->preheader];
+            uint64_t header = counts[loop->header];
+            r->has_data = 1;
+            r->iterations += header > entries ? header - entries : 0;
+            for (size_t k = 0; k < IR_TRIP_BUCKETS; k++) {
+                r->trips[k] += trips->buckets[k];
+            }
+        }
+    }
+}
+
+/*
+Writes a profile file
+
+args:
+    *profile (PGOProfile) -> recorded profile
+    *path (char) -> file to write
+
+returns:
+    (int) -> 0, -1 after reporting a write error
+*/
+int pgo_write(const PGOProfile *profile, const char *path) {
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        eidos_diag("Error: Could not open %s\n", path);
+        return -1;
+    }
+
+    fprintf(out, "eidos-profile 2\nsource %016" PRIx64 "\n", profile->source_hash);
+    for (size_t i = 0; i < profile->nrecords; i++) {
+        const PGORecord *r = &profile->records[i];
+        if (!r->has_data) {
+            continue;
+        }
+        if (r->kind == PGO_BRANCH) {
+            fprintf(out, "branch %016" PRIx64 " %zu %zu %016" PRIx64 " %" PRIu64 " %" PRIu64 "\n", r->scope,
+                    r->scope_line, r->col, r->tree_hash, r->taken, r->not_taken);
+            continue;
+        }
+        fprintf(out, "loop %016" PRIx64 " %zu %zu %016" PRIx64 " %" PRIu64, r->scope, r->scope_line, r->col,
+                r->tree_hash, r->iterations);
+        for (size_t k = 0; k < IR_TRIP_BUCKETS; k++) {
+            if (r->trips[k]) {
+                fprintf(out, " %zu:%" PRIu64, k, r->trips[k]);
+            }
+        }
+        fputc('\n', out);
+    }
+
+    if (fclose(out) != 0) {
+        eidos_diag("Error: Failed to write %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+Reads a profile file into the records it still matches
+
+args:
+    *profile (PGOProfile) -> records of the program being compiled
+    *path (char) -> profile file
+
+returns:
+    (int) -> 0, -1 after reporting that the file can't be used
+*/
+int pgo_load(PGOProfile *profile, const char *path) {
+    FILE *in = fopen(path, "r");
+    if (!in) {
+        eidos_diag("Error: Could not open %s\n", path);
+        return -1;
+    }
+
+    char line[1024];
+    if (!fgets(line, sizeof(line), in) || strncmp(line, "eidos-profile ", 14) != 0) {
+        eidos_diag("Error: %s is not an eidos profile\n", path);
+        fclose(in);
+        return -1;
+    }
+    if (strcmp(line, "eidos-profile 2\n") != 0) {
+        eidos_diag("Error: %s was written by another version of eidos, record it again\n", path);
+        fclose(in);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), in)) {
+        char kind[16];
+        size_t at_line, at_col;
+        uint64_t scope, hash;
+        int used;
+        if (sscanf(line, "%15s %" SCNx64 " %zu %zu %" SCNx64 "%n", kind, &scope, &at_line, &at_col, &hash,
+                   &used) != 5) {
+            continue;
+        }
+
+        int is_loop = strcmp(kind, "loop") == 0;
+        if (!is_loop && strcmp(kind, "branch") != 0) {
+            continue;
+        }
+        PGORecord *r = find_in_scope(profile, is_loop ? PGO_LOOP : PGO_BRANCH, scope, at_line, at_col);
+        if (!r || r->tree_hash != hash) {
+            profile->stale++;
+            continue;
+        }
+
+        const char *rest = line + used;
+        if (!is_loop) {
+            if (sscanf(rest, "%" SCNu64 " %" SCNu64, &r->taken, &r->not_taken) != 2) {
+                continue;
+            }
+        } else {
+            int n;
+            if (sscanf(rest, "%" SCNu64 "%n", &r->iterations, &n) != 1) {
+                continue;
+            }
+            rest += n;
+            size_t bucket;
+            uint64_t count;
+            while (sscanf(rest, " %zu:%" SCNu64 "%n", &bucket, &count, &n) == 2) {
+                if (bucket < IR_TRIP_BUCKETS) {
+                    r->trips[bucket] = count;
+                }
+                rest += n;
+            }
+        }
+        r->has_data = 1;
+        profile->loaded++;
+    }
+
+    fclose(in);
+    return 0;
+}
+
+/*
+Picks the unroll factor of a loop from its trip counts
+
+args:
+    *user (PGOProfile) -> loaded profile
+    *loop (ASTNode) -> for loop about to be unrolled
+    factor (size_t) -> the factor without a profile
+
+returns:
+    (size_t) -> factor, 1 to only allow full unrolling, 0 to leave the loop alone
+*/
+size_t pgo_unroll_factor(void *user, const ASTNode *loop, size_t factor) {
+    PGOProfile *profile = user;
+    const PGORecord *r = find(profile, PGO_LOOP, loop->line, loop->col);
+    if (!r || !r->has_data) {
+        return factor;
+    }
+    profile->loops_tuned++;
+
+    uint64_t entries = 0;
+    size_t usual = 0;
+    for (size_t k = 0; k < IR_TRIP_BUCKETS; k++) {
+        entries += r->trips[k];
+        if (r->trips[k] > r->trips[usual]) {
+            usual = k;
+        }
+    }
+    if (entries == 0) {
+        return 0;
+    }
+    if (r->iterations < PGO_HOT_ITERATIONS) {
+        return 1;
+    }
+
+    // the largest power of two no bigger than the trips it usually made
+    uint64_t trips = usual ? (uint64_t)1 << (usual - 1) : 0;
+    size_t f = 1;
+    while (f * 2 <= trips && f * 2 <= PGO_MAX_FACTOR) {
+        f *= 2;
+    }
+    return f;
+}
+
+/*
+Turns the loaded records into block hints
+
+args:
+    *profile (PGOProfile) -> loaded profile
+    *fn (IRFunction) -> optimized program, its functions are annotated too
+*/
+void pgo_annotate(PGOProfile *profile, IRFunction *fn) {
+    for (size_t f = 0; f <= fn->nfuncs; f++) {
+        annotate_function(profile, f ? fn->funcs[f - 1] : fn);
+    }
+}
+
+/*
+Prints the profile's effect
+
+args:
+    *profile (PGOProfile) -> profile after compilation
+    *out (FILE) -> stream to print to
+*/
+void pgo_print_stats(const PGOProfile *profile, FILE *out) {
+    fprintf(out, "pgo: %zu records used, %zu stale ignored, %zu branches hinted, %zu cold blocks, "
+            "%zu unroll factors from the profile\n", profile->loaded, profile->stale, profile->branches_hinted,
+            profile->blocks_cold, profile->loops_tuned);
+}
+
+/*
+Releases the records
+
+args:
+    *profile (PGOProfile) -> profile
+*/
+void pgo_free(PGOProfile *profile) {
+    eidos_free(profile->by_scope);
+    eidos_free(profile->records);
+    profile->by_scope = NULL;
+    profile->records = NULL;
+    profile->nrecords = 0;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+/*
+Profile-guided optimization (--profile-gen, --profile-use).
+
+--profile-gen=FILE runs the program under the profiler (ir/profile.h) and
+records, for every if statement, how often its condition held and, for every
+loop, how many trips it made each time it ran. --profile-use=FILE compiles
+with those records:
+
+- unrolling: a loop that never ran is left alone, one that ran too few
+  iterations to matter is only unrolled fully, and a hot one gets a factor
+  from the trip count it usually had (pgo_unroll_factor)
+- branches that go the same way at least PGO_LIKELY_PERCENT of the time are
+  marked likely, so the backends make that side the fall-through path
+- then and else parts (and loop bodies) that ran at most PGO_COLD_PERCENT of
+  the time are marked cold and laid out after everything else (ir_layout)
+
+A record is keyed by its scope, its position within the scope, and a hash of
+the statement's tree: its shape, operators, names and literals, with nested
+statements included. The scope is the function the statement is in (by
+name), or for the main program the top-level statement it is part of (by
+tree hash, and which copy it is when identical ones repeat). Lines count
+from the first line of the scope. So an edit inside one function only
+invalidates that function's records, even when it adds or removes lines:
+the other functions and top-level statements keep matching wherever they
+moved to. A record that no longer matches is ignored on its own.
+
+The file is text, one record per line:
+
+    eidos-profile 2
+    source <hash of the file>
+    branch <scope> <line> <col> <tree hash> <times taken> <times not taken>
+    loop <scope> <line> <col> <tree hash> <iterations> <bucket>:<entries> ...
+
+where a loop lists the trip count buckets (ir_trip_bucket) it ran in.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include "../ir/ir.h"
+#include "../ir/profile.h"
+#include "../parser/ast.h"
+
+#define PGO_LIKELY_PERCENT 90
+#define PGO_COLD_PERCENT 1
+#define PGO_HOT_ITERATIONS 256      // fewer iterations in a whole run aren't worth a partial unroll
+#define PGO_MAX_FACTOR 8
+
+typedef enum PGOKind {
+    PGO_BRANCH,
+    PGO_LOOP,
+} PGOKind;
+
+typedef struct PGORecord {
+    PGOKind kind;
+    size_t line;
+    size_t col;
+    uint64_t tree_hash;
+    uint64_t scope;             // function or top-level statement the record is in
+    size_t scope_line;          // line, counted from the scope's first line
+    int has_data;               // 1 once counts were recorded or loaded for it
+
+    uint64_t taken;             // PGO_BRANCH: the condition held
+    uint64_t not_taken;
+
+    uint64_t iterations;        // PGO_LOOP: trips over all the times it ran
+    uint64_t trips[IR_TRIP_BUCKETS];    // PGO_LOOP: times it ran, by trip count bucket
+} PGORecord;
+
+typedef struct PGOProfile {
+    PGORecord *records;         // every if and loop of the program, sorted by position
+    size_t nrecords;
+    PGORecord **by_scope;       // the same records, sorted by scope and position in it
+    uint64_t source_hash;
+
+    size_t loaded;              // records of the file that matched the program
+    size_t stale;               // records of the file whose statement changed or is gone
+    size_t branches_hinted;     // TERM_BRs marked likely
+    size_t blocks_cold;         // blocks marked cold
+    size_t loops_tuned;         // loops whose unroll factor came from the profile
+} PGOProfile;
+
+
+/* ========== Public API Functions ========== */
+
+/*
+Sets up a profile with one empty record per if statement and loop of the
+program. Call it on the checked tree, before any optimization rewrites it.
+*/
+void pgo_init(PGOProfile *profile, const ASTNode *program, const char *source);
+
+/*
+Fills the records from a profiled run of the program and its functions
+(unrolling off, so every statement has one copy)
+*/
+void pgo_record_run(PGOProfile *profile, const IRFunction *fn, const IRProfile *run);
+
+/*
+Writes the records that have data. Returns 0, or -1 after reporting the error.
+*/
+int pgo_write(const PGOProfile *profile, const char *path);
+
+/*
+Loads a profile file into the matching records, counting stale ones. Returns
+0, or -1 after reporting that the file is missing or isn't a profile.
+*/
+int pgo_load(PGOProfile *profile, const char *path);
+
+/*
+UnrollOptions.loop_factor for a loaded profile (user is the PGOProfile)
+*/
+size_t pgo_unroll_factor(void *user, const ASTNode *loop, size_t factor);
+
+/*
+Marks likely branches and cold blocks of the optimized program and its functions
+*/
+void pgo_annotate(PGOProfile *profile, IRFunction *fn);
+
+/*
+Prints what the profile did as "pgo: ..." lines
+*/
+void pgo_print_stats(const PGOProfile *profile, FILE *out);
+
+/*
+Frees the records
+*/
+void pgo_free(PGOProfile *profile);
@@ -0,0 +1,660 @@
+#include "unroll.h"
+#include "../util/context.h"
+#include "../util/arith.h"
+#include <string.h>
+
+// What a canonical for loop does, in numbers
+typedef struct TripInfo {
+    const char *iv;     // induction variable
+    int64_t start;      // initial value
+    int step;           // +1 or -1
+    uint64_t trips;     // number of times the body runs
+} TripInfo;
+
+// A for loop whose trip count is only known at run time, `i op bound` with i on the left
+typedef struct RuntimeLoop {
+    const char *iv;     // induction variable
+    CmpOp op;           // < or <= counting up, > or >= counting down
+    int step;           // +1 or -1
+    const ASTNode *bound;   // literal, or a variable the body doesn't write
+} RuntimeLoop;
+
+typedef struct UnrollState {
+    const UnrollOptions *options;
+    UnrollStats *stats;
+    size_t budget_left;
+} UnrollState;
+
+/* ===== Helper Functions ===== */
+
+/*
+1 if the subtree assigns, reads into or increments the variable
+*/
+static int writes_var(const ASTNode *node, const char *name) {
+    for (; node && node->type == AST_STMTS_NODE; node = node->data.stmts.next) {
+        if (writes_var(node->data.stmts.stmt, name)) {
+            return 1;
+        }
+    }
+    if (!node) {
+        return 0;
+    }
+
+    switch (node->type) {
+    case AST_VAR_DECL_NODE:
+        return strcmp(node->data.var_decl.identifer, name) == 0;
+    case AST_ASSIGN_NODE:
+        return strcmp(node->data.assignment.identifier, name) == 0;
+    case AST_READ_NODE:
+        return strcmp(node->data.read_stmt.identifier, name) == 0;
+    case AST_UNARY_EXPR:
+        return node->data.unary_expr.operand->type == AST_IDENTIFIER_NODE &&
+               strcmp(node->data.unary_expr.operand->data.identifier.name, name) == 0;
+    case AST_IF_STMT_NODE:
+        return writes_var(node->data.if_stmt.then_block, name) ||
+               writes_var(node->data.if_stmt.else_block, name);
+    case AST_FOR_LOOP_NODE:
+        return writes_var(node->data.for_loop.initializer, name) ||
+               writes_var(node->data.for_loop.step, name) ||
+               writes_var(node->data.for_loop.for_block, name);
+    case AST_WHILE_LOOP_NODE:
+        return writes_var(node->data.while_loop.while_block, name);
+    default:
+        return 0;
+    }
+}
+
+/*
+1 if the subtree stores to an array element
+*/
+static int writes_array(const ASTNode *node) {
+    for (; node && node->type == AST_STMTS_NODE; node = node->data.stmts.next) {
+        if (writes_array(node->data.stmts.stmt)) {
+            return 1;
+        }
+    }
+    if (!node) {
+        return 0;
+    }
+
+    switch (node->type) {
+    case AST_INDEX_ASSIGN_NODE:
+        return 1;
+    case AST_IF_STMT_NODE:
+        return writes_array(node->data.if_stmt.then_block) || writes_array(node->data.if_stmt.else_block);
+    case AST_FOR_LOOP_NODE:
+        return writes_array(node->data.for_loop.for_block);
+    case AST_WHILE_LOOP_NODE:
+        return writes_array(node->data.while_loop.while_block);
+    default:
+        return 0;
+    }
+}
+
+static int is_var(const ASTNode *node, const char *name) {
+    return node->type == AST_IDENTIFIER_NODE && strcmp(node->data.identifier.name, name) == 0;
+}
+
+// `bound op i` is `i op' bound`
+static CmpOp mirror(CmpOp op) {
+    switch (op) {
+    case CMP_LT: return CMP_GT;
+    case CMP_GT: return CMP_LT;
+    case CMP_LE: return CMP_GE;
+    case CMP_GE: return CMP_LE;
+    default:     return op;
+    }
+}
+
+/*
+Counts how often `for (i = start; i op bound; i += step)` runs its body
+
+args:
+    start, bound (int64_t) -> initial value and the literal it is compared to
+    op (CmpOp) -> comparison, with i on the left
+    step (int) -> +1 or -1
+    *trips (uint64_t) -> output
+
+returns:
+    (int) -> 1 if the count is known, 0 if the loop only ends by wrapping around
+*/
+static int trip_count(int64_t start, CmpOp op, int64_t bound, int step, uint64_t *trips) {
+    if (!eidos_compare(op, start, bound)) {
+        *trips = 0;
+        return 1;
+    }
+    if (op == CMP_EQ) {
+        *trips = 1;
+        return 1;
+    }
+
+    // counting towards the bound; the subtraction can't wrap since start is on the right side
+    if (step > 0) {
+        switch (op) {
+        case CMP_LT: *trips = (uint64_t)bound - (uint64_t)start; return 1;
+        case CMP_NE: *trips = start < bound ? (uint64_t)bound - (uint64_t)start : 0; return start < bound;
+        case CMP_LE: *trips = (uint64_t)bound - (uint64_t)start + 1; return bound != INT64_MAX;
+        default:     return 0;
+        }
+    }
+
+    switch (op) {
+    case CMP_GT: *trips = (uint64_t)start - (uint64_t)bound; return 1;
+    case CMP_NE: *trips = start > bound ? (uint64_t)start - (uint64_t)bound : 0; return start > bound;
+    case CMP_GE: *trips = (uint64_t)start - (uint64_t)bound + 1; return bound != INT64_MIN;
+    default:     return 0;
+    }
+}
+
+/*
+Recognizes a canonical for loop and computes its trip count
+
+args:
+    *loop (ASTNode) -> AST_FOR_LOOP_NODE
+    *info (TripInfo) -> output
+
+returns:
+    (int) -> 1 if the loop is canonical with a known trip count
+*/
+static int analyze_loop(const ASTNode *loop, TripInfo *info) {
+    const ASTNode *init = loop->data.for_loop.initializer;
+    const ASTNode *cond = loop->data.for_loop.condition;
+    const ASTNode *step = loop->data.for_loop.step;
+
+    if (!init || init->type != AST_ASSIGN_NODE ||
+        init->data.assignment.value->type != AST_INTAGER_LIT_NODE) {
+        return 0;
+    }
+    const char *iv = init->data.assignment.identifier;
+
+    if (!step || step->type != AST_UNARY_EXPR || !is_var(step->data.unary_expr.operand, iv)) {
+        return 0;
+    }
+    int delta = step->data.unary_expr.op[0] == '+' ? 1 : -1;
+
+    if (!cond || cond->type != AST_CONDITIONAL_NODE) {
+        return 0;
+    }
+    CmpOp op;
+    if (!cmp_op_from_lexeme(cond->data.conditional.comparison_op, &op)) {
+        return 0;
+    }
+
+    const ASTNode *left = cond->data.conditional.left_expression;
+    const ASTNode *right = cond->data.conditional.right_expression;
+    int64_t bound;
+    if (is_var(left, iv) && right->type == AST_INTAGER_LIT_NODE) {
+        bound = right->data.int_lit.value;
+    } else if (is_var(right, iv) && left->type == AST_INTAGER_LIT_NODE) {
+        bound = left->data.int_lit.value;
+        op = mirror(op);
+    } else {
+        return 0;
+    }
+
+    if (writes_var(loop->data.for_loop.for_block, iv)) {
+        return 0;
+    }
+
+    info->iv = iv;
+    info->start = init->data.assignment.value->data.int_lit.value;
+    info->step = delta;
+    return trip_count(info->start, op, bound, delta, &info->trips);
+}
+
+/*
+Recognizes a for loop that counts by one towards a bound the body can't
+change, whatever its start and bound are
+
+args:
+    *loop (ASTNode) -> AST_FOR_LOOP_NODE
+    *info (RuntimeLoop) -> output
+
+returns:
+    (int) -> 1 if the loop has that shape
+*/
+static int analyze_runtime_loop(const ASTNode *loop, RuntimeLoop *info) {
+    const ASTNode *init = loop->data.for_loop.initializer;
+    const ASTNode *cond = loop->data.for_loop.condition;
+    const ASTNode *step = loop->data.for_loop.step;
+
+    if (!init || init->type != AST_ASSIGN_NODE || !cond || cond->type != AST_CONDITIONAL_NODE) {
+        return 0;
+    }
+    const char *iv = init->data.assignment.identifier;
+    if (!step || step->type != AST_UNARY_EXPR || !is_var(step->data.unary_expr.operand, iv)) {
+        return 0;
+    }
+    int delta = step->data.unary_expr.op[0] == '+' ? 1 : -1;
+
+    CmpOp op;
+    if (!cmp_op_from_lexeme(cond->data.conditional.comparison_op, &op)) {
+        return 0;
+    }
+    const ASTNode *left = cond->data.conditional.left_expression;
+    const ASTNode *right = cond->data.conditional.right_expression;
+    const ASTNode *bound;
+    if (is_var(left, iv)) {
+        bound = right;
+    } else if (is_var(right, iv)) {
+        bound = left;
+        op = mirror(op);
+    } else {
+        return 0;
+    }
+
+    // the loop must run towards the bound, which must stay put
+    if (delta > 0 ? op != CMP_LT && op != CMP_LE : op != CMP_GT && op != CMP_GE) {
+        return 0;
+    }
+    if (bound->type == AST_IDENTIFIER_NODE) {
+        if (is_var(bound, iv) || writes_var(loop->data.for_loop.for_block, bound->data.identifier.name)) {
+            return 0;
+        }
+    } else if (bound->type != AST_INTAGER_LIT_NODE) {
+        return 0;
+    }
+    if (writes_var(loop->data.for_loop.for_block, iv)) {
+        return 0;
+    }
+
+    info->iv = iv;
+    info->op = op;
+    info->step = delta;
+    info->bound = bound;
+    return 1;
+}
+
+// start + n * step with Eidos wrapping arithmetic
+static int64_t iv_after(const TripInfo *info, uint64_t n) {
+    uint64_t moved = info->step > 0 ? n : (uint64_t)0 - n;
+    return (int64_t)((uint64_t)info->start + moved);
+}
+
+static char *copy_string(const char *s) {
+    char *copy = eidos_strdup(s);
+    if (!copy) {
+        eidos_fatal("Failed to allocate unroll string");
+    }
+    return copy;
+}
+
+// `iv = value;`
+static ASTNode *new_assign(const ASTNode *at, const char *iv, int64_t value) {
+    ASTNode *assign = ast_new_node(AST_ASSIGN_NODE, at->line, at->col);
+    assign->data.assignment.identifier = copy_string(iv);
+    assign->data.assignment.value = ast_new_int_lit(value, at->line, at->col);
+    return assign;
+}
+
+/*
+Appends a statement (or a whole list) at *tail and returns the new tail link
+*/
+static ASTNode **append(ASTNode **tail, ASTNode *stmt_or_list, const ASTNode *at) {
+    if (!stmt_or_list) {
+        return tail;
+    }
+    if (stmt_or_list->type != AST_STMTS_NODE) {
+        ASTNode *item = ast_new_node(AST_STMTS_NODE, at->line, at->col);
+        item->data.stmts.stmt = stmt_or_list;
+        stmt_or_list = item;
+    }
+
+    *tail = stmt_or_list;
+    while (*tail) {
+        tail = &(*tail)->data.stmts.next;
+    }
+    return tail;
+}
+
+/*
+Replaces a loop by `trips` copies of its body
+
+returns:
+    (ASTNode*) -> statement list to splice in place of the loop
+*/
+static ASTNode *unroll_fully(const ASTNode *loop, const TripInfo *info) {
+    ASTNode *list = NULL;
+    ASTNode **tail = &list;
+
+    for (uint64_t k = 0; k < info->trips; k++) {
+        tail = append(tail, new_assign(loop, info->iv, iv_after(info, k)), loop);
+        tail = append(tail, ast_clone(loop->data.for_loop.for_block), loop);
+    }
+
+    // the variable keeps the value it has after the last step
+    append(tail, new_assign(loop, info->iv, iv_after(info, info->trips)), loop);
+    return list;
+}
+
+/*
+Rewrites a loop to run `factor` bodies per iteration, followed by a
+remainder loop for the trips that don't fill a whole iteration
+
+returns:
+    (ASTNode*) -> statement list to splice in place of the loop
+*/
+static ASTNode *unroll_partially(ASTNode *loop, const TripInfo *info, size_t factor) {
+    uint64_t main_trips = info->trips - info->trips % factor;
+    ASTNode *body = loop->data.for_loop.for_block;
+    ASTNode *list = NULL;
+    ASTNode **tail = &list;
+
+    ASTNode *remainder = NULL;
+    if (main_trips != info->trips) {
+        remainder = ast_clone(loop);
+        ast_free(remainder->data.for_loop.initializer);
+        remainder->data.for_loop.initializer = new_assign(loop, info->iv, iv_after(info, main_trips));
+    }
+
+    // main loop: body; i++; body; i++; ... body; and the loop's own step
+    ASTNode *unrolled = NULL;
+    ASTNode **utail = &unrolled;
+    for (size_t k = 0; k < factor; k++) {
+        if (k > 0) {
+            utail = append(utail, ast_clone(loop->data.for_loop.step), loop);
+        }
+        utail = append(utail, ast_clone(body), loop);
+    }
+    ast_free(body);
+    loop->data.for_loop.for_block = unrolled;
+
+    // the counter now moves by `factor` per check, so compare against the last full block
+    ASTNode *cond = loop->data.for_loop.condition;
+    ast_free(cond->data.conditional.left_expression);
+    ast_free(cond->data.conditional.right_expression);
+    eidos_free(cond->data.conditional.comparison_op);
+    ASTNode *iv = ast_new_node(AST_IDENTIFIER_NODE, cond->line, cond->col);
+    iv->data.identifier.name = copy_string(info->iv);
+    cond->data.conditional.left_expression = iv;
+    cond->data.conditional.comparison_op = copy_string(info->step > 0 ? "<" : ">");
+    cond->data.conditional.right_expression = ast_new_int_lit(iv_after(info, main_trips), cond->line, cond->col);
+
+    tail = append(tail, loop, loop);
+    append(tail, remainder, loop);
+    return list;
+}
+
+// `left op right`, taking ownership of both sides
+static ASTNode *new_compare(const ASTNode *at, ASTNode *left, const char *op, ASTNode *right) {
+    ASTNode *cond = ast_new_node(AST_CONDITIONAL_NODE, at->line, at->col);
+    cond->data.conditional.left_expression = left;
+    cond->data.conditional.comparison_op = copy_string(op);
+    cond->data.conditional.right_expression = right;
+    return cond;
+}
+
+/*
+Rewrites a loop whose trip count is only known at run time to run `factor`
+bodies per iteration while at least that many trips are left, and keeps the
+loop itself for the rest:
+
+    i = start;
+    if (bound - (factor - 1) < bound) {     // no wrap; decided here for a literal bound
+        for (i = i; i < bound - (factor - 1); i++) { body; i++; ... body; }
+    }
+    for (i = i; i < bound; i++) { body }
+
+Every body the first loop runs is one the loop would have run, in the same
+order, since none of the `factor` values after a passing check reaches the
+bound.
+
+returns:
+    (ASTNode*) -> statement list to splice in place of the loop, NULL if
+                  the bound is a literal so close to the end of the range that
+                  a whole block never fits
+*/
+static ASTNode *unroll_runtime(ASTNode *loop, const RuntimeLoop *info, size_t factor) {
+    static const char *ops[] = { [CMP_LT] = "<", [CMP_LE] = "<=", [CMP_GT] = ">", [CMP_GE] = ">=" };
+    const char *toward = info->step > 0 ? "<" : ">";
+    const char *shift = info->step > 0 ? "-" : "+";
+    int64_t span = (int64_t)factor - 1;
+
+    // the last start of a whole block: bound -/+ (factor - 1)
+    ASTNode *last;
+    ASTNode *guard = NULL;
+    if (info->bound->type == AST_INTAGER_LIT_NODE) {
+        int64_t b = info->bound->data.int_lit.value;
+        int64_t t = info->step > 0 ? eidos_sub(b, span) : eidos_add(b, span);
+        if (info->step > 0 ? t >= b : t <= b) {
+            return NULL;
+        }
+        last = ast_new_int_lit(t, loop->line, loop->col);
+    } else {
+        last = ast_new_node(AST_BINARY_EXPR, loop->line, loop->col);
+        last->data.binary_expr.left = ast_clone(info->bound);
+        last->data.binary_expr.op = copy_string(shift);
+        last->data.binary_expr.right = ast_new_int_lit(span, loop->line, loop->col);
+        guard = ast_new_node(AST_IF_STMT_NODE, loop->line, loop->col);
+        guard->data.if_stmt.condition = new_compare(loop, ast_clone(last), toward, ast_clone(info->bound));
+    }
+
+    ASTNode *body = loop->data.for_loop.for_block;
+    ASTNode *unrolled = NULL;
+    ASTNode **utail = &unrolled;
+    for (size_t k = 0; k < factor; k++) {
+        if (k > 0) {
+            utail = append(utail, ast_clone(loop->data.for_loop.step), loop);
+        }
+        utail = append(utail, ast_clone(body), loop);
+    }
+
+    ASTNode *iv = ast_new_node(AST_IDENTIFIER_NODE, loop->line, loop->col);
+    iv->data.identifier.name = copy_string(info->iv);
+    ASTNode *blocks = ast_new_node(AST_FOR_LOOP_NODE, loop->line, loop->col);
+    ASTNode *keep = ast_new_node(AST_IDENTIFIER_NODE, loop->line, loop->col);
+    keep->data.identifier.name = copy_string(info->iv);
+    blocks->data.for_loop.initializer = ast_new_node(AST_ASSIGN_NODE, loop->line, loop->col);
+    blocks->data.for_loop.initializer->data.assignment.identifier = copy_string(info->iv);
+    blocks->data.for_loop.initializer->data.assignment.value = keep;
+    blocks->data.for_loop.condition = new_compare(loop, iv, ops[info->op], last);
+    blocks->data.for_loop.step = ast_clone(loop->data.for_loop.step);
+    blocks->data.for_loop.for_block = unrolled;
+
+    // the start runs once, before both loops; the loop itself goes on from where the blocks stopped
+    ASTNode *init = loop->data.for_loop.initializer;
+    keep = ast_new_node(AST_IDENTIFIER_NODE, loop->line, loop->col);
+    keep->data.identifier.name = copy_string(info->iv);
+    loop->data.for_loop.initializer = ast_new_node(AST_ASSIGN_NODE, loop->line, loop->col);
+    loop->data.for_loop.initializer->data.assignment.identifier = copy_string(info->iv);
+    loop->data.for_loop.initializer->data.assignment.value = keep;
+
+    ASTNode *list = NULL;
+    ASTNode **tail = append(&list, init, loop);
+    if (guard) {
+        guard->data.if_stmt.then_block = NULL;
+        append(&guard->data.if_stmt.then_block, blocks, loop);
+        tail = append(tail, guard, loop);
+    } else {
+        tail = append(tail, blocks, loop);
+    }
+    append(tail, loop, loop);
+    return list;
+}
+
+static void unroll_stmts(UnrollState *st, ASTNode **link);
+
+/*
+Unrolls the loops nested in a statement
+
+args:
+    *st (UnrollState) -> unroll state
+    *stmt (ASTNode) -> statement
+    **replacement (ASTNode) -> set to the list replacing stmt
+
+returns:
+    (int) -> 1 if stmt was replaced by *replacement
+*/
+static int unroll_stmt(UnrollState *st, ASTNode *stmt, ASTNode **replacement) {
+    switch (stmt->type) {
+    case AST_IF_STMT_NODE:
+        unroll_stmts(st, &stmt->data.if_stmt.then_block);
+        unroll_stmts(st, &stmt->data.if_stmt.else_block);
+        return 0;
+
+    case AST_WHILE_LOOP_NODE:
+        unroll_stmts(st, &stmt->data.while_loop.while_block);
+        return 0;
+
+    case AST_FN_DECL_NODE:
+        unroll_stmts(st, &stmt->data.fn_decl.body);
+        return 0;
+
+    case AST_FOR_LOOP_NODE:
+        break;
+
+    default:
+        return 0;
+    }
+
+    // innermost first, the outer loop then copies the already unrolled body
+    unroll_stmts(st, &stmt->data.for_loop.for_block);
+
+    const UnrollOptions *opt = st->options;
+    TripInfo info;
+    if (!analyze_loop(stmt, &info)) {
+        // only a profile knows whether unrolling pays when the trips aren't known
+        RuntimeLoop runtime;
+        if (!opt->loop_factor || !analyze_runtime_loop(stmt, &runtime)) {
+            return 0;
+        }
+        size_t factor = opt->loop_factor(opt->loop_factor_user, stmt, 0);
+        if (factor < 2 || writes_array(stmt->data.for_loop.for_block)) {
+            return 0;
+        }
+
+        // the unrolled loop: factor bodies and steps, its condition and the guard
+        size_t body = ast_count_nodes(stmt->data.for_loop.for_block);
+        size_t step = ast_count_nodes(stmt->data.for_loop.step);
+        size_t cost = factor * (body + step) + 3 * ast_count_nodes(stmt->data.for_loop.condition) + 8;
+        if (cost > st->budget_left) {
+            st->stats->over_budget++;
+            return 0;
+        }
+        *replacement = unroll_runtime(stmt, &runtime, factor);
+        if (!*replacement) {
+            return 0;
+        }
+        st->budget_left -= cost;
+        st->stats->nodes_added += cost;
+        st->stats->partially_unrolled++;
+        return 1;
+    }
+
+    size_t body = ast_count_nodes(stmt->data.for_loop.for_block);
+    size_t factor = opt->loop_factor ? opt->loop_factor(opt->loop_factor_user, stmt, opt->factor) : opt->factor;
+    if (factor == 0) {
+        return 0;
+    }
+
+    if (info.trips <= opt->max_full_trips) {
+        // every copy also gets a two node `i = k;`
+        if (info.trips > st->budget_left / (body + 2)) {
+            st->stats->over_budget++;
+            return 0;
+        }
+        size_t cost = info.trips * (body + 2) + 2;
+        if (cost > st->budget_left) {
+            st->stats->over_budget++;
+            return 0;
+        }
+
+        *replacement = unroll_fully(stmt, &info);
+        ast_free(stmt);
+        st->budget_left -= cost;
+        st->stats->nodes_added += cost;
+        st->stats->fully_unrolled++;
+        return 1;
+    }
+
+    // a loop writing an array keeps one element per iteration, the shape the C backend's vector kernels need
+    if (factor < 2 || info.trips < factor || writes_array(stmt->data.for_loop.for_block)) {
+        return 0;
+    }
+
+    // factor - 1 more bodies with their steps, plus the remainder loop
+    size_t step = ast_count_nodes(stmt->data.for_loop.step);
+    size_t cost = (factor - 1) * (body + step);
+    if (info.trips % factor) {
+        cost += ast_count_nodes(stmt);
+    }
+    if (cost > st->budget_left) {
+        st->stats->over_budget++;
+        return 0;
+    }
+
+    *replacement = unroll_partially(stmt, &info, factor);
+    st->budget_left -= cost;
+    st->stats->nodes_added += cost;
+    st->stats->partially_unrolled++;
+    return 1;
+}
+
+/*
+Unrolls the loops of a statement list in place
+
+args:
+    *st (UnrollState) -> unroll state
+    **link (ASTNode) -> pointer to the head of the list
+*/
+static void unroll_stmts(UnrollState *st, ASTNode **link) {
+    while (*link) {
+        ASTNode *item = *link;
+        ASTNode *replacement = NULL;
+
+        if (!unroll_stmt(st, item->data.stmts.stmt, &replacement)) {
+            link = &item->data.stmts.next;
+            continue;
+        }
+
+        ASTNode *rest = item->data.stmts.next;
+        eidos_free(item);
+
+        // the replacement is already unrolled, continue after it
+        *link = replacement;
+        while (*link) {
+            link = &(*link)->data.stmts.next;
+        }
+        *link = rest;
+    }
+}
+
+
+/* ========== PUBLIC API ========== */
+
+void unroll_default_options(UnrollOptions *options) {
+    options->max_full_trips = 16;
+    options->factor = 4;
+    options->budget = 4096;
+    options->loop_factor = NULL;
+    options->loop_factor_user = NULL;
+}
+
+/*
+Unrolls the canonical for loops of a program
+
+args:
+    *program (ASTNode) -> AST_PROGRAM_NODE to rewrite in place
+    *options (UnrollOptions) -> limits
+    *stats (UnrollStats) -> counters to add to
+*/
+void unroll_program(ASTNode *program, const UnrollOptions *options, UnrollStats *stats) {
+    UnrollState st;
+    st.options = options;
+    st.stats = stats;
+    st.budget_left = options->budget;
+
+    unroll_stmts(&st, &program->data.program.stmts);
+}
+
+/*
+Prints unroll counters on one line
+
+args:
+    *stats (UnrollStats) -> counters to print
+    *out (FILE) -> stream to print to
+*/
+void unroll_print_stats(const UnrollStats *stats, FILE *out) {
+    fprintf(out, "unroll: %zu loops fully unrolled, %zu partially unrolled, %zu over budget, %zu nodes added\n",
+            stats->fully_unrolled, stats->partially_unrolled, stats->over_budget, stats->nodes_added);
+}
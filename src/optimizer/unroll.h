@@ -0,0 +1,62 @@
+#pragma once
+
+/*
+Loop unrolling over the AST.
+
+Runs after constant folding, which turns bounds like `r < mu` into literals.
+A canonical for loop
+
+    for (i = <literal>; i <op> <literal>; i++ or i--) { body that never writes i }
+
+has a trip count known at compile time. Loops with few trips are replaced by
+that many copies of the body, each preceded by `i = <value>;`, and the IR passes
+then evaluate them like straight-line code. Longer loops get `factor` copies
+of the body per iteration plus a remainder loop for the leftover trips.
+
+With a profile (loop_factor), a for loop counting by one towards a bound its
+body doesn't change is unrolled even when the trip count is only known at run
+time: `factor` bodies per iteration while a whole block of trips is left, then
+the loop itself for the rest.
+
+Every copy counts against a budget of added AST nodes, so unrolling can't blow
+up the size of the compiled program.
+*/
+
+#include "../parser/ast.h"
+
+typedef struct UnrollOptions {
+    size_t max_full_trips;      // loops with at most this many trips are fully unrolled
+    size_t factor;              // body copies per iteration of a partially unrolled loop, < 2 disables
+    size_t budget;              // AST nodes unrolling may add to the whole program
+
+    // per-loop factor from a recorded profile (pgo.h), NULL to use `factor` everywhere; gets the
+    // default, 0 for a loop whose trips are only known at run time, and returns the loop's
+    // factor, 1 to only unroll it fully, 0 to leave it alone
+    size_t (*loop_factor)(void *user, const ASTNode *loop, size_t factor);
+    void *loop_factor_user;
+} UnrollOptions;
+
+typedef struct UnrollStats {
+    size_t fully_unrolled;      // loops replaced by straight-line copies
+    size_t partially_unrolled;  // loops unrolled by the factor
+    size_t over_budget;         // loops left alone because the budget ran out
+    size_t nodes_added;         // AST nodes added, at most the budget
+} UnrollStats;
+
+
+/* ========== Public API Functions ========== */
+
+/*
+Fills in the default options
+*/
+void unroll_default_options(UnrollOptions *options);
+
+/*
+Unrolls every canonical for loop of the program in place, innermost first
+*/
+void unroll_program(ASTNode *program, const UnrollOptions *options, UnrollStats *stats);
+
+/*
+Prints the counters of an unroll run as one line to the stream
+*/
+void unroll_print_stats(const UnrollStats *stats, FILE *out);
@@ -0,0 +1,570 @@
+#include "ast.h"
+#include "../util/context.h"
+#include <string.h>
+
+/* ===== Helper Functions ===== */
+
+/*
+Prints the indentation for a node at the given depth
+
+args:
+    depth (int) -> nesting depth of the node
+    *out (FILE) -> stream to print to
+*/
+static void dump_indent(int depth, FILE *out) {
+    for (int i = 0; i < depth; i++) {
+        fputs("  ", out);
+    }
+}
+
+/*
+Prints a node and its children, one node per line
+
+args:
+    *node (ASTNode) -> node to print, NULL prints nothing
+    depth (int) -> nesting depth of the node
+    *out (FILE) -> stream to print to
+*/
+static void dump_node(const ASTNode *node, int depth, FILE *out) {
+    if (!node) {
+        return;
+    }
+
+    // statement lists are flattened so blocks read like the source
+    if (node->type == AST_STMTS_NODE) {
+        for (const ASTNode *s = node; s; s = s->data.stmts.next) {
+            dump_node(s->data.stmts.stmt, depth, out);
+        }
+        return;
+    }
+
+    dump_indent(depth, out);
+
+    switch (node->type) {
+    case AST_PROGRAM_NODE:
+        fputs("Program\n", out);
+        dump_node(node->data.program.stmts, depth + 1, out);
+        break;
+
+    case AST_VAR_DECL_NODE:
+        fprintf(out, "VarDecl %s\n", node->data.var_decl.identifer);
+        dump_node(node->data.var_decl.value, depth + 1, out);
+        break;
+
+    case AST_ASSIGN_NODE:
+        fprintf(out, "Assign %s\n", node->data.assignment.identifier);
+        dump_node(node->data.assignment.value, depth + 1, out);
+        break;
+
+    case AST_ARRAY_DECL_NODE:
+        fprintf(out, "ArrayDecl %s[%lld]\n", node->data.array_decl.identifier,
+                (long long)node->data.array_decl.size);
+        break;
+
+    case AST_INDEX_ASSIGN_NODE:
+        fprintf(out, "IndexAssign %s\n", node->data.index_assign.identifier);
+        dump_node(node->data.index_assign.index, depth + 1, out);
+        dump_node(node->data.index_assign.value, depth + 1, out);
+        break;
+
+    case AST_FN_DECL_NODE:
+        fprintf(out, "FnDecl %s(", node->data.fn_decl.name);
+        for (size_t i = 0; i < node->data.fn_decl.nparams; i++) {
+            fprintf(out, "%s%s", i ? ", " : "", node->data.fn_decl.params[i]);
+        }
+        fputs(")\n", out);
+        dump_node(node->data.fn_decl.body, depth + 1, out);
+        dump_indent(depth, out);
+        fputs("Return\n", out);
+        dump_node(node->data.fn_decl.ret, depth + 1, out);
+        break;
+
+    case AST_IF_STMT_NODE:
+        fputs("If\n", out);
+        dump_node(node->data.if_stmt.condition, depth + 1, out);
+        dump_indent(depth, out);
+        fputs("Then\n", out);
+        dump_node(node->data.if_stmt.then_block, depth + 1, out);
+        if (node->data.if_stmt.else_block) {
+            dump_indent(depth, out);
+            fputs("Else\n", out);
+            dump_node(node->data.if_stmt.else_block, depth + 1, out);
+        }
+        break;
+
+    case AST_FOR_LOOP_NODE:
+        fputs("For\n", out);
+        dump_node(node->data.for_loop.initializer, depth + 1, out);
+        dump_node(node->data.for_loop.condition, depth + 1, out);
+        dump_node(node->data.for_loop.step, depth + 1, out);
+        dump_indent(depth, out);
+        fputs("Do\n", out);
+        dump_node(node->data.for_loop.for_block, depth + 1, out);
+        break;
+
+    case AST_WHILE_LOOP_NODE:
+        fputs("While\n", out);
+        dump_node(node->data.while_loop.condition, depth + 1, out);
+        dump_indent(depth, out);
+        fputs("Do\n", out);
+        dump_node(node->data.while_loop.while_block, depth + 1, out);
+        break;
+
+    case AST_PRINT_NODE:
+        fputs("Print\n", out);
+        dump_node(node->data.print_stmt.expression, depth + 1, out);
+        break;
+
+    case AST_READ_NODE:
+        fprintf(out, "Read %s\n", node->data.read_stmt.identifier);
+        break;
+
+    case AST_BINARY_EXPR:
+        fprintf(out, "Binary %s\n", node->data.binary_expr.op);
+        dump_node(node->data.binary_expr.left, depth + 1, out);
+        dump_node(node->data.binary_expr.right, depth + 1, out);
+        break;
+
+    case AST_CONDITIONAL_NODE:
+        fprintf(out, "Cond %s\n", node->data.conditional.comparison_op);
+        dump_node(node->data.conditional.left_expression, depth + 1, out);
+        dump_node(node->data.conditional.right_expression, depth + 1, out);
+        break;
+
+    case AST_UNARY_EXPR:
+        fprintf(out, "Unary %s%s\n", node->data.unary_expr.op,
+                node->data.unary_expr.is_prefix ? " (prefix)" : " (postfix)");
+        dump_node(node->data.unary_expr.operand, depth + 1, out);
+        break;
+
+    case AST_INDEX_EXPR:
+        fprintf(out, "Index %s\n", node->data.index_expr.identifier);
+        dump_node(node->data.index_expr.index, depth + 1, out);
+        break;
+
+    case AST_CALL_EXPR:
+        fprintf(out, "Call %s\n", node->data.call_expr.name);
+        for (size_t i = 0; i < node->data.call_expr.nargs; i++) {
+            dump_node(node->data.call_expr.args[i], depth + 1, out);
+        }
+        break;
+
+    case AST_IDENTIFIER_NODE:
+        fprintf(out, "Ident %s\n", node->data.identifier.name);
+        break;
+
+    case AST_INTAGER_LIT_NODE:
+        fprintf(out, "IntLit %lld\n", (long long)node->data.int_lit.value);
+        break;
+
+    default:
+        fprintf(out, "<node %d>\n", node->type);
+        break;
+    }
+}
+
+
+/* ========== PUBLIC API ========== */
+
+/*
+Allocates a zeroed AST node
+
+args:
+    type (ASTNodeType) -> type tag of the node
+    line (size_t) -> source line the node starts on
+    col (size_t) -> source column the node starts on
+
+returns:
+    node (ASTNode) -> the new node, exits on allocation failure
+*/
+ASTNode* ast_new_node(ASTNodeType type, size_t line, size_t col) {
+    ASTNode *node = (ASTNode*)eidos_calloc(1, sizeof(ASTNode));
+    if (!node) {
+        eidos_fatal("Failed to allocate AST node");
+    }
+
+    node->type = type;
+    node->line = line;
+    node->col = col;
+    node->refs = 1;
+
+    return node;
+}
+
+/*
+Allocates an integer literal node
+
+args:
+    value (int64_t) -> value of the literal
+    line (size_t) -> source line the literal came from
+    col (size_t) -> source column the literal came from
+
+returns:
+    node (ASTNode) -> the new AST_INTAGER_LIT_NODE
+*/
+ASTNode* ast_new_int_lit(int64_t value, size_t line, size_t col) {
+    ASTNode *node = ast_new_node(AST_INTAGER_LIT_NODE, line, col);
+    node->data.int_lit.value = value;
+    return node;
+}
+
+/*
+Drops a reference to an AST node; the last one frees it, its children and its owned strings
+
+args:
+    *node (ASTNode) -> node to free, NULL is ignored
+*/
+void ast_free(ASTNode *node) {
+    // statement lists are walked iteratively so long programs don't blow the stack
+    while (node && node->type == AST_STMTS_NODE) {
+        ASTNode *next = node->data.stmts.next;
+        ast_free(node->data.stmts.stmt);
+        eidos_free(node);
+        node = next;
+    }
+
+    // nodes shared by hash-consing go away with their last owner
+    if (!node || --node->refs > 0) {
+        return;
+    }
+
+    switch (node->type) {
+    case AST_PROGRAM_NODE:
+        ast_free(node->data.program.stmts);
+        break;
+
+    case AST_VAR_DECL_NODE:
+        eidos_free(node->data.var_decl.identifer);
+        ast_free(node->data.var_decl.value);
+        break;
+
+    case AST_ASSIGN_NODE:
+        eidos_free(node->data.assignment.identifier);
+        ast_free(node->data.assignment.value);
+        break;
+
+    case AST_ARRAY_DECL_NODE:
+        eidos_free(node->data.array_decl.identifier);
+        break;
+
+    case AST_INDEX_ASSIGN_NODE:
+        eidos_free(node->data.index_assign.identifier);
+        ast_free(node->data.index_assign.index);
+        ast_free(node->data.index_assign.value);
+        break;
+
+    case AST_FN_DECL_NODE:
+        eidos_free(node->data.fn_decl.name);
+        for (size_t i = 0; i < node->data.fn_decl.nparams; i++) {
+            eidos_free(node->data.fn_decl.params[i]);
+        }
+        eidos_free(node->data.fn_decl.params);
+        ast_free(node->data.fn_decl.body);
+        ast_free(node->data.fn_decl.ret);
+        break;
+
+    case AST_IF_STMT_NODE:
+        ast_free(node->data.if_stmt.condition);
+        ast_free(node->data.if_stmt.then_block);
+        ast_free(node->data.if_stmt.else_block);
+        break;
+
+    case AST_FOR_LOOP_NODE:
+        ast_free(node->data.for_loop.initializer);
+        ast_free(node->data.for_loop.condition);
+        ast_free(node->data.for_loop.step);
+        ast_free(node->data.for_loop.for_block);
+        break;
+
+    case AST_WHILE_LOOP_NODE:
+        ast_free(node->data.while_loop.condition);
+        ast_free(node->data.while_loop.while_block);
+        break;
+
+    case AST_PRINT_NODE:
+        ast_free(node->data.print_stmt.expression);
+        break;
+
+    case AST_READ_NODE:
+        eidos_free(node->data.read_stmt.identifier);
+        break;
+
+    case AST_BINARY_EXPR:
+        ast_free(node->data.binary_expr.left);
+        eidos_free(node->data.binary_expr.op);
+        ast_free(node->data.binary_expr.right);
+        break;
+
+    case AST_CONDITIONAL_NODE:
+        ast_free(node->data.conditional.left_expression);
+        eidos_free(node->data.conditional.comparison_op);
+        ast_free(node->data.conditional.right_expression);
+        break;
+
+    case AST_UNARY_EXPR:
+        eidos_free(node->data.unary_expr.op);
+        ast_free(node->data.unary_expr.operand);
+        break;
+
+    case AST_INDEX_EXPR:
+        eidos_free(node->data.index_expr.identifier);
+        ast_free(node->data.index_expr.index);
+        break;
+
+    case AST_CALL_EXPR:
+        eidos_free(node->data.call_expr.name);
+        for (size_t i = 0; i < node->data.call_expr.nargs; i++) {
+            ast_free(node->data.call_expr.args[i]);
+        }
+        eidos_free(node->data.call_expr.args);
+        break;
+
+    case AST_IDENTIFIER_NODE:
+        eidos_free(node->data.identifier.name);
+        break;
+
+    default:
+        break;
+    }
+
+    eidos_free(node);
+}
+
+/*
+Duplicates a string, exiting if memory runs out
+*/
+static char *copy_string(const char *s) {
+    if (!s) {
+        return NULL;
+    }
+    char *copy = eidos_strdup(s);
+    if (!copy) {
+        eidos_fatal("Failed to allocate AST string");
+    }
+    return copy;
+}
+
+/*
+Deep copies an AST node, its children and its owned strings
+
+args:
+    *node (ASTNode) -> node to copy, NULL gives NULL
+
+returns:
+    (ASTNode*) -> the copy, with the same source positions
+*/
+ASTNode* ast_clone(const ASTNode *node) {
+    if (!node) {
+        return NULL;
+    }
+
+    // statement lists are copied iteratively, like ast_free walks them
+    if (node->type == AST_STMTS_NODE) {
+        ASTNode *head = NULL;
+        ASTNode **link = &head;
+        for (; node; node = node->data.stmts.next) {
+            ASTNode *item = ast_new_node(AST_STMTS_NODE, node->line, node->col);
+            item->data.stmts.stmt = ast_clone(node->data.stmts.stmt);
+            *link = item;
+            link = &item->data.stmts.next;
+        }
+        return head;
+    }
+
+    ASTNode *copy = ast_new_node(node->type, node->line, node->col);
+
+    switch (node->type) {
+    case AST_PROGRAM_NODE:
+        copy->data.program.stmts = ast_clone(node->data.program.stmts);
+        break;
+
+    case AST_VAR_DECL_NODE:
+        copy->data.var_decl.identifer = copy_string(node->data.var_decl.identifer);
+        copy->data.var_decl.value = ast_clone(node->data.var_decl.value);
+        break;
+
+    case AST_ASSIGN_NODE:
+        copy->data.assignment.identifier = copy_string(node->data.assignment.identifier);
+        copy->data.assignment.value = ast_clone(node->data.assignment.value);
+        break;
+
+    case AST_ARRAY_DECL_NODE:
+        copy->data.array_decl.identifier = copy_string(node->data.array_decl.identifier);
+        copy->data.array_decl.size = node->data.array_decl.size;
+        break;
+
+    case AST_INDEX_ASSIGN_NODE:
+        copy->data.index_assign.identifier = copy_string(node->data.index_assign.identifier);
+        copy->data.index_assign.index = ast_clone(node->data.index_assign.index);
+        copy->data.index_assign.value = ast_clone(node->data.index_assign.value);
+        break;
+
+    case AST_FN_DECL_NODE: {
+        size_t n = node->data.fn_decl.nparams;
+        copy->data.fn_decl.name = copy_string(node->data.fn_decl.name);
+        copy->data.fn_decl.params = eidos_malloc((n ? n : 1) * sizeof(char*));
+        if (!copy->data.fn_decl.params) {
+            eidos_fatal("Failed to allocate AST node");
+        }
+        for (size_t i = 0; i < n; i++) {
+            copy->data.fn_decl.params[i] = copy_string(node->data.fn_decl.params[i]);
+        }
+        copy->data.fn_decl.nparams = n;
+        copy->data.fn_decl.body = ast_clone(node->data.fn_decl.body);
+        copy->data.fn_decl.ret = ast_clone(node->data.fn_decl.ret);
+        break;
+    }
+
+    case AST_IF_STMT_NODE:
+        copy->data.if_stmt.condition = ast_clone(node->data.if_stmt.condition);
+        copy->data.if_stmt.then_block = ast_clone(node->data.if_stmt.then_block);
+        copy->data.if_stmt.else_block = ast_clone(node->data.if_stmt.else_block);
+        break;
+
+    case AST_FOR_LOOP_NODE:
+        copy->data.for_loop.initializer = ast_clone(node->data.for_loop.initializer);
+        copy->data.for_loop.condition = ast_clone(node->data.for_loop.condition);
+        copy->data.for_loop.step = ast_clone(node->data.for_loop.step);
+        copy->data.for_loop.for_block = ast_clone(node->data.for_loop.for_block);
+        break;
+
+    case AST_WHILE_LOOP_NODE:
+        copy->data.while_loop.condition = ast_clone(node->data.while_loop.condition);
+        copy->data.while_loop.while_block = ast_clone(node->data.while_loop.while_block);
+        break;
+
+    case AST_PRINT_NODE:
+        copy->data.print_stmt.expression = ast_clone(node->data.print_stmt.expression);
+        break;
+
+    case AST_READ_NODE:
+        copy->data.read_stmt.identifier = copy_string(node->data.read_stmt.identifier);
+        break;
+
+    case AST_BINARY_EXPR:
+        copy->data.binary_expr.left = ast_clone(node->data.binary_expr.left);
+        copy->data.binary_expr.op = copy_string(node->data.binary_expr.op);
+        copy->data.binary_expr.right = ast_clone(node->data.binary_expr.right);
+        break;
+
+    case AST_CONDITIONAL_NODE:
+        copy->data.conditional.left_expression = ast_clone(node->data.conditional.left_expression);
+        copy->data.conditional.comparison_op = copy_string(node->data.conditional.comparison_op);
+        copy->data.conditional.right_expression = ast_clone(node->data.conditional.right_expression);
+        break;
+
+    case AST_UNARY_EXPR:
+        copy->data.unary_expr.op = copy_string(node->data.unary_expr.op);
+        copy->data.unary_expr.operand = ast_clone(node->data.unary_expr.operand);
+        copy->data.unary_expr.is_prefix = node->data.unary_expr.is_prefix;
+        break;
+
+    case AST_INDEX_EXPR:
+        copy->data.index_expr.identifier = copy_string(node->data.index_expr.identifier);
+        copy->data.index_expr.index = ast_clone(node->data.index_expr.index);
+        break;
+
+    case AST_CALL_EXPR: {
+        size_t n = node->data.call_expr.nargs;
+        copy->data.call_expr.name = copy_string(node->data.call_expr.name);
+        copy->data.call_expr.args = eidos_malloc((n ? n : 1) * sizeof(ASTNode*));
+        if (!copy->data.call_expr.args) {
+            eidos_fatal("Failed to allocate AST node");
+        }
+        for (size_t i = 0; i < n; i++) {
+            copy->data.call_expr.args[i] = ast_clone(node->data.call_expr.args[i]);
+        }
+        copy->data.call_expr.nargs = n;
+        break;
+    }
+
+    case AST_IDENTIFIER_NODE:
+        copy->data.identifier.name = copy_string(node->data.identifier.name);
+        break;
+
+    case AST_INTAGER_LIT_NODE:
+        copy->data.int_lit.value = node->data.int_lit.value;
+        break;
+
+    default:
+        break;
+    }
+
+    return copy;
+}
+
+/*
+Counts the nodes of a tree, a rough measure of the code it generates
+
+args:
+    *node (ASTNode) -> root, NULL counts 0
+
+returns:
+    (size_t) -> number of nodes, statement list links excluded
+*/
+size_t ast_count_nodes(const ASTNode *node) {
+    size_t count = 0;
+
+    for (; node && node->type == AST_STMTS_NODE; node = node->data.stmts.next) {
+        count += ast_count_nodes(node->data.stmts.stmt);
+    }
+    if (!node) {
+        return count;
+    }
+
+    switch (node->type) {
+    case AST_PROGRAM_NODE:
+        return 1 + ast_count_nodes(node->data.program.stmts);
+    case AST_VAR_DECL_NODE:
+        return 1 + ast_count_nodes(node->data.var_decl.value);
+    case AST_ASSIGN_NODE:
+        return 1 + ast_count_nodes(node->data.assignment.value);
+    case AST_INDEX_ASSIGN_NODE:
+        return 1 + ast_count_nodes(node->data.index_assign.index) +
+               ast_count_nodes(node->data.index_assign.value);
+    case AST_IF_STMT_NODE:
+        return 1 + ast_count_nodes(node->data.if_stmt.condition) +
+               ast_count_nodes(node->data.if_stmt.then_block) +
+               ast_count_nodes(node->data.if_stmt.else_block);
+    case AST_FOR_LOOP_NODE:
+        return 1 + ast_count_nodes(node->data.for_loop.initializer) +
+               ast_count_nodes(node->data.for_loop.condition) +
+               ast_count_nodes(node->data.for_loop.step) +
+               ast_count_nodes(node->data.for_loop.for_block);
+    case AST_WHILE_LOOP_NODE:
+        return 1 + ast_count_nodes(node->data.while_loop.condition) +
+               ast_count_nodes(node->data.while_loop.while_block);
+    case AST_PRINT_NODE:
+        return 1 + ast_count_nodes(node->data.print_stmt.expression);
+    case AST_BINARY_EXPR:
+        return 1 + ast_count_nodes(node->data.binary_expr.left) +
+               ast_count_nodes(node->data.binary_expr.right);
+    case AST_CONDITIONAL_NODE:
+        return 1 + ast_count_nodes(node->data.conditional.left_expression) +
+               ast_count_nodes(node->data.conditional.right_expression);
+    case AST_UNARY_EXPR:
+        return 1 + ast_count_nodes(node->data.unary_expr.operand);
+    case AST_INDEX_EXPR:
+        return 1 + ast_count_nodes(node->data.index_expr.index);
+    case AST_FN_DECL_NODE:
+        return 1 + ast_count_nodes(node->data.fn_decl.body) + ast_count_nodes(node->data.fn_decl.ret);
+    case AST_CALL_EXPR:
+        for (size_t i = 0; i < node->data.call_expr.nargs; i++) {
+            count += ast_count_nodes(node->data.call_expr.args[i]);
+        }
+        return 1 + count;
+    default:
+        return 1;
+    }
+}
+
+/*
+Prints an indented tree of the AST, one node per line
+
+args:
+    *node (ASTNode) -> root of the tree to print
+    *out (FILE) -> stream to print to
+*/
+void ast_dump(const ASTNode *node, FILE *out) {
+    dump_node(node, 0, out);
+}
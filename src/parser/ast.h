@@ -7,6 +7,8 @@ It contains:
 - ASTNode struct: a tagged union representing any AST node, with type-specific data for:
     * Program structure (program root, statement lists)
     * Variable operations (declarations, assignments, inc/dec)
+    * Fixed-size integer arrays (declarations, indexed reads and writes)
+    * User-defined functions (declarations, calls)
     * Control flow (if/else, for loops, while loops)
     * I/O operations (print, read)
     * Expressions (binary operations, comparisons, unary operations, literals)
@@ -17,6 +19,7 @@ The AST is built by the syntax parser and used by the semantic analyzer.
 #include <stdlib.h>
 #include <stdio.h>
 #include <ctype.h>
+#include <stdint.h>
 
 typedef enum {
 
@@ -32,11 +35,16 @@ typedef enum {
     AST_WHILE_LOOP_NODE,
     AST_PRINT_NODE,
     AST_READ_NODE,
+    AST_ARRAY_DECL_NODE,
+    AST_INDEX_ASSIGN_NODE,
+    AST_FN_DECL_NODE,
 
     // Expression Nodes
     AST_BINARY_EXPR,
     AST_CONDITIONAL_NODE,
     AST_UNARY_EXPR, 
+    AST_INDEX_EXPR,
+    AST_CALL_EXPR,
 
     // TERMINALS 
     AST_IDENTIFIER_NODE,
@@ -47,6 +55,10 @@ typedef enum {
 
 typedef struct ASTNode {
     ASTNodeType type;
+    size_t line;                        // line of the token that started this node
+    size_t col;                         // column of the token that started this node
+    unsigned refs;                      // owners of the node, more than 1 once hash-consing shares it
+    size_t hash_id;                     // hash-consing class (optimizer/hashcons.h), 0 if not interned
 
     union {
         // Program Node
@@ -74,6 +86,28 @@ typedef struct ASTNode {
         } assignment;
 
 
+        // AST_ARRAY_DECL_NODE: let a[64];
+        struct {
+            char *identifier;            // a
+            int64_t size;                // 64, elements start out 0
+        } array_decl;
+
+        // AST_INDEX_ASSIGN_NODE: a[i] = 5;
+        struct {
+            char *identifier;            // a
+            struct ASTNode *index;       // i
+            struct ASTNode *value;       // 5
+        } index_assign;
+
+        // AST_FN_DECL_NODE: fn add(a, b) { body return a + b; }
+        struct {
+            char *name;                  // add
+            char **params;               // a, b
+            size_t nparams;
+            struct ASTNode *body;        // statements before the return, NULL if none
+            struct ASTNode *ret;         // a + b
+        } fn_decl;
+
         // AST_IF_STMT_NODE: if (x == 5) { then_block } else { else_block }
         struct {
             struct ASTNode *condition;    // 2 expressions being compared that evaluates to True
@@ -100,9 +134,9 @@ typedef struct ASTNode {
 
         // AST_CONDITIONAL_NODE: x >= 3
         struct {
-            char *left_expression;
-            char *comparison_op;
-            char *right_expression;
+            struct ASTNode *left_expression;    // x
+            char *comparison_op;                // ==, !=, <, >, <=, >=
+            struct ASTNode *right_expression;   // 3
         } conditional;
 
         // AST_PRINT_NODE 
@@ -122,6 +156,19 @@ typedef struct ASTNode {
             int is_prefix;               // 1 for ++x/--x, 0 for x++/x-- (matters for inc/dec)
         } unary_expr;
 
+        // AST_INDEX_EXPR: a[i + 1]
+        struct {
+            char *identifier;            // a
+            struct ASTNode *index;       // i + 1
+        } index_expr;
+
+        // AST_CALL_EXPR: add(x, 1)
+        struct {
+            char *name;                  // add
+            struct ASTNode **args;       // x, 1
+            size_t nargs;
+        } call_expr;
+
         // AST_BINARY_EXPR let x = a * t;
         struct {
             struct ASTNode *left;       // left operand
@@ -129,9 +176,49 @@ typedef struct ASTNode {
             struct ASTNode *right;      // right operand
         } binary_expr;
 
+        // AST_IDENTIFIER_NODE: x
+        struct {
+            char *name;
+        } identifier;
 
-
+        // AST_INTAGER_LIT_NODE: 5
+        struct {
+            int64_t value;
+        } int_lit;
 
     } data;
 } ASTNode;
 
+
+/* ========== AST Helpers (ast.c) ========== */
+
+/*
+Allocates a zeroed node of the given type stamped with its source position
+*/
+ASTNode* ast_new_node(ASTNodeType type, size_t line, size_t col);
+
+/*
+Allocates an integer literal node
+*/
+ASTNode* ast_new_int_lit(int64_t value, size_t line, size_t col);
+
+/*
+Drops one reference to a node; the last one frees it, its children and the strings it owns
+*/
+void ast_free(ASTNode *node);
+
+/*
+Deep copies a node and everything below it (statement lists included)
+*/
+ASTNode* ast_clone(const ASTNode *node);
+
+/*
+Number of nodes in a tree, not counting statement list links
+*/
+size_t ast_count_nodes(const ASTNode *node);
+
+/*
+Prints an indented, human readable tree of the node to the stream
+*/
+void ast_dump(const ASTNode *node, FILE *out);
+
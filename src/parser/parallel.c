@@ -0,0 +1,286 @@
+#include "parallel.h"
+#include "parser.h"
+#include "../util/context.h"
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct Range {
+    size_t begin;           // first token
+    size_t end;             // first token of the next range
+    ASTNode *head;          // parsed statements
+    ASTNode *tail;          // last STMTS node of head
+    int failed;
+} Range;
+
+typedef struct Job {
+    const TokenBuffer *buffer;
+    Range *ranges;
+    size_t nranges;
+    size_t next;            // next range to hand out
+    pthread_mutex_t lock;
+} Job;
+
+/* ===== Helper Functions ===== */
+
+/*
+Parses one range, with syntax errors unwinding back here
+
+args:
+    *buffer (TokenBuffer) -> tokens of the program
+    *range (Range) -> range to parse, receives its statements
+*/
+static void parse_range(const TokenBuffer *buffer, Range *range) {
+    Parser *parser = parser_init_tokens(buffer->tokens, range->begin, range->end);
+    jmp_buf recover;
+    parser->recover = &recover;
+
+    // the statements so far hang off the range, so an error can free them
+    if (setjmp(recover) != 0) {
+        ast_free(range->head);
+        range->head = NULL;
+        range->tail = NULL;
+        range->failed = 1;
+        parser_free(parser);
+        return;
+    }
+
+    // the statements of parse_stmts, one at a time
+    while (parser->current_token.tokenType != EOF_TOK) {
+        if (parser->current_token.tokenType == RIGHT_CURL || parser->current_token.tokenType == KEYWORD_RETURN) {
+            longjmp(recover, 1);    // a stray '}' or 'return', the sequential parse reports it
+        }
+        size_t line = parser->current_token.line;
+        size_t col = parser->current_token.col;
+
+        ASTNode *stmt = parse_stmt(parser);
+        if (!stmt) {
+            continue;   // stray ';'
+        }
+
+        ASTNode *stmts = ast_new_node(AST_STMTS_NODE, line, col);
+        stmts->data.stmts.stmt = stmt;
+        stmts->data.stmts.next = NULL;
+        if (range->tail) {
+            range->tail->data.stmts.next = stmts;
+        } else {
+            range->head = stmts;
+        }
+        range->tail = stmts;
+    }
+    parser_free(parser);
+}
+
+static void *work(void *arg) {
+    Job *job = arg;
+
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
+        size_t i = job->next < job->nranges ? job->next++ : job->nranges;
+        pthread_mutex_unlock(&job->lock);
+        if (i == job->nranges) {
+            return NULL;
+        }
+        parse_range(job->buffer, &job->ranges[i]);
+    }
+}
+
+/*
+Cuts the tokens into ranges of whole top-level statements
+
+args:
+    *buffer (TokenBuffer) -> tokens of the program
+    wanted (size_t) -> ranges to aim for
+    *ranges (Range) -> receives them, `wanted` long
+    *statements (size_t) -> receives the number of top-level statements
+
+returns:
+    (size_t) -> number of ranges, 0 if the braces or parens don't balance
+*/
+static size_t split(const TokenBuffer *buffer, size_t wanted, Range *ranges, size_t *statements) {
+    const Token *t = buffer->tokens;
+    size_t count = buffer->count - 1;   // without the EOF token
+    long braces = 0;
+    long parens = 0;
+    size_t n = 0;
+    size_t begin = 0;
+
+    *statements = 0;
+    for (size_t i = 0; i < count; i++) {
+        switch (t[i].tokenType) {
+        case LEFT_CURL:
+            braces++;
+            break;
+        case RIGHT_CURL:
+            braces--;
+            break;
+        case LEFT_PAREN:
+            parens++;
+            break;
+        case RIGHT_PAREN:
+            parens--;
+            break;
+        default:
+            break;
+        }
+        if (braces < 0 || parens < 0) {
+            return 0;
+        }
+        if (braces || parens) {
+            continue;
+        }
+
+        int ends = t[i].tokenType == SEMICOLON ||
+                   (t[i].tokenType == RIGHT_CURL && t[i + 1].tokenType != KEYWORD_ELSE);
+        if (!ends) {
+            continue;
+        }
+        (*statements)++;
+
+        // cut once this range has its share of the tokens
+        size_t target = count / wanted * (n + 1);
+        if (n + 1 < wanted && i + 1 >= target && i + 1 - begin >= PARSE_MIN_RANGE_TOKENS) {
+            ranges[n].begin = begin;
+            ranges[n].end = i + 1;
+            n++;
+            begin = i + 1;
+        }
+    }
+    if (braces || parens) {
+        return 0;
+    }
+
+    ranges[n].begin = begin;
+    ranges[n].end = count;
+    return n + 1;
+}
+
+static ASTNode *parse_sequentially(const TokenBuffer *buffer) {
+    Parser *parser = parser_init_tokens(buffer->tokens, 0, buffer->count - 1);
+    ASTNode *program = parse_program(parser);
+    parser_free(parser);
+    return program;
+}
+
+
+/* ========== PUBLIC API ========== */
+
+/*
+Parses a program, in parallel when it pays
+
+args:
+    *lexer (Lexer) -> lexer at the start of the source
+    threads (size_t) -> --jobs, 0 for one per online CPU
+    *stats (ParseStats) -> receives what was done
+
+returns:
+    (ASTNode) -> AST_PROGRAM_NODE, the same tree parse_program builds
+*/
+ASTNode *parse_program_parallel(Lexer *lexer, size_t threads, ParseStats *stats) {
+    memset(stats, 0, sizeof(ParseStats));
+
+    if (threads == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (size_t)online : 1;
+    }
+    if (threads < 2 || strlen(lexer->src + lexer->pos) < PARSE_PARALLEL_MIN_BYTES) {
+        Parser *parser = parser_init(lexer);
+        ASTNode *program = parse_program(parser);
+        parser_free(parser);
+        return program;
+    }
+
+    TokenBuffer buffer;
+    lex_all(lexer, &buffer);
+    stats->tokens = buffer.count;
+
+    size_t wanted = threads * PARSE_RANGES_PER_THREAD;
+    Range *ranges = eidos_calloc(wanted, sizeof(Range));
+    if (!ranges) {
+        eidos_fatal("Failed to allocate parse ranges");
+    }
+
+    size_t nranges = split(&buffer, wanted, ranges, &stats->statements);
+    if (nranges < 2) {
+        // too short to cut, or unbalanced: the sequential parse reports where
+        eidos_free(ranges);
+        ASTNode *program = parse_sequentially(&buffer);
+        token_buffer_free(&buffer);
+        return program;
+    }
+    stats->ranges = nranges;
+    stats->threads = threads < nranges ? threads : nranges;
+
+    Job job;
+    job.buffer = &buffer;
+    job.ranges = ranges;
+    job.nranges = nranges;
+    job.next = 0;
+    pthread_mutex_init(&job.lock, NULL);
+
+    // this thread is one of the workers
+    pthread_t *workers = eidos_malloc((stats->threads - 1) * sizeof(pthread_t));
+    if (!workers) {
+        eidos_fatal("Failed to allocate parse threads");
+    }
+    // a thread that doesn't start leaves its ranges to the others, this one at least
+    size_t started = 0;
+    while (started + 1 < stats->threads && pthread_create(&workers[started], NULL, work, &job) == 0) {
+        started++;
+    }
+    stats->threads = started + 1;
+    work(&job);
+    for (size_t k = 0; k < started; k++) {
+        pthread_join(workers[k], NULL);
+    }
+    eidos_free(workers);
+    pthread_mutex_destroy(&job.lock);
+
+    ASTNode *program = NULL;
+    for (size_t i = 0; i < nranges; i++) {
+        if (ranges[i].failed) {
+            stats->fell_back = 1;
+        }
+    }
+
+    if (stats->fell_back) {
+        for (size_t i = 0; i < nranges; i++) {
+            ast_free(ranges[i].head);
+        }
+        program = parse_sequentially(&buffer);
+    } else {
+        ASTNode *head = NULL;
+        ASTNode **tail = &head;
+        for (size_t i = 0; i < nranges; i++) {
+            if (ranges[i].head) {
+                *tail = ranges[i].head;
+                tail = &ranges[i].tail->data.stmts.next;
+            }
+        }
+        program = ast_new_node(AST_PROGRAM_NODE, 1, 1);
+        program->data.program.stmts = head;
+    }
+
+    eidos_free(ranges);
+    token_buffer_free(&buffer);
+    return program;
+}
+
+/*
+Prints what the parallel parse did
+
+args:
+    *stats (ParseStats) -> stats of parse_program_parallel
+    *out (FILE) -> stream to print to
+*/
+void parse_print_stats(const ParseStats *stats, FILE *out) {
+    if (!stats->ranges) {
+        fprintf(out, "parse: sequential\n");
+        return;
+    }
+    fprintf(out, "parse: %zu tokens, %zu top-level statements in %zu ranges on %zu threads%s\n",
+            stats->tokens, stats->statements, stats->ranges, stats->threads,
+            stats->fell_back ? ", reparsed sequentially after a syntax error" : "");
+}
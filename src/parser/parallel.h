@@ -0,0 +1,60 @@
+#pragma once
+
+/*
+Parallel parsing of a program's top-level statements.
+
+A program is a list of top-level statements that don't depend on each other
+syntactically. The source is lexed into a TokenBuffer up front, and one pass
+over the tokens finds where top-level statements end: a ';' or '}' with no
+brace or paren open (a '}' followed by 'else' continues the if). The tokens
+are cut into ranges at those points, the ranges are parsed on a pool of
+threads, and the statement lists are joined in order, so the tree is the
+one a sequential parse builds.
+
+Syntax errors are never reported from a worker. A range that fails to parse
+makes the whole program parse again sequentially, which reports the first
+error in source order and aborts exactly like parse_program.
+
+Workers allocate nodes with eidos_malloc outside any context, so they come
+from the C library's per-thread arenas and the finished tree is an ordinary
+one any thread can free. That also means it must not run inside a library
+context (lib/eidos.h); libeidos parses sequentially.
+*/
+
+#include <stddef.h>
+#include <stdio.h>
+#include "../lexer/lexer.h"
+#include "ast.h"
+
+// sources shorter than this parse sequentially, straight from the lexer
+#define PARSE_PARALLEL_MIN_BYTES (64 * 1024)
+
+// no range is cut shorter than this many tokens
+#define PARSE_MIN_RANGE_TOKENS 4096
+
+// ranges per thread, so a thread that gets long statements doesn't hold the others up
+#define PARSE_RANGES_PER_THREAD 4
+
+typedef struct ParseStats {
+    size_t tokens;          // 0 if the parse was sequential
+    size_t statements;      // top-level statements found by the pre-scan
+    size_t ranges;          // ranges parsed
+    size_t threads;         // threads parsing them
+    int fell_back;          // 1 if a range failed and the program was parsed sequentially
+} ParseStats;
+
+
+/* ========== Public API Functions ========== */
+
+/*
+Parses the program the lexer reads, on `threads` threads (0 for one per
+online CPU) when there is more than one and the source is long enough,
+sequentially like parse_program otherwise. Reports syntax errors and aborts
+like parse_program.
+*/
+ASTNode *parse_program_parallel(Lexer *lexer, size_t threads, ParseStats *stats);
+
+/*
+Prints "parse: ..." statistics
+*/
+void parse_print_stats(const ParseStats *stats, FILE *out);
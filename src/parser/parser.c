@@ -1,6 +1,19 @@
 #include "parser.h"
+#include "../util/context.h"
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+/* ========== PRIVTATE helper declarations ========== */
+
+static void advance(Parser *parser);
+static bool match(Parser *parser, TokenType expectedType);
+static void parser_error(Parser *parser, TokenType expectedType);
+static void parser_fail(Parser *parser, const char *message);
+static ASTNode* parse_unary_expr(Parser *parser);
+static ASTNode* parse_index(Parser *parser, char **identifier);
+static ASTNode* parse_call(Parser *parser);
 
 /* ========== PUBLIC API ========== */
 Parser* parser_init(Lexer *l) {
@@ -8,131 +21,243 @@ Parser* parser_init(Lexer *l) {
     Initializes the parser structer with the current token and following token
 
     args:
-        *l (Lexer) -> Lexer instance 
+        *l (Lexer) -> Lexer instance
 
     returns:
-        parser (Parser) -> Syntax Parser instance 
+        parser (Parser) -> Syntax Parser instance
     */
-    Parser *parser = (Parser*)malloc(sizeof(Parser));
+    Parser *parser = (Parser*)eidos_malloc(sizeof(Parser));
+    if (!parser) {
+        eidos_fatal("Failed to allocate parser");
+    }
 
+    memset(parser, 0, sizeof(Parser));
     parser->lexer = l;                      // save lexer to parser
     parser->current_token = next_token(l);  // get the current toke
     parser->peek_token = next_token(l);     // automatically advance and get the next token for lookahead
 
     return parser;
-    
+
+}
+
+Parser* parser_init_tokens(const Token *tokens, size_t begin, size_t end) {
+    /*
+    Initializes a parser over tokens that were lexed ahead (lex_all). The
+    buffer keeps owning the lexemes.
+
+    args:
+        *tokens (Token) -> token buffer
+        begin (size_t) -> first token to parse
+        end (size_t) -> index of the token the range stops before: the
+                        buffer's EOF_TOK for the whole program, or the
+                        first token of the next range
+
+    returns:
+        parser (Parser) -> Syntax Parser instance, sees EOF_TOK after tokens[end - 1]
+    */
+    Parser *parser = (Parser*)eidos_malloc(sizeof(Parser));
+    if (!parser) {
+        eidos_fatal("Failed to allocate parser");
+    }
+
+    memset(parser, 0, sizeof(Parser));
+    parser->tokens = tokens;
+    parser->next = begin;
+    parser->end = end;
+
+    // the real EOF token at the end of the buffer, the position of the next range's first token otherwise
+    parser->eof = tokens[end];
+    if (parser->eof.tokenType != EOF_TOK) {
+        parser->eof.tokenType = EOF_TOK;
+        parser->eof.lexeme = "";
+    }
+
+    advance(parser);
+    advance(parser);
+
+    return parser;
 }
 
 
 void parser_free(Parser *parser) {
     /*
-    Free up tokens and lexemes(The parser now owns the lexemes) of current and peek tokens 
+    Free up tokens and lexemes(The parser now owns the lexemes) of current and peek tokens
     */
 
     if (!parser) {
         return;
-    } 
+    }
+    if (parser->tokens) {
+        eidos_free(parser);     // the lexemes belong to the token buffer
+        return;
+    }
 
     // Free lexeme strings (don't free tokenType - it's an enum, not allocated memory)
     if (parser->current_token.lexeme) {
-        free((void*)parser->current_token.lexeme);
+        eidos_free((void*)parser->current_token.lexeme);
     }
 
     if (parser->peek_token.lexeme) {
-        free((void*)parser->peek_token.lexeme);
+        eidos_free((void*)parser->peek_token.lexeme);
     }
 
     // Free parser struct itself
-    free(parser);
+    eidos_free(parser);
 }
 
 ASTNode* parse_program(Parser *parser) {
-    // Create the program root node
-    ASTNode *program = (ASTNode*)malloc(sizeof(ASTNode));
-    if (!program) {
-        fprintf(stderr, "Error: Failed to allocate AST program node\n");
-        exit(1);
-    }
-    
-    program->type = AST_PROGRAM_NODE;
+    /*
+    Parses the whole token stream: <program> ::= <stmts>
+
+    args:
+        parser (Parser) -> pointer to Parser Instance
+
+    returns:
+        program (ASTNode) -> AST_PROGRAM_NODE root of the tree
+    */
+    ASTNode *program = ast_new_node(AST_PROGRAM_NODE, 1, 1);
     program->data.program.stmts = parse_stmts(parser);
-    
-    // Expect EOF at the end of the program
+
+    // Expect EOF at the end of the program (a stray '}' stops parse_stmts early)
     if (parser->current_token.tokenType != EOF_TOK) {
         parser_error(parser, EOF_TOK);
     }
-    
+
     return program;
 }
 
 
-/* ========== PRIVTATE helper functions ========== */
-
-static ASTNode* parse_stmts(Parser *parser) {
+ASTNode* parse_stmts(Parser *parser) {
     /*
-    Parses STMTS nodes reccursively 
+    Parses STMTS nodes into a linked list, iteratively so long programs don't
+    recurse once per statement
 
     args:
         parser (Parser) -> pointer to Parser Instance
 
     returns:
-        stmts (ASTNode) -> Linked List of Stmt Nodes 
+        stmts (ASTNode) -> Linked List of Stmt Nodes, NULL for an empty block
     */
 
-    if (parser->current_token.tokenType == EOF_TOK || parser->current_token.tokenType == RIGHT_CURL) {
-        return NULL;
-    }
+    ASTNode *head = NULL;
+    ASTNode **tail = &head;
 
-    // Create a statement list node
-    ASTNode *stmts = (ASTNode*)malloc(sizeof(ASTNode));
-    if (!stmts) {
-        fprintf(stderr, "Error: Failed to allocate statement list node\n");
-        exit(1);
-    }
+    // a function body's statements end at its 'return'
+    while (parser->current_token.tokenType != EOF_TOK && parser->current_token.tokenType != RIGHT_CURL &&
+           parser->current_token.tokenType != KEYWORD_RETURN) {
+        size_t line = parser->current_token.line;
+        size_t col = parser->current_token.col;
 
-    stmts->type = AST_STMTS_NODE;
-    stmts->data.stmts.stmt = parse_stmt(parser);
-    stmts->data.stmts.next = parse_stmts(parser);
+        ASTNode *stmt = parse_stmt(parser);
+        if (!stmt) {
+            continue;   // stray ';'
+        }
 
-    return stmts;
+        // Create a statement list node
+        ASTNode *stmts = ast_new_node(AST_STMTS_NODE, line, col);
+        stmts->data.stmts.stmt = stmt;
+        stmts->data.stmts.next = NULL;
 
+        *tail = stmts;
+        tail = &stmts->data.stmts.next;
+    }
 
+    return head;
 }
 
-static ASTNode* parse_stmt(Parser *parser) {
+ASTNode* parse_top_level_stmt(Parser *parser) {
+    /*
+    Parses the next statement of <program> on its own, so a caller can compile
+    and release it before reading on (streaming compilation)
 
-    if (parser->current_token.tokenType == SEMICOLON) {
-        return NULL;       
-    } 
+    args:
+        parser (Parser) -> pointer to Parser Instance
 
-    ASTNode *stmt = (ASTNode*)malloc(sizeof(ASTNode));
-    if (!stmt) {
-        fprintf(stderr, "Error: Failed to allocate statement node\n");
+    returns:
+        stmt (ASTNode) -> parsed statement, NULL at the end of the input
+    */
+
+    while (parser->current_token.tokenType != EOF_TOK) {
+        // a stray '}' ends parse_stmts early, parse_program reports it the same way
+        if (parser->current_token.tokenType == RIGHT_CURL) {
+            parser_error(parser, EOF_TOK);
+        }
+
+        ASTNode *stmt = parse_stmt(parser);
+        if (stmt) {
+            return stmt;
+        }
     }
 
+    return NULL;
+}
+
+ASTNode* parse_stmt(Parser *parser) {
+    /*
+    Dispatches on the current token to parse a single <stmt>
+
+    args:
+        parser (Parser) -> pointer to Parser Instance
+
+    returns:
+        stmt (ASTNode) -> parsed statement, NULL for an empty ';' statement
+    */
+
+    ASTNode *stmt = NULL;
+
     switch (parser->current_token.tokenType) {
 
+    case SEMICOLON:     // empty statement, just skip it
+        advance(parser);
+        return NULL;
+
     case KEYWORD_LET:   // var declaration, let x = 5;
         stmt = parse_var_decl(parser);
         break;
 
-    case IDENTIFIER:    // x = 6;
+    case IDENTIFIER:    // x = 6; or x++; or a[i] = 6;
 
-        if (parser->peek_token.tokenType == INC_OP || parser->peek_token.tokenType == DEC_OP) {
-            stmt = parse_unary_expr(parser);
+        if (parser->peek_token.tokenType == LEFT_BRACKET) {
+            stmt = parse_index_assign(parser);
+        } else if (parser->peek_token.tokenType == INC_OP || parser->peek_token.tokenType == DEC_OP) {
+            stmt = parse_inc_dec_stmt(parser);
+            match(parser, SEMICOLON);
+            advance(parser);    // consume the ;
         } else if (parser->peek_token.tokenType == ASSIGN_OP) {
             stmt = parse_assignment_stmt(parser);
         } else {
+            advance(parser);    // point the error at the token after the identifier
             parser_error(parser, ASSIGN_OP);
         }
         break;
 
+    case INC_OP:        // ++x;
+    case DEC_OP:        // --x;
+        stmt = parse_inc_dec_stmt(parser);
+        match(parser, SEMICOLON);
+        advance(parser);    // consume the ;
+        break;
+
     case KEYWORD_IF:
         stmt = parse_if_stmt(parser);
         break;
 
+    case KEYWORD_WHILE:
+    case KEYWORD_FOR:
+        stmt = parse_loop_stmt(parser);
+        break;
+
+    case KEYWORD_PRINT:
+    case KEYWORD_READ:
+        stmt = parse_io_stmt(parser);
+        break;
+
+    case KEYWORD_FN:
+        stmt = parse_fn_decl(parser);
+        break;
 
     default:
+        parser_fail(parser, "expected a statement");
         break;
     }
 
@@ -140,92 +265,94 @@ static ASTNode* parse_stmt(Parser *parser) {
 
 }
 
-static ASTNode* parse_var_decl(Parser *parser) { 
+ASTNode* parse_var_decl(Parser *parser) {
     /*
-    Parses the VAR_DECL node (let IDENTIFIER = <expr>) 
+    Parses the VAR_DECL node (let IDENTIFIER = <expr>) and the ARRAY_DECL
+    node (let IDENTIFIER '[' INT_LIT ']')
 
     args:
-        parser (Parser) -> syntax parser instance 
+        parser (Parser) -> syntax parser instance
 
     returns:
-        var_decl (ASTNode) -> variable declaration statement
+        var_decl (ASTNode) -> variable or array declaration statement
     */
 
+    size_t line = parser->current_token.line;
+    size_t col = parser->current_token.col;
+
     advance(parser);
 
-    if (!match(parser, IDENTIFIER)) {
-        return NULL;
-    }
+    match(parser, IDENTIFIER);
 
-    char *identifier = strdup(parser->current_token.lexeme);
-    advance(parser);    // now at '='
+    char *identifier = eidos_strdup(parser->current_token.lexeme);
+    advance(parser);    // now at '=' or '['
 
-    if (!match(parser, ASSIGN_OP)) {
-        free(identifier);
-        return NULL;
-    }
-    advance(parser);    // move to the <expr>
+    if (parser->current_token.tokenType == LEFT_BRACKET) {
+        advance(parser);    // consume '['
+
+        // the size is a literal, sema checks its range
+        match(parser, INT_LIT);
+        errno = 0;
+        long long size = strtoll(parser->current_token.lexeme, NULL, 10);
+        if (errno == ERANGE) {
+            parser_fail(parser, "array size out of range");
+        }
+        advance(parser);    // consume the size
 
-    ASTNode *value = parse_expr(parser);    // parse the expression to get value 
+        match(parser, RIGHT_BRACKET);
+        advance(parser);    // consume ']'
+        match(parser, SEMICOLON);
+        advance(parser);    // consume the ;
 
-    if (!match(parser, SEMICOLON)) {
-        free(identifier);
-        return NULL;
+        ASTNode *array_decl = ast_new_node(AST_ARRAY_DECL_NODE, line, col);
+        array_decl->data.array_decl.identifier = identifier;
+        array_decl->data.array_decl.size = (int64_t)size;
+        return array_decl;
     }
 
-    advance(parser);    // consume the ;
+    match(parser, ASSIGN_OP);
+    advance(parser);    // move to the <expr>
 
-    ASTNode *var_decl = (ASTNode*)malloc(sizeof(ASTNode));
+    ASTNode *value = parse_expr(parser);    // parse the expression to get value
 
-    if (!var_decl) {
-        fprintf(stderr, "Error: Failed to allocate memory for var declaration Node"); 
-        free(identifier);
-        return NULL;
-    }
+    match(parser, SEMICOLON);
+    advance(parser);    // consume the ;
 
-    var_decl->type = AST_VAR_DECL_NODE;
+    ASTNode *var_decl = ast_new_node(AST_VAR_DECL_NODE, line, col);
     var_decl->data.var_decl.identifer = identifier;
     var_decl->data.var_decl.value = value;
 
     return var_decl;
 }
 
-static ASTNode* parse_assignment_stmt(Parser *parser) {
+ASTNode* parse_assignment_stmt(Parser *parser) {
     /*
-    Parses the assignment node IDENT '=' <expr>
+    Parses the assignment node IDENT '=' <expr> ';'
 
     args:
-        parser (fuck you)
+        parser (Parser) -> syntax parser instance
 
-    returns: 
+    returns:
         assignment_stmt (ASTNode) -> parsed assignment node
     */
 
+    size_t line = parser->current_token.line;
+    size_t col = parser->current_token.col;
+
     // get the identifer before moving on
-    char *identifier = strdup(parser->current_token.lexeme);
+    match(parser, IDENTIFIER);
+    char *identifier = eidos_strdup(parser->current_token.lexeme);
 
     advance(parser);    // should be at '='
+    match(parser, ASSIGN_OP);
     advance(parser);    // move to expression
 
     ASTNode *value = parse_expr(parser);
 
-
-    if (!match(parser, SEMICOLON)) {
-        free(identifier);
-        return NULL;
-    }
-
+    match(parser, SEMICOLON);
     advance(parser);    // consume the ;
 
-    ASTNode *assignment_node = (ASTNode*)malloc((sizeof(ASTNode)));
-
-    if (!assignment_node) {
-        fprintf(stderr, "Error: Failed to allocate memory for assignment node");
-        free(identifier);
-        return NULL;
-    }
-
-    assignment_node->type = AST_ASSIGN_NODE;
+    ASTNode *assignment_node = ast_new_node(AST_ASSIGN_NODE, line, col);
     assignment_node->data.assignment.identifier = identifier;
     assignment_node->data.assignment.value = value;
 
@@ -233,337 +360,543 @@ static ASTNode* parse_assignment_stmt(Parser *parser) {
 
 }
 
-static ASTNode* parse_if_stmt(Parser *parser) {
+ASTNode* parse_index_assign(Parser *parser) {
+    /*
+    Parses the element assignment node IDENT '[' <expr> ']' '=' <expr> ';'
+
+    args:
+        parser (Parser) -> syntax parser instance
+
+    returns:
+        index_assign (ASTNode) -> parsed element assignment node
+    */
+
+    size_t line = parser->current_token.line;
+    size_t col = parser->current_token.col;
+
+    char *identifier = NULL;
+    ASTNode *index = parse_index(parser, &identifier);
+
+    match(parser, ASSIGN_OP);
+    advance(parser);    // move to expression
+
+    ASTNode *value = parse_expr(parser);
+
+    match(parser, SEMICOLON);
+    advance(parser);    // consume the ;
+
+    ASTNode *index_assign = ast_new_node(AST_INDEX_ASSIGN_NODE, line, col);
+    index_assign->data.index_assign.identifier = identifier;
+    index_assign->data.index_assign.index = index;
+    index_assign->data.index_assign.value = value;
+
+    return index_assign;
+}
+
+ASTNode* parse_if_stmt(Parser *parser) {
     /*
     Parses If-statements: if (<conditional>) { <stmts> } [else { <stmts> }]
     */
 
+    size_t line = parser->current_token.line;
+    size_t col = parser->current_token.col;
+
     advance(parser);    // move to the opening paren
-    if (!match(parser, LEFT_PAREN)) {
-        return NULL;
-    }
+    match(parser, LEFT_PAREN);
     advance(parser);    // should be at the start of the conditional
 
     ASTNode *conditional = parse_conditional(parser);
-    
-    if (!match(parser, RIGHT_PAREN)) {
-        free(conditional);
-        return NULL;
-    }
-    
+
+    match(parser, RIGHT_PAREN);
     advance(parser);    // consume right paren
-    
-    if (!match(parser, LEFT_CURL)) {
-        free(conditional);
-        return NULL;
-    }
-    
+
+    match(parser, LEFT_CURL);
     advance(parser);    // consume left curl
 
-    // now in the then_block 
+    // now in the then_block
     ASTNode *then_block = parse_stmts(parser);
 
-    if (!match(parser, RIGHT_CURL)) {
-        free(then_block);
-        free(conditional);
-        return NULL;
-    }
-    
+    match(parser, RIGHT_CURL);
     advance(parser);    // consume right curl
 
-    // Allocate the if statement node
-    ASTNode *if_stmt = (ASTNode*)malloc(sizeof(ASTNode));
-    if (!if_stmt) {
-        fprintf(stderr, "Error: Failed to allocate memory for if statement node\n");
-        free(then_block);
-        free(conditional);
-        return NULL;
-    }
-
-    if_stmt->type = AST_IF_STMT_NODE;
+    ASTNode *if_stmt = ast_new_node(AST_IF_STMT_NODE, line, col);
     if_stmt->data.if_stmt.condition = conditional;
     if_stmt->data.if_stmt.then_block = then_block;
-    
+    if_stmt->data.if_stmt.else_block = NULL;
+
     // Check for optional else clause
     if (parser->current_token.tokenType == KEYWORD_ELSE) {
         advance(parser);    // consume 'else'
-        
-        if (!match(parser, LEFT_CURL)) {
-            free(if_stmt);
-            free(then_block);
-            free(conditional);
-            return NULL;
-        }
-        
+
+        match(parser, LEFT_CURL);
         advance(parser);    // consume left curl
-        
+
         ASTNode *else_block = parse_stmts(parser);
-        
-        if (!match(parser, RIGHT_CURL)) {
-            free(else_block);
-            free(if_stmt);
-            free(then_block);
-            free(conditional);
-            return NULL;
-        }
-        
+
+        match(parser, RIGHT_CURL);
         advance(parser);    // consume right curl
-        
+
         if_stmt->data.if_stmt.else_block = else_block;
-    } else {
-        if_stmt->data.if_stmt.else_block = NULL;
     }
 
     return if_stmt;
 
 }
 
-static ASTNode* parse_loop_stmt(Parser *parser) {
+ASTNode* parse_loop_stmt(Parser *parser) {
     /*
-    Parses loop statements: loop (<conditional>) { <stmts> }
-    
-    TODO:
-    1. Advance past 'loop' keyword
-    2. Check for and advance past LEFT_PAREN
-    3. Parse conditional with parse_conditional()
-    4. Check for and advance past RIGHT_PAREN
-    5. Check for and advance past LEFT_CURL
-    6. Parse loop body with parse_stmts()
-    7. Check for and advance past RIGHT_CURL
-    8. Create AST_LOOP_NODE
-    9. Set condition and body
-    10. Return loop node
-    
-    This follows the SAME pattern as parse_if_stmt but simpler (no else clause)
+    Parses loop statements:
+        'while' '(' <conditional> ')' '{' <stmts> '}'
+        'for' '(' <assignment_stmt> <conditional> ';' <inc_dec_stmt> ')' '{' <stmts> '}'
+
+    Follows the same pattern as parse_if_stmt, minus the else clause
     */
 
+    size_t line = parser->current_token.line;
+    size_t col = parser->current_token.col;
+    TokenType keyword = parser->current_token.tokenType;
+
+    advance(parser);    // consume 'while' / 'for'
+    match(parser, LEFT_PAREN);
+    advance(parser);    // consume left paren
+
+    ASTNode *loop = NULL;
+
+    if (keyword == KEYWORD_WHILE) {
+        loop = ast_new_node(AST_WHILE_LOOP_NODE, line, col);
+        loop->data.while_loop.condition = parse_conditional(parser);
+    } else {
+        loop = ast_new_node(AST_FOR_LOOP_NODE, line, col);
+        loop->data.for_loop.initializer = parse_assignment_stmt(parser);   // eats its own ;
+        loop->data.for_loop.condition = parse_conditional(parser);
+
+        match(parser, SEMICOLON);
+        advance(parser);    // consume the ;
+
+        loop->data.for_loop.step = parse_inc_dec_stmt(parser);
+    }
+
+    match(parser, RIGHT_PAREN);
+    advance(parser);    // consume right paren
+
+    match(parser, LEFT_CURL);
+    advance(parser);    // consume left curl
+
+    ASTNode *body = parse_stmts(parser);
+
+    match(parser, RIGHT_CURL);
+    advance(parser);    // consume right curl
+
+    if (keyword == KEYWORD_WHILE) {
+        loop->data.while_loop.while_block = body;
+    } else {
+        loop->data.for_loop.for_block = body;
+    }
+
+    return loop;
 }
 
-static ASTNode* parse_io_stmt(Parser *parser) {
+ASTNode* parse_io_stmt(Parser *parser) {
     /*
-    Parses I/O statements: print(<expr>) and input(IDENTIFIER)
-    
-    TODO:
-    1. Check if current token is KEYWORD_PRINT or KEYWORD_INPUT
-    2. For print:
-       - Advance past 'print'
-       - Check for LEFT_PAREN
-       - Advance past '('
-       - Parse expression with parse_expr()
-       - Check for RIGHT_PAREN
-       - Advance past ')'
-       - Create AST_PRINT_NODE
-       - Set expression to print
-       - Return print node
-    3. For input:
-       - Advance past 'input'
-       - Check for LEFT_PAREN
-       - Advance past '('
-       - Check for IDENTIFIER
-       - Save identifier name
-       - Advance past identifier
-       - Check for RIGHT_PAREN
-       - Advance past ')'
-       - Create AST_INPUT_NODE
-       - Set target identifier
-       - Return input node
-    4. Don't forget semicolons at the end!
+    Parses I/O statements: print '(' <expr> ')' ';' and read '(' IDENTIFIER ')' ';'
     */
 
-}
+    size_t line = parser->current_token.line;
+    size_t col = parser->current_token.col;
+    TokenType keyword = parser->current_token.tokenType;
 
+    advance(parser);    // consume 'print' / 'read'
+    match(parser, LEFT_PAREN);
+    advance(parser);    // consume left paren
 
-static ASTNode* parse_expr(Parser *parser) {
+    ASTNode *io_stmt = NULL;
+
+    if (keyword == KEYWORD_PRINT) {
+        io_stmt = ast_new_node(AST_PRINT_NODE, line, col);
+        io_stmt->data.print_stmt.expression = parse_expr(parser);
+    } else {
+        match(parser, IDENTIFIER);
+        io_stmt = ast_new_node(AST_READ_NODE, line, col);
+        io_stmt->data.read_stmt.identifier = eidos_strdup(parser->current_token.lexeme);
+        advance(parser);    // consume identifier
+    }
+
+    match(parser, RIGHT_PAREN);
+    advance(parser);    // consume right paren
+
+    match(parser, SEMICOLON);
+    advance(parser);    // consume the ;
+
+    return io_stmt;
+}
+
+ASTNode* parse_fn_decl(Parser *parser) {
     /*
-    Parses expressions with + and - operators (lowest precedence)
-    Handles: <term> (('+' | '-') <term>)*
-    
-    TODO:
-    1. Parse first term with parse_term()
-    2. If no + or - operator, return the term directly (not a binary expr!)
-    3. If + or - found, enter loop:
-       - Allocate binary_expr node INSIDE the loop (not before!)
-       - Set binary_expr->left = left_term (the accumulated result)
-       - Save operator and advance
-       - Parse right_term
-       - Set binary_expr->right = right_term
-       - Update left_term = binary_expr (so next iteration wraps this one)
-    4. After loop, return left_term (which is now the full expression tree)
-    
-    CRITICAL ISSUES TO FIX:
-    - Don't allocate binary_expr before knowing if you need it
-    - Must update left_term in the loop or you lose chaining (a+b+c breaks)
-    - Return left_term if there's no operator (just a number or variable)
-    - Logic error: using || instead of && in the if condition
+    Parses function declarations:
+        'fn' IDENTIFIER '(' [IDENTIFIER {',' IDENTIFIER}] ')' '{' <stmts> 'return' <expr> ';' '}'
+
+    The return is always the last statement of the body, so a function has
+    exactly one way out
     */
-    
-    ASTNode *left_term = parse_term(parser);
 
-    if (parser->current_token.tokenType != SUB_OP || parser->current_token.tokenType != PLUS_OP) {
-        return left_term;
+    size_t line = parser->current_token.line;
+    size_t col = parser->current_token.col;
+
+    advance(parser);    // consume 'fn'
+    match(parser, IDENTIFIER);
+
+    ASTNode *fn_decl = ast_new_node(AST_FN_DECL_NODE, line, col);
+    fn_decl->data.fn_decl.name = eidos_strdup(parser->current_token.lexeme);
+    advance(parser);    // consume the name
+
+    match(parser, LEFT_PAREN);
+    advance(parser);    // consume left paren
+
+    size_t cap = 0;
+    while (parser->current_token.tokenType != RIGHT_PAREN) {
+        if (fn_decl->data.fn_decl.nparams) {
+            match(parser, COMMA);
+            advance(parser);    // consume ','
+        }
+        match(parser, IDENTIFIER);
+
+        if (fn_decl->data.fn_decl.nparams == cap) {
+            cap = cap ? cap * 2 : 4;
+            fn_decl->data.fn_decl.params = eidos_realloc(fn_decl->data.fn_decl.params, cap * sizeof(char*));
+            if (!fn_decl->data.fn_decl.params) {
+                eidos_fatal("Failed to allocate parameters");
+            }
+        }
+        fn_decl->data.fn_decl.params[fn_decl->data.fn_decl.nparams++] = eidos_strdup(parser->current_token.lexeme);
+        advance(parser);    // consume the parameter
     }
+    advance(parser);    // consume right paren
 
-    ASTNode *binary_expr = (ASTNode*)malloc(sizeof(ASTNode));
+    match(parser, LEFT_CURL);
+    advance(parser);    // consume left curl
 
-    if (!binary_expr) {
-        fprintf(stderr, "Error: Failed to allocate memory for binary expression");
-        free(left_term);
-        return NULL;
+    fn_decl->data.fn_decl.body = parse_stmts(parser);
+
+    match(parser, KEYWORD_RETURN);
+    advance(parser);    // consume 'return'
+
+    fn_decl->data.fn_decl.ret = parse_expr(parser);
+
+    match(parser, SEMICOLON);
+    advance(parser);    // consume the ;
+
+    match(parser, RIGHT_CURL);
+    advance(parser);    // consume right curl
+
+    return fn_decl;
+}
+
+ASTNode* parse_inc_dec_stmt(Parser *parser) {
+    /*
+    Parses IDENTIFIER ('++' | '--') and ('++' | '--') IDENTIFIER.
+    The trailing ';' is left to the caller since a for-loop step has none.
+    */
+
+    TokenType first = parser->current_token.tokenType;
+
+    if (first == IDENTIFIER) {
+        TokenType next = parser->peek_token.tokenType;
+        if (next != INC_OP && next != DEC_OP) {
+            advance(parser);
+            parser_error(parser, INC_OP);
+        }
+    } else if (first != INC_OP && first != DEC_OP) {
+        parser_error(parser, INC_OP);
     }
 
+    return parse_unary_expr(parser);
+}
+
+
+ASTNode* parse_expr(Parser *parser) {
+    /*
+    Parses expressions with + and - operators (lowest precedence)
+    Handles: <term> (('+' | '-') <term>)*
+
+    The loop folds left so a - b - c parses as (a - b) - c
+    */
+
+    ASTNode *left_term = parse_term(parser);
+
     while (parser->current_token.tokenType == SUB_OP || parser->current_token.tokenType == PLUS_OP) {
-        char *operator = strdup(parser->current_token.lexeme);
+        ASTNode *binary_expr = ast_new_node(AST_BINARY_EXPR,
+                                            parser->current_token.line,
+                                            parser->current_token.col);
+        binary_expr->data.binary_expr.op = eidos_strdup(parser->current_token.lexeme);
         advance(parser);
-        ASTNode* right_term = parse_term(parser);
 
-        // TODO: Build binary_expr node here with left_term, operator, right_term
-        // TODO: Set left_term = binary_expr for next iteration
+        binary_expr->data.binary_expr.left = left_term;
+        binary_expr->data.binary_expr.right = parse_term(parser);
+
+        left_term = binary_expr;    // the next operator wraps this one
     }
 
-    // TODO: Return the final expression (currently nothing is returned!)
+    return left_term;
 
 }
+
 static ASTNode* parse_unary_expr(Parser *parser) {
     /*
-    Parses unary expressions: ++x, --x, x++, x--, -expr, !expr
-    
-    TODO:
-    1. Check if operator comes before or after identifier:
-       - Prefix: INC_OP/DEC_OP then IDENTIFIER (++x, --x)
-       - Postfix: IDENTIFIER then INC_OP/DEC_OP (x++, x--)
-       - Unary minus/not: SUB_OP/NOT_OP then expression (-5, !true)
-    2. For prefix/postfix on identifiers:
-       - Parse identifier
-       - Create AST_UNARY_EXPR node
-       - Store operator and identifier
-       - Mark as prefix or postfix
-    3. For unary operators on expressions:
-       - Save operator
-       - Advance
-       - Parse expression/factor recursively
-       - Create unary expression node
-    4. Return unary expression node
-    
-    Currently called from parse_stmt for x++ and x-- cases
-    Also needs to be called from parse_factor for -expr and !expr
+    Parses unary expressions: ++x, --x, x++, x--, -<factor>, !<factor>
+
+    Called from parse_inc_dec_stmt for the inc/dec forms and from
+    parse_factor for -expr and !expr
+    */
+
+    size_t line = parser->current_token.line;
+    size_t col = parser->current_token.col;
+
+    ASTNode *unary_expr = ast_new_node(AST_UNARY_EXPR, line, col);
+
+    // Postfix: IDENTIFIER then INC_OP/DEC_OP (x++, x--)
+    if (parser->current_token.tokenType == IDENTIFIER) {
+        ASTNode *operand = ast_new_node(AST_IDENTIFIER_NODE, line, col);
+        operand->data.identifier.name = eidos_strdup(parser->current_token.lexeme);
+        advance(parser);    // consume identifier
+
+        unary_expr->data.unary_expr.op = eidos_strdup(parser->current_token.lexeme);
+        unary_expr->data.unary_expr.operand = operand;
+        unary_expr->data.unary_expr.is_prefix = 0;
+        advance(parser);    // consume operator
+
+        return unary_expr;
+    }
+
+    TokenType op = parser->current_token.tokenType;
+    unary_expr->data.unary_expr.op = eidos_strdup(parser->current_token.lexeme);
+    unary_expr->data.unary_expr.is_prefix = 1;
+    advance(parser);    // consume operator
+
+    if (op == INC_OP || op == DEC_OP) {
+        // Prefix: INC_OP/DEC_OP then IDENTIFIER (++x, --x)
+        match(parser, IDENTIFIER);
+        ASTNode *operand = ast_new_node(AST_IDENTIFIER_NODE,
+                                        parser->current_token.line,
+                                        parser->current_token.col);
+        operand->data.identifier.name = eidos_strdup(parser->current_token.lexeme);
+        advance(parser);    // consume identifier
+        unary_expr->data.unary_expr.operand = operand;
+    } else {
+        // Unary minus/not: SUB_OP/NOT_OP then a factor (-5, !x)
+        unary_expr->data.unary_expr.operand = parse_factor(parser);
+    }
+
+    return unary_expr;
+}
+
+static ASTNode* parse_index(Parser *parser, char **identifier) {
+    /*
+    Parses IDENTIFIER '[' <expr> ']', shared by element reads and writes
+
+    args:
+        parser (Parser) -> Parser instance
+        **identifier (char) -> receives a copy of the array's name
+
+    returns:
+        index (ASTNode) -> the index expression
     */
 
+    match(parser, IDENTIFIER);
+    *identifier = eidos_strdup(parser->current_token.lexeme);
+    advance(parser);    // consume identifier
+
+    match(parser, LEFT_BRACKET);
+    advance(parser);    // consume '['
+
+    ASTNode *index = parse_expr(parser);
+
+    match(parser, RIGHT_BRACKET);
+    advance(parser);    // consume ']'
+
+    return index;
 }
 
-static ASTNode *parse_binary_expr(Parser *parser) {
+static ASTNode* parse_call(Parser *parser) {
     /*
-    PROBABLY DON'T NEED THIS FUNCTION
-    
-    Binary expressions are already handled by parse_expr and parse_term.
-    This might have been a planning mistake - you can likely delete this.
-    
-    Unless you want to use it as a helper function that parse_expr and 
-    parse_term both call with different operator sets?
-    
-    Either implement as a generic helper OR delete it entirely.
+    Parses IDENTIFIER '(' [<expr> {',' <expr>}] ')'
+
+    args:
+        parser (Parser) -> Parser instance
+
+    returns:
+        call (ASTNode) -> AST_CALL_EXPR node
     */
 
+    ASTNode *call = ast_new_node(AST_CALL_EXPR, parser->current_token.line, parser->current_token.col);
+    call->data.call_expr.name = eidos_strdup(parser->current_token.lexeme);
+    advance(parser);    // consume identifier
+    advance(parser);    // consume '('
+
+    size_t cap = 0;
+    while (parser->current_token.tokenType != RIGHT_PAREN) {
+        if (call->data.call_expr.nargs) {
+            match(parser, COMMA);
+            advance(parser);    // consume ','
+        }
+        ASTNode *arg = parse_expr(parser);
+
+        if (call->data.call_expr.nargs == cap) {
+            cap = cap ? cap * 2 : 4;
+            call->data.call_expr.args = eidos_realloc(call->data.call_expr.args, cap * sizeof(ASTNode*));
+            if (!call->data.call_expr.args) {
+                eidos_fatal("Failed to allocate arguments");
+            }
+        }
+        call->data.call_expr.args[call->data.call_expr.nargs++] = arg;
+    }
+    advance(parser);    // consume ')'
+
+    return call;
 }
 
-static ASTNode* parse_term(Parser *parser) {
+ASTNode* parse_term(Parser *parser) {
     /*
     Parses terms with * and / operators (higher precedence than +/-)
     Handles: <factor> (('*' | '/') <factor>)*
-    
-    TODO:
-    1. Parse first factor with parse_factor()
-    2. If no * or / operator, return the factor directly
-    3. If * or / found, enter loop:
-       - Allocate binary_expr node INSIDE loop
-       - Set left = accumulated result, op = operator, right = next factor
-       - Update left_factor = binary_expr for chaining
-    4. Return the final term expression
-    
+
     This is the SAME pattern as parse_expr, just for different operators
     */
 
+    ASTNode *left_factor = parse_factor(parser);
+
+    while (parser->current_token.tokenType == MULT_OP || parser->current_token.tokenType == DIV_OP) {
+        ASTNode *binary_expr = ast_new_node(AST_BINARY_EXPR,
+                                            parser->current_token.line,
+                                            parser->current_token.col);
+        binary_expr->data.binary_expr.op = eidos_strdup(parser->current_token.lexeme);
+        advance(parser);
+
+        binary_expr->data.binary_expr.left = left_factor;
+        binary_expr->data.binary_expr.right = parse_factor(parser);
+
+        left_factor = binary_expr;
+    }
+
+    return left_factor;
 }
 
-static ASTNode* parse_factor(Parser *parser) {
+ASTNode* parse_factor(Parser *parser) {
     /*
     Parses the highest precedence elements: numbers, identifiers, parentheses
-    Handles: NUMBER | IDENTIFIER | '(' <expr> ')' | <unary_expr>
-    
-    TODO:
-    1. Check current token type with switch/if-else
-    2. If NUMBER_TOK:
-       - Create AST_NUMBER_LITERAL node (ADD THIS TO ast.h!)
-       - Store the integer/float value (need to parse lexeme)
-       - Advance parser
-       - Return number node
-    3. If IDENTIFIER:
-       - Create AST_IDENTIFIER node (ADD THIS TO ast.h!)
-       - Store identifier name (strdup the lexeme)
-       - Advance parser
-       - Return identifier node
-    4. If LEFT_PAREN:
-       - Advance past '('
-       - Recursively call parse_expr() to handle the inside
-       - Check for RIGHT_PAREN
-       - Advance past ')'
-       - Return the inner expression
-    5. If INC_OP or DEC_OP:
-       - Call parse_unary_expr()
-    6. Otherwise:
-       - Error: unexpected token
-    
-    CRITICAL: You need to add NUMBER_LITERAL and IDENTIFIER node types to ast.h!
-    Without these, you can't represent actual values in your AST.
+    Handles: NUMBER | IDENTIFIER | IDENTIFIER '[' <expr> ']' | <call> | '(' <expr> ')' | ('-' | '!') <factor>
     */
 
+    size_t line = parser->current_token.line;
+    size_t col = parser->current_token.col;
+    ASTNode *factor = NULL;
+
+    switch (parser->current_token.tokenType) {
+
+    case INT_LIT: {
+        errno = 0;
+        long long value = strtoll(parser->current_token.lexeme, NULL, 10);
+        if (errno == ERANGE) {
+            parser_fail(parser, "integer literal out of range");
+        }
+        factor = ast_new_int_lit((int64_t)value, line, col);
+        advance(parser);
+        break;
+    }
+
+    case IDENTIFIER:
+        if (parser->peek_token.tokenType == LEFT_BRACKET) {
+            factor = ast_new_node(AST_INDEX_EXPR, line, col);
+            factor->data.index_expr.index = parse_index(parser, &factor->data.index_expr.identifier);
+            break;
+        }
+        if (parser->peek_token.tokenType == LEFT_PAREN) {
+            factor = parse_call(parser);
+            break;
+        }
+        factor = ast_new_node(AST_IDENTIFIER_NODE, line, col);
+        factor->data.identifier.name = eidos_strdup(parser->current_token.lexeme);
+        advance(parser);
+        break;
+
+    case LEFT_PAREN:
+        advance(parser);    // consume '('
+        factor = parse_expr(parser);
+        match(parser, RIGHT_PAREN);
+        advance(parser);    // consume ')'
+        break;
+
+    case SUB_OP:
+    case NOT_OP:
+        factor = parse_unary_expr(parser);
+        break;
+
+    default:
+        parser_fail(parser, "expected an expression");
+        break;
+    }
+
+    return factor;
 }
 
-static ASTNode* parse_conditional(Parser *parser) {
+ASTNode* parse_conditional(Parser *parser) {
     /*
     Parses conditional expressions for if/loop statements
     Handles: <expr> ('==' | '!=' | '<' | '>' | '<=' | '>=') <expr>
-    
-    TODO:
-    1. Parse left side with parse_expr()
-    2. Check if current token is a comparison operator:
-       - EQ_OP (==)
-       - NOT_EQ_OP (!=)
-       - LESS_THAN (<)
-       - GREATER_THAN (>)
-       - LESS_THAN_EQ (<=)
-       - GREATER_THAN_EQ (>=)
-    3. If comparison operator found:
-       - Save the operator lexeme
-       - Advance parser
-       - Parse right side with parse_expr()
-       - Create AST_CONDITIONAL_NODE
-       - Set left, op, right
-       - Return conditional node
-    4. If no comparison operator:
-       - Error: expected comparison operator in conditional
-    
+
     This creates nodes like: (x > 5) or (a == b)
-    Used by if statements and loop conditions
     */
 
+    ASTNode *left = parse_expr(parser);
+
+    switch (parser->current_token.tokenType) {
+    case EQUAL_OP:
+    case NEQUAL_OP:
+    case LESSER_OP:
+    case GREATER_OP:
+    case LEQUAL_OP:
+    case GEQUAL_OP:
+        break;
+    default:
+        parser_fail(parser, "expected a comparison operator in conditional");
+        break;
+    }
+
+    ASTNode *conditional = ast_new_node(AST_CONDITIONAL_NODE,
+                                        parser->current_token.line,
+                                        parser->current_token.col);
+    conditional->data.conditional.comparison_op = eidos_strdup(parser->current_token.lexeme);
+    advance(parser);    // consume the comparison operator
+
+    conditional->data.conditional.left_expression = left;
+    conditional->data.conditional.right_expression = parse_expr(parser);
+
+    return conditional;
 }
 
+/* ========== PRIVTATE helper functions ========== */
+
 static void advance(Parser *parser) {
     /*
-    Advances the parser throughout the tokens 
+    Advances the parser throughout the tokens
 
     args:
         parser (Parser) -> Parser instance
     */
 
+    if (parser->tokens) {
+        parser->current_token = parser->peek_token;
+        parser->peek_token = parser->next < parser->end ? parser->tokens[parser->next++] : parser->eof;
+        return;
+    }
+
     // free the old current_token's lexeme (parser owns the memory)
     if (parser->current_token.lexeme) {
-        free((void*)parser->current_token.lexeme);
+        eidos_free((void*)parser->current_token.lexeme);
     }
-    
+
     // move peek to current
     parser->current_token = parser->peek_token;
-    
+
     // get new peek token from lexer
     parser->peek_token = next_token(parser->lexer);
 }
@@ -574,7 +907,7 @@ static bool match(Parser *parser, TokenType expectedType) {
     Matches the current token with the expected token
 
     args:
-        parser (Parser) -> Parser instance 
+        parser (Parser) -> Parser instance
         expectedType (TokenType) -> the excpected token type
 
     returns:
@@ -590,20 +923,42 @@ static bool match(Parser *parser, TokenType expectedType) {
 
 static void parser_error(Parser *parser, TokenType expectedType) {
     /*
-    Throws error when parser finds an error with the token it got and the expected token
+    Reports a token the grammar didn't expect and abandons the compilation (eidos_abort)
 
     args:
-        parser (Parser) -> Fuck you
-        expectedType (TokenType) -> Fuck you
+        parser (Parser) -> Parser instance
+        expectedType (TokenType) -> the token type the grammar called for
     */
-    fprintf(stderr, "Parse Error at line %zu, column %zu:\n", 
-            parser->current_token.line, 
+    if (parser->recover) {
+        longjmp(*parser->recover, 1);
+    }
+    eidos_diag("Parse Error at line %zu, column %zu:\n",
+            parser->current_token.line,
             parser->current_token.col);
-    fprintf(stderr, "  Unexpected token: %d (lexeme: '%s')\n", 
-            parser->current_token.tokenType,
+    eidos_diag("  Unexpected token: %s (lexeme: '%s')\n",
+            token_type_name(parser->current_token.tokenType),
             parser->current_token.lexeme ? parser->current_token.lexeme : "NULL");
-    fprintf(stderr, "  Expected token: %d\n", expectedType);
-    exit(1);
+    eidos_diag("  Expected token: %s\n", token_type_name(expectedType));
+    eidos_abort();
 }
 
+static void parser_fail(Parser *parser, const char *message) {
+    /*
+    Reports a token that can't start the construct being parsed and abandons the compilation
 
+    args:
+        parser (Parser) -> Parser instance
+        message (char) -> what the parser was looking for
+    */
+    if (parser->recover) {
+        longjmp(*parser->recover, 1);
+    }
+    eidos_diag("Parse Error at line %zu, column %zu:\n",
+            parser->current_token.line,
+            parser->current_token.col);
+    eidos_diag("  Unexpected token: %s (lexeme: '%s')\n",
+            token_type_name(parser->current_token.tokenType),
+            parser->current_token.lexeme ? parser->current_token.lexeme : "NULL");
+    eidos_diag("  %s\n", message);
+    eidos_abort();
+}
@@ -2,30 +2,43 @@
 
 #include "../lexer/lexer.h"
 #include "ast.h"
+#include <setjmp.h>
 #include <stdbool.h>
 
 typedef struct Parser {
     Lexer* lexer;
     Token current_token;
     Token peek_token;
+
+    // parsing a range of a TokenBuffer instead of pulling tokens from the lexer
+    const Token* tokens;    // NULL when reading from the lexer
+    size_t next;            // index of the token after peek_token
+    size_t end;             // the range ends before this token
+    Token eof;              // read once the range is exhausted
+
+    jmp_buf* recover;       // syntax errors unwind here unreported, NULL to report them and abort
 } Parser;
 
 // Parser initialization and cleanup
 Parser* parser_init(Lexer* lexer);
+Parser* parser_init_tokens(const Token* tokens, size_t begin, size_t end);   // tokens[begin, end), then EOF
 void parser_free(Parser* parser);
 
 // Core parsing functions
 ASTNode* parse_program(Parser* parser);
 ASTNode* parse_stmts(Parser* parser);
 ASTNode* parse_stmt(Parser* parser);
+ASTNode* parse_top_level_stmt(Parser* parser);   // one <stmt> of <program> at a time, NULL at EOF
 
 // Statement parsing
 ASTNode* parse_var_decl(Parser* parser);
 ASTNode* parse_assignment_stmt(Parser* parser);
+ASTNode* parse_index_assign(Parser* parser);
 ASTNode* parse_if_stmt(Parser* parser);
 ASTNode* parse_loop_stmt(Parser* parser);
 ASTNode* parse_io_stmt(Parser* parser);
 ASTNode* parse_inc_dec_stmt(Parser* parser);
+ASTNode* parse_fn_decl(Parser* parser);
 
 // Expression parsing
 ASTNode* parse_expr(Parser* parser);
@@ -33,8 +46,4 @@ ASTNode* parse_term(Parser* parser);
 ASTNode* parse_factor(Parser* parser);
 ASTNode* parse_conditional(Parser* parser);
 
-// Helper functions
-void advance(Parser* parser);
-bool match(Parser* parser, TokenType type);
-bool expect(Parser* parser, TokenType type);
-void parser_error(Parser* parser, const char* message);
\ No newline at end of file
+// Token helpers (advance, match, parser_error) are private to parser.c
\ No newline at end of file
@@ -0,0 +1,234 @@
+#pragma once
+
+/*
+Buffered integer I/O for print() and read().
+
+Used by the IR interpreter and copied verbatim into every program the C
+backend generates (the makefile turns this file into a string literal), so
+both print and read integers the same way. Everything is static inline and
+depends only on the C library and POSIX read()/isatty().
+
+Output collects in a 64 KiB buffer that is flushed when it fills, when input
+is needed, and when the program ends. On a terminal every print() is flushed
+at its newline so output shows up as it is produced; pipes and files only see
+full buffers. Integers are formatted two digits at a time from a table.
+
+Input is read in 64 KiB chunks (read() on the descriptor, so a terminal
+returns a line at a time instead of blocking for a full buffer). Integers are
+parsed by hand: optional whitespace, an optional sign, then decimal digits,
+with values outside int64_t reported instead of clamped.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define EIDOS_IO_BUFFER (1 << 16)
+
+typedef struct EidosOut {
+    FILE *file;             // NULL discards output
+    int line_buffered;      // flush after every line (terminals)
+    size_t len;
+    char data[EIDOS_IO_BUFFER];
+} EidosOut;
+
+typedef struct EidosIn {
+    FILE *file;             // NULL behaves like an empty input
+    int fd;                 // descriptor of file, -1 to go through fread
+    EidosOut *tie;          // flushed before waiting for input, may be NULL
+    const char *pos;        // unread part of data
+    const char *end;
+    int eof;
+    char data[EIDOS_IO_BUFFER];
+} EidosIn;
+
+// results of eidos_read_int
+enum {
+    EIDOS_READ_OK,
+    EIDOS_READ_NONE,        // end of input or no integer next
+    EIDOS_READ_RANGE,       // integer does not fit in int64_t
+};
+
+static const char eidos_digit_pairs[201] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static inline void eidos_out_init(EidosOut *out, FILE *file) {
+    out->file = file;
+    out->line_buffered = file && fileno(file) >= 0 && isatty(fileno(file));
+    out->len = 0;
+}
+
+/*
+Writes the buffered output to the stream, returns 0 or -1 on a write error
+*/
+static inline int eidos_out_flush(EidosOut *out) {
+    int failed = 0;
+    if (out->len && out->file) {
+        failed = fwrite(out->data, 1, out->len, out->file) != out->len;
+        failed |= fflush(out->file) != 0;
+    }
+    out->len = 0;
+    return failed ? -1 : 0;
+}
+
+static inline void eidos_out_write(EidosOut *out, const char *bytes, size_t n) {
+    while (n) {
+        if (out->len == EIDOS_IO_BUFFER) {
+            eidos_out_flush(out);
+        }
+        size_t chunk = EIDOS_IO_BUFFER - out->len;
+        chunk = chunk < n ? chunk : n;
+        memcpy(out->data + out->len, bytes, chunk);
+        out->len += chunk;
+        bytes += chunk;
+        n -= chunk;
+    }
+}
+
+/*
+Formats a value in decimal, ending right before `end`; returns where it starts.
+`end` needs 20 bytes of room in front of it.
+*/
+static inline char *eidos_format_int(char *end, int64_t value) {
+    uint64_t u = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+    char *p = end;
+
+    while (u >= 100) {
+        unsigned pair = (unsigned)(u % 100) * 2;
+        u /= 100;
+        p -= 2;
+        memcpy(p, eidos_digit_pairs + pair, 2);
+    }
+    if (u >= 10) {
+        p -= 2;
+        memcpy(p, eidos_digit_pairs + u * 2, 2);
+    } else {
+        *--p = (char)('0' + u);
+    }
+
+    if (value < 0) {
+        *--p = '-';
+    }
+    return p;
+}
+
+/*
+print(): the value and a newline
+*/
+static inline void eidos_print_int(EidosOut *out, int64_t value) {
+    // sign, 19 digits and the newline
+    if (EIDOS_IO_BUFFER - out->len < 21) {
+        eidos_out_flush(out);
+    }
+
+    char text[24];
+    char *end = text + sizeof(text);
+    end[-1] = '\n';
+    char *start = eidos_format_int(end - 1, value);
+    size_t n = (size_t)(end - start);
+
+    memcpy(out->data + out->len, start, n);
+    out->len += n;
+
+    if (out->line_buffered) {
+        eidos_out_flush(out);
+    }
+}
+
+static inline void eidos_in_init(EidosIn *in, FILE *file, EidosOut *tie) {
+    in->file = file;
+    in->fd = file ? fileno(file) : -1;
+    in->tie = tie;
+    in->pos = in->end = in->data;
+    in->eof = file == NULL;
+}
+
+/*
+Refills an exhausted input buffer, returns 0 once the input has ended
+*/
+static inline int eidos_in_fill(EidosIn *in) {
+    if (in->eof) {
+        return 0;
+    }
+    if (in->tie) {
+        eidos_out_flush(in->tie);
+    }
+
+    ssize_t n;
+    if (in->fd >= 0) {
+        do {
+            n = read(in->fd, in->data, EIDOS_IO_BUFFER);
+        } while (n < 0 && errno == EINTR);
+    } else {
+        n = (ssize_t)fread(in->data, 1, EIDOS_IO_BUFFER, in->file);
+    }
+
+    if (n <= 0) {
+        in->eof = 1;
+        return 0;
+    }
+    in->pos = in->data;
+    in->end = in->data + n;
+    return 1;
+}
+
+// next character without consuming it, EOF at the end of input
+static inline int eidos_in_peek(EidosIn *in) {
+    if (in->pos == in->end && !eidos_in_fill(in)) {
+        return EOF;
+    }
+    return (unsigned char)*in->pos;
+}
+
+/*
+read(): parses the next integer
+
+returns:
+    EIDOS_READ_OK with *value set, EIDOS_READ_NONE, or EIDOS_READ_RANGE
+*/
+static inline int eidos_read_int(EidosIn *in, int64_t *value) {
+    int c = eidos_in_peek(in);
+    while (c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f') {
+        in->pos++;
+        c = eidos_in_peek(in);
+    }
+
+    int negative = c == '-';
+    if (c == '-' || c == '+') {
+        in->pos++;
+        c = eidos_in_peek(in);
+    }
+    if (c < '0' || c > '9') {
+        return EIDOS_READ_NONE;
+    }
+
+    // magnitude limit: 2^63 for negative numbers, 2^63 - 1 otherwise
+    uint64_t limit = negative ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+    uint64_t u = 0;
+    for (;;) {
+        // digits inside the buffer go without a refill check each
+        const char *p = in->pos;
+        while (p < in->end && (unsigned)(*p - '0') < 10) {
+            unsigned digit = (unsigned)(*p - '0');
+            if (u > (limit - digit) / 10) {
+                in->pos = p;
+                return EIDOS_READ_RANGE;
+            }
+            u = u * 10 + digit;
+            p++;
+        }
+        in->pos = p;
+        if (p < in->end || !eidos_in_fill(in)) {
+            break;
+        }
+    }
+
+    *value = negative ? (int64_t)(0 - u) : (int64_t)u;
+    return EIDOS_READ_OK;
+}
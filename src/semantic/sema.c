@@ -0,0 +1,578 @@
+#include "sema.h"
+#include "../util/context.h"
+#include "../util/strmap.h"
+#include <string.h>
+
+/* ===== Helper Functions ===== */
+
+/*
+Adds kind to what a name is defined as
+*/
+static void define(StrMap *defined, const char *name, size_t kind) {
+    size_t bits = 0;
+    strmap_get(defined, name, &bits);
+    strmap_put(defined, name, bits | kind);
+}
+
+/*
+What a name is defined as, 0 if it isn't
+*/
+static size_t kind_of(const StrMap *defined, const char *name) {
+    size_t bits = 0;
+    strmap_get(defined, name, &bits);
+    return bits;
+}
+
+/*
+Records every name the program defines
+
+args:
+    *defined (StrMap) -> set of defined names
+    *node (ASTNode) -> subtree to scan
+*/
+static void collect_defs(StrMap *defined, const ASTNode *node) {
+    for (; node && node->type == AST_STMTS_NODE; node = node->data.stmts.next) {
+        collect_defs(defined, node->data.stmts.stmt);
+    }
+    if (!node) {
+        return;
+    }
+
+    switch (node->type) {
+    case AST_PROGRAM_NODE:
+        collect_defs(defined, node->data.program.stmts);
+        break;
+    case AST_VAR_DECL_NODE:
+        define(defined, node->data.var_decl.identifer, SEMA_VARIABLE);
+        break;
+    case AST_ASSIGN_NODE:
+        define(defined, node->data.assignment.identifier, SEMA_VARIABLE);
+        break;
+    case AST_READ_NODE:
+        define(defined, node->data.read_stmt.identifier, SEMA_VARIABLE);
+        break;
+    case AST_ARRAY_DECL_NODE:
+        define(defined, node->data.array_decl.identifier, SEMA_ARRAY);
+        break;
+    case AST_IF_STMT_NODE:
+        collect_defs(defined, node->data.if_stmt.then_block);
+        collect_defs(defined, node->data.if_stmt.else_block);
+        break;
+    case AST_FOR_LOOP_NODE:
+        collect_defs(defined, node->data.for_loop.initializer);
+        collect_defs(defined, node->data.for_loop.for_block);
+        break;
+    case AST_WHILE_LOOP_NODE:
+        collect_defs(defined, node->data.while_loop.while_block);
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+Checks the array and function declarations of a statement: top level only,
+arrays once each, with a size in range and a name no variable has. Also
+rejects read() in a function, which would make calls depend on the input.
+
+args:
+    *arrays (StrMap) -> arrays declared so far, receives the new ones
+    *defined (StrMap) -> what names are defined as
+    *node (ASTNode) -> subtree to check
+    top (int) -> 1 while node is a top-level statement
+    *fn (char) -> name of the function node is in, NULL outside of one
+
+returns:
+    (size_t) -> number of errors reported
+*/
+static size_t check_decls(StrMap *arrays, const StrMap *defined, const ASTNode *node, int top,
+                          const char *fn) {
+    size_t errors = 0;
+
+    for (; node && node->type == AST_STMTS_NODE; node = node->data.stmts.next) {
+        errors += check_decls(arrays, defined, node->data.stmts.stmt, top, fn);
+    }
+    if (!node) {
+        return errors;
+    }
+
+    size_t unused;
+
+    switch (node->type) {
+    case AST_PROGRAM_NODE:
+        return check_decls(arrays, defined, node->data.program.stmts, 1, fn);
+    case AST_ARRAY_DECL_NODE: {
+        const char *name = node->data.array_decl.identifier;
+        int64_t size = node->data.array_decl.size;
+        if (!top) {
+            eidos_diag("Error at line %zu, column %zu: array '%s' must be declared at the top level\n",
+                    node->line, node->col, name);
+            errors++;
+        }
+        if (size < 1 || size > ARRAY_MAX_ELEMENTS) {
+            eidos_diag("Error at line %zu, column %zu: array '%s' must have 1 to %lld elements\n",
+                    node->line, node->col, name, (long long)ARRAY_MAX_ELEMENTS);
+            errors++;
+        }
+        if (strmap_get(arrays, name, &unused)) {
+            eidos_diag("Error at line %zu, column %zu: array '%s' is declared twice\n",
+                    node->line, node->col, name);
+            errors++;
+        }
+        if (kind_of(defined, name) & SEMA_VARIABLE) {
+            eidos_diag("Error at line %zu, column %zu: '%s' is both an array and a variable\n",
+                    node->line, node->col, name);
+            errors++;
+        }
+        strmap_put(arrays, name, 1);
+        return errors;
+    }
+    case AST_FN_DECL_NODE:
+        if (!top) {
+            eidos_diag("Error at line %zu, column %zu: function '%s' must be declared at the top level\n",
+                    node->line, node->col, node->data.fn_decl.name);
+            errors++;
+        }
+        return errors + check_decls(arrays, defined, node->data.fn_decl.body, 0, node->data.fn_decl.name);
+    case AST_READ_NODE:
+        if (fn) {
+            eidos_diag("Error at line %zu, column %zu: function '%s' can't read()\n",
+                    node->line, node->col, fn);
+            return 1;
+        }
+        return 0;
+    case AST_IF_STMT_NODE:
+        return check_decls(arrays, defined, node->data.if_stmt.then_block, 0, fn) +
+               check_decls(arrays, defined, node->data.if_stmt.else_block, 0, fn);
+    case AST_FOR_LOOP_NODE:
+        return check_decls(arrays, defined, node->data.for_loop.for_block, 0, fn);
+    case AST_WHILE_LOOP_NODE:
+        return check_decls(arrays, defined, node->data.while_loop.while_block, 0, fn);
+    default:
+        return 0;
+    }
+}
+
+/*
+Records a function declaration, name -> number of parameters
+
+args:
+    *funcs (StrMap) -> functions declared so far, receives this one
+    *node (ASTNode) -> AST_FN_DECL_NODE
+
+returns:
+    (size_t) -> number of errors reported
+*/
+static size_t declare_fn(StrMap *funcs, const ASTNode *node) {
+    size_t errors = 0;
+    size_t unused;
+    const char *name = node->data.fn_decl.name;
+    if (strmap_get(funcs, name, &unused)) {
+        eidos_diag("Error at line %zu, column %zu: function '%s' is declared twice\n",
+                node->line, node->col, name);
+        errors++;
+    }
+    if (node->data.fn_decl.nparams > FN_MAX_PARAMS) {
+        eidos_diag("Error at line %zu, column %zu: function '%s' has more than %d parameters\n",
+                node->line, node->col, name, FN_MAX_PARAMS);
+        errors++;
+    }
+    strmap_put(funcs, name, node->data.fn_decl.nparams);
+    return errors;
+}
+
+/*
+Records the functions the program declares. Only top-level declarations
+count (check_decls reports the others), so a function can be called
+anywhere, before its declaration included.
+
+args:
+    *funcs (StrMap) -> receives the functions
+    *program (ASTNode) -> AST_PROGRAM_NODE
+
+returns:
+    (size_t) -> number of errors reported
+*/
+static size_t collect_fns(StrMap *funcs, const ASTNode *program) {
+    size_t errors = 0;
+    for (const ASTNode *s = program->data.program.stmts; s; s = s->data.stmts.next) {
+        if (s->data.stmts.stmt->type == AST_FN_DECL_NODE) {
+            errors += declare_fn(funcs, s->data.stmts.stmt);
+        }
+    }
+    return errors;
+}
+
+/*
+Reports a call with as many arguments as the function doesn't have
+
+returns:
+    (size_t) -> 1 if an error was reported
+*/
+static size_t check_arity(size_t line, size_t col, const char *name, size_t nparams, size_t nargs) {
+    if (nparams == nargs) {
+        return 0;
+    }
+    eidos_diag("Error at line %zu, column %zu: function '%s' takes %zu argument%s, not %zu\n",
+            line, col, name, nparams, nparams == 1 ? "" : "s", nargs);
+    return 1;
+}
+
+/*
+Drops the held back uses of names that have been defined since, keeping the
+rest in order
+*/
+static void drop_defined(SemaStream *stream) {
+    size_t kept = 0;
+    for (size_t i = 0; i < stream->npending; i++) {
+        SemaUse use = stream->pending[i];
+        size_t unused;
+        if (use.kind == SEMA_FUNCTION ? strmap_get(&stream->funcs, use.name, &unused)
+                                      : (kind_of(&stream->defined, use.name) & (size_t)use.kind) != 0) {
+            eidos_free(use.name);
+        } else {
+            stream->pending[kept++] = use;
+        }
+    }
+    stream->npending = kept;
+}
+
+/*
+Holds back a use of a name no statement so far defines, sema_stream_finish
+reports it unless a later statement defines the name
+*/
+static SemaUse *defer_use(SemaStream *stream, const ASTNode *node, const char *name, int kind) {
+    if (stream->npending == stream->pending_cap) {
+        // only grow when most of the held back uses are still undefined
+        drop_defined(stream);
+        if (stream->npending * 2 >= stream->pending_cap) {
+            stream->pending_cap = stream->pending_cap ? stream->pending_cap * 2 : 16;
+            stream->pending = eidos_realloc(stream->pending, stream->pending_cap * sizeof(SemaUse));
+            if (!stream->pending) {
+                eidos_fatal("Failed to allocate pending uses");
+            }
+        }
+    }
+
+    SemaUse *use = &stream->pending[stream->npending++];
+    use->name = eidos_strdup(name);
+    if (!use->name) {
+        eidos_fatal("Failed to allocate pending use");
+    }
+    use->kind = kind;
+    use->nargs = 0;
+    use->line = node->line;
+    use->col = node->col;
+    return use;
+}
+
+/*
+Reports a name used as what it isn't defined as
+
+args:
+    line, col (size_t) -> where it is used
+    *name (char) -> the name
+    kind (int) -> SEMA_VARIABLE, SEMA_ARRAY or SEMA_FUNCTION, how it is used
+    defined (size_t) -> SEMA_* bits the name is defined with, 0 if it isn't
+*/
+static void report_use(size_t line, size_t col, const char *name, int kind, size_t defined) {
+    if (kind == SEMA_FUNCTION) {
+        eidos_diag("Error at line %zu, column %zu: call to undeclared function '%s'\n", line, col, name);
+    } else if (kind == SEMA_VARIABLE && (defined & SEMA_ARRAY)) {
+        eidos_diag("Error at line %zu, column %zu: array '%s' used without an index\n", line, col, name);
+    } else if (kind == SEMA_VARIABLE) {
+        eidos_diag("Error at line %zu, column %zu: use of undeclared variable '%s'\n", line, col, name);
+    } else if (defined & SEMA_VARIABLE) {
+        eidos_diag("Error at line %zu, column %zu: '%s' is not an array\n", line, col, name);
+    } else {
+        eidos_diag("Error at line %zu, column %zu: use of undeclared array '%s'\n", line, col, name);
+    }
+}
+
+/*
+Checks one use of a name
+
+returns:
+    (size_t) -> 1 if an error was reported
+*/
+static size_t check_use(const StrMap *defined, const ASTNode *node, const char *name, int kind,
+                        SemaStream *defer) {
+    size_t bits = kind_of(defined, name);
+    if (bits & (size_t)kind) {
+        return 0;
+    }
+    if (defer && !defer->in_fn) {
+        defer_use(defer, node, name, kind);
+        return 0;
+    }
+    report_use(node->line, node->col, name, kind, bits);
+    return 1;
+}
+
+/*
+Checks a statement that defines a variable. Only a stream reports a name an
+earlier array declaration took; a whole program reports the conflict at the
+declaration (check_decls)
+*/
+static size_t check_defines(const StrMap *defined, const ASTNode *node, const char *name,
+                            SemaStream *stream) {
+    if (!stream || !(kind_of(defined, name) & SEMA_ARRAY)) {
+        return 0;
+    }
+    size_t unused;
+    if (!strmap_get(&stream->arrays, name, &unused)) {
+        return 0;   // declared by this very statement, check_decls reports it there
+    }
+    eidos_diag("Error at line %zu, column %zu: '%s' is both an array and a variable\n",
+            node->line, node->col, name);
+    return 1;
+}
+
+static size_t check_uses(const StrMap *defined, const StrMap *funcs, const ASTNode *node, SemaStream *defer);
+
+/*
+Checks a call: the function exists and gets as many arguments as it has parameters
+
+args:
+    *funcs (StrMap) -> declared functions, NULL for none
+    *node (ASTNode) -> AST_CALL_EXPR
+    *defer (SemaStream) -> where a call to a function not declared yet waits for it, NULL to report it now
+
+returns:
+    (size_t) -> 1 if an error was reported
+*/
+static size_t check_call(const StrMap *funcs, const ASTNode *node, SemaStream *defer) {
+    const char *name = node->data.call_expr.name;
+    size_t nparams;
+    if (!funcs || !strmap_get(funcs, name, &nparams)) {
+        if (defer) {
+            defer_use(defer, node, name, SEMA_FUNCTION)->nargs = node->data.call_expr.nargs;
+            return 0;
+        }
+        report_use(node->line, node->col, name, SEMA_FUNCTION, 0);
+        return 1;
+    }
+    return check_arity(node->line, node->col, name, nparams, node->data.call_expr.nargs);
+}
+
+/*
+Checks a function declaration. Its body sees its parameters and the
+variables it defines itself, no global and no array.
+
+args:
+    *funcs (StrMap) -> declared functions
+    *node (ASTNode) -> AST_FN_DECL_NODE
+    *stream (SemaStream) -> where calls to functions declared further on wait, NULL outside of a stream
+
+returns:
+    (size_t) -> number of errors reported
+*/
+static size_t check_fn(const StrMap *funcs, const ASTNode *node, SemaStream *stream) {
+    size_t errors = 0;
+    StrMap locals;
+    strmap_init(&locals);
+
+    for (size_t i = 0; i < node->data.fn_decl.nparams; i++) {
+        const char *param = node->data.fn_decl.params[i];
+        if (kind_of(&locals, param)) {
+            eidos_diag("Error at line %zu, column %zu: parameter '%s' of '%s' is declared twice\n",
+                    node->line, node->col, param, node->data.fn_decl.name);
+            errors++;
+        }
+        define(&locals, param, SEMA_VARIABLE);
+    }
+    collect_defs(&locals, node->data.fn_decl.body);
+
+    // every name of the body is known already, only its calls can wait
+    int outer = stream ? stream->in_fn : 0;
+    if (stream) {
+        stream->in_fn = 1;
+    }
+    errors += check_uses(&locals, funcs, node->data.fn_decl.body, stream) +
+              check_uses(&locals, funcs, node->data.fn_decl.ret, stream);
+    if (stream) {
+        stream->in_fn = outer;
+    }
+
+    strmap_free(&locals);
+    return errors;
+}
+
+/*
+Reports identifiers that were never defined, or are used as what they aren't
+
+args:
+    *defined (StrMap) -> set of defined names
+    *funcs (StrMap) -> declared functions, NULL for none
+    *node (ASTNode) -> subtree to check
+    *defer (SemaStream) -> where undefined uses and calls wait for the end of a stream, NULL to report them now
+
+returns:
+    (size_t) -> number of errors reported
+*/
+static size_t check_uses(const StrMap *defined, const StrMap *funcs, const ASTNode *node, SemaStream *defer) {
+    size_t errors = 0;
+
+    for (; node && node->type == AST_STMTS_NODE; node = node->data.stmts.next) {
+        errors += check_uses(defined, funcs, node->data.stmts.stmt, defer);
+    }
+    if (!node) {
+        return errors;
+    }
+
+    switch (node->type) {
+    case AST_PROGRAM_NODE:
+        return check_uses(defined, funcs, node->data.program.stmts, defer);
+    case AST_IDENTIFIER_NODE:
+        return check_use(defined, node, node->data.identifier.name, SEMA_VARIABLE, defer);
+    case AST_INDEX_EXPR:
+        return check_use(defined, node, node->data.index_expr.identifier, SEMA_ARRAY, defer) +
+               check_uses(defined, funcs, node->data.index_expr.index, defer);
+    case AST_INDEX_ASSIGN_NODE:
+        return check_use(defined, node, node->data.index_assign.identifier, SEMA_ARRAY, defer) +
+               check_uses(defined, funcs, node->data.index_assign.index, defer) +
+               check_uses(defined, funcs, node->data.index_assign.value, defer);
+    case AST_VAR_DECL_NODE:
+        return check_defines(defined, node, node->data.var_decl.identifer, defer) +
+               check_uses(defined, funcs, node->data.var_decl.value, defer);
+    case AST_ASSIGN_NODE:
+        return check_defines(defined, node, node->data.assignment.identifier, defer) +
+               check_uses(defined, funcs, node->data.assignment.value, defer);
+    case AST_READ_NODE:
+        return check_defines(defined, node, node->data.read_stmt.identifier, defer);
+    case AST_PRINT_NODE:
+        return check_uses(defined, funcs, node->data.print_stmt.expression, defer);
+    case AST_FN_DECL_NODE:
+        return check_fn(funcs, node, defer);
+    case AST_CALL_EXPR: {
+        size_t errors = check_call(funcs, node, defer);
+        for (size_t i = 0; i < node->data.call_expr.nargs; i++) {
+            errors += check_uses(defined, funcs, node->data.call_expr.args[i], defer);
+        }
+        return errors;
+    }
+    case AST_UNARY_EXPR:
+        return check_uses(defined, funcs, node->data.unary_expr.operand, defer);
+    case AST_BINARY_EXPR:
+        return check_uses(defined, funcs, node->data.binary_expr.left, defer) +
+               check_uses(defined, funcs, node->data.binary_expr.right, defer);
+    case AST_CONDITIONAL_NODE:
+        return check_uses(defined, funcs, node->data.conditional.left_expression, defer) +
+               check_uses(defined, funcs, node->data.conditional.right_expression, defer);
+    case AST_IF_STMT_NODE:
+        return check_uses(defined, funcs, node->data.if_stmt.condition, defer) +
+               check_uses(defined, funcs, node->data.if_stmt.then_block, defer) +
+               check_uses(defined, funcs, node->data.if_stmt.else_block, defer);
+    case AST_FOR_LOOP_NODE:
+        return check_uses(defined, funcs, node->data.for_loop.initializer, defer) +
+               check_uses(defined, funcs, node->data.for_loop.condition, defer) +
+               check_uses(defined, funcs, node->data.for_loop.step, defer) +
+               check_uses(defined, funcs, node->data.for_loop.for_block, defer);
+    case AST_WHILE_LOOP_NODE:
+        return check_uses(defined, funcs, node->data.while_loop.condition, defer) +
+               check_uses(defined, funcs, node->data.while_loop.while_block, defer);
+    default:
+        return 0;
+    }
+}
+
+
+/* ========== PUBLIC API ========== */
+
+/*
+Runs the semantic checks
+
+args:
+    *program (ASTNode) -> AST_PROGRAM_NODE to check
+
+returns:
+    (size_t) -> number of errors reported to stderr
+*/
+size_t sema_check(const ASTNode *program) {
+    StrMap defined;
+    strmap_init(&defined);
+
+    StrMap arrays;
+    strmap_init(&arrays);
+
+    StrMap funcs;
+    strmap_init(&funcs);
+
+    collect_defs(&defined, program);
+    size_t errors = collect_fns(&funcs, program);
+    errors += check_decls(&arrays, &defined, program, 1, NULL);
+    errors += check_uses(&defined, &funcs, program, NULL);
+
+    strmap_free(&funcs);
+    strmap_free(&arrays);
+    strmap_free(&defined);
+    return errors;
+}
+
+/*
+Starts checking a program one top-level statement at a time
+
+args:
+    *stream (SemaStream) -> state to initialize
+*/
+void sema_stream_init(SemaStream *stream) {
+    strmap_init(&stream->defined);
+    strmap_init(&stream->arrays);
+    strmap_init(&stream->funcs);
+    stream->in_fn = 0;
+    stream->errors = 0;
+    stream->pending = NULL;
+    stream->npending = 0;
+    stream->pending_cap = 0;
+}
+
+/*
+Checks the next top-level statement. Names it uses that no statement so far
+defines are held back, a later statement may still define them. A function
+declaration checks the calls to it that were held back.
+
+args:
+    *stream (SemaStream) -> state of the program so far
+    *stmt (ASTNode) -> the statement, free to release afterwards
+*/
+void sema_stream_stmt(SemaStream *stream, const ASTNode *stmt) {
+    if (stmt->type == AST_FN_DECL_NODE) {
+        const char *name = stmt->data.fn_decl.name;
+        stream->errors += declare_fn(&stream->funcs, stmt);
+        for (size_t i = 0; i < stream->npending; i++) {
+            const SemaUse *use = &stream->pending[i];
+            if (use->kind == SEMA_FUNCTION && strcmp(use->name, name) == 0) {
+                stream->errors += check_arity(use->line, use->col, name, stmt->data.fn_decl.nparams, use->nargs);
+            }
+        }
+        drop_defined(stream);
+    }
+    collect_defs(&stream->defined, stmt);
+    stream->errors += check_uses(&stream->defined, &stream->funcs, stmt, stream);
+    stream->errors += check_decls(&stream->arrays, &stream->defined, stmt, 1, NULL);
+}
+
+/*
+Reports the uses no statement defined and frees the stream
+
+args:
+    *stream (SemaStream) -> state after the last statement
+
+returns:
+    (size_t) -> number of errors reported to stderr
+*/
+size_t sema_stream_finish(SemaStream *stream) {
+    drop_defined(stream);
+    for (size_t i = 0; i < stream->npending; i++) {
+        const SemaUse *use = &stream->pending[i];
+        report_use(use->line, use->col, use->name, use->kind, kind_of(&stream->defined, use->name));
+        eidos_free(use->name);
+    }
+    size_t errors = stream->errors + stream->npending;
+
+    eidos_free(stream->pending);
+    strmap_free(&stream->funcs);
+    strmap_free(&stream->arrays);
+    strmap_free(&stream->defined);
+    return errors;
+}
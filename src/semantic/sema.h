@@ -0,0 +1,73 @@
+#pragma once
+
+/*
+Semantic checks over the parsed AST, run before any pass rewrites the tree.
+
+For now this reports uses of variables that are never defined anywhere in the
+program (by let, assignment, read or a for-loop initializer). Running it before
+constant folding matters: folding may delete the only declaration of a variable
+inside a dead branch, which must not turn a valid program into an invalid one.
+
+Arrays (let a[N];) are static storage: they are declared once, at the top
+level, with 1 to ARRAY_MAX_ELEMENTS elements, and their names are never used
+as variables. Passes after this one rely on all of that.
+
+Functions (fn f(a, b) { ... return e; }) are declared once each, at the top
+level, and may be called anywhere with as many arguments as they have
+parameters, before their declaration and from themselves included. A
+function's body sees only its parameters and its own variables: no globals,
+no arrays and no read(), so a call can't change anything its caller can see
+except through the output, nor depend on the input. sema_stream_stmt, which
+sees one statement at a time, records a function's signature at its
+declaration; a call to a function declared further on is held back like an
+undefined name and checked once the declaration arrives.
+*/
+
+#include "../parser/ast.h"
+#include "../util/strmap.h"
+
+// largest array a program may declare, in elements
+#define ARRAY_MAX_ELEMENTS ((int64_t)1 << 27)
+
+// most parameters a function may have
+#define FN_MAX_PARAMS 64
+
+// what a name is defined as, the values of the defined map
+#define SEMA_VARIABLE 1
+#define SEMA_ARRAY 2
+#define SEMA_FUNCTION 4         // only in SemaUse: functions have names of their own, in SemaStream.funcs
+
+// use of a name that was undefined when its statement was checked
+typedef struct SemaUse {
+    char *name;
+    int kind;                   // SEMA_VARIABLE, SEMA_ARRAY or SEMA_FUNCTION, what the use needs the name to be
+    size_t nargs;               // SEMA_FUNCTION: arguments of the call
+    size_t line;
+    size_t col;
+} SemaUse;
+
+// checks a program statement by statement (sema_stream_*), without its whole tree
+typedef struct SemaStream {
+    StrMap defined;             // names defined by the statements so far, SEMA_* bits
+    StrMap arrays;              // arrays declared so far
+    StrMap funcs;               // functions declared so far, name -> number of parameters
+    int in_fn;                  // 1 while checking a function body, whose names are all known
+    size_t errors;              // reported already, at the statement
+    SemaUse *pending;           // uses that a later statement may still define
+    size_t npending;
+    size_t pending_cap;
+} SemaStream;
+
+/*
+Checks the program and prints a diagnostic per problem, returns the number of errors
+*/
+size_t sema_check(const ASTNode *program);
+
+/*
+Statement at a time checking for streaming compilation: init, one call per
+top-level statement, then finish reports what was never defined and returns
+the number of errors. The diagnostics are the ones sema_check prints.
+*/
+void sema_stream_init(SemaStream *stream);
+void sema_stream_stmt(SemaStream *stream, const ASTNode *stmt);
+size_t sema_stream_finish(SemaStream *stream);
@@ -0,0 +1,75 @@
+#pragma once
+
+/*
+Eidos integer semantics, shared by every pass that evaluates code at compile
+time and by every engine that runs it, so folding never disagrees with running.
+
+Values are 64-bit two's complement and wrap on overflow. Division truncates
+toward zero; INT64_MIN / -1 wraps to INT64_MIN. Division by zero is NOT handled
+here, callers must check the divisor first and report it.
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+// comparison operators of <conditional>
+typedef enum CmpOp {
+    CMP_EQ,     // ==
+    CMP_NE,     // !=
+    CMP_LT,     // <
+    CMP_GT,     // >
+    CMP_LE,     // <=
+    CMP_GE,     // >=
+} CmpOp;
+
+static inline int64_t eidos_add(int64_t a, int64_t b) {
+    return (int64_t)((uint64_t)a + (uint64_t)b);
+}
+
+static inline int64_t eidos_sub(int64_t a, int64_t b) {
+    return (int64_t)((uint64_t)a - (uint64_t)b);
+}
+
+static inline int64_t eidos_mul(int64_t a, int64_t b) {
+    return (int64_t)((uint64_t)a * (uint64_t)b);
+}
+
+static inline int64_t eidos_neg(int64_t a) {
+    return (int64_t)(0 - (uint64_t)a);
+}
+
+static inline int64_t eidos_div(int64_t a, int64_t b) {
+    if (b == -1) {
+        return eidos_neg(a);    // avoids the INT64_MIN / -1 trap
+    }
+    return a / b;
+}
+
+static inline int64_t eidos_not(int64_t a) {
+    return a == 0;
+}
+
+static inline int64_t eidos_compare(CmpOp op, int64_t a, int64_t b) {
+    switch (op) {
+    case CMP_EQ: return a == b;
+    case CMP_NE: return a != b;
+    case CMP_LT: return a < b;
+    case CMP_GT: return a > b;
+    case CMP_LE: return a <= b;
+    case CMP_GE: return a >= b;
+    }
+    return 0;
+}
+
+/*
+Maps a comparison lexeme ("<=", "!=", ...) to its CmpOp, returns 0 if unknown
+*/
+static inline int cmp_op_from_lexeme(const char *lexeme, CmpOp *op) {
+    if (strcmp(lexeme, "==") == 0) { *op = CMP_EQ; return 1; }
+    if (strcmp(lexeme, "!=") == 0) { *op = CMP_NE; return 1; }
+    if (strcmp(lexeme, "<") == 0)  { *op = CMP_LT; return 1; }
+    if (strcmp(lexeme, ">") == 0)  { *op = CMP_GT; return 1; }
+    if (strcmp(lexeme, "<=") == 0) { *op = CMP_LE; return 1; }
+    if (strcmp(lexeme, ">=") == 0) { *op = CMP_GE; return 1; }
+    return 0;
+}
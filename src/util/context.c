@@ -0,0 +1,234 @@
+#include "context.h"
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// context of the library call running on this thread
+static _Thread_local EidosContext *active;
+
+EidosAllocCount eidos_alloc_count;
+
+/* ===== Helper Functions ===== */
+
+/*
+Out of memory inside a library call: unwind straight away rather than trust
+every caller to check for NULL
+*/
+static void *out_of_memory(EidosContext *ctx) {
+    ctx->out_of_memory = 1;
+    if (ctx->recover) {
+        eidos_fatal("Out of memory");
+    }
+    return NULL;
+}
+
+static void *tracked_alloc(EidosContext *ctx, size_t size) {
+    if (size > SIZE_MAX - sizeof(EidosBlock)) {
+        return out_of_memory(ctx);
+    }
+    EidosBlock *b = eidos_context_alloc(ctx, sizeof(EidosBlock) + size);
+    if (!b) {
+        return out_of_memory(ctx);
+    }
+
+    b->link.size = size;
+    b->link.prev = &ctx->live;
+    b->link.next = ctx->live.link.next;
+    ctx->live.link.next->link.prev = b;
+    ctx->live.link.next = b;
+
+    ctx->live_bytes += size;
+    if (ctx->live_bytes > ctx->peak_bytes) {
+        ctx->peak_bytes = ctx->live_bytes;
+    }
+    ctx->allocations++;
+    return b + 1;
+}
+
+static void tracked_free(EidosContext *ctx, void *ptr) {
+    EidosBlock *b = (EidosBlock*)ptr - 1;
+    b->link.prev->link.next = b->link.next;
+    b->link.next->link.prev = b->link.prev;
+    ctx->live_bytes -= b->link.size;
+    eidos_context_release(ctx, b, sizeof(EidosBlock) + b->link.size);
+}
+
+static void diag_append(EidosContext *ctx, const char *text, size_t len) {
+    if (ctx->diag_len + len + 1 > ctx->diag_cap) {
+        size_t cap = ctx->diag_cap ? ctx->diag_cap : 256;
+        while (cap < ctx->diag_len + len + 1) {
+            cap *= 2;
+        }
+        char *bigger = eidos_context_alloc(ctx, cap);
+        if (!bigger) {
+            // diagnostics are best effort, the status still says what happened
+            return;
+        }
+        if (ctx->diag) {
+            memcpy(bigger, ctx->diag, ctx->diag_len);
+            eidos_context_release(ctx, ctx->diag, ctx->diag_cap);
+        }
+        ctx->diag = bigger;
+        ctx->diag_cap = cap;
+    }
+    memcpy(ctx->diag + ctx->diag_len, text, len);
+    ctx->diag_len += len;
+    ctx->diag[ctx->diag_len] = '\0';
+}
+
+static void vdiag(const char *format, va_list args) {
+    if (!active) {
+        vfprintf(stderr, format, args);
+        return;
+    }
+
+    char small[256];
+    va_list copy;
+    va_copy(copy, args);
+    int len = vsnprintf(small, sizeof(small), format, copy);
+    va_end(copy);
+    if (len < 0) {
+        return;
+    }
+
+    if ((size_t)len < sizeof(small)) {
+        diag_append(active, small, (size_t)len);
+        return;
+    }
+    char *big = eidos_context_alloc(active, (size_t)len + 1);
+    if (big) {
+        vsnprintf(big, (size_t)len + 1, format, args);
+        diag_append(active, big, (size_t)len);
+        eidos_context_release(active, big, (size_t)len + 1);
+    }
+}
+
+
+static void count_alloc(size_t size) {
+    // relaxed atomics: the parallel parser allocates on several threads
+    __atomic_fetch_add(&eidos_alloc_count.allocations, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&eidos_alloc_count.bytes, size, __ATOMIC_RELAXED);
+}
+
+
+/* ========== PUBLIC API ========== */
+
+void *eidos_malloc(size_t size) {
+    if (active) {
+        return tracked_alloc(active, size);
+    }
+    if (EIDOS_UNLIKELY(eidos_alloc_count.enabled)) {
+        count_alloc(size);
+    }
+    return malloc(size);
+}
+
+void *eidos_calloc(size_t count, size_t size) {
+    if (!active) {
+        if (EIDOS_UNLIKELY(eidos_alloc_count.enabled)) {
+            count_alloc(count * size);
+        }
+        return calloc(count, size);
+    }
+    if (size && count > SIZE_MAX / size) {
+        return out_of_memory(active);
+    }
+    void *p = tracked_alloc(active, count * size);
+    if (p) {
+        memset(p, 0, count * size);
+    }
+    return p;
+}
+
+void *eidos_realloc(void *ptr, size_t size) {
+    if (!active) {
+        if (EIDOS_UNLIKELY(eidos_alloc_count.enabled)) {
+            count_alloc(size);
+        }
+        return realloc(ptr, size);
+    }
+    if (!ptr) {
+        return tracked_alloc(active, size);
+    }
+
+    size_t old = ((EidosBlock*)ptr - 1)->link.size;
+    void *p = tracked_alloc(active, size);
+    if (p) {
+        memcpy(p, ptr, old < size ? old : size);
+        tracked_free(active, ptr);
+    }
+    return p;
+}
+
+char *eidos_strdup(const char *s) {
+    size_t len = strlen(s) + 1;
+    char *copy = eidos_malloc(len);
+    if (copy) {
+        memcpy(copy, s, len);
+    }
+    return copy;
+}
+
+void eidos_free(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+    if (active) {
+        tracked_free(active, ptr);
+    } else {
+        free(ptr);
+    }
+}
+
+void eidos_diag(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vdiag(format, args);
+    va_end(args);
+}
+
+void eidos_fatal(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    eidos_diag("Error: ");
+    vdiag(format, args);
+    eidos_diag("\n");
+    va_end(args);
+    eidos_abort();
+}
+
+void eidos_abort(void) {
+    if (active && active->recover) {
+        longjmp(*active->recover, 1);
+    }
+    exit(1);
+}
+
+EidosContext *eidos_context_enter(EidosContext *ctx) {
+    EidosContext *previous = active;
+    active = ctx;
+    return previous;
+}
+
+void eidos_context_release_all(EidosContext *ctx) {
+    while (ctx->live.link.next != &ctx->live) {
+        tracked_free(ctx, ctx->live.link.next + 1);
+    }
+}
+
+void *eidos_context_alloc(EidosContext *ctx, size_t size) {
+    if (ctx->allocator.alloc) {
+        return ctx->allocator.alloc(ctx->allocator.user, size);
+    }
+    return malloc(size);
+}
+
+void eidos_context_release(EidosContext *ctx, void *ptr, size_t size) {
+    if (ctx->allocator.release) {
+        ctx->allocator.release(ctx->allocator.user, ptr, size);
+    } else {
+        free(ptr);
+    }
+}
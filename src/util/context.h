@@ -0,0 +1,118 @@
+#pragma once
+
+/*
+Allocation, diagnostics and fatal errors for every compiler module.
+
+Modules allocate with eidos_malloc and friends, report problems with
+eidos_diag, and give up with eidos_fatal / eidos_abort instead of calling
+malloc, fprintf(stderr) and exit directly. Where these go depends on the
+context active on the calling thread:
+
+- none (the eidos binary): plain malloc/free, diagnostics to stderr, and a
+  fatal error exits with status 1
+- an EidosContext (libeidos, lib/eidos.h): memory comes from the context's
+  allocator and is tracked so all of it can be released at once,
+  diagnostics are collected in the context, and a fatal error unwinds
+  (longjmp) to the library call that activated the context
+
+The active context is thread-local: threads compiling with their own
+contexts share nothing.
+*/
+
+#include <setjmp.h>
+#include <stddef.h>
+#include "../lib/eidos.h"
+
+#if defined(__GNUC__)
+#define EIDOS_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#else
+#define EIDOS_UNLIKELY(x) (x)
+#endif
+
+// allocations made outside any context, counted while enabled (--time-report)
+typedef struct EidosAllocCount {
+    int enabled;
+    size_t allocations;
+    size_t bytes;
+} EidosAllocCount;
+
+extern EidosAllocCount eidos_alloc_count;
+
+// header in front of every block a context hands out, links the live blocks
+typedef union EidosBlock {
+    struct {
+        union EidosBlock *prev;
+        union EidosBlock *next;
+        size_t size;
+    } link;
+    max_align_t align;
+} EidosBlock;
+
+struct EidosContext {
+    EidosAllocator allocator;
+    EidosBlock live;            // sentinel of the list of live blocks
+    size_t live_bytes;
+    size_t peak_bytes;
+    size_t allocations;         // blocks handed out since the context was created
+
+    char *diag;                 // diagnostics of the current call, not in the live list
+    size_t diag_len;
+    size_t diag_cap;
+
+    char *output;               // result of the last successful call, not in the live list
+    size_t output_len;
+
+    jmp_buf *recover;           // where eidos_abort unwinds to, NULL outside library calls
+    int out_of_memory;          // set when the allocator failed
+};
+
+
+/* ========== Public API Functions ========== */
+
+/*
+Allocation, through the active context if there is one. eidos_malloc,
+eidos_calloc, eidos_realloc and eidos_strdup return NULL when memory runs out,
+like their libc counterparts, except inside a library call, where running
+out unwinds it with EIDOS_NO_MEMORY. Blocks must be freed under the context
+they were allocated under.
+*/
+void *eidos_malloc(size_t size);
+void *eidos_calloc(size_t count, size_t size);
+void *eidos_realloc(void *ptr, size_t size);
+char *eidos_strdup(const char *s);
+void eidos_free(void *ptr);
+
+/*
+Reports a diagnostic (printf-style, the caller supplies the newline)
+*/
+void eidos_diag(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+/*
+Reports "Error: <message>" and gives up, see eidos_abort
+*/
+_Noreturn void eidos_fatal(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+/*
+Gives up on the current compilation: exits with status 1 outside a context,
+unwinds to the library call otherwise
+*/
+_Noreturn void eidos_abort(void);
+
+/*
+Makes ctx the active context of the calling thread (NULL for none) and
+returns the one that was active before
+*/
+EidosContext *eidos_context_enter(EidosContext *ctx);
+
+/*
+Frees every block still live in a context, after a compilation was abandoned
+half way or to start the next one from nothing
+*/
+void eidos_context_release_all(EidosContext *ctx);
+
+/*
+Memory straight from the context's allocator, not tracked in the live list
+(diagnostics and results, which outlive the call that produced them)
+*/
+void *eidos_context_alloc(EidosContext *ctx, size_t size);
+void eidos_context_release(EidosContext *ctx, void *ptr, size_t size);
@@ -0,0 +1,123 @@
+#include "strmap.h"
+#include "context.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ===== Helper Functions ===== */
+
+/*
+FNV-1a hash of a NUL terminated string
+
+args:
+    *s (char) -> string to hash
+
+returns:
+    (size_t) -> hash of s
+*/
+static size_t hash_string(const char *s) {
+    size_t h = (size_t)14695981039346656037ULL;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= (size_t)1099511628211ULL;
+    }
+    return h;
+}
+
+/*
+Finds the slot holding key, or the empty slot where it would be inserted
+
+args:
+    *m (StrMap) -> map to search, must have capacity > 0
+    *key (char) -> key to find
+    hash (size_t) -> hash_string(key)
+
+returns:
+    (StrMapEntry*) -> matching or empty slot
+*/
+static StrMapEntry *find_slot(const StrMap *m, const char *key, size_t hash) {
+    size_t mask = m->capacity - 1;
+    size_t i = hash & mask;
+
+    while (m->entries[i].key) {
+        if (m->entries[i].hash == hash && strcmp(m->entries[i].key, key) == 0) {
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+
+    return &m->entries[i];
+}
+
+/*
+Doubles the slot array and reinserts every entry
+
+args:
+    *m (StrMap) -> map to grow
+*/
+static void grow(StrMap *m) {
+    StrMap bigger;
+    bigger.capacity = m->capacity ? m->capacity * 2 : 16;
+    bigger.count = m->count;
+    bigger.entries = eidos_calloc(bigger.capacity, sizeof(StrMapEntry));
+    if (!bigger.entries) {
+        eidos_fatal("Failed to allocate string map");
+    }
+
+    for (size_t i = 0; i < m->capacity; i++) {
+        if (m->entries[i].key) {
+            *find_slot(&bigger, m->entries[i].key, m->entries[i].hash) = m->entries[i];
+        }
+    }
+
+    eidos_free(m->entries);
+    *m = bigger;
+}
+
+
+/* ========== PUBLIC API ========== */
+
+void strmap_init(StrMap *m) {
+    m->entries = NULL;
+    m->capacity = 0;
+    m->count = 0;
+}
+
+void strmap_free(StrMap *m) {
+    for (size_t i = 0; i < m->capacity; i++) {
+        eidos_free(m->entries[i].key);
+    }
+    eidos_free(m->entries);
+    strmap_init(m);
+}
+
+int strmap_get(const StrMap *m, const char *key, size_t *value) {
+    if (m->count == 0) {
+        return 0;
+    }
+
+    StrMapEntry *e = find_slot(m, key, hash_string(key));
+    if (!e->key) {
+        return 0;
+    }
+
+    *value = e->value;
+    return 1;
+}
+
+void strmap_put(StrMap *m, const char *key, size_t value) {
+    // keep the load factor under 3/4 so probe chains stay short
+    if ((m->count + 1) * 4 > m->capacity * 3) {
+        grow(m);
+    }
+
+    size_t hash = hash_string(key);
+    StrMapEntry *e = find_slot(m, key, hash);
+
+    if (!e->key) {
+        e->key = eidos_strdup(key);
+        e->hash = hash;
+        m->count++;
+    }
+    e->value = value;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+/*
+Open addressing hash map from strings to size_t values.
+Used wherever a pass needs to look up variables by name (constant folding,
+IR construction, ...). The map owns copies of its keys, so callers are free
+to release the strings they looked up with.
+*/
+
+#include <stddef.h>
+
+typedef struct StrMapEntry {
+    char *key;              // owned copy of the key, NULL if the slot is empty
+    size_t hash;            // cached hash of key
+    size_t value;           // value stored for key
+} StrMapEntry;
+
+typedef struct StrMap {
+    StrMapEntry *entries;   // slots, capacity is always a power of two
+    size_t capacity;        // number of slots
+    size_t count;           // number of occupied slots
+} StrMap;
+
+
+/* ========== Public API Functions ========== */
+
+/*
+Initializes an empty map
+*/
+void strmap_init(StrMap *m);
+
+/*
+Frees the slots and every owned key
+*/
+void strmap_free(StrMap *m);
+
+/*
+Looks up key, returns 1 and stores the value in *value if found, else 0
+*/
+int strmap_get(const StrMap *m, const char *key, size_t *value);
+
+/*
+Inserts or overwrites the value stored for key
+*/
+void strmap_put(StrMap *m, const char *key, size_t value);
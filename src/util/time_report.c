@@ -0,0 +1,210 @@
+#include "time_report.h"
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+static const char *phase_names[TIME_PHASE_COUNT] = {
+    "read", "lex", "lex+parse", "sema", "fold", "unroll", "pe", "hashcons",
+    "ir_build", "ir_passes", "emit_c", "bytecode", "run",
+};
+
+static const char *counter_names[PERF_COUNTER_COUNT] = {
+    "cycles", "instructions", "branch-misses", "cache-misses",
+};
+
+/* ===== Helper Functions ===== */
+
+static double clock_ms(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+/*
+Opens one hardware counter of this process, user space only so a default
+perf_event_paranoid setting allows it
+
+returns:
+    (int) -> file descriptor, -1 with errno set if the counter is unavailable
+*/
+static int open_counter(PerfCounter counter) {
+#ifdef __linux__
+    static const uint64_t configs[PERF_COUNTER_COUNT] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_BRANCH_MISSES,
+        PERF_COUNT_HW_CACHE_MISSES,
+    };
+
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = configs[counter];
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    (void)counter;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static void read_counters(const TimeReport *report, uint64_t *values) {
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        values[i] = 0;
+        if (report->perf_fds[i] >= 0 &&
+            read(report->perf_fds[i], &values[i], sizeof(values[i])) != (ssize_t)sizeof(values[i])) {
+            values[i] = 0;
+        }
+    }
+}
+
+
+/* ========== PUBLIC API ========== */
+
+/*
+Sets up a report
+
+args:
+    *report (TimeReport) -> report to initialize
+    enabled (int) -> 1 for --time-report
+    perf_counters (int) -> 1 for --perf-counters as well
+*/
+void time_report_init(TimeReport *report, int enabled, int perf_counters) {
+    memset(report, 0, sizeof(TimeReport));
+    report->enabled = enabled;
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        report->perf_fds[i] = -1;
+    }
+    if (!enabled) {
+        return;
+    }
+
+    eidos_alloc_count.enabled = 1;
+
+    if (perf_counters) {
+        for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+            report->perf_fds[i] = open_counter((PerfCounter)i);
+            if (report->perf_fds[i] < 0 && !report->perf_error) {
+                report->perf_error = strerror(errno);
+            }
+        }
+    }
+}
+
+/*
+Starts measuring a phase
+
+args:
+    *report (TimeReport) -> enabled report
+    phase (TimePhase) -> phase starting now
+*/
+void time_report_begin(TimeReport *report, TimePhase phase) {
+    report->phase = phase;
+    report->allocations_start = eidos_alloc_count.allocations;
+    report->bytes_start = eidos_alloc_count.bytes;
+    read_counters(report, report->counters_start);
+    report->cpu_start = clock_ms(CLOCK_PROCESS_CPUTIME_ID);
+    report->wall_start = clock_ms(CLOCK_MONOTONIC);
+}
+
+/*
+Ends the phase started last and adds it to its totals
+
+args:
+    *report (TimeReport) -> enabled report
+*/
+void time_report_end(TimeReport *report) {
+    double wall = clock_ms(CLOCK_MONOTONIC);
+    double cpu = clock_ms(CLOCK_PROCESS_CPUTIME_ID);
+    uint64_t counters[PERF_COUNTER_COUNT];
+    read_counters(report, counters);
+
+    TimePhaseStats *stats = &report->phases[report->phase];
+    stats->calls++;
+    stats->wall_ms += wall - report->wall_start;
+    stats->cpu_ms += cpu - report->cpu_start;
+    stats->allocations += eidos_alloc_count.allocations - report->allocations_start;
+    stats->bytes += eidos_alloc_count.bytes - report->bytes_start;
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        stats->counters[i] += counters[i] - report->counters_start[i];
+    }
+}
+
+/*
+Prints the report and releases the counters
+
+args:
+    *report (TimeReport) -> report, may be off
+    *out (FILE) -> stream to print to
+*/
+void time_report_finish(TimeReport *report, FILE *out) {
+    if (!report->enabled) {
+        return;
+    }
+
+    int perf = 0;
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        perf |= report->perf_fds[i] >= 0;
+    }
+
+    fprintf(out, "time-report: %-10s %6s %10s %10s %10s %10s", "phase", "calls", "wall ms", "cpu ms",
+            "allocs", "alloc KiB");
+    if (perf) {
+        for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+            fprintf(out, " %14s", counter_names[i]);
+        }
+    }
+    fputs("\n", out);
+
+    TimePhaseStats total;
+    memset(&total, 0, sizeof(total));
+    for (int k = 0; k <= TIME_PHASE_COUNT; k++) {
+        const TimePhaseStats *s = k < TIME_PHASE_COUNT ? &report->phases[k] : &total;
+        if (k < TIME_PHASE_COUNT) {
+            if (!s->calls) {
+                continue;
+            }
+            total.calls += s->calls;
+            total.wall_ms += s->wall_ms;
+            total.cpu_ms += s->cpu_ms;
+            total.allocations += s->allocations;
+            total.bytes += s->bytes;
+            for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+                total.counters[i] += s->counters[i];
+            }
+        }
+
+        fprintf(out, "time-report: %-10s %6zu %10.3f %10.3f %10zu %10.1f",
+                k < TIME_PHASE_COUNT ? phase_names[k] : "total", s->calls, s->wall_ms, s->cpu_ms,
+                s->allocations, (double)s->bytes / 1024);
+        for (int i = 0; perf && i < PERF_COUNTER_COUNT; i++) {
+            if (report->perf_fds[i] >= 0) {
+                fprintf(out, " %14llu", (unsigned long long)s->counters[i]);
+            } else {
+                fprintf(out, " %14s", "-");
+            }
+        }
+        fputs("\n", out);
+    }
+
+    if (report->perf_error) {
+        fprintf(out, "time-report: perf counters unavailable (%s)\n", report->perf_error);
+    }
+
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        if (report->perf_fds[i] >= 0) {
+            close(report->perf_fds[i]);
+            report->perf_fds[i] = -1;
+        }
+    }
+    eidos_alloc_count.enabled = 0;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+/*
+Per-phase time report of the eidos binary (--time-report, --perf-counters).
+
+The driver brackets every phase of a compilation with TIME_BEGIN/TIME_END.
+For each phase the report adds up wall time, CPU time, and the number and
+bytes of allocations made through eidos_malloc and friends. With
+--perf-counters it also adds up cycles, instructions, branch misses and cache
+misses of this process in user space, read with perf_event_open(2). Counters
+the kernel won't provide (no PMU in a VM, perf_event_paranoid, non-Linux)
+are reported as unavailable and the rest of the report is unaffected.
+
+A phase that runs many times (a statement at a time in --stream) adds up.
+
+When the report is off, TIME_BEGIN/TIME_END cost one predicted branch on a
+flag. Building with -DEIDOS_NO_TIME_REPORT removes them altogether.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "context.h"
+
+typedef enum TimePhase {
+    TIME_READ,                  // reading or mapping the input
+    TIME_LEX,                   // the token dump of `eidos file.e`
+    TIME_PARSE,                 // parsing, which pulls its tokens from the lexer
+    TIME_SEMA,
+    TIME_FOLD,
+    TIME_UNROLL,
+    TIME_PE,
+    TIME_HASHCONS,
+    TIME_IR_BUILD,
+    TIME_IR_PASSES,
+    TIME_EMIT_C,
+    TIME_BYTECODE,
+    TIME_RUN,                   // --run or `eidos run`
+    TIME_PHASE_COUNT,
+} TimePhase;
+
+typedef enum PerfCounter {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCH_MISSES,
+    PERF_CACHE_MISSES,
+    PERF_COUNTER_COUNT,
+} PerfCounter;
+
+typedef struct TimePhaseStats {
+    size_t calls;               // times the phase ran
+    double wall_ms;
+    double cpu_ms;
+    size_t allocations;
+    size_t bytes;               // bytes allocated, frees not subtracted
+    uint64_t counters[PERF_COUNTER_COUNT];
+} TimePhaseStats;
+
+typedef struct TimeReport {
+    int enabled;
+    int perf_fds[PERF_COUNTER_COUNT];       // -1 for a counter that isn't read
+    const char *perf_error;                 // why a requested counter is missing, NULL if none is
+
+    // the phase being measured
+    TimePhase phase;
+    double wall_start;
+    double cpu_start;
+    size_t allocations_start;
+    size_t bytes_start;
+    uint64_t counters_start[PERF_COUNTER_COUNT];
+
+    TimePhaseStats phases[TIME_PHASE_COUNT];
+} TimeReport;
+
+#ifdef EIDOS_NO_TIME_REPORT
+#define TIME_BEGIN(report, phase) ((void)(report), (void)(phase))
+#define TIME_END(report) ((void)(report))
+#else
+#define TIME_BEGIN(report, phase) do {                  \
+        if (EIDOS_UNLIKELY((report)->enabled)) {        \
+            time_report_begin((report), (phase));       \
+        }                                               \
+    } while (0)
+#define TIME_END(report) do {                           \
+        if (EIDOS_UNLIKELY((report)->enabled)) {        \
+            time_report_end(report);                    \
+        }                                               \
+    } while (0)
+#endif
+
+
+/* ========== Public API Functions ========== */
+
+/*
+Sets up a report, switched off unless enabled. Turns on allocation counting
+and, with perf_counters, opens the hardware counters.
+*/
+void time_report_init(TimeReport *report, int enabled, int perf_counters);
+
+/*
+Starts and ends a phase; use TIME_BEGIN/TIME_END, which skip the call when
+the report is off. Phases don't nest.
+*/
+void time_report_begin(TimeReport *report, TimePhase phase);
+void time_report_end(TimeReport *report);
+
+/*
+Prints a line per phase that ran and a total, then closes the counters.
+Does nothing for a report that is off.
+*/
+void time_report_finish(TimeReport *report, FILE *out);
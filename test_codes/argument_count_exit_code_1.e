@@ -0,0 +1,5 @@
+fn add(a, b) {
+    return a + b;
+}
+print(add(1, 2));
+print(add(1));
@@ -0,0 +1,4 @@
+let x = 10;
+print(x);
+let y = x / (5 - 5);
+print(y);
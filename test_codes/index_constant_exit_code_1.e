@@ -0,0 +1,6 @@
+let a[4];
+for (i = 0; i < 4; i++) {
+    a[i] = i * i;
+}
+print(a[3]);
+print(a[4]);
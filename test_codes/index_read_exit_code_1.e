@@ -0,0 +1,9 @@
+let a[4];
+let i = 0;
+for (j = 0; j < 4; j++) {
+    a[j] = j * j;
+}
+while (1 < 2) {
+    read(i);
+    print(a[i]);
+}
@@ -0,0 +1,7 @@
+let x = 0;
+let total = 0;
+while (1 < 2) {
+    read(x);
+    total = total + x;
+    print(total);
+}
@@ -0,0 +1,9 @@
+let lo = 0;
+let hi = 0;
+read(lo);
+print(lo);
+read(hi);
+print(hi);
+print(lo + hi);
+print(hi + 1);
+print(lo - 1);
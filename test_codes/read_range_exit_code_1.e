@@ -0,0 +1,5 @@
+let x = 0;
+read(x);
+print(x);
+read(x);
+print(x);
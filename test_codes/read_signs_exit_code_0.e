@@ -0,0 +1,9 @@
+let n = 0;
+let x = 0;
+print(0);
+read(n);
+for (i = 0; i < n; i++) {
+    print(i + 1);
+    read(x);
+    print(x);
+}
@@ -0,0 +1,20 @@
+let a[8];
+let b[8];
+
+for (i = 0; i < 8; i++) {
+    a[i] = i * 3;
+}
+
+for (i = 0; i < 8; i++) {
+    b[i] = a[i] + 5 - i;
+}
+
+a[b[2] - 3] = 100;
+
+let sum = 0;
+for (i = 0; i < 8; i++) {
+    sum = sum + b[i];
+}
+print(sum);
+print(a[6]);
+print(b[7]);
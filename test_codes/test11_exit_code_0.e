@@ -0,0 +1,28 @@
+fn sq(x) {
+    return x * x;
+}
+
+fn gcd(a, b) {
+    while (b != 0) {
+        t = b;
+        b = a - a / b * b;
+        a = t;
+    }
+    return a;
+}
+
+fn fib(n) {
+    r = n;
+    if (n > 1) {
+        r = fib(n - 1) + fib(n - 2);
+    }
+    return r;
+}
+
+let total = 0;
+for (i = 1; i <= 10; i++) {
+    total = total + sq(i);
+}
+print(total);
+print(gcd(462, 1071));
+print(fib(15));
@@ -0,0 +1,5 @@
+fn square(x) {
+    return x * x;
+}
+print(square(3));
+print(cube(3));
@@ -0,0 +1,5 @@
+let total = 0;
+for (i = 0; i < 3; i++) {
+    total = total + i;
+}
+print(totl);
@@ -0,0 +1,15 @@
+let n = 0;
+let a[16];
+let b[16];
+read(n);
+for (i = 0; i < 16; i++) {
+    b[i] = i * i;
+}
+print(b[15]);
+for (i = 0; i < n; i++) {
+    a[i] = b[i] + 1;
+}
+print(a[15]);
+for (i = 2; i < n; i++) {
+    print(b[i - 2]);
+}
@@ -0,0 +1,31 @@
+let n = 0;
+let a[64];
+let b[64];
+let c[64];
+read(n);
+for (i = 0; i < n; i++) {
+    a[i] = i * 3;
+    b[i + 1] = i - 7;
+}
+for (i = 0; i < n; i++) {
+    c[i] = a[i] + b[i + 1] * 2 - a[i + 2];
+}
+let s = 0;
+for (i = 0; i < n; i++) {
+    s = s + c[i];
+}
+print(s);
+for (i = 0; i < n; i++) {
+    if (i / 8 * 8 == i) {
+        print(c[i] * 2);
+    }
+}
+let k = n;
+while (k > 0) {
+    if (k / 3 * 3 == k) {
+        k = k - 1;
+    } else {
+        k = k - 2;
+    }
+}
+print(k);
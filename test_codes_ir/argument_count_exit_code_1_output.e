@@ -0,0 +1 @@
+Error at line 5, column 7: function 'add' takes 2 arguments, not 1
@@ -0,0 +1 @@
+Error at line 3, column 11: division by constant zero
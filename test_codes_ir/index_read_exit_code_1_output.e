@@ -0,0 +1,22 @@
+function main (3 blocks, 15 values)
+  bb0:    ; entry, line 1
+    v1 = const 0    ; j
+    v2 = const 0
+    store a[v1], v2
+    v4 = const 1    ; j
+    v5 = const 1
+    store a[v4], v5
+    v7 = const 2    ; j
+    v8 = const 4
+    store a[v7], v8
+    v10 = const 3    ; j
+    v11 = const 9
+    store a[v10], v11
+    jmp bb1
+  bb1:    ; loop.header, line 6, preds bb0 bb2
+    jmp bb2
+  bb2:    ; loop.body, line 6, preds bb1
+    v15 = read    ; i
+    v16 = load a[v15]
+    print v16
+    jmp bb1
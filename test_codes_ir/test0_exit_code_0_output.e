@@ -0,0 +1,11 @@
+function main (1 blocks, 8 values)
+  bb0:    ; entry, line 1
+    v3 = const 5
+    print v3
+    v7 = const 3
+    print v7
+    v11 = const 4
+    print v11
+    v15 = const 5
+    print v15
+    ret
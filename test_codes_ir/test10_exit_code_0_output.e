@@ -0,0 +1,113 @@
+function main (1 blocks, 110 values)
+  bb0:    ; entry, line 1
+    v0 = const 0    ; i
+    v2 = const 0
+    store a[v0], v2
+    v4 = const 1    ; i
+    v6 = const 3
+    store a[v4], v6
+    v8 = const 2    ; i
+    v10 = const 6
+    store a[v8], v10
+    v12 = const 3    ; i
+    v14 = const 9
+    store a[v12], v14
+    v16 = const 4    ; i
+    v18 = const 12
+    store a[v16], v18
+    v20 = const 5    ; i
+    v22 = const 15
+    store a[v20], v22
+    v24 = const 6    ; i
+    v26 = const 18
+    store a[v24], v26
+    v28 = const 7    ; i
+    v30 = const 21
+    store a[v28], v30
+    v33 = const 0    ; i
+    v34 = load a[v33]
+    v35 = const 5
+    v36 = add v34, v35
+    v37 = sub v36, v33
+    store b[v33], v37
+    v39 = const 1    ; i
+    v40 = load a[v39]
+    v41 = const 5
+    v42 = add v40, v41
+    v43 = sub v42, v39
+    store b[v39], v43
+    v45 = const 2    ; i
+    v46 = load a[v45]
+    v47 = const 5
+    v48 = add v46, v47
+    v49 = sub v48, v45
+    store b[v45], v49
+    v51 = const 3    ; i
+    v52 = load a[v51]
+    v53 = const 5
+    v54 = add v52, v53
+    v55 = sub v54, v51
+    store b[v51], v55
+    v57 = const 4    ; i
+    v58 = load a[v57]
+    v59 = const 5
+    v60 = add v58, v59
+    v61 = sub v60, v57
+    store b[v57], v61
+    v63 = const 5    ; i
+    v64 = load a[v63]
+    v65 = const 5
+    v66 = add v64, v65
+    v67 = sub v66, v63
+    store b[v63], v67
+    v69 = const 6    ; i
+    v70 = load a[v69]
+    v71 = const 5
+    v72 = add v70, v71
+    v73 = sub v72, v69
+    store b[v69], v73
+    v75 = const 7    ; i
+    v76 = load a[v75]
+    v77 = const 5
+    v78 = add v76, v77
+    v79 = sub v78, v75
+    store b[v75], v79
+    v82 = const 2
+    v83 = load b[v82]
+    v84 = const 3
+    v85 = sub v83, v84
+    v86 = const 100
+    store a[v85], v86
+    v88 = const 0    ; sum
+    v89 = const 0    ; i
+    v90 = load b[v89]
+    v91 = add v88, v90    ; sum
+    v92 = const 1    ; i
+    v93 = load b[v92]
+    v94 = add v91, v93    ; sum
+    v95 = const 2    ; i
+    v96 = load b[v95]
+    v97 = add v94, v96    ; sum
+    v98 = const 3    ; i
+    v99 = load b[v98]
+    v100 = add v97, v99    ; sum
+    v101 = const 4    ; i
+    v102 = load b[v101]
+    v103 = add v100, v102    ; sum
+    v104 = const 5    ; i
+    v105 = load b[v104]
+    v106 = add v103, v105    ; sum
+    v107 = const 6    ; i
+    v108 = load b[v107]
+    v109 = add v106, v108    ; sum
+    v110 = const 7    ; i
+    v111 = load b[v110]
+    v112 = add v109, v111    ; sum
+    print v112
+    v115 = const 6
+    v116 = load a[v115]
+    print v116
+    v118 = const 7
+    v119 = load b[v118]
+    print v119
+    ret
@@ -0,0 +1,59 @@
+function main (1 blocks, 9 values)
+  bb0:    ; entry, line 1
+    v30 = const 385    ; total
+    print v30
+    v33 = const 462
+    v34 = const 1071
+    v35 = call gcd(v33, v34)
+    print v35
+    v37 = const 15
+    v38 = call fib(v37)
+    print v38
+    ret
+
+function sq(1 params, 1 blocks, 3 values)
+  bb0:    ; entry, line 1
+    v0 = param 0    ; x
+    v1 = mul v0, v0
+    return v1
+    ret
+
+function gcd(2 params, 4 blocks, 10 values)
+  bb0:    ; entry, line 5
+    v0 = param 0    ; a
+    v1 = param 1    ; b
+    v3 = const 0
+    jmp bb1
+  bb1:    ; loop.header, line 6, preds bb0 bb2
+    v2 = phi [v1, bb0], [v9, bb2]    ; b
+    v6 = phi [v0, bb0], [v2, bb2]    ; a
+    v4 = cmp.ne v2, v3
+    br v4, bb2, bb3
+  bb2:    ; loop.body, line 6, preds bb1
+    v7 = div v6, v2
+    v8 = mul v7, v2
+    v9 = sub v6, v8    ; b
+    jmp bb1
+  bb3:    ; loop.exit, line 6, preds bb1
+    return v6
+    ret
+
+function fib(1 params, 3 blocks, 12 values)
+  bb0:    ; entry, line 14
+    v0 = param 0    ; n
+    v2 = const 1
+    v3 = cmp.gt v0, v2
+    br v3, bb1, bb2
+  bb1:    ; then, line 16, preds bb0
+    v4 = const 1
+    v5 = sub v0, v4
+    v6 = call fib(v5)
+    v7 = const 2
+    v8 = sub v0, v7
+    v9 = call fib(v8)
+    v10 = add v6, v9    ; r
+    jmp bb2
+  bb2:    ; join, line 16, preds bb0 bb1
+    v11 = phi [v0, bb0], [v10, bb1]    ; r
+    return v11
+    ret
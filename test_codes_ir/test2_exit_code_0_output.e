@@ -0,0 +1,54 @@
+function main (9 blocks, 35 values)
+  bb0:    ; entry, line 1
+    v3 = const 25
+    print v3
+    v5 = const 0    ; k
+    v7 = const 32
+    v9 = const 15
+    v12 = const 1
+    v14 = const 15
+    v17 = const 1
+    v19 = const 15
+    v22 = const 1
+    v24 = const 15
+    v27 = const 1
+    jmp bb1
+  bb1:    ; loop.header, line 11, preds bb0 bb4
+    v6 = phi [v5, bb0], [v28, bb4]    ; k
+    v8 = cmp.lt v6, v7
+    br v8, bb2, bb3
+  bb2:    ; loop.body, line 11, preds bb1
+    v10 = add v6, v9
+    print v10
+    v13 = add v6, v12    ; k
+    v15 = add v13, v14
+    print v15
+    v18 = add v13, v17    ; k
+    v20 = add v18, v19
+    print v20
+    v23 = add v18, v22    ; k
+    v25 = add v23, v24
+    print v25
+    jmp bb4
+  bb3:    ; loop.exit, line 11, preds bb1
+    v29 = const 32    ; k
+    v31 = const 35
+    v33 = const 15
+    v36 = const 1
+    jmp bb5
+  bb4:    ; loop.step, line 11, preds bb2
+    v28 = add v23, v27    ; k
+    jmp bb1
+  bb5:    ; loop.header, line 11, preds bb3 bb8
+    v30 = phi [v29, bb3], [v37, bb8]    ; k
+    v32 = cmp.lt v30, v31
+    br v32, bb6, bb7
+  bb6:    ; loop.body, line 11, preds bb5
+    v34 = add v30, v33
+    print v34
+    jmp bb8
+  bb7:    ; loop.exit, line 11, preds bb5
+    ret
+  bb8:    ; loop.step, line 11, preds bb6
+    v37 = add v30, v36    ; k
+    jmp bb5
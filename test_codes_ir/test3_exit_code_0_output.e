@@ -0,0 +1,37 @@
+function main (1 blocks, 34 values)
+  bb0:    ; entry, line 1
+    v3 = const 8
+    print v3
+    v7 = const 8
+    print v7
+    v11 = const 9
+    print v11
+    v15 = const 10
+    print v15
+    v19 = const 11
+    print v19
+    v23 = const 12
+    print v23
+    v27 = const 13
+    print v27
+    v31 = const 14
+    print v31
+    v35 = const 15
+    print v35
+    v39 = const 16
+    print v39
+    v43 = const 17
+    print v43
+    v47 = const 18
+    print v47
+    v51 = const 19
+    print v51
+    v55 = const 20
+    print v55
+    v59 = const 21
+    print v59
+    v63 = const 22
+    print v63
+    v67 = const 23
+    print v67
+    ret
@@ -0,0 +1,77 @@
+function main (15 blocks, 46 values)
+  bb0:    ; entry, line 1
+    v3 = const 34
+    print v3
+    v5 = const 0    ; q
+    v7 = const 48
+    v9 = const 17
+    v12 = const 1
+    v14 = const 17
+    v17 = const 1
+    v19 = const 17
+    v22 = const 1
+    v24 = const 17
+    v27 = const 1
+    jmp bb1
+  bb1:    ; loop.header, line 11, preds bb0 bb4
+    v6 = phi [v5, bb0], [v28, bb4]    ; q
+    v8 = cmp.lt v6, v7
+    br v8, bb2, bb3
+  bb2:    ; loop.body, line 11, preds bb1
+    v10 = add v6, v9
+    print v10
+    v13 = add v6, v12    ; q
+    v15 = add v13, v14
+    print v15
+    v18 = add v13, v17    ; q
+    v20 = add v18, v19
+    print v20
+    v23 = add v18, v22    ; q
+    v25 = add v23, v24
+    print v25
+    jmp bb4
+  bb3:    ; loop.exit, line 11, preds bb1
+    v29 = const 48    ; q
+    v31 = const 51
+    v33 = const 17
+    v36 = const 1
+    jmp bb5
+  bb4:    ; loop.step, line 11, preds bb2
+    v28 = add v23, v27    ; q
+    jmp bb1
+  bb5:    ; loop.header, line 11, preds bb3 bb8
+    v30 = phi [v29, bb3], [v37, bb8]    ; q
+    v32 = cmp.lt v30, v31
+    br v32, bb6, bb7
+  bb6:    ; loop.body, line 11, preds bb5
+    v34 = add v30, v33
+    print v34
+    jmp bb8
+  bb7:    ; loop.exit, line 11, preds bb5
+    v38 = const 10    ; balls
+    v40 = const 5
+    v43 = const 10
+    v45 = const 0    ; balls
+    v46 = const 1
+    jmp bb9
+  bb8:    ; loop.step, line 11, preds bb6
+    v37 = add v30, v36    ; q
+    jmp bb5
+  bb9:    ; loop.header, line 16, preds bb7 bb14
+    v39 = phi [v38, bb7], [v48, bb14]    ; balls
+    v41 = cmp.gt v39, v40
+    br v41, bb10, bb11
+  bb10:    ; loop.body, line 16, preds bb9
+    print v39
+    v44 = cmp.eq v39, v43
+    br v44, bb12, bb13
+  bb11:    ; loop.exit, line 16, preds bb9
+    ret
+  bb12:    ; then, line 18, preds bb10
+    jmp bb14
+  bb13:    ; else, line 18, preds bb10
+    v47 = add v39, v46    ; balls
+    jmp bb14
+  bb14:    ; join, line 18, preds bb12 bb13
+    v48 = phi [v45, bb12], [v47, bb13]    ; balls
+    jmp bb9
@@ -0,0 +1,17 @@
+function main (1 blocks, 14 values)
+  bb0:    ; entry, line 1
+    v3 = const 2
+    print v3
+    v7 = const 2
+    print v7
+    v11 = const 3
+    print v11
+    v15 = const 4
+    print v15
+    v19 = const 5
+    print v19
+    v23 = const 6
+    print v23
+    v27 = const 7
+    print v27
+    ret
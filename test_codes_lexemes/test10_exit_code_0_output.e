@@ -0,0 +1,128 @@
+Lexeme Token
+let KEYWORD_LET
+a IDENTIFIER
+[ LEFT_BRACKET
+8 INT_LIT
+] RIGHT_BRACKET
+; SEMICOLON
+let KEYWORD_LET
+b IDENTIFIER
+[ LEFT_BRACKET
+8 INT_LIT
+] RIGHT_BRACKET
+; SEMICOLON
+for KEYWORD_FOR
+( LEFT_PAREN
+i IDENTIFIER
+= ASSIGN_OP
+0 INT_LIT
+; SEMICOLON
+i IDENTIFIER
+< LESSER_OP
+8 INT_LIT
+; SEMICOLON
+i IDENTIFIER
+++ INC_OP
+) RIGHT_PAREN
+{ LEFT_CURL
+a IDENTIFIER
+[ LEFT_BRACKET
+i IDENTIFIER
+] RIGHT_BRACKET
+= ASSIGN_OP
+i IDENTIFIER
+* MULT_OP
+3 INT_LIT
+; SEMICOLON
+} RIGHT_CURL
+for KEYWORD_FOR
+( LEFT_PAREN
+i IDENTIFIER
+= ASSIGN_OP
+0 INT_LIT
+; SEMICOLON
+i IDENTIFIER
+< LESSER_OP
+8 INT_LIT
+; SEMICOLON
+i IDENTIFIER
+++ INC_OP
+) RIGHT_PAREN
+{ LEFT_CURL
+b IDENTIFIER
+[ LEFT_BRACKET
+i IDENTIFIER
+] RIGHT_BRACKET
+= ASSIGN_OP
+a IDENTIFIER
+[ LEFT_BRACKET
+i IDENTIFIER
+] RIGHT_BRACKET
++ PLUS_OP
+5 INT_LIT
+- SUB_OP
+i IDENTIFIER
+; SEMICOLON
+} RIGHT_CURL
+a IDENTIFIER
+[ LEFT_BRACKET
+b IDENTIFIER
+[ LEFT_BRACKET
+2 INT_LIT
+] RIGHT_BRACKET
+- SUB_OP
+3 INT_LIT
+] RIGHT_BRACKET
+= ASSIGN_OP
+100 INT_LIT
+; SEMICOLON
+let KEYWORD_LET
+sum IDENTIFIER
+= ASSIGN_OP
+0 INT_LIT
+; SEMICOLON
+for KEYWORD_FOR
+( LEFT_PAREN
+i IDENTIFIER
+= ASSIGN_OP
+0 INT_LIT
+; SEMICOLON
+i IDENTIFIER
+< LESSER_OP
+8 INT_LIT
+; SEMICOLON
+i IDENTIFIER
+++ INC_OP
+) RIGHT_PAREN
+{ LEFT_CURL
+sum IDENTIFIER
+= ASSIGN_OP
+sum IDENTIFIER
++ PLUS_OP
+b IDENTIFIER
+[ LEFT_BRACKET
+i IDENTIFIER
+] RIGHT_BRACKET
+; SEMICOLON
+} RIGHT_CURL
+print KEYWORD_PRINT
+( LEFT_PAREN
+sum IDENTIFIER
+) RIGHT_PAREN
+; SEMICOLON
+print KEYWORD_PRINT
+( LEFT_PAREN
+a IDENTIFIER
+[ LEFT_BRACKET
+6 INT_LIT
+] RIGHT_BRACKET
+) RIGHT_PAREN
+; SEMICOLON
+print KEYWORD_PRINT
+( LEFT_PAREN
+b IDENTIFIER
+[ LEFT_BRACKET
+7 INT_LIT
+] RIGHT_BRACKET
+) RIGHT_PAREN
+; SEMICOLON
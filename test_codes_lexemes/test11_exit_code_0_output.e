@@ -0,0 +1,141 @@
+Lexeme Token
+fn KEYWORD_FN
+sq IDENTIFIER
+( LEFT_PAREN
+x IDENTIFIER
+) RIGHT_PAREN
+{ LEFT_CURL
+return KEYWORD_RETURN
+x IDENTIFIER
+* MULT_OP
+x IDENTIFIER
+; SEMICOLON
+} RIGHT_CURL
+fn KEYWORD_FN
+gcd IDENTIFIER
+( LEFT_PAREN
+a IDENTIFIER
+, COMMA
+b IDENTIFIER
+) RIGHT_PAREN
+{ LEFT_CURL
+while KEYWORD_WHILE
+( LEFT_PAREN
+b IDENTIFIER
+!= NEQUAL_OP
+0 INT_LIT
+) RIGHT_PAREN
+{ LEFT_CURL
+t IDENTIFIER
+= ASSIGN_OP
+b IDENTIFIER
+; SEMICOLON
+b IDENTIFIER
+= ASSIGN_OP
+a IDENTIFIER
+- SUB_OP
+a IDENTIFIER
+/ DIV_OP
+b IDENTIFIER
+* MULT_OP
+b IDENTIFIER
+; SEMICOLON
+a IDENTIFIER
+= ASSIGN_OP
+t IDENTIFIER
+; SEMICOLON
+} RIGHT_CURL
+return KEYWORD_RETURN
+a IDENTIFIER
+; SEMICOLON
+} RIGHT_CURL
+fn KEYWORD_FN
+fib IDENTIFIER
+( LEFT_PAREN
+n IDENTIFIER
+) RIGHT_PAREN
+{ LEFT_CURL
+r IDENTIFIER
+= ASSIGN_OP
+n IDENTIFIER
+; SEMICOLON
+if KEYWORD_IF
+( LEFT_PAREN
+n IDENTIFIER
+> GREATER_OP
+1 INT_LIT
+) RIGHT_PAREN
+{ LEFT_CURL
+r IDENTIFIER
+= ASSIGN_OP
+fib IDENTIFIER
+( LEFT_PAREN
+n IDENTIFIER
+- SUB_OP
+1 INT_LIT
+) RIGHT_PAREN
++ PLUS_OP
+fib IDENTIFIER
+( LEFT_PAREN
+n IDENTIFIER
+- SUB_OP
+2 INT_LIT
+) RIGHT_PAREN
+; SEMICOLON
+} RIGHT_CURL
+return KEYWORD_RETURN
+r IDENTIFIER
+; SEMICOLON
+} RIGHT_CURL
+let KEYWORD_LET
+total IDENTIFIER
+= ASSIGN_OP
+0 INT_LIT
+; SEMICOLON
+for KEYWORD_FOR
+( LEFT_PAREN
+i IDENTIFIER
+= ASSIGN_OP
+1 INT_LIT
+; SEMICOLON
+i IDENTIFIER
+<= LEQUAL_OP
+10 INT_LIT
+; SEMICOLON
+i IDENTIFIER
+++ INC_OP
+) RIGHT_PAREN
+{ LEFT_CURL
+total IDENTIFIER
+= ASSIGN_OP
+total IDENTIFIER
++ PLUS_OP
+sq IDENTIFIER
+( LEFT_PAREN
+i IDENTIFIER
+) RIGHT_PAREN
+; SEMICOLON
+} RIGHT_CURL
+print KEYWORD_PRINT
+( LEFT_PAREN
+total IDENTIFIER
+) RIGHT_PAREN
+; SEMICOLON
+print KEYWORD_PRINT
+( LEFT_PAREN
+gcd IDENTIFIER
+( LEFT_PAREN
+462 INT_LIT
+, COMMA
+1071 INT_LIT
+) RIGHT_PAREN
+) RIGHT_PAREN
+; SEMICOLON
+print KEYWORD_PRINT
+( LEFT_PAREN
+fib IDENTIFIER
+( LEFT_PAREN
+15 INT_LIT
+) RIGHT_PAREN
+) RIGHT_PAREN
+; SEMICOLON
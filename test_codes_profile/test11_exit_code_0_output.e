@@ -0,0 +1,18 @@
+test11_exit_code_0;fn:fib;line 14 1973
+test11_exit_code_0;fn:fib;line 16 6905
+test11_exit_code_0;fn:fib;line 17 5916
+test11_exit_code_0;fn:fib;line 19 1973
+test11_exit_code_0;fn:gcd;line 5 2
+test11_exit_code_0;fn:gcd;line 6 1
+test11_exit_code_0;fn:gcd;line 8 1
+test11_exit_code_0;fn:gcd;while:6;line 6 15
+test11_exit_code_0;fn:gcd;while:6;line 8 12
+test11_exit_code_0;for:23;line 2 10
+test11_exit_code_0;for:23;line 23 43
+test11_exit_code_0;for:23;line 24 10
+test11_exit_code_0;line 16 1
+test11_exit_code_0;line 23 2
+test11_exit_code_0;line 26 1
+test11_exit_code_0;line 27 4
+test11_exit_code_0;line 28 3
+test11_exit_code_0;line 6 1
@@ -0,0 +1 @@
+Error at line 6, column 7: index 4 is out of bounds of array 'a' of 4 elements
@@ -0,0 +1,3 @@
+3
+0
+-1
@@ -0,0 +1,3 @@
+9
+0
+Runtime Error at line 8, column 11: array index out of bounds
@@ -0,0 +1,4 @@
+1
+3
+6
+Runtime Error at line 4, column 5: read() expected an integer
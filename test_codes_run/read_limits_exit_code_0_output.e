@@ -0,0 +1,5 @@
+-9223372036854775808
+9223372036854775807
+-1
+-9223372036854775808
+9223372036854775807
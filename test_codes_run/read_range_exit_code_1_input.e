@@ -0,0 +1,2 @@
+9223372036854775807
+9223372036854775808
@@ -0,0 +1,2 @@
+9223372036854775807
+Runtime Error at line 4, column 1: read() integer out of range
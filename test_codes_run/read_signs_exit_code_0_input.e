@@ -0,0 +1,8 @@
+7
++5
+-7
+  0
+	-0
++0 
+0012
+   -00000000000000000000042
@@ -0,0 +1,15 @@
+0
+1
+5
+2
+-7
+3
+0
+4
+0
+5
+0
+6
+12
+7
+-42
@@ -0,0 +1,4 @@
+5
+3
+4
+5
@@ -0,0 +1,3 @@
+96
+100
+19
@@ -0,0 +1,3 @@
+385
+21
+610
@@ -0,0 +1,7 @@
+2
+2
+3
+4
+5
+6
+7
@@ -0,0 +1 @@
+Error at line 5, column 7: call to undeclared function 'cube'
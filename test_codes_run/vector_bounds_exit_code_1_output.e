@@ -0,0 +1,2 @@
+225
+Runtime Error at line 10, column 12: array index out of bounds
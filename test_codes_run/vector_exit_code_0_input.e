@@ -0,0 +1 @@
+61
@@ -0,0 +1,10 @@
+2809
+-40
+-8
+24
+56
+88
+120
+152
+184
+0
@@ -0,0 +1,2 @@
+10
+Runtime Error at line 3, column 11: division by zero
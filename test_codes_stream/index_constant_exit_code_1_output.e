@@ -0,0 +1,2 @@
+9
+Runtime Error at line 6, column 7: array index out of bounds
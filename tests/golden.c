@@ -0,0 +1,745 @@
+/*
+Golden test runner (make check).
+
+Compiles every test_codes/<name>.e in this process through libeidos and
+compares the result with each golden file it has:
+
+- test_codes_lexemes/<name>_output.e    the token dump of `eidos <name>.e`
+- test_codes_ir/<name>_output.e         --dump-ir
+- test_codes_run/<name>_output.e        what --run prints, reading
+                                        test_codes_run/<name>_input.e if present,
+                                        then the runtime error if there is one
+- test_codes_profile/<name>_output.e    --profile-folded of a run with no input
+
+A run check also runs its program on the scheduler (driver/sched.h), fed
+its input a line at a time. Every time the program waits in read(), it must
+have printed what eidos_run prints when the input ends right there, which
+is everything it printed before that read, and in the end the golden.
+
+A test named <name>_exit_code_N must exit with N when run: 0 if it runs to
+its end, 1 on a compile or runtime error, whose diagnostic ends its run
+golden. A test that should exit with 0 also fails any check it doesn't
+compile for; an error test's ir golden is its compile error, if it has one.
+
+With --emit-c=EIDOS the checks are of the generated C instead: for every
+run golden, the EIDOS binary translates the test with --emit-c, once as is
+(partial evaluation, vector kernels, a label per jump target), once with
+--no-pe, once with --stream and once with --parallel-loops on every loop.
+--cc=CC (default cc) compiles each result with -Werror, and the program runs
+on the run input. What it prints, then its runtime error, and its exit
+status must be those of the run golden. --stream doesn't fold, so an error
+that folding finds at compile time is a runtime error there instead:
+test_codes_stream/<name>_output.e, if a test has one, replaces the run golden
+of its --stream check. These checks run once and have no budget.
+
+Trailing newlines don't count, as in test_lexer.sh. The checks run in
+parallel, one context per thread, each `--repeat` times; a check's time is
+its fastest run and its allocations are the blocks its context handed out.
+
+tests/budgets.txt holds a time and allocation budget per check. A check
+over either fails like a wrong output, so a change that makes the compiler
+slower or hungrier on the corpus shows up as a failing test. --write-budgets
+rewrites the file from this run with headroom for noise. Checks without a
+budget only compare output.
+
+usage: golden [--jobs=N] [--repeat=N] [--budgets=FILE] [--write-budgets] [ROOT]
+       golden --emit-c=EIDOS [--cc=CC] [--jobs=N] [ROOT]
+*/
+
+#include "../src/lib/eidos.h"
+#include "../src/driver/sched.h"
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef enum CheckKind {
+    CHECK_TOKENS,
+    CHECK_IR,
+    CHECK_RUN,
+    CHECK_PROFILE,
+    CHECK_C,                    // --emit-c checks, against the run golden
+    CHECK_C_NO_PE,
+    CHECK_C_STREAM,
+    CHECK_C_PARALLEL,
+    CHECK_KIND_COUNT,
+} CheckKind;
+
+static const char *kind_names[CHECK_KIND_COUNT] = { "tokens", "ir", "run", "profile", "c", "c-nope",
+                                                     "c-stream", "c-par" };
+static const char *golden_dirs[CHECK_KIND_COUNT] = { "test_codes_lexemes", "test_codes_ir", "test_codes_run",
+                                                      "test_codes_profile", "test_codes_run", "test_codes_run",
+                                                      "test_codes_stream", "test_codes_run" };
+static const char *c_flags[CHECK_KIND_COUNT] = {
+    [CHECK_C] = "",
+    [CHECK_C_NO_PE] = "--no-pe",
+    [CHECK_C_STREAM] = "--stream",
+    [CHECK_C_PARALLEL] = "--parallel-loops --parallel-min-trips=1",
+};
+
+typedef struct Check {
+    char *test;                 // test_codes/<test>.e
+    CheckKind kind;
+    char *source;
+    size_t source_len;
+    char *golden;
+    size_t golden_len;
+    char *input;                // read() input of a run check, NULL for none
+    size_t input_len;
+    int exit_code;              // N of a test named <name>_exit_code_N, -1 if it has none
+
+    char *input_path;           // ... and its file, for the generated C
+    int has_budget;
+    double budget_millis;
+    size_t budget_allocations;
+
+    // filled in by the workers
+    double millis;
+    size_t allocations;
+    size_t diff_line;           // first line that differs from the golden, 0 if none
+    int status;                 // 0 if it compiled (and ran), 1 if not, as the eidos exit status
+    size_t sched_diff_line;     // ... on the scheduler
+    int sched_status;
+    size_t unflushed;           // input lines fed when the program waited in read() without
+                                // having printed everything before it, 0 if it always had
+    int cc_failed;              // the generated C didn't compile
+    int failed;
+} Check;
+
+static Check *checks;
+static size_t nchecks;
+static size_t repeat = 5;
+static atomic_size_t next_check;
+static const char *root = ".";
+static const char *c_eidos;     // eidos binary of --emit-c, NULL to check the library
+static const char *c_compiler = "cc";
+static char c_dir[] = "/tmp/eidos-golden-XXXXXX";
+
+/* ===== Helper Functions ===== */
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+static char *read_all(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    char *buf = malloc((size_t)size + 1);
+    if (!buf || fread(buf, 1, (size_t)size, f) != (size_t)size) {
+        fprintf(stderr, "Error: Could not read '%s'\n", path);
+        exit(1);
+    }
+    buf[size] = '\0';
+    fclose(f);
+    *len = (size_t)size;
+    return buf;
+}
+
+static size_t trim_newlines(const char *s, size_t len) {
+    while (len && (s[len - 1] == '\n' || s[len - 1] == '\r')) {
+        len--;
+    }
+    return len;
+}
+
+/*
+Compares an output with a golden, ignoring trailing newlines
+
+returns:
+    (size_t) -> 1-based line of the first difference, 0 if they match
+*/
+static size_t first_difference(const char *got, size_t got_len, const char *want, size_t want_len) {
+    got_len = trim_newlines(got, got_len);
+    want_len = trim_newlines(want, want_len);
+
+    size_t line = 1;
+    for (size_t i = 0;; i++) {
+        if (i == got_len || i == want_len) {
+            return got_len == want_len ? 0 : line;
+        }
+        if (got[i] != want[i]) {
+            return line;
+        }
+        line += got[i] == '\n';
+    }
+}
+
+static int by_name(const void *a, const void *b) {
+    const Check *x = a, *y = b;
+    int c = strcmp(x->test, y->test);
+    return c ? c : (int)x->kind - (int)y->kind;
+}
+
+static int is_c(CheckKind kind) {
+    return kind >= CHECK_C;
+}
+
+static void add_check(const char *test, CheckKind kind) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s/%s_output.e", root, golden_dirs[kind], test);
+    size_t golden_len;
+    char *golden = read_all(path, &golden_len);
+    if (!golden && kind == CHECK_C_STREAM) {
+        snprintf(path, sizeof(path), "%s/%s/%s_output.e", root, golden_dirs[CHECK_RUN], test);
+        golden = read_all(path, &golden_len);
+    }
+    if (!golden) {
+        return;
+    }
+
+    Check *c = &checks[nchecks++];
+    memset(c, 0, sizeof(Check));
+    c->test = strdup(test);
+    c->kind = kind;
+    c->golden = golden;
+    c->golden_len = golden_len;
+
+    const char *suffix = strstr(test, "_exit_code_");
+    c->exit_code = suffix ? atoi(suffix + strlen("_exit_code_")) : -1;
+
+    snprintf(path, sizeof(path), "%s/test_codes/%s.e", root, test);
+    c->source = read_all(path, &c->source_len);
+    if (kind == CHECK_RUN || is_c(kind)) {
+        snprintf(path, sizeof(path), "%s/%s/%s_input.e", root, golden_dirs[CHECK_RUN], test);
+        c->input = read_all(path, &c->input_len);
+        c->input_path = c->input ? strdup(path) : NULL;
+    }
+}
+
+/*
+Finds every test and golden under root
+
+returns:
+    (int) -> 0, -1 if there is no test_codes directory
+*/
+static int collect_checks(void) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/test_codes", root);
+    DIR *dir = opendir(path);
+    if (!dir) {
+        fprintf(stderr, "ERROR: No test_codes directory in '%s'.\n", root);
+        return -1;
+    }
+
+    size_t cap = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        size_t len = strlen(entry->d_name);
+        if (len < 3 || strcmp(entry->d_name + len - 2, ".e") != 0) {
+            continue;
+        }
+        if (nchecks + CHECK_KIND_COUNT > cap) {
+            cap = (cap + CHECK_KIND_COUNT) * 2;
+            checks = realloc(checks, cap * sizeof(Check));
+            if (!checks) {
+                fprintf(stderr, "Error: Failed to allocate checks\n");
+                exit(1);
+            }
+        }
+
+        char test[1024];
+        snprintf(test, sizeof(test), "%.*s", (int)(len - 2), entry->d_name);
+        for (int k = 0; k < CHECK_KIND_COUNT; k++) {
+            // the --emit-c mode checks the generated C and nothing else
+            if (is_c((CheckKind)k) == (c_eidos != NULL)) {
+                add_check(test, (CheckKind)k);
+            }
+        }
+    }
+    closedir(dir);
+
+    qsort(checks, nchecks, sizeof(Check), by_name);
+    return 0;
+}
+
+static void load_budgets(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return;
+    }
+
+    char line[1200];
+    while (fgets(line, sizeof(line), f)) {
+        char test[1024], kind[32];
+        double millis;
+        size_t allocations;
+        if (line[0] == '#' || sscanf(line, "%1023s %31s %lf %zu", test, kind, &millis, &allocations) != 4) {
+            continue;
+        }
+        for (size_t i = 0; i < nchecks; i++) {
+            if (strcmp(checks[i].test, test) == 0 && strcmp(kind_names[checks[i].kind], kind) == 0) {
+                checks[i].has_budget = 1;
+                checks[i].budget_millis = millis;
+                checks[i].budget_allocations = allocations;
+            }
+        }
+    }
+    fclose(f);
+}
+
+/*
+Budgets from this run: generous on time, which varies with the machine and
+its load, tight on allocations, which don't vary at all
+
+returns:
+    (int) -> 0, -1 if the file can't be written
+*/
+static int write_budgets(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "ERROR: Could not write '%s'.\n", path);
+        return -1;
+    }
+
+    fprintf(f, "# budgets of the golden tests (make check), rewritten by golden --write-budgets\n");
+    fprintf(f, "# test check max_ms max_allocations\n");
+    for (size_t i = 0; i < nchecks; i++) {
+        const Check *c = &checks[i];
+        double millis = c->millis * 4 < 1.0 ? 1.0 : c->millis * 4;
+        fprintf(f, "%s %s %.3f %zu\n", c->test, kind_names[c->kind], millis,
+                c->allocations + c->allocations / 10 + 8);
+    }
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+/*
+Compares what a run printed, and its runtime error if it failed, with the golden
+
+returns:
+    (size_t) -> first line differing from the golden, 0 if they match
+*/
+static size_t compare_run(const char *out, size_t len, const char *error, const Check *c) {
+    size_t error_len = strlen(error);
+    char *both = malloc(len + error_len + 1);
+    if (!both) {
+        return 1;
+    }
+    memcpy(both, out, len);
+    memcpy(both + len, error, error_len);
+    size_t diff = first_difference(both, len + error_len, c->golden, c->golden_len);
+    free(both);
+    return diff;
+}
+
+/*
+Compiles the check's program to an image
+
+returns:
+    (char*) -> malloc'd image, NULL with *len set to 0 if it doesn't compile
+*/
+static char *compile_image(EidosContext *ctx, const Check *c, size_t *len) {
+    EidosOptions options;
+    eidos_default_options(&options);
+    options.name = c->test;
+    options.target = EIDOS_TARGET_IMAGE;
+    *len = 0;
+    if (eidos_compile(ctx, c->source, c->source_len, &options) != EIDOS_OK) {
+        return NULL;
+    }
+    const char *out = eidos_output(ctx, len);
+    char *image = malloc(*len ? *len : 1);
+    if (image) {
+        memcpy(image, out, *len);
+    }
+    return image;
+}
+
+/*
+Compiles, and for a run check runs, the check's program once
+
+args:
+    *ctx (EidosContext) -> the worker's context
+    *c (Check) -> check to run
+    *status (int) -> set to 0 if it compiled (and ran), 1 if not
+
+returns:
+    (size_t) -> first line differing from the golden, 0 if the output matches
+*/
+static size_t run_once(EidosContext *ctx, const Check *c, int *status_out) {
+    EidosOptions options;
+    eidos_default_options(&options);
+    options.name = c->test;
+    options.target = c->kind == CHECK_TOKENS ? EIDOS_TARGET_TOKENS
+                   : c->kind == CHECK_IR ? EIDOS_TARGET_IR
+                   : c->kind == CHECK_PROFILE ? EIDOS_TARGET_PROFILE
+                   : EIDOS_TARGET_IMAGE;
+
+    EidosStatus status = eidos_compile(ctx, c->source, c->source_len, &options);
+    size_t len = 0;
+    const char *out = eidos_output(ctx, &len);
+
+    if (c->kind == CHECK_RUN && status == EIDOS_OK) {
+        // eidos_run replaces the output, so the image has to be copied out first
+        char *image = malloc(len);
+        if (!image) {
+            *status_out = 1;
+            return 1;
+        }
+        memcpy(image, out, len);
+        status = eidos_run(ctx, image, len, c->input ? c->input : "", c->input_len, 0);
+        free(image);
+        *status_out = status != EIDOS_OK;
+        out = eidos_output(ctx, &len);
+        return compare_run(out, len, status == EIDOS_OK ? "" : eidos_diagnostics(ctx), c);
+    }
+    *status_out = status != EIDOS_OK;
+    if (status != EIDOS_OK) {
+        // the diagnostics are the output of a program that doesn't compile
+        out = eidos_diagnostics(ctx);
+        len = strlen(out);
+    }
+    return first_difference(out, len, c->golden, c->golden_len);
+}
+
+// waits until the scheduler's only task has finished or waits for input
+static void settle(Sched *s) {
+    for (;;) {
+        SchedStats stats;
+        sched_stats(s, &stats);
+        if (stats.live == 0 || stats.blocked == stats.live) {
+            return;
+        }
+        struct timespec pause = { 0, 20000 };
+        nanosleep(&pause, NULL);
+    }
+}
+
+/*
+Runs a run check's program on the scheduler, fed a line of input at a time,
+filling in c->unflushed, c->sched_diff_line and c->sched_status
+
+args:
+    *ctx (EidosContext) -> the worker's context, for eidos_run on the input so far
+    *s (Sched) -> the worker's scheduler, with nothing on it
+    *c (Check) -> run check
+*/
+static void run_scheduled(EidosContext *ctx, Sched *s, Check *c) {
+    size_t len;
+    char *image = compile_image(ctx, c, &len);
+    if (!image) {
+        c->sched_status = 1;
+        return;     // run_once compared the diagnostics already
+    }
+
+    const char *input = c->input ? c->input : "";
+    SchedTask *task = sched_spawn(s, image, len, "", 0, 0, NULL, NULL);
+    if (!task) {
+        c->sched_diff_line = 1;
+        free(image);
+        return;
+    }
+
+    size_t fed = 0, lines = 0;
+    for (;;) {
+        settle(s);
+        SchedStats stats;
+        sched_stats(s, &stats);
+        if (stats.live == 0) {
+            break;
+        }
+
+        // waiting in read(): all it printed so far must be out, as if the input ended here
+        size_t want_len = 0;
+        eidos_run(ctx, image, len, input, fed, 0);
+        const char *want = eidos_output(ctx, &want_len);
+        if (!c->unflushed && (task->output_len != want_len || memcmp(task->output, want, want_len) != 0)) {
+            c->unflushed = lines ? lines : 1;
+        }
+        if (fed == c->input_len) {
+            break;
+        }
+
+        const char *end = memchr(input + fed, '\n', c->input_len - fed);
+        size_t line_len = end ? (size_t)(end - (input + fed)) + 1 : c->input_len - fed;
+        sched_feed(s, task, input + fed, line_len);
+        fed += line_len;
+        lines++;
+    }
+    sched_close_input(s, task);
+    sched_wait(s);
+
+    c->sched_status = task->result != SCHED_DONE;
+    c->sched_diff_line = compare_run(task->output ? task->output : "", task->output_len,
+                                     task->result == SCHED_DONE ? "" : task->vm.error, c);
+    sched_task_free(task);
+    free(image);
+}
+
+// exit status of a command run by system(), -1 if it didn't exit
+static int exit_status(int status) {
+    return status != -1 && WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+/*
+Checks the C the eidos binary generates for a run check: translates it with
+the check's flags, compiles it with -Werror and runs it on the run input,
+filling in c->diff_line, c->status and c->cc_failed
+
+args:
+    *c (Check) -> C check
+    index (size_t) -> its index, naming its files in c_dir
+*/
+static void run_c(Check *c, size_t index) {
+    char base[256], cmd[8192];
+    snprintf(base, sizeof(base), "%s/%zu", c_dir, index);
+
+    snprintf(cmd, sizeof(cmd), "'%s' --emit-c %s '%s/test_codes/%s.e' -o '%s.c' 2> '%s.err'", c_eidos,
+             c_flags[c->kind], root, c->test, base, base);
+    c->status = exit_status(system(cmd));
+
+    char path[300];
+    size_t out_len = 0, err_len = 0;
+    char *out = NULL;
+    if (c->status == 0) {
+        snprintf(cmd, sizeof(cmd), "%s -Werror -pthread '%s.c' -o '%s' 2> '%s.cc'", c_compiler, base, base, base);
+        if (exit_status(system(cmd)) != 0) {
+            c->cc_failed = 1;
+            return;
+        }
+        // more threads than the machine may have, so chunks really run concurrently
+        snprintf(cmd, sizeof(cmd), "EIDOS_THREADS=4 '%s' < '%s' > '%s.out' 2> '%s.err'", base,
+                 c->input_path ? c->input_path : "/dev/null", base, base);
+        c->status = exit_status(system(cmd));
+        snprintf(path, sizeof(path), "%s.out", base);
+        out = read_all(path, &out_len);
+    }
+
+    // a program that doesn't translate prints its diagnostics instead, as in run_once
+    snprintf(path, sizeof(path), "%s.err", base);
+    char *err = read_all(path, &err_len);
+    c->diff_line = compare_run(out ? out : "", out_len, err ? err : "", c);
+    free(out);
+    free(err);
+}
+
+// 1 if the check's exit status is the one its test's name asks for
+static int exits_as_named(const Check *c) {
+    if (c->exit_code < 0) {
+        return 1;
+    }
+    if (is_c(c->kind)) {
+        return c->status == c->exit_code;
+    }
+    if (c->kind == CHECK_RUN) {
+        return c->status == c->exit_code && c->sched_status == c->exit_code;
+    }
+    return c->exit_code != 0 || c->status == 0;
+}
+
+static void *work(void *arg) {
+    (void)arg;
+    EidosContext *ctx = eidos_context_new(NULL);
+    SchedOptions sched_options = { 1, SCHED_SLICE, 0, 0, NULL };
+    Sched *s = sched_start(&sched_options);
+    if (!ctx || !s) {
+        fprintf(stderr, "Error: Failed to start a worker\n");
+        exit(1);
+    }
+
+    for (;;) {
+        size_t i = atomic_fetch_add(&next_check, 1);
+        if (i >= nchecks) {
+            break;
+        }
+
+        Check *c = &checks[i];
+        if (is_c(c->kind)) {
+            double start = now_ms();
+            run_c(c, i);
+            c->millis = now_ms() - start;
+            c->failed = c->diff_line != 0 || c->cc_failed || !exits_as_named(c);
+            continue;
+        }
+
+        c->millis = -1;
+        for (size_t r = 0; r < repeat; r++) {
+            size_t before, after;
+            eidos_memory_stats(ctx, NULL, NULL, &before);
+            double start = now_ms();
+            int status;
+            size_t diff = run_once(ctx, c, &status);
+            double millis = now_ms() - start;
+            eidos_memory_stats(ctx, NULL, NULL, &after);
+
+            if (r == 0) {
+                c->diff_line = diff;
+                c->status = status;
+                c->allocations = after - before;
+            }
+            if (c->millis < 0 || millis < c->millis) {
+                c->millis = millis;
+            }
+        }
+
+        if (c->kind == CHECK_RUN) {
+            run_scheduled(ctx, s, c);
+        }
+
+        c->failed = c->diff_line != 0 || c->sched_diff_line != 0 || c->unflushed != 0 || !exits_as_named(c) ||
+                    (c->has_budget && (c->millis > c->budget_millis || c->allocations > c->budget_allocations));
+    }
+
+    sched_stop(s);
+    eidos_context_free(ctx);
+    return NULL;
+}
+
+static int parse_count(const char *arg, const char *name, size_t *value) {
+    size_t len = strlen(name);
+    if (strncmp(arg, name, len) != 0) {
+        return 0;
+    }
+    char *end;
+    *value = strtoul(arg + len, &end, 10);
+    if (*value == 0 || *end != '\0') {
+        fprintf(stderr, "ERROR: Bad value in '%s'.\n", arg);
+        exit(2);
+    }
+    return 1;
+}
+
+
+int main(int argc, char *argv[]) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t jobs = cpus > 0 ? (size_t)cpus : 1;
+    const char *budgets = NULL;
+    int rewrite = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (parse_count(argv[i], "--jobs=", &jobs) || parse_count(argv[i], "--repeat=", &repeat)) {
+            continue;
+        } else if (strncmp(argv[i], "--budgets=", 10) == 0) {
+            budgets = argv[i] + 10;
+        } else if (strcmp(argv[i], "--write-budgets") == 0) {
+            rewrite = 1;
+        } else if (strncmp(argv[i], "--emit-c=", 9) == 0) {
+            c_eidos = argv[i] + 9;
+        } else if (strncmp(argv[i], "--cc=", 5) == 0) {
+            c_compiler = argv[i] + 5;
+        } else if (argv[i][0] != '-') {
+            root = argv[i];
+        } else {
+            fprintf(stderr, "usage: golden [--jobs=N] [--repeat=N] [--budgets=FILE] [--write-budgets] [ROOT]\n"
+                            "       golden --emit-c=EIDOS [--cc=CC] [--jobs=N] [ROOT]\n");
+            return 2;
+        }
+    }
+    if (c_eidos && rewrite) {
+        fprintf(stderr, "ERROR: The --emit-c checks have no budgets to write.\n");
+        return 2;
+    }
+    if (c_eidos && !mkdtemp(c_dir)) {
+        fprintf(stderr, "ERROR: Could not create '%s'.\n", c_dir);
+        return 2;
+    }
+
+    char budgets_path[4096];
+    if (!budgets) {
+        snprintf(budgets_path, sizeof(budgets_path), "%s/tests/budgets.txt", root);
+        budgets = budgets_path;
+    }
+
+    if (collect_checks() != 0) {
+        return 2;
+    }
+    if (!rewrite && !c_eidos) {
+        load_budgets(budgets);
+    }
+
+    if (jobs > nchecks) {
+        jobs = nchecks ? nchecks : 1;
+    }
+    pthread_t *threads = malloc(jobs * sizeof(pthread_t));
+    if (!threads) {
+        fprintf(stderr, "Error: Failed to allocate threads\n");
+        return 1;
+    }
+
+    double start = now_ms();
+    for (size_t k = 0; k < jobs; k++) {
+        pthread_create(&threads[k], NULL, work, NULL);
+    }
+    for (size_t k = 0; k < jobs; k++) {
+        pthread_join(threads[k], NULL);
+    }
+    double elapsed = now_ms() - start;
+    free(threads);
+
+    size_t failed = 0;
+    for (size_t i = 0; i < nchecks; i++) {
+        const Check *c = &checks[i];
+        failed += c->failed;
+        printf("%s %-28s %-8s %9.3f ms %9zu allocs", c->failed ? "✗" : "✓", c->test, kind_names[c->kind],
+               c->millis, c->allocations);
+        if (c->diff_line) {
+            printf("  output differs at line %zu", c->diff_line);
+        }
+        if (c->cc_failed) {
+            printf("  generated C doesn't compile with %s -Werror, see %s/%zu.cc", c_compiler, c_dir, i);
+        } else if (!exits_as_named(c) && is_c(c->kind)) {
+            printf("  exited with %d, not %d", c->status, c->exit_code);
+        } else if (!exits_as_named(c) && c->kind == CHECK_RUN) {
+            printf("  exited with %d (%d on the scheduler), not %d", c->status, c->sched_status, c->exit_code);
+        } else if (!exits_as_named(c)) {
+            printf("  doesn't compile");
+        }
+        if (c->sched_diff_line) {
+            printf("  output on the scheduler differs at line %zu", c->sched_diff_line);
+        }
+        if (c->unflushed) {
+            printf("  output missing when read() waited after %zu input lines", c->unflushed);
+        }
+        if (c->has_budget && c->millis > c->budget_millis) {
+            printf("  over its %.3f ms budget", c->budget_millis);
+        }
+        if (c->has_budget && c->allocations > c->budget_allocations) {
+            printf("  over its %zu allocation budget", c->budget_allocations);
+        }
+        printf("\n");
+    }
+
+    printf("\nResults: %zu passed, %zu failed (%zu threads, %.1f ms)\n", nchecks - failed, failed, jobs, elapsed);
+
+    int status = failed ? 1 : 0;
+    if (rewrite) {
+        if (write_budgets(budgets) != 0) {
+            status = 1;
+        } else {
+            printf("Budgets written to %s\n", budgets);
+        }
+    }
+
+    if (c_eidos && !failed) {
+        // the files of a failed check stay for a look at what went wrong
+        char cmd[256];
+        snprintf(cmd, sizeof(cmd), "rm -rf '%s'", c_dir);
+        if (system(cmd) != 0) {
+            fprintf(stderr, "Warning: Could not remove '%s'\n", c_dir);
+        }
+    } else if (c_eidos) {
+        printf("Generated C and outputs kept in %s\n", c_dir);
+    }
+
+    for (size_t i = 0; i < nchecks; i++) {
+        free(checks[i].test);
+        free(checks[i].source);
+        free(checks[i].golden);
+        free(checks[i].input);
+        free(checks[i].input_path);
+    }
+    free(checks);
+    return status;
+}
@@ -0,0 +1,290 @@
+/*
+Stress test for libeidos (make stress).
+
+Generates a few thousand programs, some of them with parse, semantic or
+constant-division errors, and compiles each once on the main thread to get the
+expected status and output. Then compiles all of them again on many threads,
+one context per thread, rotating through the targets, and checks that:
+
+- every result matches the single-threaded one byte for byte
+- each context's allocator gets back every byte it handed out
+- running out of memory part way through returns EIDOS_NO_MEMORY instead of
+  exiting, and still leaks nothing
+
+usage: lib_stress [threads] [programs]
+*/
+
+#include "../src/lib/eidos.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct Expected {
+    EidosStatus status;
+    uint64_t output_hash;
+    uint64_t diag_hash;
+} Expected;
+
+// allocator that counts what is outstanding, and can fail on purpose
+typedef struct Counter {
+    size_t outstanding;
+    size_t allocations;
+    size_t fail_after;      // 0 never fails
+} Counter;
+
+typedef struct Worker {
+    pthread_t thread;
+    size_t failures;
+    size_t leaks;
+    size_t compiled;
+} Worker;
+
+static char **programs;
+static Expected *expected[3];
+static size_t nprograms;
+static atomic_size_t next_program;
+
+static const EidosTarget targets[3] = { EIDOS_TARGET_C, EIDOS_TARGET_IMAGE, EIDOS_TARGET_IR };
+
+/* ===== Helper Functions ===== */
+
+static void *counting_alloc(void *user, size_t size) {
+    Counter *c = user;
+    if (c->fail_after && c->allocations >= c->fail_after) {
+        return NULL;
+    }
+    c->allocations++;
+    c->outstanding += size;
+    return malloc(size);
+}
+
+static void counting_release(void *user, void *ptr, size_t size) {
+    Counter *c = user;
+    c->outstanding -= size;
+    free(ptr);
+}
+
+static uint64_t hash_bytes(const char *s, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)s[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static uint32_t next_random(uint32_t *state) {
+    *state = *state * 1664525u + 1013904223u;
+    return *state >> 8;
+}
+
+static void append(char **buf, size_t *len, size_t *cap, const char *text) {
+    size_t n = strlen(text);
+    if (*len + n + 1 > *cap) {
+        *cap = (*len + n + 1) * 2;
+        *buf = realloc(*buf, *cap);
+        if (!*buf) {
+            fprintf(stderr, "Error: Failed to allocate program\n");
+            exit(1);
+        }
+    }
+    memcpy(*buf + *len, text, n + 1);
+    *len += n;
+}
+
+/*
+Program number `seed`: straight-line code, loops and branches over a handful
+of variables; every 7th has a syntax error, every 11th an undeclared
+variable and every 13th a division by constant zero
+*/
+static char *generate(uint32_t seed) {
+    uint32_t r = seed * 2654435761u + 1;
+    char *buf = NULL;
+    size_t len = 0, cap = 0;
+    char line[160];
+
+    int nvars = 1 + (int)(next_random(&r) % 5);
+    for (int v = 0; v < nvars; v++) {
+        snprintf(line, sizeof(line), "let v%d = %u;\n", v, next_random(&r) % 100);
+        append(&buf, &len, &cap, line);
+    }
+
+    int nstmts = 3 + (int)(next_random(&r) % 30);
+    for (int s = 0; s < nstmts; s++) {
+        int a = (int)(next_random(&r) % nvars), b = (int)(next_random(&r) % nvars);
+        switch (next_random(&r) % 6) {
+        case 0:
+            snprintf(line, sizeof(line), "v%d = v%d * %u + v%d;\n", a, b, next_random(&r) % 9, a);
+            break;
+        case 1:
+            snprintf(line, sizeof(line), "print(v%d - v%d * 3);\n", a, b);
+            break;
+        case 2:
+            snprintf(line, sizeof(line), "if (v%d < v%d) { v%d = v%d + 1; } else { print(v%d); }\n",
+                     a, b, a, a, b);
+            break;
+        case 3:
+            snprintf(line, sizeof(line), "for (i%d = 0; i%d < %u; i%d++) { v%d = v%d + i%d * 2; }\n",
+                     s, s, next_random(&r) % 40, s, a, a, s);
+            break;
+        case 4:
+            snprintf(line, sizeof(line), "read(v%d);\nprint(v%d / (v%d + 1));\n", a, b, a);
+            break;
+        default:
+            snprintf(line, sizeof(line), "while (v%d > 0) { v%d--; print(v%d); }\n", a, a, b);
+            break;
+        }
+        append(&buf, &len, &cap, line);
+    }
+
+    if (seed % 7 == 3) {
+        append(&buf, &len, &cap, "let broken = 1\nprint(broken);\n");
+    } else if (seed % 11 == 5) {
+        append(&buf, &len, &cap, "print(nowhere);\n");
+    } else if (seed % 13 == 6) {
+        append(&buf, &len, &cap, "print(v0 / 0);\n");
+    }
+    return buf;
+}
+
+static Expected compile_one(EidosContext *ctx, size_t i, EidosTarget target) {
+    EidosOptions options;
+    eidos_default_options(&options);
+    options.target = target;
+    options.name = "stress.e";
+
+    Expected e;
+    size_t len = 0;
+    e.status = eidos_compile(ctx, programs[i], strlen(programs[i]), &options);
+    const char *out = eidos_output(ctx, &len);
+    e.output_hash = out ? hash_bytes(out, len) : 0;
+    const char *diag = eidos_diagnostics(ctx);
+    e.diag_hash = hash_bytes(diag, strlen(diag));
+    return e;
+}
+
+static void *work(void *arg) {
+    Worker *w = arg;
+    Counter counter = {0};
+    EidosAllocator allocator = { counting_alloc, counting_release, &counter };
+    EidosContext *ctx = eidos_context_new(&allocator);
+
+    for (;;) {
+        size_t i = atomic_fetch_add(&next_program, 1);
+        if (i >= nprograms) {
+            break;
+        }
+        int t = (int)(i % 3);
+        Expected got = compile_one(ctx, i, targets[t]);
+        const Expected *want = &expected[t][i];
+        if (got.status != want->status || got.output_hash != want->output_hash ||
+            got.diag_hash != want->diag_hash) {
+            w->failures++;
+        }
+        w->compiled++;
+    }
+
+    eidos_context_free(ctx);
+    w->leaks += counter.outstanding;
+    return NULL;
+}
+
+/*
+Compiles a program with an allocator that fails after n allocations, for
+every n until the compilation gets through
+
+returns:
+    (int) -> number of failures (wrong status or leaked bytes)
+*/
+static int out_of_memory_sweep(size_t i) {
+    int failures = 0;
+    for (size_t n = 1;; n++) {
+        Counter counter = { 0, 0, n };
+        EidosAllocator allocator = { counting_alloc, counting_release, &counter };
+        EidosContext *ctx = eidos_context_new(&allocator);
+        if (!ctx) {
+            continue;
+        }
+
+        Expected got = compile_one(ctx, i, EIDOS_TARGET_C);
+        eidos_context_free(ctx);
+
+        if (counter.outstanding) {
+            failures++;
+        }
+        if (got.status != EIDOS_NO_MEMORY) {
+            if (got.status != expected[0][i].status || got.output_hash != expected[0][i].output_hash) {
+                failures++;
+            }
+            return failures;
+        }
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+    size_t nthreads = argc > 1 ? strtoul(argv[1], NULL, 10) : 8;
+    nprograms = argc > 2 ? strtoul(argv[2], NULL, 10) : 3000;
+    if (nthreads == 0 || nprograms == 0) {
+        fprintf(stderr, "usage: lib_stress [threads] [programs]\n");
+        return 2;
+    }
+
+    programs = malloc(nprograms * sizeof(char*));
+    for (int t = 0; t < 3; t++) {
+        expected[t] = malloc(nprograms * sizeof(Expected));
+    }
+    Worker *workers = calloc(nthreads, sizeof(Worker));
+    if (!programs || !expected[0] || !expected[1] || !expected[2] || !workers) {
+        fprintf(stderr, "Error: Failed to allocate test state\n");
+        return 1;
+    }
+
+    // single-threaded reference, one reused context
+    size_t errors = 0;
+    EidosContext *ctx = eidos_context_new(NULL);
+    for (size_t i = 0; i < nprograms; i++) {
+        programs[i] = generate((uint32_t)i);
+        for (int t = 0; t < 3; t++) {
+            expected[t][i] = compile_one(ctx, i, targets[t]);
+        }
+        errors += expected[0][i].status != EIDOS_OK;
+    }
+    eidos_context_free(ctx);
+
+    for (size_t k = 0; k < nthreads; k++) {
+        pthread_create(&workers[k].thread, NULL, work, &workers[k]);
+    }
+    size_t failures = 0, leaks = 0, compiled = 0;
+    for (size_t k = 0; k < nthreads; k++) {
+        pthread_join(workers[k].thread, NULL);
+        failures += workers[k].failures;
+        leaks += workers[k].leaks;
+        compiled += workers[k].compiled;
+    }
+
+    int oom_failures = 0;
+    for (size_t i = 0; i < nprograms && i < 24; i++) {
+        oom_failures += out_of_memory_sweep(i);
+    }
+
+    printf("lib_stress: %zu programs (%zu with errors), %zu threads, %zu compiled\n",
+           nprograms, errors, nthreads, compiled);
+    printf("lib_stress: %zu mismatches, %zu bytes leaked, %d out-of-memory failures\n",
+           failures, leaks, oom_failures);
+
+    for (size_t i = 0; i < nprograms; i++) {
+        free(programs[i]);
+    }
+    free(programs);
+    for (int t = 0; t < 3; t++) {
+        free(expected[t]);
+    }
+    free(workers);
+
+    int ok = failures == 0 && leaks == 0 && oom_failures == 0 && compiled == nprograms;
+    printf("lib_stress: %s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}